@@ -42,6 +42,12 @@
     Optionally provide the following defines with your own implementations:
         PHYSFS_DECL     - public function declaration prefix (default: extern)
 
+    Instrumentation is disabled by default, you can enable it by defining to 1:
+        PHYSFS_SUPPORTS_STATS   - i/o statistics counters (see PHYSFS_getIoStats)
+        PHYSFS_SUPPORTS_TRACE   - operation tracing hooks (see PHYSFS_setTraceCallbacks)
+        PHYSFS_SUPPORTS_LOCK_PROFILE - lock contention profile (see PHYSFS_getLockProfile)
+        PHYSFS_SUPPORTS_MEMORY_STATS - memory use by archive and category (see PHYSFS_getMemoryStats)
+
 
     LICENSE
         Same license as PhysFS, see end of file.
@@ -182,6 +188,25 @@
  *  file from two threads at the same time. Other race conditions are bugs
  *  that should be reported/patched.
  *
+ * Distinct PHYSFS_File handles don't need locks, though: any number of
+ *  threads can PHYSFS_readBytes(), PHYSFS_seek() and PHYSFS_tell() their own
+ *  handles at once, even handles to the same file in the same archive, and
+ *  they never wait on each other. Each handle owns everything its reads
+ *  change (its own OS file handle, decompression state and buffer), and the
+ *  archive data it shares with other handles is only read. With
+ *  PHYSFS_SUPPORTS_STATS enabled, reads also bump shared atomic counters.
+ *
+ * PHYSFS_openRead(), PHYSFS_stat() and PHYSFS_exists() don't wait on each
+ *  other or on mounts, either: they look through a snapshot of the search
+ *  path, which PHYSFS_mount(), PHYSFS_unmount() and PHYSFS_setRoot() replace
+ *  instead of changing it, and an archive taken out of the search path is
+ *  only closed once no lookup is still using it. Directories, .zip files and
+ *  the simpler archive types are searched on any number of threads at once
+ *  (if they were mounted from a PHYSFS_Io, it needs readAt()); other archives
+ *  are still searched one thread at a time. Adding an opened file to the
+ *  list of open files, closing files, enumerating, writing and the content
+ *  cache still go through the library-wide lock.
+ *
  * While you CAN use stdio/syscall file access in a program that has PHYSFS_*
  *  calls, doing so is not recommended, and you can not directly use system
  *  filehandles with PhysicsFS and vice versa (but as of PhysicsFS 2.1, you
@@ -2843,7 +2868,9 @@ PHYSFS_DECL int PHYSFS_enumerate(const char *dir, PHYSFS_EnumerateCallback c,
  *  search path, specified in platform-dependent notation.
  *
  * This call will fail (and fail to remove from the path) if the element still
- *  has files open in it.
+ *  has files open in it. A file another thread is opening from it at the
+ *  same moment might still open, though; then the archive stays open, out of
+ *  the search path, until that file is closed.
  *
  * \warning This function wants the path to the archive or directory that was
  *          mounted (the same string used for the "newDir" argument of
@@ -3077,6 +3104,20 @@ PHYSFS_DECL PHYSFS_sint64 PHYSFS_writeBytes(PHYSFS_File *handle,
                                             PHYSFS_uint64 len);
 
 
+/**
+ * \struct PHYSFS_IoVec
+ * \brief One range of a PHYSFS_Io::readv() request.
+ *
+ * \sa PHYSFS_Io
+ */
+typedef struct PHYSFS_IoVec
+{
+    PHYSFS_uint64 offset;  /**< Byte offset in the i/o to read from. */
+    void *buf;  /**< Where to put the data; at least (len) bytes. */
+    PHYSFS_uint64 len;  /**< Bytes to read. */
+} PHYSFS_IoVec;
+
+
 /**
  * \struct PHYSFS_Io
  * \brief An abstract i/o interface.
@@ -3123,8 +3164,10 @@ typedef struct PHYSFS_Io
     /**
      * \brief Binary compatibility information.
      *
-     * This must be set to zero at this time. Future versions of this
-     *  struct will increment this field, so we know what a given
+     * This must be set to zero or one at this time. Version 1 adds the
+     *  readAt() and readv() methods at the end of the struct; version 0
+     *  implementations don't have those fields at all. Future versions of
+     *  this struct will increment this field, so we know what a given
      *  implementation supports. We'll presumably keep supporting older
      *  versions as we offer new features, though.
      */
@@ -3275,6 +3318,55 @@ typedef struct PHYSFS_Io
      *   \param s The i/o instance to destroy.
      */
     void (*destroy)(struct PHYSFS_Io *io);
+
+    /**
+     * \brief Read data from a given offset. (version 1 and later.)
+     *
+     * Read up to (len) bytes starting at byte (offset) into (buf), without
+     *  using or moving the i/o position. This is what lets PhysicsFS read
+     *  an archive for many open files without a duplicate() and a seek()
+     *  for each of them.
+     *
+     * This may be called from several threads at once on the same instance,
+     *  and while another thread uses read() and seek() on it, so it can't
+     *  touch any state they do without locking it. POSIX pread() behaves
+     *  this way.
+     *
+     * You don't have to implement this, even in version 1; set it to NULL
+     *  and PhysicsFS will duplicate() and seek() as it does for version 0.
+     *
+     *   \param io The i/o instance to read from.
+     *   \param offset The byte offset to start reading at.
+     *   \param buf The buffer to store data into. It must be at least
+     *                 (len) bytes long and can't be NULL.
+     *   \param len The number of bytes to read.
+     *  \return number of bytes read, 0 at or past the end of the data,
+     *          -1 if complete failure.
+     */
+    PHYSFS_sint64 (*readAt)(struct PHYSFS_Io *io, PHYSFS_uint64 offset,
+                            void *buf, PHYSFS_uint64 len);
+
+    /**
+     * \brief Read several ranges at once. (version 1 and later.)
+     *
+     * Fill each of (count) ranges in (vec), in order, as readAt() would,
+     *  stopping after the first range that couldn't be filled completely.
+     *  This lets an implementation batch requests that archivers would
+     *  otherwise make one at a time, like the per-file headers of a ZIP.
+     *
+     * The same thread safety rules as readAt() apply.
+     *
+     * You don't have to implement this; if it's NULL, PhysicsFS calls
+     *  readAt() for each range instead. It's ignored if readAt() is NULL.
+     *
+     *   \param io The i/o instance to read from.
+     *   \param vec The ranges to read.
+     *   \param count The number of ranges in (vec).
+     *  \return total bytes read into all ranges, -1 if the first range
+     *          failed completely.
+     */
+    PHYSFS_sint64 (*readv)(struct PHYSFS_Io *io, const PHYSFS_IoVec *vec,
+                           PHYSFS_uint32 count);
 } PHYSFS_Io;
 
 
@@ -3689,7 +3781,11 @@ PHYSFS_DECL const char *PHYSFS_getPrefDir(const char *org, const char *app);
  *  such, your PHYSFS_Archiver can assume that locking is handled for you
  *  so long as the PHYSFS_Io you return from PHYSFS_open* doesn't change any
  *  of your Archiver state, as the PHYSFS_Io won't be as aggressively
- *  protected.
+ *  protected. In fact, it isn't protected at all: apps may read different
+ *  PHYSFS_Io instances from your archive on several threads at once, while
+ *  another thread is inside one of your methods. Anything those instances
+ *  share, with each other or with your archive, must not change after
+ *  openRead() returns (or only change atomically, like a reference count).
  *
  * \sa PHYSFS_registerArchiver
  * \sa PHYSFS_deregisterArchiver
@@ -3965,174 +4061,1328 @@ PHYSFS_DECL int PHYSFS_setRoot(const char *archive, const char *subdir);
 /* Everything above this line is part of the PhysicsFS 3.1 API. */
 
 
-#ifdef __cplusplus
-}
-#endif
+/**
+ * \struct PHYSFS_IoStats
+ * \brief Counters describing the work PhysicsFS has done.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * PhysicsFS can keep running counters of the i/o it does, both for the
+ *  whole library and for each archive in the search path. This is meant
+ *  for profiling and for feeding monitoring dashboards. Counters are only
+ *  kept if the implementation was built with PHYSFS_SUPPORTS_STATS defined
+ *  to 1; otherwise they cost nothing and PHYSFS_getIoStats() fails.
+ *
+ * The global counters start at zero in PHYSFS_init(), an archive's counters
+ *  start at zero when it is mounted. They only ever increase, so tools should
+ *  sample them periodically and look at the difference between samples.
+ *  Each field is updated atomically, but a snapshot is not taken atomically
+ *  across all fields.
+ *
+ * The lock fields are only tracked globally, they are always zero in a
+ *  snapshot for a specific archive.
+ *
+ * \sa PHYSFS_getIoStats
+ */
+typedef struct PHYSFS_IoStats
+{
+    PHYSFS_uint64 opens; /**< files successfully opened for reading. */
+    PHYSFS_uint64 bufferHits; /**< PHYSFS_setBuffer() buffer read hits. */
+    PHYSFS_uint64 bufferMisses; /**< buffer refills from the archive. */
+    PHYSFS_uint64 bytesRead; /**< bytes returned by PHYSFS_readBytes(). */
+    PHYSFS_uint64 bytesReadPhysical; /**< bytes read from disk or memory. */
+    PHYSFS_uint64 bytesDecompressed; /**< bytes produced by zip/7z decoding. */
+    PHYSFS_uint64 seekReinflates; /**< backwards zip seeks that re-decode. */
+    PHYSFS_uint64 pathStats; /**< stat calls made while verifying paths. */
+    PHYSFS_uint64 lockAcquisitions; /**< times the state lock was taken. */
+    PHYSFS_uint64 lockContentions; /**< times the state lock was busy. */
+    PHYSFS_uint64 lockWaitNanoseconds; /**< total time spent waiting on it. */
+    PHYSFS_uint64 bytesPrefetched; /**< bytes PHYSFS_prefetch() read ahead. */
+} PHYSFS_IoStats;
 
-#endif  /* !defined _INCLUDE_PHYSFS_H_ */
 
-/* end of physfs.h ... */
+/**
+ * \fn int PHYSFS_getIoStats(const char *archive, PHYSFS_IoStats *stats)
+ * \brief Get a snapshot of the i/o statistics counters.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * If (archive) is NULL, this reports the counters for the whole library,
+ *  which is safe to call at any time, even before PHYSFS_init(). Otherwise,
+ *  it reports the counters for a single archive or directory in the search
+ *  path; the string must match what was passed to PHYSFS_mount() exactly.
+ *
+ * This fails with PHYSFS_ERR_UNSUPPORTED if the library was built without
+ *  PHYSFS_SUPPORTS_STATS.
+ *
+ *   \param archive dir/archive in the search path, or NULL for global stats.
+ *   \param stats pointer to structure to fill in with the counters.
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_IoStats
+ */
+PHYSFS_DECL int PHYSFS_getIoStats(const char *archive, PHYSFS_IoStats *stats);
 
 
-#if defined(PHYSFS_IMPL) || defined(PHYSFS_PLATFORM_IMPL)
+/**
+ * \enum PHYSFS_TraceOp
+ * \brief Type of operation reported to trace callbacks.
+ *
+ * \sa PHYSFS_TraceEvent
+ * \sa PHYSFS_setTraceCallbacks
+ */
+typedef enum PHYSFS_TraceOp
+{
+    PHYSFS_TRACE_OPEN,      /**< PHYSFS_openRead()                    */
+    PHYSFS_TRACE_READ,      /**< PHYSFS_readBytes()                   */
+    PHYSFS_TRACE_SEEK,      /**< PHYSFS_seek()                        */
+    PHYSFS_TRACE_STAT,      /**< PHYSFS_stat()                        */
+    PHYSFS_TRACE_ENUMERATE, /**< PHYSFS_enumerate()                   */
+    PHYSFS_TRACE_MOUNT,     /**< PHYSFS_mount() and friends           */
+    PHYSFS_TRACE_IO_READ,   /**< read from a file in the native fs    */
+    PHYSFS_TRACE_IO_SEEK,   /**< seek in a file in the native fs      */
+    PHYSFS_TRACE_CLOSE      /**< PHYSFS_close()                       */
+} PHYSFS_TraceOp;
 
-#ifdef PHYSFS_SUPPORTS_ONLY_ZIP
-#define PHYSFS_SUPPORTS_DEFAULT 0
-#define PHYSFS_SUPPORTS_ZIP 1
-#endif
-#ifdef PHYSFS_SUPPORTS_ONLY_7Z
-#define PHYSFS_SUPPORTS_DEFAULT 0
-#define PHYSFS_SUPPORTS_7Z 1
-#endif
-#ifdef PHYSFS_SUPPORTS_ONLY_GRP
-#define PHYSFS_SUPPORTS_DEFAULT 0
-#define PHYSFS_SUPPORTS_GRP 1
-#endif
-#ifdef PHYSFS_SUPPORTS_ONLY_WAD
-#define PHYSFS_SUPPORTS_DEFAULT 0
-#define PHYSFS_SUPPORTS_WAD 1
-#endif
-#ifdef PHYSFS_SUPPORTS_ONLY_HOG
-#define PHYSFS_SUPPORTS_DEFAULT 0
-#define PHYSFS_SUPPORTS_HOG 1
-#endif
-#ifdef PHYSFS_SUPPORTS_ONLY_MVL
-#define PHYSFS_SUPPORTS_DEFAULT 0
-#define PHYSFS_SUPPORTS_MVL 1
-#endif
-#ifdef PHYSFS_SUPPORTS_ONLY_QPAK
-#define PHYSFS_SUPPORTS_DEFAULT 0
-#define PHYSFS_SUPPORTS_QPAK 1
-#endif
-#ifdef PHYSFS_SUPPORTS_ONLY_SLB
-#define PHYSFS_SUPPORTS_DEFAULT 0
-#define PHYSFS_SUPPORTS_SLB 1
-#endif
-#ifdef PHYSFS_SUPPORTS_ONLY_ISO9660
-#define PHYSFS_SUPPORTS_DEFAULT 0
-#define PHYSFS_SUPPORTS_ISO966010
-#endif
-#ifdef PHYSFS_SUPPORTS_ONLY_VDF
-#define PHYSFS_SUPPORTS_DEFAULT 0
-#define PHYSFS_SUPPORTS_VDF 1
-#endif
+/**
+ * \struct PHYSFS_TraceEvent
+ * \brief Information about a traced operation.
+ *
+ * Each traced operation produces a begin event and a matching end event
+ *  on the same thread. Operations can nest: reading from a file in a .zip
+ *  archive will report PHYSFS_TRACE_IO_READ events for the archive itself
+ *  inside the PHYSFS_TRACE_READ event.
+ *
+ * (path) is the path in platform-independent notation for open, stat,
+ *  enumerate and mount, and the native path of the file for the
+ *  PHYSFS_TRACE_IO_* operations. It's NULL for reads, seeks and closes on
+ *  a PHYSFS_File; match (handle) with the one from the open event instead.
+ *
+ * (archive) is only set in end events: it's the dir/archive in the search
+ *  path that handled the request, as passed to PHYSFS_mount(), or NULL if
+ *  none did or it isn't known.
+ *
+ * Strings are only valid for the duration of the callback.
+ *
+ * \sa PHYSFS_setTraceCallbacks
+ */
+typedef struct PHYSFS_TraceEvent
+{
+    PHYSFS_TraceOp op;  /**< What is being done. */
+    PHYSFS_uint64 timestamp;  /**< Monotonic clock, in nanoseconds. */
+    const char *path;  /**< Path being worked on, or NULL. */
+    const char *archive;  /**< Dir/archive that resolved (path), or NULL. */
+    const void *handle;  /**< PHYSFS_File or PHYSFS_Io involved, or NULL. */
+    PHYSFS_uint64 bytes;  /**< Bytes requested, or offset for seeks. */
+    PHYSFS_sint64 result;  /**< End only: bytes read, or non-zero success; -1 on read failure. */
+    PHYSFS_uint64 duration;  /**< End only: nanoseconds since the begin event. */
+} PHYSFS_TraceEvent;
 
-#ifdef PHYSFS_SUPPORTS_NO_ZIP
-#define PHYSFS_SUPPORTS_ZIP 0
-#endif
-#ifdef PHYSFS_SUPPORTS_NO_7Z
-#define PHYSFS_SUPPORTS_7Z 0
-#endif
-#ifdef PHYSFS_SUPPORTS_NO_GRP
-#define PHYSFS_SUPPORTS_GRP 0
-#endif
-#ifdef PHYSFS_SUPPORTS_NO_WAD
-#define PHYSFS_SUPPORTS_WAD 0
-#endif
-#ifdef PHYSFS_SUPPORTS_NO_HOG
-#define PHYSFS_SUPPORTS_HOG 0
-#endif
-#ifdef PHYSFS_SUPPORTS_NO_MVL
-#define PHYSFS_SUPPORTS_MVL 0
-#endif
-#ifdef PHYSFS_SUPPORTS_NO_QPAK
-#define PHYSFS_SUPPORTS_QPAK 0
-#endif
-#ifdef PHYSFS_SUPPORTS_NO_SLB
-#define PHYSFS_SUPPORTS_SLB 0
-#endif
-#ifdef PHYSFS_SUPPORTS_NO_ISO9660
-#define PHYSFS_SUPPORTS_ISO9660 0
-#endif
-#ifdef PHYSFS_SUPPORTS_NO_VDF
-#define PHYSFS_SUPPORTS_VDF 0
-#endif
+/**
+ * \typedef PHYSFS_TraceCallback
+ * \brief Function signature for trace callbacks.
+ *
+ *    \param data The (data) pointer passed to PHYSFS_setTraceCallbacks().
+ *    \param event The event being reported. Don't keep this pointer.
+ *
+ * \sa PHYSFS_setTraceCallbacks
+ */
+typedef void (*PHYSFS_TraceCallback)(void *data, const PHYSFS_TraceEvent *event);
 
-#define __PHYSICSFS_INTERNAL__
+/**
+ * \fn int PHYSFS_setTraceCallbacks(PHYSFS_TraceCallback begin, PHYSFS_TraceCallback end, void *data)
+ * \brief Get told when PhysicsFS starts and finishes an operation.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * This lets a profiler see which files are opened, read, seeked and stat'd,
+ *  which archives served them, and how long each operation took. This is
+ *  only available if the implementation was built with PHYSFS_SUPPORTS_TRACE
+ *  defined to 1; otherwise this function fails and tracing costs nothing.
+ *
+ * Callbacks run on whatever thread is calling into PhysicsFS, possibly on
+ *  several threads at once, and sometimes while PhysicsFS holds internal
+ *  locks. They must be quick, must be thread safe, and must not call back
+ *  into PhysicsFS.
+ *
+ * Pass NULL for both callbacks to stop tracing. Only change the callbacks
+ *  while no other thread is using PhysicsFS. This may be called before
+ *  PHYSFS_init(), and the callbacks stay set across PHYSFS_deinit().
+ *
+ *   \param begin Called before an operation starts. May be NULL.
+ *   \param end Called after an operation finished. May be NULL.
+ *   \param data Passed through to the callbacks.
+ *  \return nonzero on success, zero if tracing support isn't built in.
+ *
+ * \sa PHYSFS_TraceEvent
+ */
+PHYSFS_DECL int PHYSFS_setTraceCallbacks(PHYSFS_TraceCallback begin,
+                                         PHYSFS_TraceCallback end, void *data);
 
-/*
- * Internal function/structure declaration. Do NOT include in your
- *  application.
+
+/**
+ * \enum PHYSFS_LockSite
+ * \brief Places where PhysicsFS takes its global locks.
  *
- * Please see the file LICENSE.txt in the source's root directory.
+ * Almost every PhysicsFS call serializes on one global state lock. Lock
+ *  profiles are kept separately for the calls most likely to pile up
+ *  on it. The error state lock is separate, and gets its own profile.
  *
- *  This file written by Ryan C. Gordon.
+ * \sa PHYSFS_getLockProfile
  */
+typedef enum PHYSFS_LockSite
+{
+    PHYSFS_LOCKSITE_OTHER,      /**< state lock, anything not listed here */
+    PHYSFS_LOCKSITE_OPEN,       /**< state lock, opening files            */
+    PHYSFS_LOCKSITE_CLOSE,      /**< state lock, PHYSFS_close()           */
+    PHYSFS_LOCKSITE_STAT,       /**< state lock, stat and path lookups    */
+    PHYSFS_LOCKSITE_ENUMERATE,  /**< state lock, PHYSFS_enumerate()       */
+    PHYSFS_LOCKSITE_MOUNT,      /**< state lock, (un)mounting, write dir  */
+    PHYSFS_LOCKSITE_ERRORSTATE  /**< error lock, per-thread error codes   */
+} PHYSFS_LockSite;
 
-#ifndef _INCLUDE_PHYSFS_INTERNAL_H_
-#define _INCLUDE_PHYSFS_INTERNAL_H_
+/**
+ * \def PHYSFS_LOCK_HISTOGRAM_BUCKETS
+ * \brief Number of buckets in PHYSFS_LockProfile::waitHistogram.
+ */
+#define PHYSFS_LOCK_HISTOGRAM_BUCKETS 20
 
-#ifndef __PHYSICSFS_INTERNAL__
-#error Do not include this header from your applications.
-#endif
+/**
+ * \struct PHYSFS_LockProfile
+ * \brief Lock contention profile for a PHYSFS_LockSite.
+ *
+ * Hold times are measured from the outermost grab of the lock to the final
+ *  release (the locks are recursive), and are charged to the site of that
+ *  outermost grab.
+ *
+ * The wait histogram counts every acquisition at this site: bucket 0 has
+ *  waits under a microsecond, bucket n has waits from 2^(n-1) up to 2^n
+ *  microseconds, and the last bucket has everything longer than that.
+ *
+ * \sa PHYSFS_getLockProfile
+ */
+typedef struct PHYSFS_LockProfile
+{
+    PHYSFS_uint64 acquisitions; /**< times the lock was grabbed here. */
+    PHYSFS_uint64 contentions; /**< grabs that had to wait for another thread. */
+    PHYSFS_uint64 waitNanoseconds; /**< total time spent waiting. */
+    PHYSFS_uint64 longestWaitNanoseconds; /**< longest single wait. */
+    PHYSFS_uint64 holdNanoseconds; /**< total time the lock was held. */
+    PHYSFS_uint64 longestHoldNanoseconds; /**< longest single hold. */
+    PHYSFS_uint64 waitHistogram[PHYSFS_LOCK_HISTOGRAM_BUCKETS]; /**< see above. */
+} PHYSFS_LockProfile;
 
-/* Turn off MSVC warnings that are aggressively anti-portability. */
-#if defined(_MSC_VER) && !defined(_CRT_SECURE_NO_WARNINGS)
-#define _CRT_SECURE_NO_WARNINGS 1
-#endif
+/**
+ * \fn int PHYSFS_getLockProfile(PHYSFS_LockSite site, PHYSFS_LockProfile *profile)
+ * \brief Find out how much time is lost waiting on PhysicsFS's locks.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * This is only available if the implementation was built with
+ *  PHYSFS_SUPPORTS_LOCK_PROFILE defined to 1; otherwise this function fails
+ *  with PHYSFS_ERR_UNSUPPORTED and the locks aren't instrumented at all.
+ *
+ * Profiles start out empty in PHYSFS_init() and grow until
+ *  PHYSFS_resetLockProfiles() is called.
+ *
+ *   \param site Which call site to report.
+ *   \param profile pointer to structure to fill in.
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_LockProfile
+ * \sa PHYSFS_resetLockProfiles
+ */
+PHYSFS_DECL int PHYSFS_getLockProfile(PHYSFS_LockSite site,
+                                      PHYSFS_LockProfile *profile);
 
-/*#include "physfs.h"*/
+/**
+ * \fn int PHYSFS_resetLockProfiles(void)
+ * \brief Clear the lock profiles of all sites.
+ *
+ * Use this to measure a specific phase of your program, like loading a level.
+ *
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_getLockProfile
+ */
+PHYSFS_DECL int PHYSFS_resetLockProfiles(void);
 
-/* The holy trinity. */
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
 
-/*#include "physfs_platforms.h"*/
-#ifndef _INCL_PHYSFS_PLATFORMS
-#define _INCL_PHYSFS_PLATFORMS
+/**
+ * \def PHYSFS_PREFETCH_MANIFEST
+ * \brief Name of the file that marks an archive's read-ahead range.
+ *
+ * An archive can carry a small text file by this name in its root, listing
+ *  where the data that is read first after mounting lives. When such an
+ *  archive is mounted straight from a file on disk, PhysicsFS asks the OS
+ *  to start reading that range in the background, so the first opens and
+ *  reads don't have to wait on the disk. This is a hint and nothing else:
+ *  a missing or malformed manifest never makes a mount fail.
+ *
+ * The file is plain text, one item per line:
+ *
+ * \code
+ * PHYSFS-PREFETCH 1
+ * range <byte offset> <byte count>
+ * <path of the first file read>
+ * <path of the second file read>
+ * ...
+ * \endcode
+ *
+ * Only the first two lines matter to PhysicsFS; the paths are there for
+ *  tools. test/repack_physfs.c writes archives with their entries in the
+ *  order a recorded access trace first read them, and can add a manifest.
+ */
+#define PHYSFS_PREFETCH_MANIFEST ".physfs-prefetch"
 
-#ifndef __PHYSICSFS_INTERNAL__
-#error Do not include this header from your applications.
-#endif
 
-/*
- * These only define the platforms to determine which files in the platforms
- *  directory should be compiled. For example, technically BeOS can be called
- *  a "unix" system, but since it doesn't use unix.c, we don't define
- *  PHYSFS_PLATFORM_UNIX on that system.
+/**
+ * \typedef PHYSFS_Prefetch
+ * \brief A prefetch running in the background.
+ *
+ * This is opaque. You get one from PHYSFS_prefetch(), and must hand it back
+ *  to PHYSFS_endPrefetch().
+ *
+ * \sa PHYSFS_prefetch
  */
+typedef struct PHYSFS_Prefetch PHYSFS_Prefetch;
 
-#if (defined __HAIKU__)
-#  define PHYSFS_PLATFORM_HAIKU 1
-#  define PHYSFS_PLATFORM_POSIX 1
-#elif ((defined __BEOS__) || (defined __beos__))
-#  error BeOS support was dropped since PhysicsFS 2.1. Sorry. Try Haiku!
-#elif (defined _WIN32_WCE) || (defined _WIN64_WCE)
-#  error PocketPC support was dropped since PhysicsFS 2.1. Sorry. Try WinRT!
-#elif (defined(_MSC_VER) && (_MSC_VER >= 1700) && !_USING_V110_SDK71_)  /* _MSC_VER==1700 for MSVC 2012 */
-#  include <winapifamily.h>
-#  define PHYSFS_PLATFORM_WINDOWS 1
-#  if WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_APP) && !WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
-#    define PHYSFS_NO_CDROM_SUPPORT 1
-#    define PHYSFS_PLATFORM_WINRT 1
-#  endif
-#elif (((defined _WIN32) || (defined _WIN64)) && (!defined __CYGWIN__))
-#  define PHYSFS_PLATFORM_WINDOWS 1
-#elif defined(__OS2__) || defined(OS2)
-#  define PHYSFS_PLATFORM_OS2 1
-#elif ((defined __MACH__) && (defined __APPLE__))
-/* To check if iOS or not, we need to include this file */
-#  include <TargetConditionals.h>
-#  if ((TARGET_IPHONE_SIMULATOR) || (TARGET_OS_IPHONE))
-#     define PHYSFS_NO_CDROM_SUPPORT 1
-#  endif
-#  define PHYSFS_PLATFORM_APPLE 1
-#  define PHYSFS_PLATFORM_POSIX 1
-#elif defined(macintosh)
-#  error Classic Mac OS support was dropped from PhysicsFS 2.0. Move to OS X.
-#elif defined(__ANDROID__)
- #  define PHYSFS_PLATFORM_LINUX 1
- #  define PHYSFS_PLATFORM_ANDROID 1
- #  define PHYSFS_PLATFORM_POSIX 1
- #  define PHYSFS_NO_CDROM_SUPPORT 1
-#elif defined(__linux)
-#  define PHYSFS_PLATFORM_LINUX 1
-#  define PHYSFS_PLATFORM_UNIX 1
-#  define PHYSFS_PLATFORM_POSIX 1
-#elif defined(__sun) || defined(sun)
-#  define PHYSFS_PLATFORM_SOLARIS 1
-#  define PHYSFS_PLATFORM_UNIX 1
+/**
+ * \fn PHYSFS_Prefetch *PHYSFS_prefetch(const char * const *paths)
+ * \brief Start warming up a list of files in the background.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * If you know which files you're about to open, say before loading a level,
+ *  this gets the disk working on them while you do something else. A
+ *  background thread finds each path in the search path the way
+ *  PHYSFS_openRead() would, and reads the archive metadata an open needs,
+ *  so that's ready when you open it for real. Then, for each archive that
+ *  is a file on disk, it merges the byte ranges the files' data occupies
+ *  and asks the OS to read them into its cache, in offset order.
+ *
+ * Data is read ahead for ZIP files, the simple archive formats (GRP, WAD,
+ *  ISO9660, etc) and directories; other archives only get the lookup.
+ *  Paths that aren't found are skipped. Nothing is read into PhysicsFS
+ *  itself and the read-ahead is only a hint to the OS, so you can open the
+ *  files whenever you like, before or after the prefetch is done.
+ *
+ * The search path can change while a prefetch runs; files in archives that
+ *  are unmounted meanwhile are skipped. What was read ahead is counted in
+ *  PHYSFS_IoStats::bytesPrefetched.
+ *
+ * Every prefetch must be ended with PHYSFS_endPrefetch(), before
+ *  PHYSFS_deinit() at the latest.
+ *
+ *   \param paths NULL-terminated list of paths, in platform-independent
+ *                notation. It's copied, so you can free it right away.
+ *  \return a prefetch handle, or NULL on error. Use PHYSFS_getLastErrorCode()
+ *          to obtain the specific error. Platforms without threads fail
+ *          with PHYSFS_ERR_UNSUPPORTED.
+ *
+ * \sa PHYSFS_prefetchDone
+ * \sa PHYSFS_endPrefetch
+ */
+PHYSFS_DECL PHYSFS_Prefetch *PHYSFS_prefetch(const char * const *paths);
+
+/**
+ * \fn int PHYSFS_prefetchDone(PHYSFS_Prefetch *prefetch)
+ * \brief See if a prefetch has finished, without waiting for it.
+ *
+ *   \param prefetch a handle from PHYSFS_prefetch().
+ *  \return non-zero if the background thread is done, zero if it's still
+ *          working.
+ *
+ * \sa PHYSFS_prefetch
+ * \sa PHYSFS_endPrefetch
+ */
+PHYSFS_DECL int PHYSFS_prefetchDone(PHYSFS_Prefetch *prefetch);
+
+/**
+ * \fn void PHYSFS_endPrefetch(PHYSFS_Prefetch *prefetch, int cancel)
+ * \brief Wait for a prefetch to finish, or cancel it, and free it.
+ *
+ * If (cancel) is non-zero, the background thread stops before the next
+ *  path or range, so this returns quickly. Read-ahead the OS was already
+ *  asked for still happens.
+ *
+ * (prefetch) is invalid after this call.
+ *
+ *   \param prefetch a handle from PHYSFS_prefetch().
+ *   \param cancel non-zero to stop early, zero to let it finish.
+ *
+ * \sa PHYSFS_prefetch
+ * \sa PHYSFS_prefetchDone
+ */
+PHYSFS_DECL void PHYSFS_endPrefetch(PHYSFS_Prefetch *prefetch, int cancel);
+
+
+/**
+ * \fn int PHYSFS_setContentCache(PHYSFS_uint64 budget, PHYSFS_uint64 maxFileSize)
+ * \brief Keep the contents of small files in memory between opens.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * Opening a compressed file in an archive means decompressing it again,
+ *  every time. If the same small files (configs, shaders, fonts...) get
+ *  opened over and over, this cache keeps their decompressed contents and
+ *  shares them between every PHYSFS_File opened on them, so opens after
+ *  the first don't touch the archive at all.
+ *
+ * Files in archives up to (maxFileSize) bytes are cached when they're first
+ *  opened with PHYSFS_openRead(), reading them in whole at that point. Files
+ *  in plain directories aren't cached, since they can change on disk.
+ *  When the cache would go over (budget) bytes, the least recently opened
+ *  files are dropped. Files that are still open when they're dropped keep
+ *  their memory until they're closed. Unmounting an archive drops all its
+ *  files.
+ *
+ * The cache is off by default. Set (budget) to zero to turn it off again
+ *  and free what it holds.
+ *
+ *   \param budget most bytes to keep, zero to disable the cache.
+ *   \param maxFileSize biggest file, in bytes, that will be cached.
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_getContentCacheStats
+ */
+PHYSFS_DECL int PHYSFS_setContentCache(PHYSFS_uint64 budget,
+                                       PHYSFS_uint64 maxFileSize);
+
+/**
+ * \struct PHYSFS_ContentCacheStats
+ * \brief Counters for the content cache.
+ *
+ * \sa PHYSFS_getContentCacheStats
+ */
+typedef struct PHYSFS_ContentCacheStats
+{
+    PHYSFS_uint64 hits;       /**< opens served from the cache.          */
+    PHYSFS_uint64 misses;     /**< opens that filled a cache entry.      */
+    PHYSFS_uint64 evictions;  /**< files dropped to stay in the budget.  */
+    PHYSFS_uint64 files;      /**< files in the cache right now.         */
+    PHYSFS_uint64 bytes;      /**< bytes counted against the budget now. */
+} PHYSFS_ContentCacheStats;
+
+/**
+ * \fn int PHYSFS_getContentCacheStats(PHYSFS_ContentCacheStats *stats)
+ * \brief Get the content cache's counters.
+ *
+ * The counters start at zero in PHYSFS_init() and keep counting when the
+ *  budget changes.
+ *
+ *   \param stats filled in with the current counters.
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_setContentCache
+ */
+PHYSFS_DECL int PHYSFS_getContentCacheStats(PHYSFS_ContentCacheStats *stats);
+
+
+/**
+ * \fn void PHYSFS_setResolveOnMount(int enable)
+ * \brief Read all per-file archive metadata when an archive is mounted.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * ZIP files keep a small header in front of each file's data, and
+ *  PhysicsFS normally reads it the first time that file is opened or
+ *  stat'd, so mounting stays fast. That's a disk seek and read in the middle
+ *  of whatever you're doing, while other threads wait to open files.
+ *
+ * With this enabled, ZIP archives mounted afterwards read all those headers
+ *  during the mount, with several threads on large archives, and resolve
+ *  their symbolic links too. Opening files later never touches the disk
+ *  for metadata. Mounting takes longer and reads more of the archive, even
+ *  files you'll never open.
+ *
+ * This is disabled by default. It only affects archives mounted after the
+ *  call; it doesn't matter to other archive types.
+ *
+ *   \param enable nonzero to resolve at mount time, zero to resolve lazily.
+ *
+ * \sa PHYSFS_getResolveOnMount
+ */
+PHYSFS_DECL void PHYSFS_setResolveOnMount(int enable);
+
+/**
+ * \fn int PHYSFS_getResolveOnMount(void)
+ * \brief Determine if archive metadata is resolved at mount time.
+ *
+ *  \return nonzero if PHYSFS_setResolveOnMount() enabled it, zero if not.
+ *
+ * \sa PHYSFS_setResolveOnMount
+ */
+PHYSFS_DECL int PHYSFS_getResolveOnMount(void);
+
+
+/**
+ * \fn int PHYSFS_setIndexCache(const char *dir)
+ * \brief Share archive indexes between processes through files in a directory.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * Mounting a ZIP archive reads its central directory and builds an index of
+ *  every file in it, in memory. Lots of processes mounting the same big
+ *  archives each spend the time to build that, and each keep their own
+ *  identical copy.
+ *
+ * With an index cache, the first process to mount a ZIP archive resolves
+ *  all of it, as PHYSFS_setResolveOnMount() would, and writes the index to
+ *  a file in (dir), laid out so it can be used right where it lies. Then it
+ *  and every process that mounts the archive after it map that file
+ *  read-only and look files up in it directly, so the system keeps one copy
+ *  in memory for all of them, and mounting skips the central directory.
+ *  Put (dir) on a RAM disk, like /dev/shm, to keep it off real disks.
+ *
+ * An index file is only used if it matches the archive: the same path, size
+ *  and modification time, and the same central directory. Otherwise it's
+ *  built again and replaced. Index files are replaced by renaming a new one
+ *  over them, never rewritten, so processes still using the old one are
+ *  fine; don't truncate or edit them yourself while they might be in use.
+ *  Nothing ever deletes them, either; clear out (dir) when archives go away.
+ *
+ * Archives that can't be found again by the name they were mounted with,
+ *  like PHYSFS_mountMemory() and most PHYSFS_mountIo() mounts, aren't
+ *  indexed. Trouble reading or writing an index file never fails a mount;
+ *  that archive just goes without. Index files are created like any other
+ *  file PhysicsFS writes, which on Unix means only their owner can read them.
+ *
+ * This is disabled by default, and only affects archives mounted after the
+ *  call. It needs memory-mapped files, so where PhysicsFS doesn't have those
+ *  (currently anything but Unix-like systems) it fails with
+ *  PHYSFS_ERR_UNSUPPORTED.
+ *
+ *   \param dir directory, in platform-dependent notation, to keep index
+ *               files in, which must already exist. NULL stops using one.
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_setResolveOnMount
+ */
+PHYSFS_DECL int PHYSFS_setIndexCache(const char *dir);
+
+
+/**
+ * \fn PHYSFS_sint64 PHYSFS_sendToFd(PHYSFS_File *handle, int fd, PHYSFS_uint64 len)
+ * \brief Copy data from a PhysicsFS filehandle to an OS file descriptor.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * This does what a loop of PHYSFS_readBytes() and write() calls would,
+ *  for servers that stream files from archives out over sockets or pipes.
+ *  Where it can, the data never comes into the process at all: if the
+ *  file is stored uncompressed and unencrypted (a file in a plain
+ *  directory, a ZIP entry that isn't deflated, or any file in GRP, HOG,
+ *  MVL, WAD, QPAK, SLB, VDF or ISO9660 archives) and the archive is a file
+ *  on disk, the OS copies it straight from the archive to (fd) with
+ *  sendfile(). Everything else, including every platform without
+ *  sendfile(), is read and decompressed into a buffer and written out.
+ *
+ * This starts at the handle's current position, and moves it past what
+ *  was sent, so it can be mixed with PHYSFS_readBytes() and PHYSFS_seek().
+ *  It stops early at the end of the file.
+ *
+ * (fd) is an open file descriptor you own (a socket, a pipe, a file...);
+ *  on Windows and OS/2, one from the C runtime, like _open() returns. It
+ *  should block: if a non-blocking (fd) fills up, this returns what it
+ *  sent so far. If (fd) is a file, data is written at its current
+ *  position.
+ *
+ *   \param handle handle returned from PHYSFS_openRead().
+ *   \param fd file descriptor to write to.
+ *   \param len number of bytes to send.
+ *  \return number of bytes sent. This may be less than (len); this does
+ *           not signify an error, necessarily (a short send may mean EOF).
+ *           PHYSFS_getLastErrorCode() can shed light on the reason this
+ *           might be < (len), as can PHYSFS_eof(). -1 if complete failure.
+ *
+ * \sa PHYSFS_readBytes
+ */
+PHYSFS_DECL PHYSFS_sint64 PHYSFS_sendToFd(PHYSFS_File *handle, int fd,
+                                          PHYSFS_uint64 len);
+
+
+/**
+ * \struct PHYSFS_PhysicalStat
+ * \brief Where a file's data physically lives inside an archive.
+ *
+ * \sa PHYSFS_statPhysical
+ */
+typedef struct PHYSFS_PhysicalStat
+{
+    const char *archive;       /**< platform-dependent path of the archive. */
+    PHYSFS_uint64 offset;      /**< where the data starts in (archive).     */
+    PHYSFS_uint64 storedsize;  /**< bytes of data at (offset), as stored.   */
+    PHYSFS_uint64 filesize;    /**< bytes once decompressed.                */
+    PHYSFS_uint32 crc;         /**< CRC-32 of the file, if (hascrc).        */
+    PHYSFS_uint16 method;      /**< 0 if stored, 8 if deflated, as in ZIP.  */
+    PHYSFS_uint8 hascrc;       /**< non-zero if the archive stores a CRC.   */
+    PHYSFS_uint8 encrypted;    /**< non-zero if the data is encrypted.      */
+} PHYSFS_PhysicalStat;
+
+/**
+ * \fn int PHYSFS_statPhysical(const char *fname, PHYSFS_PhysicalStat *stat)
+ * \brief Find where a file's data is stored in its archive on disk.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * This finds (fname) in the search path like PHYSFS_openRead() would, and
+ *  reports where its bytes sit inside the archive file that has it, so
+ *  you can read them yourself with whatever is fastest (a GPU upload path,
+ *  your own decompressor, sendfile() to a socket...) and skip PhysicsFS's
+ *  read path entirely.
+ *
+ * If (method) is zero and (encrypted) is zero, the file is exactly the
+ *  (storedsize) bytes at (offset) of (archive). Otherwise those bytes need
+ *  decoding: method 8 is a raw deflate stream (no zlib header), and ZIP's
+ *  "traditional" encryption puts a 12-byte header in front of the data.
+ *
+ * This only works for files in ZIP archives and archives PhysicsFS reads
+ *  without decoding anything (GRP, HOG, MVL, WAD, QPAK, SLB, VDF, ISO9660),
+ *  mounted from a file on disk. Files in plain directories, 7z archives,
+ *  and archives mounted from memory or from another file fail with
+ *  PHYSFS_ERR_UNSUPPORTED. Use PHYSFS_getRealDir() for plain directories.
+ *
+ * (archive) points to memory owned by PhysicsFS; it stays valid until that
+ *  archive is unmounted. The archive might be mounted again and changed on
+ *  disk, so don't hold on to any of this longer than you need it.
+ *
+ *   \param fname filename to look up, in platform-independent notation.
+ *   \param stat pointer to structure to fill in.
+ *  \return non-zero on success, zero on failure. On failure, the reason can
+ *          be retrieved with PHYSFS_getLastErrorCode().
+ *
+ * \sa PHYSFS_stat
+ * \sa PHYSFS_getRealDir
+ */
+PHYSFS_DECL int PHYSFS_statPhysical(const char *fname,
+                                    PHYSFS_PhysicalStat *stat);
+
+
+/**
+ * \fn int PHYSFS_setUncached(PHYSFS_File *handle, int enable)
+ * \brief Keep a file's data out of the OS's disk cache.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * The OS keeps what it reads from disk in memory, in case it's wanted
+ *  again. Streaming through something huge once (a video, a bulk
+ *  extraction, an integrity check) fills that cache with data nobody will
+ *  read again and pushes out what everything else was using, which then has
+ *  to come off the disk again.
+ *
+ * With this enabled, as reads and PHYSFS_sendToFd() on (handle) get through
+ *  the file, the OS is told to drop what they've used from its cache. This
+ *  applies to the bytes this file reads from the disk, compressed or not,
+ *  whether it's in a plain directory or in a ZIP or other archive that
+ *  doesn't decode at open time (not 7z). Other parts of the same archive
+ *  are left alone. The file is still read through the cache, with the OS's
+ *  usual read-ahead, so this is no slower than a normal read; it's just
+ *  not left behind.
+ *
+ * This is only a hint. It does nothing on platforms that can't do it
+ *  (currently everything but Linux and other systems with
+ *  posix_fadvise()), or to data someone else still has cached.
+ *
+ *   \param handle handle returned from PHYSFS_openRead().
+ *   \param enable non-zero to drop data as it's read, zero to stop.
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_readBytes
+ * \sa PHYSFS_sendToFd
+ */
+PHYSFS_DECL int PHYSFS_setUncached(PHYSFS_File *handle, int enable);
+
+
+/**
+ * \fn int PHYSFS_setStreaming(PHYSFS_File *handle, PHYSFS_uint64 bufsize)
+ * \brief Read a file ahead of you on a background thread.
+ *
+ * Normally a read does everything on the calling thread: it waits for the
+ *  disk, decompresses what came back, and only then returns. Something that
+ *  reads a big file front to back in small steps (an audio or video
+ *  decoder, say) can starve when the disk is slow to answer, even though it
+ *  wasn't busy in between reads.
+ *
+ * This starts a thread for (handle) that reads ahead of you, and
+ *  decompresses if the file's compressed, into (bufsize) bytes of buffers
+ *  split into a few chunks. Your reads are then served from chunks that
+ *  are ready, while the thread fills the next ones. So the disk,
+ *  decompression and your own work on the data can all happen at once, and
+ *  a hiccup on the disk is hidden as long as the buffered data lasts. Read
+ *  in pieces no bigger than a chunk to get the most overlap.
+ *
+ * Seeking works, but stops the thread; it starts again on the next read,
+ *  from the new position, and the buffered data is thrown away unless the
+ *  seek stays inside the chunk you're reading. So this is for reading
+ *  sequentially; seek-heavy use is better off with PHYSFS_setBuffer().
+ *  PHYSFS_setUncached() has no effect on a streaming handle.
+ *
+ * Call this again with a (bufsize) of zero to stop streaming; the file
+ *  position is kept, but getting back to it may mean decompressing the file
+ *  from the start again.
+ *
+ * Don't use the same handle from two threads at once, streaming or not; the
+ *  thread this starts is private to the handle. This fails with
+ *  PHYSFS_ERR_UNSUPPORTED on platforms without threads.
+ *
+ *   \param handle handle returned from PHYSFS_openRead().
+ *   \param bufsize total bytes to read ahead. Zero to stop streaming.
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_setBuffer
+ * \sa PHYSFS_readBytes
+ */
+PHYSFS_DECL int PHYSFS_setStreaming(PHYSFS_File *handle, PHYSFS_uint64 bufsize);
+
+
+/**
+ * \fn int PHYSFS_setDecodeThreads(PHYSFS_File *handle, PHYSFS_uint32 threads)
+ * \brief Decompress big reads from a file on several threads.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * A deflated file is one long stream that normally has to be decoded from
+ *  front to back on one thread, however many cores are sitting idle. This
+ *  lets (handle) use up to (threads) of them on reads of a big deflated
+ *  file in a ZIP archive, such as reading the whole thing into memory.
+ *
+ * It can't start right away. The first time a handle with this set reads
+ *  through the file, it saves checkpoints: every 8 megabytes of output, a
+ *  copy of everything the decompressor knows at that point, about 44K each.
+ *  After that, a read that spans checkpoints is split up at them, and each
+ *  piece is decoded from its checkpoint on its own thread. The checkpoints
+ *  belong to the archive, not the handle, so they're still there for other
+ *  handles that set this, and last until the archive is unmounted. Seeking
+ *  in the file on any handle uses them too, instead of decoding from the
+ *  start of the file again.
+ *
+ * Files that aren't deflated, are encrypted, are smaller than 16 megabytes,
+ *  or aren't in a ZIP archive ignore this. So do archives that can't be
+ *  read from several threads at once, such as ones mounted from memory. A
+ *  (threads) of 0 or 1 turns it off; the checkpoints already saved stay.
+ *
+ *   \param handle handle returned from PHYSFS_openRead().
+ *   \param threads most threads to decode on, including the caller's.
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_readBytes
+ * \sa PHYSFS_seek
+ */
+PHYSFS_DECL int PHYSFS_setDecodeThreads(PHYSFS_File *handle,
+                                        PHYSFS_uint32 threads);
+
+
+/**
+ * \fn int PHYSFS_setIoScheduler(const char *archive, int enable, PHYSFS_uint64 backgroundBytesPerSecond)
+ * \brief Put the reads on one archive in order before they reach the disk.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * Normally, when several threads read files from the same archive, each
+ *  read goes to the OS as soon as it's asked for, in whatever order the
+ *  threads happen to run. On a hard drive or a network mount, that jumps
+ *  all over the archive, and a read that's needed right now (the next bit
+ *  of an audio stream) waits behind a big one that isn't (a texture that's
+ *  being loaded in the background).
+ *
+ * This puts the reads on (archive) through a queue instead. When reads are
+ *  waiting, the next one issued is:
+ *
+ * - a read that has waited past its deadline, earliest deadline first;
+ * - otherwise, one from the highest PHYSFS_IoPriority that's waiting, the
+ *   nearest one past where the last read ended, sweeping through the
+ *   archive in one direction and starting over at the front.
+ *
+ * Waiting reads that touch or overlap the one being issued are issued with
+ *  it, as a single read of up to a megabyte. Set priorities and deadlines
+ *  per file handle with PHYSFS_setIoPriority(); every read waits a second
+ *  at most, so background reads can't be put off forever.
+ *
+ * If (backgroundBytesPerSecond) isn't zero, reads at
+ *  PHYSFS_IOPRIO_BACKGROUND are also held back before they're queued, so
+ *  they average no more than that, leaving the rest of the bandwidth to
+ *  everything else. This counts bytes read from the archive, so a
+ *  compressed file can be decompressed faster than that.
+ *
+ * Your reads don't change: they still block until their data is there. No
+ *  extra thread is started; whichever thread is reading issues reads for
+ *  the others while they wait. A read that nothing else is competing with
+ *  goes straight through, so this costs little when there's no contention.
+ *
+ * Only archives read from a file on disk through the ZIP archiver or the
+ *  simple ones (GRP, HOG, etc) can be scheduled; this fails with
+ *  PHYSFS_ERR_UNSUPPORTED for directories, archives mounted from memory or
+ *  an app's own PHYSFS_Io, and on platforms without threads. Call this
+ *  again with (enable) zero to turn it off. It lasts until (archive) is
+ *  unmounted.
+ *
+ *   \param archive dir/archive in the search path, as given to PHYSFS_mount().
+ *   \param enable nonzero to schedule reads, zero to stop.
+ *   \param backgroundBytesPerSecond most bandwidth for background reads,
+ *                                   zero for no limit.
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_setIoPriority
+ */
+PHYSFS_DECL int PHYSFS_setIoScheduler(const char *archive, int enable,
+                                      PHYSFS_uint64 backgroundBytesPerSecond);
+
+
+/**
+ * \enum PHYSFS_IoPriority
+ * \brief How soon a file's reads are needed, for the i/o scheduler.
+ *
+ * \sa PHYSFS_setIoPriority
+ * \sa PHYSFS_setIoScheduler
+ */
+typedef enum PHYSFS_IoPriority
+{
+    PHYSFS_IOPRIO_BACKGROUND,  /**< bulk loading, can be throttled.   */
+    PHYSFS_IOPRIO_NORMAL,      /**< what every file starts out with.  */
+    PHYSFS_IOPRIO_URGENT       /**< latency critical, like audio.     */
+} PHYSFS_IoPriority;
+
+
+/**
+ * \fn int PHYSFS_setIoPriority(PHYSFS_File *handle, PHYSFS_IoPriority priority, PHYSFS_uint32 deadline)
+ * \brief Say how urgently a file's reads are needed.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * Reads from (handle) are queued at (priority) from now on, if its archive
+ *  has a scheduler; see PHYSFS_setIoScheduler(). If (deadline) isn't zero,
+ *  each read wants to be issued within that many milliseconds of being
+ *  asked for, and goes ahead of every other priority once it's late.
+ *
+ * This is only a hint. Files in archives without a scheduler ignore it, so
+ *  it doesn't fail for them; it's fine to set it on every file and turn
+ *  scheduling on only where it helps. Reads done for the handle by a
+ *  streaming thread (PHYSFS_setStreaming()) or decode threads
+ *  (PHYSFS_setDecodeThreads()) use it too.
+ *
+ *   \param handle handle returned from PHYSFS_openRead().
+ *   \param priority one of the PHYSFS_IoPriority values.
+ *   \param deadline milliseconds each read should wait at most, or zero.
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_setIoScheduler
+ */
+PHYSFS_DECL int PHYSFS_setIoPriority(PHYSFS_File *handle,
+                                     PHYSFS_IoPriority priority,
+                                     PHYSFS_uint32 deadline);
+
+
+/**
+ * \fn int PHYSFS_replaceMount(const char *oldDir, const char *newDir)
+ * \brief Swap one archive in the search path for another, while in use.
+ *
+ * Patching a running program by unmounting an archive and mounting a new
+ *  one doesn't work well: PHYSFS_unmount() fails while any file from the
+ *  archive is open, and both calls hold the library's lock while they
+ *  work, so every other thread's lookups wait for the new archive to be
+ *  opened and its directory read.
+ *
+ * This opens (newDir) first, without holding that lock, so other threads
+ *  go on opening and reading files meanwhile. If that works, (newDir) takes
+ *  (oldDir)'s place in the search path, with its mount point and root (see
+ *  PHYSFS_setRoot()), in a single step: every open from then on sees
+ *  (newDir), and none of them fail or see neither.
+ *
+ * Files already open from (oldDir) aren't touched. They keep reading from
+ *  it, and it's closed when the last of them is. Until then it's not in the
+ *  search path, so it can't be unmounted or queried, but it does still hold
+ *  its file open.
+ *
+ * (newDir) can be the same as (oldDir), to reopen an archive that was
+ *  replaced on disk (by renaming a new file over it, not by overwriting it
+ *  in place, which would change what the open files read). Otherwise it
+ *  must not be in the search path already.
+ *
+ * If this fails, (oldDir) is left as it was. While an archive is being
+ *  opened here, PHYSFS_registerArchiver() and PHYSFS_deregisterArchiver()
+ *  fail with PHYSFS_ERR_BUSY. Archives mounted from memory, a PHYSFS_Io or
+ *  a PHYSFS_File can be replaced, but only by one that's read from a file
+ *  or directory.
+ *
+ *   \param oldDir dir/archive in the search path, as given to PHYSFS_mount().
+ *   \param newDir dir/archive to replace it with, in platform-dependent
+ *                 notation.
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_mount
+ * \sa PHYSFS_unmount
+ */
+PHYSFS_DECL int PHYSFS_replaceMount(const char *oldDir, const char *newDir);
+
+
+/**
+ * \enum PHYSFS_MemoryCategory
+ * \brief What a block of PhysicsFS's memory is for.
+ *
+ * \sa PHYSFS_MemoryStats
+ */
+typedef enum PHYSFS_MemoryCategory
+{
+    PHYSFS_MEMORY_OTHER,  /**< search path, strings, bookkeeping. */
+    PHYSFS_MEMORY_INDEX,  /**< an archive's directory: entries, names... */
+    PHYSFS_MEMORY_HANDLE, /**< open files: archiver state, i/o, copies. */
+    PHYSFS_MEMORY_BUFFER, /**< PHYSFS_setBuffer() and streaming buffers. */
+    PHYSFS_MEMORY_DECODE, /**< decompressor state and work space. */
+    PHYSFS_MEMORY_CACHE   /**< PHYSFS_setContentCache() file contents. */
+} PHYSFS_MemoryCategory;
+
+/**
+ * \struct PHYSFS_MemoryStats
+ * \brief How much memory PhysicsFS is holding, and what for.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * Everything PhysicsFS allocates goes through the allocator (see
+ *  PHYSFS_setAllocator()), and if the implementation was built with
+ *  PHYSFS_SUPPORTS_MEMORY_STATS defined to 1, each allocation is counted by
+ *  category, both for the whole library and for the archive it was made
+ *  for. An archive is charged for its directory when it's mounted, and for
+ *  each file opened from it: the archiver's state for the file, buffers set
+ *  on it, decompressor state, and its content cache entry, if any.
+ *
+ * Bytes are what PhysicsFS asked for, not what the allocator used to hold
+ *  them; counting also puts a small header in front of every block. Each
+ *  field is updated atomically, but a snapshot is not taken atomically
+ *  across all fields.
+ *
+ * \sa PHYSFS_getMemoryStats
+ * \sa PHYSFS_MemoryCategory
+ */
+typedef struct PHYSFS_MemoryStats
+{
+    PHYSFS_uint64 bytes; /**< bytes held right now, all categories. */
+    PHYSFS_uint64 peakBytes; /**< most bytes held at once so far. */
+    PHYSFS_uint64 allocations; /**< blocks held right now. */
+    PHYSFS_uint64 other; /**< bytes for PHYSFS_MEMORY_OTHER. */
+    PHYSFS_uint64 index; /**< bytes for PHYSFS_MEMORY_INDEX. */
+    PHYSFS_uint64 handles; /**< bytes for PHYSFS_MEMORY_HANDLE. */
+    PHYSFS_uint64 buffers; /**< bytes for PHYSFS_MEMORY_BUFFER. */
+    PHYSFS_uint64 decode; /**< bytes for PHYSFS_MEMORY_DECODE. */
+    PHYSFS_uint64 cache; /**< bytes for PHYSFS_MEMORY_CACHE. */
+} PHYSFS_MemoryStats;
+
+/**
+ * \fn int PHYSFS_getMemoryStats(const char *archive, PHYSFS_MemoryStats *stats)
+ * \brief Find out how much memory PhysicsFS holds, and for what.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * If (archive) is NULL, this reports everything the library holds, which
+ *  is safe to call at any time, even before PHYSFS_init(). The counts start
+ *  over in PHYSFS_init(). Otherwise, it reports what's charged to a single
+ *  archive or directory in the search path, or the write dir; the string
+ *  must match what was passed to PHYSFS_mount() or PHYSFS_setWriteDir()
+ *  exactly. Files opened from an archive stay charged to it after it's
+ *  unmounted or replaced, until they're closed.
+ *
+ * Work done on threads PhysicsFS starts itself (see
+ *  PHYSFS_setDecodeThreads() and PHYSFS_prefetch()) is only counted for
+ *  the whole library, as PHYSFS_MEMORY_OTHER unless it's decoding.
+ *
+ * This fails with PHYSFS_ERR_UNSUPPORTED if the library was built without
+ *  PHYSFS_SUPPORTS_MEMORY_STATS.
+ *
+ *   \param archive dir/archive in the search path, or NULL for everything.
+ *   \param stats pointer to structure to fill in.
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_MemoryStats
+ */
+PHYSFS_DECL int PHYSFS_getMemoryStats(const char *archive,
+                                      PHYSFS_MemoryStats *stats);
+
+
+/**
+ * \fn int PHYSFS_setMemoryBudget(PHYSFS_uint64 budget)
+ * \brief Cap the memory PhysicsFS uses for things it can do without.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * Some of what PhysicsFS allocates only makes things faster: files kept by
+ *  PHYSFS_setContentCache(), buffers from PHYSFS_setBuffer() and
+ *  PHYSFS_setStreaming(), the decode checkpoints PHYSFS_setDecodeThreads()
+ *  saves, and a 7zip file's whole decompressed block and copy. This puts a
+ *  single ceiling of (budget) bytes on all of those together.
+ *
+ * When one of them would go over, cached files that aren't open are dropped
+ *  first, least recently used first. If that's not enough, the file is
+ *  opened without caching it, a checkpoint isn't saved, PHYSFS_setBuffer()
+ *  and PHYSFS_setStreaming() fail, and opening a file from a 7zip archive
+ *  fails before decompressing anything, each with PHYSFS_ERR_OUT_OF_MEMORY.
+ *  Memory PhysicsFS can't work without, like an archive's directory or an
+ *  open file's own state, is never refused.
+ *
+ * There's no limit by default, and a (budget) of zero takes it away again.
+ *  Setting a budget below what's used right now drops what it can at once;
+ *  the rest is given back as it's freed.
+ *
+ *   \param budget most bytes for those things together, zero for no limit.
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_lowMemory
+ * \sa PHYSFS_getMemoryBudgetStats
+ */
+PHYSFS_DECL int PHYSFS_setMemoryBudget(PHYSFS_uint64 budget);
+
+/**
+ * \fn PHYSFS_uint64 PHYSFS_lowMemory(void)
+ * \brief Give back the memory PhysicsFS can do without, right now.
+ *
+ * This drops every cached file that isn't open (see
+ *  PHYSFS_setContentCache()), without changing any settings, so the cache
+ *  fills up again as files are opened. It's meant to be called when the
+ *  system is short of memory, for example from a thread watching for memory
+ *  pressure, and can be called from any thread.
+ *
+ *  \return bytes given back, zero if there was nothing to give back or the
+ *          library isn't initialized.
+ *
+ * \sa PHYSFS_setMemoryBudget
+ */
+PHYSFS_DECL PHYSFS_uint64 PHYSFS_lowMemory(void);
+
+/**
+ * \struct PHYSFS_MemoryBudgetStats
+ * \brief What's counted against the memory budget.
+ *
+ * \sa PHYSFS_getMemoryBudgetStats
+ */
+typedef struct PHYSFS_MemoryBudgetStats
+{
+    PHYSFS_uint64 budget;   /**< the ceiling, zero if there's none.       */
+    PHYSFS_uint64 used;     /**< bytes counted against it right now.      */
+    PHYSFS_uint64 peak;     /**< most bytes counted against it at once.   */
+    PHYSFS_uint64 trimmed;  /**< bytes of cached files dropped to fit.    */
+    PHYSFS_uint64 refused;  /**< times something didn't fit after that.   */
+} PHYSFS_MemoryBudgetStats;
+
+/**
+ * \fn int PHYSFS_getMemoryBudgetStats(PHYSFS_MemoryBudgetStats *stats)
+ * \brief See how close PhysicsFS is to its memory budget.
+ *
+ * What's used is counted even without a budget. The counters start at zero
+ *  in PHYSFS_init(); PHYSFS_lowMemory() doesn't count as trimming.
+ *
+ *   \param stats filled in with the current counters.
+ *  \return nonzero on success, zero on failure. Use
+ *          PHYSFS_getLastErrorCode() to obtain the specific error.
+ *
+ * \sa PHYSFS_setMemoryBudget
+ */
+PHYSFS_DECL int PHYSFS_getMemoryBudgetStats(PHYSFS_MemoryBudgetStats *stats);
+
+/**
+ * \struct PHYSFS_Allocator2
+ * \brief PhysicsFS allocation function pointers, with more to go on.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * This is PHYSFS_Allocator for allocators that want more than malloc()
+ *  gives them: every call gets back the (opaque) pointer you set here, is
+ *  told what the memory is for, and Free() and Realloc() are told how big
+ *  the block is, so a pool or size-class allocator doesn't have to keep
+ *  that itself.
+ *
+ * The sizes given are exactly what PhysicsFS passed to Malloc() or
+ *  Realloc() for that block, which is a little more than the library
+ *  needed: it keeps its own record of each block in front of it. A block
+ *  keeps the category it was allocated with through reallocations. The
+ *  category is only a hint; memory allocated on threads PhysicsFS starts
+ *  itself (see PHYSFS_setDecodeThreads() and PHYSFS_prefetch()) is
+ *  PHYSFS_MEMORY_OTHER unless it's decoding, as are blocks allocated where
+ *  thread-local storage isn't available.
+ *
+ * As with PHYSFS_Allocator, the functions have to be reentrant.
+ *
+ * \sa PHYSFS_setAllocator2
+ * \sa PHYSFS_MemoryCategory
+ */
+typedef struct PHYSFS_Allocator2
+{
+    /**
+     * \brief Binary compatibility information.
+     *
+     * This must be set to zero at this time. Future versions of this
+     *  struct will increment this field, so we know what a given
+     *  implementation supports.
+     */
+    PHYSFS_uint32 version;
+
+    /**
+     * \brief Instance data for your allocator.
+     *
+     * Passed to every function below. PhysicsFS doesn't touch it.
+     */
+    void *opaque;
+
+    /**
+     * \brief Initialize. Can be NULL. Zero on failure.
+     */
+    int (*Init)(void *opaque);
+
+    /**
+     * \brief Deinitialize your allocator. Can be NULL.
+     */
+    void (*Deinit)(void *opaque);
+
+    /**
+     * \brief Allocate (len) bytes, for (category), like malloc().
+     */
+    void *(*Malloc)(void *opaque, PHYSFS_uint64 len,
+                    PHYSFS_MemoryCategory category);
+
+    /**
+     * \brief Resize a (oldlen) byte block to (len) bytes, like realloc().
+     *
+     * (ptr) is never NULL; new blocks always come from Malloc().
+     */
+    void *(*Realloc)(void *opaque, void *ptr, PHYSFS_uint64 oldlen,
+                     PHYSFS_uint64 len, PHYSFS_MemoryCategory category);
+
+    /**
+     * \brief Free a (len) byte block from Malloc or Realloc.
+     *
+     * (ptr) is never NULL.
+     */
+    void (*Free)(void *opaque, void *ptr, PHYSFS_uint64 len,
+                 PHYSFS_MemoryCategory category);
+} PHYSFS_Allocator2;
+
+/**
+ * \fn int PHYSFS_setAllocator2(const PHYSFS_Allocator2 *allocator)
+ * \brief Hook your own sized, context-aware allocator into PhysicsFS.
+ *
+ * (This is for limited, hardcore use. If you don't immediately see a need
+ *  for it, you can probably ignore this forever.)
+ *
+ * This works like PHYSFS_setAllocator(), with a PHYSFS_Allocator2 instead:
+ *  you can only call it before PHYSFS_init() (or after PHYSFS_deinit()),
+ *  the allocator stays set between deinit/init calls, and passing NULL
+ *  goes back to the platform's default allocator. Whichever of the two
+ *  was called last wins.
+ *
+ * PHYSFS_getAllocator() still works while this is set: it returns a
+ *  PHYSFS_Allocator that calls yours, so code sharing PhysicsFS's
+ *  allocator doesn't need to know about this.
+ *
+ *    \param allocator Structure containing your allocator's entry points.
+ *   \return zero on failure, non-zero on success. This fails if the library
+ *           is initialized, with PHYSFS_ERR_UNSUPPORTED if (version) is
+ *           newer than this PhysicsFS knows, and with
+ *           PHYSFS_ERR_INVALID_ARGUMENT if Malloc, Realloc or Free is NULL.
+ *
+ * \sa PHYSFS_Allocator2
+ * \sa PHYSFS_setAllocator
+ */
+PHYSFS_DECL int PHYSFS_setAllocator2(const PHYSFS_Allocator2 *allocator);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* !defined _INCLUDE_PHYSFS_H_ */
+
+/* end of physfs.h ... */
+
+
+#if defined(PHYSFS_IMPL) || defined(PHYSFS_PLATFORM_IMPL)
+
+#ifdef PHYSFS_SUPPORTS_ONLY_ZIP
+#define PHYSFS_SUPPORTS_DEFAULT 0
+#define PHYSFS_SUPPORTS_ZIP 1
+#endif
+#ifdef PHYSFS_SUPPORTS_ONLY_7Z
+#define PHYSFS_SUPPORTS_DEFAULT 0
+#define PHYSFS_SUPPORTS_7Z 1
+#endif
+#ifdef PHYSFS_SUPPORTS_ONLY_GRP
+#define PHYSFS_SUPPORTS_DEFAULT 0
+#define PHYSFS_SUPPORTS_GRP 1
+#endif
+#ifdef PHYSFS_SUPPORTS_ONLY_WAD
+#define PHYSFS_SUPPORTS_DEFAULT 0
+#define PHYSFS_SUPPORTS_WAD 1
+#endif
+#ifdef PHYSFS_SUPPORTS_ONLY_HOG
+#define PHYSFS_SUPPORTS_DEFAULT 0
+#define PHYSFS_SUPPORTS_HOG 1
+#endif
+#ifdef PHYSFS_SUPPORTS_ONLY_MVL
+#define PHYSFS_SUPPORTS_DEFAULT 0
+#define PHYSFS_SUPPORTS_MVL 1
+#endif
+#ifdef PHYSFS_SUPPORTS_ONLY_QPAK
+#define PHYSFS_SUPPORTS_DEFAULT 0
+#define PHYSFS_SUPPORTS_QPAK 1
+#endif
+#ifdef PHYSFS_SUPPORTS_ONLY_SLB
+#define PHYSFS_SUPPORTS_DEFAULT 0
+#define PHYSFS_SUPPORTS_SLB 1
+#endif
+#ifdef PHYSFS_SUPPORTS_ONLY_ISO9660
+#define PHYSFS_SUPPORTS_DEFAULT 0
+#define PHYSFS_SUPPORTS_ISO966010
+#endif
+#ifdef PHYSFS_SUPPORTS_ONLY_VDF
+#define PHYSFS_SUPPORTS_DEFAULT 0
+#define PHYSFS_SUPPORTS_VDF 1
+#endif
+
+#ifdef PHYSFS_SUPPORTS_NO_ZIP
+#define PHYSFS_SUPPORTS_ZIP 0
+#endif
+#ifdef PHYSFS_SUPPORTS_NO_7Z
+#define PHYSFS_SUPPORTS_7Z 0
+#endif
+#ifdef PHYSFS_SUPPORTS_NO_GRP
+#define PHYSFS_SUPPORTS_GRP 0
+#endif
+#ifdef PHYSFS_SUPPORTS_NO_WAD
+#define PHYSFS_SUPPORTS_WAD 0
+#endif
+#ifdef PHYSFS_SUPPORTS_NO_HOG
+#define PHYSFS_SUPPORTS_HOG 0
+#endif
+#ifdef PHYSFS_SUPPORTS_NO_MVL
+#define PHYSFS_SUPPORTS_MVL 0
+#endif
+#ifdef PHYSFS_SUPPORTS_NO_QPAK
+#define PHYSFS_SUPPORTS_QPAK 0
+#endif
+#ifdef PHYSFS_SUPPORTS_NO_SLB
+#define PHYSFS_SUPPORTS_SLB 0
+#endif
+#ifdef PHYSFS_SUPPORTS_NO_ISO9660
+#define PHYSFS_SUPPORTS_ISO9660 0
+#endif
+#ifdef PHYSFS_SUPPORTS_NO_VDF
+#define PHYSFS_SUPPORTS_VDF 0
+#endif
+
+#define __PHYSICSFS_INTERNAL__
+
+/*
+ * Internal function/structure declaration. Do NOT include in your
+ *  application.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ *
+ *  This file written by Ryan C. Gordon.
+ */
+
+#ifndef _INCLUDE_PHYSFS_INTERNAL_H_
+#define _INCLUDE_PHYSFS_INTERNAL_H_
+
+#ifndef __PHYSICSFS_INTERNAL__
+#error Do not include this header from your applications.
+#endif
+
+/* Turn off MSVC warnings that are aggressively anti-portability. */
+#if defined(_MSC_VER) && !defined(_CRT_SECURE_NO_WARNINGS)
+#define _CRT_SECURE_NO_WARNINGS 1
+#endif
+
+/*#include "physfs.h"*/
+
+/* The holy trinity. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*#include "physfs_platforms.h"*/
+#ifndef _INCL_PHYSFS_PLATFORMS
+#define _INCL_PHYSFS_PLATFORMS
+
+#ifndef __PHYSICSFS_INTERNAL__
+#error Do not include this header from your applications.
+#endif
+
+/*
+ * These only define the platforms to determine which files in the platforms
+ *  directory should be compiled. For example, technically BeOS can be called
+ *  a "unix" system, but since it doesn't use unix.c, we don't define
+ *  PHYSFS_PLATFORM_UNIX on that system.
+ */
+
+#if (defined __HAIKU__)
+#  define PHYSFS_PLATFORM_HAIKU 1
+#  define PHYSFS_PLATFORM_POSIX 1
+#elif ((defined __BEOS__) || (defined __beos__))
+#  error BeOS support was dropped since PhysicsFS 2.1. Sorry. Try Haiku!
+#elif (defined _WIN32_WCE) || (defined _WIN64_WCE)
+#  error PocketPC support was dropped since PhysicsFS 2.1. Sorry. Try WinRT!
+#elif (defined(_MSC_VER) && (_MSC_VER >= 1700) && !_USING_V110_SDK71_)  /* _MSC_VER==1700 for MSVC 2012 */
+#  include <winapifamily.h>
+#  define PHYSFS_PLATFORM_WINDOWS 1
+#  if WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_APP) && !WINAPI_FAMILY_PARTITION(WINAPI_PARTITION_DESKTOP)
+#    define PHYSFS_NO_CDROM_SUPPORT 1
+#    define PHYSFS_PLATFORM_WINRT 1
+#  endif
+#elif (((defined _WIN32) || (defined _WIN64)) && (!defined __CYGWIN__))
+#  define PHYSFS_PLATFORM_WINDOWS 1
+#elif defined(__OS2__) || defined(OS2)
+#  define PHYSFS_PLATFORM_OS2 1
+#elif ((defined __MACH__) && (defined __APPLE__))
+/* To check if iOS or not, we need to include this file */
+#  include <TargetConditionals.h>
+#  if ((TARGET_IPHONE_SIMULATOR) || (TARGET_OS_IPHONE))
+#     define PHYSFS_NO_CDROM_SUPPORT 1
+#  endif
+#  define PHYSFS_PLATFORM_APPLE 1
+#  define PHYSFS_PLATFORM_POSIX 1
+#elif defined(macintosh)
+#  error Classic Mac OS support was dropped from PhysicsFS 2.0. Move to OS X.
+#elif defined(__ANDROID__)
+ #  define PHYSFS_PLATFORM_LINUX 1
+ #  define PHYSFS_PLATFORM_ANDROID 1
+ #  define PHYSFS_PLATFORM_POSIX 1
+ #  define PHYSFS_NO_CDROM_SUPPORT 1
+#elif defined(__linux)
+#  define PHYSFS_PLATFORM_LINUX 1
+#  define PHYSFS_PLATFORM_UNIX 1
+#  define PHYSFS_PLATFORM_POSIX 1
+#elif defined(__sun) || defined(sun)
+#  define PHYSFS_PLATFORM_SOLARIS 1
+#  define PHYSFS_PLATFORM_UNIX 1
 #  define PHYSFS_PLATFORM_POSIX 1
 #elif defined(__FreeBSD__) || defined(__FreeBSD_kernel__) || defined(__DragonFly__)
 #  define PHYSFS_PLATFORM_FREEBSD 1
@@ -4154,1823 +5404,4008 @@ PHYSFS_DECL int PHYSFS_setRoot(const char *archive, const char *subdir);
 #  define PHYSFS_PLATFORM_UNIX 1
 #  define PHYSFS_PLATFORM_POSIX 1
 #else
-#  error Unknown platform.
+#  error Unknown platform.
+#endif
+
+#endif  /* include-once blocker. */
+
+
+#include <assert.h>
+
+#define __PHYSFS_COMPILE_TIME_ASSERT(name, x) \
+       typedef int __PHYSFS_compile_time_assert_##name[(x) * 2 - 1]
+
+/* !!! FIXME: remove this when revamping stack allocation code... */
+#if defined(_MSC_VER) || defined(__MINGW32__) || defined(__WATCOMC__)
+#include <malloc.h>
+#endif
+
+#ifdef PHYSFS_PLATFORM_SOLARIS
+#include <alloca.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __GNUC__
+#define PHYSFS_MINIMUM_GCC_VERSION(major, minor) \
+    ( ((__GNUC__ << 16) + __GNUC_MINOR__) >= (((major) << 16) + (minor)) )
+#else
+#define PHYSFS_MINIMUM_GCC_VERSION(major, minor) (0)
+#endif
+
+#ifdef __cplusplus
+    /* C++ always has a real inline keyword. */
+#elif (defined macintosh) && !(defined __MWERKS__)
+#   define inline
+#elif (defined _MSC_VER)
+#   define inline __inline
+#endif
+
+#if defined(PHYSFS_PLATFORM_LINUX) && !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS 64
+#endif
+
+/* All public APIs need to be in physfs.h with a PHYSFS_DECL.
+   All file-private symbols need to be marked "static".
+   Everything shared between PhysicsFS sources needs to be in this
+   file between the visibility pragma blocks. */
+#if PHYSFS_MINIMUM_GCC_VERSION(4,0) || defined(__clang__)
+#define PHYSFS_HAVE_PRAGMA_VISIBILITY 1
+#endif
+
+#if PHYSFS_HAVE_PRAGMA_VISIBILITY
+#pragma GCC visibility push(hidden)
+#endif
+
+/* These are the build-in archivers. We list them all as "extern" here without
+   #ifdefs to keep it tidy, but obviously you need to make sure these are
+   wrapped in PHYSFS_SUPPORTS_* checks before actually referencing them. */
+extern const PHYSFS_Archiver __PHYSFS_Archiver_DIR;
+extern const PHYSFS_Archiver __PHYSFS_Archiver_ZIP;
+extern const PHYSFS_Archiver __PHYSFS_Archiver_7Z;
+extern const PHYSFS_Archiver __PHYSFS_Archiver_GRP;
+extern const PHYSFS_Archiver __PHYSFS_Archiver_QPAK;
+extern const PHYSFS_Archiver __PHYSFS_Archiver_HOG;
+extern const PHYSFS_Archiver __PHYSFS_Archiver_MVL;
+extern const PHYSFS_Archiver __PHYSFS_Archiver_WAD;
+extern const PHYSFS_Archiver __PHYSFS_Archiver_SLB;
+extern const PHYSFS_Archiver __PHYSFS_Archiver_ISO9660;
+extern const PHYSFS_Archiver __PHYSFS_Archiver_VDF;
+
+/* a real C99-compliant snprintf() is in Visual Studio 2015,
+   but just use this everywhere for binary compatibility. */
+#if defined(_MSC_VER)
+#include <stdarg.h>
+int __PHYSFS_msvc_vsnprintf(char *outBuf, size_t size, const char *format, va_list ap);
+int __PHYSFS_msvc_snprintf(char *outBuf, size_t size, const char *format, ...);
+#define vsnprintf __PHYSFS_msvc_vsnprintf
+#define snprintf __PHYSFS_msvc_snprintf
+#endif
+
+/* Some simple wrappers around WinRT C++ interfaces we can call from C. */
+#ifdef PHYSFS_PLATFORM_WINRT
+const void *__PHYSFS_winrtCalcBaseDir(void);
+const void *__PHYSFS_winrtCalcPrefDir(void);
+#endif
+
+/* atomic operations. INCR and DECR return the new value. */
+#if defined(_MSC_VER) && (_MSC_VER >= 1500)
+#include <intrin.h>
+__PHYSFS_COMPILE_TIME_ASSERT(LongEqualsInt, sizeof (int) == sizeof (long));
+#define __PHYSFS_ATOMIC_INCR(ptrval) _InterlockedIncrement((long*)(ptrval))
+#define __PHYSFS_ATOMIC_DECR(ptrval) _InterlockedDecrement((long*)(ptrval))
+#if defined(_M_X64) || defined(_M_ARM64)
+#define __PHYSFS_ATOMIC_ADD64(ptrval, val) _InterlockedExchangeAdd64((__int64*)(ptrval), (__int64)(val))
+#endif
+#elif defined(__clang__) || (defined(__GNUC__) && (((__GNUC__ * 10000) + (__GNUC_MINOR__ * 100)) >= 40100))
+#define __PHYSFS_ATOMIC_INCR(ptrval) __sync_add_and_fetch(ptrval, 1)
+#define __PHYSFS_ATOMIC_DECR(ptrval) __sync_add_and_fetch(ptrval, -1)
+#define __PHYSFS_ATOMIC_ADD64(ptrval, val) __sync_fetch_and_add(ptrval, val)
+#else
+#define PHYSFS_NEED_ATOMIC_OP_FALLBACK 1
+int __PHYSFS_ATOMIC_INCR(volatile int *ptrval);
+int __PHYSFS_ATOMIC_DECR(volatile int *ptrval);
+#endif
+
+/* 64-bit adds are only used for statistics, so a racy fallback is fine. */
+#ifndef __PHYSFS_ATOMIC_ADD64
+#define __PHYSFS_ATOMIC_ADD64(ptrval, val) (*(ptrval) += (val))
+#endif
+
+/*
+ * For data read without a lock: a LOAD that sees what a STORE wrote also
+ *  sees everything written before that STORE. Without the __atomic builtins,
+ *  these are plain accesses to data declared volatile, which MSVC orders
+ *  like this on x86 and x64 (and ARM, with /volatile:ms).
+ */
+#if defined(__ATOMIC_ACQUIRE)
+#define __PHYSFS_ATOMIC_LOAD(ptrval) __atomic_load_n(ptrval, __ATOMIC_ACQUIRE)
+#define __PHYSFS_ATOMIC_STORE(ptrval, val) __atomic_store_n(ptrval, val, __ATOMIC_RELEASE)
+#else
+#define __PHYSFS_ATOMIC_LOAD(ptrval) (*(ptrval))
+#define __PHYSFS_ATOMIC_STORE(ptrval, val) (*(ptrval) = (val))
+#endif
+
+
+/*
+ * Interface for small allocations. If you need a little scratch space for
+ *  a throwaway buffer or string, use this. It will make small allocations
+ *  on the stack if possible, and use allocator.Malloc() if they are too
+ *  large. This helps reduce malloc pressure.
+ * There are some rules, though:
+ * NEVER return a pointer from this, as stack-allocated buffers go away
+ *  when your function returns.
+ * NEVER allocate in a loop, as stack-allocated pointers will pile up. Call
+ *  a function that uses smallAlloc from your loop, so the allocation can
+ *  free each time.
+ * NEVER call smallAlloc with any complex expression (it's a macro that WILL
+ *  have side effects...it references the argument multiple times). Use a
+ *  variable or a literal.
+ * NEVER free a pointer from this with anything but smallFree. It will not
+ *  be a valid pointer to the allocator, regardless of where the memory came
+ *  from.
+ * NEVER realloc a pointer from this.
+ * NEVER forget to use smallFree: it may not be a pointer from the stack.
+ * NEVER forget to check for NULL...allocation can fail here, of course!
+ */
+#define __PHYSFS_SMALLALLOCTHRESHOLD 256
+void *__PHYSFS_initSmallAlloc(void *ptr, const size_t len);
+
+#define __PHYSFS_smallAlloc(bytes) ( \
+    __PHYSFS_initSmallAlloc( \
+        (((bytes) < __PHYSFS_SMALLALLOCTHRESHOLD) ? \
+            alloca((size_t)((bytes)+sizeof(void*))) : NULL), (bytes)) \
+)
+
+void __PHYSFS_smallFree(void *ptr);
+
+
+/* Use the allocation hooks. */
+#define malloc(x) Do not use malloc() directly.
+#define realloc(x, y) Do not use realloc() directly.
+#define free(x) Do not use free() directly.
+/* !!! FIXME: add alloca check here. */
+
+
+/* by default, enable things, so builds can opt out of a few things they
+   want to avoid. But you can build with this #defined to 0 if you would
+   like to turn off everything except a handful of things you opt into. */
+#ifndef PHYSFS_SUPPORTS_DEFAULT
+#define PHYSFS_SUPPORTS_DEFAULT 1
+#endif
+
+
+#ifndef PHYSFS_SUPPORTS_ZIP
+#define PHYSFS_SUPPORTS_ZIP PHYSFS_SUPPORTS_DEFAULT
+#endif
+#ifndef PHYSFS_SUPPORTS_7Z
+#define PHYSFS_SUPPORTS_7Z PHYSFS_SUPPORTS_DEFAULT
+#endif
+#ifndef PHYSFS_SUPPORTS_GRP
+#define PHYSFS_SUPPORTS_GRP PHYSFS_SUPPORTS_DEFAULT
+#endif
+#ifndef PHYSFS_SUPPORTS_HOG
+#define PHYSFS_SUPPORTS_HOG PHYSFS_SUPPORTS_DEFAULT
+#endif
+#ifndef PHYSFS_SUPPORTS_MVL
+#define PHYSFS_SUPPORTS_MVL PHYSFS_SUPPORTS_DEFAULT
+#endif
+#ifndef PHYSFS_SUPPORTS_WAD
+#define PHYSFS_SUPPORTS_WAD PHYSFS_SUPPORTS_DEFAULT
+#endif
+#ifndef PHYSFS_SUPPORTS_QPAK
+#define PHYSFS_SUPPORTS_QPAK PHYSFS_SUPPORTS_DEFAULT
+#endif
+#ifndef PHYSFS_SUPPORTS_SLB
+#define PHYSFS_SUPPORTS_SLB PHYSFS_SUPPORTS_DEFAULT
+#endif
+#ifndef PHYSFS_SUPPORTS_ISO9660
+#define PHYSFS_SUPPORTS_ISO9660 PHYSFS_SUPPORTS_DEFAULT
+#endif
+#ifndef PHYSFS_SUPPORTS_VDF
+#define PHYSFS_SUPPORTS_VDF PHYSFS_SUPPORTS_DEFAULT
+#endif
+
+/* instrumentation is opt-in, as it adds work to the hot paths. */
+#ifndef PHYSFS_SUPPORTS_STATS
+#define PHYSFS_SUPPORTS_STATS 0
+#endif
+#ifndef PHYSFS_SUPPORTS_TRACE
+#define PHYSFS_SUPPORTS_TRACE 0
+#endif
+#ifndef PHYSFS_SUPPORTS_LOCK_PROFILE
+#define PHYSFS_SUPPORTS_LOCK_PROFILE 0
+#endif
+#ifndef PHYSFS_SUPPORTS_MEMORY_STATS
+#define PHYSFS_SUPPORTS_MEMORY_STATS 0
+#endif
+
+#if PHYSFS_SUPPORTS_7Z
+/* 7zip support needs a global init function called at startup (no deinit). */
+extern void SZIP_global_init(void);
+#endif
+
+/* The latest supported PHYSFS_Io::version value. */
+#define CURRENT_PHYSFS_IO_API_VERSION 1
+
+/* The latest supported PHYSFS_Archiver::version value. */
+#define CURRENT_PHYSFS_ARCHIVER_API_VERSION 0
+
+/* The latest supported PHYSFS_Allocator2::version value. */
+#define CURRENT_PHYSFS_ALLOCATOR2_API_VERSION 0
+
+/* This byteorder stuff was lifted from SDL. https://www.libsdl.org/ */
+#define PHYSFS_LIL_ENDIAN  1234
+#define PHYSFS_BIG_ENDIAN  4321
+
+#ifdef __linux__
+#include <endian.h>
+#define PHYSFS_BYTEORDER  __BYTE_ORDER
+#else /* __linux__ */
+#if defined(__hppa__) || \
+    defined(__m68k__) || defined(mc68000) || defined(_M_M68K) || \
+    (defined(__MIPS__) && defined(__MISPEB__)) || \
+    defined(__ppc__) || defined(__POWERPC__) || defined(_M_PPC) || \
+    defined(__sparc__)
+#define PHYSFS_BYTEORDER   PHYSFS_BIG_ENDIAN
+#else
+#define PHYSFS_BYTEORDER   PHYSFS_LIL_ENDIAN
+#endif
+#endif /* __linux__ */
+
+
+/*
+ * When sorting the entries in an archive, we use a modified QuickSort.
+ *  When there are less then PHYSFS_QUICKSORT_THRESHOLD entries left to sort,
+ *  we switch over to a BubbleSort for the remainder. Tweak to taste.
+ *
+ * You can override this setting by defining PHYSFS_QUICKSORT_THRESHOLD
+ *  before #including "physfs_internal.h".
+ */
+#ifndef PHYSFS_QUICKSORT_THRESHOLD
+#define PHYSFS_QUICKSORT_THRESHOLD 4
+#endif
+
+/*
+ * Sort an array (or whatever) of (max) elements. This uses a mixture of
+ *  a QuickSort and BubbleSort internally.
+ * (cmpfn) is used to determine ordering, and (swapfn) does the actual
+ *  swapping of elements in the list.
+ */
+void __PHYSFS_sort(void *entries, size_t max,
+                   int (*cmpfn)(void *, size_t, size_t),
+                   void (*swapfn)(void *, size_t, size_t));
+
+/*
+ * Release a mutex held by the library core. This is just
+ *  __PHYSFS_platformReleaseMutex(), unless lock profiling is built in, in
+ *  which case it also finishes timing how long the lock was held.
+ */
+#if PHYSFS_SUPPORTS_LOCK_PROFILE
+void __PHYSFS_releaseMutex(void *mutex);
+#else
+#define __PHYSFS_releaseMutex(m) __PHYSFS_platformReleaseMutex(m)
+#endif
+
+/* These get used all over for lessening code clutter. */
+/* "ERRPASS" means "something else just set the error state for us" and is
+    just to make it clear where the responsibility for the error state lays. */
+#define BAIL(e, r) do { if (e) PHYSFS_setErrorCode(e); return r; } while (0)
+#define BAIL_ERRPASS(r) do { return r; } while (0)
+#define BAIL_IF(c, e, r) do { if (c) { if (e) PHYSFS_setErrorCode(e); return r; } } while (0)
+#define BAIL_IF_ERRPASS(c, r) do { if (c) { return r; } } while (0)
+#define BAIL_MUTEX(e, m, r) do { if (e) PHYSFS_setErrorCode(e); __PHYSFS_releaseMutex(m); return r; } while (0)
+#define BAIL_MUTEX_ERRPASS(m, r) do { __PHYSFS_releaseMutex(m); return r; } while (0)
+#define BAIL_IF_MUTEX(c, e, m, r) do { if (c) { if (e) PHYSFS_setErrorCode(e); __PHYSFS_releaseMutex(m); return r; } } while (0)
+#define BAIL_IF_MUTEX_ERRPASS(c, m, r) do { if (c) { __PHYSFS_releaseMutex(m); return r; } } while (0)
+#define GOTO(e, g) do { if (e) PHYSFS_setErrorCode(e); goto g; } while (0)
+#define GOTO_ERRPASS(g) do { goto g; } while (0)
+#define GOTO_IF(c, e, g) do { if (c) { if (e) PHYSFS_setErrorCode(e); goto g; } } while (0)
+#define GOTO_IF_ERRPASS(c, g) do { if (c) { goto g; } } while (0)
+#define GOTO_MUTEX(e, m, g) do { if (e) PHYSFS_setErrorCode(e); __PHYSFS_releaseMutex(m); goto g; } while (0)
+#define GOTO_MUTEX_ERRPASS(m, g) do { __PHYSFS_releaseMutex(m); goto g; } while (0)
+#define GOTO_IF_MUTEX(c, e, m, g) do { if (c) { if (e) PHYSFS_setErrorCode(e); __PHYSFS_releaseMutex(m); goto g; } } while (0)
+#define GOTO_IF_MUTEX_ERRPASS(c, m, g) do { if (c) { __PHYSFS_releaseMutex(m); goto g; } } while (0)
+
+#define __PHYSFS_ARRAYLEN(x) ( (sizeof (x)) / (sizeof (x[0])) )
+
+#ifdef PHYSFS_NO_64BIT_SUPPORT
+#define __PHYSFS_SI64(x) ((PHYSFS_sint64) (x))
+#define __PHYSFS_UI64(x) ((PHYSFS_uint64) (x))
+#elif (defined __GNUC__)
+#define __PHYSFS_SI64(x) x##LL
+#define __PHYSFS_UI64(x) x##ULL
+#elif (defined _MSC_VER)
+#define __PHYSFS_SI64(x) x##i64
+#define __PHYSFS_UI64(x) x##ui64
+#else
+#define __PHYSFS_SI64(x) ((PHYSFS_sint64) (x))
+#define __PHYSFS_UI64(x) ((PHYSFS_uint64) (x))
+#endif
+
+
+/*
+ * Check if a ui64 will fit in the platform's address space.
+ *  The initial sizeof check will optimize this macro out entirely on
+ *  64-bit (and larger?!) platforms, and the other condition will
+ *  return zero or non-zero if the variable will fit in the platform's
+ *  size_t, suitable to pass to malloc. This is kinda messy, but effective.
+ */
+#define __PHYSFS_ui64FitsAddressSpace(s) ( \
+    (sizeof (PHYSFS_uint64) <= sizeof (size_t)) || \
+    ((s) < (__PHYSFS_UI64(0xFFFFFFFFFFFFFFFF) >> (64-(sizeof(size_t)*8)))) \
+)
+
+/*
+ * Like strdup(), but uses the current PhysicsFS allocator.
+ */
+char *__PHYSFS_strdup(const char *str);
+
+/*
+ * Where the index of the archive at (path), in platform-dependent notation,
+ *  goes in the PHYSFS_setIndexCache() directory. The caller frees it. NULL
+ *  if there's no index cache, or no memory to say.
+ */
+char *__PHYSFS_indexCachePath(const char *path);
+
+/*
+ * Give a hash value for a C string (uses djb's xor hashing algorithm).
+ */
+PHYSFS_uint32 __PHYSFS_hashString(const char *str, size_t len);
+
+
+/*
+ * The current allocator. Not valid before PHYSFS_init is called!
+ */
+extern PHYSFS_Allocator __PHYSFS_AllocatorHooks;
+
+/* convenience macro to make this less cumbersome internally... */
+#define allocator __PHYSFS_AllocatorHooks
+#define physfs_allocator __PHYSFS_AllocatorHooks
+/*
+ * Create a PHYSFS_Io for a file in the physical filesystem.
+ *  This path is in platform-dependent notation. (mode) must be 'r', 'w', or
+ *  'a' for Read, Write, or Append.
+ */
+PHYSFS_Io *__PHYSFS_createNativeIo(const char *path, const int mode);
+
+/*
+ * Create a PHYSFS_Io for a buffer of memory (READ-ONLY). If you already
+ *  have one of these, just use its duplicate() method, and it'll increment
+ *  its refcount without allocating a copy of the buffer.
+ */
+PHYSFS_Io *__PHYSFS_createMemoryIo(const void *buf, PHYSFS_uint64 len,
+                                   void (*destruct)(void *));
+
+
+/*
+ * Read (len) bytes from (io) into (buf). Returns non-zero on success,
+ *  zero on i/o error. Literally: "return (io->read(io, buf, len) == len);"
+ */
+int __PHYSFS_readAll(PHYSFS_Io *io, void *buf, const size_t len);
+
+/* nonzero if (io) has a readAt() method we can call. */
+#define __PHYSFS_ioHasReadAt(io) (((io)->version >= 1) && ((io)->readAt != NULL))
+
+/*
+ * Positional reads that work on any PHYSFS_Io. They use readAt() and
+ *  readv() if (io) has them; otherwise they seek and read, which moves
+ *  the i/o position, so only do that to i/o you own or hold stateLock for.
+ *  The return values are those of PHYSFS_Io::readAt() and readv().
+ */
+PHYSFS_sint64 __PHYSFS_readAt(PHYSFS_Io *io, PHYSFS_uint64 offset,
+                              void *buf, PHYSFS_uint64 len);
+PHYSFS_sint64 __PHYSFS_readv(PHYSFS_Io *io, const PHYSFS_IoVec *vec,
+                             PHYSFS_uint32 count);
+
+/* like __PHYSFS_readAll(), at (offset). */
+int __PHYSFS_readAllAt(PHYSFS_Io *io, PHYSFS_uint64 offset,
+                       void *buf, const size_t len);
+
+/*
+ * Get a private read-only stream over (io) for an archiver to hand out
+ *  from openRead(). If (io) has readAt(), this is just a position of its
+ *  own that reads through it, with no file handle to open and no seek
+ *  calls; (io) must outlive it, which the archive's i/o always does.
+ *  Otherwise, it's io->duplicate(io).
+ */
+PHYSFS_Io *__PHYSFS_duplicateForRead(PHYSFS_Io *io);
+
+
+/*
+ * Forget the current thread's error state. Threads PhysicsFS starts itself
+ *  call this before they end, so their state doesn't pile up until deinit.
+ */
+void __PHYSFS_freeThreadErrorState(void);
+
+
+#if PHYSFS_SUPPORTS_STATS
+/*
+ * I/O statistics. __PHYSFS_STAT_ADD() bumps a counter in the global block
+ *  and, if (s) isn't NULL, in the per-archive block (s), too.
+ *  Native and memory PHYSFS_Io instances that back a mounted archive carry
+ *  a pointer to that archive's block (duplicates inherit it), so archivers
+ *  can find it with __PHYSFS_getIoStats(). It returns NULL for any other
+ *  i/o, including app-provided ones. __PHYSFS_setIoStats() is a no-op
+ *  for i/o it doesn't recognize.
+ */
+extern PHYSFS_IoStats __PHYSFS_GlobalIoStats;
+void __PHYSFS_setIoStats(PHYSFS_Io *io, PHYSFS_IoStats *stats);
+PHYSFS_IoStats *__PHYSFS_getIoStats(PHYSFS_Io *io);
+#define __PHYSFS_STAT_ADD(s, field, n) do { \
+    PHYSFS_IoStats *__physfs_stats = (s); \
+    const PHYSFS_uint64 __physfs_statval = (PHYSFS_uint64) (n); \
+    __PHYSFS_ATOMIC_ADD64(&__PHYSFS_GlobalIoStats.field, __physfs_statval); \
+    if (__physfs_stats != NULL) \
+        __PHYSFS_ATOMIC_ADD64(&__physfs_stats->field, __physfs_statval); \
+} while (0)
+#else
+#define __PHYSFS_STAT_ADD(s, field, n) do {} while (0)
+#endif
+
+
+/*
+ * Memory accounting. Blocks from the allocator are charged to the category
+ *  and archive the current thread is working for, which physfs.c sets
+ *  around its calls into archivers; the category is also the hint given to
+ *  a PHYSFS_Allocator2. This changes the category for what this thread
+ *  allocates next, and returns the old one, to put back when done. Without
+ *  thread-local storage, it does nothing.
+ */
+int __PHYSFS_setMemoryCategory(const int category);
+
+/*
+ * The memory budget (see PHYSFS_setMemoryBudget()). Count (len) bytes of
+ *  optional memory against it before allocating them, and give them back
+ *  once they're freed. Reserving fails with PHYSFS_ERR_OUT_OF_MEMORY if
+ *  they don't fit. If (trim) is non-zero, it drops cached files to make
+ *  room first, which takes stateLock, so only ask for that when waiting on
+ *  it can't deadlock.
+ */
+int __PHYSFS_memoryReserve(const PHYSFS_uint64 len, const int trim);
+void __PHYSFS_memoryRelease(const PHYSFS_uint64 len);
+
+
+/* These are shared between some archivers. */
+
+void UNPK_abandonArchive(void *opaque);
+void UNPK_closeArchive(void *opaque);
+void *UNPK_openArchive(PHYSFS_Io *io);
+void *UNPK_addEntry(void *opaque, char *name, const int isdir,
+                    const PHYSFS_sint64 ctime, const PHYSFS_sint64 mtime,
+                    const PHYSFS_uint64 pos, const PHYSFS_uint64 len);
+PHYSFS_Io *UNPK_openRead(void *opaque, const char *name);
+PHYSFS_Io *UNPK_openWrite(void *opaque, const char *name);
+PHYSFS_Io *UNPK_openAppend(void *opaque, const char *name);
+int UNPK_remove(void *opaque, const char *name);
+int UNPK_mkdir(void *opaque, const char *name);
+int UNPK_stat(void *opaque, const char *fn, PHYSFS_Stat *st);
+#define UNPK_enumerate __PHYSFS_DirTreeEnumerate
+
+/*
+ * Find where the data of file (name) is stored: set (*_io) to the archive's
+ *  own i/o and fill in everything in (stat) but the archive path. For ZIP
+ *  this resolves the entry's local header like an open would. Returns zero
+ *  and sets the error code if there's no such file.
+ */
+int UNPK_statPhysical(void *opaque, const char *name, PHYSFS_Io **_io,
+                      PHYSFS_PhysicalStat *stat);
+#if PHYSFS_SUPPORTS_ZIP
+int ZIP_statPhysical(void *opaque, const char *name, PHYSFS_Io **_io,
+                     PHYSFS_PhysicalStat *stat);
+#endif
+
+/*
+ * If (io) is a file opened by this archiver, and reading it copies bytes
+ *  straight out of the archive, set (*_io) to the i/o it reads them from,
+ *  (*_pos) to where in there its current position is, and (*_avail) to the
+ *  bytes left before EOF. Returns zero for anything else, like compressed
+ *  or encrypted files, without setting an error code.
+ */
+int UNPK_rawRange(PHYSFS_Io *io, PHYSFS_Io **_io, PHYSFS_uint64 *_pos,
+                  PHYSFS_uint64 *_avail);
+#if PHYSFS_SUPPORTS_ZIP
+int ZIP_rawRange(PHYSFS_Io *io, PHYSFS_Io **_io, PHYSFS_uint64 *_pos,
+                 PHYSFS_uint64 *_avail);
+#endif
+
+/*
+ * If (io) is a file opened by this archiver, return the i/o it reads the
+ *  archive through, compressed or not. Returns NULL for anything else,
+ *  without setting an error code.
+ */
+PHYSFS_Io *UNPK_rawIo(PHYSFS_Io *io);
+#if PHYSFS_SUPPORTS_ZIP
+PHYSFS_Io *ZIP_rawIo(PHYSFS_Io *io);
+#endif
+
+#if PHYSFS_SUPPORTS_ZIP
+/*
+ * If (io) is a file opened by the ZIP archiver, let big reads on it decode
+ *  on up to (threads) threads. Returns zero for anything else.
+ */
+int ZIP_setDecodeThreads(PHYSFS_Io *io, PHYSFS_uint32 threads);
+#endif
+
+
+
+/* Optional API many archivers use this to manage their directory tree. */
+/* !!! FIXME: document this better. */
+
+typedef struct __PHYSFS_DirTreeEntry
+{
+    char *name;                              /* Full path in archive.        */
+    struct __PHYSFS_DirTreeEntry *hashnext;  /* next item in hash bucket.    */
+    struct __PHYSFS_DirTreeEntry *children;  /* linked list of kids, if dir. */
+    struct __PHYSFS_DirTreeEntry *sibling;   /* next item in same dir.       */
+    int isdir;
+} __PHYSFS_DirTreeEntry;
+
+typedef struct __PHYSFS_DirTree
+{
+    __PHYSFS_DirTreeEntry *root;    /* root of directory tree.             */
+    __PHYSFS_DirTreeEntry **hash;  /* all entries hashed for fast lookup. */
+    size_t hashBuckets;            /* number of buckets in hash.          */
+    size_t hashEntries;            /* number of entries in hash.          */
+    size_t entrylen;    /* size in bytes of entries (including subclass). */
+} __PHYSFS_DirTree;
+
+
+int __PHYSFS_DirTreeInit(__PHYSFS_DirTree *dt, const size_t entrylen);
+void *__PHYSFS_DirTreeAdd(__PHYSFS_DirTree *dt, char *name, const int isdir);
+void *__PHYSFS_DirTreeFind(__PHYSFS_DirTree *dt, const char *path);
+PHYSFS_EnumerateCallbackResult __PHYSFS_DirTreeEnumerate(void *opaque,
+                              const char *dname, PHYSFS_EnumerateCallback cb,
+                              const char *origdir, void *callbackdata);
+void __PHYSFS_DirTreeDeinit(__PHYSFS_DirTree *dt);
+
+
+
+/*--------------------------------------------------------------------------*/
+/*--------------------------------------------------------------------------*/
+/*------------                                              ----------------*/
+/*------------  You MUST implement the following functions  ----------------*/
+/*------------        if porting to a new platform.         ----------------*/
+/*------------     (see platform/unix.c for an example)     ----------------*/
+/*------------                                              ----------------*/
+/*--------------------------------------------------------------------------*/
+/*--------------------------------------------------------------------------*/
+
+
+/*
+ * The dir separator; '/' on unix, '\\' on win32, ":" on MacOS, etc...
+ *  Obviously, this isn't a function. If you need more than one char for this,
+ *  you'll need to pull some old pieces of PhysicsFS out of revision control.
+ */
+#if defined(PHYSFS_PLATFORM_WINDOWS) || defined(PHYSFS_PLATFORM_OS2)
+#define __PHYSFS_platformDirSeparator '\\'
+#else
+#define __PHYSFS_STANDARD_DIRSEP 1
+#define __PHYSFS_platformDirSeparator '/'
+#endif
+
+/*
+ * Initialize the platform. This is called when PHYSFS_init() is called from
+ *  the application.
+ *
+ * Return zero if there was a catastrophic failure (which prevents you from
+ *  functioning at all), and non-zero otherwise.
+ */
+int __PHYSFS_platformInit(void);
+
+
+/*
+ * Deinitialize the platform. This is called when PHYSFS_deinit() is called
+ *  from the application. You can use this to clean up anything you've
+ *  allocated in your platform driver.
+ */
+void __PHYSFS_platformDeinit(void);
+
+
+/*
+ * Open a file for reading. (filename) is in platform-dependent notation. The
+ *  file pointer should be positioned on the first byte of the file.
+ *
+ * The return value will be some platform-specific datatype that is opaque to
+ *  the caller; it could be a (FILE *) under Unix, or a (HANDLE *) under win32.
+ *
+ * The same file can be opened for read multiple times, and each should have
+ *  a unique file handle; this is frequently employed to prevent race
+ *  conditions in the archivers.
+ *
+ * Call PHYSFS_setErrorCode() and return (NULL) if the file can't be opened.
+ */
+void *__PHYSFS_platformOpenRead(const char *filename);
+
+
+/*
+ * Open a file for writing. (filename) is in platform-dependent notation. If
+ *  the file exists, it should be truncated to zero bytes, and if it doesn't
+ *  exist, it should be created as a zero-byte file. The file pointer should
+ *  be positioned on the first byte of the file.
+ *
+ * The return value will be some platform-specific datatype that is opaque to
+ *  the caller; it could be a (FILE *) under Unix, or a (HANDLE *) under win32,
+ *  etc.
+ *
+ * Opening a file for write multiple times has undefined results.
+ *
+ * Call PHYSFS_setErrorCode() and return (NULL) if the file can't be opened.
+ */
+void *__PHYSFS_platformOpenWrite(const char *filename);
+
+
+/*
+ * Open a file for appending. (filename) is in platform-dependent notation. If
+ *  the file exists, the file pointer should be place just past the end of the
+ *  file, so that the first write will be one byte after the current end of
+ *  the file. If the file doesn't exist, it should be created as a zero-byte
+ *  file. The file pointer should be positioned on the first byte of the file.
+ *
+ * The return value will be some platform-specific datatype that is opaque to
+ *  the caller; it could be a (FILE *) under Unix, or a (HANDLE *) under win32,
+ *  etc.
+ *
+ * Opening a file for append multiple times has undefined results.
+ *
+ * Call PHYSFS_setErrorCode() and return (NULL) if the file can't be opened.
+ */
+void *__PHYSFS_platformOpenAppend(const char *filename);
+
+/*
+ * Read more data from a platform-specific file handle. (opaque) should be
+ *  cast to whatever data type your platform uses. Read a maximum of (len)
+ *  8-bit bytes to the area pointed to by (buf). If there isn't enough data
+ *  available, return the number of bytes read, and position the file pointer
+ *  immediately after those bytes.
+ *  On success, return (len) and position the file pointer immediately past
+ *  the end of the last read byte. Return (-1) if there is a catastrophic
+ *  error, and call PHYSFS_setErrorCode() to describe the problem; the file
+ *  pointer should not move in such a case. A partial read is success; only
+ *  return (-1) on total failure; presumably, the next read call after a
+ *  partial read will fail as such.
+ */
+PHYSFS_sint64 __PHYSFS_platformRead(void *opaque, void *buf, PHYSFS_uint64 len);
+
+/*
+ * Read like __PHYSFS_platformRead(), but from (pos), without using or moving
+ *  the file pointer; this is pread(). Several threads may call this on the
+ *  same handle at once, and alongside the other file functions.
+ *
+ * Platforms that can't do that (Windows moves the file pointer even for a
+ *  ReadFile() at an OVERLAPPED offset) set PHYSFS_PLATFORM_READAT to zero
+ *  and don't implement this; native i/o has no readAt() there.
+ */
+#if PHYSFS_PLATFORM_POSIX
+#define PHYSFS_PLATFORM_READAT 1
+PHYSFS_sint64 __PHYSFS_platformReadAt(void *opaque, PHYSFS_uint64 pos,
+                                      void *buf, PHYSFS_uint64 len);
+#else
+#define PHYSFS_PLATFORM_READAT 0
+#endif
+
+/*
+ * Write more data to a platform-specific file handle. (opaque) should be
+ *  cast to whatever data type your platform uses. Write a maximum of (len)
+ *  8-bit bytes from the area pointed to by (buffer). If there is a problem,
+ *  return the number of bytes written, and position the file pointer
+ *  immediately after those bytes. Return (-1) if there is a catastrophic
+ *  error, and call PHYSFS_setErrorCode() to describe the problem; the file
+ *  pointer should not move in such a case. A partial write is success; only
+ *  return (-1) on total failure; presumably, the next write call after a
+ *  partial write will fail as such.
+ */
+PHYSFS_sint64 __PHYSFS_platformWrite(void *opaque, const void *buffer,
+                                     PHYSFS_uint64 len);
+
+/*
+ * Set the file pointer to a new position. (opaque) should be cast to
+ *  whatever data type your platform uses. (pos) specifies the number
+ *  of 8-bit bytes to seek to from the start of the file. Seeking past the
+ *  end of the file is an error condition, and you should check for it.
+ *
+ * Not all file types can seek; this is to be expected by the caller.
+ *
+ * On error, call PHYSFS_setErrorCode() and return zero. On success, return
+ *  a non-zero value.
+ */
+int __PHYSFS_platformSeek(void *opaque, PHYSFS_uint64 pos);
+
+
+/*
+ * Get the file pointer's position, in an 8-bit byte offset from the start of
+ *  the file. (opaque) should be cast to whatever data type your platform
+ *  uses.
+ *
+ * Not all file types can "tell"; this is to be expected by the caller.
+ *
+ * On error, call PHYSFS_setErrorCode() and return -1. On success, return >= 0.
+ */
+PHYSFS_sint64 __PHYSFS_platformTell(void *opaque);
+
+
+/*
+ * Determine the current size of a file, in 8-bit bytes, from an open file.
+ *
+ * The caller expects that this information may not be available for all
+ *  file types on all platforms.
+ *
+ * Return -1 if you can't do it, and call PHYSFS_setErrorCode(). Otherwise,
+ *  return the file length in 8-bit bytes.
+ */
+PHYSFS_sint64 __PHYSFS_platformFileLength(void *handle);
+
+/*
+ * Hint that (len) bytes at (pos) in an open file will be read soon, so the
+ *  OS can start reading them in the background. (opaque) should be cast to
+ *  whatever data type your platform uses.
+ *
+ * This is only a hint; do nothing if the platform has no way to do it.
+ */
+void __PHYSFS_platformReadAhead(void *opaque, PHYSFS_uint64 pos,
+                                PHYSFS_uint64 len);
+
+/*
+ * Hint that (len) bytes at (pos) in an open file won't be read again soon,
+ *  so the OS can drop them from its cache. (opaque) should be cast to
+ *  whatever data type your platform uses. Only pages that lie completely
+ *  inside the range go; partial pages at either end stay, since they may
+ *  hold data someone still wants, like a neighbouring archive entry.
+ *
+ * This is only a hint; do nothing if the platform has no way to do it.
+ */
+void __PHYSFS_platformDropCache(void *opaque, PHYSFS_uint64 pos,
+                                PHYSFS_uint64 len);
+
+/*
+ * Copy up to (len) bytes at (pos) of an open file to the file descriptor
+ *  (fd) without bringing them into the process, and without using or moving
+ *  the file pointer; this is sendfile(). (opaque) should be cast to whatever
+ *  data type your platform uses. Return the number of bytes copied, which
+ *  may be short, or -1 on failure after calling PHYSFS_setErrorCode().
+ *
+ * Platforms that can't do that set PHYSFS_PLATFORM_SENDFILE to zero and
+ *  don't implement this; PHYSFS_sendToFd() reads and writes instead.
+ */
+#if PHYSFS_PLATFORM_LINUX
+#define PHYSFS_PLATFORM_SENDFILE 1
+PHYSFS_sint64 __PHYSFS_platformSendFile(void *opaque, PHYSFS_uint64 pos,
+                                        int fd, PHYSFS_uint64 len);
+#else
+#define PHYSFS_PLATFORM_SENDFILE 0
+#endif
+
+/*
+ * Write up to (len) bytes from (buf) to the file descriptor (fd), which
+ *  the app opened, not us. Return the number of bytes written, which may be
+ *  short, or -1 on failure after calling PHYSFS_setErrorCode(). Platforms
+ *  without file descriptors fail with PHYSFS_ERR_UNSUPPORTED.
+ */
+PHYSFS_sint64 __PHYSFS_platformWriteFd(int fd, const void *buf,
+                                       PHYSFS_uint64 len);
+
+/*
+ * Map all of the file (fname) into memory, read-only and shared with any
+ *  other process that maps it, and put its length in (*len); unmap it with
+ *  __PHYSFS_platformUnmapFile(). __PHYSFS_platformRename() replaces (dst)
+ *  with (src) in one step, so nobody ever sees half of either. On failure,
+ *  call PHYSFS_setErrorCode() and return NULL or zero.
+ *
+ * Platforms that can't do that set PHYSFS_PLATFORM_MAPFILE to zero and
+ *  don't implement these; PHYSFS_setIndexCache() isn't supported there.
+ */
+#if PHYSFS_PLATFORM_POSIX
+#define PHYSFS_PLATFORM_MAPFILE 1
+void *__PHYSFS_platformMapFile(const char *fname, PHYSFS_uint64 *len);
+void __PHYSFS_platformUnmapFile(void *ptr, PHYSFS_uint64 len);
+int __PHYSFS_platformRename(const char *src, const char *dst);
+#else
+#define PHYSFS_PLATFORM_MAPFILE 0
+#endif
+
+
+/*
+ * Read filesystem metadata for a specific path.
+ *
+ * This needs to fill in all the fields of (stat). For fields that might not
+ *  mean anything on a platform (access time, perhaps), choose a reasonable
+ *  default. if (follow), we want to follow symlinks and stat what they
+ *  link to and not the link itself.
+ *
+ *  Return zero on failure, non-zero on success.
+ */
+int __PHYSFS_platformStat(const char *fn, PHYSFS_Stat *stat, const int follow);
+
+/*
+ * Flush any pending writes to disk. (opaque) should be cast to whatever data
+ *  type your platform uses. Be sure to check for errors; the caller expects
+ *  that this function can fail if there was a flushing error, etc.
+ *
+ *  Return zero on failure, non-zero on success.
+ */
+int __PHYSFS_platformFlush(void *opaque);
+
+/*
+ * Close file and deallocate resources. (opaque) should be cast to whatever
+ *  data type your platform uses. This should close the file in any scenario:
+ *  flushing is a separate function call, and this function should never fail.
+ *
+ * You should clean up all resources associated with (opaque); the pointer
+ *  will be considered invalid after this call.
+ */
+void __PHYSFS_platformClose(void *opaque);
+
+/*
+ * Platform implementation of PHYSFS_getCdRomDirsCallback()...
+ *  CD directories are discovered and reported to the callback one at a time.
+ *  Pointers passed to the callback are assumed to be invalid to the
+ *  application after the callback returns, so you can free them or whatever.
+ *  Callback does not assume results will be sorted in any meaningful way.
+ */
+void __PHYSFS_platformDetectAvailableCDs(PHYSFS_StringCallback cb, void *data);
+
+/*
+ * Calculate the base dir, if your platform needs special consideration.
+ *  Just return NULL if the standard routines will suffice. (see
+ *  calculateBaseDir() in physfs.c ...)
+ * Your string must end with a dir separator if you don't return NULL.
+ *  Caller will allocator.Free() the retval if it's not NULL.
+ */
+char *__PHYSFS_platformCalcBaseDir(const char *argv0);
+
+/*
+ * Get the platform-specific user dir.
+ * As of PhysicsFS 2.1, returning NULL means fatal error.
+ * Your string must end with a dir separator if you don't return NULL.
+ *  Caller will allocator.Free() the retval if it's not NULL.
+ */
+char *__PHYSFS_platformCalcUserDir(void);
+
+
+/* This is the cached version from PHYSFS_init(). This is a fast call. */
+const char *__PHYSFS_getUserDir(void);  /* not deprecated internal version. */
+
+
+/*
+ * Get the platform-specific pref dir.
+ * Returning NULL means fatal error.
+ * Your string must end with a dir separator if you don't return NULL.
+ *  Caller will allocator.Free() the retval if it's not NULL.
+ *  Caller will make missing directories if necessary; this just reports
+ *   the final path.
+ */
+char *__PHYSFS_platformCalcPrefDir(const char *org, const char *app);
+
+
+/*
+ * Return a pointer that uniquely identifies the current thread.
+ *  On a platform without threading, (0x1) will suffice. These numbers are
+ *  arbitrary; the only requirement is that no two threads have the same
+ *  pointer.
+ */
+void *__PHYSFS_platformGetThreadID(void);
+
+
+/*
+ * Enumerate a directory of files. This follows the rules for the
+ *  PHYSFS_Archiver::enumerate() method, except that the (dirName) that is
+ *  passed to this function is converted to platform-DEPENDENT notation by
+ *  the caller. The PHYSFS_Archiver version uses platform-independent
+ *  notation. Note that ".", "..", and other meta-entries should always
+ *  be ignored.
+ */
+PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerate(const char *dirname,
+                               PHYSFS_EnumerateCallback callback,
+                               const char *origdir, void *callbackdata);
+
+/*
+ * Make a directory in the actual filesystem. (path) is specified in
+ *  platform-dependent notation. On error, return zero and set the error
+ *  message. Return non-zero on success.
+ */
+int __PHYSFS_platformMkDir(const char *path);
+
+
+/*
+ * Remove a file or directory entry in the actual filesystem. (path) is
+ *  specified in platform-dependent notation. Note that this deletes files
+ *  _and_ directories, so you might need to do some determination.
+ *  Non-empty directories should report an error and not delete themselves
+ *  or their contents.
+ *
+ * Deleting a symlink should remove the link, not what it points to.
+ *
+ * On error, return zero and set the error message. Return non-zero on success.
+ */
+int __PHYSFS_platformDelete(const char *path);
+
+
+/*
+ * Create a platform-specific mutex. This can be whatever datatype your
+ *  platform uses for mutexes, but it is cast to a (void *) for abstractness.
+ *
+ * Return (NULL) if you couldn't create one. Systems without threads can
+ *  return any arbitrary non-NULL value.
+ */
+void *__PHYSFS_platformCreateMutex(void);
+
+/*
+ * Destroy a platform-specific mutex, and clean up any resources associated
+ *  with it. (mutex) is a value previously returned by
+ *  __PHYSFS_platformCreateMutex(). This can be a no-op on single-threaded
+ *  platforms.
+ */
+void __PHYSFS_platformDestroyMutex(void *mutex);
+
+/*
+ * Grab possession of a platform-specific mutex. Mutexes should be recursive;
+ *  that is, the same thread should be able to call this function multiple
+ *  times in a row without causing a deadlock. This function should block
+ *  until a thread can gain possession of the mutex.
+ *
+ * Return non-zero if the mutex was grabbed, zero if there was an
+ *  unrecoverable problem grabbing it (this should not be a matter of
+ *  timing out! We're talking major system errors; block until the mutex
+ *  is available otherwise.)
+ *
+ * _DO NOT_ call PHYSFS_setErrorCode() in here! Since setErrorCode calls this
+ *  function, you'll cause an infinite recursion. This means you can't
+ *  use the BAIL_*MACRO* macros, either.
+ */
+int __PHYSFS_platformGrabMutex(void *mutex);
+
+/*
+ * Relinquish possession of the mutex when this method has been called
+ *  once for each time that platformGrabMutex was called. Once possession has
+ *  been released, the next thread in line to grab the mutex (if any) may
+ *  proceed.
+ *
+ * _DO NOT_ call PHYSFS_setErrorCode() in here! Since setErrorCode calls this
+ *  function, you'll cause an infinite recursion. This means you can't
+ *  use the BAIL_*MACRO* macros, either.
+ */
+void __PHYSFS_platformReleaseMutex(void *mutex);
+
+/*
+ * Like __PHYSFS_platformGrabMutex(), but never blocks: if another thread
+ *  holds the mutex, return zero immediately. Return non-zero if the mutex
+ *  was grabbed, in which case it must be released as usual.
+ *
+ * _DO NOT_ call PHYSFS_setErrorCode() in here!
+ */
+int __PHYSFS_platformTryGrabMutex(void *mutex);
+
+/*
+ * Return a timestamp in nanoseconds from a monotonic clock. The starting
+ *  point is arbitrary, only differences between two values are meaningful.
+ *
+ * _DO NOT_ call PHYSFS_setErrorCode() in here!
+ */
+PHYSFS_uint64 __PHYSFS_platformGetTicks(void);
+
+/*
+ * Start a new thread that calls (fn)(data) and then ends. Return a handle
+ *  for __PHYSFS_platformWaitThread(), or NULL if you couldn't start one,
+ *  after calling PHYSFS_setErrorCode(). Platforms without threads should
+ *  fail with PHYSFS_ERR_UNSUPPORTED.
+ */
+void *__PHYSFS_platformCreateThread(void (*fn)(void *), void *data);
+
+/*
+ * Wait for a thread from __PHYSFS_platformCreateThread() to end, and free
+ *  its handle. Every thread must be waited for exactly once.
+ */
+void __PHYSFS_platformWaitThread(void *thread);
+
+/*
+ * Create a counting semaphore starting at (count). Return NULL if you
+ *  couldn't, after calling PHYSFS_setErrorCode(). Platforms without threads
+ *  should fail with PHYSFS_ERR_UNSUPPORTED.
+ */
+void *__PHYSFS_platformCreateSemaphore(PHYSFS_uint32 count);
+
+/*
+ * Destroy a semaphore. Nothing may be waiting on it.
+ */
+void __PHYSFS_platformDestroySemaphore(void *sem);
+
+/*
+ * Wait for a semaphore's count to be above zero, then take one from it.
+ *  Returns non-zero on success, zero on failure.
+ *
+ * _DO NOT_ call PHYSFS_setErrorCode() in here!
+ */
+int __PHYSFS_platformWaitSemaphore(void *sem);
+
+/*
+ * Add one to a semaphore's count, waking one waiter if there are any.
+ */
+void __PHYSFS_platformPostSemaphore(void *sem);
+
+/*
+ * Put the current thread to sleep for at least (ms) milliseconds.
+ */
+void __PHYSFS_platformSleep(PHYSFS_uint32 ms);
+
+#if PHYSFS_HAVE_PRAGMA_VISIBILITY
+#pragma GCC visibility pop
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/* end of physfs_internal.h ... */
+
+#endif /* defined(PHYSFS_IMPL) || defined(PHYSFS_PLATFORM_IMPL) */
+
+
+#ifdef PHYSFS_IMPL
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * PhysicsFS; a portable, flexible file i/o abstraction.
+ *
+ * Documentation is in physfs.h. It's verbose, honest.  :)
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ *
+ *  This file written by Ryan C. Gordon.
+ */
+/*
+#define __PHYSICSFS_INTERNAL__
+#include "physfs_internal.h"
+*/
+#if defined(_MSC_VER)
+
+/* this code came from https://stackoverflow.com/a/8712996 */
+int __PHYSFS_msvc_vsnprintf(char *outBuf, size_t size, const char *format, va_list ap)
+{
+    int count = -1;
+
+    if (size != 0)
+        count = _vsnprintf_s(outBuf, size, _TRUNCATE, format, ap);
+    if (count == -1)
+        count = _vscprintf(format, ap);
+
+    return count;
+}
+
+int __PHYSFS_msvc_snprintf(char *outBuf, size_t size, const char *format, ...)
+{
+    int count;
+    va_list ap;
+
+    va_start(ap, format);
+    count = __PHYSFS_msvc_vsnprintf(outBuf, size, format, ap);
+    va_end(ap);
+
+    return count;
+}
+#endif
+
+
+#define MEMORY_CATEGORIES ((int) PHYSFS_MEMORY_CACHE + 1)
+
+/* What memory is charged to: the whole library, or an archive as well. */
+typedef struct MemoryAccount
+{
+    PHYSFS_uint64 bytes[MEMORY_CATEGORIES];
+    PHYSFS_uint64 total;
+    PHYSFS_uint64 peak;
+    PHYSFS_uint64 blocks;
+    volatile int refcount;  /* the archive's, plus one per block charged. */
+} MemoryAccount;
+
+/* the current thread's charges, saved by memoryScopeEnter(). */
+typedef struct MemoryScope
+{
+    MemoryAccount *account;
+    int category;
+} MemoryScope;
+
+
+typedef struct __PHYSFS_DIRHANDLE__
+{
+    void *opaque;  /* Instance data unique to the archiver. */
+    char *dirName;  /* Path to archive in platform-dependent notation. */
+    char *mountPoint; /* Mountpoint in virtual file tree. */
+    char *root;  /* subdirectory of archiver to use as root of archive (NULL for actual root) */
+    size_t rootlen;  /* subdirectory of archiver to use as root of archive (NULL for actual root) */
+    const PHYSFS_Archiver *funcs;  /* Ptr to archiver info for this handle. */
+    PHYSFS_Io *io;  /* what the archive was opened from, NULL for dirs. Not ours. */
+    int generation;  /* unique per handle, even if the address is reused. */
+#if PHYSFS_SUPPORTS_STATS
+    PHYSFS_IoStats stats;  /* i/o counters for this archive. */
+#endif
+#if PHYSFS_SUPPORTS_MEMORY_STATS
+    MemoryAccount *memory;  /* what this archive holds, NULL if untracked. */
+#endif
+    struct __PHYSFS_DIRHANDLE__ *next;  /* linked list stuff. */
+} DirHandle;
+
+
+typedef struct __PHYSFS_FILEHANDLE__
+{
+    PHYSFS_Io *io;  /* Instance data unique to the archiver for this file. */
+    PHYSFS_uint8 forReading; /* Non-zero if reading, zero if write/append */
+    PHYSFS_uint8 uncached;  /* Non-zero to drop what we read from OS cache. */
+    PHYSFS_uint64 uncachedFrom;  /* Start of disk range not yet dropped. */
+    PHYSFS_uint64 uncachedTo;  /* End of that range, where reads stopped. */
+    const DirHandle *dirHandle;  /* Archiver instance that created this */
+    PHYSFS_uint8 *buffer;  /* Buffer, if set (NULL otherwise). Don't touch! */
+    size_t bufsize;  /* Bufsize, if set (0 otherwise). Don't touch! */
+    size_t buffill;  /* Buffer fill size. Don't touch! */
+    size_t bufpos;  /* Buffer position. Don't touch! */
+    struct __PHYSFS_FILEHANDLE__ *next;  /* linked list stuff. */
+} FileHandle;
+
+
+typedef struct __PHYSFS_ERRSTATETYPE__
+{
+    void *tid;
+    PHYSFS_ErrorCode code;
+    struct __PHYSFS_ERRSTATETYPE__ *next;
+} ErrState;
+
+
+/* General PhysicsFS state ... */
+static int initialized = 0;
+static ErrState *errorStates = NULL;
+static DirHandle *searchPath = NULL;
+static DirHandle *writeDir = NULL;
+static FileHandle *openWriteList = NULL;
+static FileHandle *openReadList = NULL;
+static DirHandle *retiredDirs = NULL;  /* replaced, but files still open. */
+static int unlockedMounts = 0;  /* archives being opened without stateLock. */
+static char *baseDir = NULL;
+static char *userDir = NULL;
+static char *prefDir = NULL;
+static int allowSymLinks = 0;
+static int resolveOnMount = 0;
+static char *indexCacheDir = NULL;  /* for PHYSFS_setIndexCache(). */
+static PHYSFS_Archiver **archivers = NULL;
+static PHYSFS_ArchiveInfo **archiveInfo = NULL;
+static volatile size_t numArchivers = 0;
+static size_t longest_root = 0;
+
+/*
+ * Opens and stats don't walk (searchPath), they walk a snapshot of it that
+ *  never changes once it's published, so they don't need stateLock. Anything
+ *  that changes the search path publishes a new snapshot, under stateLock,
+ *  and retires the old one. Entries have their own copies of the mount point
+ *  and root, since PHYSFS_setRoot() and PHYSFS_replaceMount() change those
+ *  in the DirHandle.
+ *
+ * A reader pins the current epoch before it loads the snapshot, by counting
+ *  itself in its slot for that epoch, and unpins when it's done with it.
+ *  The epoch only moves on when nobody is left pinned in the one before it,
+ *  so once it's moved on twice since a snapshot was retired, nobody can
+ *  still be using that snapshot, or what was taken off the search path
+ *  with it.
+ */
+typedef struct SearchPathEntry
+{
+    DirHandle *dirHandle;
+    const char *mountPoint;  /* dirHandle's, when this was published. */
+    const char *root;        /* dirHandle's, when this was published. */
+    size_t rootlen;
+} SearchPathEntry;
+
+typedef struct SearchPathSnapshot
+{
+    size_t longestRoot;  /* longest_root, when this was published. */
+    PHYSFS_uint32 count;
+    PHYSFS_uint32 capacity;
+    SearchPathEntry *entries;
+    int retiredAt;  /* the epoch when it was replaced. */
+    DirHandle *dropped;  /* what was taken off the search path then. */
+    char *droppedRoot;  /* a root that PHYSFS_setRoot() replaced then. */
+    struct SearchPathSnapshot *next;  /* retired ones, newest first. */
+} SearchPathSnapshot;
+
+#define SEARCH_PATH_READER_SLOTS 16
+
+typedef struct SearchPathReaders
+{
+    volatile int active[2];  /* readers pinned in even and odd epochs. */
+    char padding[64 - (2 * sizeof (int))];  /* a cache line each. */
+} SearchPathReaders;
+
+static SearchPathSnapshot * volatile searchPathSnapshot = NULL;
+static SearchPathSnapshot *retiredSearchPaths = NULL;
+static volatile int searchPathEpoch = 0;
+static SearchPathReaders searchPathReaders[SEARCH_PATH_READER_SLOTS];
+
+/* mutexes ... */
+static void *errorLock = NULL;     /* protects error message list.        */
+static void *stateLock = NULL;     /* protects other PhysFS static state. */
+static void *memoryLock = NULL;    /* protects the memory budget.         */
+
+/* allocator ... */
+static int externalAllocator = 0;
+PHYSFS_Allocator allocator;
+
+#if PHYSFS_SUPPORTS_STATS
+PHYSFS_IoStats __PHYSFS_GlobalIoStats;
+
+/* dirHandle is const in FileHandle, but its counters are always writable. */
+#define DIRHANDLE_STATS(dh) ((PHYSFS_IoStats *) &(dh)->stats)
+
+#endif
+
+/* the app's PHYSFS_Allocator2, if it gave us one; (allocator) calls it. */
+static PHYSFS_Allocator2 sizedAllocator;
+
+#if PHYSFS_SUPPORTS_MEMORY_STATS
+static PHYSFS_Allocator rawAllocator;  /* what (allocator) counts and calls. */
+static MemoryAccount globalMemory;
+
+#define DIRHANDLE_MEMORY(dh) ((dh)->memory)
+#else
+#define DIRHANDLE_MEMORY(dh) ((MemoryAccount *) NULL)
+#endif
+
+#if defined(_MSC_VER)
+#define MEMORY_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define MEMORY_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_THREADS__)
+#define MEMORY_THREAD_LOCAL _Thread_local
+#endif
+
+/* Without thread-local storage, everything is OTHER, for the library only. */
+#ifdef MEMORY_THREAD_LOCAL
+#if PHYSFS_SUPPORTS_MEMORY_STATS
+static MEMORY_THREAD_LOCAL MemoryAccount *memoryAccount = NULL;
+#endif
+static MEMORY_THREAD_LOCAL int memoryCategory = (int) PHYSFS_MEMORY_OTHER;
+#define CURRENT_MEMORY_CATEGORY() (memoryCategory)
+#else
+#define CURRENT_MEMORY_CATEGORY() ((int) PHYSFS_MEMORY_OTHER)
+#endif
+
+/* charge what this thread allocates to (account) and (category), for now. */
+static void memoryScopeEnter(MemoryScope *prev, MemoryAccount *account,
+                             const PHYSFS_MemoryCategory category)
+{
+#if PHYSFS_SUPPORTS_MEMORY_STATS && defined(MEMORY_THREAD_LOCAL)
+    prev->account = memoryAccount;
+    memoryAccount = account;
+#else
+    (void) account;
+    prev->account = NULL;
+#endif
+
+#ifdef MEMORY_THREAD_LOCAL
+    prev->category = memoryCategory;
+    memoryCategory = (int) category;
+#else
+    (void) category;
+    prev->category = 0;
+#endif
+} /* memoryScopeEnter */
+
+
+static void memoryScopeLeave(const MemoryScope *prev)
+{
+#if PHYSFS_SUPPORTS_MEMORY_STATS && defined(MEMORY_THREAD_LOCAL)
+    memoryAccount = prev->account;
+#endif
+#ifdef MEMORY_THREAD_LOCAL
+    memoryCategory = prev->category;
+#else
+    (void) prev;
+#endif
+} /* memoryScopeLeave */
+
+
+int __PHYSFS_setMemoryCategory(const int category)
+{
+#ifdef MEMORY_THREAD_LOCAL
+    const int retval = memoryCategory;
+    memoryCategory = category;
+    return retval;
+#else
+    (void) category;
+    return 0;
+#endif
+} /* __PHYSFS_setMemoryCategory */
+
+
+/* An archive's account. NULL if it can't have one; it's just not tracked. */
+static MemoryAccount *memoryAccountCreate(void)
+{
+#if PHYSFS_SUPPORTS_MEMORY_STATS
+    MemoryAccount *retval;
+    MemoryScope scope;  /* it's counted, but it can't pay for itself. */
+    memoryScopeEnter(&scope, NULL, PHYSFS_MEMORY_OTHER);
+    retval = (MemoryAccount *) allocator.Malloc(sizeof (MemoryAccount));
+    memoryScopeLeave(&scope);
+    if (retval != NULL)
+    {
+        memset(retval, '\0', sizeof (*retval));
+        retval->refcount = 1;
+    } /* if */
+    return retval;
+#else
+    return NULL;
+#endif
+} /* memoryAccountCreate */
+
+
+/* blocks charged to (account) can outlive its archive, so it's refcounted. */
+static void memoryAccountRelease(MemoryAccount *account)
+{
+#if PHYSFS_SUPPORTS_MEMORY_STATS
+    if ((account != NULL) && (__PHYSFS_ATOMIC_DECR(&account->refcount) == 0))
+        allocator.Free(account);
+#else
+    (void) account;
+#endif
+} /* memoryAccountRelease */
+
+#if PHYSFS_SUPPORTS_LOCK_PROFILE
+/* Who holds a lock right now. Only touched while holding that lock. */
+typedef struct LockHolder
+{
+    PHYSFS_uint32 depth;  /* the locks are recursive. */
+    PHYSFS_uint64 since;  /* when the outermost grab happened. */
+    PHYSFS_LockSite site;  /* where the outermost grab happened. */
+} LockHolder;
+
+#define LOCKSITE_COUNT ((int) PHYSFS_LOCKSITE_ERRORSTATE + 1)
+
+/* The profile for a site is only touched while holding that site's lock. */
+static PHYSFS_LockProfile lockProfiles[LOCKSITE_COUNT];
+static LockHolder stateLockHolder;
+static LockHolder errorLockHolder;
+
+static LockHolder *findLockHolder(void *lock)
+{
+    if (lock == stateLock)
+        return &stateLockHolder;
+    else if (lock == errorLock)
+        return &errorLockHolder;
+    return NULL;
+} /* findLockHolder */
+
+
+static void profileLockGrab(void *lock, const PHYSFS_LockSite site,
+                            const int contended, const PHYSFS_uint64 wait)
+{
+    PHYSFS_LockProfile *profile = &lockProfiles[site];
+    LockHolder *holder = findLockHolder(lock);
+    PHYSFS_uint64 us = wait / 1000;
+    int bucket = 0;
+
+    while ((us > 0) && (bucket < PHYSFS_LOCK_HISTOGRAM_BUCKETS - 1))
+    {
+        bucket++;
+        us >>= 1;
+    } /* while */
+
+    profile->acquisitions++;
+    profile->waitHistogram[bucket]++;
+    if (contended)
+    {
+        profile->contentions++;
+        profile->waitNanoseconds += wait;
+        if (wait > profile->longestWaitNanoseconds)
+            profile->longestWaitNanoseconds = wait;
+    } /* if */
+
+    if ((holder != NULL) && (holder->depth++ == 0))
+    {
+        holder->since = __PHYSFS_platformGetTicks();
+        holder->site = site;
+    } /* if */
+} /* profileLockGrab */
+
+
+void __PHYSFS_releaseMutex(void *mutex)
+{
+    LockHolder *holder = findLockHolder(mutex);
+    if ((holder != NULL) && (holder->depth > 0) && (--holder->depth == 0))
+    {
+        PHYSFS_LockProfile *profile = &lockProfiles[holder->site];
+        const PHYSFS_uint64 held = __PHYSFS_platformGetTicks() - holder->since;
+        profile->holdNanoseconds += held;
+        if (held > profile->longestHoldNanoseconds)
+            profile->longestHoldNanoseconds = held;
+    } /* if */
+
+    __PHYSFS_platformReleaseMutex(mutex);
+} /* __PHYSFS_releaseMutex */
+#endif
+
+#if PHYSFS_SUPPORTS_STATS || PHYSFS_SUPPORTS_LOCK_PROFILE
+/* Grab one of our locks, measuring the time spent waiting for it. */
+static void grabLock(void *lock, const PHYSFS_LockSite site)
+{
+    PHYSFS_uint64 wait = 0;
+    int contended = 0;
+
+    if (!__PHYSFS_platformTryGrabMutex(lock))
+    {
+        const PHYSFS_uint64 start = __PHYSFS_platformGetTicks();
+        __PHYSFS_platformGrabMutex(lock);
+        wait = __PHYSFS_platformGetTicks() - start;
+        contended = 1;
+    } /* if */
+
+#if PHYSFS_SUPPORTS_STATS
+    if (lock == stateLock)
+    {
+        __PHYSFS_STAT_ADD(NULL, lockAcquisitions, 1);
+        if (contended)
+        {
+            __PHYSFS_STAT_ADD(NULL, lockContentions, 1);
+            __PHYSFS_STAT_ADD(NULL, lockWaitNanoseconds, wait);
+        } /* if */
+    } /* if */
+#endif
+
+#if PHYSFS_SUPPORTS_LOCK_PROFILE
+    profileLockGrab(lock, site, contended, wait);
+#endif
+} /* grabLock */
+#else
+#define grabLock(lock, site) __PHYSFS_platformGrabMutex(lock)
+#endif
+
+#define grabStateLock(site) grabLock(stateLock, PHYSFS_LOCKSITE_##site)
+
+#if PHYSFS_SUPPORTS_TRACE
+static PHYSFS_TraceCallback traceBeginCallback = NULL;
+static PHYSFS_TraceCallback traceEndCallback = NULL;
+static void *traceCallbackData = NULL;
+
+static void traceBegin(PHYSFS_TraceEvent *ev, const PHYSFS_TraceOp op,
+                       const char *path, const void *handle,
+                       const PHYSFS_uint64 bytes)
+{
+    const PHYSFS_TraceCallback cb = traceBeginCallback;
+    ev->op = op;
+    ev->path = path;
+    ev->archive = NULL;
+    ev->handle = handle;
+    ev->bytes = bytes;
+    ev->result = 0;
+    ev->duration = 0;
+    ev->timestamp = 0;  /* callbacks might be set before the end event. */
+    if ((cb != NULL) || (traceEndCallback != NULL))
+        ev->timestamp = __PHYSFS_platformGetTicks();
+    if (cb != NULL)
+        cb(traceCallbackData, ev);
+} /* traceBegin */
+
+static void traceEnd(PHYSFS_TraceEvent *ev, const char *archive,
+                     const PHYSFS_sint64 result)
+{
+    const PHYSFS_TraceCallback cb = traceEndCallback;
+    if (cb != NULL)
+    {
+        const PHYSFS_uint64 now = __PHYSFS_platformGetTicks();
+        ev->duration = ev->timestamp ? (now - ev->timestamp) : 0;
+        ev->timestamp = now;
+        ev->archive = archive;
+        ev->result = result;
+        cb(traceCallbackData, ev);
+    } /* if */
+} /* traceEnd */
+
+#define TRACE_BEGIN(ev, op, path, handle, bytes) traceBegin(&ev, op, path, handle, bytes)
+#define TRACE_END(ev, archive, result) traceEnd(&ev, archive, result)
+#else
+#define TRACE_BEGIN(ev, op, path, handle, bytes) ((void) &ev)
+#define TRACE_END(ev, archive, result) do {} while (0)
+#endif
+
+
+#ifdef PHYSFS_NEED_ATOMIC_OP_FALLBACK
+static inline int __PHYSFS_atomicAdd(volatile int *ptrval, const int val)
+{
+    int retval;
+    __PHYSFS_platformGrabMutex(stateLock);
+    retval = *ptrval;
+    *ptrval = retval + val;
+    __PHYSFS_platformReleaseMutex(stateLock);
+    return retval;
+} /* __PHYSFS_atomicAdd */
+
+int __PHYSFS_ATOMIC_INCR(volatile int *ptrval)
+{
+    return __PHYSFS_atomicAdd(ptrval, 1) + 1;
+} /* __PHYSFS_ATOMIC_INCR */
+
+int __PHYSFS_ATOMIC_DECR(volatile int *ptrval)
+{
+    return __PHYSFS_atomicAdd(ptrval, -1) - 1;
+} /* __PHYSFS_ATOMIC_DECR */
+#endif
+
+
+
+/* Queueing reads on an archive's i/o, for PHYSFS_setIoScheduler()... */
+
+/* reads that don't ask for a deadline get this one, so none wait forever. */
+#define IOSCHED_MAX_WAIT_MS 1000
+
+/* waiting reads that touch are merged into one read up to this size. */
+#define IOSCHED_MAX_COALESCE (1024 * 1024)
+
+typedef struct __PHYSFS_IOREQUEST__
+{
+    PHYSFS_uint64 offset;
+    PHYSFS_uint8 *buf;
+    PHYSFS_uint64 len;
+    PHYSFS_IoPriority priority;
+    PHYSFS_uint64 deadline;  /* in __PHYSFS_platformGetTicks() time. */
+    PHYSFS_sint64 result;  /* what readAt() returned for us. */
+    PHYSFS_ErrorCode err;  /* error code to set if (result) is -1. */
+    void *sem;  /* waiter sleeps on this until (done) or (lead) is set. */
+    int done;
+    int lead;  /* our turn to issue reads for everyone. */
+    struct __PHYSFS_IOREQUEST__ *next;
+} IoRequest;
+
+typedef struct __PHYSFS_IOSCHEDULER__
+{
+    void *lock;  /* protects everything here but (enabled). */
+    volatile int enabled;
+    int dispatching;  /* nonzero while a thread is issuing queued reads. */
+    IoRequest *queue;
+    PHYSFS_uint64 head;  /* where the last read ended. */
+    PHYSFS_uint64 throttle;  /* background bytes per second, 0 for no limit. */
+    PHYSFS_uint64 backgroundReady;  /* ticks when the next may be queued. */
+} IoScheduler;
+
+static IoScheduler *ioSchedCreate(void)
+{
+    IoScheduler *s;
+    void *sem;
+
+    /* waiting needs semaphores; find out now if there aren't any. */
+    sem = __PHYSFS_platformCreateSemaphore(0);
+    BAIL_IF_ERRPASS(!sem, NULL);
+    __PHYSFS_platformDestroySemaphore(sem);
+
+    s = (IoScheduler *) allocator.Malloc(sizeof (IoScheduler));
+    BAIL_IF(!s, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    memset(s, '\0', sizeof (IoScheduler));
+    s->lock = __PHYSFS_platformCreateMutex();
+    if (!s->lock)
+    {
+        allocator.Free(s);
+        return NULL;
+    } /* if */
+    return s;
+} /* ioSchedCreate */
+
+static void ioSchedDestroy(IoScheduler *s)
+{
+    assert(s->queue == NULL);  /* the archive's still being read from?! */
+    __PHYSFS_platformDestroyMutex(s->lock);
+    allocator.Free(s);
+} /* ioSchedDestroy */
+
+/* the next read to issue, or NULL if none are waiting. */
+static IoRequest *ioSchedPick(const IoScheduler *s, const PHYSFS_uint64 now)
+{
+    IoRequest *late = NULL;
+    IoRequest *best = NULL;
+    IoRequest *r;
+
+    for (r = s->queue; r != NULL; r = r->next)
+    {
+        if (r->deadline <= now)
+        {
+            if ((late == NULL) || (r->deadline < late->deadline))
+                late = r;
+        } /* else if */
+        else if ((best == NULL) || (r->priority > best->priority))
+            best = r;
+        else if (r->priority == best->priority)
+        {
+            /* sweep forward from the head, wrapping around to the front. */
+            const int ahead = (r->offset >= s->head);
+            const int bestAhead = (best->offset >= s->head);
+            if ((ahead && !bestAhead) ||
+                ((ahead == bestAhead) && (r->offset < best->offset)))
+                best = r;
+        } /* else if */
+    } /* for */
+
+    return late ? late : best;
+} /* ioSchedPick */
+
+static void ioSchedUnlink(IoScheduler *s, IoRequest *req)
+{
+    IoRequest **i;
+    for (i = &s->queue; *i != req; i = &(*i)->next) { /* find it. */ }
+    *i = req->next;
+    req->next = NULL;
+} /* ioSchedUnlink */
+
+/*
+ * Take the next read off the queue, with every other waiting read that
+ *  touches it, while the whole thing fits in IOSCHED_MAX_COALESCE. Returns
+ *  them as a list, and the range they cover in (*_start) and (*_end).
+ */
+static IoRequest *ioSchedTake(IoScheduler *s, const PHYSFS_uint64 now,
+                              PHYSFS_uint64 *_start, PHYSFS_uint64 *_end)
+{
+    IoRequest *group = ioSchedPick(s, now);
+    PHYSFS_uint64 start, end;
+    int merged = 1;
+
+    if (group == NULL)
+        return NULL;
+
+    ioSchedUnlink(s, group);
+    start = group->offset;
+    end = group->offset + group->len;
+
+    while (merged)
+    {
+        IoRequest *r;
+        merged = 0;
+        for (r = s->queue; r != NULL; r = r->next)
+        {
+            const PHYSFS_uint64 rend = r->offset + r->len;
+            const PHYSFS_uint64 newstart = (r->offset < start) ? r->offset : start;
+            const PHYSFS_uint64 newend = (rend > end) ? rend : end;
+
+            if ((r->offset > end) || (rend < start))
+                continue;  /* doesn't touch. */
+            else if ((newend - newstart) > IOSCHED_MAX_COALESCE)
+                continue;
+
+            ioSchedUnlink(s, r);
+            r->next = group;
+            group = r;
+            start = newstart;
+            end = newend;
+            merged = 1;
+            break;  /* the queue changed under us, start over. */
+        } /* for */
+    } /* while */
+
+    *_start = start;
+    *_end = end;
+    return group;
+} /* ioSchedTake */
+
+static void ioSchedReadOne(PHYSFS_Io *io, IoRequest *r)
+{
+    r->result = io->readAt(io, r->offset, r->buf, r->len);
+    if (r->result < 0)
+        r->err = PHYSFS_getLastErrorCode();
+} /* ioSchedReadOne */
+
+/* issue a group from ioSchedTake(). Call this without holding the lock. */
+static void ioSchedIssue(PHYSFS_Io *io, IoRequest *group,
+                         const PHYSFS_uint64 start, const PHYSFS_uint64 end)
+{
+    PHYSFS_uint8 *bounce = NULL;
+    PHYSFS_ErrorCode err = PHYSFS_ERR_OK;
+    PHYSFS_sint64 rc;
+    IoRequest *r;
+
+    if (group->next != NULL)
+        bounce = (PHYSFS_uint8 *) allocator.Malloc((size_t) (end - start));
+
+    if (bounce == NULL)  /* just one, or out of memory: one read each. */
+    {
+        for (r = group; r != NULL; r = r->next)
+            ioSchedReadOne(io, r);
+        return;
+    } /* if */
+
+    rc = io->readAt(io, start, bounce, end - start);
+    if (rc < 0)
+        err = PHYSFS_getLastErrorCode();
+
+    for (r = group; r != NULL; r = r->next)
+    {
+        const PHYSFS_uint64 skip = r->offset - start;
+        PHYSFS_uint64 avail = 0;
+
+        if (rc < 0)
+        {
+            r->result = -1;
+            r->err = err;
+            continue;
+        } /* if */
+
+        if (((PHYSFS_uint64) rc) > skip)
+            avail = ((PHYSFS_uint64) rc) - skip;
+        if (avail > r->len)
+            avail = r->len;
+        memcpy(r->buf, bounce + skip, (size_t) avail);
+        r->result = (PHYSFS_sint64) avail;
+    } /* for */
+
+    allocator.Free(bounce);
+} /* ioSchedIssue */
+
+/*
+ * Issue queued reads, for anyone, until (me) is done; then pass the job on
+ *  to the thread whose read is next, if any. Call with the lock held.
+ */
+static void ioSchedDispatch(IoScheduler *s, PHYSFS_Io *io, IoRequest *me)
+{
+    IoRequest *next;
+
+    while (!me->done)
+    {
+        PHYSFS_uint64 start, end;
+        IoRequest *group = ioSchedTake(s, __PHYSFS_platformGetTicks(),
+                                       &start, &end);
+
+        assert(group != NULL);  /* (me), at least, is waiting. */
+        __PHYSFS_platformReleaseMutex(s->lock);
+        ioSchedIssue(io, group, start, end);
+        __PHYSFS_platformGrabMutex(s->lock);
+
+        s->head = end;
+        while (group != NULL)
+        {
+            IoRequest *r = group;
+            group = r->next;
+            r->done = 1;
+            if (r != me)
+                __PHYSFS_platformPostSemaphore(r->sem);  /* it can't run until we unlock. */
+        } /* while */
+    } /* while */
+
+    next = ioSchedPick(s, __PHYSFS_platformGetTicks());
+    if (next == NULL)
+        s->dispatching = 0;
+    else
+    {
+        next->lead = 1;
+        __PHYSFS_platformPostSemaphore(next->sem);
+    } /* else */
+} /* ioSchedDispatch */
+
+static PHYSFS_sint64 ioSchedRead(IoScheduler *s, PHYSFS_Io *io,
+                                 PHYSFS_uint64 offset, void *buf,
+                                 PHYSFS_uint64 len,
+                                 const PHYSFS_IoPriority priority,
+                                 const PHYSFS_uint32 deadline)
+{
+    const PHYSFS_uint64 wait = deadline ? deadline : IOSCHED_MAX_WAIT_MS;
+    IoRequest req;
+
+    memset(&req, '\0', sizeof (req));
+    req.offset = offset;
+    req.buf = (PHYSFS_uint8 *) buf;
+    req.len = len;
+    req.priority = priority;
+
+    __PHYSFS_platformGrabMutex(s->lock);
+
+    /* book our share of the bandwidth, and wait for it out of the queue. */
+    if ((priority == PHYSFS_IOPRIO_BACKGROUND) && (s->throttle > 0))
+    {
+        const PHYSFS_uint64 rate = s->throttle;
+        const PHYSFS_uint64 now = __PHYSFS_platformGetTicks();
+        const PHYSFS_uint64 ready = (s->backgroundReady > now) ? s->backgroundReady : now;
+        s->backgroundReady = ready + ((len / rate) * 1000000000) +
+                             (((len % rate) * 1000000000) / rate);
+        if (ready > now)
+        {
+            __PHYSFS_platformReleaseMutex(s->lock);
+            __PHYSFS_platformSleep((PHYSFS_uint32) (((ready - now) + 999999) / 1000000));
+            __PHYSFS_platformGrabMutex(s->lock);
+        } /* if */
+    } /* if */
+
+    req.deadline = __PHYSFS_platformGetTicks() + (wait * 1000000);
+    req.next = s->queue;
+    s->queue = &req;
+
+    if (!s->dispatching)
+        s->dispatching = 1;  /* nobody's issuing reads, so it's us. */
+    else
+    {
+        req.sem = __PHYSFS_platformCreateSemaphore(0);
+        if (req.sem == NULL)  /* can't wait; skip the line. */
+        {
+            ioSchedUnlink(s, &req);
+            __PHYSFS_platformReleaseMutex(s->lock);
+            return io->readAt(io, offset, buf, len);
+        } /* if */
+
+        __PHYSFS_platformReleaseMutex(s->lock);
+        __PHYSFS_platformWaitSemaphore(req.sem);
+        __PHYSFS_platformGrabMutex(s->lock);
+    } /* else */
+
+    if (!req.done)
+        ioSchedDispatch(s, io, &req);
+    __PHYSFS_platformReleaseMutex(s->lock);
+
+    if (req.sem != NULL)
+        __PHYSFS_platformDestroySemaphore(req.sem);
+    if (req.result < 0)
+        PHYSFS_setErrorCode(req.err);
+    return req.result;
+} /* ioSchedRead */
+
+
+/* PHYSFS_Io implementation for i/o to physical filesystem... */
+
+/* !!! FIXME: maybe refcount the paths in a string pool? */
+typedef struct __PHYSFS_NativeIoInfo
+{
+    void *handle;
+    const char *path;
+    int mode;   /* 'r', 'w', or 'a' */
+    IoScheduler *sched;  /* set once, under stateLock; NULL if never used. */
+#if PHYSFS_SUPPORTS_STATS
+    PHYSFS_IoStats *stats;  /* counters of the archive we back, or NULL. */
+#endif
+} NativeIoInfo;
+
+static PHYSFS_sint64 nativeIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
+{
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    PHYSFS_TraceEvent trace;
+    PHYSFS_sint64 rc;
+
+    TRACE_BEGIN(trace, PHYSFS_TRACE_IO_READ, info->path, io, len);
+    rc = __PHYSFS_platformRead(info->handle, buf, len);
+    TRACE_END(trace, NULL, rc);
+
+    if (rc > 0)
+        __PHYSFS_STAT_ADD(info->stats, bytesReadPhysical, rc);
+    return rc;
+} /* nativeIo_read */
+
+#if PHYSFS_PLATFORM_READAT
+static PHYSFS_sint64 nativeIo_readAt(PHYSFS_Io *io, PHYSFS_uint64 offset,
+                                     void *buf, PHYSFS_uint64 len)
+{
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    PHYSFS_TraceEvent trace;
+    PHYSFS_sint64 rc;
+
+    TRACE_BEGIN(trace, PHYSFS_TRACE_IO_READ, info->path, io, len);
+    rc = __PHYSFS_platformReadAt(info->handle, offset, buf, len);
+    TRACE_END(trace, NULL, rc);
+
+    if (rc > 0)
+        __PHYSFS_STAT_ADD(info->stats, bytesReadPhysical, rc);
+    return rc;
+} /* nativeIo_readAt */
+
+static PHYSFS_sint64 nativeIo_readv(PHYSFS_Io *io, const PHYSFS_IoVec *vec,
+                                    PHYSFS_uint32 count)
+{
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    PHYSFS_TraceEvent trace;
+    PHYSFS_uint64 requested = 0;
+    PHYSFS_sint64 retval = 0;
+    PHYSFS_uint32 i;
+
+    for (i = 0; i < count; i++)
+        requested += vec[i].len;
+
+    TRACE_BEGIN(trace, PHYSFS_TRACE_IO_READ, info->path, io, requested);
+    for (i = 0; i < count; i++)
+    {
+        const PHYSFS_sint64 rc = __PHYSFS_platformReadAt(info->handle,
+                                        vec[i].offset, vec[i].buf, vec[i].len);
+        if (rc < 0)
+        {
+            if (i == 0)
+                retval = -1;
+            break;
+        } /* if */
+
+        retval += rc;
+        if (((PHYSFS_uint64) rc) != vec[i].len)
+            break;
+    } /* for */
+    TRACE_END(trace, NULL, retval);
+
+    if (retval > 0)
+        __PHYSFS_STAT_ADD(info->stats, bytesReadPhysical, retval);
+    return retval;
+} /* nativeIo_readv */
+#endif
+
+static PHYSFS_sint64 nativeIo_write(PHYSFS_Io *io, const void *buffer,
+                                    PHYSFS_uint64 len)
+{
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    return __PHYSFS_platformWrite(info->handle, buffer, len);
+} /* nativeIo_write */
+
+static int nativeIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
+{
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    PHYSFS_TraceEvent trace;
+    int rc;
+
+    TRACE_BEGIN(trace, PHYSFS_TRACE_IO_SEEK, info->path, io, offset);
+    rc = __PHYSFS_platformSeek(info->handle, offset);
+    TRACE_END(trace, NULL, rc);
+    return rc;
+} /* nativeIo_seek */
+
+static PHYSFS_sint64 nativeIo_tell(PHYSFS_Io *io)
+{
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    return __PHYSFS_platformTell(info->handle);
+} /* nativeIo_tell */
+
+static PHYSFS_sint64 nativeIo_length(PHYSFS_Io *io)
+{
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    return __PHYSFS_platformFileLength(info->handle);
+} /* nativeIo_length */
+
+static PHYSFS_Io *nativeIo_duplicate(PHYSFS_Io *io)
+{
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+#if PHYSFS_SUPPORTS_STATS
+    PHYSFS_Io *retval = __PHYSFS_createNativeIo(info->path, info->mode);
+    if (retval != NULL)
+        ((NativeIoInfo *) retval->opaque)->stats = info->stats;
+    return retval;
+#else
+    return __PHYSFS_createNativeIo(info->path, info->mode);
 #endif
+} /* nativeIo_duplicate */
 
-#endif  /* include-once blocker. */
+static int nativeIo_flush(PHYSFS_Io *io)
+{
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    return __PHYSFS_platformFlush(info->handle);
+} /* nativeIo_flush */
+
+static void nativeIo_destroy(PHYSFS_Io *io)
+{
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    if (info->sched != NULL)
+        ioSchedDestroy(info->sched);
+    __PHYSFS_platformClose(info->handle);
+    allocator.Free((void *) info->path);
+    allocator.Free(info);
+    allocator.Free(io);
+} /* nativeIo_destroy */
+
+static const PHYSFS_Io __PHYSFS_nativeIoInterface =
+{
+    CURRENT_PHYSFS_IO_API_VERSION, NULL,
+    nativeIo_read,
+    nativeIo_write,
+    nativeIo_seek,
+    nativeIo_tell,
+    nativeIo_length,
+    nativeIo_duplicate,
+    nativeIo_flush,
+    nativeIo_destroy,
+#if PHYSFS_PLATFORM_READAT
+    nativeIo_readAt,
+    nativeIo_readv
+#else
+    NULL,
+    NULL
+#endif
+};
 
+PHYSFS_Io *__PHYSFS_createNativeIo(const char *path, const int mode)
+{
+    PHYSFS_Io *io = NULL;
+    NativeIoInfo *info = NULL;
+    void *handle = NULL;
+    char *pathdup = NULL;
 
-#include <assert.h>
+    assert((mode == 'r') || (mode == 'w') || (mode == 'a'));
 
-#define __PHYSFS_COMPILE_TIME_ASSERT(name, x) \
-       typedef int __PHYSFS_compile_time_assert_##name[(x) * 2 - 1]
+    io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
+    GOTO_IF(!io, PHYSFS_ERR_OUT_OF_MEMORY, createNativeIo_failed);
+    info = (NativeIoInfo *) allocator.Malloc(sizeof (NativeIoInfo));
+    GOTO_IF(!info, PHYSFS_ERR_OUT_OF_MEMORY, createNativeIo_failed);
+    pathdup = (char *) allocator.Malloc(strlen(path) + 1);
+    GOTO_IF(!pathdup, PHYSFS_ERR_OUT_OF_MEMORY, createNativeIo_failed);
+
+    if (mode == 'r')
+        handle = __PHYSFS_platformOpenRead(path);
+    else if (mode == 'w')
+        handle = __PHYSFS_platformOpenWrite(path);
+    else if (mode == 'a')
+        handle = __PHYSFS_platformOpenAppend(path);
+
+    GOTO_IF_ERRPASS(!handle, createNativeIo_failed);
+
+    strcpy(pathdup, path);
+    info->handle = handle;
+    info->path = pathdup;
+    info->mode = mode;
+    info->sched = NULL;
+#if PHYSFS_SUPPORTS_STATS
+    info->stats = NULL;
+#endif
+    memcpy(io, &__PHYSFS_nativeIoInterface, sizeof (*io));
+    io->opaque = info;
+    return io;
+
+createNativeIo_failed:
+    if (handle != NULL) __PHYSFS_platformClose(handle);
+    if (pathdup != NULL) allocator.Free(pathdup);
+    if (info != NULL) allocator.Free(info);
+    if (io != NULL) allocator.Free(io);
+    return NULL;
+} /* __PHYSFS_createNativeIo */
 
-/* !!! FIXME: remove this when revamping stack allocation code... */
-#if defined(_MSC_VER) || defined(__MINGW32__) || defined(__WATCOMC__)
-#include <malloc.h>
-#endif
 
-#ifdef PHYSFS_PLATFORM_SOLARIS
-#include <alloca.h>
-#endif
+/* PHYSFS_Io implementation for i/o to a memory buffer... */
 
-#ifdef __cplusplus
-extern "C" {
+typedef struct __PHYSFS_MemoryIoInfo
+{
+    const PHYSFS_uint8 *buf;
+    PHYSFS_uint64 len;
+    PHYSFS_uint64 pos;
+    PHYSFS_Io *parent;
+    int refcount;
+    void (*destruct)(void *);
+#if PHYSFS_SUPPORTS_STATS
+    PHYSFS_IoStats *stats;  /* counters of the archive we back, or NULL. */
 #endif
+} MemoryIoInfo;
 
-#ifdef __GNUC__
-#define PHYSFS_MINIMUM_GCC_VERSION(major, minor) \
-    ( ((__GNUC__ << 16) + __GNUC_MINOR__) >= (((major) << 16) + (minor)) )
-#else
-#define PHYSFS_MINIMUM_GCC_VERSION(major, minor) (0)
-#endif
+static PHYSFS_sint64 memoryIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
+{
+    MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
+    const PHYSFS_uint64 avail = info->len - info->pos;
+    assert(avail <= info->len);
 
-#ifdef __cplusplus
-    /* C++ always has a real inline keyword. */
-#elif (defined macintosh) && !(defined __MWERKS__)
-#   define inline
-#elif (defined _MSC_VER)
-#   define inline __inline
-#endif
+    if (avail == 0)
+        return 0;  /* we're at EOF; nothing to do. */
 
-#if defined(PHYSFS_PLATFORM_LINUX) && !defined(_FILE_OFFSET_BITS)
-#define _FILE_OFFSET_BITS 64
-#endif
+    if (len > avail)
+        len = avail;
 
-/* All public APIs need to be in physfs.h with a PHYSFS_DECL.
-   All file-private symbols need to be marked "static".
-   Everything shared between PhysicsFS sources needs to be in this
-   file between the visibility pragma blocks. */
-#if PHYSFS_MINIMUM_GCC_VERSION(4,0) || defined(__clang__)
-#define PHYSFS_HAVE_PRAGMA_VISIBILITY 1
-#endif
+    memcpy(buf, info->buf + info->pos, (size_t) len);
+    info->pos += len;
 
-#if PHYSFS_HAVE_PRAGMA_VISIBILITY
-#pragma GCC visibility push(hidden)
+    /* only count buffers backing an archive, not decoded file data. */
+#if PHYSFS_SUPPORTS_STATS
+    if (info->stats != NULL)
+        __PHYSFS_STAT_ADD(info->stats, bytesReadPhysical, len);
 #endif
 
-/* These are the build-in archivers. We list them all as "extern" here without
-   #ifdefs to keep it tidy, but obviously you need to make sure these are
-   wrapped in PHYSFS_SUPPORTS_* checks before actually referencing them. */
-extern const PHYSFS_Archiver __PHYSFS_Archiver_DIR;
-extern const PHYSFS_Archiver __PHYSFS_Archiver_ZIP;
-extern const PHYSFS_Archiver __PHYSFS_Archiver_7Z;
-extern const PHYSFS_Archiver __PHYSFS_Archiver_GRP;
-extern const PHYSFS_Archiver __PHYSFS_Archiver_QPAK;
-extern const PHYSFS_Archiver __PHYSFS_Archiver_HOG;
-extern const PHYSFS_Archiver __PHYSFS_Archiver_MVL;
-extern const PHYSFS_Archiver __PHYSFS_Archiver_WAD;
-extern const PHYSFS_Archiver __PHYSFS_Archiver_SLB;
-extern const PHYSFS_Archiver __PHYSFS_Archiver_ISO9660;
-extern const PHYSFS_Archiver __PHYSFS_Archiver_VDF;
+    return len;
+} /* memoryIo_read */
 
-/* a real C99-compliant snprintf() is in Visual Studio 2015,
-   but just use this everywhere for binary compatibility. */
-#if defined(_MSC_VER)
-#include <stdarg.h>
-int __PHYSFS_msvc_vsnprintf(char *outBuf, size_t size, const char *format, va_list ap);
-int __PHYSFS_msvc_snprintf(char *outBuf, size_t size, const char *format, ...);
-#define vsnprintf __PHYSFS_msvc_vsnprintf
-#define snprintf __PHYSFS_msvc_snprintf
-#endif
+static PHYSFS_sint64 memoryIo_readAt(PHYSFS_Io *io, PHYSFS_uint64 offset,
+                                     void *buf, PHYSFS_uint64 len)
+{
+    const MemoryIoInfo *info = (const MemoryIoInfo *) io->opaque;
 
-/* Some simple wrappers around WinRT C++ interfaces we can call from C. */
-#ifdef PHYSFS_PLATFORM_WINRT
-const void *__PHYSFS_winrtCalcBaseDir(void);
-const void *__PHYSFS_winrtCalcPrefDir(void);
-#endif
+    if (offset >= info->len)
+        return 0;  /* at or past EOF; nothing to do. */
 
-/* atomic operations. */
-#if defined(_MSC_VER) && (_MSC_VER >= 1500)
-#include <intrin.h>
-__PHYSFS_COMPILE_TIME_ASSERT(LongEqualsInt, sizeof (int) == sizeof (long));
-#define __PHYSFS_ATOMIC_INCR(ptrval) _InterlockedIncrement((long*)(ptrval))
-#define __PHYSFS_ATOMIC_DECR(ptrval) _InterlockedDecrement((long*)(ptrval))
-#elif defined(__clang__) || (defined(__GNUC__) && (((__GNUC__ * 10000) + (__GNUC_MINOR__ * 100)) >= 40100))
-#define __PHYSFS_ATOMIC_INCR(ptrval) __sync_fetch_and_add(ptrval, 1)
-#define __PHYSFS_ATOMIC_DECR(ptrval) __sync_fetch_and_add(ptrval, -1)
-#else
-#define PHYSFS_NEED_ATOMIC_OP_FALLBACK 1
-int __PHYSFS_ATOMIC_INCR(int *ptrval);
-int __PHYSFS_ATOMIC_DECR(int *ptrval);
-#endif
+    if (len > info->len - offset)
+        len = info->len - offset;
 
+    memcpy(buf, info->buf + offset, (size_t) len);
 
-/*
- * Interface for small allocations. If you need a little scratch space for
- *  a throwaway buffer or string, use this. It will make small allocations
- *  on the stack if possible, and use allocator.Malloc() if they are too
- *  large. This helps reduce malloc pressure.
- * There are some rules, though:
- * NEVER return a pointer from this, as stack-allocated buffers go away
- *  when your function returns.
- * NEVER allocate in a loop, as stack-allocated pointers will pile up. Call
- *  a function that uses smallAlloc from your loop, so the allocation can
- *  free each time.
- * NEVER call smallAlloc with any complex expression (it's a macro that WILL
- *  have side effects...it references the argument multiple times). Use a
- *  variable or a literal.
- * NEVER free a pointer from this with anything but smallFree. It will not
- *  be a valid pointer to the allocator, regardless of where the memory came
- *  from.
- * NEVER realloc a pointer from this.
- * NEVER forget to use smallFree: it may not be a pointer from the stack.
- * NEVER forget to check for NULL...allocation can fail here, of course!
- */
-#define __PHYSFS_SMALLALLOCTHRESHOLD 256
-void *__PHYSFS_initSmallAlloc(void *ptr, const size_t len);
+#if PHYSFS_SUPPORTS_STATS
+    if (info->stats != NULL)
+        __PHYSFS_STAT_ADD(info->stats, bytesReadPhysical, len);
+#endif
 
-#define __PHYSFS_smallAlloc(bytes) ( \
-    __PHYSFS_initSmallAlloc( \
-        (((bytes) < __PHYSFS_SMALLALLOCTHRESHOLD) ? \
-            alloca((size_t)((bytes)+sizeof(void*))) : NULL), (bytes)) \
-)
+    return len;
+} /* memoryIo_readAt */
 
-void __PHYSFS_smallFree(void *ptr);
+static PHYSFS_sint64 memoryIo_readv(PHYSFS_Io *io, const PHYSFS_IoVec *vec,
+                                    PHYSFS_uint32 count)
+{
+    PHYSFS_sint64 retval = 0;
+    PHYSFS_uint32 i;
 
+    for (i = 0; i < count; i++)
+    {
+        const PHYSFS_sint64 rc = memoryIo_readAt(io, vec[i].offset,
+                                                 vec[i].buf, vec[i].len);
+        retval += rc;
+        if (((PHYSFS_uint64) rc) != vec[i].len)
+            break;
+    } /* for */
 
-/* Use the allocation hooks. */
-#define malloc(x) Do not use malloc() directly.
-#define realloc(x, y) Do not use realloc() directly.
-#define free(x) Do not use free() directly.
-/* !!! FIXME: add alloca check here. */
+    return retval;
+} /* memoryIo_readv */
 
+static PHYSFS_sint64 memoryIo_write(PHYSFS_Io *io, const void *buffer,
+                                    PHYSFS_uint64 len)
+{
+    BAIL(PHYSFS_ERR_OPEN_FOR_READING, -1);
+} /* memoryIo_write */
 
-/* by default, enable things, so builds can opt out of a few things they
-   want to avoid. But you can build with this #defined to 0 if you would
-   like to turn off everything except a handful of things you opt into. */
-#ifndef PHYSFS_SUPPORTS_DEFAULT
-#define PHYSFS_SUPPORTS_DEFAULT 1
-#endif
+static int memoryIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
+{
+    MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
+    BAIL_IF(offset > info->len, PHYSFS_ERR_PAST_EOF, 0);
+    info->pos = offset;
+    return 1;
+} /* memoryIo_seek */
 
+static PHYSFS_sint64 memoryIo_tell(PHYSFS_Io *io)
+{
+    const MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
+    return (PHYSFS_sint64) info->pos;
+} /* memoryIo_tell */
 
-#ifndef PHYSFS_SUPPORTS_ZIP
-#define PHYSFS_SUPPORTS_ZIP PHYSFS_SUPPORTS_DEFAULT
-#endif
-#ifndef PHYSFS_SUPPORTS_7Z
-#define PHYSFS_SUPPORTS_7Z PHYSFS_SUPPORTS_DEFAULT
-#endif
-#ifndef PHYSFS_SUPPORTS_GRP
-#define PHYSFS_SUPPORTS_GRP PHYSFS_SUPPORTS_DEFAULT
-#endif
-#ifndef PHYSFS_SUPPORTS_HOG
-#define PHYSFS_SUPPORTS_HOG PHYSFS_SUPPORTS_DEFAULT
-#endif
-#ifndef PHYSFS_SUPPORTS_MVL
-#define PHYSFS_SUPPORTS_MVL PHYSFS_SUPPORTS_DEFAULT
-#endif
-#ifndef PHYSFS_SUPPORTS_WAD
-#define PHYSFS_SUPPORTS_WAD PHYSFS_SUPPORTS_DEFAULT
-#endif
-#ifndef PHYSFS_SUPPORTS_QPAK
-#define PHYSFS_SUPPORTS_QPAK PHYSFS_SUPPORTS_DEFAULT
-#endif
-#ifndef PHYSFS_SUPPORTS_SLB
-#define PHYSFS_SUPPORTS_SLB PHYSFS_SUPPORTS_DEFAULT
-#endif
-#ifndef PHYSFS_SUPPORTS_ISO9660
-#define PHYSFS_SUPPORTS_ISO9660 PHYSFS_SUPPORTS_DEFAULT
-#endif
-#ifndef PHYSFS_SUPPORTS_VDF
-#define PHYSFS_SUPPORTS_VDF PHYSFS_SUPPORTS_DEFAULT
-#endif
+static PHYSFS_sint64 memoryIo_length(PHYSFS_Io *io)
+{
+    const MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
+    return (PHYSFS_sint64) info->len;
+} /* memoryIo_length */
 
-#if PHYSFS_SUPPORTS_7Z
-/* 7zip support needs a global init function called at startup (no deinit). */
-extern void SZIP_global_init(void);
-#endif
+static PHYSFS_Io *memoryIo_duplicate(PHYSFS_Io *io)
+{
+    MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
+    MemoryIoInfo *newinfo = NULL;
+    PHYSFS_Io *parent = info->parent;
+    PHYSFS_Io *retval = NULL;
 
-/* The latest supported PHYSFS_Io::version value. */
-#define CURRENT_PHYSFS_IO_API_VERSION 0
+    /* avoid deep copies. */
+    assert((!parent) || (!((MemoryIoInfo *) parent->opaque)->parent) );
 
-/* The latest supported PHYSFS_Archiver::version value. */
-#define CURRENT_PHYSFS_ARCHIVER_API_VERSION 0
+    /* share the buffer between duplicates. */
+    if (parent != NULL)  /* dup the parent, increment its refcount. */
+        return parent->duplicate(parent);
 
-/* This byteorder stuff was lifted from SDL. https://www.libsdl.org/ */
-#define PHYSFS_LIL_ENDIAN  1234
-#define PHYSFS_BIG_ENDIAN  4321
+    /* we're the parent. */
 
-#ifdef __linux__
-#include <endian.h>
-#define PHYSFS_BYTEORDER  __BYTE_ORDER
-#else /* __linux__ */
-#if defined(__hppa__) || \
-    defined(__m68k__) || defined(mc68000) || defined(_M_M68K) || \
-    (defined(__MIPS__) && defined(__MISPEB__)) || \
-    defined(__ppc__) || defined(__POWERPC__) || defined(_M_PPC) || \
-    defined(__sparc__)
-#define PHYSFS_BYTEORDER   PHYSFS_BIG_ENDIAN
-#else
-#define PHYSFS_BYTEORDER   PHYSFS_LIL_ENDIAN
-#endif
-#endif /* __linux__ */
+    retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
+    BAIL_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    newinfo = (MemoryIoInfo *) allocator.Malloc(sizeof (MemoryIoInfo));
+    if (!newinfo)
+    {
+        allocator.Free(retval);
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    } /* if */
 
+    __PHYSFS_ATOMIC_INCR(&info->refcount);
 
-/*
- * When sorting the entries in an archive, we use a modified QuickSort.
- *  When there are less then PHYSFS_QUICKSORT_THRESHOLD entries left to sort,
- *  we switch over to a BubbleSort for the remainder. Tweak to taste.
- *
- * You can override this setting by defining PHYSFS_QUICKSORT_THRESHOLD
- *  before #including "physfs_internal.h".
- */
-#ifndef PHYSFS_QUICKSORT_THRESHOLD
-#define PHYSFS_QUICKSORT_THRESHOLD 4
+    memset(newinfo, '\0', sizeof (*info));
+    newinfo->buf = info->buf;
+    newinfo->len = info->len;
+    newinfo->pos = 0;
+    newinfo->parent = io;
+    newinfo->refcount = 0;
+    newinfo->destruct = NULL;
+#if PHYSFS_SUPPORTS_STATS
+    newinfo->stats = info->stats;
 #endif
 
-/*
- * Sort an array (or whatever) of (max) elements. This uses a mixture of
- *  a QuickSort and BubbleSort internally.
- * (cmpfn) is used to determine ordering, and (swapfn) does the actual
- *  swapping of elements in the list.
- */
-void __PHYSFS_sort(void *entries, size_t max,
-                   int (*cmpfn)(void *, size_t, size_t),
-                   void (*swapfn)(void *, size_t, size_t));
+    memcpy(retval, io, sizeof (*retval));
+    retval->opaque = newinfo;
+    return retval;
+} /* memoryIo_duplicate */
 
-/* These get used all over for lessening code clutter. */
-/* "ERRPASS" means "something else just set the error state for us" and is
-    just to make it clear where the responsibility for the error state lays. */
-#define BAIL(e, r) do { if (e) PHYSFS_setErrorCode(e); return r; } while (0)
-#define BAIL_ERRPASS(r) do { return r; } while (0)
-#define BAIL_IF(c, e, r) do { if (c) { if (e) PHYSFS_setErrorCode(e); return r; } } while (0)
-#define BAIL_IF_ERRPASS(c, r) do { if (c) { return r; } } while (0)
-#define BAIL_MUTEX(e, m, r) do { if (e) PHYSFS_setErrorCode(e); __PHYSFS_platformReleaseMutex(m); return r; } while (0)
-#define BAIL_MUTEX_ERRPASS(m, r) do { __PHYSFS_platformReleaseMutex(m); return r; } while (0)
-#define BAIL_IF_MUTEX(c, e, m, r) do { if (c) { if (e) PHYSFS_setErrorCode(e); __PHYSFS_platformReleaseMutex(m); return r; } } while (0)
-#define BAIL_IF_MUTEX_ERRPASS(c, m, r) do { if (c) { __PHYSFS_platformReleaseMutex(m); return r; } } while (0)
-#define GOTO(e, g) do { if (e) PHYSFS_setErrorCode(e); goto g; } while (0)
-#define GOTO_ERRPASS(g) do { goto g; } while (0)
-#define GOTO_IF(c, e, g) do { if (c) { if (e) PHYSFS_setErrorCode(e); goto g; } } while (0)
-#define GOTO_IF_ERRPASS(c, g) do { if (c) { goto g; } } while (0)
-#define GOTO_MUTEX(e, m, g) do { if (e) PHYSFS_setErrorCode(e); __PHYSFS_platformReleaseMutex(m); goto g; } while (0)
-#define GOTO_MUTEX_ERRPASS(m, g) do { __PHYSFS_platformReleaseMutex(m); goto g; } while (0)
-#define GOTO_IF_MUTEX(c, e, m, g) do { if (c) { if (e) PHYSFS_setErrorCode(e); __PHYSFS_platformReleaseMutex(m); goto g; } } while (0)
-#define GOTO_IF_MUTEX_ERRPASS(c, m, g) do { if (c) { __PHYSFS_platformReleaseMutex(m); goto g; } } while (0)
+static int memoryIo_flush(PHYSFS_Io *io) { return 1;  /* it's read-only. */ }
 
-#define __PHYSFS_ARRAYLEN(x) ( (sizeof (x)) / (sizeof (x[0])) )
+static void memoryIo_destroy(PHYSFS_Io *io)
+{
+    MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
+    PHYSFS_Io *parent = info->parent;
 
-#ifdef PHYSFS_NO_64BIT_SUPPORT
-#define __PHYSFS_SI64(x) ((PHYSFS_sint64) (x))
-#define __PHYSFS_UI64(x) ((PHYSFS_uint64) (x))
-#elif (defined __GNUC__)
-#define __PHYSFS_SI64(x) x##LL
-#define __PHYSFS_UI64(x) x##ULL
-#elif (defined _MSC_VER)
-#define __PHYSFS_SI64(x) x##i64
-#define __PHYSFS_UI64(x) x##ui64
-#else
-#define __PHYSFS_SI64(x) ((PHYSFS_sint64) (x))
-#define __PHYSFS_UI64(x) ((PHYSFS_uint64) (x))
-#endif
+    if (parent != NULL)
+    {
+        assert(info->buf == ((MemoryIoInfo *) info->parent->opaque)->buf);
+        assert(info->len == ((MemoryIoInfo *) info->parent->opaque)->len);
+        assert(info->refcount == 0);
+        assert(info->destruct == NULL);
+        allocator.Free(info);
+        allocator.Free(io);
+        parent->destroy(parent);  /* decrements refcount. */
+        return;
+    } /* if */
 
+    /* we _are_ the parent. */
+    assert(info->refcount > 0);  /* even in a race, we hold a reference. */
 
-/*
- * Check if a ui64 will fit in the platform's address space.
- *  The initial sizeof check will optimize this macro out entirely on
- *  64-bit (and larger?!) platforms, and the other condition will
- *  return zero or non-zero if the variable will fit in the platform's
- *  size_t, suitable to pass to malloc. This is kinda messy, but effective.
- */
-#define __PHYSFS_ui64FitsAddressSpace(s) ( \
-    (sizeof (PHYSFS_uint64) <= sizeof (size_t)) || \
-    ((s) < (__PHYSFS_UI64(0xFFFFFFFFFFFFFFFF) >> (64-(sizeof(size_t)*8)))) \
-)
+    if (__PHYSFS_ATOMIC_DECR(&info->refcount) == 0)
+    {
+        void (*destruct)(void *) = info->destruct;
+        void *buf = (void *) info->buf;
+        io->opaque = NULL;  /* kill this here in case of race. */
+        allocator.Free(info);
+        allocator.Free(io);
+        if (destruct != NULL)
+            destruct(buf);
+    } /* if */
+} /* memoryIo_destroy */
 
-/*
- * Like strdup(), but uses the current PhysicsFS allocator.
- */
-char *__PHYSFS_strdup(const char *str);
 
-/*
- * Give a hash value for a C string (uses djb's xor hashing algorithm).
- */
-PHYSFS_uint32 __PHYSFS_hashString(const char *str, size_t len);
+static const PHYSFS_Io __PHYSFS_memoryIoInterface =
+{
+    CURRENT_PHYSFS_IO_API_VERSION, NULL,
+    memoryIo_read,
+    memoryIo_write,
+    memoryIo_seek,
+    memoryIo_tell,
+    memoryIo_length,
+    memoryIo_duplicate,
+    memoryIo_flush,
+    memoryIo_destroy,
+    memoryIo_readAt,
+    memoryIo_readv
+};
 
+PHYSFS_Io *__PHYSFS_createMemoryIo(const void *buf, PHYSFS_uint64 len,
+                                   void (*destruct)(void *))
+{
+    PHYSFS_Io *io = NULL;
+    MemoryIoInfo *info = NULL;
 
-/*
- * The current allocator. Not valid before PHYSFS_init is called!
- */
-extern PHYSFS_Allocator __PHYSFS_AllocatorHooks;
+    io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
+    GOTO_IF(!io, PHYSFS_ERR_OUT_OF_MEMORY, createMemoryIo_failed);
+    info = (MemoryIoInfo *) allocator.Malloc(sizeof (MemoryIoInfo));
+    GOTO_IF(!info, PHYSFS_ERR_OUT_OF_MEMORY, createMemoryIo_failed);
 
-/* convenience macro to make this less cumbersome internally... */
-#define allocator __PHYSFS_AllocatorHooks
-#define physfs_allocator __PHYSFS_AllocatorHooks
-/*
- * Create a PHYSFS_Io for a file in the physical filesystem.
- *  This path is in platform-dependent notation. (mode) must be 'r', 'w', or
- *  'a' for Read, Write, or Append.
- */
-PHYSFS_Io *__PHYSFS_createNativeIo(const char *path, const int mode);
+    memset(info, '\0', sizeof (*info));
+    info->buf = (const PHYSFS_uint8 *) buf;
+    info->len = len;
+    info->pos = 0;
+    info->parent = NULL;
+    info->refcount = 1;
+    info->destruct = destruct;
 
-/*
- * Create a PHYSFS_Io for a buffer of memory (READ-ONLY). If you already
- *  have one of these, just use its duplicate() method, and it'll increment
- *  its refcount without allocating a copy of the buffer.
- */
-PHYSFS_Io *__PHYSFS_createMemoryIo(const void *buf, PHYSFS_uint64 len,
-                                   void (*destruct)(void *));
+    memcpy(io, &__PHYSFS_memoryIoInterface, sizeof (*io));
+    io->opaque = info;
+    return io;
 
+createMemoryIo_failed:
+    if (info != NULL) allocator.Free(info);
+    if (io != NULL) allocator.Free(io);
+    return NULL;
+} /* __PHYSFS_createMemoryIo */
 
-/*
- * Read (len) bytes from (io) into (buf). Returns non-zero on success,
- *  zero on i/o error. Literally: "return (io->read(io, buf, len) == len);"
- */
-int __PHYSFS_readAll(PHYSFS_Io *io, void *buf, const size_t len);
 
+/* PHYSFS_Io implementation for a private position in another i/o... */
 
-/* These are shared between some archivers. */
+typedef struct __PHYSFS_ReaderIoInfo
+{
+    PHYSFS_Io *parent;  /* has readAt(); not ours, it outlives us. */
+    PHYSFS_uint64 pos;
+    PHYSFS_IoPriority priority;  /* for the parent's scheduler, if any. */
+    PHYSFS_uint32 deadline;  /* milliseconds, 0 for none. */
+} ReaderIoInfo;
 
-void UNPK_abandonArchive(void *opaque);
-void UNPK_closeArchive(void *opaque);
-void *UNPK_openArchive(PHYSFS_Io *io);
-void *UNPK_addEntry(void *opaque, char *name, const int isdir,
-                    const PHYSFS_sint64 ctime, const PHYSFS_sint64 mtime,
-                    const PHYSFS_uint64 pos, const PHYSFS_uint64 len);
-PHYSFS_Io *UNPK_openRead(void *opaque, const char *name);
-PHYSFS_Io *UNPK_openWrite(void *opaque, const char *name);
-PHYSFS_Io *UNPK_openAppend(void *opaque, const char *name);
-int UNPK_remove(void *opaque, const char *name);
-int UNPK_mkdir(void *opaque, const char *name);
-int UNPK_stat(void *opaque, const char *fn, PHYSFS_Stat *st);
-#define UNPK_enumerate __PHYSFS_DirTreeEnumerate
+/* the parent's scheduler, if it's turned on. */
+static IoScheduler *readerIoScheduler(const ReaderIoInfo *info)
+{
+    const PHYSFS_Io *parent = info->parent;
+    IoScheduler *sched;
 
+    if (parent->read != nativeIo_read)
+        return NULL;
+    sched = ((const NativeIoInfo *) parent->opaque)->sched;
+    return ((sched != NULL) && (sched->enabled)) ? sched : NULL;
+} /* readerIoScheduler */
 
+static PHYSFS_sint64 readerIoReadAt(const ReaderIoInfo *info,
+                                    PHYSFS_uint64 offset, void *buf,
+                                    PHYSFS_uint64 len)
+{
+    PHYSFS_Io *parent = info->parent;
+    IoScheduler *sched = readerIoScheduler(info);
+    if (sched != NULL)
+    {
+        return ioSchedRead(sched, parent, offset, buf, len,
+                           info->priority, info->deadline);
+    } /* if */
+    return parent->readAt(parent, offset, buf, len);
+} /* readerIoReadAt */
 
-/* Optional API many archivers use this to manage their directory tree. */
-/* !!! FIXME: document this better. */
+static PHYSFS_sint64 readerIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
+{
+    ReaderIoInfo *info = (ReaderIoInfo *) io->opaque;
+    const PHYSFS_sint64 rc = readerIoReadAt(info, info->pos, buf, len);
+    if (rc > 0)
+        info->pos += (PHYSFS_uint64) rc;
+    return rc;
+} /* readerIo_read */
 
-typedef struct __PHYSFS_DirTreeEntry
+static PHYSFS_sint64 readerIo_write(PHYSFS_Io *io, const void *buffer,
+                                    PHYSFS_uint64 len)
 {
-    char *name;                              /* Full path in archive.        */
-    struct __PHYSFS_DirTreeEntry *hashnext;  /* next item in hash bucket.    */
-    struct __PHYSFS_DirTreeEntry *children;  /* linked list of kids, if dir. */
-    struct __PHYSFS_DirTreeEntry *sibling;   /* next item in same dir.       */
-    int isdir;
-} __PHYSFS_DirTreeEntry;
+    BAIL(PHYSFS_ERR_OPEN_FOR_READING, -1);
+} /* readerIo_write */
 
-typedef struct __PHYSFS_DirTree
+static int readerIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
 {
-    __PHYSFS_DirTreeEntry *root;    /* root of directory tree.             */
-    __PHYSFS_DirTreeEntry **hash;  /* all entries hashed for fast lookup. */
-    size_t hashBuckets;            /* number of buckets in hash.          */
-    size_t entrylen;    /* size in bytes of entries (including subclass). */
-} __PHYSFS_DirTree;
+    /* no syscall, that's the point. Reading past the end gets EOF. */
+    ((ReaderIoInfo *) io->opaque)->pos = offset;
+    return 1;
+} /* readerIo_seek */
 
+static PHYSFS_sint64 readerIo_tell(PHYSFS_Io *io)
+{
+    return (PHYSFS_sint64) ((ReaderIoInfo *) io->opaque)->pos;
+} /* readerIo_tell */
 
-int __PHYSFS_DirTreeInit(__PHYSFS_DirTree *dt, const size_t entrylen);
-void *__PHYSFS_DirTreeAdd(__PHYSFS_DirTree *dt, char *name, const int isdir);
-void *__PHYSFS_DirTreeFind(__PHYSFS_DirTree *dt, const char *path);
-PHYSFS_EnumerateCallbackResult __PHYSFS_DirTreeEnumerate(void *opaque,
-                              const char *dname, PHYSFS_EnumerateCallback cb,
-                              const char *origdir, void *callbackdata);
-void __PHYSFS_DirTreeDeinit(__PHYSFS_DirTree *dt);
+static PHYSFS_sint64 readerIo_length(PHYSFS_Io *io)
+{
+    PHYSFS_Io *parent = ((ReaderIoInfo *) io->opaque)->parent;
+    return parent->length(parent);
+} /* readerIo_length */
 
+static PHYSFS_Io *readerIo_duplicate(PHYSFS_Io *io)
+{
+    /* a new position in the same parent, not a reader of a reader. */
+    const ReaderIoInfo *info = (const ReaderIoInfo *) io->opaque;
+    PHYSFS_Io *retval = __PHYSFS_duplicateForRead(info->parent);
+    if (retval != NULL)
+    {
+        ReaderIoInfo *dupinfo = (ReaderIoInfo *) retval->opaque;
+        dupinfo->priority = info->priority;
+        dupinfo->deadline = info->deadline;
+    } /* if */
+    return retval;
+} /* readerIo_duplicate */
 
+static int readerIo_flush(PHYSFS_Io *io)
+{
+    return 1;  /* it's read-only. */
+} /* readerIo_flush */
 
-/*--------------------------------------------------------------------------*/
-/*--------------------------------------------------------------------------*/
-/*------------                                              ----------------*/
-/*------------  You MUST implement the following functions  ----------------*/
-/*------------        if porting to a new platform.         ----------------*/
-/*------------     (see platform/unix.c for an example)     ----------------*/
-/*------------                                              ----------------*/
-/*--------------------------------------------------------------------------*/
-/*--------------------------------------------------------------------------*/
+static void readerIo_destroy(PHYSFS_Io *io)
+{
+    allocator.Free(io->opaque);
+    allocator.Free(io);
+} /* readerIo_destroy */
 
+static PHYSFS_sint64 readerIo_readAt(PHYSFS_Io *io, PHYSFS_uint64 offset,
+                                     void *buf, PHYSFS_uint64 len)
+{
+    return readerIoReadAt((ReaderIoInfo *) io->opaque, offset, buf, len);
+} /* readerIo_readAt */
 
-/*
- * The dir separator; '/' on unix, '\\' on win32, ":" on MacOS, etc...
- *  Obviously, this isn't a function. If you need more than one char for this,
- *  you'll need to pull some old pieces of PhysicsFS out of revision control.
- */
-#if defined(PHYSFS_PLATFORM_WINDOWS) || defined(PHYSFS_PLATFORM_OS2)
-#define __PHYSFS_platformDirSeparator '\\'
-#else
-#define __PHYSFS_STANDARD_DIRSEP 1
-#define __PHYSFS_platformDirSeparator '/'
-#endif
+static PHYSFS_sint64 readerIo_readv(PHYSFS_Io *io, const PHYSFS_IoVec *vec,
+                                    PHYSFS_uint32 count)
+{
+    ReaderIoInfo *info = (ReaderIoInfo *) io->opaque;
+    PHYSFS_sint64 retval = 0;
+    PHYSFS_uint32 i;
 
-/*
- * Initialize the platform. This is called when PHYSFS_init() is called from
- *  the application.
- *
- * Return zero if there was a catastrophic failure (which prevents you from
- *  functioning at all), and non-zero otherwise.
- */
-int __PHYSFS_platformInit(void);
+    if (readerIoScheduler(info) == NULL)
+        return __PHYSFS_readv(info->parent, vec, count);
 
+    /* each range is its own read in the queue, so they can be merged. */
+    for (i = 0; i < count; i++)
+    {
+        const PHYSFS_sint64 rc = readerIoReadAt(info, vec[i].offset,
+                                                vec[i].buf, vec[i].len);
+        if (rc < 0)
+            return (i == 0) ? -1 : retval;
+        retval += rc;
+        if (((PHYSFS_uint64) rc) != vec[i].len)
+            break;
+    } /* for */
 
-/*
- * Deinitialize the platform. This is called when PHYSFS_deinit() is called
- *  from the application. You can use this to clean up anything you've
- *  allocated in your platform driver.
- */
-void __PHYSFS_platformDeinit(void);
+    return retval;
+} /* readerIo_readv */
+
+static const PHYSFS_Io __PHYSFS_readerIoInterface =
+{
+    CURRENT_PHYSFS_IO_API_VERSION, NULL,
+    readerIo_read,
+    readerIo_write,
+    readerIo_seek,
+    readerIo_tell,
+    readerIo_length,
+    readerIo_duplicate,
+    readerIo_flush,
+    readerIo_destroy,
+    readerIo_readAt,
+    readerIo_readv
+};
 
+PHYSFS_Io *__PHYSFS_duplicateForRead(PHYSFS_Io *io)
+{
+    PHYSFS_Io *retval = NULL;
+    ReaderIoInfo *info = NULL;
 
-/*
- * Open a file for reading. (filename) is in platform-dependent notation. The
- *  file pointer should be positioned on the first byte of the file.
- *
- * The return value will be some platform-specific datatype that is opaque to
- *  the caller; it could be a (FILE *) under Unix, or a (HANDLE *) under win32.
- *
- * The same file can be opened for read multiple times, and each should have
- *  a unique file handle; this is frequently employed to prevent race
- *  conditions in the archivers.
- *
- * Call PHYSFS_setErrorCode() and return (NULL) if the file can't be opened.
- */
-void *__PHYSFS_platformOpenRead(const char *filename);
+    if (!__PHYSFS_ioHasReadAt(io))
+        return io->duplicate(io);
 
+    retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
+    BAIL_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    info = (ReaderIoInfo *) allocator.Malloc(sizeof (ReaderIoInfo));
+    if (!info)
+    {
+        allocator.Free(retval);
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    } /* if */
 
-/*
- * Open a file for writing. (filename) is in platform-dependent notation. If
- *  the file exists, it should be truncated to zero bytes, and if it doesn't
- *  exist, it should be created as a zero-byte file. The file pointer should
- *  be positioned on the first byte of the file.
- *
- * The return value will be some platform-specific datatype that is opaque to
- *  the caller; it could be a (FILE *) under Unix, or a (HANDLE *) under win32,
- *  etc.
- *
- * Opening a file for write multiple times has undefined results.
- *
- * Call PHYSFS_setErrorCode() and return (NULL) if the file can't be opened.
- */
-void *__PHYSFS_platformOpenWrite(const char *filename);
+    info->parent = io;
+    info->pos = 0;
+    info->priority = PHYSFS_IOPRIO_NORMAL;
+    info->deadline = 0;
+    memcpy(retval, &__PHYSFS_readerIoInterface, sizeof (*retval));
+    retval->opaque = info;
+    return retval;
+} /* __PHYSFS_duplicateForRead */
 
 
-/*
- * Open a file for appending. (filename) is in platform-dependent notation. If
- *  the file exists, the file pointer should be place just past the end of the
- *  file, so that the first write will be one byte after the current end of
- *  the file. If the file doesn't exist, it should be created as a zero-byte
- *  file. The file pointer should be positioned on the first byte of the file.
- *
- * The return value will be some platform-specific datatype that is opaque to
- *  the caller; it could be a (FILE *) under Unix, or a (HANDLE *) under win32,
- *  etc.
- *
- * Opening a file for append multiple times has undefined results.
- *
- * Call PHYSFS_setErrorCode() and return (NULL) if the file can't be opened.
- */
-void *__PHYSFS_platformOpenAppend(const char *filename);
+#if PHYSFS_SUPPORTS_STATS
+void __PHYSFS_setIoStats(PHYSFS_Io *io, PHYSFS_IoStats *stats)
+{
+    if (io == NULL)
+        return;
+    else if (io->read == nativeIo_read)
+        ((NativeIoInfo *) io->opaque)->stats = stats;
+    else if (io->read == memoryIo_read)
+        ((MemoryIoInfo *) io->opaque)->stats = stats;
+} /* __PHYSFS_setIoStats */
 
-/*
- * Read more data from a platform-specific file handle. (opaque) should be
- *  cast to whatever data type your platform uses. Read a maximum of (len)
- *  8-bit bytes to the area pointed to by (buf). If there isn't enough data
- *  available, return the number of bytes read, and position the file pointer
- *  immediately after those bytes.
- *  On success, return (len) and position the file pointer immediately past
- *  the end of the last read byte. Return (-1) if there is a catastrophic
- *  error, and call PHYSFS_setErrorCode() to describe the problem; the file
- *  pointer should not move in such a case. A partial read is success; only
- *  return (-1) on total failure; presumably, the next read call after a
- *  partial read will fail as such.
- */
-PHYSFS_sint64 __PHYSFS_platformRead(void *opaque, void *buf, PHYSFS_uint64 len);
+PHYSFS_IoStats *__PHYSFS_getIoStats(PHYSFS_Io *io)
+{
+    if (io == NULL)
+        return NULL;
+    else if (io->read == nativeIo_read)
+        return ((NativeIoInfo *) io->opaque)->stats;
+    else if (io->read == memoryIo_read)
+        return ((MemoryIoInfo *) io->opaque)->stats;
+    else if (io->read == readerIo_read)
+        return __PHYSFS_getIoStats(((ReaderIoInfo *) io->opaque)->parent);
+    return NULL;
+} /* __PHYSFS_getIoStats */
+#endif
 
-/*
- * Write more data to a platform-specific file handle. (opaque) should be
- *  cast to whatever data type your platform uses. Write a maximum of (len)
- *  8-bit bytes from the area pointed to by (buffer). If there is a problem,
- *  return the number of bytes written, and position the file pointer
- *  immediately after those bytes. Return (-1) if there is a catastrophic
- *  error, and call PHYSFS_setErrorCode() to describe the problem; the file
- *  pointer should not move in such a case. A partial write is success; only
- *  return (-1) on total failure; presumably, the next write call after a
- *  partial write will fail as such.
- */
-PHYSFS_sint64 __PHYSFS_platformWrite(void *opaque, const void *buffer,
-                                     PHYSFS_uint64 len);
 
-/*
- * Set the file pointer to a new position. (opaque) should be cast to
- *  whatever data type your platform uses. (pos) specifies the number
- *  of 8-bit bytes to seek to from the start of the file. Seeking past the
- *  end of the file is an error condition, and you should check for it.
- *
- * Not all file types can seek; this is to be expected by the caller.
- *
- * On error, call PHYSFS_setErrorCode() and return zero. On success, return
- *  a non-zero value.
- */
-int __PHYSFS_platformSeek(void *opaque, PHYSFS_uint64 pos);
+/* PHYSFS_Io implementation for i/o to a PHYSFS_File... */
 
+static PHYSFS_sint64 handleIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
+{
+    return PHYSFS_readBytes((PHYSFS_File *) io->opaque, buf, len);
+} /* handleIo_read */
 
-/*
- * Get the file pointer's position, in an 8-bit byte offset from the start of
- *  the file. (opaque) should be cast to whatever data type your platform
- *  uses.
- *
- * Not all file types can "tell"; this is to be expected by the caller.
- *
- * On error, call PHYSFS_setErrorCode() and return -1. On success, return >= 0.
- */
-PHYSFS_sint64 __PHYSFS_platformTell(void *opaque);
+static PHYSFS_sint64 handleIo_write(PHYSFS_Io *io, const void *buffer,
+                                    PHYSFS_uint64 len)
+{
+    return PHYSFS_writeBytes((PHYSFS_File *) io->opaque, buffer, len);
+} /* handleIo_write */
 
+/* these skip the handle's buffer; it only caches around its position. */
+static PHYSFS_sint64 handleIo_readAt(PHYSFS_Io *io, PHYSFS_uint64 offset,
+                                     void *buf, PHYSFS_uint64 len)
+{
+    PHYSFS_Io *fio = ((FileHandle *) io->opaque)->io;
+    return fio->readAt(fio, offset, buf, len);
+} /* handleIo_readAt */
 
-/*
- * Determine the current size of a file, in 8-bit bytes, from an open file.
- *
- * The caller expects that this information may not be available for all
- *  file types on all platforms.
- *
- * Return -1 if you can't do it, and call PHYSFS_setErrorCode(). Otherwise,
- *  return the file length in 8-bit bytes.
- */
-PHYSFS_sint64 __PHYSFS_platformFileLength(void *handle);
+static PHYSFS_sint64 handleIo_readv(PHYSFS_Io *io, const PHYSFS_IoVec *vec,
+                                    PHYSFS_uint32 count)
+{
+    return __PHYSFS_readv(((FileHandle *) io->opaque)->io, vec, count);
+} /* handleIo_readv */
 
+static int handleIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
+{
+    return PHYSFS_seek((PHYSFS_File *) io->opaque, offset);
+} /* handleIo_seek */
 
-/*
- * Read filesystem metadata for a specific path.
- *
- * This needs to fill in all the fields of (stat). For fields that might not
- *  mean anything on a platform (access time, perhaps), choose a reasonable
- *  default. if (follow), we want to follow symlinks and stat what they
- *  link to and not the link itself.
- *
- *  Return zero on failure, non-zero on success.
- */
-int __PHYSFS_platformStat(const char *fn, PHYSFS_Stat *stat, const int follow);
+static PHYSFS_sint64 handleIo_tell(PHYSFS_Io *io)
+{
+    return PHYSFS_tell((PHYSFS_File *) io->opaque);
+} /* handleIo_tell */
 
-/*
- * Flush any pending writes to disk. (opaque) should be cast to whatever data
- *  type your platform uses. Be sure to check for errors; the caller expects
- *  that this function can fail if there was a flushing error, etc.
- *
- *  Return zero on failure, non-zero on success.
- */
-int __PHYSFS_platformFlush(void *opaque);
+static PHYSFS_sint64 handleIo_length(PHYSFS_Io *io)
+{
+    return PHYSFS_fileLength((PHYSFS_File *) io->opaque);
+} /* handleIo_length */
 
-/*
- * Close file and deallocate resources. (opaque) should be cast to whatever
- *  data type your platform uses. This should close the file in any scenario:
- *  flushing is a separate function call, and this function should never fail.
- *
- * You should clean up all resources associated with (opaque); the pointer
- *  will be considered invalid after this call.
- */
-void __PHYSFS_platformClose(void *opaque);
+static PHYSFS_Io *handleIo_duplicate(PHYSFS_Io *io)
+{
+    /*
+     * There's no duplicate at the PHYSFS_File level, so we break the
+     *  abstraction. We're allowed to: we're physfs.c!
+     */
+    FileHandle *origfh = (FileHandle *) io->opaque;
+    FileHandle *newfh = (FileHandle *) allocator.Malloc(sizeof (FileHandle));
+    PHYSFS_Io *retval = NULL;
 
-/*
- * Platform implementation of PHYSFS_getCdRomDirsCallback()...
- *  CD directories are discovered and reported to the callback one at a time.
- *  Pointers passed to the callback are assumed to be invalid to the
- *  application after the callback returns, so you can free them or whatever.
- *  Callback does not assume results will be sorted in any meaningful way.
- */
-void __PHYSFS_platformDetectAvailableCDs(PHYSFS_StringCallback cb, void *data);
+    GOTO_IF(!newfh, PHYSFS_ERR_OUT_OF_MEMORY, handleIo_dupe_failed);
+    memset(newfh, '\0', sizeof (*newfh));
 
-/*
- * Calculate the base dir, if your platform needs special consideration.
- *  Just return NULL if the standard routines will suffice. (see
- *  calculateBaseDir() in physfs.c ...)
- * Your string must end with a dir separator if you don't return NULL.
- *  Caller will allocator.Free() the retval if it's not NULL.
- */
-char *__PHYSFS_platformCalcBaseDir(const char *argv0);
+    retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
+    GOTO_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, handleIo_dupe_failed);
 
-/*
- * Get the platform-specific user dir.
- * As of PhysicsFS 2.1, returning NULL means fatal error.
- * Your string must end with a dir separator if you don't return NULL.
- *  Caller will allocator.Free() the retval if it's not NULL.
- */
-char *__PHYSFS_platformCalcUserDir(void);
+#if 0  /* we don't buffer the duplicate, at least not at the moment. */
+    if (origfh->buffer != NULL)
+    {
+        newfh->buffer = (PHYSFS_uint8 *) allocator.Malloc(origfh->bufsize);
+        if (!newfh->buffer)
+            GOTO(PHYSFS_ERR_OUT_OF_MEMORY, handleIo_dupe_failed);
+        newfh->bufsize = origfh->bufsize;
+    } /* if */
+#endif
 
+    newfh->io = origfh->io->duplicate(origfh->io);
+    GOTO_IF_ERRPASS(!newfh->io, handleIo_dupe_failed);
 
-/* This is the cached version from PHYSFS_init(). This is a fast call. */
-const char *__PHYSFS_getUserDir(void);  /* not deprecated internal version. */
+    newfh->forReading = origfh->forReading;
+    newfh->dirHandle = origfh->dirHandle;
 
+    grabStateLock(OPEN);
+    if (newfh->forReading)
+    {
+        newfh->next = openReadList;
+        openReadList = newfh;
+    } /* if */
+    else
+    {
+        newfh->next = openWriteList;
+        openWriteList = newfh;
+    } /* else */
+    __PHYSFS_releaseMutex(stateLock);
 
-/*
- * Get the platform-specific pref dir.
- * Returning NULL means fatal error.
- * Your string must end with a dir separator if you don't return NULL.
- *  Caller will allocator.Free() the retval if it's not NULL.
- *  Caller will make missing directories if necessary; this just reports
- *   the final path.
- */
-char *__PHYSFS_platformCalcPrefDir(const char *org, const char *app);
+    memcpy(retval, io, sizeof (PHYSFS_Io));
+    retval->opaque = newfh;
+    return retval;
 
+handleIo_dupe_failed:
+    if (newfh)
+    {
+        if (newfh->io != NULL) newfh->io->destroy(newfh->io);
+        if (newfh->buffer != NULL) allocator.Free(newfh->buffer);
+        allocator.Free(newfh);
+    } /* if */
 
-/*
- * Return a pointer that uniquely identifies the current thread.
- *  On a platform without threading, (0x1) will suffice. These numbers are
- *  arbitrary; the only requirement is that no two threads have the same
- *  pointer.
- */
-void *__PHYSFS_platformGetThreadID(void);
+    return NULL;
+} /* handleIo_duplicate */
 
+static int handleIo_flush(PHYSFS_Io *io)
+{
+    return PHYSFS_flush((PHYSFS_File *) io->opaque);
+} /* handleIo_flush */
 
-/*
- * Enumerate a directory of files. This follows the rules for the
- *  PHYSFS_Archiver::enumerate() method, except that the (dirName) that is
- *  passed to this function is converted to platform-DEPENDENT notation by
- *  the caller. The PHYSFS_Archiver version uses platform-independent
- *  notation. Note that ".", "..", and other meta-entries should always
- *  be ignored.
- */
-PHYSFS_EnumerateCallbackResult __PHYSFS_platformEnumerate(const char *dirname,
-                               PHYSFS_EnumerateCallback callback,
-                               const char *origdir, void *callbackdata);
+static void handleIo_destroy(PHYSFS_Io *io)
+{
+    if (io->opaque != NULL)
+        PHYSFS_close((PHYSFS_File *) io->opaque);
+    allocator.Free(io);
+} /* handleIo_destroy */
 
-/*
- * Make a directory in the actual filesystem. (path) is specified in
- *  platform-dependent notation. On error, return zero and set the error
- *  message. Return non-zero on success.
- */
-int __PHYSFS_platformMkDir(const char *path);
+static const PHYSFS_Io __PHYSFS_handleIoInterface =
+{
+    CURRENT_PHYSFS_IO_API_VERSION, NULL,
+    handleIo_read,
+    handleIo_write,
+    handleIo_seek,
+    handleIo_tell,
+    handleIo_length,
+    handleIo_duplicate,
+    handleIo_flush,
+    handleIo_destroy,
+    handleIo_readAt,
+    handleIo_readv
+};
 
+static PHYSFS_Io *__PHYSFS_createHandleIo(PHYSFS_File *f)
+{
+    PHYSFS_Io *io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
+    BAIL_IF(!io, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    memcpy(io, &__PHYSFS_handleIoInterface, sizeof (*io));
+    io->opaque = f;
 
-/*
- * Remove a file or directory entry in the actual filesystem. (path) is
- *  specified in platform-dependent notation. Note that this deletes files
- *  _and_ directories, so you might need to do some determination.
- *  Non-empty directories should report an error and not delete themselves
- *  or their contents.
- *
- * Deleting a symlink should remove the link, not what it points to.
- *
- * On error, return zero and set the error message. Return non-zero on success.
- */
-int __PHYSFS_platformDelete(const char *path);
+    /* we can only read at an offset if what the handle reads from can. */
+    if (!__PHYSFS_ioHasReadAt(((FileHandle *) f)->io))
+        io->readAt = NULL;
 
+    return io;
+} /* __PHYSFS_createHandleIo */
 
-/*
- * Create a platform-specific mutex. This can be whatever datatype your
- *  platform uses for mutexes, but it is cast to a (void *) for abstractness.
- *
- * Return (NULL) if you couldn't create one. Systems without threads can
- *  return any arbitrary non-NULL value.
- */
-void *__PHYSFS_platformCreateMutex(void);
 
-/*
- * Destroy a platform-specific mutex, and clean up any resources associated
- *  with it. (mutex) is a value previously returned by
- *  __PHYSFS_platformCreateMutex(). This can be a no-op on single-threaded
- *  platforms.
- */
-void __PHYSFS_platformDestroyMutex(void *mutex);
+/* functions ... */
 
-/*
- * Grab possession of a platform-specific mutex. Mutexes should be recursive;
- *  that is, the same thread should be able to call this function multiple
- *  times in a row without causing a deadlock. This function should block
- *  until a thread can gain possession of the mutex.
- *
- * Return non-zero if the mutex was grabbed, zero if there was an
- *  unrecoverable problem grabbing it (this should not be a matter of
- *  timing out! We're talking major system errors; block until the mutex
- *  is available otherwise.)
- *
- * _DO NOT_ call PHYSFS_setErrorCode() in here! Since setErrorCode calls this
- *  function, you'll cause an infinite recursion. This means you can't
- *  use the BAIL_*MACRO* macros, either.
- */
-int __PHYSFS_platformGrabMutex(void *mutex);
+typedef struct
+{
+    char **list;
+    PHYSFS_uint32 size;
+    PHYSFS_ErrorCode errcode;
+} EnumStringListCallbackData;
 
-/*
- * Relinquish possession of the mutex when this method has been called
- *  once for each time that platformGrabMutex was called. Once possession has
- *  been released, the next thread in line to grab the mutex (if any) may
- *  proceed.
- *
- * _DO NOT_ call PHYSFS_setErrorCode() in here! Since setErrorCode calls this
- *  function, you'll cause an infinite recursion. This means you can't
- *  use the BAIL_*MACRO* macros, either.
- */
-void __PHYSFS_platformReleaseMutex(void *mutex);
+static void enumStringListCallback(void *data, const char *str)
+{
+    void *ptr;
+    char *newstr;
+    EnumStringListCallbackData *pecd = (EnumStringListCallbackData *) data;
 
-#if PHYSFS_HAVE_PRAGMA_VISIBILITY
-#pragma GCC visibility pop
-#endif
+    if (pecd->errcode)
+        return;
 
-#ifdef __cplusplus
-}
-#endif
+    ptr = allocator.Realloc(pecd->list, (pecd->size + 2) * sizeof (char *));
+    newstr = (char *) allocator.Malloc(strlen(str) + 1);
+    if (ptr != NULL)
+        pecd->list = (char **) ptr;
 
-#endif
+    if ((ptr == NULL) || (newstr == NULL))
+    {
+        pecd->errcode = PHYSFS_ERR_OUT_OF_MEMORY;
+        pecd->list[pecd->size] = NULL;
+        PHYSFS_freeList(pecd->list);
+        return;
+    } /* if */
 
-/* end of physfs_internal.h ... */
+    strcpy(newstr, str);
+    pecd->list[pecd->size] = newstr;
+    pecd->size++;
+} /* enumStringListCallback */
 
-#endif /* defined(PHYSFS_IMPL) || defined(PHYSFS_PLATFORM_IMPL) */
 
+static char **doEnumStringList(void (*func)(PHYSFS_StringCallback, void *))
+{
+    EnumStringListCallbackData ecd;
+    memset(&ecd, '\0', sizeof (ecd));
+    ecd.list = (char **) allocator.Malloc(sizeof (char *));
+    BAIL_IF(!ecd.list, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    func(enumStringListCallback, &ecd);
 
-#ifdef PHYSFS_IMPL
+    if (ecd.errcode)
+    {
+        PHYSFS_setErrorCode(ecd.errcode);
+        return NULL;
+    } /* if */
 
-#ifdef __cplusplus
-extern "C" {
-#endif
+    ecd.list[ecd.size] = NULL;
+    return ecd.list;
+} /* doEnumStringList */
 
-/**
- * PhysicsFS; a portable, flexible file i/o abstraction.
- *
- * Documentation is in physfs.h. It's verbose, honest.  :)
- *
- * Please see the file LICENSE.txt in the source's root directory.
- *
- *  This file written by Ryan C. Gordon.
- */
-/*
-#define __PHYSICSFS_INTERNAL__
-#include "physfs_internal.h"
-*/
-#if defined(_MSC_VER)
 
-/* this code came from https://stackoverflow.com/a/8712996 */
-int __PHYSFS_msvc_vsnprintf(char *outBuf, size_t size, const char *format, va_list ap)
+static void __PHYSFS_bubble_sort(void *a, size_t lo, size_t hi,
+                                 int (*cmpfn)(void *, size_t, size_t),
+                                 void (*swapfn)(void *, size_t, size_t))
 {
-    int count = -1;
+    size_t i;
+    int sorted;
 
-    if (size != 0)
-        count = _vsnprintf_s(outBuf, size, _TRUNCATE, format, ap);
-    if (count == -1)
-        count = _vscprintf(format, ap);
+    do
+    {
+        sorted = 1;
+        for (i = lo; i < hi; i++)
+        {
+            if (cmpfn(a, i, i + 1) > 0)
+            {
+                swapfn(a, i, i + 1);
+                sorted = 0;
+            } /* if */
+        } /* for */
+    } while (!sorted);
+} /* __PHYSFS_bubble_sort */
 
-    return count;
-}
 
-int __PHYSFS_msvc_snprintf(char *outBuf, size_t size, const char *format, ...)
+static void __PHYSFS_quick_sort(void *a, size_t lo, size_t hi,
+                         int (*cmpfn)(void *, size_t, size_t),
+                         void (*swapfn)(void *, size_t, size_t))
 {
-    int count;
-    va_list ap;
-
-    va_start(ap, format);
-    count = __PHYSFS_msvc_vsnprintf(outBuf, size, format, ap);
-    va_end(ap);
+    size_t i;
+    size_t j;
+    size_t v;
 
-    return count;
-}
-#endif
+    if ((hi - lo) <= PHYSFS_QUICKSORT_THRESHOLD)
+        __PHYSFS_bubble_sort(a, lo, hi, cmpfn, swapfn);
+    else
+    {
+        i = (hi + lo) / 2;
 
+        if (cmpfn(a, lo, i) > 0) swapfn(a, lo, i);
+        if (cmpfn(a, lo, hi) > 0) swapfn(a, lo, hi);
+        if (cmpfn(a, i, hi) > 0) swapfn(a, i, hi);
 
-typedef struct __PHYSFS_DIRHANDLE__
-{
-    void *opaque;  /* Instance data unique to the archiver. */
-    char *dirName;  /* Path to archive in platform-dependent notation. */
-    char *mountPoint; /* Mountpoint in virtual file tree. */
-    char *root;  /* subdirectory of archiver to use as root of archive (NULL for actual root) */
-    size_t rootlen;  /* subdirectory of archiver to use as root of archive (NULL for actual root) */
-    const PHYSFS_Archiver *funcs;  /* Ptr to archiver info for this handle. */
-    struct __PHYSFS_DIRHANDLE__ *next;  /* linked list stuff. */
-} DirHandle;
+        j = hi - 1;
+        swapfn(a, i, j);
+        i = lo;
+        v = j;
+        while (1)
+        {
+            while(cmpfn(a, ++i, v) < 0) { /* do nothing */ }
+            while(cmpfn(a, --j, v) > 0) { /* do nothing */ }
+            if (j < i)
+                break;
+            swapfn(a, i, j);
+        } /* while */
+        if (i != (hi-1))
+            swapfn(a, i, hi-1);
+        __PHYSFS_quick_sort(a, lo, j, cmpfn, swapfn);
+        __PHYSFS_quick_sort(a, i+1, hi, cmpfn, swapfn);
+    } /* else */
+} /* __PHYSFS_quick_sort */
 
 
-typedef struct __PHYSFS_FILEHANDLE__
+void __PHYSFS_sort(void *entries, size_t max,
+                   int (*cmpfn)(void *, size_t, size_t),
+                   void (*swapfn)(void *, size_t, size_t))
 {
-    PHYSFS_Io *io;  /* Instance data unique to the archiver for this file. */
-    PHYSFS_uint8 forReading; /* Non-zero if reading, zero if write/append */
-    const DirHandle *dirHandle;  /* Archiver instance that created this */
-    PHYSFS_uint8 *buffer;  /* Buffer, if set (NULL otherwise). Don't touch! */
-    size_t bufsize;  /* Bufsize, if set (0 otherwise). Don't touch! */
-    size_t buffill;  /* Buffer fill size. Don't touch! */
-    size_t bufpos;  /* Buffer position. Don't touch! */
-    struct __PHYSFS_FILEHANDLE__ *next;  /* linked list stuff. */
-} FileHandle;
+    /*
+     * Quicksort w/ Bubblesort fallback algorithm inspired by code from here:
+     *   https://www.cs.ubc.ca/spider/harrison/Java/sorting-demo.html
+     */
+    if (max > 0)
+        __PHYSFS_quick_sort(entries, 0, max - 1, cmpfn, swapfn);
+} /* __PHYSFS_sort */
 
 
-typedef struct __PHYSFS_ERRSTATETYPE__
+static ErrState *findErrorForCurrentThread(void)
 {
+    ErrState *i;
     void *tid;
-    PHYSFS_ErrorCode code;
-    struct __PHYSFS_ERRSTATETYPE__ *next;
-} ErrState;
 
+    if (errorLock != NULL)
+        grabLock(errorLock, PHYSFS_LOCKSITE_ERRORSTATE);
 
-/* General PhysicsFS state ... */
-static int initialized = 0;
-static ErrState *errorStates = NULL;
-static DirHandle *searchPath = NULL;
-static DirHandle *writeDir = NULL;
-static FileHandle *openWriteList = NULL;
-static FileHandle *openReadList = NULL;
-static char *baseDir = NULL;
-static char *userDir = NULL;
-static char *prefDir = NULL;
-static int allowSymLinks = 0;
-static PHYSFS_Archiver **archivers = NULL;
-static PHYSFS_ArchiveInfo **archiveInfo = NULL;
-static volatile size_t numArchivers = 0;
-static size_t longest_root = 0;
-
-/* mutexes ... */
-static void *errorLock = NULL;     /* protects error message list.        */
-static void *stateLock = NULL;     /* protects other PhysFS static state. */
+    if (errorStates != NULL)
+    {
+        tid = __PHYSFS_platformGetThreadID();
 
-/* allocator ... */
-static int externalAllocator = 0;
-PHYSFS_Allocator allocator;
+        for (i = errorStates; i != NULL; i = i->next)
+        {
+            if (i->tid == tid)
+            {
+                if (errorLock != NULL)
+                    __PHYSFS_releaseMutex(errorLock);
+                return i;
+            } /* if */
+        } /* for */
+    } /* if */
 
+    if (errorLock != NULL)
+        __PHYSFS_releaseMutex(errorLock);
 
-#ifdef PHYSFS_NEED_ATOMIC_OP_FALLBACK
-static inline int __PHYSFS_atomicAdd(int *ptrval, const int val)
-{
-    int retval;
-    __PHYSFS_platformGrabMutex(stateLock);
-    retval = *ptrval;
-    *ptrval = retval + val;
-    __PHYSFS_platformReleaseMutex(stateLock);
-    return retval;
-} /* __PHYSFS_atomicAdd */
+    return NULL;   /* no error available. */
+} /* findErrorForCurrentThread */
 
-int __PHYSFS_ATOMIC_INCR(int *ptrval)
-{
-    return __PHYSFS_atomicAdd(ptrval, 1);
-} /* __PHYSFS_ATOMIC_INCR */
 
-int __PHYSFS_ATOMIC_DECR(int *ptrval)
+void __PHYSFS_freeThreadErrorState(void)
 {
-    return __PHYSFS_atomicAdd(ptrval, -1);
-} /* __PHYSFS_ATOMIC_DECR */
-#endif
+    ErrState *prev = NULL;
+    ErrState *i;
+    void *tid;
 
+    if (errorLock == NULL)
+        return;
 
+    tid = __PHYSFS_platformGetThreadID();
+    grabLock(errorLock, PHYSFS_LOCKSITE_ERRORSTATE);
+    for (i = errorStates; i != NULL; i = i->next)
+    {
+        if (i->tid == tid)
+        {
+            if (prev == NULL)
+                errorStates = i->next;
+            else
+                prev->next = i->next;
+            allocator.Free(i);
+            break;
+        } /* if */
+        prev = i;
+    } /* for */
+    __PHYSFS_releaseMutex(errorLock);
+} /* __PHYSFS_freeThreadErrorState */
 
-/* PHYSFS_Io implementation for i/o to physical filesystem... */
 
-/* !!! FIXME: maybe refcount the paths in a string pool? */
-typedef struct __PHYSFS_NativeIoInfo
+/* this doesn't reset the error state. */
+static inline PHYSFS_ErrorCode currentErrorCode(void)
 {
-    void *handle;
-    const char *path;
-    int mode;   /* 'r', 'w', or 'a' */
-} NativeIoInfo;
+    const ErrState *err = findErrorForCurrentThread();
+    return err ? err->code : PHYSFS_ERR_OK;
+} /* currentErrorCode */
 
-static PHYSFS_sint64 nativeIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
-{
-    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_platformRead(info->handle, buf, len);
-} /* nativeIo_read */
 
-static PHYSFS_sint64 nativeIo_write(PHYSFS_Io *io, const void *buffer,
-                                    PHYSFS_uint64 len)
+PHYSFS_ErrorCode PHYSFS_getLastErrorCode(void)
 {
-    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_platformWrite(info->handle, buffer, len);
-} /* nativeIo_write */
+    ErrState *err = findErrorForCurrentThread();
+    const PHYSFS_ErrorCode retval = (err) ? err->code : PHYSFS_ERR_OK;
+    if (err)
+        err->code = PHYSFS_ERR_OK;
+    return retval;
+} /* PHYSFS_getLastErrorCode */
 
-static int nativeIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
-{
-    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_platformSeek(info->handle, offset);
-} /* nativeIo_seek */
 
-static PHYSFS_sint64 nativeIo_tell(PHYSFS_Io *io)
+PHYSFS_DECL const char *PHYSFS_getErrorByCode(PHYSFS_ErrorCode code)
 {
-    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_platformTell(info->handle);
-} /* nativeIo_tell */
+    switch (code)
+    {
+        case PHYSFS_ERR_OK: return "no error";
+        case PHYSFS_ERR_OTHER_ERROR: return "unknown error";
+        case PHYSFS_ERR_OUT_OF_MEMORY: return "out of memory";
+        case PHYSFS_ERR_NOT_INITIALIZED: return "not initialized";
+        case PHYSFS_ERR_IS_INITIALIZED: return "already initialized";
+        case PHYSFS_ERR_ARGV0_IS_NULL: return "argv[0] is NULL";
+        case PHYSFS_ERR_UNSUPPORTED: return "unsupported";
+        case PHYSFS_ERR_PAST_EOF: return "past end of file";
+        case PHYSFS_ERR_FILES_STILL_OPEN: return "files still open";
+        case PHYSFS_ERR_INVALID_ARGUMENT: return "invalid argument";
+        case PHYSFS_ERR_NOT_MOUNTED: return "not mounted";
+        case PHYSFS_ERR_NOT_FOUND: return "not found";
+        case PHYSFS_ERR_SYMLINK_FORBIDDEN: return "symlinks are forbidden";
+        case PHYSFS_ERR_NO_WRITE_DIR: return "write directory is not set";
+        case PHYSFS_ERR_OPEN_FOR_READING: return "file open for reading";
+        case PHYSFS_ERR_OPEN_FOR_WRITING: return "file open for writing";
+        case PHYSFS_ERR_NOT_A_FILE: return "not a file";
+        case PHYSFS_ERR_READ_ONLY: return "read-only filesystem";
+        case PHYSFS_ERR_CORRUPT: return "corrupted";
+        case PHYSFS_ERR_SYMLINK_LOOP: return "infinite symbolic link loop";
+        case PHYSFS_ERR_IO: return "i/o error";
+        case PHYSFS_ERR_PERMISSION: return "permission denied";
+        case PHYSFS_ERR_NO_SPACE: return "no space available for writing";
+        case PHYSFS_ERR_BAD_FILENAME: return "filename is illegal or insecure";
+        case PHYSFS_ERR_BUSY: return "tried to modify a file the OS needs";
+        case PHYSFS_ERR_DIR_NOT_EMPTY: return "directory isn't empty";
+        case PHYSFS_ERR_OS_ERROR: return "OS reported an error";
+        case PHYSFS_ERR_DUPLICATE: return "duplicate resource";
+        case PHYSFS_ERR_BAD_PASSWORD: return "bad password";
+        case PHYSFS_ERR_APP_CALLBACK: return "app callback reported error";
+    } /* switch */
 
-static PHYSFS_sint64 nativeIo_length(PHYSFS_Io *io)
-{
-    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_platformFileLength(info->handle);
-} /* nativeIo_length */
+    return NULL;  /* don't know this error code. */
+} /* PHYSFS_getErrorByCode */
 
-static PHYSFS_Io *nativeIo_duplicate(PHYSFS_Io *io)
-{
-    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_createNativeIo(info->path, info->mode);
-} /* nativeIo_duplicate */
 
-static int nativeIo_flush(PHYSFS_Io *io)
+void PHYSFS_setErrorCode(PHYSFS_ErrorCode errcode)
 {
-    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_platformFlush(info->handle);
-} /* nativeIo_flush */
+    ErrState *err;
 
-static void nativeIo_destroy(PHYSFS_Io *io)
-{
-    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    __PHYSFS_platformClose(info->handle);
-    allocator.Free((void *) info->path);
-    allocator.Free(info);
-    allocator.Free(io);
-} /* nativeIo_destroy */
+    if (!errcode)
+        return;
 
-static const PHYSFS_Io __PHYSFS_nativeIoInterface =
-{
-    CURRENT_PHYSFS_IO_API_VERSION, NULL,
-    nativeIo_read,
-    nativeIo_write,
-    nativeIo_seek,
-    nativeIo_tell,
-    nativeIo_length,
-    nativeIo_duplicate,
-    nativeIo_flush,
-    nativeIo_destroy
-};
+    err = findErrorForCurrentThread();
+    if (err == NULL)
+    {
+        MemoryScope scope;  /* it's the thread's, whatever it was doing. */
+        memoryScopeEnter(&scope, NULL, PHYSFS_MEMORY_OTHER);
+        err = (ErrState *) allocator.Malloc(sizeof (ErrState));
+        memoryScopeLeave(&scope);
+        if (err == NULL)
+            return;   /* uhh...? */
 
-PHYSFS_Io *__PHYSFS_createNativeIo(const char *path, const int mode)
-{
-    PHYSFS_Io *io = NULL;
-    NativeIoInfo *info = NULL;
-    void *handle = NULL;
-    char *pathdup = NULL;
+        memset(err, '\0', sizeof (ErrState));
+        err->tid = __PHYSFS_platformGetThreadID();
 
-    assert((mode == 'r') || (mode == 'w') || (mode == 'a'));
+        if (errorLock != NULL)
+            grabLock(errorLock, PHYSFS_LOCKSITE_ERRORSTATE);
 
-    io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    GOTO_IF(!io, PHYSFS_ERR_OUT_OF_MEMORY, createNativeIo_failed);
-    info = (NativeIoInfo *) allocator.Malloc(sizeof (NativeIoInfo));
-    GOTO_IF(!info, PHYSFS_ERR_OUT_OF_MEMORY, createNativeIo_failed);
-    pathdup = (char *) allocator.Malloc(strlen(path) + 1);
-    GOTO_IF(!pathdup, PHYSFS_ERR_OUT_OF_MEMORY, createNativeIo_failed);
+        err->next = errorStates;
+        errorStates = err;
 
-    if (mode == 'r')
-        handle = __PHYSFS_platformOpenRead(path);
-    else if (mode == 'w')
-        handle = __PHYSFS_platformOpenWrite(path);
-    else if (mode == 'a')
-        handle = __PHYSFS_platformOpenAppend(path);
+        if (errorLock != NULL)
+            __PHYSFS_releaseMutex(errorLock);
+    } /* if */
 
-    GOTO_IF_ERRPASS(!handle, createNativeIo_failed);
+    err->code = errcode;
+} /* PHYSFS_setErrorCode */
 
-    strcpy(pathdup, path);
-    info->handle = handle;
-    info->path = pathdup;
-    info->mode = mode;
-    memcpy(io, &__PHYSFS_nativeIoInterface, sizeof (*io));
-    io->opaque = info;
-    return io;
 
-createNativeIo_failed:
-    if (handle != NULL) __PHYSFS_platformClose(handle);
-    if (pathdup != NULL) allocator.Free(pathdup);
-    if (info != NULL) allocator.Free(info);
-    if (io != NULL) allocator.Free(io);
-    return NULL;
-} /* __PHYSFS_createNativeIo */
+const char *PHYSFS_getLastError(void)
+{
+    const PHYSFS_ErrorCode err = PHYSFS_getLastErrorCode();
+    return (err) ? PHYSFS_getErrorByCode(err) : NULL;
+} /* PHYSFS_getLastError */
+
+
+/* MAKE SURE that errorLock is held before calling this! */
+static void freeErrorStates(void)
+{
+    ErrState *i;
+    ErrState *next;
+
+    for (i = errorStates; i != NULL; i = next)
+    {
+        next = i->next;
+        allocator.Free(i);
+    } /* for */
 
+    errorStates = NULL;
+} /* freeErrorStates */
 
-/* PHYSFS_Io implementation for i/o to a memory buffer... */
 
-typedef struct __PHYSFS_MemoryIoInfo
+void PHYSFS_getLinkedVersion(PHYSFS_Version *ver)
 {
-    const PHYSFS_uint8 *buf;
-    PHYSFS_uint64 len;
-    PHYSFS_uint64 pos;
-    PHYSFS_Io *parent;
-    int refcount;
-    void (*destruct)(void *);
-} MemoryIoInfo;
+    if (ver != NULL)
+    {
+        ver->major = PHYSFS_VER_MAJOR;
+        ver->minor = PHYSFS_VER_MINOR;
+        ver->patch = PHYSFS_VER_PATCH;
+    } /* if */
+} /* PHYSFS_getLinkedVersion */
 
-static PHYSFS_sint64 memoryIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
+
+static const char *find_filename_extension(const char *fname)
 {
-    MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
-    const PHYSFS_uint64 avail = info->len - info->pos;
-    assert(avail <= info->len);
+    const char *retval = NULL;
+    if (fname != NULL)
+    {
+        const char *p = strchr(fname, '.');
+        retval = p;
 
-    if (avail == 0)
-        return 0;  /* we're at EOF; nothing to do. */
+        while (p != NULL)
+        {
+            p = strchr(p + 1, '.');
+            if (p != NULL)
+                retval = p;
+        } /* while */
 
-    if (len > avail)
-        len = avail;
+        if (retval != NULL)
+            retval++;  /* skip '.' */
+    } /* if */
 
-    memcpy(buf, info->buf + info->pos, (size_t) len);
-    info->pos += len;
-    return len;
-} /* memoryIo_read */
+    return retval;
+} /* find_filename_extension */
 
-static PHYSFS_sint64 memoryIo_write(PHYSFS_Io *io, const void *buffer,
-                                    PHYSFS_uint64 len)
-{
-    BAIL(PHYSFS_ERR_OPEN_FOR_READING, -1);
-} /* memoryIo_write */
 
-static int memoryIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
+/* parse a decimal number at (*_str), and move (*_str) past it. */
+static int parseUInt64(const char **_str, PHYSFS_uint64 *_val)
 {
-    MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
-    BAIL_IF(offset > info->len, PHYSFS_ERR_PAST_EOF, 0);
-    info->pos = offset;
+    const char *str = *_str;
+    PHYSFS_uint64 val = 0;
+
+    if ((*str < '0') || (*str > '9'))
+        return 0;
+
+    while ((*str >= '0') && (*str <= '9'))
+    {
+        if (val >= ((PHYSFS_uint64) -1) / 10)
+            return 0;  /* too big to be a real offset. */
+        val = (val * 10) + (PHYSFS_uint64) (*str - '0');
+        str++;
+    } /* while */
+
+    *_str = str;
+    *_val = val;
     return 1;
-} /* memoryIo_seek */
+} /* parseUInt64 */
 
-static PHYSFS_sint64 memoryIo_tell(PHYSFS_Io *io)
-{
-    const MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
-    return (PHYSFS_sint64) info->pos;
-} /* memoryIo_tell */
 
-static PHYSFS_sint64 memoryIo_length(PHYSFS_Io *io)
+/*
+ * If the archive has a PHYSFS_PREFETCH_MANIFEST, ask the OS to start reading
+ *  the range it names. This is only for archives that live in a file on
+ *  disk, and never fails the mount: whatever goes wrong, we just don't ask.
+ */
+static void readAheadFromManifest(PHYSFS_Io *io, const PHYSFS_Archiver *funcs,
+                                  void *opaque)
 {
-    const MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
-    return (PHYSFS_sint64) info->len;
-} /* memoryIo_length */
+    static const char header[] = "PHYSFS-PREFETCH 1\nrange ";
+    const PHYSFS_ErrorCode errcode = PHYSFS_getLastErrorCode();
+    PHYSFS_Io *manifest;
+    PHYSFS_uint64 pos, len;
+    const char *ptr;
+    char buf[80];
+    PHYSFS_sint64 br;
 
-static PHYSFS_Io *memoryIo_duplicate(PHYSFS_Io *io)
-{
-    MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
-    MemoryIoInfo *newinfo = NULL;
-    PHYSFS_Io *parent = info->parent;
-    PHYSFS_Io *retval = NULL;
+    if ((io == NULL) || (io->read != nativeIo_read))
+        return;  /* not a file on disk (a directory, memory, etc). */
 
-    /* avoid deep copies. */
-    assert((!parent) || (!((MemoryIoInfo *) parent->opaque)->parent) );
+    manifest = funcs->openRead(opaque, PHYSFS_PREFETCH_MANIFEST);
+    if (manifest == NULL)
+    {
+        PHYSFS_getLastErrorCode();  /* no manifest isn't an error here. */
+        PHYSFS_setErrorCode(errcode);
+        return;
+    } /* if */
 
-    /* share the buffer between duplicates. */
-    if (parent != NULL)  /* dup the parent, increment its refcount. */
-        return parent->duplicate(parent);
+    br = manifest->read(manifest, buf, sizeof (buf) - 1);
+    manifest->destroy(manifest);
+    if (br <= 0)
+        return;
 
-    /* we're the parent. */
+    buf[br] = '\0';
+    ptr = buf + (sizeof (header) - 1);
+    if ( (strncmp(buf, header, sizeof (header) - 1) == 0) &&
+         (parseUInt64(&ptr, &pos)) && (*(ptr++) == ' ') &&
+         (parseUInt64(&ptr, &len)) && (*ptr == '\n') && (len > 0) )
+    {
+        const NativeIoInfo *info = (const NativeIoInfo *) io->opaque;
+        __PHYSFS_platformReadAhead(info->handle, pos, len);
+    } /* if */
+} /* readAheadFromManifest */
 
-    retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
+
+static DirHandle *tryOpenDir(PHYSFS_Io *io, const PHYSFS_Archiver *funcs,
+                             const char *d, int forWriting, int *_claimed)
+{
+    DirHandle *retval = NULL;
+    void *opaque = NULL;
+
+    if (io != NULL)
+        BAIL_IF_ERRPASS(!io->seek(io, 0), NULL);
+
+#if PHYSFS_SUPPORTS_STATS
+    /* allocate first, so the archiver's i/o is counted from the start. */
+    retval = (DirHandle *) allocator.Malloc(sizeof (DirHandle));
     BAIL_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
-    newinfo = (MemoryIoInfo *) allocator.Malloc(sizeof (MemoryIoInfo));
-    if (!newinfo)
+    memset(retval, '\0', sizeof (DirHandle));
+    __PHYSFS_setIoStats(io, &retval->stats);
+
+    opaque = funcs->openArchive(io, d, forWriting, _claimed);
+    if (opaque == NULL)
     {
+        __PHYSFS_setIoStats(io, NULL);
         allocator.Free(retval);
-        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+        return NULL;
     } /* if */
 
-    __PHYSFS_ATOMIC_INCR(&info->refcount);
+    retval->mountPoint = NULL;
+    retval->funcs = funcs;
+    retval->opaque = opaque;
+    retval->io = io;
 
-    memset(newinfo, '\0', sizeof (*info));
-    newinfo->buf = info->buf;
-    newinfo->len = info->len;
-    newinfo->pos = 0;
-    newinfo->parent = io;
-    newinfo->refcount = 0;
-    newinfo->destruct = NULL;
+    if (!forWriting)
+        readAheadFromManifest(io, funcs, opaque);
+#else
+    opaque = funcs->openArchive(io, d, forWriting, _claimed);
+    if (opaque != NULL)
+    {
+        retval = (DirHandle *) allocator.Malloc(sizeof (DirHandle));
+        if (retval == NULL)
+            funcs->closeArchive(opaque);
+        else
+        {
+            memset(retval, '\0', sizeof (DirHandle));
+            retval->mountPoint = NULL;
+            retval->funcs = funcs;
+            retval->opaque = opaque;
+            retval->io = io;
+
+            if (!forWriting)
+                readAheadFromManifest(io, funcs, opaque);
+        } /* else */
+    } /* if */
+#endif
 
-    memcpy(retval, io, sizeof (*retval));
-    retval->opaque = newinfo;
     return retval;
-} /* memoryIo_duplicate */
+} /* tryOpenDir */
 
-static int memoryIo_flush(PHYSFS_Io *io) { return 1;  /* it's read-only. */ }
 
-static void memoryIo_destroy(PHYSFS_Io *io)
+static DirHandle *openDirectory(PHYSFS_Io *io, const char *d, int forWriting)
 {
-    MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
-    PHYSFS_Io *parent = info->parent;
+    DirHandle *retval = NULL;
+    PHYSFS_Archiver **i;
+    const char *ext;
+    int created_io = 0;
+    int claimed = 0;
+    PHYSFS_ErrorCode errcode;
 
-    if (parent != NULL)
+    assert((io != NULL) || (d != NULL));
+
+    if (io == NULL)
     {
-        assert(info->buf == ((MemoryIoInfo *) info->parent->opaque)->buf);
-        assert(info->len == ((MemoryIoInfo *) info->parent->opaque)->len);
-        assert(info->refcount == 0);
-        assert(info->destruct == NULL);
-        allocator.Free(info);
-        allocator.Free(io);
-        parent->destroy(parent);  /* decrements refcount. */
-        return;
-    } /* if */
+        /* file doesn't exist, etc? Just fail out. */
+        PHYSFS_Stat statbuf;
+        BAIL_IF_ERRPASS(!__PHYSFS_platformStat(d, &statbuf, 1), NULL);
 
-    /* we _are_ the parent. */
-    assert(info->refcount > 0);  /* even in a race, we hold a reference. */
+        /* DIR gets first shot (unlike the rest, it doesn't deal with files). */
+        if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
+        {
+            retval = tryOpenDir(io, &__PHYSFS_Archiver_DIR, d, forWriting, &claimed);
+            if (retval || claimed)
+                return retval;
+        } /* if */
 
-    if (__PHYSFS_ATOMIC_DECR(&info->refcount) == 0)
+        io = __PHYSFS_createNativeIo(d, forWriting ? 'w' : 'r');
+        BAIL_IF_ERRPASS(!io, NULL);
+        created_io = 1;
+    } /* if */
+
+    ext = find_filename_extension(d);
+    if (ext != NULL)
     {
-        void (*destruct)(void *) = info->destruct;
-        void *buf = (void *) info->buf;
-        io->opaque = NULL;  /* kill this here in case of race. */
-        allocator.Free(info);
-        allocator.Free(io);
-        if (destruct != NULL)
-            destruct(buf);
+        /* Look for archivers with matching file extensions first... */
+        for (i = archivers; (*i != NULL) && (retval == NULL) && !claimed; i++)
+        {
+            if (PHYSFS_utf8stricmp(ext, (*i)->info.extension) == 0)
+                retval = tryOpenDir(io, *i, d, forWriting, &claimed);
+        } /* for */
+
+        /* failing an exact file extension match, try all the others... */
+        for (i = archivers; (*i != NULL) && (retval == NULL) && !claimed; i++)
+        {
+            if (PHYSFS_utf8stricmp(ext, (*i)->info.extension) != 0)
+                retval = tryOpenDir(io, *i, d, forWriting, &claimed);
+        } /* for */
     } /* if */
-} /* memoryIo_destroy */
 
+    else  /* no extension? Try them all. */
+    {
+        for (i = archivers; (*i != NULL) && (retval == NULL) && !claimed; i++)
+            retval = tryOpenDir(io, *i, d, forWriting, &claimed);
+    } /* else */
+
+    errcode = currentErrorCode();
+
+    if ((!retval) && (created_io))
+        io->destroy(io);
+
+    errcode = claimed ? errcode : PHYSFS_ERR_UNSUPPORTED;
+    BAIL_IF(!retval, errcode, NULL);
+    return retval;
+} /* openDirectory */
+
+
+/*
+ * Make a platform-independent path string sane. Doesn't actually check the
+ *  file hierarchy, it just cleans up the string.
+ *  (dst) must be a buffer at least as big as (src), as this is where the
+ *  cleaned up string is deposited.
+ * If there are illegal bits in the path (".." entries, etc) then we
+ *  return zero and (dst) is undefined. Non-zero if the path was sanitized.
+ */
+static int sanitizePlatformIndependentPath(const char *src, char *dst)
+{
+    char *prev;
+    char ch;
+
+    while (*src == '/')  /* skip initial '/' chars... */
+        src++;
+
+    /* Make sure the entire string isn't "." or ".." */
+    if ((strcmp(src, ".") == 0) || (strcmp(src, "..") == 0))
+        BAIL(PHYSFS_ERR_BAD_FILENAME, 0);
+
+    prev = dst;
+    do
+    {
+        ch = *(src++);
 
-static const PHYSFS_Io __PHYSFS_memoryIoInterface =
-{
-    CURRENT_PHYSFS_IO_API_VERSION, NULL,
-    memoryIo_read,
-    memoryIo_write,
-    memoryIo_seek,
-    memoryIo_tell,
-    memoryIo_length,
-    memoryIo_duplicate,
-    memoryIo_flush,
-    memoryIo_destroy
-};
+        if ((ch == ':') || (ch == '\\'))  /* illegal chars in a physfs path. */
+            BAIL(PHYSFS_ERR_BAD_FILENAME, 0);
 
-PHYSFS_Io *__PHYSFS_createMemoryIo(const void *buf, PHYSFS_uint64 len,
-                                   void (*destruct)(void *))
-{
-    PHYSFS_Io *io = NULL;
-    MemoryIoInfo *info = NULL;
+        if (ch == '/')   /* path separator. */
+        {
+            *dst = '\0';  /* "." and ".." are illegal pathnames. */
+            if ((strcmp(prev, ".") == 0) || (strcmp(prev, "..") == 0))
+                BAIL(PHYSFS_ERR_BAD_FILENAME, 0);
 
-    io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    GOTO_IF(!io, PHYSFS_ERR_OUT_OF_MEMORY, createMemoryIo_failed);
-    info = (MemoryIoInfo *) allocator.Malloc(sizeof (MemoryIoInfo));
-    GOTO_IF(!info, PHYSFS_ERR_OUT_OF_MEMORY, createMemoryIo_failed);
+            while (*src == '/')   /* chop out doubles... */
+                src++;
 
-    memset(info, '\0', sizeof (*info));
-    info->buf = (const PHYSFS_uint8 *) buf;
-    info->len = len;
-    info->pos = 0;
-    info->parent = NULL;
-    info->refcount = 1;
-    info->destruct = destruct;
+            if (*src == '\0') /* ends with a pathsep? */
+                break;  /* we're done, don't add final pathsep to dst. */
 
-    memcpy(io, &__PHYSFS_memoryIoInterface, sizeof (*io));
-    io->opaque = info;
-    return io;
+            prev = dst + 1;
+        } /* if */
 
-createMemoryIo_failed:
-    if (info != NULL) allocator.Free(info);
-    if (io != NULL) allocator.Free(io);
-    return NULL;
-} /* __PHYSFS_createMemoryIo */
+        *(dst++) = ch;
+    } while (ch != '\0');
 
+    return 1;
+} /* sanitizePlatformIndependentPath */
 
-/* PHYSFS_Io implementation for i/o to a PHYSFS_File... */
 
-static PHYSFS_sint64 handleIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
+static inline size_t dirHandleRootLen(const DirHandle *h)
 {
-    return PHYSFS_readBytes((PHYSFS_File *) io->opaque, buf, len);
-} /* handleIo_read */
+    return h ? h->rootlen : 0;
+} /* dirHandleRootLen */
 
-static PHYSFS_sint64 handleIo_write(PHYSFS_Io *io, const void *buffer,
-                                    PHYSFS_uint64 len)
+static inline int sanitizePlatformIndependentPathWithRoot(const DirHandle *h, const char *src, char *dst)
 {
-    return PHYSFS_writeBytes((PHYSFS_File *) io->opaque, buffer, len);
-} /* handleIo_write */
+    return sanitizePlatformIndependentPath(src, dst + dirHandleRootLen(h));
+} /* sanitizePlatformIndependentPathWithRoot */
 
-static int handleIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
-{
-    return PHYSFS_seek((PHYSFS_File *) io->opaque, offset);
-} /* handleIo_seek */
 
-static PHYSFS_sint64 handleIo_tell(PHYSFS_Io *io)
-{
-    return PHYSFS_tell((PHYSFS_File *) io->opaque);
-} /* handleIo_tell */
 
-static PHYSFS_sint64 handleIo_length(PHYSFS_Io *io)
+/*
+ * Figure out if (fname) is part of (h)'s mountpoint. (fname) must be an
+ *  output from sanitizePlatformIndependentPath(), so that it is in a known
+ *  state.
+ *
+ * This only finds legitimate segments of a mountpoint. If the mountpoint is
+ *  "/a/b/c" and (fname) is "/a/b/c", "/", or "/a/b/c/d", then the results are
+ *  all zero. "/a/b" will succeed, though.
+ */
+static int partOfMountPoint(const SearchPathEntry *h, const char *fname)
 {
-    return PHYSFS_fileLength((PHYSFS_File *) io->opaque);
-} /* handleIo_length */
+    int rc;
+    size_t len, mntpntlen;
 
-static PHYSFS_Io *handleIo_duplicate(PHYSFS_Io *io)
+    if (h->mountPoint == NULL)
+        return 0;
+    else if (*fname == '\0')
+        return 1;
+
+    len = strlen(fname);
+    mntpntlen = strlen(h->mountPoint);
+    if (len > mntpntlen)  /* can't be a subset of mountpoint. */
+        return 0;
+
+    /* if true, must be not a match or a complete match, but not a subset. */
+    if ((len + 1) == mntpntlen)
+        return 0;
+
+    rc = strncmp(fname, h->mountPoint, len); /* !!! FIXME: case insensitive? */
+    if (rc != 0)
+        return 0;  /* not a match. */
+
+    /* make sure /a/b matches /a/b/ and not /a/bc ... */
+    return h->mountPoint[len] == '/';
+} /* partOfMountPoint */
+
+
+static int dirHandleGeneration = 0;
+
+static DirHandle *createDirHandle(PHYSFS_Io *io, const char *newDir,
+                                  const char *mountPoint, int forWriting)
 {
-    /*
-     * There's no duplicate at the PHYSFS_File level, so we break the
-     *  abstraction. We're allowed to: we're physfs.c!
-     */
-    FileHandle *origfh = (FileHandle *) io->opaque;
-    FileHandle *newfh = (FileHandle *) allocator.Malloc(sizeof (FileHandle));
-    PHYSFS_Io *retval = NULL;
+    DirHandle *dirHandle = NULL;
+    char *tmpmntpnt = NULL;
+    MemoryAccount *memory = memoryAccountCreate();
+    MemoryScope scope;
 
-    GOTO_IF(!newfh, PHYSFS_ERR_OUT_OF_MEMORY, handleIo_dupe_failed);
-    memset(newfh, '\0', sizeof (*newfh));
+    assert(newDir != NULL);  /* should have caught this higher up. */
 
-    retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    GOTO_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, handleIo_dupe_failed);
+    memoryScopeEnter(&scope, memory, PHYSFS_MEMORY_INDEX);
 
-#if 0  /* we don't buffer the duplicate, at least not at the moment. */
-    if (origfh->buffer != NULL)
+    if (mountPoint != NULL)
     {
-        newfh->buffer = (PHYSFS_uint8 *) allocator.Malloc(origfh->bufsize);
-        if (!newfh->buffer)
-            GOTO(PHYSFS_ERR_OUT_OF_MEMORY, handleIo_dupe_failed);
-        newfh->bufsize = origfh->bufsize;
+        const size_t len = strlen(mountPoint) + 1;
+        tmpmntpnt = (char *) __PHYSFS_smallAlloc(len);
+        GOTO_IF(!tmpmntpnt, PHYSFS_ERR_OUT_OF_MEMORY, badDirHandle);
+        if (!sanitizePlatformIndependentPath(mountPoint, tmpmntpnt))
+            goto badDirHandle;
+        mountPoint = tmpmntpnt;  /* sanitized version. */
     } /* if */
-#endif
 
-    newfh->io = origfh->io->duplicate(origfh->io);
-    GOTO_IF_ERRPASS(!newfh->io, handleIo_dupe_failed);
+    dirHandle = openDirectory(io, newDir, forWriting);
+    GOTO_IF_ERRPASS(!dirHandle, badDirHandle);
 
-    newfh->forReading = origfh->forReading;
-    newfh->dirHandle = origfh->dirHandle;
+    dirHandle->dirName = (char *) allocator.Malloc(strlen(newDir) + 1);
+    GOTO_IF(!dirHandle->dirName, PHYSFS_ERR_OUT_OF_MEMORY, badDirHandle);
+    strcpy(dirHandle->dirName, newDir);
 
-    __PHYSFS_platformGrabMutex(stateLock);
-    if (newfh->forReading)
+    if ((mountPoint != NULL) && (*mountPoint != '\0'))
     {
-        newfh->next = openReadList;
-        openReadList = newfh;
+        dirHandle->mountPoint = (char *)allocator.Malloc(strlen(mountPoint)+2);
+        if (!dirHandle->mountPoint)
+            GOTO(PHYSFS_ERR_OUT_OF_MEMORY, badDirHandle);
+        strcpy(dirHandle->mountPoint, mountPoint);
+        strcat(dirHandle->mountPoint, "/");
     } /* if */
-    else
-    {
-        newfh->next = openWriteList;
-        openWriteList = newfh;
-    } /* else */
-    __PHYSFS_platformReleaseMutex(stateLock);
 
-    memcpy(retval, io, sizeof (PHYSFS_Io));
-    retval->opaque = newfh;
-    return retval;
+    /* atomic: PHYSFS_replaceMount() gets here without stateLock. */
+    dirHandle->generation = __PHYSFS_ATOMIC_INCR(&dirHandleGeneration);
+#if PHYSFS_SUPPORTS_MEMORY_STATS
+    dirHandle->memory = memory;
+#endif
+    __PHYSFS_smallFree(tmpmntpnt);
+    memoryScopeLeave(&scope);
+    return dirHandle;
 
-handleIo_dupe_failed:
-    if (newfh)
+badDirHandle:
+    if (dirHandle != NULL)
     {
-        if (newfh->io != NULL) newfh->io->destroy(newfh->io);
-        if (newfh->buffer != NULL) allocator.Free(newfh->buffer);
-        allocator.Free(newfh);
+        dirHandle->funcs->closeArchive(dirHandle->opaque);
+        allocator.Free(dirHandle->dirName);
+        allocator.Free(dirHandle->mountPoint);
+        allocator.Free(dirHandle);
     } /* if */
 
+    __PHYSFS_smallFree(tmpmntpnt);
+    memoryScopeLeave(&scope);
+    memoryAccountRelease(memory);
     return NULL;
-} /* handleIo_duplicate */
-
-static int handleIo_flush(PHYSFS_Io *io)
-{
-    return PHYSFS_flush((PHYSFS_File *) io->opaque);
-} /* handleIo_flush */
+} /* createDirHandle */
 
-static void handleIo_destroy(PHYSFS_Io *io)
-{
-    if (io->opaque != NULL)
-        PHYSFS_close((PHYSFS_File *) io->opaque);
-    allocator.Free(io);
-} /* handleIo_destroy */
 
-static const PHYSFS_Io __PHYSFS_handleIoInterface =
+/* MAKE SURE you've got the stateLock held before calling this! */
+/*
+ * The content cache: whole decompressed files, keyed by DirHandle and path
+ *  in the archive, handed out as memory i/o that shares one buffer. The
+ *  entry and its data are one allocation; the data follows the struct and
+ *  the name follows the data. Everything here is protected by stateLock.
+ */
+typedef struct ContentCacheEntry
 {
-    CURRENT_PHYSFS_IO_API_VERSION, NULL,
-    handleIo_read,
-    handleIo_write,
-    handleIo_seek,
-    handleIo_tell,
-    handleIo_length,
-    handleIo_duplicate,
-    handleIo_flush,
-    handleIo_destroy
-};
+    DirHandle *dirHandle;
+    const char *name;
+    PHYSFS_uint32 hash;
+    PHYSFS_uint64 len;
+    int refcount;  /* memory i/o using the data. */
+    int cached;  /* zero once dropped, then freed with the last i/o. */
+    struct ContentCacheEntry *hashNext;
+    struct ContentCacheEntry *lruPrev;  /* more recently used. */
+    struct ContentCacheEntry *lruNext;  /* less recently used. */
+} ContentCacheEntry;
 
-static PHYSFS_Io *__PHYSFS_createHandleIo(PHYSFS_File *f)
-{
-    PHYSFS_Io *io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    BAIL_IF(!io, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
-    memcpy(io, &__PHYSFS_handleIoInterface, sizeof (*io));
-    io->opaque = f;
-    return io;
-} /* __PHYSFS_createHandleIo */
+#define CONTENT_CACHE_BUCKETS 1024
 
+static ContentCacheEntry *contentCacheHash[CONTENT_CACHE_BUCKETS];
+static ContentCacheEntry *contentCacheLruHead = NULL;
+static ContentCacheEntry *contentCacheLruTail = NULL;
+static PHYSFS_uint64 contentCacheBudget = 0;
+static PHYSFS_uint64 contentCacheMaxFile = 0;
+static volatile int contentCacheEnabled = 0;  /* for opens without a lock. */
+static PHYSFS_ContentCacheStats contentCacheStats;
 
-/* functions ... */
+#define contentCacheData(e) ((PHYSFS_uint8 *) ((e) + 1))
+#define contentCacheCost(e) (sizeof (ContentCacheEntry) + (e)->len + strlen((e)->name) + 1)
 
-typedef struct
-{
-    char **list;
-    PHYSFS_uint32 size;
-    PHYSFS_ErrorCode errcode;
-} EnumStringListCallbackData;
 
-static void enumStringListCallback(void *data, const char *str)
+static void contentCacheLruUnlink(ContentCacheEntry *e)
 {
-    void *ptr;
-    char *newstr;
-    EnumStringListCallbackData *pecd = (EnumStringListCallbackData *) data;
-
-    if (pecd->errcode)
-        return;
+    if (e->lruPrev)
+        e->lruPrev->lruNext = e->lruNext;
+    else
+        contentCacheLruHead = e->lruNext;
 
-    ptr = allocator.Realloc(pecd->list, (pecd->size + 2) * sizeof (char *));
-    newstr = (char *) allocator.Malloc(strlen(str) + 1);
-    if (ptr != NULL)
-        pecd->list = (char **) ptr;
+    if (e->lruNext)
+        e->lruNext->lruPrev = e->lruPrev;
+    else
+        contentCacheLruTail = e->lruPrev;
 
-    if ((ptr == NULL) || (newstr == NULL))
-    {
-        pecd->errcode = PHYSFS_ERR_OUT_OF_MEMORY;
-        pecd->list[pecd->size] = NULL;
-        PHYSFS_freeList(pecd->list);
-        return;
-    } /* if */
+    e->lruPrev = e->lruNext = NULL;
+} /* contentCacheLruUnlink */
 
-    strcpy(newstr, str);
-    pecd->list[pecd->size] = newstr;
-    pecd->size++;
-} /* enumStringListCallback */
 
+static void contentCacheLruPush(ContentCacheEntry *e)
+{
+    e->lruPrev = NULL;
+    e->lruNext = contentCacheLruHead;
+    if (contentCacheLruHead)
+        contentCacheLruHead->lruPrev = e;
+    else
+        contentCacheLruTail = e;
+    contentCacheLruHead = e;
+} /* contentCacheLruPush */
 
-static char **doEnumStringList(void (*func)(PHYSFS_StringCallback, void *))
+
+/* take (e) out of the cache; it's freed now or when its last i/o goes. */
+static void contentCacheDrop(ContentCacheEntry *e)
 {
-    EnumStringListCallbackData ecd;
-    memset(&ecd, '\0', sizeof (ecd));
-    ecd.list = (char **) allocator.Malloc(sizeof (char *));
-    BAIL_IF(!ecd.list, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
-    func(enumStringListCallback, &ecd);
+    ContentCacheEntry **bucket = &contentCacheHash[e->hash % CONTENT_CACHE_BUCKETS];
 
-    if (ecd.errcode)
+    while (*bucket != e)
+        bucket = &(*bucket)->hashNext;
+    *bucket = e->hashNext;
+
+    contentCacheLruUnlink(e);
+    contentCacheStats.files--;
+    contentCacheStats.bytes -= contentCacheCost(e);
+    e->cached = 0;
+
+    if (e->refcount == 0)
     {
-        PHYSFS_setErrorCode(ecd.errcode);
-        return NULL;
+        __PHYSFS_memoryRelease(contentCacheCost(e));
+        allocator.Free(e);
     } /* if */
-
-    ecd.list[ecd.size] = NULL;
-    return ecd.list;
-} /* doEnumStringList */
+} /* contentCacheDrop */
 
 
-static void __PHYSFS_bubble_sort(void *a, size_t lo, size_t hi,
-                                 int (*cmpfn)(void *, size_t, size_t),
-                                 void (*swapfn)(void *, size_t, size_t))
+/* drop everything from (dh), or everything at all if (dh) is NULL. */
+static void contentCachePurge(const DirHandle *dh)
 {
-    size_t i;
-    int sorted;
+    ContentCacheEntry *e = contentCacheLruHead;
+    while (e != NULL)
+    {
+        ContentCacheEntry *next = e->lruNext;
+        if ((dh == NULL) || (e->dirHandle == dh))
+            contentCacheDrop(e);
+        e = next;
+    } /* while */
+} /* contentCachePurge */
 
-    do
+
+static void contentCacheShrink(const PHYSFS_uint64 needed)
+{
+    while ( (contentCacheLruTail != NULL) &&
+            (contentCacheStats.bytes + needed > contentCacheBudget) )
     {
-        sorted = 1;
-        for (i = lo; i < hi; i++)
-        {
-            if (cmpfn(a, i, i + 1) > 0)
-            {
-                swapfn(a, i, i + 1);
-                sorted = 0;
-            } /* if */
-        } /* for */
-    } while (!sorted);
-} /* __PHYSFS_bubble_sort */
+        contentCacheDrop(contentCacheLruTail);
+        contentCacheStats.evictions++;
+    } /* while */
+} /* contentCacheShrink */
 
 
-static void __PHYSFS_quick_sort(void *a, size_t lo, size_t hi,
-                         int (*cmpfn)(void *, size_t, size_t),
-                         void (*swapfn)(void *, size_t, size_t))
+/*
+ * The memory budget. Everything here is protected by memoryLock, which is
+ *  only held for a moment and never while taking another lock. Trimming
+ *  the content cache to make room takes stateLock first.
+ */
+static PHYSFS_MemoryBudgetStats memoryBudgetStats;
+
+/* count (len) more bytes, if they fit. */
+static int memoryFits(const PHYSFS_uint64 len)
 {
-    size_t i;
-    size_t j;
-    size_t v;
+    PHYSFS_MemoryBudgetStats *st = &memoryBudgetStats;
+    int retval = 0;
 
-    if ((hi - lo) <= PHYSFS_QUICKSORT_THRESHOLD)
-        __PHYSFS_bubble_sort(a, lo, hi, cmpfn, swapfn);
-    else
+    __PHYSFS_platformGrabMutex(memoryLock);
+    if ((st->budget == 0) || ((st->used <= st->budget) && (len <= st->budget - st->used)))
     {
-        i = (hi + lo) / 2;
+        st->used += len;
+        if (st->used > st->peak)
+            st->peak = st->used;
+        retval = 1;
+    } /* if */
+    __PHYSFS_platformReleaseMutex(memoryLock);
 
-        if (cmpfn(a, lo, i) > 0) swapfn(a, lo, i);
-        if (cmpfn(a, lo, hi) > 0) swapfn(a, lo, hi);
-        if (cmpfn(a, i, hi) > 0) swapfn(a, i, hi);
+    return retval;
+} /* memoryFits */
 
-        j = hi - 1;
-        swapfn(a, i, j);
-        i = lo;
-        v = j;
-        while (1)
-        {
-            while(cmpfn(a, ++i, v) < 0) { /* do nothing */ }
-            while(cmpfn(a, --j, v) > 0) { /* do nothing */ }
-            if (j < i)
-                break;
-            swapfn(a, i, j);
-        } /* while */
-        if (i != (hi-1))
-            swapfn(a, i, hi-1);
-        __PHYSFS_quick_sort(a, lo, j, cmpfn, swapfn);
-        __PHYSFS_quick_sort(a, i+1, hi, cmpfn, swapfn);
-    } /* else */
-} /* __PHYSFS_quick_sort */
+
+static int memoryOver(const PHYSFS_uint64 needed)
+{
+    const PHYSFS_MemoryBudgetStats *st = &memoryBudgetStats;
+    int retval;
+    __PHYSFS_platformGrabMutex(memoryLock);
+    retval = (st->budget != 0) && ((st->used > st->budget) || (needed > st->budget - st->used));
+    __PHYSFS_platformReleaseMutex(memoryLock);
+    return retval;
+} /* memoryOver */
 
 
-void __PHYSFS_sort(void *entries, size_t max,
-                   int (*cmpfn)(void *, size_t, size_t),
-                   void (*swapfn)(void *, size_t, size_t))
+/*
+ * stateLock must be held. Drop cached files nobody has open, oldest first,
+ *  until (needed) more bytes fit, or (all) of them. Returns bytes freed.
+ */
+static PHYSFS_uint64 memoryTrim(const PHYSFS_uint64 needed, const int all)
 {
-    /*
-     * Quicksort w/ Bubblesort fallback algorithm inspired by code from here:
-     *   https://www.cs.ubc.ca/spider/harrison/Java/sorting-demo.html
-     */
-    if (max > 0)
-        __PHYSFS_quick_sort(entries, 0, max - 1, cmpfn, swapfn);
-} /* __PHYSFS_sort */
+    ContentCacheEntry *e = contentCacheLruTail;
+    PHYSFS_uint64 retval = 0;
+
+    while ((e != NULL) && (all || memoryOver(needed)))
+    {
+        ContentCacheEntry *prev = e->lruPrev;
+        if (e->refcount == 0)  /* open ones wouldn't be freed yet anyhow. */
+        {
+            retval += contentCacheCost(e);
+            contentCacheDrop(e);
+            if (!all)
+                contentCacheStats.evictions++;
+        } /* if */
+        e = prev;
+    } /* while */
+
+    return retval;
+} /* memoryTrim */
 
 
-static ErrState *findErrorForCurrentThread(void)
+int __PHYSFS_memoryReserve(const PHYSFS_uint64 len, const int trim)
 {
-    ErrState *i;
-    void *tid;
+    PHYSFS_uint64 trimmed;
 
-    if (errorLock != NULL)
-        __PHYSFS_platformGrabMutex(errorLock);
+    if (memoryFits(len))
+        return 1;
 
-    if (errorStates != NULL)
+    if (trim)
     {
-        tid = __PHYSFS_platformGetThreadID();
+        grabStateLock(OTHER);
+        trimmed = memoryTrim(len, 0);
+        __PHYSFS_releaseMutex(stateLock);
 
-        for (i = errorStates; i != NULL; i = i->next)
-        {
-            if (i->tid == tid)
-            {
-                if (errorLock != NULL)
-                    __PHYSFS_platformReleaseMutex(errorLock);
-                return i;
-            } /* if */
-        } /* for */
-    } /* if */
+        __PHYSFS_platformGrabMutex(memoryLock);
+        memoryBudgetStats.trimmed += trimmed;
+        __PHYSFS_platformReleaseMutex(memoryLock);
 
-    if (errorLock != NULL)
-        __PHYSFS_platformReleaseMutex(errorLock);
+        if (memoryFits(len))
+            return 1;
+    } /* if */
 
-    return NULL;   /* no error available. */
-} /* findErrorForCurrentThread */
+    __PHYSFS_platformGrabMutex(memoryLock);
+    memoryBudgetStats.refused++;
+    __PHYSFS_platformReleaseMutex(memoryLock);
+    BAIL(PHYSFS_ERR_OUT_OF_MEMORY, 0);
+} /* __PHYSFS_memoryReserve */
 
 
-/* this doesn't reset the error state. */
-static inline PHYSFS_ErrorCode currentErrorCode(void)
+void __PHYSFS_memoryRelease(const PHYSFS_uint64 len)
 {
-    const ErrState *err = findErrorForCurrentThread();
-    return err ? err->code : PHYSFS_ERR_OK;
-} /* currentErrorCode */
+    __PHYSFS_platformGrabMutex(memoryLock);
+    assert(memoryBudgetStats.used >= len);
+    memoryBudgetStats.used -= len;
+    __PHYSFS_platformReleaseMutex(memoryLock);
+} /* __PHYSFS_memoryRelease */
 
 
-PHYSFS_ErrorCode PHYSFS_getLastErrorCode(void)
+/* memory i/o destructor: the buffer is the data of a ContentCacheEntry. */
+static void contentCacheRelease(void *buf)
 {
-    ErrState *err = findErrorForCurrentThread();
-    const PHYSFS_ErrorCode retval = (err) ? err->code : PHYSFS_ERR_OK;
-    if (err)
-        err->code = PHYSFS_ERR_OK;
-    return retval;
-} /* PHYSFS_getLastErrorCode */
+    ContentCacheEntry *e = ((ContentCacheEntry *) buf) - 1;
+    grabStateLock(CLOSE);
+    assert(e->refcount > 0);
+    if ((--e->refcount == 0) && (!e->cached))
+    {
+        __PHYSFS_memoryRelease(contentCacheCost(e));
+        allocator.Free(e);
+    } /* if */
+    __PHYSFS_releaseMutex(stateLock);
+} /* contentCacheRelease */
 
 
-PHYSFS_DECL const char *PHYSFS_getErrorByCode(PHYSFS_ErrorCode code)
+static PHYSFS_Io *contentCacheOpen(ContentCacheEntry *e)
 {
-    switch (code)
-    {
-        case PHYSFS_ERR_OK: return "no error";
-        case PHYSFS_ERR_OTHER_ERROR: return "unknown error";
-        case PHYSFS_ERR_OUT_OF_MEMORY: return "out of memory";
-        case PHYSFS_ERR_NOT_INITIALIZED: return "not initialized";
-        case PHYSFS_ERR_IS_INITIALIZED: return "already initialized";
-        case PHYSFS_ERR_ARGV0_IS_NULL: return "argv[0] is NULL";
-        case PHYSFS_ERR_UNSUPPORTED: return "unsupported";
-        case PHYSFS_ERR_PAST_EOF: return "past end of file";
-        case PHYSFS_ERR_FILES_STILL_OPEN: return "files still open";
-        case PHYSFS_ERR_INVALID_ARGUMENT: return "invalid argument";
-        case PHYSFS_ERR_NOT_MOUNTED: return "not mounted";
-        case PHYSFS_ERR_NOT_FOUND: return "not found";
-        case PHYSFS_ERR_SYMLINK_FORBIDDEN: return "symlinks are forbidden";
-        case PHYSFS_ERR_NO_WRITE_DIR: return "write directory is not set";
-        case PHYSFS_ERR_OPEN_FOR_READING: return "file open for reading";
-        case PHYSFS_ERR_OPEN_FOR_WRITING: return "file open for writing";
-        case PHYSFS_ERR_NOT_A_FILE: return "not a file";
-        case PHYSFS_ERR_READ_ONLY: return "read-only filesystem";
-        case PHYSFS_ERR_CORRUPT: return "corrupted";
-        case PHYSFS_ERR_SYMLINK_LOOP: return "infinite symbolic link loop";
-        case PHYSFS_ERR_IO: return "i/o error";
-        case PHYSFS_ERR_PERMISSION: return "permission denied";
-        case PHYSFS_ERR_NO_SPACE: return "no space available for writing";
-        case PHYSFS_ERR_BAD_FILENAME: return "filename is illegal or insecure";
-        case PHYSFS_ERR_BUSY: return "tried to modify a file the OS needs";
-        case PHYSFS_ERR_DIR_NOT_EMPTY: return "directory isn't empty";
-        case PHYSFS_ERR_OS_ERROR: return "OS reported an error";
-        case PHYSFS_ERR_DUPLICATE: return "duplicate resource";
-        case PHYSFS_ERR_BAD_PASSWORD: return "bad password";
-        case PHYSFS_ERR_APP_CALLBACK: return "app callback reported error";
-    } /* switch */
-
-    return NULL;  /* don't know this error code. */
-} /* PHYSFS_getErrorByCode */
+    PHYSFS_Io *io = __PHYSFS_createMemoryIo(contentCacheData(e), e->len,
+                                            contentCacheRelease);
+    BAIL_IF_ERRPASS(!io, NULL);
+    e->refcount++;
+    contentCacheLruUnlink(e);
+    contentCacheLruPush(e);
+    return io;
+} /* contentCacheOpen */
 
 
-void PHYSFS_setErrorCode(PHYSFS_ErrorCode errcode)
+/*
+ * Read all of (io) into a new cache entry, and return memory i/o for it
+ *  instead. If the file shouldn't or can't be cached, hand back (io) as is.
+ */
+static PHYSFS_Io *contentCacheFill(DirHandle *h, const char *name,
+                                   const PHYSFS_uint32 hash, PHYSFS_Io *io)
 {
-    ErrState *err;
-
-    if (!errcode)
-        return;
+    const size_t namelen = strlen(name);
+    const PHYSFS_sint64 len = io->length(io);
+    ContentCacheEntry *e;
+    PHYSFS_Io *retval;
+    const PHYSFS_ErrorCode err = currentErrorCode();
+    size_t cost;
+    int category;
+
+    if ((len <= 0) || ((PHYSFS_uint64) len > contentCacheMaxFile))
+        return io;
+
+    cost = sizeof (ContentCacheEntry) + (size_t) len + namelen + 1;
+    if (cost > contentCacheBudget)
+        return io;
+    else if (!__PHYSFS_memoryReserve(cost, 1))
+    {
+        PHYSFS_getLastErrorCode();  /* the open still works... */
+        PHYSFS_setErrorCode(err);  /* ...so put back what was set before. */
+        return io;  /* over the memory budget, so just don't cache it. */
+    } /* else if */
 
-    err = findErrorForCurrentThread();
-    if (err == NULL)
+    category = __PHYSFS_setMemoryCategory(PHYSFS_MEMORY_CACHE);
+    e = (ContentCacheEntry *) allocator.Malloc(cost);
+    __PHYSFS_setMemoryCategory(category);
+    if (e == NULL)
     {
-        err = (ErrState *) allocator.Malloc(sizeof (ErrState));
-        if (err == NULL)
-            return;   /* uhh...? */
-
-        memset(err, '\0', sizeof (ErrState));
-        err->tid = __PHYSFS_platformGetThreadID();
-
-        if (errorLock != NULL)
-            __PHYSFS_platformGrabMutex(errorLock);
+        __PHYSFS_memoryRelease(cost);
+        return io;  /* no memory to cache it, but the file still works. */
+    } /* if */
 
-        err->next = errorStates;
-        errorStates = err;
+    if (!__PHYSFS_readAll(io, contentCacheData(e), (size_t) len))
+    {
+        __PHYSFS_memoryRelease(cost);
+        allocator.Free(e);
+        if (!io->seek(io, 0))
+        {
+            io->destroy(io);
+            return NULL;  /* leave the error from seek() set. */
+        } /* if */
+        PHYSFS_getLastErrorCode();  /* the open still works, as above. */
+        PHYSFS_setErrorCode(err);
+        return io;
+    } /* if */
 
-        if (errorLock != NULL)
-            __PHYSFS_platformReleaseMutex(errorLock);
+    memset(e, '\0', sizeof (*e));
+    e->dirHandle = h;
+    e->name = (const char *) contentCacheData(e) + len;
+    memcpy((char *) e->name, name, namelen + 1);
+    e->hash = hash;
+    e->len = (PHYSFS_uint64) len;
+    e->cached = 1;
+
+    contentCacheShrink(cost);
+    e->hashNext = contentCacheHash[hash % CONTENT_CACHE_BUCKETS];
+    contentCacheHash[hash % CONTENT_CACHE_BUCKETS] = e;
+    contentCacheLruPush(e);
+    contentCacheStats.files++;
+    contentCacheStats.bytes += cost;
+    contentCacheStats.misses++;
+
+    retval = contentCacheOpen(e);
+    if (retval == NULL)  /* it's cached, but this open uses the original. */
+    {
+        if (!io->seek(io, 0))
+        {
+            io->destroy(io);
+            return NULL;  /* leave the error from seek() set. */
+        } /* if */
+        return io;
     } /* if */
 
-    err->code = errcode;
-} /* PHYSFS_setErrorCode */
+    io->destroy(io);
+    return retval;
+} /* contentCacheFill */
 
 
-const char *PHYSFS_getLastError(void)
+/* stateLock must be held. This is (h)'s openRead, through the cache. */
+static PHYSFS_Io *openReadCached(DirHandle *h, const char *arcfname)
 {
-    const PHYSFS_ErrorCode err = PHYSFS_getLastErrorCode();
-    return (err) ? PHYSFS_getErrorByCode(err) : NULL;
-} /* PHYSFS_getLastError */
+    PHYSFS_uint32 hash;
+    ContentCacheEntry *e;
+    PHYSFS_Io *io;
 
+    if ((contentCacheBudget == 0) || (h->funcs == &__PHYSFS_Archiver_DIR))
+        return h->funcs->openRead(h->opaque, arcfname);
 
-/* MAKE SURE that errorLock is held before calling this! */
-static void freeErrorStates(void)
-{
-    ErrState *i;
-    ErrState *next;
+    hash = __PHYSFS_hashString(arcfname, strlen(arcfname)) ^
+           ((PHYSFS_uint32) (((size_t) h) >> 4));
 
-    for (i = errorStates; i != NULL; i = next)
+    for (e = contentCacheHash[hash % CONTENT_CACHE_BUCKETS]; e; e = e->hashNext)
     {
-        next = i->next;
-        allocator.Free(i);
+        if ( (e->dirHandle == h) && (e->hash == hash) &&
+             (strcmp(e->name, arcfname) == 0) )
+        {
+            io = contentCacheOpen(e);
+            if (io != NULL)
+                contentCacheStats.hits++;
+            return io;
+        } /* if */
     } /* for */
 
-    errorStates = NULL;
-} /* freeErrorStates */
+    io = h->funcs->openRead(h->opaque, arcfname);
+    return io ? contentCacheFill(h, arcfname, hash, io) : NULL;
+} /* openReadCached */
 
 
-void PHYSFS_getLinkedVersion(PHYSFS_Version *ver)
+int PHYSFS_setContentCache(PHYSFS_uint64 budget, PHYSFS_uint64 maxFileSize)
 {
-    if (ver != NULL)
-    {
-        ver->major = PHYSFS_VER_MAJOR;
-        ver->minor = PHYSFS_VER_MINOR;
-        ver->patch = PHYSFS_VER_PATCH;
-    } /* if */
-} /* PHYSFS_getLinkedVersion */
+    BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
 
+    grabStateLock(OTHER);
+    contentCacheBudget = budget;
+    contentCacheMaxFile = maxFileSize;
+    __PHYSFS_ATOMIC_STORE(&contentCacheEnabled, (budget != 0));
+    contentCacheShrink(0);
+    __PHYSFS_releaseMutex(stateLock);
+    return 1;
+} /* PHYSFS_setContentCache */
 
-static const char *find_filename_extension(const char *fname)
+
+int PHYSFS_getContentCacheStats(PHYSFS_ContentCacheStats *stats)
 {
-    const char *retval = NULL;
-    if (fname != NULL)
-    {
-        const char *p = strchr(fname, '.');
-        retval = p;
+    BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+    BAIL_IF(!stats, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    grabStateLock(OTHER);
+    memcpy(stats, &contentCacheStats, sizeof (*stats));
+    __PHYSFS_releaseMutex(stateLock);
+    return 1;
+} /* PHYSFS_getContentCacheStats */
+
+
+int PHYSFS_setMemoryBudget(PHYSFS_uint64 budget)
+{
+    PHYSFS_uint64 trimmed;
+
+    BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+
+    __PHYSFS_platformGrabMutex(memoryLock);
+    memoryBudgetStats.budget = budget;
+    __PHYSFS_platformReleaseMutex(memoryLock);
+
+    grabStateLock(OTHER);
+    trimmed = memoryTrim(0, 0);
+    __PHYSFS_releaseMutex(stateLock);
+
+    __PHYSFS_platformGrabMutex(memoryLock);
+    memoryBudgetStats.trimmed += trimmed;
+    __PHYSFS_platformReleaseMutex(memoryLock);
+    return 1;
+} /* PHYSFS_setMemoryBudget */
 
-        while (p != NULL)
-        {
-            p = strchr(p + 1, '.');
-            if (p != NULL)
-                retval = p;
-        } /* while */
 
-        if (retval != NULL)
-            retval++;  /* skip '.' */
-    } /* if */
+PHYSFS_uint64 PHYSFS_lowMemory(void)
+{
+    PHYSFS_uint64 retval;
+
+    BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
 
+    grabStateLock(OTHER);
+    retval = memoryTrim(0, 1);
+    __PHYSFS_releaseMutex(stateLock);
     return retval;
-} /* find_filename_extension */
+} /* PHYSFS_lowMemory */
 
 
-static DirHandle *tryOpenDir(PHYSFS_Io *io, const PHYSFS_Archiver *funcs,
-                             const char *d, int forWriting, int *_claimed)
+int PHYSFS_getMemoryBudgetStats(PHYSFS_MemoryBudgetStats *stats)
 {
-    DirHandle *retval = NULL;
-    void *opaque = NULL;
+    BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+    BAIL_IF(!stats, PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
-    if (io != NULL)
-        BAIL_IF_ERRPASS(!io->seek(io, 0), NULL);
+    __PHYSFS_platformGrabMutex(memoryLock);
+    memcpy(stats, &memoryBudgetStats, sizeof (*stats));
+    __PHYSFS_platformReleaseMutex(memoryLock);
+    return 1;
+} /* PHYSFS_getMemoryBudgetStats */
 
-    opaque = funcs->openArchive(io, d, forWriting, _claimed);
-    if (opaque != NULL)
-    {
-        retval = (DirHandle *) allocator.Malloc(sizeof (DirHandle));
-        if (retval == NULL)
-            funcs->closeArchive(opaque);
-        else
-        {
-            memset(retval, '\0', sizeof (DirHandle));
-            retval->mountPoint = NULL;
-            retval->funcs = funcs;
-            retval->opaque = opaque;
-        } /* else */
-    } /* if */
 
-    return retval;
-} /* tryOpenDir */
+/* doesn't need stateLock, if nothing else can reach (dh) anymore. */
+static void closeDirHandle(DirHandle *dh)
+{
+    MemoryAccount *memory = DIRHANDLE_MEMORY(dh);
+    dh->funcs->closeArchive(dh->opaque);
+    allocator.Free(dh->dirName);
+    allocator.Free(dh->mountPoint);
+    allocator.Free(dh->root);
+    allocator.Free(dh);
+    memoryAccountRelease(memory);
+} /* closeDirHandle */
 
 
-static DirHandle *openDirectory(PHYSFS_Io *io, const char *d, int forWriting)
+static int freeDirHandle(DirHandle *dh, FileHandle *openList)
 {
-    DirHandle *retval = NULL;
-    PHYSFS_Archiver **i;
-    const char *ext;
-    int created_io = 0;
-    int claimed = 0;
-    PHYSFS_ErrorCode errcode;
+    FileHandle *i;
 
-    assert((io != NULL) || (d != NULL));
+    if (dh == NULL)
+        return 1;
 
-    if (io == NULL)
-    {
-        /* file doesn't exist, etc? Just fail out. */
-        PHYSFS_Stat statbuf;
-        BAIL_IF_ERRPASS(!__PHYSFS_platformStat(d, &statbuf, 1), NULL);
+    for (i = openList; i != NULL; i = i->next)
+        BAIL_IF(i->dirHandle == dh, PHYSFS_ERR_FILES_STILL_OPEN, 0);
 
-        /* DIR gets first shot (unlike the rest, it doesn't deal with files). */
-        if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
-        {
-            retval = tryOpenDir(io, &__PHYSFS_Archiver_DIR, d, forWriting, &claimed);
-            if (retval || claimed)
-                return retval;
-        } /* if */
+    contentCachePurge(dh);
+    closeDirHandle(dh);
+    return 1;
+} /* freeDirHandle */
 
-        io = __PHYSFS_createNativeIo(d, forWriting ? 'w' : 'r');
-        BAIL_IF_ERRPASS(!io, NULL);
-        created_io = 1;
-    } /* if */
 
-    ext = find_filename_extension(d);
-    if (ext != NULL)
+/* doesn't need stateLock: closes what reclaimSearchPaths() handed back. */
+static void closeDirHandleList(DirHandle *list)
+{
+    DirHandle *next;
+    for (; list != NULL; list = next)
     {
-        /* Look for archivers with matching file extensions first... */
-        for (i = archivers; (*i != NULL) && (retval == NULL) && !claimed; i++)
-        {
-            if (PHYSFS_utf8stricmp(ext, (*i)->info.extension) == 0)
-                retval = tryOpenDir(io, *i, d, forWriting, &claimed);
-        } /* for */
+        next = list->next;
+        closeDirHandle(list);
+    } /* for */
+} /* closeDirHandleList */
 
-        /* failing an exact file extension match, try all the others... */
-        for (i = archivers; (*i != NULL) && (retval == NULL) && !claimed; i++)
-        {
-            if (PHYSFS_utf8stricmp(ext, (*i)->info.extension) != 0)
-                retval = tryOpenDir(io, *i, d, forWriting, &claimed);
-        } /* for */
-    } /* if */
 
-    else  /* no extension? Try them all. */
-    {
-        for (i = archivers; (*i != NULL) && (retval == NULL) && !claimed; i++)
-            retval = tryOpenDir(io, *i, d, forWriting, &claimed);
-    } /* else */
+/* stateLock must be held, if (dh) is reachable. (dh) as it is right now. */
+static void dirHandleEntry(SearchPathEntry *entry, DirHandle *dh)
+{
+    entry->dirHandle = dh;
+    entry->mountPoint = dh->mountPoint;
+    entry->root = dh->root;
+    entry->rootlen = dh->rootlen;
+} /* dirHandleEntry */
 
-    errcode = currentErrorCode();
 
-    if ((!retval) && (created_io))
-        io->destroy(io);
+/* stateLock must be held. Room for the search path, plus (extra) more. */
+static SearchPathSnapshot *allocSearchPath(const PHYSFS_uint32 extra)
+{
+    PHYSFS_uint32 capacity = extra;
+    SearchPathSnapshot *retval;
+    DirHandle *i;
 
-    errcode = claimed ? errcode : PHYSFS_ERR_UNSUPPORTED;
-    BAIL_IF(!retval, errcode, NULL);
+    for (i = searchPath; i != NULL; i = i->next)
+        capacity++;
+
+    retval = (SearchPathSnapshot *) allocator.Malloc(sizeof (SearchPathSnapshot)
+                                      + (capacity * sizeof (SearchPathEntry)));
+    BAIL_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    memset(retval, '\0', sizeof (SearchPathSnapshot));
+    retval->capacity = capacity;
+    retval->entries = (SearchPathEntry *) (retval + 1);
     return retval;
-} /* openDirectory */
+} /* allocSearchPath */
 
 
 /*
- * Make a platform-independent path string sane. Doesn't actually check the
- *  file hierarchy, it just cleans up the string.
- *  (dst) must be a buffer at least as big as (src), as this is where the
- *  cleaned up string is deposited.
- * If there are illegal bits in the path (".." entries, etc) then we
- *  return zero and (dst) is undefined. Non-zero if the path was sanitized.
+ * Doesn't need stateLock. Returns the search path to look things up in,
+ *  and (*_active) to hand to unpinSearchPath() when done with it and
+ *  everything it points to.
  */
-static int sanitizePlatformIndependentPath(const char *src, char *dst)
+static const SearchPathSnapshot *pinSearchPath(volatile int **_active)
 {
-    char *prev;
-    char ch;
-
-    while (*src == '/')  /* skip initial '/' chars... */
-        src++;
+    static const SearchPathSnapshot empty = { 0, 0, 0, NULL, 0, NULL, NULL, NULL };  /* before the first mount. */
+    const SearchPathSnapshot *retval;
+    void *tid = __PHYSFS_platformGetThreadID();
+    const PHYSFS_uint32 hash = __PHYSFS_hashString((const char *) &tid, sizeof (tid));
+    SearchPathReaders *slot = &searchPathReaders[hash % SEARCH_PATH_READER_SLOTS];
+    volatile int *active;
 
-    /* Make sure the entire string isn't "." or ".." */
-    if ((strcmp(src, ".") == 0) || (strcmp(src, "..") == 0))
-        BAIL(PHYSFS_ERR_BAD_FILENAME, 0);
-
-    prev = dst;
-    do
+    while (1)
     {
-        ch = *(src++);
+        const int epoch = __PHYSFS_ATOMIC_LOAD(&searchPathEpoch);
+        active = &slot->active[epoch & 1];
+        __PHYSFS_ATOMIC_INCR(active);
+        if (__PHYSFS_ATOMIC_LOAD(&searchPathEpoch) == epoch)
+            break;
+        __PHYSFS_ATOMIC_DECR(active);  /* it moved on meanwhile, try again. */
+    } /* while */
 
-        if ((ch == ':') || (ch == '\\'))  /* illegal chars in a physfs path. */
-            BAIL(PHYSFS_ERR_BAD_FILENAME, 0);
+    *_active = active;
+    retval = __PHYSFS_ATOMIC_LOAD(&searchPathSnapshot);
+    return retval ? retval : &empty;
+} /* pinSearchPath */
 
-        if (ch == '/')   /* path separator. */
-        {
-            *dst = '\0';  /* "." and ".." are illegal pathnames. */
-            if ((strcmp(prev, ".") == 0) || (strcmp(prev, "..") == 0))
-                BAIL(PHYSFS_ERR_BAD_FILENAME, 0);
 
-            while (*src == '/')   /* chop out doubles... */
-                src++;
+static void unpinSearchPath(volatile int *active)
+{
+    __PHYSFS_ATOMIC_DECR(active);
+} /* unpinSearchPath */
 
-            if (*src == '\0') /* ends with a pathsep? */
-                break;  /* we're done, don't add final pathsep to dst. */
 
-            prev = dst + 1;
-        } /* if */
+/* stateLock must be held. Move the epoch on, if nobody's in the last one. */
+static int advanceSearchPathEpoch(void)
+{
+    const int previous = (searchPathEpoch + 1) & 1;
+    size_t i;
 
-        *(dst++) = ch;
-    } while (ch != '\0');
+    for (i = 0; i < SEARCH_PATH_READER_SLOTS; i++)
+    {
+        if (__PHYSFS_ATOMIC_LOAD(&searchPathReaders[i].active[previous]) != 0)
+            return 0;
+    } /* for */
 
+    __PHYSFS_ATOMIC_INCR(&searchPathEpoch);
     return 1;
-} /* sanitizePlatformIndependentPath */
+} /* advanceSearchPathEpoch */
 
 
-static inline size_t dirHandleRootLen(const DirHandle *h)
+/*
+ * stateLock must be held. Frees retired search paths that no reader can be
+ *  using anymore, and returns what was taken off the search path with them,
+ *  to close once the lock is released. Archives that still have files open
+ *  go on the retired list instead, for the last PHYSFS_close() to close.
+ */
+static DirHandle *reclaimSearchPaths(void)
 {
-    return h ? h->rootlen : 0;
-} /* dirHandleRootLen */
+    SearchPathSnapshot **i = &retiredSearchPaths;
+    DirHandle *retval = NULL;
+    unsigned int epoch;
 
-static inline int sanitizePlatformIndependentPathWithRoot(const DirHandle *h, const char *src, char *dst)
-{
-    return sanitizePlatformIndependentPath(src, dst + dirHandleRootLen(h));
-} /* sanitizePlatformIndependentPathWithRoot */
+    if (*i == NULL)
+        return NULL;
 
+    if (advanceSearchPathEpoch())
+        advanceSearchPathEpoch();
+    epoch = (unsigned int) searchPathEpoch;
 
+    while (*i != NULL)
+    {
+        SearchPathSnapshot *snap = *i;
+        if ((epoch - ((unsigned int) snap->retiredAt)) < 2)
+        {
+            i = &snap->next;  /* someone might still be looking at it. */
+            continue;
+        } /* if */
 
-/*
- * Figure out if (fname) is part of (h)'s mountpoint. (fname) must be an
- *  output from sanitizePlatformIndependentPath(), so that it is in a known
- *  state.
- *
- * This only finds legitimate segments of a mountpoint. If the mountpoint is
- *  "/a/b/c" and (fname) is "/a/b/c", "/", or "/a/b/c/d", then the results are
- *  all zero. "/a/b" will succeed, though.
- */
-static int partOfMountPoint(DirHandle *h, char *fname)
-{
-    int rc;
-    size_t len, mntpntlen;
+        *i = snap->next;
+        while (snap->dropped != NULL)
+        {
+            DirHandle *dh = snap->dropped;
+            FileHandle *fh;
 
-    if (h->mountPoint == NULL)
-        return 0;
-    else if (*fname == '\0')
-        return 1;
+            snap->dropped = dh->next;
+            contentCachePurge(dh);  /* a late open might have filled it. */
 
-    len = strlen(fname);
-    mntpntlen = strlen(h->mountPoint);
-    if (len > mntpntlen)  /* can't be a subset of mountpoint. */
-        return 0;
+            for (fh = openReadList; fh != NULL; fh = fh->next)
+            {
+                if (fh->dirHandle == dh)
+                    break;
+            } /* for */
 
-    /* if true, must be not a match or a complete match, but not a subset. */
-    if ((len + 1) == mntpntlen)
-        return 0;
+            if (fh != NULL)  /* files still open? Keep it for them. */
+            {
+                dh->next = retiredDirs;
+                retiredDirs = dh;
+            } /* if */
+            else
+            {
+                dh->next = retval;
+                retval = dh;
+            } /* else */
+        } /* while */
 
-    rc = strncmp(fname, h->mountPoint, len); /* !!! FIXME: case insensitive? */
-    if (rc != 0)
-        return 0;  /* not a match. */
+        allocator.Free(snap->droppedRoot);
+        allocator.Free(snap);
+    } /* while */
 
-    /* make sure /a/b matches /a/b/ and not /a/bc ... */
-    return h->mountPoint[len] == '/';
-} /* partOfMountPoint */
+    return retval;
+} /* reclaimSearchPaths */
 
 
-static DirHandle *createDirHandle(PHYSFS_Io *io, const char *newDir,
-                                  const char *mountPoint, int forWriting)
+/*
+ * stateLock must be held. Fill in (snap) from searchPath and make it what
+ *  readers see, and retire the one it replaces, along with what (dropped)
+ *  off the search path and what (droppedRoot) was freed meanwhile, since
+ *  readers might still be using them. (snap) came from allocSearchPath()
+ *  before anything changed, so this can't fail. Returns what to close once
+ *  stateLock is released.
+ */
+static DirHandle *publishSearchPath(SearchPathSnapshot *snap,
+                                    DirHandle *dropped, char *droppedRoot)
 {
-    DirHandle *dirHandle = NULL;
-    char *tmpmntpnt = NULL;
-
-    assert(newDir != NULL);  /* should have caught this higher up. */
+    SearchPathSnapshot *old = searchPathSnapshot;
+    DirHandle *i;
 
-    if (mountPoint != NULL)
+    for (i = searchPath; i != NULL; i = i->next)
     {
-        const size_t len = strlen(mountPoint) + 1;
-        tmpmntpnt = (char *) __PHYSFS_smallAlloc(len);
-        GOTO_IF(!tmpmntpnt, PHYSFS_ERR_OUT_OF_MEMORY, badDirHandle);
-        if (!sanitizePlatformIndependentPath(mountPoint, tmpmntpnt))
-            goto badDirHandle;
-        mountPoint = tmpmntpnt;  /* sanitized version. */
-    } /* if */
-
-    dirHandle = openDirectory(io, newDir, forWriting);
-    GOTO_IF_ERRPASS(!dirHandle, badDirHandle);
+        assert(snap->count < snap->capacity);
+        dirHandleEntry(&snap->entries[snap->count++], i);
+    } /* for */
+    snap->longestRoot = longest_root;
 
-    dirHandle->dirName = (char *) allocator.Malloc(strlen(newDir) + 1);
-    GOTO_IF(!dirHandle->dirName, PHYSFS_ERR_OUT_OF_MEMORY, badDirHandle);
-    strcpy(dirHandle->dirName, newDir);
+    __PHYSFS_ATOMIC_STORE(&searchPathSnapshot, snap);
 
-    if ((mountPoint != NULL) && (*mountPoint != '\0'))
+    if (old == NULL)  /* nothing was ever published, nobody can see these. */
     {
-        dirHandle->mountPoint = (char *)allocator.Malloc(strlen(mountPoint)+2);
-        if (!dirHandle->mountPoint)
-            GOTO(PHYSFS_ERR_OUT_OF_MEMORY, badDirHandle);
-        strcpy(dirHandle->mountPoint, mountPoint);
-        strcat(dirHandle->mountPoint, "/");
+        allocator.Free(droppedRoot);
+        return dropped;
     } /* if */
 
-    __PHYSFS_smallFree(tmpmntpnt);
-    return dirHandle;
+    old->retiredAt = searchPathEpoch;
+    old->dropped = dropped;
+    old->droppedRoot = droppedRoot;
+    old->next = retiredSearchPaths;
+    retiredSearchPaths = old;
+    return reclaimSearchPaths();
+} /* publishSearchPath */
 
-badDirHandle:
-    if (dirHandle != NULL)
-    {
-        dirHandle->funcs->closeArchive(dirHandle->opaque);
-        allocator.Free(dirHandle->dirName);
-        allocator.Free(dirHandle->mountPoint);
-        allocator.Free(dirHandle);
-    } /* if */
 
-    __PHYSFS_smallFree(tmpmntpnt);
-    return NULL;
-} /* createDirHandle */
+/*
+ * Can (h)'s archiver look things up on several threads at once, without
+ *  stateLock? The DIR archiver can. So can ZIP and the unpacked archivers,
+ *  when the archive's i/o has readAt(), so they don't share a file position.
+ *  Everything else is called under stateLock, one thread at a time.
+ */
+static int dirHandleIsThreadSafe(const DirHandle *h)
+{
+    const PHYSFS_Archiver *funcs = h->funcs;
+
+    if (funcs == &__PHYSFS_Archiver_DIR)
+        return 1;
+    else if ((h->io == NULL) || (!__PHYSFS_ioHasReadAt(h->io)))
+        return 0;
+    else if (funcs->openRead == UNPK_openRead)
+        return 1;
+#if PHYSFS_SUPPORTS_ZIP
+    else if (funcs->openRead == __PHYSFS_Archiver_ZIP.openRead)  /* a copy. */
+        return 1;
+#endif
+
+    return 0;
+} /* dirHandleIsThreadSafe */
 
 
-/* MAKE SURE you've got the stateLock held before calling this! */
-static int freeDirHandle(DirHandle *dh, FileHandle *openList)
+/* (h)'s stat. Doesn't need stateLock, and takes it if (h) needs it. */
+static int dirHandleStat(DirHandle *h, const char *name, PHYSFS_Stat *st)
 {
-    FileHandle *i;
+    int retval;
 
-    if (dh == NULL)
-        return 1;
+    if (dirHandleIsThreadSafe(h))
+        return h->funcs->stat(h->opaque, name, st);
 
-    for (i = openList; i != NULL; i = i->next)
-        BAIL_IF(i->dirHandle == dh, PHYSFS_ERR_FILES_STILL_OPEN, 0);
+    grabStateLock(STAT);
+    retval = h->funcs->stat(h->opaque, name, st);
+    __PHYSFS_releaseMutex(stateLock);
+    return retval;
+} /* dirHandleStat */
 
-    dh->funcs->closeArchive(dh->opaque);
-    allocator.Free(dh->dirName);
-    allocator.Free(dh->mountPoint);
-    allocator.Free(dh);
-    return 1;
-} /* freeDirHandle */
+
+/* (h)'s openRead. Doesn't need stateLock; the content cache does, though. */
+static PHYSFS_Io *dirHandleOpenRead(DirHandle *h, const char *name)
+{
+    PHYSFS_Io *retval;
+
+    if ( (dirHandleIsThreadSafe(h)) &&
+         ((h->funcs == &__PHYSFS_Archiver_DIR) ||
+          (!__PHYSFS_ATOMIC_LOAD(&contentCacheEnabled))) )
+        return h->funcs->openRead(h->opaque, name);
+
+    grabStateLock(OPEN);
+    retval = openReadCached(h, name);
+    __PHYSFS_releaseMutex(stateLock);
+    return retval;
+} /* dirHandleOpenRead */
 
 
 static char *calculateBaseDir(const char *argv0)
@@ -6013,6 +9448,10 @@ static int initializeMutexes(void)
     if (stateLock == NULL)
         goto initializeMutexes_failed;
 
+    memoryLock = __PHYSFS_platformCreateMutex();
+    if (memoryLock == NULL)
+        goto initializeMutexes_failed;
+
     return 1;  /* success. */
 
 initializeMutexes_failed:
@@ -6022,7 +9461,10 @@ initializeMutexes_failed:
     if (stateLock != NULL)
         __PHYSFS_platformDestroyMutex(stateLock);
 
-    errorLock = stateLock = NULL;
+    if (memoryLock != NULL)
+        __PHYSFS_platformDestroyMutex(memoryLock);
+
+    errorLock = stateLock = memoryLock = NULL;
     return 0;  /* failed. */
 } /* initializeMutexes */
 
@@ -6076,25 +9518,44 @@ static int initStaticArchivers(void)
 
 
 static void setDefaultAllocator(void);
+static void startMemoryAccounting(void);
+static void stopMemoryAccounting(void);
 static int doDeinit(void);
 
 int PHYSFS_init(const char *argv0)
 {
     BAIL_IF(initialized, PHYSFS_ERR_IS_INITIALIZED, 0);
 
+    /* errors from before init came from the allocator we're about to wrap. */
+    freeErrorStates();
+
     if (!externalAllocator)
         setDefaultAllocator();
 
     if ((allocator.Init != NULL) && (!allocator.Init())) return 0;
 
+    startMemoryAccounting();
+
     if (!__PHYSFS_platformInit())
     {
         if (allocator.Deinit != NULL) allocator.Deinit();
+        stopMemoryAccounting();
         return 0;
     } /* if */
 
     /* everything below here can be cleaned up safely by doDeinit(). */
 
+#if PHYSFS_SUPPORTS_STATS
+    memset(&__PHYSFS_GlobalIoStats, '\0', sizeof (__PHYSFS_GlobalIoStats));
+#endif
+#if PHYSFS_SUPPORTS_LOCK_PROFILE
+    memset(lockProfiles, '\0', sizeof (lockProfiles));
+    memset(&stateLockHolder, '\0', sizeof (stateLockHolder));
+    memset(&errorLockHolder, '\0', sizeof (errorLockHolder));
+#endif
+    memset(&contentCacheStats, '\0', sizeof (contentCacheStats));
+    memset(&memoryBudgetStats, '\0', sizeof (memoryBudgetStats));
+
     if (!initializeMutexes()) goto initFailed;
 
     baseDir = calculateBaseDir(argv0);
@@ -6167,6 +9628,26 @@ static void freeSearchPath(void)
         } /* for */
         searchPath = NULL;
     } /* if */
+
+    for (i = retiredDirs; i != NULL; i = next)
+    {
+        next = i->next;
+        closeDirHandle(i);
+    } /* for */
+    retiredDirs = NULL;
+
+    /* nobody should be looking things up while we shut down. */
+    while (retiredSearchPaths != NULL)
+    {
+        SearchPathSnapshot *snap = retiredSearchPaths;
+        retiredSearchPaths = snap->next;
+        closeDirHandleList(snap->dropped);
+        allocator.Free(snap->droppedRoot);
+        allocator.Free(snap);
+    } /* while */
+
+    allocator.Free(searchPathSnapshot);
+    __PHYSFS_ATOMIC_STORE(&searchPathSnapshot, NULL);
 } /* freeSearchPath */
 
 
@@ -6190,11 +9671,16 @@ static int doDeregisterArchiver(const size_t idx)
     const size_t len = (numArchivers - idx) * sizeof (void *);
     PHYSFS_ArchiveInfo *info = archiveInfo[idx];
     PHYSFS_Archiver *arc = archivers[idx];
+    SearchPathSnapshot *snap;
 
     /* make sure nothing is still using this archiver */
-    if (archiverInUse(arc, searchPath) || archiverInUse(arc, writeDir))
+    if (archiverInUse(arc, searchPath) || archiverInUse(arc, writeDir) ||
+        archiverInUse(arc, retiredDirs))
         BAIL(PHYSFS_ERR_FILES_STILL_OPEN, 0);
 
+    for (snap = retiredSearchPaths; snap != NULL; snap = snap->next)
+        BAIL_IF(archiverInUse(arc, snap->dropped), PHYSFS_ERR_FILES_STILL_OPEN, 0);
+
     allocator.Free((void *) info->extension);
     allocator.Free((void *) info->description);
     allocator.Free((void *) info->author);
@@ -6233,6 +9719,10 @@ static int doDeinit(void)
     BAIL_IF(!PHYSFS_setWriteDir(NULL), PHYSFS_ERR_FILES_STILL_OPEN, 0);
 
     freeSearchPath();
+    contentCachePurge(NULL);  /* should be empty already. */
+    contentCacheBudget = contentCacheMaxFile = 0;
+    contentCacheEnabled = 0;
+    memoryBudgetStats.budget = 0;
     freeArchivers();
     freeErrorStates();
 
@@ -6266,20 +9756,30 @@ static int doDeinit(void)
         archivers = NULL;
     } /* if */
 
+    if (indexCacheDir != NULL)
+    {
+        allocator.Free(indexCacheDir);
+        indexCacheDir = NULL;
+    } /* if */
+
     longest_root = 0;
     allowSymLinks = 0;
+    resolveOnMount = 0;
     initialized = 0;
 
     if (errorLock) __PHYSFS_platformDestroyMutex(errorLock);
     if (stateLock) __PHYSFS_platformDestroyMutex(stateLock);
+    if (memoryLock) __PHYSFS_platformDestroyMutex(memoryLock);
 
     if (allocator.Deinit != NULL)
         allocator.Deinit();
 
-    errorLock = stateLock = NULL;
+    errorLock = stateLock = memoryLock = NULL;
 
     __PHYSFS_platformDeinit();
 
+    stopMemoryAccounting();
+
     return 1;
 } /* doDeinit */
 
@@ -6404,9 +9904,11 @@ int PHYSFS_registerArchiver(const PHYSFS_Archiver *archiver)
 {
     int retval;
     BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
-    __PHYSFS_platformGrabMutex(stateLock);
+    grabStateLock(OTHER);
+    /* PHYSFS_replaceMount() is walking the list without the lock. */
+    BAIL_IF_MUTEX(unlockedMounts > 0, PHYSFS_ERR_BUSY, stateLock, 0);
     retval = doRegisterArchiver(archiver);
-    __PHYSFS_platformReleaseMutex(stateLock);
+    __PHYSFS_releaseMutex(stateLock);
     return retval;
 } /* PHYSFS_registerArchiver */
 
@@ -6418,17 +9920,18 @@ int PHYSFS_deregisterArchiver(const char *ext)
     BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
     BAIL_IF(!ext, PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    grabStateLock(OTHER);
+    BAIL_IF_MUTEX(unlockedMounts > 0, PHYSFS_ERR_BUSY, stateLock, 0);
     for (i = 0; i < numArchivers; i++)
     {
         if (PHYSFS_utf8stricmp(archiveInfo[i]->extension, ext) == 0)
         {
             const int retval = doDeregisterArchiver(i);
-            __PHYSFS_platformReleaseMutex(stateLock);
+            __PHYSFS_releaseMutex(stateLock);
             return retval;
         } /* if */
     } /* for */
-    __PHYSFS_platformReleaseMutex(stateLock);
+    __PHYSFS_releaseMutex(stateLock);
 
     BAIL(PHYSFS_ERR_NOT_FOUND, 0);
 } /* PHYSFS_deregisterArchiver */
@@ -6539,10 +10042,10 @@ const char *PHYSFS_getWriteDir(void)
 {
     const char *retval = NULL;
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    grabStateLock(MOUNT);
     if (writeDir != NULL)
         retval = writeDir->dirName;
-    __PHYSFS_platformReleaseMutex(stateLock);
+    __PHYSFS_releaseMutex(stateLock);
 
     return retval;
 } /* PHYSFS_getWriteDir */
@@ -6552,7 +10055,7 @@ int PHYSFS_setWriteDir(const char *newDir)
 {
     int retval = 1;
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    grabStateLock(MOUNT);
 
     if (writeDir != NULL)
     {
@@ -6567,7 +10070,7 @@ int PHYSFS_setWriteDir(const char *newDir)
         retval = (writeDir != NULL);
     } /* if */
 
-    __PHYSFS_platformReleaseMutex(stateLock);
+    __PHYSFS_releaseMutex(stateLock);
 
     return retval;
 } /* PHYSFS_setWriteDir */
@@ -6575,55 +10078,65 @@ int PHYSFS_setWriteDir(const char *newDir)
 
 int PHYSFS_setRoot(const char *archive, const char *subdir)
 {
+    SearchPathSnapshot *snap;
+    DirHandle *closeList;
     DirHandle *i;
+    char *oldroot;
+    char *ptr = NULL;
+    size_t len = 0;
 
     BAIL_IF(!archive, PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    grabStateLock(MOUNT);
 
     for (i = searchPath; i != NULL; i = i->next)
     {
         if ((i->dirName != NULL) && (strcmp(archive, i->dirName) == 0))
+            break;
+    } /* for */
+
+    if (i == NULL)
+        BAIL_MUTEX_ERRPASS(stateLock, 1);
+
+    if (subdir && (strcmp(subdir, "/") != 0))
+    {
+        len = strlen(subdir) + 1;
+        ptr = (char *) allocator.Malloc(len);
+        BAIL_IF_MUTEX(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, stateLock, 0);
+        if (!sanitizePlatformIndependentPath(subdir, ptr))
         {
-            if (!subdir || (strcmp(subdir, "/") == 0))
-            {
-                if (i->root)
-                    allocator.Free(i->root);
-                i->root = NULL;
-                i->rootlen = 0;
-            } /* if */
-            else
-            {
-                const size_t len = strlen(subdir) + 1;
-                char *ptr = (char *) allocator.Malloc(len);
-                BAIL_IF_MUTEX(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, stateLock, 0);
-                if (!sanitizePlatformIndependentPath(subdir, ptr))
-                {
-                    allocator.Free(ptr);
-                    BAIL_MUTEX_ERRPASS(stateLock, 0);
-                } /* if */
+            allocator.Free(ptr);
+            BAIL_MUTEX_ERRPASS(stateLock, 0);
+        } /* if */
+    } /* if */
 
-                if (i->root)
-                    allocator.Free(i->root);
-                i->root = ptr;
-                i->rootlen = len;
+    snap = allocSearchPath(0);
+    if (!snap)
+    {
+        allocator.Free(ptr);
+        BAIL_MUTEX_ERRPASS(stateLock, 0);
+    } /* if */
 
-                if (longest_root < len)
-                    longest_root = len;
-            } /* else */
+    /* readers might still be prepending the old root; it goes later. */
+    oldroot = i->root;
+    i->root = ptr;
+    i->rootlen = len;
 
-            break;
-        } /* if */
-    } /* for */
+    if (longest_root < len)
+        longest_root = len;
 
-    __PHYSFS_platformReleaseMutex(stateLock);
+    closeList = publishSearchPath(snap, NULL, oldroot);
+    __PHYSFS_releaseMutex(stateLock);
+    closeDirHandleList(closeList);
     return 1;
 } /* PHYSFS_setRoot */
 
 
-static int doMount(PHYSFS_Io *io, const char *fname,
-                   const char *mountPoint, int appendToPath)
+static int doMountArchive(PHYSFS_Io *io, const char *fname,
+                          const char *mountPoint, int appendToPath)
 {
+    SearchPathSnapshot *snap;
+    DirHandle *closeList;
     DirHandle *dh;
     DirHandle *prev = NULL;
     DirHandle *i;
@@ -6633,7 +10146,7 @@ static int doMount(PHYSFS_Io *io, const char *fname,
     if (mountPoint == NULL)
         mountPoint = "/";
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    grabStateLock(MOUNT);
 
     for (i = searchPath; i != NULL; i = i->next)
     {
@@ -6643,8 +10156,15 @@ static int doMount(PHYSFS_Io *io, const char *fname,
         prev = i;
     } /* for */
 
+    snap = allocSearchPath(1);
+    BAIL_IF_MUTEX_ERRPASS(!snap, stateLock, 0);
+
     dh = createDirHandle(io, fname, mountPoint, 0);
-    BAIL_IF_MUTEX_ERRPASS(!dh, stateLock, 0);
+    if (!dh)
+    {
+        allocator.Free(snap);
+        BAIL_MUTEX_ERRPASS(stateLock, 0);
+    } /* if */
 
     if (appendToPath)
     {
@@ -6659,8 +10179,23 @@ static int doMount(PHYSFS_Io *io, const char *fname,
         searchPath = dh;
     } /* else */
 
-    __PHYSFS_platformReleaseMutex(stateLock);
+    closeList = publishSearchPath(snap, NULL, NULL);
+    __PHYSFS_releaseMutex(stateLock);
+    closeDirHandleList(closeList);
     return 1;
+} /* doMountArchive */
+
+
+static int doMount(PHYSFS_Io *io, const char *fname,
+                   const char *mountPoint, int appendToPath)
+{
+    PHYSFS_TraceEvent trace;
+    int retval;
+
+    TRACE_BEGIN(trace, PHYSFS_TRACE_MOUNT, fname, io, 0);
+    retval = doMountArchive(io, fname, mountPoint, appendToPath);
+    TRACE_END(trace, retval ? fname : NULL, retval);
+    return retval;
 } /* doMount */
 
 
@@ -6669,7 +10204,7 @@ int PHYSFS_mountIo(PHYSFS_Io *io, const char *fname,
 {
     BAIL_IF(!io, PHYSFS_ERR_INVALID_ARGUMENT, 0);
     BAIL_IF(!fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF(io->version != 0, PHYSFS_ERR_UNSUPPORTED, 0);
+    BAIL_IF(io->version > CURRENT_PHYSFS_IO_API_VERSION, PHYSFS_ERR_UNSUPPORTED, 0);
     return doMount(io, fname, mountPoint, appendToPath);
 } /* PHYSFS_mountIo */
 
@@ -6741,35 +10276,145 @@ int PHYSFS_removeFromSearchPath(const char *oldDir)
 } /* PHYSFS_removeFromSearchPath */
 
 
+/* stateLock must be held. The search path entry called (dirName), or NULL. */
+static DirHandle **findMounted(const char *dirName)
+{
+    DirHandle **i;
+    for (i = &searchPath; *i != NULL; i = &(*i)->next)
+    {
+        if (strcmp((*i)->dirName, dirName) == 0)
+            return i;
+    } /* for */
+    return NULL;
+} /* findMounted */
+
+
 int PHYSFS_unmount(const char *oldDir)
 {
+    SearchPathSnapshot *snap;
+    DirHandle *closeList;
     DirHandle *i;
-    DirHandle *prev = NULL;
-    DirHandle *next = NULL;
+    DirHandle **slot;
+    FileHandle *fh;
 
     BAIL_IF(oldDir == NULL, PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
-    __PHYSFS_platformGrabMutex(stateLock);
-    for (i = searchPath; i != NULL; i = i->next)
-    {
-        if (strcmp(i->dirName, oldDir) == 0)
-        {
-            next = i->next;
-            BAIL_IF_MUTEX_ERRPASS(!freeDirHandle(i, openReadList),
-                                stateLock, 0);
+    grabStateLock(MOUNT);
+    slot = findMounted(oldDir);
+    BAIL_IF_MUTEX(!slot, PHYSFS_ERR_NOT_MOUNTED, stateLock, 0);
 
-            if (prev == NULL)
-                searchPath = next;
-            else
-                prev->next = next;
+    i = *slot;
+    for (fh = openReadList; fh != NULL; fh = fh->next)
+        BAIL_IF_MUTEX(fh->dirHandle == i, PHYSFS_ERR_FILES_STILL_OPEN, stateLock, 0);
 
-            BAIL_MUTEX_ERRPASS(stateLock, 1);
+    snap = allocSearchPath(0);
+    BAIL_IF_MUTEX_ERRPASS(!snap, stateLock, 0);
+
+    /* lookups might still be using it; it's closed once they're done. */
+    *slot = i->next;
+    i->next = NULL;
+    closeList = publishSearchPath(snap, i, NULL);
+    __PHYSFS_releaseMutex(stateLock);
+    closeDirHandleList(closeList);
+    return 1;
+} /* PHYSFS_unmount */
+
+
+/*
+ * stateLock must be held. If (dh) was replaced and this was its last open
+ *  file, take it off the retired list and return it, to close once the
+ *  lock is released. Otherwise NULL.
+ */
+static DirHandle *releaseRetiredDir(const DirHandle *dh)
+{
+    DirHandle **i;
+    FileHandle *fh;
+
+    for (fh = openReadList; fh != NULL; fh = fh->next)
+    {
+        if (fh->dirHandle == dh)
+            return NULL;  /* still in use. */
+    } /* for */
+
+    for (i = &retiredDirs; *i != NULL; i = &(*i)->next)
+    {
+        if (*i == dh)
+        {
+            DirHandle *retval = *i;
+            *i = retval->next;
+            return retval;
         } /* if */
-        prev = i;
     } /* for */
 
-    BAIL_MUTEX(PHYSFS_ERR_NOT_MOUNTED, stateLock, 0);
-} /* PHYSFS_unmount */
+    return NULL;  /* still mounted. */
+} /* releaseRetiredDir */
+
+
+static int doReplaceMount(const char *oldDir, const char *newDir)
+{
+    SearchPathSnapshot *snap;
+    DirHandle *closeList;
+    DirHandle *dh = NULL;
+    DirHandle *old = NULL;
+    DirHandle **slot;
+
+    BAIL_IF(!oldDir, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF(!newDir, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+
+    grabStateLock(MOUNT);
+    BAIL_IF_MUTEX(!findMounted(oldDir), PHYSFS_ERR_NOT_MOUNTED, stateLock, 0);
+    unlockedMounts++;
+    __PHYSFS_releaseMutex(stateLock);
+
+    /* the slow part: open it and read its directory, while others work. */
+    dh = createDirHandle(NULL, newDir, NULL, 0);
+
+    grabStateLock(MOUNT);
+    unlockedMounts--;
+    BAIL_IF_MUTEX_ERRPASS(!dh, stateLock, 0);
+
+    /* things may have changed while we weren't looking. */
+    slot = findMounted(oldDir);
+    GOTO_IF_MUTEX(!slot, PHYSFS_ERR_NOT_MOUNTED, stateLock, replaceMount_failed);
+    GOTO_IF_MUTEX((strcmp(oldDir, newDir) != 0) && (findMounted(newDir)),
+                  PHYSFS_ERR_DUPLICATE, stateLock, replaceMount_failed);
+    snap = allocSearchPath(0);
+    GOTO_IF_MUTEX_ERRPASS(!snap, stateLock, replaceMount_failed);
+
+    old = *slot;
+    dh->mountPoint = old->mountPoint;
+    dh->root = old->root;
+    dh->rootlen = old->rootlen;
+    old->mountPoint = NULL;
+    old->root = NULL;
+    old->rootlen = 0;
+    dh->next = old->next;
+    *slot = dh;
+
+    /* once lookups are done with it, files still open on it keep it. */
+    old->next = NULL;
+    closeList = publishSearchPath(snap, old, NULL);
+    __PHYSFS_releaseMutex(stateLock);
+    closeDirHandleList(closeList);
+    return 1;
+
+replaceMount_failed:
+    closeDirHandle(dh);
+    return 0;
+} /* doReplaceMount */
+
+
+int PHYSFS_replaceMount(const char *oldDir, const char *newDir)
+{
+    PHYSFS_TraceEvent trace;
+    int retval;
+
+    TRACE_BEGIN(trace, PHYSFS_TRACE_MOUNT, newDir, NULL, 0);
+    retval = doReplaceMount(oldDir, newDir);
+    TRACE_END(trace, retval ? newDir : NULL, retval);
+    return retval;
+} /* PHYSFS_replaceMount */
 
 
 char **PHYSFS_getSearchPath(void)
@@ -6781,32 +10426,174 @@ char **PHYSFS_getSearchPath(void)
 const char *PHYSFS_getMountPoint(const char *dir)
 {
     DirHandle *i;
-    __PHYSFS_platformGrabMutex(stateLock);
+    grabStateLock(MOUNT);
     for (i = searchPath; i != NULL; i = i->next)
     {
         if (strcmp(i->dirName, dir) == 0)
         {
             const char *retval = ((i->mountPoint) ? i->mountPoint : "/");
-            __PHYSFS_platformReleaseMutex(stateLock);
+            __PHYSFS_releaseMutex(stateLock);
             return retval;
         } /* if */
     } /* for */
-    __PHYSFS_platformReleaseMutex(stateLock);
+    __PHYSFS_releaseMutex(stateLock);
 
     BAIL(PHYSFS_ERR_NOT_MOUNTED, NULL);
 } /* PHYSFS_getMountPoint */
 
 
-void PHYSFS_getSearchPathCallback(PHYSFS_StringCallback callback, void *data)
+int PHYSFS_getIoStats(const char *archive, PHYSFS_IoStats *stats)
+{
+#if PHYSFS_SUPPORTS_STATS
+    DirHandle *i;
+
+    BAIL_IF(!stats, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    if (archive == NULL)
+    {
+        memcpy(stats, &__PHYSFS_GlobalIoStats, sizeof (*stats));
+        return 1;
+    } /* if */
+
+    BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+
+    grabStateLock(OTHER);
+    for (i = searchPath; i != NULL; i = i->next)
+    {
+        if (strcmp(i->dirName, archive) == 0)
+        {
+            memcpy(stats, &i->stats, sizeof (*stats));
+            __PHYSFS_releaseMutex(stateLock);
+            return 1;
+        } /* if */
+    } /* for */
+    __PHYSFS_releaseMutex(stateLock);
+
+    BAIL(PHYSFS_ERR_NOT_MOUNTED, 0);
+#else
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+#endif
+} /* PHYSFS_getIoStats */
+
+
+#if PHYSFS_SUPPORTS_MEMORY_STATS
+static void copyMemoryStats(PHYSFS_MemoryStats *stats, const MemoryAccount *a)
+{
+    stats->bytes = a->total;
+    stats->peakBytes = a->peak;
+    stats->allocations = a->blocks;
+    stats->other = a->bytes[PHYSFS_MEMORY_OTHER];
+    stats->index = a->bytes[PHYSFS_MEMORY_INDEX];
+    stats->handles = a->bytes[PHYSFS_MEMORY_HANDLE];
+    stats->buffers = a->bytes[PHYSFS_MEMORY_BUFFER];
+    stats->decode = a->bytes[PHYSFS_MEMORY_DECODE];
+    stats->cache = a->bytes[PHYSFS_MEMORY_CACHE];
+} /* copyMemoryStats */
+#endif
+
+
+int PHYSFS_getMemoryStats(const char *archive, PHYSFS_MemoryStats *stats)
 {
+#if PHYSFS_SUPPORTS_MEMORY_STATS
     DirHandle *i;
 
+    BAIL_IF(!stats, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    if (archive == NULL)
+    {
+        copyMemoryStats(stats, &globalMemory);
+        return 1;
+    } /* if */
+
+    BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+
+    grabStateLock(OTHER);
+    for (i = searchPath; i != NULL; i = i->next)
+    {
+        if (strcmp(i->dirName, archive) == 0)
+            break;
+    } /* for */
+
+    if ((i == NULL) && (writeDir != NULL) && (strcmp(writeDir->dirName, archive) == 0))
+        i = writeDir;
+
+    BAIL_IF_MUTEX(!i, PHYSFS_ERR_NOT_MOUNTED, stateLock, 0);
+
+    if (i->memory != NULL)
+        copyMemoryStats(stats, i->memory);
+    else  /* there was no memory to track it with. */
+        memset(stats, '\0', sizeof (*stats));
+    __PHYSFS_releaseMutex(stateLock);
+    return 1;
+#else
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+#endif
+} /* PHYSFS_getMemoryStats */
+
+
+int PHYSFS_setTraceCallbacks(PHYSFS_TraceCallback begin,
+                             PHYSFS_TraceCallback end, void *data)
+{
+#if PHYSFS_SUPPORTS_TRACE
+    traceBeginCallback = begin;
+    traceEndCallback = end;
+    traceCallbackData = data;
+    return 1;
+#else
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+#endif
+} /* PHYSFS_setTraceCallbacks */
+
+
+int PHYSFS_getLockProfile(PHYSFS_LockSite site, PHYSFS_LockProfile *profile)
+{
+#if PHYSFS_SUPPORTS_LOCK_PROFILE
+    void *lock;
+
+    BAIL_IF(!profile, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF((int) site < 0, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF((int) site >= LOCKSITE_COUNT, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+
+    /* don't go through grabLock(), reporting shouldn't skew the profile. */
+    lock = (site == PHYSFS_LOCKSITE_ERRORSTATE) ? errorLock : stateLock;
+    __PHYSFS_platformGrabMutex(lock);
+    memcpy(profile, &lockProfiles[site], sizeof (*profile));
+    __PHYSFS_platformReleaseMutex(lock);
+    return 1;
+#else
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+#endif
+} /* PHYSFS_getLockProfile */
+
+
+int PHYSFS_resetLockProfiles(void)
+{
+#if PHYSFS_SUPPORTS_LOCK_PROFILE
+    BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+
     __PHYSFS_platformGrabMutex(stateLock);
+    __PHYSFS_platformGrabMutex(errorLock);
+    memset(lockProfiles, '\0', sizeof (lockProfiles));
+    __PHYSFS_platformReleaseMutex(errorLock);
+    __PHYSFS_platformReleaseMutex(stateLock);
+    return 1;
+#else
+    BAIL(PHYSFS_ERR_UNSUPPORTED, 0);
+#endif
+} /* PHYSFS_resetLockProfiles */
+
+
+void PHYSFS_getSearchPathCallback(PHYSFS_StringCallback callback, void *data)
+{
+    DirHandle *i;
+
+    grabStateLock(MOUNT);
 
     for (i = searchPath; i != NULL; i = i->next)
         callback(data, i->dirName);
 
-    __PHYSFS_platformReleaseMutex(stateLock);
+    __PHYSFS_releaseMutex(stateLock);
 } /* PHYSFS_getSearchPathCallback */
 
 
@@ -6923,6 +10710,72 @@ int PHYSFS_symbolicLinksPermitted(void)
 } /* PHYSFS_symbolicLinksPermitted */
 
 
+void PHYSFS_setResolveOnMount(int enable)
+{
+    resolveOnMount = enable;
+} /* PHYSFS_setResolveOnMount */
+
+
+int PHYSFS_getResolveOnMount(void)
+{
+    return resolveOnMount;
+} /* PHYSFS_getResolveOnMount */
+
+
+int PHYSFS_setIndexCache(const char *dir)
+{
+    char *copy = NULL;
+    char *old;
+
+    BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+
+    if (dir != NULL)
+    {
+        PHYSFS_Stat statbuf;
+        BAIL_IF(!PHYSFS_PLATFORM_MAPFILE, PHYSFS_ERR_UNSUPPORTED, 0);
+        BAIL_IF_ERRPASS(!__PHYSFS_platformStat(dir, &statbuf, 1), 0);
+        BAIL_IF(statbuf.filetype != PHYSFS_FILETYPE_DIRECTORY,
+                PHYSFS_ERR_INVALID_ARGUMENT, 0);
+        copy = __PHYSFS_strdup(dir);
+        BAIL_IF(!copy, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    } /* if */
+
+    grabStateLock(OTHER);
+    old = indexCacheDir;
+    indexCacheDir = copy;
+    __PHYSFS_releaseMutex(stateLock);
+
+    allocator.Free(old);
+    return 1;
+} /* PHYSFS_setIndexCache */
+
+
+char *__PHYSFS_indexCachePath(const char *path)
+{
+    const size_t pathlen = strlen(path);
+    char *retval = NULL;
+
+    /* archives can be opened without stateLock (see PHYSFS_replaceMount). */
+    grabStateLock(OTHER);
+    if (indexCacheDir != NULL)
+    {
+        /* named by the path's hash; a clash just gets rebuilt more often. */
+        const size_t len = strlen(indexCacheDir) + 32;
+        retval = (char *) allocator.Malloc(len);
+        if (retval != NULL)
+        {
+            snprintf(retval, len, "%s%c%08x%08x.idx", indexCacheDir,
+                     __PHYSFS_platformDirSeparator,
+                     (unsigned int) __PHYSFS_hashString(path, pathlen),
+                     (unsigned int) pathlen);
+        } /* if */
+    } /* if */
+    __PHYSFS_releaseMutex(stateLock);
+
+    return retval;
+} /* __PHYSFS_indexCachePath */
+
+
 /*
  * Verify that (fname) (in platform-independent notation), in relation
  *  to (h) is secure. That means that each element of fname is checked
@@ -6939,14 +10792,17 @@ int PHYSFS_symbolicLinksPermitted(void)
  *  gives us license to treat (fname) as scratch space in this function.
  *
  * (fname)'s buffer must have enough space available before it for this
- *  function to prepend any root directory for this DirHandle.
+ *  function to prepend any root directory for (h).
+ *
+ * (h) is an entry from a pinned search path, or one dirHandleEntry() made
+ *  for the write dir under stateLock; this doesn't need the lock itself.
  *
  * Returns non-zero if string is safe, zero if there's a security issue.
  *  PHYSFS_getLastError() will specify what was wrong. (*fname) will be
  *  updated to point past any mount point elements so it is prepared to
  *  be used with the archiver directly.
  */
-static int verifyPath(DirHandle *h, char **_fname, int allowMissing)
+static int verifyPath(const SearchPathEntry *h, char **_fname, int allowMissing)
 {
     char *fname = *_fname;
     int retval = 1;
@@ -6997,7 +10853,8 @@ static int verifyPath(DirHandle *h, char **_fname, int allowMissing)
             end = strchr(start, '/');
 
             if (end != NULL) *end = '\0';
-            rc = h->funcs->stat(h->opaque, fname, &statbuf);
+            __PHYSFS_STAT_ADD(&h->dirHandle->stats, pathStats, 1);
+            rc = dirHandleStat(h->dirHandle, fname, &statbuf);
             if (rc)
                 rc = (statbuf.filetype == PHYSFS_FILETYPE_SYMLINK);
             else if (currentErrorCode() == PHYSFS_ERR_NOT_FOUND)
@@ -7036,6 +10893,7 @@ static int verifyPath(DirHandle *h, char **_fname, int allowMissing)
 static int doMkdir(const char *_dname, char *dname)
 {
     DirHandle *h = writeDir;
+    SearchPathEntry entry;
     char *start;
     char *end;
     int retval = 0;
@@ -7043,8 +10901,9 @@ static int doMkdir(const char *_dname, char *dname)
 
     assert(h != NULL);
 
+    dirHandleEntry(&entry, h);
     BAIL_IF_ERRPASS(!sanitizePlatformIndependentPathWithRoot(h, _dname, dname), 0);
-    BAIL_IF_ERRPASS(!verifyPath(h, &dname, 1), 0);
+    BAIL_IF_ERRPASS(!verifyPath(&entry, &dname, 1), 0);
 
     start = dname;
     while (1)
@@ -7088,13 +10947,13 @@ int PHYSFS_mkdir(const char *_dname)
 
     BAIL_IF(!_dname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    grabStateLock(OTHER);
     BAIL_IF_MUTEX(!writeDir, PHYSFS_ERR_NO_WRITE_DIR, stateLock, 0);
     len = strlen(_dname) + dirHandleRootLen(writeDir) + 1;
     dname = (char *) __PHYSFS_smallAlloc(len);
     BAIL_IF_MUTEX(!dname, PHYSFS_ERR_OUT_OF_MEMORY, stateLock, 0);
     retval = doMkdir(_dname, dname);
-    __PHYSFS_platformReleaseMutex(stateLock);
+    __PHYSFS_releaseMutex(stateLock);
     __PHYSFS_smallFree(dname);
     return retval;
 } /* PHYSFS_mkdir */
@@ -7104,8 +10963,10 @@ int PHYSFS_mkdir(const char *_dname)
 static int doDelete(const char *_fname, char *fname)
 {
     DirHandle *h = writeDir;
+    SearchPathEntry entry;
+    dirHandleEntry(&entry, h);
     BAIL_IF_ERRPASS(!sanitizePlatformIndependentPathWithRoot(h, _fname, fname), 0);
-    BAIL_IF_ERRPASS(!verifyPath(h, &fname, 0), 0);
+    BAIL_IF_ERRPASS(!verifyPath(&entry, &fname, 0), 0);
     return h->funcs->remove(h->opaque, fname);
 } /* doDelete */
 
@@ -7116,13 +10977,13 @@ int PHYSFS_delete(const char *_fname)
     char *fname;
     size_t len;
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    grabStateLock(OTHER);
     BAIL_IF_MUTEX(!writeDir, PHYSFS_ERR_NO_WRITE_DIR, stateLock, 0);
     len = strlen(_fname) + dirHandleRootLen(writeDir) + 1;
     fname = (char *) __PHYSFS_smallAlloc(len);
     BAIL_IF_MUTEX(!fname, PHYSFS_ERR_OUT_OF_MEMORY, stateLock, 0);
     retval = doDelete(_fname, fname);
-    __PHYSFS_platformReleaseMutex(stateLock);
+    __PHYSFS_releaseMutex(stateLock);
     __PHYSFS_smallFree(fname);
     return retval;
 } /* PHYSFS_delete */
@@ -7131,41 +10992,49 @@ int PHYSFS_delete(const char *_fname)
 static DirHandle *getRealDirHandle(const char *_fname)
 {
     DirHandle *retval = NULL;
+    const SearchPathSnapshot *sp;
+    volatile int *pin;
     char *allocated_fname = NULL;
     char *fname = NULL;
     size_t len;
 
     BAIL_IF(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
 
-    __PHYSFS_platformGrabMutex(stateLock);
-    len = strlen(_fname) + longest_root + 1;
+    sp = pinSearchPath(&pin);
+    len = strlen(_fname) + sp->longestRoot + 1;
     allocated_fname = (char*)__PHYSFS_smallAlloc(len);
-    BAIL_IF_MUTEX(!allocated_fname, PHYSFS_ERR_OUT_OF_MEMORY, stateLock, NULL);
-    fname = allocated_fname + longest_root;
+    if (!allocated_fname)
+    {
+        unpinSearchPath(pin);
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    } /* if */
+
+    fname = allocated_fname + sp->longestRoot;
     if (sanitizePlatformIndependentPath(_fname, fname))
     {
-        DirHandle *i;
-        for (i = searchPath; i != NULL; i = i->next)
+        PHYSFS_uint32 i;
+        for (i = 0; i < sp->count; i++)
         {
+            const SearchPathEntry *entry = &sp->entries[i];
             char *arcfname = fname;
-            if (partOfMountPoint(i, arcfname))
+            if (partOfMountPoint(entry, arcfname))
             {
-                retval = i;
+                retval = entry->dirHandle;
                 break;
             } /* if */
-            else if (verifyPath(i, &arcfname, 0))
+            else if (verifyPath(entry, &arcfname, 0))
             {
                 PHYSFS_Stat statbuf;
-                if (i->funcs->stat(i->opaque, arcfname, &statbuf))
+                if (dirHandleStat(entry->dirHandle, arcfname, &statbuf))
                 {
-                    retval = i;
+                    retval = entry->dirHandle;
                     break;
                 } /* if */
             } /* if */
         } /* for */
     } /* if */
 
-    __PHYSFS_platformReleaseMutex(stateLock);
+    unpinSearchPath(pin);
     __PHYSFS_smallFree(allocated_fname);
     return retval;
 } /* getRealDirHandle */
@@ -7279,7 +11148,7 @@ char **PHYSFS_enumerateFiles(const char *path)
 /*
  * Broke out to seperate function so we can use stack allocation gratuitously.
  */
-static PHYSFS_EnumerateCallbackResult enumerateFromMountPoint(DirHandle *i,
+static PHYSFS_EnumerateCallbackResult enumerateFromMountPoint(const SearchPathEntry *i,
                                     const char *arcfname,
                                     PHYSFS_EnumerateCallback callback,
                                     const char *_fname, void *data)
@@ -7357,9 +11226,12 @@ static PHYSFS_EnumerateCallbackResult enumCallbackFilterSymLinks(void *_data,
 } /* enumCallbackFilterSymLinks */
 
 
-int PHYSFS_enumerate(const char *_fn, PHYSFS_EnumerateCallback cb, void *data)
+static int doEnumerate(const char *_fn, PHYSFS_EnumerateCallback cb,
+                       void *data)
 {
     PHYSFS_EnumerateCallbackResult retval = PHYSFS_ENUM_OK;
+    const SearchPathSnapshot *sp;
+    volatile int *pin;
     size_t len;
     char *allocated_fname;
     char *fname;
@@ -7367,17 +11239,22 @@ int PHYSFS_enumerate(const char *_fn, PHYSFS_EnumerateCallback cb, void *data)
     BAIL_IF(!_fn, PHYSFS_ERR_INVALID_ARGUMENT, 0);
     BAIL_IF(!cb, PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    grabStateLock(ENUMERATE);
+    sp = pinSearchPath(&pin);  /* callbacks might change the search path. */
 
-    len = strlen(_fn) + longest_root + 1;
+    len = strlen(_fn) + sp->longestRoot + 1;
     allocated_fname = (char *) __PHYSFS_smallAlloc(len);
-    BAIL_IF_MUTEX(!allocated_fname, PHYSFS_ERR_OUT_OF_MEMORY, stateLock, 0);
-    fname = allocated_fname + longest_root;
+    if (!allocated_fname)
+    {
+        unpinSearchPath(pin);
+        BAIL_MUTEX(PHYSFS_ERR_OUT_OF_MEMORY, stateLock, 0);
+    } /* if */
+    fname = allocated_fname + sp->longestRoot;
     if (!sanitizePlatformIndependentPath(_fn, fname))
         retval = PHYSFS_ENUM_STOP;
     else
     {
-        DirHandle *i;
+        PHYSFS_uint32 idx;
         SymlinkFilterData filterdata;
 
         if (!allowSymLinks)
@@ -7387,14 +11264,16 @@ int PHYSFS_enumerate(const char *_fn, PHYSFS_EnumerateCallback cb, void *data)
             filterdata.callbackData = data;
         } /* if */
 
-        for (i = searchPath; (retval == PHYSFS_ENUM_OK) && i; i = i->next)
+        for (idx = 0; (retval == PHYSFS_ENUM_OK) && (idx < sp->count); idx++)
         {
+            const SearchPathEntry *entry = &sp->entries[idx];
+            DirHandle *i = entry->dirHandle;
             char *arcfname = fname;
 
-            if (partOfMountPoint(i, arcfname))
-                retval = enumerateFromMountPoint(i, arcfname, cb, _fn, data);
+            if (partOfMountPoint(entry, arcfname))
+                retval = enumerateFromMountPoint(entry, arcfname, cb, _fn, data);
 
-            else if (verifyPath(i, &arcfname, 0))
+            else if (verifyPath(entry, &arcfname, 0))
             {
                 PHYSFS_Stat statbuf;
                 if (!i->funcs->stat(i->opaque, arcfname, &statbuf))
@@ -7430,11 +11309,24 @@ int PHYSFS_enumerate(const char *_fn, PHYSFS_EnumerateCallback cb, void *data)
 
     } /* if */
 
-    __PHYSFS_platformReleaseMutex(stateLock);
+    unpinSearchPath(pin);
+    __PHYSFS_releaseMutex(stateLock);
 
     __PHYSFS_smallFree(allocated_fname);
 
     return (retval == PHYSFS_ENUM_ERROR) ? 0 : 1;
+} /* doEnumerate */
+
+
+int PHYSFS_enumerate(const char *fn, PHYSFS_EnumerateCallback cb, void *data)
+{
+    PHYSFS_TraceEvent trace;
+    int retval;
+
+    TRACE_BEGIN(trace, PHYSFS_TRACE_ENUMERATE, fn, NULL, 0);
+    retval = doEnumerate(fn, cb, data);
+    TRACE_END(trace, NULL, retval);
+    return retval;
 } /* PHYSFS_enumerate */
 
 
@@ -7502,124 +11394,571 @@ static PHYSFS_File *doOpenWrite(const char *_fname, const int appending)
 
     BAIL_IF(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    grabStateLock(OPEN);
+
+    h = writeDir;
+    BAIL_IF_MUTEX(!h, PHYSFS_ERR_NO_WRITE_DIR, stateLock, 0);
+
+    len = strlen(_fname) + dirHandleRootLen(h) + 1;
+    fname = (char *) __PHYSFS_smallAlloc(len);
+    BAIL_IF_MUTEX(!fname, PHYSFS_ERR_OUT_OF_MEMORY, stateLock, 0);
+
+    if (sanitizePlatformIndependentPathWithRoot(h, _fname, fname))
+    {
+        PHYSFS_Io *io = NULL;
+        char *arcfname = fname;
+        SearchPathEntry entry;
+        dirHandleEntry(&entry, h);
+        if (verifyPath(&entry, &arcfname, 0))
+        {
+            const PHYSFS_Archiver *f = h->funcs;
+            MemoryScope scope;
+            memoryScopeEnter(&scope, DIRHANDLE_MEMORY(h), PHYSFS_MEMORY_HANDLE);
+            if (appending)
+                io = f->openAppend(h->opaque, arcfname);
+            else
+                io = f->openWrite(h->opaque, arcfname);
+
+            if (io)
+            {
+                fh = (FileHandle *) allocator.Malloc(sizeof (FileHandle));
+                if (fh == NULL)
+                {
+                    io->destroy(io);
+                    PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
+                } /* if */
+                else
+                {
+                    memset(fh, '\0', sizeof (FileHandle));
+                    fh->io = io;
+                    fh->dirHandle = h;
+                    fh->next = openWriteList;
+                    openWriteList = fh;
+                } /* else */
+            } /* if */
+            memoryScopeLeave(&scope);
+        } /* if */
+    } /* if */
+
+    __PHYSFS_releaseMutex(stateLock);
+
+    __PHYSFS_smallFree(fname);
+    return ((PHYSFS_File *) fh);
+} /* doOpenWrite */
+
+
+PHYSFS_File *PHYSFS_openWrite(const char *filename)
+{
+    return doOpenWrite(filename, 0);
+} /* PHYSFS_openWrite */
+
+
+PHYSFS_File *PHYSFS_openAppend(const char *filename)
+{
+    return doOpenWrite(filename, 1);
+} /* PHYSFS_openAppend */
+
+
+static FileHandle *doOpenRead(const char *_fname)
+{
+    FileHandle *fh = NULL;
+    const SearchPathSnapshot *sp;
+    volatile int *pin;
+    char *allocated_fname;
+    char *fname;
+    size_t len;
+
+    BAIL_IF(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    /* the archives can't go away while it's pinned, so no lock for this. */
+    sp = pinSearchPath(&pin);
+    if (sp->count == 0)
+    {
+        unpinSearchPath(pin);
+        BAIL(PHYSFS_ERR_NOT_FOUND, 0);
+    } /* if */
+
+    len = strlen(_fname) + sp->longestRoot + 1;
+    allocated_fname = (char *) __PHYSFS_smallAlloc(len);
+    if (!allocated_fname)
+    {
+        unpinSearchPath(pin);
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    } /* if */
+    fname = allocated_fname + sp->longestRoot;
+
+    if (sanitizePlatformIndependentPath(_fname, fname))
+    {
+        PHYSFS_Io *io = NULL;
+        DirHandle *dh = NULL;
+        MemoryScope scope;
+        PHYSFS_uint32 i;
+
+        for (i = 0; i < sp->count; i++)
+        {
+            char *arcfname = fname;
+            if (verifyPath(&sp->entries[i], &arcfname, 0))
+            {
+                dh = sp->entries[i].dirHandle;
+                memoryScopeEnter(&scope, DIRHANDLE_MEMORY(dh), PHYSFS_MEMORY_HANDLE);
+                io = dirHandleOpenRead(dh, arcfname);
+                memoryScopeLeave(&scope);
+                if (io)
+                    break;
+            } /* if */
+        } /* for */
+
+        if (io)
+        {
+            memoryScopeEnter(&scope, DIRHANDLE_MEMORY(dh), PHYSFS_MEMORY_HANDLE);
+            fh = (FileHandle *) allocator.Malloc(sizeof (FileHandle));
+            memoryScopeLeave(&scope);
+            if (fh == NULL)
+            {
+                io->destroy(io);
+                PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
+            } /* if */
+            else
+            {
+                memset(fh, '\0', sizeof (FileHandle));
+                fh->io = io;
+                fh->forReading = 1;
+                fh->dirHandle = dh;
+
+#if PHYSFS_SUPPORTS_STATS
+                /* the DIR archiver opens native files itself, tag them. */
+                if (dh->funcs == &__PHYSFS_Archiver_DIR)
+                    __PHYSFS_setIoStats(io, &dh->stats);
+#endif
+                __PHYSFS_STAT_ADD(&dh->stats, opens, 1);
+
+                /* still pinned, so (dh) is still open for the list. */
+                grabStateLock(OPEN);
+                fh->next = openReadList;
+                openReadList = fh;
+                __PHYSFS_releaseMutex(stateLock);
+            } /* else */
+        } /* if */
+    } /* if */
+
+    unpinSearchPath(pin);
+    __PHYSFS_smallFree(allocated_fname);
+    return fh;
+} /* doOpenRead */
+
+
+PHYSFS_File *PHYSFS_openRead(const char *fname)
+{
+    PHYSFS_TraceEvent trace;
+    FileHandle *fh;
+
+    TRACE_BEGIN(trace, PHYSFS_TRACE_OPEN, fname, NULL, 0);
+    fh = doOpenRead(fname);
+    trace.handle = fh;  /* so later reads and seeks can be matched up. */
+    TRACE_END(trace, fh ? fh->dirHandle->dirName : NULL, fh != NULL);
+    return ((PHYSFS_File *) fh);
+} /* PHYSFS_openRead */
+
+
+/* byte range of one prefetched file, in an archive's i/o. */
+typedef struct
+{
+    DirHandle *dirHandle;
+    int generation;  /* dirHandle's, to tell it from a later mount's. */
+    PHYSFS_Io *io;
+    PHYSFS_uint64 pos;
+    PHYSFS_uint64 len;
+} PrefetchRange;
+
+struct PHYSFS_Prefetch
+{
+    char **paths;
+    PHYSFS_uint32 count;
+    PrefetchRange *ranges;
+    PHYSFS_uint32 numRanges;
+    void *thread;
+    int cancel;
+    int done;
+};
+
+/* ranges closer than this are read ahead as one. */
+#define PREFETCH_MERGE_GAP (64 * 1024)
+
+#define prefetchCanceled(pf) (*((volatile int *) &(pf)->cancel))
+
+
+/*
+ * stateLock must be held. (h) may be long gone, and a later mount may have
+ *  the same address, so only a handle still in the search path is looked
+ *  at, to check it's the same mount.
+ */
+static int isMounted(const DirHandle *h, const int generation)
+{
+    const DirHandle *i;
+    for (i = searchPath; i != NULL; i = i->next)
+    {
+        if ((i == h) && (i->generation == generation))
+            return 1;
+    } /* for */
+    return 0;
+} /* isMounted */
+
+
+/* stateLock must be held. Directories are read ahead right away. */
+static void prefetchResolve(PHYSFS_Prefetch *pf, DirHandle *h,
+                            const char *arcfname)
+{
+    const PHYSFS_Archiver *funcs = h->funcs;
+    PrefetchRange *range = &pf->ranges[pf->numRanges];
+    PHYSFS_PhysicalStat st;
+    int found = 0;
+
+    if (funcs == &__PHYSFS_Archiver_DIR)
+    {
+        PHYSFS_Io *io = funcs->openRead(h->opaque, arcfname);
+        if (io != NULL)
+        {
+            const PHYSFS_sint64 len = io->length(io);
+            if ((io->read == nativeIo_read) && (len > 0))
+            {
+                const NativeIoInfo *info = (const NativeIoInfo *) io->opaque;
+                __PHYSFS_platformReadAhead(info->handle, 0, len);
+                __PHYSFS_STAT_ADD(DIRHANDLE_STATS(h), bytesPrefetched, len);
+            } /* if */
+            io->destroy(io);
+        } /* if */
+        return;
+    } /* if */
+
+    else if (funcs->openRead == UNPK_openRead)
+        found = UNPK_statPhysical(h->opaque, arcfname, &range->io, &st);
+#if PHYSFS_SUPPORTS_ZIP
+    else if (funcs->openRead == __PHYSFS_Archiver_ZIP.openRead)  /* a copy. */
+        found = ZIP_statPhysical(h->opaque, arcfname, &range->io, &st);
+#endif
+
+    if ((found) && (st.storedsize > 0) && (range->io->read == nativeIo_read))
+    {
+        range->pos = st.offset;
+        range->len = st.storedsize;
+        range->dirHandle = h;
+        range->generation = h->generation;
+        pf->numRanges++;
+    } /* if */
+} /* prefetchResolve */
+
+
+/* find the first archive that has (_fname), like doOpenRead() would. */
+static void prefetchPath(PHYSFS_Prefetch *pf, const char *_fname)
+{
+    const SearchPathSnapshot *sp;
+    volatile int *pin;
+    char *allocated_fname;
+    char *fname;
+    size_t len;
+
+    grabStateLock(OPEN);
+    sp = pinSearchPath(&pin);
+
+    len = strlen(_fname) + sp->longestRoot + 1;
+    allocated_fname = (char *) __PHYSFS_smallAlloc(len);
+    if (allocated_fname != NULL)
+    {
+        fname = allocated_fname + sp->longestRoot;
+        if (sanitizePlatformIndependentPath(_fname, fname))
+        {
+            PHYSFS_uint32 i;
+            for (i = 0; i < sp->count; i++)
+            {
+                DirHandle *dh = sp->entries[i].dirHandle;
+                char *arcfname = fname;
+                PHYSFS_Stat statbuf;
+                if ( (verifyPath(&sp->entries[i], &arcfname, 0)) &&
+                     (dh->funcs->stat(dh->opaque, arcfname, &statbuf)) )
+                {
+                    if (statbuf.filetype == PHYSFS_FILETYPE_REGULAR)
+                        prefetchResolve(pf, dh, arcfname);
+                    break;
+                } /* if */
+            } /* for */
+        } /* if */
+        __PHYSFS_smallFree(allocated_fname);
+    } /* if */
+
+    unpinSearchPath(pin);
+    __PHYSFS_releaseMutex(stateLock);
+} /* prefetchPath */
+
+
+static int cmpPrefetchRanges(void *_a, size_t one, size_t two)
+{
+    const PrefetchRange *a = ((const PrefetchRange *) _a) + one;
+    const PrefetchRange *b = ((const PrefetchRange *) _a) + two;
+    if (a->dirHandle != b->dirHandle)
+        return (a->dirHandle < b->dirHandle) ? -1 : 1;
+    else if (a->generation != b->generation)
+        return (a->generation < b->generation) ? -1 : 1;
+    else if (a->pos != b->pos)
+        return (a->pos < b->pos) ? -1 : 1;
+    return 0;
+} /* cmpPrefetchRanges */
+
+
+static void swapPrefetchRanges(void *_a, size_t one, size_t two)
+{
+    PrefetchRange *a = ((PrefetchRange *) _a) + one;
+    PrefetchRange *b = ((PrefetchRange *) _a) + two;
+    PrefetchRange tmp;
+    memcpy(&tmp, a, sizeof (tmp));
+    memcpy(a, b, sizeof (*a));
+    memcpy(b, &tmp, sizeof (*b));
+} /* swapPrefetchRanges */
+
+
+/* sort by archive and offset, and merge ranges that (nearly) touch. */
+static void coalescePrefetchRanges(PHYSFS_Prefetch *pf)
+{
+    PrefetchRange *ranges = pf->ranges;
+    PHYSFS_uint32 i, out = 0;
+
+    if (pf->numRanges == 0)
+        return;
+
+    __PHYSFS_sort(ranges, pf->numRanges, cmpPrefetchRanges, swapPrefetchRanges);
+    for (i = 1; i < pf->numRanges; i++)
+    {
+        PrefetchRange *prev = &ranges[out];
+        const PrefetchRange *r = &ranges[i];
+        if ( (r->dirHandle == prev->dirHandle) &&
+             (r->generation == prev->generation) &&
+             (r->pos <= prev->pos + prev->len + PREFETCH_MERGE_GAP) )
+        {
+            const PHYSFS_uint64 end = r->pos + r->len;
+            if (end > prev->pos + prev->len)
+                prev->len = end - prev->pos;
+        } /* if */
+        else
+        {
+            ranges[++out] = *r;
+        } /* else */
+    } /* for */
+    pf->numRanges = out + 1;
+} /* coalescePrefetchRanges */
+
+
+static void prefetchThread(void *data)
+{
+    PHYSFS_Prefetch *pf = (PHYSFS_Prefetch *) data;
+    PHYSFS_uint32 i;
+
+    for (i = 0; (i < pf->count) && (!prefetchCanceled(pf)); i++)
+        prefetchPath(pf, pf->paths[i]);
+
+    coalescePrefetchRanges(pf);
+
+    for (i = 0; (i < pf->numRanges) && (!prefetchCanceled(pf)); i++)
+    {
+        const PrefetchRange *r = &pf->ranges[i];
+        grabStateLock(OPEN);
+        if (isMounted(r->dirHandle, r->generation))  /* else r->io is gone. */
+        {
+            const NativeIoInfo *info = (const NativeIoInfo *) r->io->opaque;
+            __PHYSFS_platformReadAhead(info->handle, r->pos, r->len);
+            __PHYSFS_STAT_ADD(DIRHANDLE_STATS(r->dirHandle), bytesPrefetched,
+                              r->len);
+        } /* if */
+        __PHYSFS_releaseMutex(stateLock);
+    } /* for */
+
+    __PHYSFS_freeThreadErrorState();
+    __PHYSFS_ATOMIC_INCR(&pf->done);
+} /* prefetchThread */
+
+
+static void freePrefetch(PHYSFS_Prefetch *pf)
+{
+    PHYSFS_uint32 i;
+    for (i = 0; i < pf->count; i++)
+        allocator.Free(pf->paths[i]);
+    allocator.Free(pf->paths);
+    allocator.Free(pf->ranges);
+    allocator.Free(pf);
+} /* freePrefetch */
+
+
+PHYSFS_Prefetch *PHYSFS_prefetch(const char * const *paths)
+{
+    PHYSFS_Prefetch *pf;
+    PHYSFS_uint32 count = 0;
+
+    BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, NULL);
+    BAIL_IF(!paths, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+
+    while (paths[count] != NULL)
+        count++;
+
+    pf = (PHYSFS_Prefetch *) allocator.Malloc(sizeof (PHYSFS_Prefetch));
+    BAIL_IF(!pf, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    memset(pf, '\0', sizeof (PHYSFS_Prefetch));
+
+    /* one extra of each, so a zero-length list still allocates. */
+    pf->paths = (char **) allocator.Malloc(sizeof (char *) * (count + 1));
+    pf->ranges = (PrefetchRange *) allocator.Malloc(sizeof (PrefetchRange) * (count + 1));
+    GOTO_IF(!pf->paths || !pf->ranges, PHYSFS_ERR_OUT_OF_MEMORY, prefetch_failed);
+
+    for (pf->count = 0; pf->count < count; pf->count++)
+    {
+        const char *path = paths[pf->count];
+        char *ptr = (char *) allocator.Malloc(strlen(path) + 1);
+        GOTO_IF(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, prefetch_failed);
+        strcpy(ptr, path);
+        pf->paths[pf->count] = ptr;
+    } /* for */
+
+    pf->thread = __PHYSFS_platformCreateThread(prefetchThread, pf);
+    GOTO_IF_ERRPASS(!pf->thread, prefetch_failed);
+    return pf;
+
+prefetch_failed:
+    if (pf->paths == NULL)
+        pf->count = 0;
+    freePrefetch(pf);
+    return NULL;
+} /* PHYSFS_prefetch */
+
+
+int PHYSFS_prefetchDone(PHYSFS_Prefetch *pf)
+{
+    BAIL_IF(!pf, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    return (*((volatile int *) &pf->done) != 0);
+} /* PHYSFS_prefetchDone */
+
+
+void PHYSFS_endPrefetch(PHYSFS_Prefetch *pf, int cancel)
+{
+    if (pf == NULL)
+        return;
+
+    if (cancel)
+        __PHYSFS_ATOMIC_INCR(&pf->cancel);
+    __PHYSFS_platformWaitThread(pf->thread);
+    freePrefetch(pf);
+} /* PHYSFS_endPrefetch */
 
-    h = writeDir;
-    BAIL_IF_MUTEX(!h, PHYSFS_ERR_NO_WRITE_DIR, stateLock, 0);
 
-    len = strlen(_fname) + dirHandleRootLen(h) + 1;
-    fname = (char *) __PHYSFS_smallAlloc(len);
-    BAIL_IF_MUTEX(!fname, PHYSFS_ERR_OUT_OF_MEMORY, stateLock, 0);
+/*
+ * Find the file on disk that reading (io) pulls bytes from, and where in
+ *  it (io) is reading right now. NULL if (io) doesn't read a native file.
+ */
+static PHYSFS_Io *findNativePosition(PHYSFS_Io *io, PHYSFS_uint64 *_pos)
+{
+    PHYSFS_Io *raw = io;
+    PHYSFS_sint64 pos;
 
-    if (sanitizePlatformIndependentPathWithRoot(h, _fname, fname))
+    if (io->read != nativeIo_read)
     {
-        PHYSFS_Io *io = NULL;
-        char *arcfname = fname;
-        if (verifyPath(h, &arcfname, 0))
-        {
-            const PHYSFS_Archiver *f = h->funcs;
-            if (appending)
-                io = f->openAppend(h->opaque, arcfname);
-            else
-                io = f->openWrite(h->opaque, arcfname);
+        raw = UNPK_rawIo(io);
+#if PHYSFS_SUPPORTS_ZIP
+        if (raw == NULL)
+            raw = ZIP_rawIo(io);
+#endif
+        if (raw == NULL)
+            return NULL;
+    } /* if */
 
-            if (io)
-            {
-                fh = (FileHandle *) allocator.Malloc(sizeof (FileHandle));
-                if (fh == NULL)
-                {
-                    io->destroy(io);
-                    PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
-                } /* if */
-                else
-                {
-                    memset(fh, '\0', sizeof (FileHandle));
-                    fh->io = io;
-                    fh->dirHandle = h;
-                    fh->next = openWriteList;
-                    openWriteList = fh;
-                } /* else */
-            } /* if */
-        } /* if */
+    if (raw->read == readerIo_read)  /* a private position, no syscall. */
+    {
+        const ReaderIoInfo *info = (const ReaderIoInfo *) raw->opaque;
+        *_pos = info->pos;
+        return (info->parent->read == nativeIo_read) ? info->parent : NULL;
     } /* if */
 
-    __PHYSFS_platformReleaseMutex(stateLock);
+    if (raw->read != nativeIo_read)
+        return NULL;
 
-    __PHYSFS_smallFree(fname);
-    return ((PHYSFS_File *) fh);
-} /* doOpenWrite */
+    pos = raw->tell(raw);
+    if (pos < 0)
+        return NULL;
+    *_pos = (PHYSFS_uint64) pos;
+    return raw;
+} /* findNativePosition */
 
 
-PHYSFS_File *PHYSFS_openWrite(const char *filename)
+/*
+ * Readahead fills the OS cache in chunks of up to a few megabytes, and the
+ *  OS only drops a chunk when asked to drop all of it. So uncached handles
+ *  don't drop each read as it happens: they let the consumed range grow to
+ *  twice this size, drop it, and start over this far back, to get the chunk
+ *  that straddled the end next time.
+ */
+#define UNCACHED_DROP_LAG (2 * 1024 * 1024)
+
+/* for uncached handles: note where the disk is before reading... */
+static PHYSFS_Io *uncachedBegin(const FileHandle *fh, PHYSFS_uint64 *_pos)
 {
-    return doOpenWrite(filename, 0);
-} /* PHYSFS_openWrite */
+    if (!fh->uncached)
+        return NULL;
+    return findNativePosition(fh->io, _pos);
+} /* uncachedBegin */
 
 
-PHYSFS_File *PHYSFS_openAppend(const char *filename)
+static void dropNativeRange(PHYSFS_Io *native, const PHYSFS_uint64 start,
+                            const PHYSFS_uint64 end)
 {
-    return doOpenWrite(filename, 1);
-} /* PHYSFS_openAppend */
+    const NativeIoInfo *info = (const NativeIoInfo *) native->opaque;
+    if (end > start)
+        __PHYSFS_platformDropCache(info->handle, start, end - start);
+} /* dropNativeRange */
 
 
-PHYSFS_File *PHYSFS_openRead(const char *_fname)
+/* ...and drop what the read went through from the OS cache afterwards. */
+static void uncachedEnd(FileHandle *fh, PHYSFS_Io *native,
+                        const PHYSFS_uint64 start)
 {
-    FileHandle *fh = NULL;
-    char *allocated_fname;
-    char *fname;
-    size_t len;
+    PHYSFS_uint64 end;
+    if ((native == NULL) || (findNativePosition(fh->io, &end) != native))
+        return;
 
-    BAIL_IF(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    /* seeked somewhere else? Don't drop the gap, it wasn't ours. */
+    if ((start != fh->uncachedTo) || (start < fh->uncachedFrom))
+        fh->uncachedFrom = start;
+    fh->uncachedTo = end;
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    if ((end > fh->uncachedFrom) &&
+        ((end - fh->uncachedFrom) >= (2 * UNCACHED_DROP_LAG)))
+    {
+        dropNativeRange(native, fh->uncachedFrom, end);
+        fh->uncachedFrom = end - UNCACHED_DROP_LAG;
+    } /* if */
+} /* uncachedEnd */
 
-    BAIL_IF_MUTEX(!searchPath, PHYSFS_ERR_NOT_FOUND, stateLock, 0);
 
-    len = strlen(_fname) + longest_root + 1;
-    allocated_fname = (char *) __PHYSFS_smallAlloc(len);
-    BAIL_IF_MUTEX(!allocated_fname, PHYSFS_ERR_OUT_OF_MEMORY, stateLock, 0);
-    fname = allocated_fname + longest_root;
+/* drop whatever's left over, when closing or turning it off. */
+static void uncachedFlush(FileHandle *fh)
+{
+    PHYSFS_uint64 pos;
+    PHYSFS_Io *native;
 
-    if (sanitizePlatformIndependentPath(_fname, fname))
-    {
-        PHYSFS_Io *io = NULL;
-        DirHandle *i;
+    if (!fh->uncached)
+        return;
 
-        for (i = searchPath; i != NULL; i = i->next)
-        {
-            char *arcfname = fname;
-            if (verifyPath(i, &arcfname, 0))
-            {
-                io = i->funcs->openRead(i->opaque, arcfname);
-                if (io)
-                    break;
-            } /* if */
-        } /* for */
+    native = findNativePosition(fh->io, &pos);
+    if (native != NULL)
+        dropNativeRange(native, fh->uncachedFrom, fh->uncachedTo);
+    fh->uncachedFrom = fh->uncachedTo = 0;
+} /* uncachedFlush */
 
-        if (io)
-        {
-            fh = (FileHandle *) allocator.Malloc(sizeof (FileHandle));
-            if (fh == NULL)
-            {
-                io->destroy(io);
-                PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
-            } /* if */
-            else
-            {
-                memset(fh, '\0', sizeof (FileHandle));
-                fh->io = io;
-                fh->forReading = 1;
-                fh->dirHandle = i;
-                fh->next = openReadList;
-                openReadList = fh;
-            } /* else */
-        } /* if */
-    } /* if */
 
-    __PHYSFS_platformReleaseMutex(stateLock);
-    __PHYSFS_smallFree(allocated_fname);
-    return ((PHYSFS_File *) fh);
-} /* PHYSFS_openRead */
+int PHYSFS_setUncached(PHYSFS_File *handle, int enable)
+{
+    FileHandle *fh = (FileHandle *) handle;
+    BAIL_IF(!fh, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF(!fh->forReading, PHYSFS_ERR_OPEN_FOR_WRITING, 0);
+    if (!enable)
+        uncachedFlush(fh);
+    fh->uncached = enable ? 1 : 0;
+    return 1;
+} /* PHYSFS_setUncached */
 
 
 static int closeHandleInOpenList(FileHandle **list, FileHandle *handle)
@@ -7645,11 +11984,19 @@ static int closeHandleInOpenList(FileHandle **list, FileHandle *handle)
                     return -1;
             } /* if */
 
+            else
+            {
+                uncachedFlush(handle);
+            } /* else */
+
             /* ...then close the underlying file. */
             io->destroy(io);
 
             if (tmp != NULL)  /* free any associated buffer. */
+            {
+                __PHYSFS_memoryRelease(handle->bufsize);
                 allocator.Free(tmp);
+            } /* if */
 
             if (prev == NULL)
                 *list = handle->next;
@@ -7666,12 +12013,26 @@ static int closeHandleInOpenList(FileHandle **list, FileHandle *handle)
 } /* closeHandleInOpenList */
 
 
-int PHYSFS_close(PHYSFS_File *_handle)
+static int doClose(PHYSFS_File *_handle)
 {
     FileHandle *handle = (FileHandle *) _handle;
+    const DirHandle *dh = NULL;
+    DirHandle *retired = NULL;
+    DirHandle *closeList = NULL;
+    FileHandle *i;
     int rc;
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    grabStateLock(CLOSE);
+
+    /* if its archive was replaced, we might be the last one using it. */
+    for (i = retiredDirs ? openReadList : NULL; i != NULL; i = i->next)
+    {
+        if (i == handle)
+        {
+            dh = i->dirHandle;
+            break;
+        } /* if */
+    } /* for */
 
     /* -1 == close failure. 0 == not found. 1 == success. */
     rc = closeHandleInOpenList(&openReadList, handle);
@@ -7681,85 +12042,309 @@ int PHYSFS_close(PHYSFS_File *_handle)
         rc = closeHandleInOpenList(&openWriteList, handle);
         BAIL_IF_MUTEX_ERRPASS(rc == -1, stateLock, 0);
     } /* if */
+    else if (dh != NULL)
+    {
+        retired = releaseRetiredDir(dh);
+    } /* else if */
 
-    __PHYSFS_platformReleaseMutex(stateLock);
+    if (rc)  /* unmounted archives that lookups kept around might be done. */
+        closeList = reclaimSearchPaths();
+
+    __PHYSFS_releaseMutex(stateLock);
     BAIL_IF(!rc, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    if (retired != NULL)
+        closeDirHandle(retired);  /* nothing can reach it now. */
+    closeDirHandleList(closeList);
     return 1;
+} /* doClose */
+
+
+int PHYSFS_close(PHYSFS_File *handle)
+{
+    PHYSFS_TraceEvent trace;
+    int retval;
+
+    /* the handle is gone afterwards, so there's no archive to report. */
+    TRACE_BEGIN(trace, PHYSFS_TRACE_CLOSE, NULL, handle, 0);
+    retval = doClose(handle);
+    TRACE_END(trace, NULL, retval);
+    return retval;
 } /* PHYSFS_close */
 
 
-static PHYSFS_sint64 doBufferedRead(FileHandle *fh, void *_buffer, size_t len)
-{
-    PHYSFS_uint8 *buffer = (PHYSFS_uint8 *) _buffer;
-    PHYSFS_sint64 retval = 0;
+static PHYSFS_sint64 doBufferedRead(FileHandle *fh, void *_buffer, size_t len)
+{
+    PHYSFS_uint8 *buffer = (PHYSFS_uint8 *) _buffer;
+    PHYSFS_sint64 retval = 0;
+
+    while (len > 0)
+    {
+        const size_t avail = fh->buffill - fh->bufpos;
+        if (avail > 0)  /* data available in the buffer. */
+        {
+            const size_t cpy = (len < avail) ? len : avail;
+            memcpy(buffer, fh->buffer + fh->bufpos, cpy);
+            assert(len >= cpy);
+            buffer += cpy;
+            len -= cpy;
+            fh->bufpos += cpy;
+            retval += cpy;
+            __PHYSFS_STAT_ADD(DIRHANDLE_STATS(fh->dirHandle), bufferHits, 1);
+        } /* if */
+
+        else   /* buffer is empty, refill it. */
+        {
+            PHYSFS_Io *io = fh->io;
+            const PHYSFS_sint64 rc = io->read(io, fh->buffer, fh->bufsize);
+            __PHYSFS_STAT_ADD(DIRHANDLE_STATS(fh->dirHandle), bufferMisses, 1);
+            fh->bufpos = 0;
+            if (rc > 0)
+                fh->buffill = (size_t) rc;
+            else
+            {
+                fh->buffill = 0;
+                if (retval == 0)  /* report already-read data, or failure. */
+                    retval = rc;
+                break;
+            } /* else */
+        } /* else */
+    } /* while */
+
+    return retval;
+} /* doBufferedRead */
+
+
+PHYSFS_sint64 PHYSFS_read(PHYSFS_File *handle, void *buffer,
+                          PHYSFS_uint32 size, PHYSFS_uint32 count)
+{
+    const PHYSFS_uint64 len = ((PHYSFS_uint64) size) * ((PHYSFS_uint64) count);
+    const PHYSFS_sint64 retval = PHYSFS_readBytes(handle, buffer, len);
+    return ( (retval <= 0) ? retval : (retval / ((PHYSFS_sint64) size)) );
+} /* PHYSFS_read */
+
+
+PHYSFS_sint64 PHYSFS_readBytes(PHYSFS_File *handle, void *buffer,
+                               PHYSFS_uint64 _len)
+{
+    const size_t len = (size_t) _len;
+    FileHandle *fh = (FileHandle *) handle;
+    PHYSFS_TraceEvent trace;
+    PHYSFS_sint64 retval;
+    PHYSFS_uint64 physpos = 0;
+    PHYSFS_Io *native;
+
+#ifdef PHYSFS_NO_64BIT_SUPPORT
+    const PHYSFS_uint64 maxlen = __PHYSFS_UI64(0x7FFFFFFF);
+#else
+    const PHYSFS_uint64 maxlen = __PHYSFS_UI64(0x7FFFFFFFFFFFFFFF);
+#endif
+
+    if (!__PHYSFS_ui64FitsAddressSpace(_len))
+        BAIL(PHYSFS_ERR_INVALID_ARGUMENT, -1);
+
+    BAIL_IF(_len > maxlen, PHYSFS_ERR_INVALID_ARGUMENT, -1);
+    BAIL_IF(!fh->forReading, PHYSFS_ERR_OPEN_FOR_WRITING, -1);
+    BAIL_IF_ERRPASS(len == 0, 0);
+
+    TRACE_BEGIN(trace, PHYSFS_TRACE_READ, NULL, handle, _len);
+    native = uncachedBegin(fh, &physpos);
+    if (fh->buffer)
+        retval = doBufferedRead(fh, buffer, len);
+    else
+        retval = fh->io->read(fh->io, buffer, len);
+    uncachedEnd(fh, native, physpos);
+    TRACE_END(trace, fh->dirHandle->dirName, retval);
+
+    if (retval > 0)
+        __PHYSFS_STAT_ADD(DIRHANDLE_STATS(fh->dirHandle), bytesRead, retval);
+    return retval;
+} /* PHYSFS_readBytes */
+
+
+/* size of the bounce buffer when PHYSFS_sendToFd() can't use sendfile(). */
+#define SENDTOFD_BUFSIZE (64 * 1024)
+
+/* write all of (buf) to (fd), or as much as we can. */
+static PHYSFS_sint64 writeAllToFd(int fd, const PHYSFS_uint8 *buf,
+                                  PHYSFS_uint64 len)
+{
+    PHYSFS_sint64 retval = 0;
+    while (len > 0)
+    {
+        const PHYSFS_sint64 rc = __PHYSFS_platformWriteFd(fd, buf, len);
+        if (rc <= 0)
+            return (retval == 0) ? -1 : retval;
+        buf += rc;
+        len -= (PHYSFS_uint64) rc;
+        retval += rc;
+    } /* while */
+    return retval;
+} /* writeAllToFd */
+
+
+#if PHYSFS_PLATFORM_SENDFILE
+/*
+ * If reading (io) copies bytes straight out of a file on disk, find that
+ *  file's native i/o and where (io)'s current position is in it.
+ */
+static PHYSFS_Io *findNativeRange(PHYSFS_Io *io, PHYSFS_uint64 *_pos,
+                                  PHYSFS_uint64 *_avail)
+{
+    PHYSFS_Io *raw = NULL;
+
+    if (io->read == nativeIo_read)  /* a file in a plain directory. */
+    {
+        const PHYSFS_sint64 pos = io->tell(io);
+        const PHYSFS_sint64 len = io->length(io);
+        if ((pos < 0) || (len < pos))
+            return NULL;
+        *_pos = (PHYSFS_uint64) pos;
+        *_avail = (PHYSFS_uint64) (len - pos);
+        return io;
+    } /* if */
+
+    else if (UNPK_rawRange(io, &raw, _pos, _avail))
+        /* found it */ ;
+#if PHYSFS_SUPPORTS_ZIP
+    else if (ZIP_rawRange(io, &raw, _pos, _avail))
+        /* found it */ ;
+#endif
+    else
+        return NULL;
+
+    /* archivers read through a private position in the archive's i/o. */
+    if (raw->read == readerIo_read)
+        raw = ((ReaderIoInfo *) raw->opaque)->parent;
+
+    return (raw->read == nativeIo_read) ? raw : NULL;
+} /* findNativeRange */
+#endif
+
+
+static PHYSFS_sint64 doSendToFd(FileHandle *fh, int fd, PHYSFS_uint64 len)
+{
+    PHYSFS_Io *io = fh->io;
+    PHYSFS_sint64 retval = 0;
+    PHYSFS_uint8 *buf;
+
+    /* whatever's already buffered goes first. */
+    if (fh->bufpos < fh->buffill)
+    {
+        PHYSFS_uint64 avail = (PHYSFS_uint64) (fh->buffill - fh->bufpos);
+        PHYSFS_sint64 rc;
+        if (avail > len)
+            avail = len;
+        rc = writeAllToFd(fd, fh->buffer + fh->bufpos, avail);
+        BAIL_IF_ERRPASS(rc < 0, -1);
+        fh->bufpos += (size_t) rc;
+        retval = rc;
+        len -= (PHYSFS_uint64) rc;
+        if ((PHYSFS_uint64) rc < avail)
+            return retval;
+    } /* if */
+
+    if (len == 0)
+        return retval;
+
+    fh->buffill = fh->bufpos = 0;  /* the i/o is where we are now. */
+
+#if PHYSFS_PLATFORM_SENDFILE
+    {
+        PHYSFS_uint64 pos, avail;
+        PHYSFS_Io *native = findNativeRange(io, &pos, &avail);
+        if (native != NULL)
+        {
+            const PHYSFS_sint64 start = io->tell(io);
+            void *handle = ((NativeIoInfo *) native->opaque)->handle;
+            PHYSFS_uint64 sent = 0;
+
+            if (avail > len)
+                avail = len;
+
+            while (sent < avail)
+            {
+                const PHYSFS_sint64 rc = __PHYSFS_platformSendFile(handle,
+                                            pos + sent, fd, avail - sent);
+                if (rc <= 0)
+                    break;
+                sent += (PHYSFS_uint64) rc;
+            } /* while */
+
+            if (sent > 0)
+            {
+                __PHYSFS_STAT_ADD(__PHYSFS_getIoStats(native), bytesReadPhysical, sent);
+                BAIL_IF_ERRPASS(!io->seek(io, start + sent), -1);
+                return retval + (PHYSFS_sint64) sent;
+            } /* if */
+
+            /* sendfile() refused to do anything at all? Do it the slow way. */
+            PHYSFS_getLastErrorCode();
+        } /* if */
+    } /* block */
+#endif
+
+    buf = (PHYSFS_uint8 *) allocator.Malloc(SENDTOFD_BUFSIZE);
+    if (!buf)
+        BAIL(PHYSFS_ERR_OUT_OF_MEMORY, (retval > 0) ? retval : -1);
 
     while (len > 0)
     {
-        const size_t avail = fh->buffill - fh->bufpos;
-        if (avail > 0)  /* data available in the buffer. */
+        const PHYSFS_uint64 want = (len > SENDTOFD_BUFSIZE) ? SENDTOFD_BUFSIZE : len;
+        const PHYSFS_sint64 br = io->read(io, buf, want);
+        PHYSFS_sint64 bw;
+
+        if (br <= 0)
         {
-            const size_t cpy = (len < avail) ? len : avail;
-            memcpy(buffer, fh->buffer + fh->bufpos, cpy);
-            assert(len >= cpy);
-            buffer += cpy;
-            len -= cpy;
-            fh->bufpos += cpy;
-            retval += cpy;
+            if ((br < 0) && (retval == 0))
+                retval = -1;
+            break;
         } /* if */
 
-        else   /* buffer is empty, refill it. */
+        bw = writeAllToFd(fd, buf, (PHYSFS_uint64) br);
+        if (bw < br)
         {
-            PHYSFS_Io *io = fh->io;
-            const PHYSFS_sint64 rc = io->read(io, fh->buffer, fh->bufsize);
-            fh->bufpos = 0;
-            if (rc > 0)
-                fh->buffill = (size_t) rc;
-            else
-            {
-                fh->buffill = 0;
-                if (retval == 0)  /* report already-read data, or failure. */
-                    retval = rc;
-                break;
-            } /* else */
-        } /* else */
+            /* put the file position back after what actually went out. */
+            if (bw > 0)
+                retval += bw;
+            io->seek(io, io->tell(io) - (br - ((bw > 0) ? bw : 0)));
+            if (retval == 0)
+                retval = -1;
+            break;
+        } /* if */
+
+        retval += bw;
+        len -= (PHYSFS_uint64) bw;
     } /* while */
 
+    allocator.Free(buf);
     return retval;
-} /* doBufferedRead */
-
-
-PHYSFS_sint64 PHYSFS_read(PHYSFS_File *handle, void *buffer,
-                          PHYSFS_uint32 size, PHYSFS_uint32 count)
-{
-    const PHYSFS_uint64 len = ((PHYSFS_uint64) size) * ((PHYSFS_uint64) count);
-    const PHYSFS_sint64 retval = PHYSFS_readBytes(handle, buffer, len);
-    return ( (retval <= 0) ? retval : (retval / ((PHYSFS_sint64) size)) );
-} /* PHYSFS_read */
+} /* doSendToFd */
 
 
-PHYSFS_sint64 PHYSFS_readBytes(PHYSFS_File *handle, void *buffer,
-                               PHYSFS_uint64 _len)
+PHYSFS_sint64 PHYSFS_sendToFd(PHYSFS_File *handle, int fd, PHYSFS_uint64 len)
 {
-    const size_t len = (size_t) _len;
     FileHandle *fh = (FileHandle *) handle;
+    PHYSFS_TraceEvent trace;
+    PHYSFS_sint64 retval;
+    PHYSFS_uint64 physpos = 0;
+    PHYSFS_Io *native;
 
-#ifdef PHYSFS_NO_64BIT_SUPPORT
-    const PHYSFS_uint64 maxlen = __PHYSFS_UI64(0x7FFFFFFF);
-#else
-    const PHYSFS_uint64 maxlen = __PHYSFS_UI64(0x7FFFFFFFFFFFFFFF);
-#endif
-
-    if (!__PHYSFS_ui64FitsAddressSpace(_len))
-        BAIL(PHYSFS_ERR_INVALID_ARGUMENT, -1);
-
-    BAIL_IF(_len > maxlen, PHYSFS_ERR_INVALID_ARGUMENT, -1);
+    BAIL_IF(!fh, PHYSFS_ERR_INVALID_ARGUMENT, -1);
+    BAIL_IF(fd < 0, PHYSFS_ERR_INVALID_ARGUMENT, -1);
     BAIL_IF(!fh->forReading, PHYSFS_ERR_OPEN_FOR_WRITING, -1);
     BAIL_IF_ERRPASS(len == 0, 0);
-    if (fh->buffer)
-        return doBufferedRead(fh, buffer, len);
 
-    return fh->io->read(fh->io, buffer, len);
-} /* PHYSFS_readBytes */
+    TRACE_BEGIN(trace, PHYSFS_TRACE_READ, NULL, handle, len);
+    native = uncachedBegin(fh, &physpos);
+    retval = doSendToFd(fh, fd, len);
+    uncachedEnd(fh, native, physpos);
+    TRACE_END(trace, fh->dirHandle->dirName, retval);
+
+    if (retval > 0)
+        __PHYSFS_STAT_ADD(DIRHANDLE_STATS(fh->dirHandle), bytesRead, retval);
+    return retval;
+} /* PHYSFS_sendToFd */
 
 
 static PHYSFS_sint64 doBufferedWrite(PHYSFS_File *handle, const void *buffer,
@@ -7849,7 +12434,7 @@ PHYSFS_sint64 PHYSFS_tell(PHYSFS_File *handle)
 } /* PHYSFS_tell */
 
 
-int PHYSFS_seek(PHYSFS_File *handle, PHYSFS_uint64 pos)
+static int doSeek(PHYSFS_File *handle, PHYSFS_uint64 pos)
 {
     FileHandle *fh = (FileHandle *) handle;
     BAIL_IF_ERRPASS(!PHYSFS_flush(handle), 0);
@@ -7872,6 +12457,20 @@ int PHYSFS_seek(PHYSFS_File *handle, PHYSFS_uint64 pos)
     /* we have to fall back to a 'raw' seek. */
     fh->buffill = fh->bufpos = 0;
     return fh->io->seek(fh->io, pos);
+} /* doSeek */
+
+
+int PHYSFS_seek(PHYSFS_File *handle, PHYSFS_uint64 pos)
+{
+    const FileHandle *fh = (const FileHandle *) handle;
+    PHYSFS_TraceEvent trace;
+    int retval;
+
+    TRACE_BEGIN(trace, PHYSFS_TRACE_SEEK, NULL, handle, pos);
+    retval = doSeek(handle, pos);
+    TRACE_END(trace, fh->dirHandle ? fh->dirHandle->dirName : NULL, retval);
+    (void) fh;  /* only used for tracing. */
+    return retval;
 } /* PHYSFS_seek */
 
 
@@ -7886,12 +12485,17 @@ int PHYSFS_setBuffer(PHYSFS_File *handle, PHYSFS_uint64 _bufsize)
 {
     FileHandle *fh = (FileHandle *) handle;
     const size_t bufsize = (size_t) _bufsize;
+    const size_t charged = fh->buffer ? fh->bufsize : 0;
 
     if (!__PHYSFS_ui64FitsAddressSpace(_bufsize))
         BAIL(PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
     BAIL_IF_ERRPASS(!PHYSFS_flush(handle), 0);
 
+    /* fail before touching anything if a bigger buffer won't fit the budget. */
+    if (bufsize > charged)
+        BAIL_IF_ERRPASS(!__PHYSFS_memoryReserve(bufsize - charged, 1), 0);
+
     /*
      * For reads, we need to move the file pointer to where it would be
      *  if we weren't buffering, so that the next read will get the
@@ -7899,11 +12503,14 @@ int PHYSFS_setBuffer(PHYSFS_File *handle, PHYSFS_uint64 _bufsize)
      */
     if ((fh->forReading) && (fh->buffill != fh->bufpos))
     {
-        PHYSFS_uint64 pos;
         const PHYSFS_sint64 curpos = fh->io->tell(fh->io);
-        BAIL_IF_ERRPASS(curpos == -1, 0);
-        pos = ((curpos - fh->buffill) + fh->bufpos);
-        BAIL_IF_ERRPASS(!fh->io->seek(fh->io, pos), 0);
+        if ((curpos == -1) ||
+            (!fh->io->seek(fh->io, (curpos - fh->buffill) + fh->bufpos)))
+        {
+            if (bufsize > charged)  /* give back what we reserved above. */
+                __PHYSFS_memoryRelease(bufsize - charged);
+            return 0;  /* (errcode set by tell() or seek().) */
+        } /* if */
     } /* if */
 
     if (bufsize == 0)  /* delete existing buffer. */
@@ -7918,11 +12525,22 @@ int PHYSFS_setBuffer(PHYSFS_File *handle, PHYSFS_uint64 _bufsize)
     else
     {
         PHYSFS_uint8 *newbuf;
+        MemoryScope scope;
+        memoryScopeEnter(&scope, DIRHANDLE_MEMORY(fh->dirHandle), PHYSFS_MEMORY_BUFFER);
         newbuf = (PHYSFS_uint8 *) allocator.Realloc(fh->buffer, bufsize);
-        BAIL_IF(!newbuf, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        memoryScopeLeave(&scope);
+        if (!newbuf)
+        {
+            if (bufsize > charged)
+                __PHYSFS_memoryRelease(bufsize - charged);
+            BAIL(PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        } /* if */
         fh->buffer = newbuf;
     } /* else */
 
+    if (bufsize < charged)
+        __PHYSFS_memoryRelease(charged - bufsize);
+
     fh->bufsize = bufsize;
     fh->buffill = fh->bufpos = 0;
     return 1;
@@ -7944,18 +12562,490 @@ int PHYSFS_flush(PHYSFS_File *handle)
     BAIL_IF_ERRPASS(rc <= 0, 0);
     fh->bufpos = fh->buffill = 0;
     return 1;
-} /* PHYSFS_flush */
+} /* PHYSFS_flush */
+
+
+/* PHYSFS_Io implementation that reads ahead of its reader on a thread... */
+
+#define STREAM_CHUNKS 4
+
+typedef struct __PHYSFS_StreamChunk
+{
+    PHYSFS_uint8 *data;
+    PHYSFS_sint64 len;  /* bytes in data; 0 at EOF, -1 if the read failed. */
+    PHYSFS_ErrorCode err;  /* why len is -1; the thread can't tell us. */
+} StreamChunk;
+
+typedef struct __PHYSFS_StreamIoInfo
+{
+    PHYSFS_Io *parent;  /* only the thread touches it while it's running. */
+    PHYSFS_uint8 *buffer;  /* all the chunks' data. */
+    size_t bufsize;  /* what buffer counts against the memory budget. */
+    StreamChunk chunks[STREAM_CHUNKS];
+    size_t chunksize;
+    PHYSFS_uint64 len;  /* parent->length(), so we needn't ask mid-read. */
+    void *thread;  /* NULL if stopped; starts on the next read. */
+    void *empty;  /* semaphore: chunks the thread may fill. */
+    void *full;  /* semaphore: chunks the reader may use. */
+    int cancel;  /* non-zero to make the thread quit. */
+    PHYSFS_uint32 fillidx;  /* next chunk the thread fills. */
+    PHYSFS_uint32 useidx;  /* next chunk the reader takes, or holds. */
+    int holding;  /* non-zero if the reader is using chunks[useidx]. */
+    size_t chunkpos;  /* reader's position in chunks[useidx]. */
+    PHYSFS_uint64 pos;  /* reader's position in the file. */
+    int ended;  /* reader saw EOF or an error; thread has quit. */
+} StreamIoInfo;
+
+static void streamThread(void *data)
+{
+    StreamIoInfo *info = (StreamIoInfo *) data;
+    PHYSFS_Io *parent = info->parent;
+
+    while (1)
+    {
+        StreamChunk *chunk;
+        if (!__PHYSFS_platformWaitSemaphore(info->empty))
+            break;  /* the reader will block, but this doesn't happen. */
+        else if (*((volatile int *) &info->cancel))
+            break;
+
+        chunk = &info->chunks[info->fillidx];
+        info->fillidx = (info->fillidx + 1) % STREAM_CHUNKS;
+        chunk->len = parent->read(parent, chunk->data, info->chunksize);
+        if (chunk->len < 0)
+            chunk->err = PHYSFS_getLastErrorCode();
+        __PHYSFS_platformPostSemaphore(info->full);
+
+        if (chunk->len <= 0)
+            break;  /* nothing more to read until the reader seeks. */
+    } /* while */
+
+    __PHYSFS_freeThreadErrorState();
+} /* streamThread */
+
+static void streamStop(StreamIoInfo *info)
+{
+    if (info->thread == NULL)
+        return;
+
+    /* it takes a chunk before checking, so give it one. */
+    __PHYSFS_ATOMIC_INCR(&info->cancel);
+    __PHYSFS_platformPostSemaphore(info->empty);
+    __PHYSFS_platformWaitThread(info->thread);
+    __PHYSFS_platformDestroySemaphore(info->empty);
+    __PHYSFS_platformDestroySemaphore(info->full);
+    info->thread = info->empty = info->full = NULL;
+    info->holding = 0;
+} /* streamStop */
+
+/* the parent isn't where we are anymore; fail reads until a seek works. */
+static void streamFail(StreamIoInfo *info)
+{
+    StreamChunk *chunk = &info->chunks[info->useidx];
+    chunk->len = -1;
+    chunk->err = PHYSFS_getLastErrorCode();
+    info->holding = 0;
+    info->ended = 1;
+} /* streamFail */
+
+static int streamStart(StreamIoInfo *info)
+{
+    info->empty = __PHYSFS_platformCreateSemaphore(STREAM_CHUNKS);
+    GOTO_IF_ERRPASS(!info->empty, streamStart_failed);
+    info->full = __PHYSFS_platformCreateSemaphore(0);
+    GOTO_IF_ERRPASS(!info->full, streamStart_failed);
+
+    info->cancel = 0;
+    info->fillidx = info->useidx = 0;
+    info->holding = 0;
+    info->ended = 0;
+    info->thread = __PHYSFS_platformCreateThread(streamThread, info);
+    GOTO_IF_ERRPASS(!info->thread, streamStart_failed);
+    return 1;
+
+streamStart_failed:
+    if (info->empty)
+        __PHYSFS_platformDestroySemaphore(info->empty);
+    if (info->full)
+        __PHYSFS_platformDestroySemaphore(info->full);
+    info->empty = info->full = NULL;
+    return 0;
+} /* streamStart */
+
+static PHYSFS_sint64 streamIo_read(PHYSFS_Io *io, void *_buf, PHYSFS_uint64 len)
+{
+    StreamIoInfo *info = (StreamIoInfo *) io->opaque;
+    PHYSFS_uint8 *buf = (PHYSFS_uint8 *) _buf;
+    PHYSFS_sint64 retval = 0;
+
+    while (len > 0)
+    {
+        StreamChunk *chunk = &info->chunks[info->useidx];
+        size_t cpy;
+
+        if (info->holding && (chunk->len <= 0))
+            break;  /* EOF or an error; the thread's done. */
+
+        else if (info->holding && (info->chunkpos == (size_t) chunk->len))
+        {
+            /* used it up; hand it back to be filled again. */
+            info->holding = 0;
+            info->useidx = (info->useidx + 1) % STREAM_CHUNKS;
+            __PHYSFS_platformPostSemaphore(info->empty);
+            continue;
+        } /* if */
+
+        else if (!info->holding)
+        {
+            if (info->ended)
+                break;
+            else if (!info->thread)  /* seeked since the last read? */
+                BAIL_IF_ERRPASS(!streamStart(info), retval ? retval : -1);
+            BAIL_IF(!__PHYSFS_platformWaitSemaphore(info->full),
+                    PHYSFS_ERR_OS_ERROR, retval ? retval : -1);
+
+            chunk = &info->chunks[info->useidx];  /* starting resets it. */
+            info->holding = 1;
+            info->chunkpos = 0;
+            if (chunk->len <= 0)  /* the thread has quit, keep the chunk. */
+            {
+                info->ended = 1;
+                break;
+            } /* if */
+        } /* else if */
+
+        cpy = (size_t) chunk->len - info->chunkpos;
+        if (cpy > len)
+            cpy = (size_t) len;
+        memcpy(buf, chunk->data + info->chunkpos, cpy);
+        info->chunkpos += cpy;
+        info->pos += cpy;
+        buf += cpy;
+        len -= cpy;
+        retval += (PHYSFS_sint64) cpy;
+    } /* while */
+
+    /* report a failure now, unless we've got something to return first. */
+    if ((retval == 0) && info->ended && (info->chunks[info->useidx].len < 0))
+        BAIL(info->chunks[info->useidx].err, -1);
+
+    return retval;
+} /* streamIo_read */
+
+static PHYSFS_sint64 streamIo_write(PHYSFS_Io *io, const void *buffer,
+                                    PHYSFS_uint64 len)
+{
+    BAIL(PHYSFS_ERR_OPEN_FOR_READING, -1);
+} /* streamIo_write */
+
+static int streamIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
+{
+    StreamIoInfo *info = (StreamIoInfo *) io->opaque;
+
+    BAIL_IF(offset > info->len, PHYSFS_ERR_PAST_EOF, 0);
+
+    /* still inside the chunk we're reading? Just move around in it. */
+    if ((info->holding) && (info->chunks[info->useidx].len > 0))
+    {
+        const PHYSFS_uint64 start = info->pos - info->chunkpos;
+        const PHYSFS_uint64 end = start + info->chunks[info->useidx].len;
+        if ((offset >= start) && (offset <= end))
+        {
+            info->chunkpos = (size_t) (offset - start);
+            info->pos = offset;
+            return 1;
+        } /* if */
+    } /* if */
+
+    streamStop(info);
+    if (!info->parent->seek(info->parent, offset))
+    {
+        streamFail(info);
+        return 0;
+    } /* if */
+
+    info->ended = 0;
+    info->pos = offset;
+    return 1;
+} /* streamIo_seek */
+
+static PHYSFS_sint64 streamIo_tell(PHYSFS_Io *io)
+{
+    return (PHYSFS_sint64) ((StreamIoInfo *) io->opaque)->pos;
+} /* streamIo_tell */
+
+static PHYSFS_sint64 streamIo_length(PHYSFS_Io *io)
+{
+    return (PHYSFS_sint64) ((StreamIoInfo *) io->opaque)->len;
+} /* streamIo_length */
+
+static PHYSFS_Io *streamIo_duplicate(PHYSFS_Io *io)
+{
+    /* the thread's using the parent, and we don't know if that's safe. */
+    StreamIoInfo *info = (StreamIoInfo *) io->opaque;
+    PHYSFS_Io *retval;
+    streamStop(info);
+    retval = info->parent->duplicate(info->parent);
+    BAIL_IF_ERRPASS(!retval, NULL);
+    if (!info->parent->seek(info->parent, info->pos))
+        streamFail(info);  /* unlikely, but don't read from the wrong spot. */
+    return retval;
+} /* streamIo_duplicate */
+
+static int streamIo_flush(PHYSFS_Io *io)
+{
+    return 1;  /* it's read-only. */
+} /* streamIo_flush */
+
+/* stop the thread and free everything but the parent. */
+static PHYSFS_Io *streamIoUnwrap(PHYSFS_Io *io)
+{
+    StreamIoInfo *info = (StreamIoInfo *) io->opaque;
+    PHYSFS_Io *parent = info->parent;
+    streamStop(info);
+    __PHYSFS_memoryRelease(info->bufsize);
+    allocator.Free(info->buffer);
+    allocator.Free(info);
+    allocator.Free(io);
+    return parent;
+} /* streamIoUnwrap */
+
+static void streamIo_destroy(PHYSFS_Io *io)
+{
+    PHYSFS_Io *parent = streamIoUnwrap(io);
+    parent->destroy(parent);
+} /* streamIo_destroy */
+
+static const PHYSFS_Io __PHYSFS_streamIoInterface =
+{
+    CURRENT_PHYSFS_IO_API_VERSION, NULL,
+    streamIo_read,
+    streamIo_write,
+    streamIo_seek,
+    streamIo_tell,
+    streamIo_length,
+    streamIo_duplicate,
+    streamIo_flush,
+    streamIo_destroy,
+    NULL,
+    NULL
+};
+
+static PHYSFS_Io *createStreamIo(PHYSFS_Io *parent, const size_t bufsize)
+{
+    PHYSFS_Io *io = NULL;
+    StreamIoInfo *info = NULL;
+    PHYSFS_sint64 len;
+    PHYSFS_sint64 pos;
+    int i;
+
+    len = parent->length(parent);
+    BAIL_IF_ERRPASS(len < 0, NULL);
+    pos = parent->tell(parent);
+    BAIL_IF_ERRPASS(pos < 0, NULL);
+
+    io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
+    GOTO_IF(!io, PHYSFS_ERR_OUT_OF_MEMORY, createStreamIo_failed);
+    info = (StreamIoInfo *) allocator.Malloc(sizeof (StreamIoInfo));
+    GOTO_IF(!info, PHYSFS_ERR_OUT_OF_MEMORY, createStreamIo_failed);
+    memset(info, '\0', sizeof (StreamIoInfo));
+    GOTO_IF_ERRPASS(!__PHYSFS_memoryReserve(bufsize, 1), createStreamIo_failed);
+    info->bufsize = bufsize;
+    info->buffer = (PHYSFS_uint8 *) allocator.Malloc(bufsize);
+    GOTO_IF(!info->buffer, PHYSFS_ERR_OUT_OF_MEMORY, createStreamIo_failed);
+
+    info->parent = parent;
+    info->chunksize = bufsize / STREAM_CHUNKS;
+    for (i = 0; i < STREAM_CHUNKS; i++)
+        info->chunks[i].data = info->buffer + (i * info->chunksize);
+    info->len = (PHYSFS_uint64) len;
+    info->pos = (PHYSFS_uint64) pos;
+
+    /* start reading now, so there's something ready by the first read. */
+    GOTO_IF_ERRPASS(!streamStart(info), createStreamIo_failed);
+
+    memcpy(io, &__PHYSFS_streamIoInterface, sizeof (*io));
+    io->opaque = info;
+    return io;
+
+createStreamIo_failed:
+    if (info != NULL)
+    {
+        __PHYSFS_memoryRelease(info->bufsize);
+        if (info->buffer != NULL)
+            allocator.Free(info->buffer);
+        allocator.Free(info);
+    } /* if */
+    if (io != NULL)
+        allocator.Free(io);
+    return NULL;
+} /* createStreamIo */
+
+
+int PHYSFS_setStreaming(PHYSFS_File *handle, PHYSFS_uint64 _bufsize)
+{
+    FileHandle *fh = (FileHandle *) handle;
+    const size_t bufsize = (size_t) _bufsize;
+    MemoryScope scope;
+    PHYSFS_Io *io;
+
+    BAIL_IF(!fh, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF(!fh->forReading, PHYSFS_ERR_OPEN_FOR_WRITING, 0);
+    BAIL_IF(!__PHYSFS_ui64FitsAddressSpace(_bufsize), PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF((bufsize != 0) && (bufsize < STREAM_CHUNKS), PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    /* already streaming? Put the parent back where we are, and go from there. */
+    if (fh->io->read == streamIo_read)
+    {
+        StreamIoInfo *info = (StreamIoInfo *) fh->io->opaque;
+        streamStop(info);
+        BAIL_IF_ERRPASS(!info->parent->seek(info->parent, info->pos), 0);
+        fh->io = streamIoUnwrap(fh->io);
+    } /* if */
+
+    if (bufsize == 0)
+        return 1;
+
+    memoryScopeEnter(&scope, DIRHANDLE_MEMORY(fh->dirHandle), PHYSFS_MEMORY_BUFFER);
+    io = createStreamIo(fh->io, bufsize);
+    memoryScopeLeave(&scope);
+    BAIL_IF_ERRPASS(!io, 0);
+    fh->io = io;
+    return 1;
+} /* PHYSFS_setStreaming */
+
+
+int PHYSFS_setDecodeThreads(PHYSFS_File *handle, PHYSFS_uint32 threads)
+{
+    FileHandle *fh = (FileHandle *) handle;
+    PHYSFS_Io *io;
+#if PHYSFS_SUPPORTS_ZIP
+    MemoryScope scope;
+#endif
+
+    BAIL_IF(!fh, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF(!fh->forReading, PHYSFS_ERR_OPEN_FOR_WRITING, 0);
+
+    io = fh->io;
+    if (io->read == streamIo_read)  /* its thread is using the parent. */
+    {
+        StreamIoInfo *info = (StreamIoInfo *) io->opaque;
+        streamStop(info);
+        if (!info->parent->seek(info->parent, info->pos))
+            streamFail(info);
+        io = info->parent;
+    } /* if */
+
+#if PHYSFS_SUPPORTS_ZIP
+    memoryScopeEnter(&scope, DIRHANDLE_MEMORY(fh->dirHandle), PHYSFS_MEMORY_DECODE);
+    ZIP_setDecodeThreads(io, threads);  /* everything else ignores it. */
+    memoryScopeLeave(&scope);
+#else
+    (void) threads;
+#endif
+    return 1;
+} /* PHYSFS_setDecodeThreads */
+
+
+int PHYSFS_setIoScheduler(const char *archive, int enable,
+                          PHYSFS_uint64 backgroundBytesPerSecond)
+{
+    NativeIoInfo *info;
+    IoScheduler *sched;
+    DirHandle *i;
+
+    BAIL_IF(!archive, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+
+    grabStateLock(OTHER);
+    for (i = searchPath; i != NULL; i = i->next)
+    {
+        if (strcmp(i->dirName, archive) == 0)
+            break;
+    } /* for */
+
+    BAIL_IF_MUTEX(!i, PHYSFS_ERR_NOT_MOUNTED, stateLock, 0);
+    BAIL_IF_MUTEX((i->io == NULL) || (i->io->read != nativeIo_read) ||
+                  !__PHYSFS_ioHasReadAt(i->io),
+                  PHYSFS_ERR_UNSUPPORTED, stateLock, 0);
+
+    /* readers look at this without stateLock, so it never goes away. */
+    info = (NativeIoInfo *) i->io->opaque;
+    if ((info->sched == NULL) && (enable))
+    {
+        info->sched = ioSchedCreate();
+        BAIL_IF_MUTEX_ERRPASS(!info->sched, stateLock, 0);
+    } /* if */
+
+    sched = info->sched;
+    if (sched != NULL)
+    {
+        __PHYSFS_platformGrabMutex(sched->lock);
+        sched->throttle = backgroundBytesPerSecond;
+        sched->backgroundReady = 0;
+        sched->enabled = enable ? 1 : 0;
+        __PHYSFS_platformReleaseMutex(sched->lock);
+    } /* if */
+
+    __PHYSFS_releaseMutex(stateLock);
+    return 1;
+} /* PHYSFS_setIoScheduler */
+
+
+int PHYSFS_setIoPriority(PHYSFS_File *handle, PHYSFS_IoPriority priority,
+                         PHYSFS_uint32 deadline)
+{
+    FileHandle *fh = (FileHandle *) handle;
+    PHYSFS_Io *io;
+    PHYSFS_Io *raw;
+
+    BAIL_IF(!fh, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF(!fh->forReading, PHYSFS_ERR_OPEN_FOR_WRITING, 0);
+    BAIL_IF((priority != PHYSFS_IOPRIO_BACKGROUND) &&
+            (priority != PHYSFS_IOPRIO_NORMAL) &&
+            (priority != PHYSFS_IOPRIO_URGENT),
+            PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    io = fh->io;
+    if (io->read == streamIo_read)  /* its thread reads through the parent. */
+        io = ((StreamIoInfo *) io->opaque)->parent;
+
+    raw = UNPK_rawIo(io);
+#if PHYSFS_SUPPORTS_ZIP
+    if (raw == NULL)
+        raw = ZIP_rawIo(io);
+#endif
+
+    /* only readers of an archive can be scheduled; the rest ignore this. */
+    if ((raw != NULL) && (raw->read == readerIo_read))
+    {
+        ReaderIoInfo *info = (ReaderIoInfo *) raw->opaque;
+        info->priority = priority;
+        info->deadline = deadline;
+    } /* if */
+
+    return 1;
+} /* PHYSFS_setIoPriority */
 
 
-int PHYSFS_stat(const char *_fname, PHYSFS_Stat *stat)
+/* ends (trace) before unpinning, while the archive's name is still there. */
+static int doStat(const char *_fname, PHYSFS_Stat *stat,
+                  PHYSFS_TraceEvent *trace)
 {
+    const char *archive = NULL;
     int retval = 0;
+    const SearchPathSnapshot *sp;
+    volatile int *pin;
     char *allocated_fname;
     char *fname;
     size_t len;
 
-    BAIL_IF(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF(!stat, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    if ((!_fname) || (!stat))
+    {
+        PHYSFS_setErrorCode(PHYSFS_ERR_INVALID_ARGUMENT);
+        TRACE_END(*trace, NULL, 0);
+        return 0;
+    } /* if */
 
     /* set some sane defaults... */
     stat->filesize = -1;
@@ -7965,50 +13055,184 @@ int PHYSFS_stat(const char *_fname, PHYSFS_Stat *stat)
     stat->filetype = PHYSFS_FILETYPE_OTHER;
     stat->readonly = 1;
 
-    __PHYSFS_platformGrabMutex(stateLock);
-    len = strlen(_fname) + longest_root + 1;
+    sp = pinSearchPath(&pin);
+    len = strlen(_fname) + sp->longestRoot + 1;
     allocated_fname = (char *) __PHYSFS_smallAlloc(len);
-    BAIL_IF_MUTEX(!allocated_fname, PHYSFS_ERR_OUT_OF_MEMORY, stateLock, 0);
-    fname = allocated_fname + longest_root;
+    if (!allocated_fname)
+    {
+        unpinSearchPath(pin);
+        PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
+        TRACE_END(*trace, NULL, 0);
+        return 0;
+    } /* if */
+    fname = allocated_fname + sp->longestRoot;
 
     if (sanitizePlatformIndependentPath(_fname, fname))
     {
         if (*fname == '\0')
         {
             stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
+            grabStateLock(STAT);
             stat->readonly = !writeDir; /* Writeable if we have a writeDir */
+            __PHYSFS_releaseMutex(stateLock);
             retval = 1;
         } /* if */
         else
         {
-            DirHandle *i;
+            PHYSFS_uint32 i;
             int exists = 0;
-            for (i = searchPath; ((i != NULL) && (!exists)); i = i->next)
+            for (i = 0; ((i < sp->count) && (!exists)); i++)
             {
+                const SearchPathEntry *entry = &sp->entries[i];
                 char *arcfname = fname;
-                exists = partOfMountPoint(i, arcfname);
+                exists = partOfMountPoint(entry, arcfname);
                 if (exists)
                 {
                     stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
                     stat->readonly = 1;
                     retval = 1;
                 } /* if */
-                else if (verifyPath(i, &arcfname, 0))
+                else if (verifyPath(entry, &arcfname, 0))
                 {
-                    retval = i->funcs->stat(i->opaque, arcfname, stat);
+                    retval = dirHandleStat(entry->dirHandle, arcfname, stat);
                     if ((retval) || (currentErrorCode() != PHYSFS_ERR_NOT_FOUND))
                         exists = 1;
                 } /* else if */
+
+                if (exists)
+                    archive = entry->dirHandle->dirName;
             } /* for */
         } /* else */
     } /* if */
 
-    __PHYSFS_platformReleaseMutex(stateLock);
+    TRACE_END(*trace, archive, retval);
+    (void) archive;  /* only traced builds look at it. */
+    unpinSearchPath(pin);
     __PHYSFS_smallFree(allocated_fname);
     return retval;
+} /* doStat */
+
+
+int PHYSFS_stat(const char *fname, PHYSFS_Stat *stat)
+{
+    PHYSFS_TraceEvent trace;
+    TRACE_BEGIN(trace, PHYSFS_TRACE_STAT, fname, NULL, 0);
+    return doStat(fname, stat, &trace);
 } /* PHYSFS_stat */
 
 
+/* this ends (trace) before unpinning, while the archive's name is still
+ *  there. */
+static int doStatPhysical(const char *_fname, PHYSFS_PhysicalStat *stat,
+                          PHYSFS_TraceEvent *trace)
+{
+    const char *archive = NULL;
+    int retval = 0;
+    const SearchPathSnapshot *sp;
+    volatile int *pin;
+    char *allocated_fname;
+    char *fname;
+    size_t len;
+
+    if ((!_fname) || (!stat))
+    {
+        PHYSFS_setErrorCode(PHYSFS_ERR_INVALID_ARGUMENT);
+        TRACE_END(*trace, NULL, 0);
+        return 0;
+    } /* if */
+    memset(stat, '\0', sizeof (*stat));
+
+    grabStateLock(STAT);
+    sp = pinSearchPath(&pin);
+    len = strlen(_fname) + sp->longestRoot + 1;
+    allocated_fname = (char *) __PHYSFS_smallAlloc(len);
+    if (!allocated_fname)
+    {
+        unpinSearchPath(pin);
+        __PHYSFS_releaseMutex(stateLock);
+        PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
+        TRACE_END(*trace, NULL, 0);
+        return 0;
+    } /* if */
+    fname = allocated_fname + sp->longestRoot;
+
+    if (sanitizePlatformIndependentPath(_fname, fname))
+    {
+        PHYSFS_ErrorCode err = PHYSFS_ERR_NOT_FOUND;
+        PHYSFS_uint32 idx;
+        for (idx = 0; idx < sp->count; idx++)
+        {
+            const SearchPathEntry *entry = &sp->entries[idx];
+            DirHandle *i = entry->dirHandle;
+            const PHYSFS_Archiver *funcs = i->funcs;
+            char *arcfname = fname;
+            PHYSFS_Io *io = NULL;
+            PHYSFS_Stat statbuf;
+
+            if ((*fname == '\0') || (partOfMountPoint(entry, arcfname)))
+            {
+                err = PHYSFS_ERR_NOT_A_FILE;
+                break;
+            } /* if */
+            else if (!verifyPath(entry, &arcfname, 0))
+                continue;
+            else if (!funcs->stat(i->opaque, arcfname, &statbuf))
+            {
+                if ((err = currentErrorCode()) == PHYSFS_ERR_NOT_FOUND)
+                    continue;
+                break;
+            } /* else if */
+
+            archive = i->dirName;
+            if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
+                err = PHYSFS_ERR_NOT_A_FILE;
+            else if (funcs->openRead == UNPK_openRead)
+                retval = UNPK_statPhysical(i->opaque, arcfname, &io, stat);
+#if PHYSFS_SUPPORTS_ZIP
+            else if (funcs->openRead == __PHYSFS_Archiver_ZIP.openRead)
+                retval = ZIP_statPhysical(i->opaque, arcfname, &io, stat);
+#endif
+            else
+                err = PHYSFS_ERR_UNSUPPORTED;  /* DIR, 7z, etc. */
+
+            if (!retval)
+            {
+                if (err == PHYSFS_ERR_NOT_FOUND)  /* archiver set the error. */
+                    err = currentErrorCode();
+            } /* if */
+            else if (io->read != nativeIo_read)  /* memory, handle, app io... */
+            {
+                err = PHYSFS_ERR_UNSUPPORTED;
+                retval = 0;
+            } /* else if */
+            else
+            {
+                stat->archive = ((const NativeIoInfo *) io->opaque)->path;
+            } /* else */
+            break;
+        } /* for */
+
+        if (!retval)
+            PHYSFS_setErrorCode(err);
+    } /* if */
+
+    TRACE_END(*trace, archive, retval);
+    (void) archive;  /* only traced builds look at it. */
+    unpinSearchPath(pin);
+    __PHYSFS_releaseMutex(stateLock);
+    __PHYSFS_smallFree(allocated_fname);
+    return retval;
+} /* doStatPhysical */
+
+
+int PHYSFS_statPhysical(const char *fname, PHYSFS_PhysicalStat *stat)
+{
+    PHYSFS_TraceEvent trace;
+    TRACE_BEGIN(trace, PHYSFS_TRACE_STAT, fname, NULL, 0);
+    return doStatPhysical(fname, stat, &trace);
+} /* PHYSFS_statPhysical */
+
+
 int __PHYSFS_readAll(PHYSFS_Io *io, void *buf, const size_t _len)
 {
     const PHYSFS_uint64 len = (PHYSFS_uint64) _len;
@@ -8016,6 +13240,54 @@ int __PHYSFS_readAll(PHYSFS_Io *io, void *buf, const size_t _len)
 } /* __PHYSFS_readAll */
 
 
+PHYSFS_sint64 __PHYSFS_readAt(PHYSFS_Io *io, PHYSFS_uint64 offset,
+                              void *buf, PHYSFS_uint64 len)
+{
+    if (__PHYSFS_ioHasReadAt(io))
+        return io->readAt(io, offset, buf, len);
+    else if (!io->seek(io, offset))
+    {
+        /* readAt() gets 0 past EOF, but some i/o won't seek there at all. */
+        const PHYSFS_sint64 end = io->length(io);
+        BAIL_IF_ERRPASS((end < 0) || (offset < (PHYSFS_uint64) end), -1);
+        return 0;
+    } /* else if */
+    return io->read(io, buf, len);
+} /* __PHYSFS_readAt */
+
+
+PHYSFS_sint64 __PHYSFS_readv(PHYSFS_Io *io, const PHYSFS_IoVec *vec,
+                             PHYSFS_uint32 count)
+{
+    PHYSFS_sint64 retval = 0;
+    PHYSFS_uint32 i;
+
+    if (__PHYSFS_ioHasReadAt(io) && (io->readv != NULL))
+        return io->readv(io, vec, count);
+
+    for (i = 0; i < count; i++)
+    {
+        const PHYSFS_sint64 rc = __PHYSFS_readAt(io, vec[i].offset,
+                                                 vec[i].buf, vec[i].len);
+        if (rc < 0)
+            return (i == 0) ? -1 : retval;
+        retval += rc;
+        if (((PHYSFS_uint64) rc) != vec[i].len)
+            break;
+    } /* for */
+
+    return retval;
+} /* __PHYSFS_readv */
+
+
+int __PHYSFS_readAllAt(PHYSFS_Io *io, PHYSFS_uint64 offset,
+                       void *buf, const size_t _len)
+{
+    const PHYSFS_uint64 len = (PHYSFS_uint64) _len;
+    return ((size_t) __PHYSFS_readAt(io, offset, buf, len) == len);
+} /* __PHYSFS_readAllAt */
+
+
 void *__PHYSFS_initSmallAlloc(void *ptr, const size_t len)
 {
     void *useHeap = ((ptr == NULL) ? ((void *) 1) : ((void *) 0));
@@ -8051,9 +13323,15 @@ void __PHYSFS_smallFree(void *ptr)
 int PHYSFS_setAllocator(const PHYSFS_Allocator *a)
 {
     BAIL_IF(initialized, PHYSFS_ERR_IS_INITIALIZED, 0);
+
+    /* errors since deinit came from the allocator we're replacing. */
+    freeErrorStates();
+
     externalAllocator = (a != NULL);
     if (externalAllocator)
         memcpy(&allocator, a, sizeof (PHYSFS_Allocator));
+    else
+        setDefaultAllocator();
 
     return 1;
 } /* PHYSFS_setAllocator */
@@ -8102,6 +13380,246 @@ static void setDefaultAllocator(void)
 } /* setDefaultAllocator */
 
 
+/*
+ * A PHYSFS_Allocator2 is called through (allocator) like any other, but each
+ *  block starts with what it needs at free time. Padded like MemoryBlock.
+ */
+typedef struct SizedBlock
+{
+    PHYSFS_uint64 len;  /* what was asked of the app, header and all. */
+    int category;
+} SizedBlock;
+
+#define SIZED_BLOCK_HEADER ((sizeof (SizedBlock) + 15) & ~((size_t) 15))
+#define SIZED_BLOCK(ptr) ((SizedBlock *) (((PHYSFS_uint8 *) (ptr)) - SIZED_BLOCK_HEADER))
+#define SIZED_BLOCK_DATA(block) ((void *) (((PHYSFS_uint8 *) (block)) + SIZED_BLOCK_HEADER))
+
+static int sizedAllocatorInit(void)
+{
+    if (sizedAllocator.Init == NULL)
+        return 1;
+    return sizedAllocator.Init(sizedAllocator.opaque);
+} /* sizedAllocatorInit */
+
+
+static void sizedAllocatorDeinit(void)
+{
+    if (sizedAllocator.Deinit != NULL)
+        sizedAllocator.Deinit(sizedAllocator.opaque);
+} /* sizedAllocatorDeinit */
+
+
+static void *sizedAllocatorMalloc(PHYSFS_uint64 len)
+{
+    const int category = CURRENT_MEMORY_CATEGORY();
+    SizedBlock *block;
+
+    BAIL_IF(len > (~((PHYSFS_uint64) 0) - SIZED_BLOCK_HEADER), PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    len += SIZED_BLOCK_HEADER;
+    block = (SizedBlock *) sizedAllocator.Malloc(sizedAllocator.opaque, len,
+                                        (PHYSFS_MemoryCategory) category);
+    if (block == NULL)
+        return NULL;
+
+    block->len = len;
+    block->category = category;
+    return SIZED_BLOCK_DATA(block);
+} /* sizedAllocatorMalloc */
+
+
+static void *sizedAllocatorRealloc(void *ptr, PHYSFS_uint64 len)
+{
+    SizedBlock *block;
+
+    if (ptr == NULL)
+        return sizedAllocatorMalloc(len);
+
+    BAIL_IF(len > (~((PHYSFS_uint64) 0) - SIZED_BLOCK_HEADER), PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    len += SIZED_BLOCK_HEADER;
+    block = SIZED_BLOCK(ptr);
+    block = (SizedBlock *) sizedAllocator.Realloc(sizedAllocator.opaque, block,
+                                block->len, len,
+                                (PHYSFS_MemoryCategory) block->category);
+    if (block == NULL)
+        return NULL;  /* (ptr) is still there, as it was. */
+
+    block->len = len;
+    return SIZED_BLOCK_DATA(block);
+} /* sizedAllocatorRealloc */
+
+
+static void sizedAllocatorFree(void *ptr)
+{
+    if (ptr != NULL)
+    {
+        SizedBlock *block = SIZED_BLOCK(ptr);
+        sizedAllocator.Free(sizedAllocator.opaque, block, block->len,
+                            (PHYSFS_MemoryCategory) block->category);
+    } /* if */
+} /* sizedAllocatorFree */
+
+
+int PHYSFS_setAllocator2(const PHYSFS_Allocator2 *a)
+{
+    BAIL_IF(initialized, PHYSFS_ERR_IS_INITIALIZED, 0);
+
+    if (!externalAllocator)
+        setDefaultAllocator();  /* somewhere to keep an error until init. */
+
+    if (a != NULL)
+    {
+        BAIL_IF(a->version > CURRENT_PHYSFS_ALLOCATOR2_API_VERSION, PHYSFS_ERR_UNSUPPORTED, 0);
+        BAIL_IF(!a->Malloc || !a->Realloc || !a->Free, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    } /* if */
+
+    /* errors since deinit came from the allocator we're replacing. */
+    freeErrorStates();
+
+    externalAllocator = (a != NULL);
+    if (!externalAllocator)
+        setDefaultAllocator();
+    else
+    {
+        memcpy(&sizedAllocator, a, sizeof (PHYSFS_Allocator2));
+        allocator.Init = sizedAllocatorInit;
+        allocator.Deinit = sizedAllocatorDeinit;
+        allocator.Malloc = sizedAllocatorMalloc;
+        allocator.Realloc = sizedAllocatorRealloc;
+        allocator.Free = sizedAllocatorFree;
+    } /* else */
+
+    return 1;
+} /* PHYSFS_setAllocator2 */
+
+
+#if PHYSFS_SUPPORTS_MEMORY_STATS
+/*
+ * Each block starts with one of these, so it can be uncharged when it's
+ *  freed. The header is padded to keep the block as aligned as the app's
+ *  allocator made it.
+ */
+typedef struct MemoryBlock
+{
+    PHYSFS_uint64 len;
+    MemoryAccount *account;
+    int category;
+} MemoryBlock;
+
+#define MEMORY_BLOCK_HEADER ((sizeof (MemoryBlock) + 15) & ~((size_t) 15))
+#define MEMORY_BLOCK(ptr) ((MemoryBlock *) (((PHYSFS_uint8 *) (ptr)) - MEMORY_BLOCK_HEADER))
+#define MEMORY_BLOCK_DATA(block) ((void *) (((PHYSFS_uint8 *) (block)) + MEMORY_BLOCK_HEADER))
+
+/*
+ * (len) and (blocks) wrap around to subtract. A peak can be missed if two
+ *  threads race past it, which is fine for this.
+ */
+static void memoryCount(MemoryAccount *account, const int category,
+                        const PHYSFS_uint64 len, const PHYSFS_uint64 blocks)
+{
+    PHYSFS_uint64 total;
+    __PHYSFS_ATOMIC_ADD64(&account->bytes[category], len);
+    __PHYSFS_ATOMIC_ADD64(&account->total, len);
+    __PHYSFS_ATOMIC_ADD64(&account->blocks, blocks);
+    total = __PHYSFS_ATOMIC_LOAD(&account->total);
+    if (total > __PHYSFS_ATOMIC_LOAD(&account->peak))
+        __PHYSFS_ATOMIC_STORE(&account->peak, total);
+} /* memoryCount */
+
+
+static void *memoryCharge(MemoryBlock *block, const PHYSFS_uint64 len)
+{
+#ifdef MEMORY_THREAD_LOCAL
+    block->account = memoryAccount;
+#else
+    block->account = NULL;
+#endif
+    block->category = CURRENT_MEMORY_CATEGORY();
+    block->len = len;
+
+    memoryCount(&globalMemory, block->category, len, 1);
+    if (block->account != NULL)
+    {
+        __PHYSFS_ATOMIC_INCR(&block->account->refcount);
+        memoryCount(block->account, block->category, len, 1);
+    } /* if */
+
+    return MEMORY_BLOCK_DATA(block);
+} /* memoryCharge */
+
+
+static void *accountedMalloc(PHYSFS_uint64 len)
+{
+    MemoryBlock *block;
+    BAIL_IF(len > (~((PHYSFS_uint64) 0) - MEMORY_BLOCK_HEADER), PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    block = (MemoryBlock *) rawAllocator.Malloc(len + MEMORY_BLOCK_HEADER);
+    return block ? memoryCharge(block, len) : NULL;
+} /* accountedMalloc */
+
+
+static void *accountedRealloc(void *ptr, PHYSFS_uint64 len)
+{
+    MemoryBlock *block;
+    PHYSFS_uint64 oldlen;
+
+    if (ptr == NULL)
+        return accountedMalloc(len);
+
+    BAIL_IF(len > (~((PHYSFS_uint64) 0) - MEMORY_BLOCK_HEADER), PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    oldlen = MEMORY_BLOCK(ptr)->len;
+    block = (MemoryBlock *) rawAllocator.Realloc(MEMORY_BLOCK(ptr), len + MEMORY_BLOCK_HEADER);
+    BAIL_IF_ERRPASS(!block, NULL);  /* (ptr) is still there, as it was. */
+
+    /* it stays charged to what it was charged to first. */
+    block->len = len;
+    memoryCount(&globalMemory, block->category, len - oldlen, 0);
+    if (block->account != NULL)
+        memoryCount(block->account, block->category, len - oldlen, 0);
+
+    return MEMORY_BLOCK_DATA(block);
+} /* accountedRealloc */
+
+
+static void accountedFree(void *ptr)
+{
+    MemoryBlock *block;
+
+    if (ptr == NULL)
+        return;
+
+    block = MEMORY_BLOCK(ptr);
+    memoryCount(&globalMemory, block->category, 0 - block->len, (PHYSFS_uint64) -1);
+    if (block->account != NULL)
+    {
+        memoryCount(block->account, block->category, 0 - block->len, (PHYSFS_uint64) -1);
+        memoryAccountRelease(block->account);
+    } /* if */
+
+    rawAllocator.Free(block);
+} /* accountedFree */
+#endif
+
+
+/* Put accounting in front of the app's allocator, from init to deinit. */
+static void startMemoryAccounting(void)
+{
+#if PHYSFS_SUPPORTS_MEMORY_STATS
+    memcpy(&rawAllocator, &allocator, sizeof (PHYSFS_Allocator));
+    memset(&globalMemory, '\0', sizeof (globalMemory));
+    allocator.Malloc = accountedMalloc;
+    allocator.Realloc = accountedRealloc;
+    allocator.Free = accountedFree;
+#endif
+} /* startMemoryAccounting */
+
+
+static void stopMemoryAccounting(void)
+{
+#if PHYSFS_SUPPORTS_MEMORY_STATS
+    memcpy(&allocator, &rawAllocator, sizeof (PHYSFS_Allocator));
+#endif
+} /* stopMemoryAccounting */
+
+
 int __PHYSFS_DirTreeInit(__PHYSFS_DirTree *dt, const size_t entrylen)
 {
     static char rootpath[2] = { '/', '\0' };
@@ -8136,6 +13654,43 @@ static inline PHYSFS_uint32 hashPathName(__PHYSFS_DirTree *dt, const char *name)
 } /* hashPathName */
 
 
+/*
+ * Double the hash buckets, so chains stay short: finds don't reorder them
+ *  any more, so they can run on many threads at once. If there isn't memory
+ *  for it, the old buckets just keep getting longer chains.
+ */
+static void growHash(__PHYSFS_DirTree *dt)
+{
+    const size_t buckets = dt->hashBuckets * 2;
+    const size_t alloclen = buckets * sizeof (__PHYSFS_DirTreeEntry *);
+    __PHYSFS_DirTreeEntry **hash;
+    size_t i;
+
+    hash = (__PHYSFS_DirTreeEntry **) allocator.Malloc(alloclen);
+    if (hash == NULL)
+        return;
+    memset(hash, '\0', alloclen);
+
+    for (i = 0; i < dt->hashBuckets; i++)
+    {
+        __PHYSFS_DirTreeEntry *entry;
+        __PHYSFS_DirTreeEntry *next;
+        for (entry = dt->hash[i]; entry; entry = next)
+        {
+            const PHYSFS_uint32 hashval = __PHYSFS_hashString(entry->name,
+                                          strlen(entry->name)) % buckets;
+            next = entry->hashnext;
+            entry->hashnext = hash[hashval];
+            hash[hashval] = entry;
+        } /* for */
+    } /* for */
+
+    allocator.Free(dt->hash);
+    dt->hash = hash;
+    dt->hashBuckets = buckets;
+} /* growHash */
+
+
 /* Fill in missing parent directories. */
 static __PHYSFS_DirTreeEntry *addAncestors(__PHYSFS_DirTree *dt, char *name)
 {
@@ -8181,6 +13736,9 @@ void *__PHYSFS_DirTreeAdd(__PHYSFS_DirTree *dt, char *name, const int isdir)
         hashval = hashPathName(dt, name);
         retval->hashnext = dt->hash[hashval];
         dt->hash[hashval] = retval;
+        dt->hashEntries++;
+        if (dt->hashEntries > (dt->hashBuckets * 2))
+            growHash(dt);
         retval->sibling = parent->children;
         retval->isdir = isdir;
         parent->children = retval;
@@ -8190,11 +13748,14 @@ void *__PHYSFS_DirTreeAdd(__PHYSFS_DirTree *dt, char *name, const int isdir)
 } /* __PHYSFS_DirTreeAdd */
 
 
-/* Find the __PHYSFS_DirTreeEntry for a path in platform-independent notation. */
+/*
+ * Find the __PHYSFS_DirTreeEntry for a path in platform-independent notation.
+ *  This only reads the tree, so once it's built, any number of threads can
+ *  call it at once without a lock.
+ */
 void *__PHYSFS_DirTreeFind(__PHYSFS_DirTree *dt, const char *path)
 {
     PHYSFS_uint32 hashval;
-    __PHYSFS_DirTreeEntry *prev = NULL;
     __PHYSFS_DirTreeEntry *retval;
 
     if (*path == '\0')
@@ -8204,18 +13765,7 @@ void *__PHYSFS_DirTreeFind(__PHYSFS_DirTree *dt, const char *path)
     for (retval = dt->hash[hashval]; retval; retval = retval->hashnext)
     {
         if (strcmp(retval->name, path) == 0)
-        {
-            if (prev != NULL)  /* move this to the front of the list */
-            {
-                prev->hashnext = retval->hashnext;
-                retval->hashnext = dt->hash[hashval];
-                dt->hash[hashval] = retval;
-            } /* if */
-
             return retval;
-        } /* if */
-
-        prev = retval;
     } /* for */
 
     BAIL(PHYSFS_ERR_NOT_FOUND, NULL);
@@ -17857,6 +23407,17 @@ failed:
 } /* SZIP_openArchive */
 
 
+/* a file's data counts against the memory budget until its io is gone. */
+#define SZIP_BUFFER_HEADER 16
+
+static void SZIP_freeBuffer(void *data)
+{
+    PHYSFS_uint8 *ptr = ((PHYSFS_uint8 *) data) - SZIP_BUFFER_HEADER;
+    __PHYSFS_memoryRelease(*((PHYSFS_uint64 *) ptr));
+    allocator.Free(ptr);
+} /* SZIP_freeBuffer */
+
+
 static PHYSFS_Io *SZIP_openRead(void *opaque, const char *path)
 {
     /* !!! FIXME: the current lzma sdk C API only allows you to decompress
@@ -17874,36 +23435,60 @@ static PHYSFS_Io *SZIP_openRead(void *opaque, const char *path)
     size_t outBufferSize = 0;
     size_t offset = 0;
     size_t outSizeProcessed = 0;
-    void *buf = NULL;
+    PHYSFS_uint8 *buf = NULL;
+    PHYSFS_uint64 blockSize = 0;
+    PHYSFS_uint64 fileSize;
+    UInt32 folderIndex;
+    int category;
     SRes rc;
 
     BAIL_IF_ERRPASS(!entry, NULL);
     BAIL_IF(entry->tree.isdir, PHYSFS_ERR_NOT_A_FILE, NULL);
 
-    io = info->io->duplicate(info->io);
+    /*
+     * Decoding needs the whole solid block, then a copy of the file, so if
+     *  those won't fit the memory budget, don't spend the time decoding.
+     */
+    folderIndex = info->db.FileToFolder[entry->dbidx];
+    if (folderIndex != (UInt32) -1)
+        blockSize = SzAr_GetFolderUnpackSize(&info->db.db, folderIndex);
+    fileSize = SzArEx_GetFileSize(&info->db, entry->dbidx);
+    BAIL_IF_ERRPASS(!__PHYSFS_memoryReserve(blockSize + fileSize, 1), NULL);
+
+    io = __PHYSFS_duplicateForRead(info->io);
     GOTO_IF_ERRPASS(!io, SZIP_openRead_failed);
 
     szipInitStream(&stream, io);
 
+    /* the decoder and its output, the whole solid block, are transient. */
+    category = __PHYSFS_setMemoryCategory(PHYSFS_MEMORY_DECODE);
     rc = SzArEx_Extract(&info->db, &stream.lookStream.s, entry->dbidx,
                         &blockIndex, &outBuffer, &outBufferSize, &offset,
                         &outSizeProcessed, alloc, alloc);
+    __PHYSFS_setMemoryCategory(category);
     GOTO_IF(rc != SZ_OK, szipErrorCode(rc), SZIP_openRead_failed);
     GOTO_IF(outBuffer == NULL, PHYSFS_ERR_OUT_OF_MEMORY, SZIP_openRead_failed);
 
+    /* the whole solid block was decoded, not just this file. */
+    __PHYSFS_STAT_ADD(__PHYSFS_getIoStats(io), bytesDecompressed, outBufferSize);
+
     io->destroy(io);
     io = NULL;
 
-    buf = allocator.Malloc(outSizeProcessed ? outSizeProcessed : 1);
+    buf = (PHYSFS_uint8 *) allocator.Malloc(SZIP_BUFFER_HEADER + outSizeProcessed);
     GOTO_IF(buf == NULL, PHYSFS_ERR_OUT_OF_MEMORY, SZIP_openRead_failed);
+    *((PHYSFS_uint64 *) buf) = fileSize;
 
     if (outSizeProcessed > 0)
-        memcpy(buf, outBuffer + offset, outSizeProcessed);
+        memcpy(buf + SZIP_BUFFER_HEADER, outBuffer + offset, outSizeProcessed);
 
     alloc->Free(alloc, outBuffer);
     outBuffer = NULL;
+    __PHYSFS_memoryRelease(blockSize);
+    blockSize = 0;
 
-    retval = __PHYSFS_createMemoryIo(buf, outSizeProcessed, allocator.Free);
+    retval = __PHYSFS_createMemoryIo(buf + SZIP_BUFFER_HEADER,
+                                     outSizeProcessed, SZIP_freeBuffer);
     GOTO_IF_ERRPASS(!retval, SZIP_openRead_failed);
 
     return retval;
@@ -17918,6 +23503,7 @@ SZIP_openRead_failed:
     if (outBuffer)
         alloc->Free(alloc, outBuffer);
 
+    __PHYSFS_memoryRelease(blockSize + fileSize);
     return NULL;
 } /* SZIP_openRead */
 
@@ -18720,6 +24306,10 @@ static int iso9660LoadEntries(PHYSFS_Io *io, const int joliet,
         t.tm_isdst = -1;
         timestamp = (PHYSFS_sint64) mktime(&t);
 
+        /* "." and ".." point back at this directory and its parent. */
+        if ((fnamelen == 1) && ((fname[0] == 0) || (fname[0] == 1)))
+            continue;
+
         extent += extattrlen;  /* skip extended attribute record. */
 
         /* infinite loop, corrupt file? */
@@ -19303,7 +24893,7 @@ typedef struct
 {
     PHYSFS_Io *io;
     UNPKentry *entry;
-    PHYSFS_uint32 curPos;
+    PHYSFS_uint64 curPos;
 } UNPKfileinfo;
 
 
@@ -19335,7 +24925,7 @@ static PHYSFS_sint64 UNPK_read(PHYSFS_Io *io, void *buffer, PHYSFS_uint64 len)
 {
     UNPKfileinfo *finfo = (UNPKfileinfo *) io->opaque;
     const UNPKentry *entry = finfo->entry;
-    const PHYSFS_uint64 bytesLeft = (PHYSFS_uint64)(entry->size-finfo->curPos);
+    const PHYSFS_uint64 bytesLeft = entry->size - finfo->curPos;
     PHYSFS_sint64 rc;
 
     if (bytesLeft < len)
@@ -19343,7 +24933,7 @@ static PHYSFS_sint64 UNPK_read(PHYSFS_Io *io, void *buffer, PHYSFS_uint64 len)
 
     rc = finfo->io->read(finfo->io, buffer, len);
     if (rc > 0)
-        finfo->curPos += (PHYSFS_uint32) rc;
+        finfo->curPos += (PHYSFS_uint64) rc;
 
     return rc;
 } /* UNPK_read */
@@ -19367,10 +24957,10 @@ static int UNPK_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
     const UNPKentry *entry = finfo->entry;
     int rc;
 
-    BAIL_IF(offset >= entry->size, PHYSFS_ERR_PAST_EOF, 0);
+    BAIL_IF(offset > entry->size, PHYSFS_ERR_PAST_EOF, 0);
     rc = finfo->io->seek(finfo->io, entry->startPos + offset);
     if (rc)
-        finfo->curPos = (PHYSFS_uint32) offset;
+        finfo->curPos = offset;
 
     return rc;
 } /* UNPK_seek */
@@ -19429,7 +25019,9 @@ static const PHYSFS_Io UNPK_Io =
     UNPK_length,
     UNPK_duplicate,
     UNPK_flush,
-    UNPK_destroy
+    UNPK_destroy,
+    NULL,
+    NULL
 };
 
 
@@ -19439,6 +25031,50 @@ static inline UNPKentry *findEntry(UNPKinfo *info, const char *path)
 } /* findEntry */
 
 
+int UNPK_statPhysical(void *opaque, const char *name, PHYSFS_Io **_io,
+                      PHYSFS_PhysicalStat *stat)
+{
+    UNPKinfo *info = (UNPKinfo *) opaque;
+    const UNPKentry *entry = findEntry(info, name);
+
+    BAIL_IF_ERRPASS(!entry, 0);
+    BAIL_IF(entry->tree.isdir, PHYSFS_ERR_NOT_A_FILE, 0);
+
+    *_io = info->io;
+    stat->offset = entry->startPos;
+    stat->storedsize = entry->size;
+    stat->filesize = entry->size;
+    stat->crc = 0;
+    stat->method = 0;
+    stat->hascrc = 0;
+    stat->encrypted = 0;
+    return 1;
+} /* UNPK_statPhysical */
+
+
+int UNPK_rawRange(PHYSFS_Io *io, PHYSFS_Io **_io, PHYSFS_uint64 *_pos,
+                  PHYSFS_uint64 *_avail)
+{
+    const UNPKfileinfo *finfo = (const UNPKfileinfo *) io->opaque;
+
+    if (io->read != UNPK_read)
+        return 0;
+
+    *_io = finfo->io;
+    *_pos = finfo->entry->startPos + finfo->curPos;
+    *_avail = finfo->entry->size - finfo->curPos;
+    return 1;
+} /* UNPK_rawRange */
+
+
+PHYSFS_Io *UNPK_rawIo(PHYSFS_Io *io)
+{
+    if (io->read != UNPK_read)
+        return NULL;
+    return ((UNPKfileinfo *) io->opaque)->io;
+} /* UNPK_rawIo */
+
+
 PHYSFS_Io *UNPK_openRead(void *opaque, const char *name)
 {
     PHYSFS_Io *retval = NULL;
@@ -19455,7 +25091,7 @@ PHYSFS_Io *UNPK_openRead(void *opaque, const char *name)
     finfo = (UNPKfileinfo *) allocator.Malloc(sizeof (UNPKfileinfo));
     GOTO_IF(!finfo, PHYSFS_ERR_OUT_OF_MEMORY, UNPK_openRead_failed);
 
-    finfo->io = info->io->duplicate(info->io);
+    finfo->io = __PHYSFS_duplicateForRead(info->io);
     GOTO_IF_ERRPASS(!finfo->io, UNPK_openRead_failed);
 
     if (!finfo->io->seek(finfo->io, entry->startPos))
@@ -20621,39 +26257,149 @@ typedef enum
     ZIP_BROKEN_SYMLINK
 } ZipResolveType;
 
-#if PHYSFS_HAVE_PRAGMA_VISIBILITY
-#pragma GCC visibility push(hidden)
-#endif
+#if PHYSFS_HAVE_PRAGMA_VISIBILITY
+#pragma GCC visibility push(hidden)
+#endif
+
+/*
+ * An open ZIP archive keeps its entries in one flat table of ZIPrecords,
+ *  numbered from 0 (the root), with entry numbers where a tree would have
+ *  pointers and every path in one block of names. Offsets and sizes are in
+ *  their own array, and only 64 bits wide for archives that need it (Zip64,
+ *  or over 4 gigabytes). That's less than half of what an entry cost in a
+ *  __PHYSFS_DirTree, with its own allocation, and lookups touch less memory.
+ */
+#define ZIP_NONE 0xFFFFFFFF
+
+#define ZIP_RECORD_LOADED (1 << 0)   /* central directory had it.      */
+#define ZIP_RECORD_SYMLINK (1 << 1)  /* resolved or not.               */
+
+typedef struct
+{
+    PHYSFS_uint32 name;                /* offset of its full path.       */
+    PHYSFS_uint32 hashnext;            /* entry numbers, or ZIP_NONE.    */
+    PHYSFS_uint32 children;            /* kids; a symlink's target.      */
+    PHYSFS_uint32 sibling;             /* next item in same dir.         */
+    PHYSFS_uint32 crc;                 /* crc-32                         */
+    PHYSFS_uint32 dos_mod_time;        /* original MS-DOS style mod time */
+    PHYSFS_uint16 version;             /* version made by                */
+    PHYSFS_uint16 version_needed;      /* version needed to extract      */
+    PHYSFS_uint16 general_bits;        /* general purpose bits           */
+    PHYSFS_uint16 compression_method;  /* compression method             */
+    volatile PHYSFS_uint8 resolved;    /* a ZipResolveType.              */
+    PHYSFS_uint8 flags;                /* ZIP_RECORD_*                   */
+    PHYSFS_uint16 unused;
+} ZIPrecord;
+
+/* each record has three of these in the sizes, in this order. */
+#define ZIP_SIZE_OFFSET 0
+#define ZIP_SIZE_COMPRESSED 1
+#define ZIP_SIZE_UNCOMPRESSED 2
 
 /*
- * One ZIPentry is kept for each file in an open ZIP archive.
+ * A ZIPentry is a record and its sizes at full width, copied out of the
+ *  table. Open files keep their own. A symlink's has its target's data.
  */
-typedef struct _ZIPentry
+typedef struct
 {
-    __PHYSFS_DirTreeEntry tree;         /* manages directory tree         */
-    struct _ZIPentry *symlink;          /* NULL or file we symlink to     */
-    ZipResolveType resolved;            /* Have we resolved file/symlink? */
     PHYSFS_uint64 offset;               /* offset of data in archive      */
+    PHYSFS_uint64 compressed_size;      /* compressed size                */
+    PHYSFS_uint64 uncompressed_size;    /* uncompressed size              */
+    PHYSFS_uint32 crc;                  /* crc-32                         */
+    PHYSFS_uint32 dos_mod_time;         /* the link's own, for a symlink. */
     PHYSFS_uint16 version;              /* version made by                */
     PHYSFS_uint16 version_needed;       /* version needed to extract      */
     PHYSFS_uint16 general_bits;         /* general purpose bits           */
     PHYSFS_uint16 compression_method;   /* compression method             */
-    PHYSFS_uint32 crc;                  /* crc-32                         */
-    PHYSFS_uint64 compressed_size;      /* compressed size                */
-    PHYSFS_uint64 uncompressed_size;    /* uncompressed size              */
-    PHYSFS_sint64 last_mod_time;        /* last file mod time             */
-    PHYSFS_uint32 dos_mod_time;         /* original MS-DOS style mod time */
+    ZipResolveType resolved;            /* Have we resolved file/symlink? */
+    int symlink;                        /* non-zero if it's a symlink.    */
 } ZIPentry;
 
+/*
+ * Deflated entries can have checkpoints every ZIP_CHECKPOINT_SPACING bytes
+ *  of output: a copy of inflate's state there, so decoding can pick up at
+ *  that point instead of the start of the entry. Handles that asked for
+ *  decode threads save them as they read, big reads on those handles
+ *  decode the pieces between them in parallel, and seeks on any handle
+ *  start from the nearest one. They last until the archive is closed.
+ */
+#define ZIP_CHECKPOINT_SPACING (8 * 1024 * 1024)
+#define ZIP_MAX_DECODE_THREADS 64
+
+typedef struct
+{
+    PHYSFS_uint64 compressed_position;  /* where its input picks up.      */
+    inflate_state state;                /* inflate's state at that point. */
+} ZIPcheckpoint;
+
+typedef struct _ZIPindex
+{
+    PHYSFS_uint64 offset;      /* data offset of the entry they're for.  */
+    PHYSFS_uint32 count;       /* checkpoints this entry has room for.   */
+    ZIPcheckpoint **points;    /* [k-1] is at k * spacing, or NULL.      */
+    struct _ZIPindex *next;    /* another entry's, in the same archive.  */
+} ZIPindex;
+
+/*
+ * A shared index (see PHYSFS_setIndexCache()) is a resolved archive's
+ *  table written out whole: a header, the sizes, the records, hash buckets
+ *  and then all the names, followed by the archive's path. Any process can
+ *  map the file and look things up right where it lies. It's not trusted
+ *  any more than the archive is, so numbers from it are checked before
+ *  they're used.
+ */
+#define ZIP_SHARED_MAGIC "PhysFSzi"
+#define ZIP_SHARED_VERSION 2
+#define ZIP_SHARED_SAMPLE 4096  /* central directory bytes that identify it. */
+#define ZIP_SHARED_ZIP64 (1 << 0)
+#define ZIP_SHARED_CRYPTO (1 << 1)
+#define ZIP_SHARED_WIDE (1 << 2)
+
+typedef struct
+{
+    PHYSFS_uint64 archive_size;
+    PHYSFS_sint64 archive_mtime;
+    PHYSFS_uint64 cdir_ofs;
+    PHYSFS_uint64 cdir_count;
+    PHYSFS_uint64 cdir_hash;   /* of the start of the central directory. */
+} ZIPsharedId;
+
+typedef struct
+{
+    char magic[8];             /* ZIP_SHARED_MAGIC, without the null.    */
+    PHYSFS_uint32 version;     /* ZIP_SHARED_VERSION, in our byte order. */
+    PHYSFS_uint32 entrylen;    /* sizeof (ZIPrecord).                    */
+    ZIPsharedId id;            /* the archive this was built from.       */
+    PHYSFS_uint64 names_len;   /* bytes of names, after the buckets.     */
+    PHYSFS_uint32 count;       /* records, after the sizes.              */
+    PHYSFS_uint32 buckets;     /* hash buckets, after the records.       */
+    PHYSFS_uint32 path;        /* the archive's path, in the names.      */
+    PHYSFS_uint32 flags;       /* ZIP_SHARED_ZIP64, _CRYPTO, _WIDE.      */
+} ZIPsharedHeader;
+
 /*
  * One ZIPinfo is kept for each open ZIP archive.
  */
 typedef struct
 {
-    __PHYSFS_DirTree tree;    /* manages directory tree.                */
+    ZIPrecord *records;       /* the entries; [0] is the root.          */
+    void *sizes;              /* three per record, 32 or 64 bits each.  */
+    PHYSFS_uint32 *hash;      /* first entry number in each bucket.     */
+    char *names;              /* every entry's path, null-terminated.   */
+    PHYSFS_uint32 count;      /* records in the table.                  */
+    PHYSFS_uint32 buckets;    /* hash buckets.                          */
+    PHYSFS_uint64 names_len;  /* bytes of names.                        */
+    PHYSFS_uint32 records_room;  /* while loading, what's allocated.    */
+    PHYSFS_uint64 names_room;
+    int wide;                 /* non-zero if sizes are 64 bits.         */
+    const void *map;          /* a shared index the table is in, or NULL. */
+    PHYSFS_uint64 map_len;
     PHYSFS_Io *io;            /* the i/o interface for this archive.    */
     int zip64;                /* non-zero if this is a Zip64 archive.   */
     int has_crypto;           /* non-zero if any entry uses encryption. */
+    void *index_lock;         /* guards indexes; NULL for no indexes.   */
+    ZIPindex *indexes;        /* checkpoints, for entries that have any. */
+    void *resolve_lock;       /* guards entries that aren't resolved.   */
 } ZIPinfo;
 
 /*
@@ -20661,14 +26407,17 @@ typedef struct
  */
 typedef struct
 {
-    ZIPentry *entry;                      /* Info on file.              */
+    ZIPentry entry;                       /* Info on file.              */
     PHYSFS_Io *io;                        /* physical file handle.      */
-    PHYSFS_uint32 compressed_position;    /* offset in compressed data. */
-    PHYSFS_uint32 uncompressed_position;  /* tell() position.           */
+    PHYSFS_uint64 compressed_position;    /* offset in compressed data. */
+    PHYSFS_uint64 uncompressed_position;  /* tell() position.           */
     PHYSFS_uint8 *buffer;                 /* decompression buffer.      */
     PHYSFS_uint32 crypto_keys[3];         /* for "traditional" crypto.  */
     PHYSFS_uint32 initial_crypto_keys[3]; /* for "traditional" crypto.  */
     z_stream stream;                      /* zlib stream state.         */
+    ZIPinfo *info;                        /* archive this is from.      */
+    ZIPindex *index;                      /* non-NULL to save checkpoints. */
+    PHYSFS_uint32 decode_threads;         /* for big reads.             */
 } ZIPfileinfo;
 
 #if PHYSFS_HAVE_PRAGMA_VISIBILITY
@@ -20734,7 +26483,7 @@ static PHYSFS_sint64 zip_read_decrypt(ZIPfileinfo *finfo, void *buf, PHYSFS_uint
     const PHYSFS_sint64 br = io->read(io, buf, len);
 
     /* Decompression the new data if necessary. */
-    if (zip_entry_is_tradional_crypto(finfo->entry) && (br > 0))
+    if (zip_entry_is_tradional_crypto(&finfo->entry) && (br > 0))
     {
         PHYSFS_uint32 *keys = finfo->crypto_keys;
         PHYSFS_uint8 *ptr = (PHYSFS_uint8 *) buf;
@@ -20758,7 +26507,7 @@ static int zip_prep_crypto_keys(ZIPfileinfo *finfo, const PHYSFS_uint8 *crypto_h
        That's what the (verifier) value is doing, below. */
 
     PHYSFS_uint32 *keys = finfo->crypto_keys;
-    const ZIPentry *entry = finfo->entry;
+    const ZIPentry *entry = &finfo->entry;
     const int usedate = zip_entry_ignore_local_header(entry);
     const PHYSFS_uint8 verifier = (PHYSFS_uint8) ((usedate ? (entry->dos_mod_time >> 8) : (entry->crc >> 24)) & 0xFF);
     PHYSFS_uint8 finalbyte = 0;
@@ -20794,7 +26543,10 @@ static int zip_prep_crypto_keys(ZIPfileinfo *finfo, const PHYSFS_uint8 *crypto_h
  */
 static voidpf zlibPhysfsAlloc(voidpf opaque, uInt items, uInt size)
 {
-    return ((PHYSFS_Allocator *) opaque)->Malloc(items * size);
+    const int category = __PHYSFS_setMemoryCategory(PHYSFS_MEMORY_DECODE);
+    voidpf retval = ((PHYSFS_Allocator *) opaque)->Malloc(items * size);
+    __PHYSFS_setMemoryCategory(category);
+    return retval;
 } /* zlibPhysfsAlloc */
 
 /*
@@ -20806,6 +26558,16 @@ static void zlibPhysfsFree(voidpf opaque, voidpf address)
 } /* zlibPhysfsFree */
 
 
+/* compressed input waiting for inflate() is decoder work space, too. */
+static PHYSFS_uint8 *zip_alloc_readbuf(void)
+{
+    const int category = __PHYSFS_setMemoryCategory(PHYSFS_MEMORY_DECODE);
+    PHYSFS_uint8 *retval = (PHYSFS_uint8 *) allocator.Malloc(ZIP_READBUFSIZE);
+    __PHYSFS_setMemoryCategory(category);
+    return retval;
+} /* zip_alloc_readbuf */
+
+
 /*
  * Construct a new z_stream to a sane state.
  */
@@ -20853,62 +26615,407 @@ static int readui16(PHYSFS_Io *io, PHYSFS_uint16 *val)
 } /* readui16 */
 
 
-static PHYSFS_sint64 ZIP_read(PHYSFS_Io *_io, void *buf, PHYSFS_uint64 len)
+/* find the checkpoints for (entry), and maybe make room for some. */
+static ZIPindex *zip_find_index(ZIPinfo *info, const ZIPentry *entry,
+                                const int create)
 {
-    ZIPfileinfo *finfo = (ZIPfileinfo *) _io->opaque;
-    ZIPentry *entry = finfo->entry;
-    PHYSFS_sint64 retval = 0;
-    PHYSFS_sint64 maxread = (PHYSFS_sint64) len;
-    PHYSFS_sint64 avail = entry->uncompressed_size -
-                          finfo->uncompressed_position;
+    ZIPindex *retval;
 
-    if (avail < maxread)
-        maxread = avail;
+    if (info->index_lock == NULL)
+        return NULL;
 
-    BAIL_IF_ERRPASS(maxread == 0, 0);    /* quick rejection. */
+    __PHYSFS_platformGrabMutex(info->index_lock);
+    for (retval = info->indexes; retval != NULL; retval = retval->next)
+    {
+        if (retval->offset == entry->offset)
+            break;
+    } /* for */
 
-    if (entry->compression_method == COMPMETH_NONE)
-        retval = zip_read_decrypt(finfo, buf, maxread);
-    else
+    if ((retval == NULL) && (create))
+    {
+        const PHYSFS_uint64 count = entry->uncompressed_size / ZIP_CHECKPOINT_SPACING;
+        const size_t len = (size_t) count * sizeof (ZIPcheckpoint *);
+        retval = (ZIPindex *) allocator.Malloc(sizeof (ZIPindex));
+        if (retval != NULL)
+        {
+            retval->points = (ZIPcheckpoint **) allocator.Malloc(len);
+            if (retval->points == NULL)
+            {
+                allocator.Free(retval);
+                retval = NULL;
+            } /* if */
+            else
+            {
+                memset(retval->points, '\0', len);
+                retval->offset = entry->offset;
+                retval->count = (PHYSFS_uint32) count;
+                retval->next = info->indexes;
+                info->indexes = retval;
+            } /* else */
+        } /* if */
+    } /* if */
+
+    __PHYSFS_platformReleaseMutex(info->index_lock);
+    return retval;
+} /* zip_find_index */
+
+
+/* checkpoint (k), at (k * ZIP_CHECKPOINT_SPACING), or NULL if we don't have it. */
+static const ZIPcheckpoint *zip_get_checkpoint(ZIPinfo *info,
+                                               const ZIPindex *index,
+                                               const PHYSFS_uint64 k)
+{
+    const ZIPcheckpoint *retval = NULL;
+    if ((k > 0) && (k <= index->count))
+    {
+        __PHYSFS_platformGrabMutex(info->index_lock);
+        retval = index->points[k - 1];
+        __PHYSFS_platformReleaseMutex(info->index_lock);
+    } /* if */
+    return retval;
+} /* zip_get_checkpoint */
+
+
+/* (finfo) just decoded up to checkpoint (k); save it if nobody has yet. */
+static void zip_save_checkpoint(ZIPfileinfo *finfo, const PHYSFS_uint64 k)
+{
+    ZIPindex *index = finfo->index;
+    ZIPcheckpoint *cp;
+    PHYSFS_ErrorCode err;
+
+    if (zip_get_checkpoint(finfo->info, index, k) != NULL)
+        return;
+    else if ((k == 0) || (k > index->count))
+        return;
+
+    /* not worth pushing anything else out of the memory budget for. */
+    err = PHYSFS_getLastErrorCode();
+    if (!__PHYSFS_memoryReserve(sizeof (ZIPcheckpoint), 0))
+    {
+        PHYSFS_getLastErrorCode();  /* this read is still fine... */
+        PHYSFS_setErrorCode(err);  /* ...so put back what was set before. */
+        return;
+    } /* if */
+    PHYSFS_setErrorCode(err);
+
+    cp = (ZIPcheckpoint *) allocator.Malloc(sizeof (ZIPcheckpoint));
+    if (cp == NULL)
+    {
+        __PHYSFS_memoryRelease(sizeof (ZIPcheckpoint));
+        return;  /* oh well, decoding will just start further back. */
+    } /* if */
+
+    cp->compressed_position = finfo->compressed_position - finfo->stream.avail_in;
+    memcpy(&cp->state, finfo->stream.state, sizeof (inflate_state));
+
+    __PHYSFS_platformGrabMutex(finfo->info->index_lock);
+    if (index->points[k - 1] == NULL)
+    {
+        index->points[k - 1] = cp;
+        cp = NULL;
+    } /* if */
+    __PHYSFS_platformReleaseMutex(finfo->info->index_lock);
+
+    if (cp != NULL)  /* another handle got there first. */
+    {
+        __PHYSFS_memoryRelease(sizeof (ZIPcheckpoint));
+        allocator.Free(cp);
+    } /* if */
+} /* zip_save_checkpoint */
+
+
+/* put (finfo) at checkpoint (k), as if it had decoded everything before. */
+static int zip_restore_checkpoint(ZIPfileinfo *finfo,
+                                  const ZIPcheckpoint *cp,
+                                  const PHYSFS_uint64 k)
+{
+    const PHYSFS_uint64 pos = finfo->entry.offset + cp->compressed_position;
+    BAIL_IF_ERRPASS(!finfo->io->seek(finfo->io, pos), 0);
+    memcpy(finfo->stream.state, &cp->state, sizeof (inflate_state));
+    finfo->stream.next_in = finfo->buffer;
+    finfo->stream.avail_in = 0;
+    finfo->compressed_position = cp->compressed_position;
+    finfo->uncompressed_position = k * ZIP_CHECKPOINT_SPACING;
+    return 1;
+} /* zip_restore_checkpoint */
+
+
+/* decode (maxread) bytes from where (finfo) is. Doesn't move its tell(). */
+static PHYSFS_sint64 zip_read_inflate(ZIPfileinfo *finfo, void *buf,
+                                      const PHYSFS_sint64 maxread)
+{
+    const ZIPentry *entry = &finfo->entry;
+    PHYSFS_sint64 retval = 0;
+
+    finfo->stream.next_out = (unsigned char*)buf;
+
+    while (retval < maxread)
     {
-        finfo->stream.next_out = (unsigned char*)buf;
-        finfo->stream.avail_out = (uInt) maxread;
+        /* avail_out is a uInt, so feed zlib at most 4 gigs at a time.
+           total_out is only a uLong (32 bits on Windows), so count
+           what it wrote by how much avail_out went down instead. */
+        const PHYSFS_uint64 at = finfo->uncompressed_position + retval;
+        PHYSFS_uint64 want = (PHYSFS_uint64) (maxread - retval);
+        uInt chunk;
+        int rc;
 
-        while (retval < maxread)
+        /* saving checkpoints? Stop at the next one. */
+        if (finfo->index != NULL)
         {
-            const PHYSFS_uint32 before = (PHYSFS_uint32) finfo->stream.total_out;
-            int rc;
+            const PHYSFS_uint64 next = ((at / ZIP_CHECKPOINT_SPACING) + 1) * ZIP_CHECKPOINT_SPACING;
+            if (want > next - at)
+                want = next - at;
+        } /* if */
 
-            if (finfo->stream.avail_in == 0)
-            {
-                PHYSFS_sint64 br;
+        chunk = (want > 0xFFFFFFFF) ? 0xFFFFFFFF : (uInt) want;
 
-                br = entry->compressed_size - finfo->compressed_position;
-                if (br > 0)
-                {
-                    if (br > ZIP_READBUFSIZE)
-                        br = ZIP_READBUFSIZE;
+        if (finfo->stream.avail_in == 0)
+        {
+            PHYSFS_sint64 br;
 
-                    br = zip_read_decrypt(finfo, finfo->buffer, (PHYSFS_uint64) br);
-                    if (br <= 0)
-                        break;
+            br = entry->compressed_size - finfo->compressed_position;
+            if (br > 0)
+            {
+                if (br > ZIP_READBUFSIZE)
+                    br = ZIP_READBUFSIZE;
 
-                    finfo->compressed_position += (PHYSFS_uint32) br;
-                    finfo->stream.next_in = finfo->buffer;
-                    finfo->stream.avail_in = (unsigned int) br;
-                } /* if */
+                br = zip_read_decrypt(finfo, finfo->buffer, (PHYSFS_uint64) br);
+                if (br <= 0)
+                    break;
+
+                finfo->compressed_position += (PHYSFS_uint64) br;
+                finfo->stream.next_in = finfo->buffer;
+                finfo->stream.avail_in = (unsigned int) br;
             } /* if */
+        } /* if */
+
+        finfo->stream.avail_out = chunk;
+        rc = zlib_err(inflate(&finfo->stream, Z_SYNC_FLUSH));
+        retval += (PHYSFS_sint64) (chunk - finfo->stream.avail_out);
+
+        if ((finfo->index != NULL) && (finfo->stream.avail_out == 0) &&
+            (((at + chunk) % ZIP_CHECKPOINT_SPACING) == 0))
+            zip_save_checkpoint(finfo, (at + chunk) / ZIP_CHECKPOINT_SPACING);
+
+        if (rc != Z_OK)
+            break;
+    } /* while */
+
+    return retval;
+} /* zip_read_inflate */
+
+
+/* one big read, split at checkpoints; threads take pieces as they can. */
+typedef struct
+{
+    ZIPfileinfo *finfo;
+    PHYSFS_uint8 *buf;         /* where the first piece's output goes.  */
+    const ZIPcheckpoint **points;  /* [i] starts piece (i).            */
+    int count;                 /* number of pieces.                     */
+    int next;                  /* one more than the last piece taken.   */
+    int failed;                /* non-zero if any piece didn't decode.  */
+} ZIPdecodeJob;
+
+static void zip_decode_pieces(ZIPdecodeJob *job)
+{
+    const ZIPentry *entry = &job->finfo->entry;
+    PHYSFS_Io *io = job->finfo->io;  /* has readAt(), we checked. */
+    PHYSFS_uint8 *inbuf = zip_alloc_readbuf();
+    z_stream stream;
+    int i;
+
+    initializeZStream(&stream);
+    if ((inbuf == NULL) || (inflateInit2(&stream, -MAX_WBITS) != Z_OK))
+    {
+        /* can't help; make sure somebody notices if nobody else can. */
+        if (inbuf != NULL)
+            allocator.Free(inbuf);
+        __PHYSFS_ATOMIC_INCR(&job->failed);
+        return;
+    } /* if */
 
-            rc = zlib_err(inflate(&finfo->stream, Z_SYNC_FLUSH));
-            retval += (finfo->stream.total_out - before);
+    while ((i = __PHYSFS_ATOMIC_INCR(&job->next) - 1) < job->count)
+    {
+        const ZIPcheckpoint *cp = job->points[i];
+        PHYSFS_uint64 pos = cp->compressed_position;
+
+        memcpy(stream.state, &cp->state, sizeof (inflate_state));
+        stream.avail_in = 0;
+        stream.next_out = job->buf + (((size_t) i) * ZIP_CHECKPOINT_SPACING);
+        stream.avail_out = ZIP_CHECKPOINT_SPACING;
+
+        while (stream.avail_out > 0)
+        {
+            int rc;
+            if (stream.avail_in == 0)
+            {
+                PHYSFS_uint64 want = entry->compressed_size - pos;
+                PHYSFS_sint64 br;
+                if (want > ZIP_READBUFSIZE)
+                    want = ZIP_READBUFSIZE;
+                br = (want == 0) ? 0 : __PHYSFS_readAt(io, entry->offset + pos, inbuf, want);
+                if (br <= 0)
+                    break;
+                pos += (PHYSFS_uint64) br;
+                stream.next_in = inbuf;
+                stream.avail_in = (uInt) br;
+            } /* if */
 
+            rc = inflate(&stream, Z_SYNC_FLUSH);
             if (rc != Z_OK)
-                break;
+                break;  /* the end, or broken; avail_out says which. */
         } /* while */
+
+        if (stream.avail_out != 0)
+            __PHYSFS_ATOMIC_INCR(&job->failed);
+    } /* while */
+
+    inflateEnd(&stream);
+    allocator.Free(inbuf);
+} /* zip_decode_pieces */
+
+static void zip_decode_thread(void *data)
+{
+    zip_decode_pieces((ZIPdecodeJob *) data);
+    __PHYSFS_freeThreadErrorState();
+} /* zip_decode_thread */
+
+
+/*
+ * Read (len) bytes on several threads, if (finfo) wants that and there are
+ *  checkpoints all through the range. Returns zero if it didn't try, so
+ *  the caller should decode it itself, else non-zero with (*_retval) set
+ *  the way ZIP_read() should return, and tell() updated.
+ *
+ * This thread decodes up to the first checkpoint, then jumps to the last
+ *  one and decodes the rest, so the stream ends up where the read does.
+ *  The pieces between checkpoints go to whichever thread is free.
+ */
+static int zip_read_parallel(ZIPfileinfo *finfo, PHYSFS_uint8 *buf,
+                             const PHYSFS_sint64 len, PHYSFS_sint64 *_retval)
+{
+    const PHYSFS_uint64 start = finfo->uncompressed_position;
+    const PHYSFS_uint64 end = start + (PHYSFS_uint64) len;
+    const PHYSFS_uint64 first = (start / ZIP_CHECKPOINT_SPACING) + 1;
+    const PHYSFS_uint64 last = end / ZIP_CHECKPOINT_SPACING;
+    const ZIPcheckpoint **points = NULL;
+    void *threads[ZIP_MAX_DECODE_THREADS];
+    PHYSFS_uint64 head, tail, k;
+    PHYSFS_sint64 br;
+    ZIPdecodeJob job;
+    int numThreads, i;
+
+    if ((finfo->index == NULL) || (last <= first))
+        return 0;
+    else if (!__PHYSFS_ioHasReadAt(finfo->io))
+        return 0;  /* threads can't share it. */
+
+    points = (const ZIPcheckpoint **) allocator.Malloc((size_t) (last - first + 1) * sizeof (ZIPcheckpoint *));
+    if (points == NULL)
+        return 0;  /* do it the slow way. */
+
+    for (k = first; k <= last; k++)
+    {
+        points[k - first] = zip_get_checkpoint(finfo->info, finfo->index, k);
+        if (points[k - first] == NULL)
+        {
+            allocator.Free(points);
+            return 0;  /* not read this far yet; that'll save them. */
+        } /* if */
+    } /* for */
+
+    /* up to the first checkpoint, here. */
+    head = (first * ZIP_CHECKPOINT_SPACING) - start;
+    br = zip_read_inflate(finfo, buf, (PHYSFS_sint64) head);
+    if (br > 0)
+        finfo->uncompressed_position += (PHYSFS_uint64) br;
+    if (br != (PHYSFS_sint64) head)
+    {
+        allocator.Free(points);
+        *_retval = br;
+        return 1;
+    } /* if */
+
+    job.finfo = finfo;
+    job.buf = buf + head;
+    job.points = points;
+    job.count = (int) (last - first);
+    job.next = 0;
+    job.failed = 0;
+
+    numThreads = (int) finfo->decode_threads - 1;
+    if (numThreads > job.count)
+        numThreads = job.count;
+    for (i = 0; i < numThreads; i++)
+        threads[i] = __PHYSFS_platformCreateThread(zip_decode_thread, &job);
+
+    /* the rest, from the last checkpoint, here too, while they work. */
+    tail = end - (last * ZIP_CHECKPOINT_SPACING);
+    br = -1;
+    if (zip_restore_checkpoint(finfo, points[job.count], last))
+    {
+        br = zip_read_inflate(finfo, buf + (end - start - tail), (PHYSFS_sint64) tail);
+        if (br > 0)
+            finfo->uncompressed_position += (PHYSFS_uint64) br;
+    } /* if */
+
+    zip_decode_pieces(&job);  /* then help with whatever's left. */
+    for (i = 0; i < numThreads; i++)
+    {
+        if (threads[i] != NULL)
+            __PHYSFS_platformWaitThread(threads[i]);
+    } /* for */
+
+    allocator.Free(points);
+
+    if ((job.failed) || (br != (PHYSFS_sint64) tail))
+    {
+        PHYSFS_setErrorCode(PHYSFS_ERR_CORRUPT);
+        *_retval = -1;
+    } /* if */
+    else
+    {
+        *_retval = len;
     } /* else */
 
-    if (retval > 0)
-        finfo->uncompressed_position += (PHYSFS_uint32) retval;
+    return 1;
+} /* zip_read_parallel */
+
+
+static PHYSFS_sint64 ZIP_read(PHYSFS_Io *_io, void *buf, PHYSFS_uint64 len)
+{
+    ZIPfileinfo *finfo = (ZIPfileinfo *) _io->opaque;
+    const ZIPentry *entry = &finfo->entry;
+    PHYSFS_sint64 retval = 0;
+    PHYSFS_sint64 maxread = (PHYSFS_sint64) len;
+    const PHYSFS_sint64 avail = (PHYSFS_sint64) (entry->uncompressed_size -
+                                                 finfo->uncompressed_position);
+
+    if (avail < maxread)
+        maxread = avail;
+
+    BAIL_IF_ERRPASS(maxread == 0, 0);    /* quick rejection. */
+
+    if (entry->compression_method == COMPMETH_NONE)
+    {
+        retval = zip_read_decrypt(finfo, buf, maxread);
+        if (retval > 0)
+            finfo->uncompressed_position += (PHYSFS_uint64) retval;
+    } /* if */
+
+    else
+    {
+        if ((finfo->decode_threads < 2) ||
+            (!zip_read_parallel(finfo, (PHYSFS_uint8 *) buf, maxread, &retval)))
+        {
+            retval = zip_read_inflate(finfo, buf, maxread);
+            if (retval > 0)
+                finfo->uncompressed_position += (PHYSFS_uint64) retval;
+        } /* if */
+
+        if (retval > 0)
+            __PHYSFS_STAT_ADD(__PHYSFS_getIoStats(finfo->io), bytesDecompressed, retval);
+    } /* else */
 
     return retval;
 } /* ZIP_read */
@@ -20929,7 +27036,7 @@ static PHYSFS_sint64 ZIP_tell(PHYSFS_Io *io)
 static int ZIP_seek(PHYSFS_Io *_io, PHYSFS_uint64 offset)
 {
     ZIPfileinfo *finfo = (ZIPfileinfo *) _io->opaque;
-    ZIPentry *entry = finfo->entry;
+    const ZIPentry *entry = &finfo->entry;
     PHYSFS_Io *io = finfo->io;
     const int encrypted = zip_entry_is_tradional_crypto(entry);
 
@@ -20939,7 +27046,7 @@ static int ZIP_seek(PHYSFS_Io *_io, PHYSFS_uint64 offset)
     {
         PHYSFS_sint64 newpos = offset + entry->offset;
         BAIL_IF_ERRPASS(!io->seek(io, newpos), 0);
-        finfo->uncompressed_position = (PHYSFS_uint32) offset;
+        finfo->uncompressed_position = offset;
     } /* if */
 
     else
@@ -20950,6 +27057,22 @@ static int ZIP_seek(PHYSFS_Io *_io, PHYSFS_uint64 offset)
          *  the offset we need. If seeking forward, we still need to
          *  decode, but we don't rewind first.
          */
+        const PHYSFS_uint64 k = offset / ZIP_CHECKPOINT_SPACING;
+        ZIPindex *index = finfo->index;
+
+        if ((index == NULL) && (!encrypted) && (k > 0))
+            index = zip_find_index(finfo->info, entry, 0);
+
+        /* a checkpoint between here and there, or before there if going back? */
+        if ((index != NULL) && (!encrypted) &&
+            ((offset < finfo->uncompressed_position) ||
+             ((k * ZIP_CHECKPOINT_SPACING) > finfo->uncompressed_position)))
+        {
+            const ZIPcheckpoint *cp = zip_get_checkpoint(finfo->info, index, k);
+            if (cp != NULL)
+                BAIL_IF_ERRPASS(!zip_restore_checkpoint(finfo, cp, k), 0);
+        } /* if */
+
         if (offset < finfo->uncompressed_position)
         {
             /* we do a copy so state is sane if inflateInit2() fails. */
@@ -20964,6 +27087,7 @@ static int ZIP_seek(PHYSFS_Io *_io, PHYSFS_uint64 offset)
             inflateEnd(&finfo->stream);
             memcpy(&finfo->stream, &str, sizeof (z_stream));
             finfo->uncompressed_position = finfo->compressed_position = 0;
+            __PHYSFS_STAT_ADD(__PHYSFS_getIoStats(io), seekReinflates, 1);
 
             if (encrypted)
                 memcpy(finfo->crypto_keys, finfo->initial_crypto_keys, 12);
@@ -20972,13 +27096,13 @@ static int ZIP_seek(PHYSFS_Io *_io, PHYSFS_uint64 offset)
         while (finfo->uncompressed_position != offset)
         {
             PHYSFS_uint8 buf[512];
-            PHYSFS_uint32 maxread;
+            PHYSFS_uint64 maxread;
 
-            maxread = (PHYSFS_uint32) (offset - finfo->uncompressed_position);
+            maxread = offset - finfo->uncompressed_position;
             if (maxread > sizeof (buf))
                 maxread = sizeof (buf);
 
-            if (ZIP_read(_io, buf, maxread) != maxread)
+            if (ZIP_read(_io, buf, maxread) != (PHYSFS_sint64) maxread)
                 return 0;
         } /* while */
     } /* else */
@@ -20990,11 +27114,11 @@ static int ZIP_seek(PHYSFS_Io *_io, PHYSFS_uint64 offset)
 static PHYSFS_sint64 ZIP_length(PHYSFS_Io *io)
 {
     const ZIPfileinfo *finfo = (ZIPfileinfo *) io->opaque;
-    return (PHYSFS_sint64) finfo->entry->uncompressed_size;
+    return (PHYSFS_sint64) finfo->entry.uncompressed_size;
 } /* ZIP_length */
 
 
-static PHYSFS_Io *zip_get_io(PHYSFS_Io *io, ZIPinfo *inf, ZIPentry *entry);
+static PHYSFS_Io *zip_get_io(PHYSFS_Io *io, const ZIPentry *entry);
 
 static PHYSFS_Io *ZIP_duplicate(PHYSFS_Io *io)
 {
@@ -21005,14 +27129,15 @@ static PHYSFS_Io *ZIP_duplicate(PHYSFS_Io *io)
     GOTO_IF(!finfo, PHYSFS_ERR_OUT_OF_MEMORY, failed);
     memset(finfo, '\0', sizeof (*finfo));
 
-    finfo->entry = origfinfo->entry;
-    finfo->io = zip_get_io(origfinfo->io, NULL, finfo->entry);
+    memcpy(&finfo->entry, &origfinfo->entry, sizeof (ZIPentry));
+    finfo->info = origfinfo->info;
+    finfo->io = zip_get_io(origfinfo->io, &finfo->entry);
     GOTO_IF_ERRPASS(!finfo->io, failed);
 
     initializeZStream(&finfo->stream);
-    if (finfo->entry->compression_method != COMPMETH_NONE)
+    if (finfo->entry.compression_method != COMPMETH_NONE)
     {
-        finfo->buffer = (PHYSFS_uint8 *) allocator.Malloc(ZIP_READBUFSIZE);
+        finfo->buffer = zip_alloc_readbuf();
         GOTO_IF(!finfo->buffer, PHYSFS_ERR_OUT_OF_MEMORY, failed);
         if (zlib_err(inflateInit2(&finfo->stream, -MAX_WBITS)) != Z_OK)
             goto failed;
@@ -21050,7 +27175,7 @@ static void ZIP_destroy(PHYSFS_Io *io)
     ZIPfileinfo *finfo = (ZIPfileinfo *) io->opaque;
     finfo->io->destroy(finfo->io);
 
-    if (finfo->entry->compression_method != COMPMETH_NONE)
+    if (finfo->entry.compression_method != COMPMETH_NONE)
         inflateEnd(&finfo->stream);
 
     if (finfo->buffer != NULL)
@@ -21071,7 +27196,9 @@ static const PHYSFS_Io ZIP_Io =
     ZIP_length,
     ZIP_duplicate,
     ZIP_flush,
-    ZIP_destroy
+    ZIP_destroy,
+    NULL,
+    NULL
 };
 
 
@@ -21265,44 +27392,123 @@ static void zip_expand_symlink_path(char *path)
 } /* zip_expand_symlink_path */
 
 
-static inline ZIPentry *zip_find_entry(ZIPinfo *info, const char *path)
+static PHYSFS_uint64 zip_get_size(const ZIPinfo *info, const PHYSFS_uint32 i,
+                                  const int which)
+{
+    const size_t pos = (((size_t) i) * 3) + which;
+    if (info->wide)
+        return ((const PHYSFS_uint64 *) info->sizes)[pos];
+    return (PHYSFS_uint64) ((const PHYSFS_uint32 *) info->sizes)[pos];
+} /* zip_get_size */
+
+
+/*
+ * Sizes are only narrow for archives under 4 gigabytes, where nothing real
+ *  is bigger. A corrupt offset that is becomes 0xFFFFFFFF, which is still
+ *  past the end of the archive, so reading there fails all the same.
+ */
+static void zip_set_size(ZIPinfo *info, const PHYSFS_uint32 i,
+                         const int which, const PHYSFS_uint64 val)
+{
+    const size_t pos = (((size_t) i) * 3) + which;
+    if (info->wide)
+        ((PHYSFS_uint64 *) info->sizes)[pos] = val;
+    else
+    {
+        ((PHYSFS_uint32 *) info->sizes)[pos] = (val > 0xFFFFFFFF) ?
+                                    0xFFFFFFFF : (PHYSFS_uint32) val;
+    } /* else */
+} /* zip_set_size */
+
+
+static const char *zip_name(const ZIPinfo *info, const ZIPrecord *rec)
+{
+    /* the names end with a null, so any offset inside them is a string. */
+    return (rec->name < info->names_len) ? info->names + rec->name : "";
+} /* zip_name */
+
+
+/* entry (i) at full width, in (entry). */
+static void zip_get_record(const ZIPinfo *info, const PHYSFS_uint32 i,
+                           ZIPentry *entry)
+{
+    const ZIPrecord *rec = &info->records[i];
+
+    /* this goes first: once it says resolved, the rest is there to read. */
+    entry->resolved = (ZipResolveType) __PHYSFS_ATOMIC_LOAD(&rec->resolved);
+    entry->symlink = (rec->flags & ZIP_RECORD_SYMLINK) ? 1 : 0;
+    entry->offset = zip_get_size(info, i, ZIP_SIZE_OFFSET);
+    entry->compressed_size = zip_get_size(info, i, ZIP_SIZE_COMPRESSED);
+    entry->uncompressed_size = zip_get_size(info, i, ZIP_SIZE_UNCOMPRESSED);
+    entry->crc = rec->crc;
+    entry->dos_mod_time = rec->dos_mod_time;
+    entry->version = rec->version;
+    entry->version_needed = rec->version_needed;
+    entry->general_bits = rec->general_bits;
+    entry->compression_method = rec->compression_method;
+} /* zip_get_record */
+
+
+/*
+ * Find the entry number for a path in platform-independent notation, or
+ *  ZIP_NONE. This only reads the table, so once it's built, any number of
+ *  threads can call it at once without a lock. A table from a shared index
+ *  could have loops, but no chain is longer than all of it.
+ */
+static PHYSFS_uint32 zip_find_entry(const ZIPinfo *info, const char *path)
 {
-    return (ZIPentry *) __PHYSFS_DirTreeFind(&info->tree, path);
+    PHYSFS_uint32 steps;
+    PHYSFS_uint32 i;
+
+    if (*path == '\0')
+        return 0;  /* the root. */
+
+    i = info->hash[__PHYSFS_hashString(path, strlen(path)) % info->buckets];
+    for (steps = 0; (i < info->count) && (steps < info->count); steps++)
+    {
+        const ZIPrecord *rec = &info->records[i];
+        if (strcmp(zip_name(info, rec), path) == 0)
+            return i;
+        i = rec->hashnext;
+    } /* for */
+
+    BAIL(PHYSFS_ERR_NOT_FOUND, ZIP_NONE);
 } /* zip_find_entry */
 
 /* (forward reference: zip_follow_symlink and zip_resolve call each other.) */
-static int zip_resolve(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry);
+static int zip_resolve(PHYSFS_Io *io, ZIPinfo *info, const PHYSFS_uint32 i);
 
 /*
  * Look for the entry named by (path). If it exists, resolve it, and return
- *  a pointer to that entry. If it's another symlink, keep resolving until you
- *  hit a real file and then return a pointer to the final non-symlink entry.
- *  If there's a problem, return NULL.
+ *  its number. If it's another symlink, return the number of the real file
+ *  that one ended up at. If there's a problem, return ZIP_NONE.
  */
-static ZIPentry *zip_follow_symlink(PHYSFS_Io *io, ZIPinfo *info, char *path)
+static PHYSFS_uint32 zip_follow_symlink(PHYSFS_Io *io, ZIPinfo *info,
+                                        char *path)
 {
-    ZIPentry *entry;
+    PHYSFS_uint32 i;
 
     zip_expand_symlink_path(path);
-    entry = zip_find_entry(info, path);
-    if (entry != NULL)
+    i = zip_find_entry(info, path);
+    if (i != ZIP_NONE)
     {
-        if (!zip_resolve(io, info, entry))  /* recursive! */
-            entry = NULL;
-        else
-        {
-            if (entry->symlink != NULL)
-                entry = entry->symlink;
-        } /* else */
+        if (!zip_resolve(io, info, i))  /* recursive! */
+            i = ZIP_NONE;
+        else if (info->records[i].flags & ZIP_RECORD_SYMLINK)
+            i = info->records[i].children;
     } /* if */
 
-    return entry;
+    return i;
 } /* zip_follow_symlink */
 
 
-static int zip_resolve_symlink(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry)
+static int zip_resolve_symlink(PHYSFS_Io *io, ZIPinfo *info,
+                               const PHYSFS_uint32 i)
 {
-    const size_t size = (size_t) entry->uncompressed_size;
+    ZIPentry copy;
+    const ZIPentry *entry = &copy;
+    PHYSFS_uint32 target = ZIP_NONE;
+    size_t size;
     char *path = NULL;
     int rc = 0;
 
@@ -21312,13 +27518,13 @@ static int zip_resolve_symlink(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry)
      *  follow it.
      */
 
-    BAIL_IF_ERRPASS(!io->seek(io, entry->offset), 0);
-
+    zip_get_record(info, i, &copy);
+    size = (size_t) entry->uncompressed_size;
     path = (char *) __PHYSFS_smallAlloc(size + 1);
     BAIL_IF(!path, PHYSFS_ERR_OUT_OF_MEMORY, 0);
 
     if (entry->compression_method == COMPMETH_NONE)
-        rc = __PHYSFS_readAll(io, path, size);
+        rc = __PHYSFS_readAllAt(io, entry->offset, path, size);
 
     else  /* symlink target path is compressed... */
     {
@@ -21327,7 +27533,7 @@ static int zip_resolve_symlink(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry)
         PHYSFS_uint8 *compressed = (PHYSFS_uint8*) __PHYSFS_smallAlloc(complen);
         if (compressed != NULL)
         {
-            if (__PHYSFS_readAll(io, compressed, complen))
+            if (__PHYSFS_readAllAt(io, entry->offset, compressed, complen))
             {
                 initializeZStream(&stream);
                 stream.next_in = compressed;
@@ -21351,20 +27557,43 @@ static int zip_resolve_symlink(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry)
     {
         path[entry->uncompressed_size] = '\0';    /* null-terminate it. */
         zip_convert_dos_path(entry->version, path);
-        entry->symlink = zip_follow_symlink(io, info, path);
+        target = zip_follow_symlink(io, info, path);
     } /* else */
 
     __PHYSFS_smallFree(path);
 
-    return (entry->symlink != NULL);
+    if (target == ZIP_NONE)
+        return 0;
+
+    info->records[i].children = target;  /* a symlink has no kids. */
+    return 1;
 } /* zip_resolve_symlink */
 
 
+/* littleendian values out of a header that was read into memory. */
+static PHYSFS_uint16 zip_get16(const PHYSFS_uint8 *ptr)
+{
+    return (PHYSFS_uint16) (ptr[0] | (ptr[1] << 8));
+} /* zip_get16 */
+
+static PHYSFS_uint32 zip_get32(const PHYSFS_uint8 *ptr)
+{
+    return ((PHYSFS_uint32) zip_get16(ptr)) |
+           (((PHYSFS_uint32) zip_get16(ptr + 2)) << 16);
+} /* zip_get32 */
+
+
+#define ZIP_LOCAL_HEADER_LEN 30
+
 /*
- * Parse the local file header of an entry, and update entry->offset.
+ * Check the local file header of entry (i), already read into (hdr), and
+ *  update its offset.
  */
-static int zip_parse_local(PHYSFS_Io *io, ZIPentry *entry)
+static int zip_check_local(ZIPinfo *info, const PHYSFS_uint32 i,
+                           const PHYSFS_uint8 *hdr)
 {
+    ZIPentry copy;
+    const ZIPentry *entry = &copy;
     PHYSFS_uint32 ui32;
     PHYSFS_uint16 ui16;
     PHYSFS_uint16 fnamelen;
@@ -21383,38 +27612,59 @@ static int zip_parse_local(PHYSFS_Io *io, ZIPentry *entry)
        !!! FIXME:  which is probably true for Jar files, fwiw, but we don't
        !!! FIXME:  care about these values anyhow. */
 
-    BAIL_IF_ERRPASS(!io->seek(io, entry->offset), 0);
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    zip_get_record(info, i, &copy);
+
+    ui32 = zip_get32(hdr);
     BAIL_IF(ui32 != ZIP_LOCAL_FILE_SIG, PHYSFS_ERR_CORRUPT, 0);
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+    ui16 = zip_get16(hdr + 4);
     BAIL_IF(ui16 != entry->version_needed, PHYSFS_ERR_CORRUPT, 0);
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);  /* general bits. */
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+    /* general bits at hdr + 6. */
+    ui16 = zip_get16(hdr + 8);
     BAIL_IF(ui16 != entry->compression_method, PHYSFS_ERR_CORRUPT, 0);
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);  /* date/time */
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    /* date/time at hdr + 10. */
+    ui32 = zip_get32(hdr + 14);
     BAIL_IF(ui32 && (ui32 != entry->crc), PHYSFS_ERR_CORRUPT, 0);
 
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    ui32 = zip_get32(hdr + 18);
     BAIL_IF(ui32 && (ui32 != 0xFFFFFFFF) &&
                   (ui32 != entry->compressed_size), PHYSFS_ERR_CORRUPT, 0);
 
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    ui32 = zip_get32(hdr + 22);
     BAIL_IF(ui32 && (ui32 != 0xFFFFFFFF) &&
                  (ui32 != entry->uncompressed_size), PHYSFS_ERR_CORRUPT, 0);
 
-    BAIL_IF_ERRPASS(!readui16(io, &fnamelen), 0);
-    BAIL_IF_ERRPASS(!readui16(io, &extralen), 0);
+    fnamelen = zip_get16(hdr + 26);
+    extralen = zip_get16(hdr + 28);
 
-    entry->offset += fnamelen + extralen + 30;
+    zip_set_size(info, i, ZIP_SIZE_OFFSET, entry->offset + fnamelen +
+                 extralen + ZIP_LOCAL_HEADER_LEN);
     return 1;
+} /* zip_check_local */
+
+
+/*
+ * Parse the local file header of entry (i), and update its offset.
+ */
+static int zip_parse_local(PHYSFS_Io *io, ZIPinfo *info, const PHYSFS_uint32 i)
+{
+    /* the fixed part is read in one go; that's one syscall, not twelve. */
+    PHYSFS_uint8 hdr[ZIP_LOCAL_HEADER_LEN];
+    const PHYSFS_uint64 offset = zip_get_size(info, i, ZIP_SIZE_OFFSET);
+    BAIL_IF_ERRPASS(!__PHYSFS_readAllAt(io, offset, hdr, sizeof (hdr)), 0);
+    return zip_check_local(info, i, hdr);
 } /* zip_parse_local */
 
 
-static int zip_resolve(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry)
+/*
+ * This changes entries, so it runs under info->resolve_lock (see
+ *  zip_resolve()) or at mount time, before anyone else can see the archive.
+ */
+static int zip_resolve_locked(PHYSFS_Io *io, ZIPinfo *info,
+                              const PHYSFS_uint32 i)
 {
+    ZIPrecord *rec = &info->records[i];
     int retval = 1;
-    const ZipResolveType resolve_type = entry->resolved;
+    const ZipResolveType resolve_type = (ZipResolveType) rec->resolved;
 
     if (resolve_type == ZIP_DIRECTORY)
         return 1;   /* we're good. */
@@ -21435,13 +27685,7 @@ static int zip_resolve(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry)
      */
     if (resolve_type != ZIP_RESOLVED)
     {
-        if (entry->tree.isdir)  /* an ancestor dir that DirTree filled in? */
-        {
-            entry->resolved = ZIP_DIRECTORY;
-            return 1;
-        } /* if */
-
-        retval = zip_parse_local(io, entry);
+        retval = zip_parse_local(io, info, i);
         if (retval)
         {
             /*
@@ -21450,25 +27694,41 @@ static int zip_resolve(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry)
              *  the real file) if all goes well.
              */
             if (resolve_type == ZIP_UNRESOLVED_SYMLINK)
-                retval = zip_resolve_symlink(io, info, entry);
+                retval = zip_resolve_symlink(io, info, i);
         } /* if */
 
         if (resolve_type == ZIP_UNRESOLVED_SYMLINK)
-            entry->resolved = ((retval) ? ZIP_RESOLVED : ZIP_BROKEN_SYMLINK);
+            __PHYSFS_ATOMIC_STORE(&rec->resolved, ((retval) ? ZIP_RESOLVED : ZIP_BROKEN_SYMLINK));
         else if (resolve_type == ZIP_UNRESOLVED_FILE)
-            entry->resolved = ((retval) ? ZIP_RESOLVED : ZIP_BROKEN_FILE);
+            __PHYSFS_ATOMIC_STORE(&rec->resolved, ((retval) ? ZIP_RESOLVED : ZIP_BROKEN_FILE));
     } /* if */
 
     return retval;
-} /* zip_resolve */
+} /* zip_resolve_locked */
 
 
-static int zip_entry_is_symlink(const ZIPentry *entry)
+/*
+ * Lookups run on many threads at once, without stateLock. A resolved entry
+ *  never changes again, so those are checked without a lock too, and that's
+ *  also what lets ZIP_read() get by without locks. Everything else waits
+ *  its turn on resolve_lock, which is recursive, for symlinks to follow.
+ *  A shared index was written resolved, and is never written to.
+ */
+static int zip_resolve(PHYSFS_Io *io, ZIPinfo *info, const PHYSFS_uint32 i)
 {
-    return ((entry->resolved == ZIP_UNRESOLVED_SYMLINK) ||
-            (entry->resolved == ZIP_BROKEN_SYMLINK) ||
-            (entry->symlink));
-} /* zip_entry_is_symlink */
+    const ZipResolveType resolve_type = (ZipResolveType) __PHYSFS_ATOMIC_LOAD(&info->records[i].resolved);
+    int retval;
+
+    if ((resolve_type == ZIP_RESOLVED) || (resolve_type == ZIP_DIRECTORY))
+        return 1;   /* we're good. */
+
+    BAIL_IF(info->map != NULL, PHYSFS_ERR_CORRUPT, 0);
+
+    __PHYSFS_platformGrabMutex(info->resolve_lock);
+    retval = zip_resolve_locked(io, info, i);
+    __PHYSFS_platformReleaseMutex(info->resolve_lock);
+    return retval;
+} /* zip_resolve */
 
 
 static int zip_version_does_symlinks(PHYSFS_uint32 version)
@@ -21517,6 +27777,10 @@ static PHYSFS_sint64 zip_dos_time_to_physfs_time(PHYSFS_uint32 dostime)
 {
     PHYSFS_uint32 dosdate;
     struct tm unixtime;
+
+    if (dostime == 0)
+        return 0;  /* not a real date; the directories we fill in have it. */
+
     memset(&unixtime, '\0', sizeof (unixtime));
 
     dosdate = (PHYSFS_uint32) ((dostime >> 16) & 0xFFFF);
@@ -21539,12 +27803,242 @@ static PHYSFS_sint64 zip_dos_time_to_physfs_time(PHYSFS_uint32 dostime)
 } /* zip_dos_time_to_physfs_time */
 
 
-static ZIPentry *zip_load_entry(ZIPinfo *info, const int zip64,
-                                const PHYSFS_uint64 ofs_fixup)
+/*
+ * Start a table with room for (count) entries, as the central directory
+ *  says, or as many as (len) bytes of it could hold, whichever's fewer.
+ */
+static int zip_table_init(ZIPinfo *info, const PHYSFS_uint64 count,
+                          const PHYSFS_uint64 len)
+{
+    const size_t sizelen = info->wide ? sizeof (PHYSFS_uint64) : sizeof (PHYSFS_uint32);
+    PHYSFS_uint64 room = count + 1;
+
+    BAIL_IF(count >= ZIP_NONE, PHYSFS_ERR_UNSUPPORTED, 0);
+    if (room > (len / 46) + 1)  /* a central directory record is 46+ bytes. */
+        room = (len / 46) + 1;
+
+    info->records_room = (PHYSFS_uint32) room;
+    info->records = (ZIPrecord *) allocator.Malloc((size_t) room * sizeof (ZIPrecord));
+    info->sizes = allocator.Malloc((size_t) room * 3 * sizelen);
+    info->buckets = (PHYSFS_uint32) room;
+    info->hash = (PHYSFS_uint32 *) allocator.Malloc((size_t) room * sizeof (PHYSFS_uint32));
+    info->names_room = 64 + (room * 16);
+    info->names = (char *) allocator.Malloc((size_t) info->names_room);
+    BAIL_IF(!info->records || !info->sizes || !info->hash || !info->names,
+            PHYSFS_ERR_OUT_OF_MEMORY, 0);
+
+    memset(info->hash, 0xFF, (size_t) room * sizeof (PHYSFS_uint32));  /* NONE */
+    memset(&info->records[0], '\0', sizeof (ZIPrecord));
+    info->records[0].hashnext = ZIP_NONE;
+    info->records[0].children = ZIP_NONE;
+    info->records[0].sibling = ZIP_NONE;
+    info->records[0].resolved = ZIP_DIRECTORY;
+    zip_set_size(info, 0, ZIP_SIZE_OFFSET, 0);
+    zip_set_size(info, 0, ZIP_SIZE_COMPRESSED, 0);
+    zip_set_size(info, 0, ZIP_SIZE_UNCOMPRESSED, 0);
+    info->names[0] = '\0';  /* the root's name. */
+    info->names_len = 1;
+    info->count = 1;
+    return 1;
+} /* zip_table_init */
+
+
+/* Make room for one more entry, named with (namelen) bytes. */
+static int zip_table_grow(ZIPinfo *info, const size_t namelen)
+{
+    const size_t sizelen = info->wide ? sizeof (PHYSFS_uint64) : sizeof (PHYSFS_uint32);
+
+    BAIL_IF(info->count >= ZIP_NONE - 1, PHYSFS_ERR_UNSUPPORTED, 0);
+    BAIL_IF(info->names_len + namelen >= ZIP_NONE, PHYSFS_ERR_UNSUPPORTED, 0);
+
+    if (info->count == info->records_room)
+    {
+        const PHYSFS_uint32 room = (info->records_room < (ZIP_NONE / 2)) ?
+                                    info->records_room * 2 : ZIP_NONE - 1;
+        void *ptr;
+
+        ptr = allocator.Realloc(info->records, (size_t) room * sizeof (ZIPrecord));
+        BAIL_IF(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        info->records = (ZIPrecord *) ptr;
+
+        ptr = allocator.Realloc(info->sizes, (size_t) room * 3 * sizelen);
+        BAIL_IF(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        info->sizes = ptr;
+        info->records_room = room;
+    } /* if */
+
+    if (info->names_len + namelen > info->names_room)
+    {
+        const PHYSFS_uint64 room = (info->names_room * 2) + namelen;
+        void *ptr;
+        BAIL_IF(!__PHYSFS_ui64FitsAddressSpace(room), PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        ptr = allocator.Realloc(info->names, (size_t) room);
+        BAIL_IF(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        info->names = (char *) ptr;
+        info->names_room = room;
+    } /* if */
+
+    return 1;
+} /* zip_table_grow */
+
+
+/*
+ * Double the hash buckets, so chains stay short. If there isn't memory for
+ *  it, the old buckets just keep getting longer chains.
+ */
+static void zip_table_grow_hash(ZIPinfo *info)
+{
+    const PHYSFS_uint32 buckets = info->buckets * 2;
+    PHYSFS_uint32 *hash;
+    PHYSFS_uint32 i;
+
+    if (buckets < info->buckets)
+        return;  /* overflow; that's a lot of buckets already. */
+
+    hash = (PHYSFS_uint32 *) allocator.Malloc((size_t) buckets * sizeof (PHYSFS_uint32));
+    if (hash == NULL)
+        return;
+    memset(hash, 0xFF, (size_t) buckets * sizeof (PHYSFS_uint32));
+
+    for (i = 1; i < info->count; i++)  /* the root isn't hashed. */
+    {
+        const char *name = zip_name(info, &info->records[i]);
+        const PHYSFS_uint32 bucket = __PHYSFS_hashString(name, strlen(name)) % buckets;
+        info->records[i].hashnext = hash[bucket];
+        hash[bucket] = i;
+    } /* for */
+
+    allocator.Free(info->hash);
+    info->hash = hash;
+    info->buckets = buckets;
+} /* zip_table_grow_hash */
+
+
+/* Give back what loading didn't use; the table doesn't move after this. */
+static void zip_table_shrink(ZIPinfo *info)
+{
+    const size_t sizelen = info->wide ? sizeof (PHYSFS_uint64) : sizeof (PHYSFS_uint32);
+    void *ptr;
+
+    ptr = allocator.Realloc(info->records, (size_t) info->count * sizeof (ZIPrecord));
+    if (ptr != NULL)
+        info->records = (ZIPrecord *) ptr;
+
+    ptr = allocator.Realloc(info->sizes, (size_t) info->count * 3 * sizelen);
+    if (ptr != NULL)
+        info->sizes = ptr;
+
+    ptr = allocator.Realloc(info->names, (size_t) info->names_len);
+    if (ptr != NULL)
+        info->names = (char *) ptr;
+
+    info->records_room = info->count;
+    info->names_room = info->names_len;
+} /* zip_table_shrink */
+
+
+static void zip_table_free(ZIPinfo *info)
+{
+#if PHYSFS_PLATFORM_MAPFILE
+    if (info->map != NULL)
+    {
+        __PHYSFS_platformUnmapFile((void *) info->map, info->map_len);
+        info->map = NULL;
+    } /* if */
+    else
+#endif
+    {
+        allocator.Free(info->records);
+        allocator.Free(info->sizes);
+        allocator.Free(info->hash);
+        allocator.Free(info->names);
+    } /* else */
+
+    info->records = NULL;
+    info->sizes = NULL;
+    info->hash = NULL;
+    info->names = NULL;
+    info->count = info->buckets = 0;
+    info->names_len = 0;
+} /* zip_table_free */
+
+
+static PHYSFS_uint32 zip_table_add(ZIPinfo *info, char *name, const int isdir);
+
+/* Fill in missing parent directories. */
+static PHYSFS_uint32 zip_table_add_ancestors(ZIPinfo *info, char *name)
+{
+    PHYSFS_uint32 retval = 0;  /* the root. */
+    char *sep = strrchr(name, '/');
+
+    if (sep)
+    {
+        *sep = '\0';  /* chop off last piece. */
+        retval = zip_find_entry(info, name);
+
+        if (retval != ZIP_NONE)
+        {
+            *sep = '/';
+            BAIL_IF(info->records[retval].resolved != ZIP_DIRECTORY, PHYSFS_ERR_CORRUPT, ZIP_NONE);
+            return retval;  /* already hashed. */
+        } /* if */
+
+        /* okay, this is a new dir. Build and hash us. */
+        retval = zip_table_add(info, name, 1);
+        *sep = '/';
+    } /* if */
+
+    return retval;
+} /* zip_table_add_ancestors */
+
+
+/* Add (name) to the table, if it's not there, and return its number. */
+static PHYSFS_uint32 zip_table_add(ZIPinfo *info, char *name, const int isdir)
+{
+    PHYSFS_uint32 retval = zip_find_entry(info, name);
+    if (retval == ZIP_NONE)
+    {
+        const size_t namelen = strlen(name) + 1;
+        const PHYSFS_uint32 parent = zip_table_add_ancestors(info, name);
+        PHYSFS_uint32 bucket;
+        ZIPrecord *rec;
+
+        BAIL_IF_ERRPASS(parent == ZIP_NONE, ZIP_NONE);
+        BAIL_IF_ERRPASS(!zip_table_grow(info, namelen), ZIP_NONE);
+
+        retval = info->count++;
+        rec = &info->records[retval];
+        memset(rec, '\0', sizeof (*rec));
+        zip_set_size(info, retval, ZIP_SIZE_OFFSET, 0);
+        zip_set_size(info, retval, ZIP_SIZE_COMPRESSED, 0);
+        zip_set_size(info, retval, ZIP_SIZE_UNCOMPRESSED, 0);
+        rec->name = (PHYSFS_uint32) info->names_len;
+        memcpy(info->names + info->names_len, name, namelen);
+        info->names_len += namelen;
+        rec->children = ZIP_NONE;
+        rec->resolved = isdir ? ZIP_DIRECTORY : ZIP_UNRESOLVED_FILE;
+
+        bucket = __PHYSFS_hashString(name, namelen - 1) % info->buckets;
+        rec->hashnext = info->hash[bucket];
+        info->hash[bucket] = retval;
+        rec->sibling = info->records[parent].children;
+        info->records[parent].children = retval;
+
+        if (info->count > (info->buckets * 2))
+            zip_table_grow_hash(info);
+    } /* if */
+
+    return retval;
+} /* zip_table_add */
+
+
+/* Load the next central directory record into the table, and (entry). */
+static int zip_load_entry(ZIPinfo *info, const int zip64,
+                          const PHYSFS_uint64 ofs_fixup, ZIPentry *entry)
 {
     PHYSFS_Io *io = info->io;
-    ZIPentry entry;
-    ZIPentry *retval = NULL;
+    ZIPrecord *rec = NULL;
+    PHYSFS_uint32 i;
     PHYSFS_uint16 fnamelen, extralen, commentlen;
     PHYSFS_uint32 external_attr;
     PHYSFS_uint32 starting_disk;
@@ -21554,41 +28048,41 @@ static ZIPentry *zip_load_entry(ZIPinfo *info, const int zip64,
     PHYSFS_sint64 si64;
     char *name = NULL;
     int isdir = 0;
+    int symlink = 0;
 
     /* sanity check with central directory signature... */
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), NULL);
-    BAIL_IF(ui32 != ZIP_CENTRAL_DIR_SIG, PHYSFS_ERR_CORRUPT, NULL);
+    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    BAIL_IF(ui32 != ZIP_CENTRAL_DIR_SIG, PHYSFS_ERR_CORRUPT, 0);
 
-    memset(&entry, '\0', sizeof (entry));
+    memset(entry, '\0', sizeof (*entry));
 
     /* Get the pertinent parts of the record... */
-    BAIL_IF_ERRPASS(!readui16(io, &entry.version), NULL);
-    BAIL_IF_ERRPASS(!readui16(io, &entry.version_needed), NULL);
-    BAIL_IF_ERRPASS(!readui16(io, &entry.general_bits), NULL);  /* general bits */
-    BAIL_IF_ERRPASS(!readui16(io, &entry.compression_method), NULL);
-    BAIL_IF_ERRPASS(!readui32(io, &entry.dos_mod_time), NULL);
-    entry.last_mod_time = zip_dos_time_to_physfs_time(entry.dos_mod_time);
-    BAIL_IF_ERRPASS(!readui32(io, &entry.crc), NULL);
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), NULL);
-    entry.compressed_size = (PHYSFS_uint64) ui32;
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), NULL);
-    entry.uncompressed_size = (PHYSFS_uint64) ui32;
-    BAIL_IF_ERRPASS(!readui16(io, &fnamelen), NULL);
-    BAIL_IF_ERRPASS(!readui16(io, &extralen), NULL);
-    BAIL_IF_ERRPASS(!readui16(io, &commentlen), NULL);
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), NULL);
+    BAIL_IF_ERRPASS(!readui16(io, &entry->version), 0);
+    BAIL_IF_ERRPASS(!readui16(io, &entry->version_needed), 0);
+    BAIL_IF_ERRPASS(!readui16(io, &entry->general_bits), 0);  /* general bits */
+    BAIL_IF_ERRPASS(!readui16(io, &entry->compression_method), 0);
+    BAIL_IF_ERRPASS(!readui32(io, &entry->dos_mod_time), 0);
+    BAIL_IF_ERRPASS(!readui32(io, &entry->crc), 0);
+    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    entry->compressed_size = (PHYSFS_uint64) ui32;
+    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+    entry->uncompressed_size = (PHYSFS_uint64) ui32;
+    BAIL_IF_ERRPASS(!readui16(io, &fnamelen), 0);
+    BAIL_IF_ERRPASS(!readui16(io, &extralen), 0);
+    BAIL_IF_ERRPASS(!readui16(io, &commentlen), 0);
+    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
     starting_disk = (PHYSFS_uint32) ui16;
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), NULL);  /* internal file attribs */
-    BAIL_IF_ERRPASS(!readui32(io, &external_attr), NULL);
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), NULL);
+    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);  /* internal file attribs */
+    BAIL_IF_ERRPASS(!readui32(io, &external_attr), 0);
+    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
     offset = (PHYSFS_uint64) ui32;
 
     name = (char *) __PHYSFS_smallAlloc(fnamelen + 1);
-    BAIL_IF(!name, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    BAIL_IF(!name, PHYSFS_ERR_OUT_OF_MEMORY, 0);
     if (!__PHYSFS_readAll(io, name, fnamelen))
     {
         __PHYSFS_smallFree(name);
-        return NULL;
+        return 0;
     } /* if */
 
     if (name[fnamelen - 1] == '/')
@@ -21598,56 +28092,41 @@ static ZIPentry *zip_load_entry(ZIPinfo *info, const int zip64,
     } /* if */
     name[fnamelen] = '\0';  /* null-terminate the filename. */
 
-    zip_convert_dos_path(entry.version, name);
+    zip_convert_dos_path(entry->version, name);
 
-    retval = (ZIPentry *) __PHYSFS_DirTreeAdd(&info->tree, name, isdir);
+    i = zip_table_add(info, name, isdir);
     __PHYSFS_smallFree(name);
 
-    BAIL_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
-
-    /* It's okay to BAIL without freeing retval, because it's stored in the
-       __PHYSFS_DirTree and will be freed later anyhow. */
-    BAIL_IF(retval->last_mod_time != 0, PHYSFS_ERR_CORRUPT, NULL); /* dupe? */
-
-    /* Move the data we already read into place in the official object. */
-    memcpy(((PHYSFS_uint8 *) retval) + sizeof (__PHYSFS_DirTreeEntry),
-           ((PHYSFS_uint8 *) &entry) + sizeof (__PHYSFS_DirTreeEntry),
-           sizeof (*retval) - sizeof (__PHYSFS_DirTreeEntry));
-
-    retval->symlink = NULL;  /* will be resolved later, if necessary. */
-
-    if (isdir)
-        retval->resolved = ZIP_DIRECTORY;
-    else
-    {
-        retval->resolved = (zip_has_symlink_attr(retval, external_attr)) ?
-                                ZIP_UNRESOLVED_SYMLINK : ZIP_UNRESOLVED_FILE;
-    } /* else */
+    /* It's okay to BAIL now, the table is freed with the rest later. */
+    BAIL_IF_ERRPASS(i == ZIP_NONE, 0);
+    rec = &info->records[i];  /* the table is done growing for this one. */
+    BAIL_IF(rec->flags & ZIP_RECORD_LOADED, PHYSFS_ERR_CORRUPT, 0); /* dupe? */
+    symlink = zip_has_symlink_attr(entry, external_attr);
 
     si64 = io->tell(io);
-    BAIL_IF_ERRPASS(si64 == -1, NULL);
+    BAIL_IF_ERRPASS(si64 == -1, 0);
 
     /* If the actual sizes didn't fit in 32-bits, look for the Zip64
         extended information extra field... */
     if ( (zip64) &&
          ((offset == 0xFFFFFFFF) ||
           (starting_disk == 0xFFFFFFFF) ||
-          (retval->compressed_size == 0xFFFFFFFF) ||
-          (retval->uncompressed_size == 0xFFFFFFFF)) )
+          (entry->compressed_size == 0xFFFFFFFF) ||
+          (entry->uncompressed_size == 0xFFFFFFFF)) )
     {
         int found = 0;
         PHYSFS_uint16 sig = 0;
         PHYSFS_uint16 len = 0;
         while (extralen > 4)
         {
-            BAIL_IF_ERRPASS(!readui16(io, &sig), NULL);
-            BAIL_IF_ERRPASS(!readui16(io, &len), NULL);
+            BAIL_IF_ERRPASS(!readui16(io, &sig), 0);
+            BAIL_IF_ERRPASS(!readui16(io, &len), 0);
 
             si64 += 4 + len;
             extralen -= 4 + len;
             if (sig != ZIP64_EXTENDED_INFO_EXTRA_FIELD_SIG)
             {
-                BAIL_IF_ERRPASS(!io->seek(io, si64), NULL);
+                BAIL_IF_ERRPASS(!io->seek(io, si64), 0);
                 continue;
             } /* if */
 
@@ -21655,47 +28134,66 @@ static ZIPentry *zip_load_entry(ZIPinfo *info, const int zip64,
             break;
         } /* while */
 
-        BAIL_IF(!found, PHYSFS_ERR_CORRUPT, NULL);
+        BAIL_IF(!found, PHYSFS_ERR_CORRUPT, 0);
 
-        if (retval->uncompressed_size == 0xFFFFFFFF)
+        if (entry->uncompressed_size == 0xFFFFFFFF)
         {
-            BAIL_IF(len < 8, PHYSFS_ERR_CORRUPT, NULL);
-            BAIL_IF_ERRPASS(!readui64(io, &retval->uncompressed_size), NULL);
+            BAIL_IF(len < 8, PHYSFS_ERR_CORRUPT, 0);
+            BAIL_IF_ERRPASS(!readui64(io, &entry->uncompressed_size), 0);
             len -= 8;
         } /* if */
 
-        if (retval->compressed_size == 0xFFFFFFFF)
+        if (entry->compressed_size == 0xFFFFFFFF)
         {
-            BAIL_IF(len < 8, PHYSFS_ERR_CORRUPT, NULL);
-            BAIL_IF_ERRPASS(!readui64(io, &retval->compressed_size), NULL);
+            BAIL_IF(len < 8, PHYSFS_ERR_CORRUPT, 0);
+            BAIL_IF_ERRPASS(!readui64(io, &entry->compressed_size), 0);
             len -= 8;
         } /* if */
 
         if (offset == 0xFFFFFFFF)
         {
-            BAIL_IF(len < 8, PHYSFS_ERR_CORRUPT, NULL);
-            BAIL_IF_ERRPASS(!readui64(io, &offset), NULL);
+            BAIL_IF(len < 8, PHYSFS_ERR_CORRUPT, 0);
+            BAIL_IF_ERRPASS(!readui64(io, &offset), 0);
             len -= 8;
         } /* if */
 
         if (starting_disk == 0xFFFFFFFF)
         {
-            BAIL_IF(len < 8, PHYSFS_ERR_CORRUPT, NULL);
-            BAIL_IF_ERRPASS(!readui32(io, &starting_disk), NULL);
+            BAIL_IF(len < 8, PHYSFS_ERR_CORRUPT, 0);
+            BAIL_IF_ERRPASS(!readui32(io, &starting_disk), 0);
             len -= 4;
         } /* if */
 
-        BAIL_IF(len != 0, PHYSFS_ERR_CORRUPT, NULL);
+        BAIL_IF(len != 0, PHYSFS_ERR_CORRUPT, 0);
     } /* if */
 
-    BAIL_IF(starting_disk != 0, PHYSFS_ERR_CORRUPT, NULL);
+    BAIL_IF(starting_disk != 0, PHYSFS_ERR_CORRUPT, 0);
+
+    entry->offset = offset + ofs_fixup;
 
-    retval->offset = offset + ofs_fixup;
+    /* Move the data we already read into place in the table. */
+    rec->crc = entry->crc;
+    rec->dos_mod_time = entry->dos_mod_time;
+    rec->version = entry->version;
+    rec->version_needed = entry->version_needed;
+    rec->general_bits = entry->general_bits;
+    rec->compression_method = entry->compression_method;
+    rec->flags |= ZIP_RECORD_LOADED;
+    zip_set_size(info, i, ZIP_SIZE_OFFSET, entry->offset);
+    zip_set_size(info, i, ZIP_SIZE_COMPRESSED, entry->compressed_size);
+    zip_set_size(info, i, ZIP_SIZE_UNCOMPRESSED, entry->uncompressed_size);
+
+    /* a directory stays one, even if we filled it in first. */
+    if ((rec->resolved != ZIP_DIRECTORY) && (symlink))
+    {
+        rec->flags |= ZIP_RECORD_SYMLINK;
+        rec->resolved = ZIP_UNRESOLVED_SYMLINK;  /* resolved later. */
+    } /* if */
 
     /* seek to the start of the next entry in the central directory... */
-    BAIL_IF_ERRPASS(!io->seek(io, si64 + extralen + commentlen), NULL);
+    BAIL_IF_ERRPASS(!io->seek(io, si64 + extralen + commentlen), 0);
 
-    return retval;  /* success. */
+    return 1;  /* success. */
 } /* zip_load_entry */
 
 
@@ -21713,9 +28211,9 @@ static int zip_load_entries(ZIPinfo *info,
 
     for (i = 0; i < entry_count; i++)
     {
-        ZIPentry *entry = zip_load_entry(info, zip64, data_ofs);
-        BAIL_IF_ERRPASS(!entry, 0);
-        if (zip_entry_is_tradional_crypto(entry))
+        ZIPentry entry;
+        BAIL_IF_ERRPASS(!zip_load_entry(info, zip64, data_ofs, &entry), 0);
+        if (zip_entry_is_tradional_crypto(&entry))
             info->has_crypto = 1;
     } /* for */
 
@@ -21948,78 +28446,497 @@ static int zip_parse_end_of_central_dir(ZIPinfo *info,
     BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
     BAIL_IF(ui16 != 0, PHYSFS_ERR_CORRUPT, 0);
 
-    /* number of the disk with the start of the central directory */
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
-    BAIL_IF(ui16 != 0, PHYSFS_ERR_CORRUPT, 0);
+    /* number of the disk with the start of the central directory */
+    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+    BAIL_IF(ui16 != 0, PHYSFS_ERR_CORRUPT, 0);
+
+    /* total number of entries in the central dir on this disk */
+    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+
+    /* total number of entries in the central dir */
+    BAIL_IF_ERRPASS(!readui16(io, &entryCount16), 0);
+    BAIL_IF(ui16 != entryCount16, PHYSFS_ERR_CORRUPT, 0);
+
+    *entry_count = entryCount16;
+
+    /* size of the central directory */
+    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
+
+    /* offset of central directory */
+    BAIL_IF_ERRPASS(!readui32(io, &offset32), 0);
+    *dir_ofs = (PHYSFS_uint64) offset32;
+    BAIL_IF(((PHYSFS_uint64) pos) < (*dir_ofs + ui32), PHYSFS_ERR_CORRUPT, 0);
+
+    /*
+     * For self-extracting archives, etc, there's crapola in the file
+     *  before the zipfile records; we calculate how much data there is
+     *  prepended by determining how far the central directory offset is
+     *  from where it is supposed to be (start of end-of-central-dir minus
+     *  sizeof central dir)...the difference in bytes is how much arbitrary
+     *  data is at the start of the physical file.
+     */
+    *data_start = (PHYSFS_uint64) (pos - (*dir_ofs + ui32));
+
+    /* Now that we know the difference, fix up the central dir offset... */
+    *dir_ofs += *data_start;
+
+    /* zipfile comment length */
+    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+
+    /*
+     * Make sure that the comment length matches to the end of file...
+     *  If it doesn't, we're either in the wrong part of the file, or the
+     *  file is corrupted, but we give up either way.
+     */
+    BAIL_IF((pos + 22 + ui16) != len, PHYSFS_ERR_CORRUPT, 0);
+
+    return 1;  /* made it. */
+} /* zip_parse_end_of_central_dir */
+
+
+static void ZIP_closeArchive(void *opaque)
+{
+    ZIPinfo *info = (ZIPinfo *) (opaque);
+
+    if (!info)
+        return;
+
+    if (info->io)
+        info->io->destroy(info->io);
+
+    while (info->indexes != NULL)
+    {
+        ZIPindex *next = info->indexes->next;
+        PHYSFS_uint32 i;
+        for (i = 0; i < info->indexes->count; i++)
+        {
+            if (info->indexes->points[i] != NULL)
+            {
+                __PHYSFS_memoryRelease(sizeof (ZIPcheckpoint));
+                allocator.Free(info->indexes->points[i]);
+            } /* if */
+        } /* for */
+        allocator.Free(info->indexes->points);
+        allocator.Free(info->indexes);
+        info->indexes = next;
+    } /* while */
+
+    if (info->index_lock)
+        __PHYSFS_platformDestroyMutex(info->index_lock);
+
+    if (info->resolve_lock)
+        __PHYSFS_platformDestroyMutex(info->resolve_lock);
+
+    zip_table_free(info);
+    allocator.Free(info);
+} /* ZIP_closeArchive */
+
+
+/* Big archives are resolved at mount by up to this many threads... */
+#define ZIP_RESOLVE_THREADS 4
+/* ...but each one gets at least this many files, or it isn't worth it. */
+#define ZIP_RESOLVE_MIN_PER_THREAD 256
+/* local headers are asked for this many at a time. */
+#define ZIP_RESOLVE_BATCH 64
+
+typedef struct
+{
+    ZIPinfo *info;
+    PHYSFS_Io *io;  /* the archive i/o if it has readAt(), else our own. */
+    PHYSFS_uint32 *entries;
+    size_t count;
+} ZIPresolveJob;
+
+/* every entry belongs to one job, so jobs can run in parallel. */
+static void zip_resolve_files(ZIPresolveJob *job)
+{
+    PHYSFS_uint8 hdrs[ZIP_RESOLVE_BATCH][ZIP_LOCAL_HEADER_LEN];
+    PHYSFS_IoVec vec[ZIP_RESOLVE_BATCH];
+    size_t i, j;
+
+    for (i = 0; i < job->count; i += ZIP_RESOLVE_BATCH)
+    {
+        const PHYSFS_uint32 *entries = job->entries + i;
+        const size_t n = (job->count - i < ZIP_RESOLVE_BATCH) ?
+                          job->count - i : ZIP_RESOLVE_BATCH;
+        PHYSFS_sint64 br;
+        size_t got;
+
+        for (j = 0; j < n; j++)
+        {
+            vec[j].offset = zip_get_size(job->info, entries[j], ZIP_SIZE_OFFSET);
+            vec[j].buf = hdrs[j];
+            vec[j].len = ZIP_LOCAL_HEADER_LEN;
+        } /* for */
+
+        /* a range that comes up short ends the batch; do the rest alone. */
+        br = __PHYSFS_readv(job->io, vec, (PHYSFS_uint32) n);
+        got = (br <= 0) ? 0 : (size_t) (br / ZIP_LOCAL_HEADER_LEN);
+
+        for (j = 0; j < n; j++)
+        {
+            const PHYSFS_uint32 e = entries[j];
+            const int ok = (j < got) ? zip_check_local(job->info, e, hdrs[j]) :
+                                       zip_parse_local(job->io, job->info, e);
+            job->info->records[e].resolved = ok ? ZIP_RESOLVED : ZIP_BROKEN_FILE;
+        } /* for */
+    } /* for */
+} /* zip_resolve_files */
+
+static void zip_resolve_thread(void *data)
+{
+    zip_resolve_files((ZIPresolveJob *) data);
+    __PHYSFS_freeThreadErrorState();
+} /* zip_resolve_thread */
+
+
+/*
+ * Resolve every entry now instead of on first use: local headers in
+ *  parallel, then symlinks, which can touch other entries, one at a time.
+ *  Failures just leave entries broken, like a lazy resolve would. Jobs all
+ *  read through the archive i/o if it has readAt(), or else duplicates.
+ */
+static void zip_resolve_all(ZIPinfo *info)
+{
+    const int shared = __PHYSFS_ioHasReadAt(info->io);
+    const size_t total = info->count;
+    ZIPresolveJob jobs[ZIP_RESOLVE_THREADS];
+    void *threads[ZIP_RESOLVE_THREADS];
+    PHYSFS_uint32 *entries;
+    size_t numFiles = 0, numLinks = 0;
+    size_t per, numJobs, i;
+
+    entries = (PHYSFS_uint32 *) allocator.Malloc(sizeof (PHYSFS_uint32) * total);
+    if (entries == NULL)
+        return;  /* oh well, they'll resolve lazily. */
+
+    /* files from the front, symlinks from the back. */
+    for (i = 1; i < total; i++)
+    {
+        const ZipResolveType resolved = (ZipResolveType) info->records[i].resolved;
+        if (resolved == ZIP_UNRESOLVED_FILE)
+            entries[numFiles++] = (PHYSFS_uint32) i;
+        else if (resolved == ZIP_UNRESOLVED_SYMLINK)
+            entries[total - ++numLinks] = (PHYSFS_uint32) i;
+    } /* for */
+
+    numJobs = numFiles / ZIP_RESOLVE_MIN_PER_THREAD;
+    if (numJobs > ZIP_RESOLVE_THREADS)
+        numJobs = ZIP_RESOLVE_THREADS;
+    else if (numJobs == 0)
+        numJobs = 1;
+    per = (numFiles + numJobs - 1) / numJobs;
+
+    for (i = 0; i < numJobs; i++)
+    {
+        const size_t start = i * per;
+        jobs[i].info = info;
+        jobs[i].entries = entries + start;
+        jobs[i].count = (start >= numFiles) ? 0 :
+                        ((numFiles - start < per) ? numFiles - start : per);
+        jobs[i].io = ((i == 0) || shared) ? info->io : info->io->duplicate(info->io);
+        threads[i] = NULL;
+        if (i == 0)
+            continue;  /* this thread does the first job itself. */
+        else if (jobs[i].io == NULL)
+            jobs[i].io = info->io;  /* do it here, after the first job. */
+        else
+        {
+            threads[i] = __PHYSFS_platformCreateThread(zip_resolve_thread, &jobs[i]);
+            if ((threads[i] == NULL) && (!shared))
+            {
+                jobs[i].io->destroy(jobs[i].io);
+                jobs[i].io = info->io;
+            } /* if */
+        } /* else */
+    } /* for */
+
+    zip_resolve_files(&jobs[0]);
+    for (i = 1; i < numJobs; i++)
+    {
+        if (threads[i] == NULL)
+            zip_resolve_files(&jobs[i]);
+        else
+        {
+            __PHYSFS_platformWaitThread(threads[i]);
+            if (!shared)
+                jobs[i].io->destroy(jobs[i].io);
+        } /* else */
+    } /* for */
+
+    for (i = total - numLinks; i < total; i++)
+        zip_resolve(info->io, info, entries[i]);
+
+    allocator.Free(entries);
+} /* zip_resolve_all */
+
+
+static PHYSFS_EnumerateCallbackResult ZIP_enumerate(void *opaque,
+                              const char *dname, PHYSFS_EnumerateCallback cb,
+                              const char *origdir, void *callbackdata)
+{
+    PHYSFS_EnumerateCallbackResult retval = PHYSFS_ENUM_OK;
+    const ZIPinfo *info = (const ZIPinfo *) opaque;
+    PHYSFS_uint32 steps;
+    PHYSFS_uint32 i = zip_find_entry(info, dname);
+
+    BAIL_IF_ERRPASS(i == ZIP_NONE, PHYSFS_ENUM_ERROR);
+    if (info->records[i].resolved != ZIP_DIRECTORY)
+        return PHYSFS_ENUM_OK;  /* no kids; a symlink's (children) isn't. */
+
+    i = info->records[i].children;
+    for (steps = 0; (i < info->count) && (steps < info->count) &&
+                    (retval == PHYSFS_ENUM_OK); steps++)
+    {
+        const char *name = zip_name(info, &info->records[i]);
+        const char *ptr = strrchr(name, '/');
+        retval = cb(callbackdata, origdir, ptr ? ptr + 1 : name);
+        BAIL_IF(retval == PHYSFS_ENUM_ERROR, PHYSFS_ERR_APP_CALLBACK, retval);
+        i = info->records[i].sibling;
+    } /* for */
+
+    return retval;
+} /* ZIP_enumerate */
+
+
+/*
+ * Find and resolve the entry for (path), and copy it into (entry). A
+ *  symlink's copy holds its target's data, and its own mod time. Resolving
+ *  points a symlink at the end of its chain, so that's never another one.
+ */
+static int zip_get_entry(ZIPinfo *info, const char *path, ZIPentry *entry)
+{
+    const PHYSFS_uint32 i = zip_find_entry(info, path);
+    PHYSFS_uint32 target = i;
+
+    BAIL_IF_ERRPASS(i == ZIP_NONE, 0);
+    BAIL_IF_ERRPASS(!zip_resolve(info->io, info, i), 0);
+
+    if (info->records[i].flags & ZIP_RECORD_SYMLINK)
+    {
+        target = info->records[i].children;
+        BAIL_IF(target >= info->count, PHYSFS_ERR_CORRUPT, 0);
+        BAIL_IF(info->records[target].flags & ZIP_RECORD_SYMLINK, PHYSFS_ERR_CORRUPT, 0);
+    } /* if */
+
+    zip_get_record(info, target, entry);
+    BAIL_IF((entry->resolved != ZIP_RESOLVED) &&
+            (entry->resolved != ZIP_DIRECTORY), PHYSFS_ERR_CORRUPT, 0);
+    entry->dos_mod_time = info->records[i].dos_mod_time;
+    entry->symlink = (target != i);
+    return 1;
+} /* zip_get_entry */
 
-    /* total number of entries in the central dir on this disk */
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
 
-    /* total number of entries in the central dir */
-    BAIL_IF_ERRPASS(!readui16(io, &entryCount16), 0);
-    BAIL_IF(ui16 != entryCount16, PHYSFS_ERR_CORRUPT, 0);
+#if PHYSFS_PLATFORM_MAPFILE
 
-    *entry_count = entryCount16;
+static PHYSFS_uint64 zip_shared_hash(const PHYSFS_uint8 *buf, size_t len)
+{
+    PHYSFS_uint64 hash = __PHYSFS_UI64(0xCBF29CE484222325);  /* FNV-1a */
+    while (len--)
+        hash = (hash ^ *(buf++)) * __PHYSFS_UI64(0x100000001B3);
+    return hash;
+} /* zip_shared_hash */
 
-    /* size of the central directory */
-    BAIL_IF_ERRPASS(!readui32(io, &ui32), 0);
 
-    /* offset of central directory */
-    BAIL_IF_ERRPASS(!readui32(io, &offset32), 0);
-    *dir_ofs = (PHYSFS_uint64) offset32;
-    BAIL_IF(((PHYSFS_uint64) pos) < (*dir_ofs + ui32), PHYSFS_ERR_CORRUPT, 0);
+/* What a shared index has to match. Zero if we can't find (path) again. */
+static int zip_shared_identify(ZIPinfo *info, const char *path,
+                               const PHYSFS_uint64 cdir_ofs,
+                               const PHYSFS_uint64 count, ZIPsharedId *id)
+{
+    PHYSFS_uint8 sample[ZIP_SHARED_SAMPLE];
+    const PHYSFS_sint64 len = info->io->length(info->io);
+    PHYSFS_uint64 samplelen;
+    PHYSFS_Stat statbuf;
 
-    /*
-     * For self-extracting archives, etc, there's crapola in the file
-     *  before the zipfile records; we calculate how much data there is
-     *  prepended by determining how far the central directory offset is
-     *  from where it is supposed to be (start of end-of-central-dir minus
-     *  sizeof central dir)...the difference in bytes is how much arbitrary
-     *  data is at the start of the physical file.
-     */
-    *data_start = (PHYSFS_uint64) (pos - (*dir_ofs + ui32));
+    BAIL_IF_ERRPASS(len < 0, 0);
+    BAIL_IF_ERRPASS(!__PHYSFS_platformStat(path, &statbuf, 1), 0);
+    BAIL_IF(statbuf.filetype != PHYSFS_FILETYPE_REGULAR, PHYSFS_ERR_UNSUPPORTED, 0);
+    BAIL_IF(statbuf.filesize != len, PHYSFS_ERR_UNSUPPORTED, 0);
+    BAIL_IF(cdir_ofs > (PHYSFS_uint64) len, PHYSFS_ERR_CORRUPT, 0);
+
+    samplelen = ((PHYSFS_uint64) len) - cdir_ofs;
+    if (samplelen > sizeof (sample))
+        samplelen = sizeof (sample);
+    BAIL_IF_ERRPASS(!__PHYSFS_readAllAt(info->io, cdir_ofs, sample, samplelen), 0);
+
+    memset(id, '\0', sizeof (*id));
+    id->archive_size = (PHYSFS_uint64) len;
+    id->archive_mtime = statbuf.modtime;
+    id->cdir_ofs = cdir_ofs;
+    id->cdir_count = count;
+    id->cdir_hash = zip_shared_hash(sample, (size_t) samplelen);
+    return 1;
+} /* zip_shared_identify */
 
-    /* Now that we know the difference, fix up the central dir offset... */
-    *dir_ofs += *data_start;
 
-    /* zipfile comment length */
-    BAIL_IF_ERRPASS(!readui16(io, &ui16), 0);
+/*
+ * Map the index at (indexpath) and use it instead of our own table, if
+ *  it's (path)'s and sane.
+ */
+static int zip_shared_attach(ZIPinfo *info, const char *indexpath,
+                             const char *path, const ZIPsharedId *id)
+{
+    const ZIPsharedHeader *header;
+    PHYSFS_uint8 *map;
+    PHYSFS_uint64 sizelen;
+    const char *names;
+    PHYSFS_uint64 len = 0;
 
-    /*
-     * Make sure that the comment length matches to the end of file...
-     *  If it doesn't, we're either in the wrong part of the file, or the
-     *  file is corrupted, but we give up either way.
-     */
-    BAIL_IF((pos + 22 + ui16) != len, PHYSFS_ERR_CORRUPT, 0);
+    map = (PHYSFS_uint8 *) __PHYSFS_platformMapFile(indexpath, &len);
+    BAIL_IF_ERRPASS(!map, 0);
+
+    header = (const ZIPsharedHeader *) map;
+    if (len < sizeof (*header))
+        goto attach_failed;
+    else if (memcmp(header->magic, ZIP_SHARED_MAGIC, sizeof (header->magic)) != 0)
+        goto attach_failed;
+    else if (header->version != ZIP_SHARED_VERSION)
+        goto attach_failed;
+    else if (header->entrylen != sizeof (ZIPrecord))
+        goto attach_failed;
+    else if (memcmp(&header->id, id, sizeof (*id)) != 0)
+        goto attach_failed;  /* stale, or some other archive's. */
+    else if ((header->count == 0) || (header->buckets == 0) || (header->names_len == 0))
+        goto attach_failed;
+
+    sizelen = (header->flags & ZIP_SHARED_WIDE) ? sizeof (PHYSFS_uint64) : sizeof (PHYSFS_uint32);
+    if (len != sizeof (*header) + (header->count * ((3 * sizelen) + sizeof (ZIPrecord))) +
+               (header->buckets * (PHYSFS_uint64) sizeof (PHYSFS_uint32)) + header->names_len)
+        goto attach_failed;
+
+    names = (const char *) (map + (len - header->names_len));
+    if (names[header->names_len - 1] != '\0')
+        goto attach_failed;
+    else if ((header->path >= header->names_len) || (strcmp(names + header->path, path) != 0))
+        goto attach_failed;
+
+    /* it's ours; our own table, if we built one, can go. */
+    zip_table_free(info);
+    info->map = map;
+    info->map_len = len;
+    info->wide = (header->flags & ZIP_SHARED_WIDE) ? 1 : 0;
+    info->sizes = map + sizeof (*header);
+    info->records = (ZIPrecord *) (map + sizeof (*header) + (header->count * 3 * sizelen));
+    info->hash = (PHYSFS_uint32 *) (info->records + header->count);
+    info->names = (char *) names;
+    info->count = header->count;
+    info->buckets = header->buckets;
+    info->names_len = header->names_len;
+    info->zip64 = (header->flags & ZIP_SHARED_ZIP64) ? 1 : 0;
+    info->has_crypto = (header->flags & ZIP_SHARED_CRYPTO) ? 1 : 0;
+    return 1;
 
-    return 1;  /* made it. */
-} /* zip_parse_end_of_central_dir */
+attach_failed:
+    __PHYSFS_platformUnmapFile(map, len);
+    BAIL(PHYSFS_ERR_CORRUPT, 0);
+} /* zip_shared_attach */
 
 
-static void ZIP_closeArchive(void *opaque)
+static int zip_shared_write(void *fh, const void *buf, const PHYSFS_uint64 len)
 {
-    ZIPinfo *info = (ZIPinfo *) (opaque);
+    PHYSFS_uint64 written = 0;
+    while (written < len)
+    {
+        const PHYSFS_sint64 rc = __PHYSFS_platformWrite(fh,
+                    ((const PHYSFS_uint8 *) buf) + written, len - written);
+        BAIL_IF_ERRPASS(rc <= 0, 0);
+        written += (PHYSFS_uint64) rc;
+    } /* while */
+    return 1;
+} /* zip_shared_write */
 
-    if (!info)
+
+/*
+ * Write (info)'s table where other processes will look for it, and use that
+ *  instead from now on. Everything in it has to be resolved already, so
+ *  nobody ever writes to it; if zip_resolve_all() didn't get that far, this
+ *  doesn't happen. It's written under another name and renamed over the
+ *  old one, so nobody mapping that sees it change.
+ */
+static void zip_shared_publish(ZIPinfo *info, const char *indexpath,
+                               const char *path, const ZIPsharedId *id)
+{
+    const size_t tmplen = strlen(indexpath) + 32;
+    const PHYSFS_uint64 pathlen = strlen(path) + 1;
+    const size_t sizelen = info->wide ? sizeof (PHYSFS_uint64) : sizeof (PHYSFS_uint32);
+    ZIPsharedHeader header;
+    char *tmppath = NULL;
+    void *fh = NULL;
+    PHYSFS_uint32 i;
+    int ok = 0;
+
+    for (i = 0; i < info->count; i++)
+    {
+        const ZipResolveType resolved = (ZipResolveType) info->records[i].resolved;
+        if ((resolved != ZIP_RESOLVED) && (resolved != ZIP_DIRECTORY) &&
+            (resolved != ZIP_BROKEN_FILE) && (resolved != ZIP_BROKEN_SYMLINK))
+            return;
+    } /* for */
+
+    if (info->names_len + pathlen >= ZIP_NONE)
         return;
 
-    if (info->io)
-        info->io->destroy(info->io);
+    memset(&header, '\0', sizeof (header));
+    memcpy(header.magic, ZIP_SHARED_MAGIC, sizeof (header.magic));
+    header.version = ZIP_SHARED_VERSION;
+    header.entrylen = sizeof (ZIPrecord);
+    memcpy(&header.id, id, sizeof (*id));
+    header.names_len = info->names_len + pathlen;
+    header.count = info->count;
+    header.buckets = info->buckets;
+    header.path = (PHYSFS_uint32) info->names_len;
+    header.flags = (info->zip64 ? ZIP_SHARED_ZIP64 : 0) |
+                   (info->has_crypto ? ZIP_SHARED_CRYPTO : 0) |
+                   (info->wide ? ZIP_SHARED_WIDE : 0);
+
+    tmppath = (char *) allocator.Malloc(tmplen);
+    if (tmppath != NULL)
+    {
+        /* another process could be writing this index too. */
+        snprintf(tmppath, tmplen, "%s.%llx.tmp", indexpath,
+                 (unsigned long long) (__PHYSFS_platformGetTicks() ^
+                 (PHYSFS_uint64) (size_t) __PHYSFS_platformGetThreadID()));
+        fh = __PHYSFS_platformOpenWrite(tmppath);
+    } /* if */
+
+    if (fh != NULL)
+    {
+        ok = zip_shared_write(fh, &header, sizeof (header)) &&
+             zip_shared_write(fh, info->sizes, (PHYSFS_uint64) info->count * 3 * sizelen) &&
+             zip_shared_write(fh, info->records, (PHYSFS_uint64) info->count * sizeof (ZIPrecord)) &&
+             zip_shared_write(fh, info->hash, (PHYSFS_uint64) info->buckets * sizeof (PHYSFS_uint32)) &&
+             zip_shared_write(fh, info->names, info->names_len) &&
+             zip_shared_write(fh, path, pathlen) &&
+             __PHYSFS_platformFlush(fh);
+        __PHYSFS_platformClose(fh);
+        ok = ok && __PHYSFS_platformRename(tmppath, indexpath);
+        if (!ok)
+            __PHYSFS_platformDelete(tmppath);
+    } /* if */
 
-    __PHYSFS_DirTreeDeinit(&info->tree);
+    allocator.Free(tmppath);
 
-    allocator.Free(info);
-} /* ZIP_closeArchive */
+    /* somebody else's might be there by now; that's just as good. */
+    if (ok)
+        zip_shared_attach(info, indexpath, path, id);
+} /* zip_shared_publish */
+
+#endif  /* PHYSFS_PLATFORM_MAPFILE */
 
 
 static void *ZIP_openArchive(PHYSFS_Io *io, const char *name,
                              int forWriting, int *claimed)
 {
     ZIPinfo *info = NULL;
-    ZIPentry *root = NULL;
+    PHYSFS_sint64 len;
     PHYSFS_uint64 dstart = 0;  /* data start */
     PHYSFS_uint64 cdir_ofs;  /* central dir offset */
     PHYSFS_uint64 count;
+    char *indexpath = NULL;
+#if PHYSFS_PLATFORM_MAPFILE
+    ZIPsharedId id;
+#endif
 
     assert(io != NULL);  /* shouldn't ever happen. */
 
@@ -22033,46 +28950,87 @@ static void *ZIP_openArchive(PHYSFS_Io *io, const char *name,
     memset(info, '\0', sizeof (ZIPinfo));
 
     info->io = io;
+    info->index_lock = __PHYSFS_platformCreateMutex();  /* NULL is okay. */
+    info->resolve_lock = __PHYSFS_platformCreateMutex();
+    GOTO_IF_ERRPASS(!info->resolve_lock, ZIP_openarchive_failed);
 
     if (!zip_parse_end_of_central_dir(info, &dstart, &cdir_ofs, &count))
         goto ZIP_openarchive_failed;
-    else if (!__PHYSFS_DirTreeInit(&info->tree, sizeof (ZIPentry)))
-        goto ZIP_openarchive_failed;
 
-    root = (ZIPentry *) info->tree.root;
-    root->resolved = ZIP_DIRECTORY;
+    len = io->length(io);
+    GOTO_IF_ERRPASS(len < 0, ZIP_openarchive_failed);
+    info->wide = (info->zip64) || (((PHYSFS_uint64) len) > 0xFFFFFFFF);
+
+#if PHYSFS_PLATFORM_MAPFILE
+    indexpath = __PHYSFS_indexCachePath(name);  /* NULL if there's no cache. */
+    if (indexpath != NULL)
+    {
+        /* no index, or a stale one, just means building it. */
+        const PHYSFS_ErrorCode errcode = PHYSFS_getLastErrorCode();
+        const int found = zip_shared_identify(info, name, cdir_ofs, count, &id);
+        if (found && zip_shared_attach(info, indexpath, name, &id))
+        {
+            PHYSFS_setErrorCode(errcode);
+            allocator.Free(indexpath);
+            return info;
+        } /* if */
+
+        PHYSFS_setErrorCode(errcode);
+        if (!found)
+        {
+            allocator.Free(indexpath);
+            indexpath = NULL;
+        } /* if */
+    } /* if */
+#endif
+
+    if (!zip_table_init(info, count, (PHYSFS_uint64) len))
+        goto ZIP_openarchive_failed;
 
     if (!zip_load_entries(info, dstart, cdir_ofs, count))
         goto ZIP_openarchive_failed;
 
-    assert(info->tree.root->sibling == NULL);
+    zip_table_shrink(info);
+
+    /* a shared index has to be resolved, so nobody ever writes to it. */
+    if (PHYSFS_getResolveOnMount() || (indexpath != NULL))
+    {
+        const PHYSFS_ErrorCode errcode = PHYSFS_getLastErrorCode();
+        zip_resolve_all(info);
+        PHYSFS_setErrorCode(errcode);  /* broken entries don't fail mounts. */
+    } /* if */
+
+    assert(info->records[0].sibling == ZIP_NONE);
+
+#if PHYSFS_PLATFORM_MAPFILE
+    if (indexpath != NULL)
+    {
+        const PHYSFS_ErrorCode errcode = PHYSFS_getLastErrorCode();
+        zip_shared_publish(info, indexpath, name, &id);
+        PHYSFS_setErrorCode(errcode);  /* we can do without it. */
+        allocator.Free(indexpath);
+    } /* if */
+#endif
+
     return info;
 
 ZIP_openarchive_failed:
+    allocator.Free(indexpath);
     info->io = NULL;  /* don't let ZIP_closeArchive destroy (io). */
     ZIP_closeArchive(info);
     return NULL;
 } /* ZIP_openArchive */
 
 
-static PHYSFS_Io *zip_get_io(PHYSFS_Io *io, ZIPinfo *inf, ZIPentry *entry)
+/* (entry) was resolved, and its symlink followed, by zip_get_entry(). */
+static PHYSFS_Io *zip_get_io(PHYSFS_Io *io, const ZIPentry *entry)
 {
-    int success;
-    PHYSFS_Io *retval = io->duplicate(io);
+    PHYSFS_Io *retval = __PHYSFS_duplicateForRead(io);
     BAIL_IF_ERRPASS(!retval, NULL);
 
-    assert(!entry->tree.isdir); /* should have been checked before calling. */
-
-    /* (inf) can be NULL if we already resolved. */
-    success = (inf == NULL) || zip_resolve(retval, inf, entry);
-    if (success)
-    {
-        PHYSFS_sint64 offset;
-        offset = ((entry->symlink) ? entry->symlink->offset : entry->offset);
-        success = retval->seek(retval, offset);
-    } /* if */
+    assert(entry->resolved == ZIP_RESOLVED); /* should have been checked before calling. */
 
-    if (!success)
+    if (!retval->seek(retval, entry->offset))
     {
         retval->destroy(retval);
         retval = NULL;
@@ -22082,17 +29040,92 @@ static PHYSFS_Io *zip_get_io(PHYSFS_Io *io, ZIPinfo *inf, ZIPentry *entry)
 } /* zip_get_io */
 
 
+int ZIP_statPhysical(void *opaque, const char *name, PHYSFS_Io **_io,
+                     PHYSFS_PhysicalStat *stat)
+{
+    ZIPinfo *info = (ZIPinfo *) opaque;
+    ZIPentry entry;
+
+    BAIL_IF_ERRPASS(!zip_get_entry(info, name, &entry), 0);
+    BAIL_IF(entry.resolved == ZIP_DIRECTORY, PHYSFS_ERR_NOT_A_FILE, 0);
+
+    *_io = info->io;
+    stat->offset = entry.offset;
+    stat->storedsize = entry.compressed_size;
+    stat->filesize = entry.uncompressed_size;
+    stat->crc = entry.crc;
+    stat->method = entry.compression_method;
+    stat->hascrc = 1;
+    stat->encrypted = zip_entry_is_tradional_crypto(&entry) ? 1 : 0;
+    return 1;
+} /* ZIP_statPhysical */
+
+
+int ZIP_rawRange(PHYSFS_Io *io, PHYSFS_Io **_io, PHYSFS_uint64 *_pos,
+                 PHYSFS_uint64 *_avail)
+{
+    const ZIPfileinfo *finfo = (const ZIPfileinfo *) io->opaque;
+    const ZIPentry *entry;
+
+    if (io->read != ZIP_read)
+        return 0;
+
+    entry = &finfo->entry;  /* symlinks were already followed. */
+    if ( (entry->compression_method != COMPMETH_NONE) ||
+         (zip_entry_is_tradional_crypto(entry)) )
+        return 0;
+
+    *_io = finfo->io;
+    *_pos = entry->offset + finfo->uncompressed_position;
+    *_avail = entry->uncompressed_size - finfo->uncompressed_position;
+    return 1;
+} /* ZIP_rawRange */
+
+
+PHYSFS_Io *ZIP_rawIo(PHYSFS_Io *io)
+{
+    if (io->read != ZIP_read)
+        return NULL;
+    return ((ZIPfileinfo *) io->opaque)->io;
+} /* ZIP_rawIo */
+
+
+int ZIP_setDecodeThreads(PHYSFS_Io *io, PHYSFS_uint32 threads)
+{
+    ZIPfileinfo *finfo;
+    const ZIPentry *entry;
+
+    if (io->read != ZIP_read)
+        return 0;
+
+    finfo = (ZIPfileinfo *) io->opaque;
+    entry = &finfo->entry;
+    if (threads > ZIP_MAX_DECODE_THREADS)
+        threads = ZIP_MAX_DECODE_THREADS;
+
+    finfo->decode_threads = threads;
+    finfo->index = NULL;
+    if ( (threads > 1) && (entry->compression_method != COMPMETH_NONE) &&
+         (!zip_entry_is_tradional_crypto(entry)) &&
+         (entry->uncompressed_size >= (2 * ZIP_CHECKPOINT_SPACING)) )
+        finfo->index = zip_find_index(finfo->info, entry, 1);
+
+    return 1;
+} /* ZIP_setDecodeThreads */
+
+
 static PHYSFS_Io *ZIP_openRead(void *opaque, const char *filename)
 {
     PHYSFS_Io *retval = NULL;
     ZIPinfo *info = (ZIPinfo *) opaque;
-    ZIPentry *entry = zip_find_entry(info, filename);
+    ZIPentry entry;
+    int found = zip_get_entry(info, filename, &entry);
     ZIPfileinfo *finfo = NULL;
     PHYSFS_Io *io = NULL;
     PHYSFS_uint8 *password = NULL;
 
     /* if not found, see if maybe "$PASSWORD" is appended. */
-    if ((!entry) && (info->has_crypto))
+    if ((!found) && (info->has_crypto))
     {
         const char *ptr = strrchr(filename, '$');
         if (ptr != NULL)
@@ -22102,17 +29135,15 @@ static PHYSFS_Io *ZIP_openRead(void *opaque, const char *filename)
             BAIL_IF(!str, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
             memcpy(str, filename, len);
             str[len] = '\0';
-            entry = zip_find_entry(info, str);
+            found = zip_get_entry(info, str, &entry);
             __PHYSFS_smallFree(str);
             password = (PHYSFS_uint8 *) (ptr + 1);
         } /* if */
     } /* if */
 
-    BAIL_IF_ERRPASS(!entry, NULL);
-
-    BAIL_IF_ERRPASS(!zip_resolve(info->io, info, entry), NULL);
+    BAIL_IF_ERRPASS(!found, NULL);
 
-    BAIL_IF(entry->tree.isdir, PHYSFS_ERR_NOT_A_FILE, NULL);
+    BAIL_IF(entry.resolved == ZIP_DIRECTORY, PHYSFS_ERR_NOT_A_FILE, NULL);
 
     retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
     GOTO_IF(!retval, PHYSFS_ERR_OUT_OF_MEMORY, ZIP_openRead_failed);
@@ -22121,22 +29152,23 @@ static PHYSFS_Io *ZIP_openRead(void *opaque, const char *filename)
     GOTO_IF(!finfo, PHYSFS_ERR_OUT_OF_MEMORY, ZIP_openRead_failed);
     memset(finfo, '\0', sizeof (ZIPfileinfo));
 
-    io = zip_get_io(info->io, info, entry);
+    io = zip_get_io(info->io, &entry);
     GOTO_IF_ERRPASS(!io, ZIP_openRead_failed);
     finfo->io = io;
-    finfo->entry = ((entry->symlink != NULL) ? entry->symlink : entry);
+    memcpy(&finfo->entry, &entry, sizeof (ZIPentry));
+    finfo->info = info;
     initializeZStream(&finfo->stream);
 
-    if (finfo->entry->compression_method != COMPMETH_NONE)
+    if (finfo->entry.compression_method != COMPMETH_NONE)
     {
-        finfo->buffer = (PHYSFS_uint8 *) allocator.Malloc(ZIP_READBUFSIZE);
+        finfo->buffer = zip_alloc_readbuf();
         if (!finfo->buffer)
             GOTO(PHYSFS_ERR_OUT_OF_MEMORY, ZIP_openRead_failed);
         else if (zlib_err(inflateInit2(&finfo->stream, -MAX_WBITS)) != Z_OK)
             goto ZIP_openRead_failed;
     } /* if */
 
-    if (!zip_entry_is_tradional_crypto(entry))
+    if (!zip_entry_is_tradional_crypto(&entry))
         GOTO_IF(password != NULL, PHYSFS_ERR_BAD_PASSWORD, ZIP_openRead_failed);
     else
     {
@@ -22202,33 +29234,31 @@ static int ZIP_mkdir(void *opaque, const char *name)
 static int ZIP_stat(void *opaque, const char *filename, PHYSFS_Stat *stat)
 {
     ZIPinfo *info = (ZIPinfo *) opaque;
-    ZIPentry *entry = zip_find_entry(info, filename);
-
-    if (entry == NULL)
-        return 0;
+    ZIPentry entry;
 
-    else if (!zip_resolve(info->io, info, entry))
+    if (!zip_get_entry(info, filename, &entry))
         return 0;
 
-    else if (entry->resolved == ZIP_DIRECTORY)
+    else if (entry.symlink)
     {
         stat->filesize = 0;
-        stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
-    } /* if */
+        stat->filetype = PHYSFS_FILETYPE_SYMLINK;
+    } /* else if */
 
-    else if (zip_entry_is_symlink(entry))
+    else if (entry.resolved == ZIP_DIRECTORY)
     {
         stat->filesize = 0;
-        stat->filetype = PHYSFS_FILETYPE_SYMLINK;
-    } /* else if */
+        stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
+    } /* if */
 
     else
     {
-        stat->filesize = (PHYSFS_sint64) entry->uncompressed_size;
+        stat->filesize = (PHYSFS_sint64) entry.uncompressed_size;
         stat->filetype = PHYSFS_FILETYPE_REGULAR;
     } /* else */
 
-    stat->modtime = ((entry) ? entry->last_mod_time : 0);
+    /* worked out here, not at mount: most entries never get asked. */
+    stat->modtime = zip_dos_time_to_physfs_time(entry.dos_mod_time);
     stat->createtime = stat->modtime;
     stat->accesstime = -1;
     stat->readonly = 1; /* .zip files are always read only */
@@ -22248,7 +29278,7 @@ const PHYSFS_Archiver __PHYSFS_Archiver_ZIP =
         1,  /* supportsSymlinks */
     },
     ZIP_openArchive,
-    __PHYSFS_DirTreeEnumerate,
+    ZIP_enumerate,
     ZIP_openRead,
     ZIP_openWrite,
     ZIP_openAppend,
@@ -22415,12 +29445,14 @@ char *__PHYSFS_platformCalcPrefDir(const char *org, const char *app)
 #define INCL_DOSDEVICES
 #define INCL_DOSDEVIOCTL
 #define INCL_DOSMISC
+#define INCL_DOSPROFILE
 #include <os2.h>
 #include <uconv.h>
 
 #include <errno.h>
 #include <time.h>
 #include <ctype.h>
+#include <io.h>  /* write() for PHYSFS_sendToFd(). */
 
 /*#include "physfs_internal.h"*/
 
@@ -23062,6 +30094,41 @@ PHYSFS_sint64 __PHYSFS_platformFileLength(void *opaque)
 } /* __PHYSFS_platformFileLength */
 
 
+void __PHYSFS_platformReadAhead(void *opaque, PHYSFS_uint64 pos,
+                                PHYSFS_uint64 len)
+{
+    /* no-op: OS/2 has no read-ahead hint. */
+    (void) opaque;
+    (void) pos;
+    (void) len;
+} /* __PHYSFS_platformReadAhead */
+
+
+void __PHYSFS_platformDropCache(void *opaque, PHYSFS_uint64 pos,
+                                PHYSFS_uint64 len)
+{
+    /* no-op: OS/2 has no cache hints. */
+    (void) opaque;
+    (void) pos;
+    (void) len;
+} /* __PHYSFS_platformDropCache */
+
+
+PHYSFS_sint64 __PHYSFS_platformWriteFd(int fd, const void *buf,
+                                       PHYSFS_uint64 len)
+{
+    int rc;
+
+    /* the C runtime takes an unsigned int; a short write is allowed. */
+    if (len > 0x7FFFFFFF)
+        len = 0x7FFFFFFF;
+
+    rc = write(fd, buf, (unsigned int) len);
+    BAIL_IF(rc == -1, PHYSFS_ERR_IO, -1);
+    return (PHYSFS_sint64) rc;
+} /* __PHYSFS_platformWriteFd */
+
+
 int __PHYSFS_platformFlush(void *opaque)
 {
     const APIRET rc = DosResetBuffer((HFILE) opaque);
@@ -23132,74 +30199,227 @@ int __PHYSFS_platformStat(const char *filename, PHYSFS_Stat *stat, const int fol
         stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
         stat->filesize = 0;
     } /* if */
-    else
+    else
+    {
+        stat->filetype = PHYSFS_FILETYPE_REGULAR;
+        stat->filesize = fs.cbFile;
+    } /* else */
+
+    stat->modtime = os2TimeToUnixTime(&fs.fdateLastWrite, &fs.ftimeLastWrite);
+    if (stat->modtime < 0)
+        stat->modtime = 0;
+
+    stat->accesstime = os2TimeToUnixTime(&fs.fdateLastAccess, &fs.ftimeLastAccess);
+    if (stat->accesstime < 0)
+        stat->accesstime = 0;
+
+    stat->createtime = os2TimeToUnixTime(&fs.fdateCreation, &fs.ftimeCreation);
+    if (stat->createtime < 0)
+        stat->createtime = 0;
+
+    stat->readonly = ((fs.attrFile & FILE_READONLY) == FILE_READONLY);
+    return 1;  /* success */
+
+done:
+    allocator.Free(cpfname);
+    return retval;
+} /* __PHYSFS_platformStat */
+
+
+void *__PHYSFS_platformGetThreadID(void)
+{
+    PTIB ptib;
+    PPIB ppib;
+
+    /*
+     * Allegedly, this API never fails, but we'll punt and return a
+     *  default value (zero might as well do) if it does.
+     */
+    const APIRET rc = DosGetInfoBlocks(&ptib, &ppib);
+    BAIL_IF(rc != NO_ERROR, errcodeFromAPIRET(rc), 0);
+    return ((void *) ptib->tib_ordinal);
+} /* __PHYSFS_platformGetThreadID */
+
+
+void *__PHYSFS_platformCreateMutex(void)
+{
+    HMTX hmtx = NULLHANDLE;
+    const APIRET rc = DosCreateMutexSem(NULL, &hmtx, 0, 0);
+    BAIL_IF(rc != NO_ERROR, errcodeFromAPIRET(rc), NULL);
+    return ((void *) hmtx);
+} /* __PHYSFS_platformCreateMutex */
+
+
+void __PHYSFS_platformDestroyMutex(void *mutex)
+{
+    DosCloseMutexSem((HMTX) mutex);
+} /* __PHYSFS_platformDestroyMutex */
+
+
+int __PHYSFS_platformGrabMutex(void *mutex)
+{
+    /* Do _NOT_ set the physfs error message in here! */
+    return (DosRequestMutexSem((HMTX) mutex, SEM_INDEFINITE_WAIT) == NO_ERROR);
+} /* __PHYSFS_platformGrabMutex */
+
+
+int __PHYSFS_platformTryGrabMutex(void *mutex)
+{
+    /* Do _NOT_ set the physfs error message in here! */
+    return (DosRequestMutexSem((HMTX) mutex, SEM_IMMEDIATE_RETURN) == NO_ERROR);
+} /* __PHYSFS_platformTryGrabMutex */
+
+
+void __PHYSFS_platformReleaseMutex(void *mutex)
+{
+    DosReleaseMutexSem((HMTX) mutex);
+} /* __PHYSFS_platformReleaseMutex */
+
+
+typedef struct
+{
+    TID tid;
+    void (*fn)(void *);
+    void *data;
+} OS2Thread;
+
+static void APIENTRY os2ThreadMain(ULONG data)
+{
+    OS2Thread *t = (OS2Thread *) data;
+    t->fn(t->data);
+} /* os2ThreadMain */
+
+
+void *__PHYSFS_platformCreateThread(void (*fn)(void *), void *data)
+{
+    APIRET rc;
+    OS2Thread *t = (OS2Thread *) allocator.Malloc(sizeof (OS2Thread));
+    BAIL_IF(!t, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    t->fn = fn;
+    t->data = data;
+    rc = DosCreateThread(&t->tid, os2ThreadMain, (ULONG) t,
+                         CREATE_READY | STACK_COMMITTED, 64 * 1024);
+    if (rc != NO_ERROR)
+    {
+        allocator.Free(t);
+        BAIL(errcodeFromAPIRET(rc), NULL);
+    } /* if */
+    return t;
+} /* __PHYSFS_platformCreateThread */
+
+
+void __PHYSFS_platformWaitThread(void *thread)
+{
+    OS2Thread *t = (OS2Thread *) thread;
+    DosWaitThread(&t->tid, DCWW_WAIT);
+    allocator.Free(t);
+} /* __PHYSFS_platformWaitThread */
+
+
+/* OS/2 has no counting semaphores; build one from a mutex and an event. */
+typedef struct
+{
+    HMTX hmtx;
+    HEV hev;
+    PHYSFS_uint32 count;
+} OS2Semaphore;
+
+
+void *__PHYSFS_platformCreateSemaphore(PHYSFS_uint32 count)
+{
+    APIRET rc;
+    OS2Semaphore *s = (OS2Semaphore *) allocator.Malloc(sizeof (OS2Semaphore));
+    BAIL_IF(!s, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    s->hmtx = NULLHANDLE;
+    s->hev = NULLHANDLE;
+    s->count = count;
+
+    rc = DosCreateMutexSem(NULL, &s->hmtx, 0, 0);
+    if (rc == NO_ERROR)
+    {
+        rc = DosCreateEventSem(NULL, &s->hev, 0, FALSE);
+        if (rc != NO_ERROR)
+            DosCloseMutexSem(s->hmtx);
+    } /* if */
+
+    if (rc != NO_ERROR)
     {
-        stat->filetype = PHYSFS_FILETYPE_REGULAR;
-        stat->filesize = fs.cbFile;
-    } /* else */
+        allocator.Free(s);
+        BAIL(errcodeFromAPIRET(rc), NULL);
+    } /* if */
 
-    stat->modtime = os2TimeToUnixTime(&fs.fdateLastWrite, &fs.ftimeLastWrite);
-    if (stat->modtime < 0)
-        stat->modtime = 0;
+    return s;
+} /* __PHYSFS_platformCreateSemaphore */
 
-    stat->accesstime = os2TimeToUnixTime(&fs.fdateLastAccess, &fs.ftimeLastAccess);
-    if (stat->accesstime < 0)
-        stat->accesstime = 0;
 
-    stat->createtime = os2TimeToUnixTime(&fs.fdateCreation, &fs.ftimeCreation);
-    if (stat->createtime < 0)
-        stat->createtime = 0;
+void __PHYSFS_platformDestroySemaphore(void *sem)
+{
+    OS2Semaphore *s = (OS2Semaphore *) sem;
+    DosCloseEventSem(s->hev);
+    DosCloseMutexSem(s->hmtx);
+    allocator.Free(s);
+} /* __PHYSFS_platformDestroySemaphore */
 
-    stat->readonly = ((fs.attrFile & FILE_READONLY) == FILE_READONLY);
-    return 1;  /* success */
 
-done:
-    allocator.Free(cpfname);
-    return retval;
-} /* __PHYSFS_platformStat */
+int __PHYSFS_platformWaitSemaphore(void *sem)
+{
+    OS2Semaphore *s = (OS2Semaphore *) sem;
+    ULONG posts;
 
+    if (DosRequestMutexSem(s->hmtx, SEM_INDEFINITE_WAIT) != NO_ERROR)
+        return 0;
 
-void *__PHYSFS_platformGetThreadID(void)
-{
-    PTIB ptib;
-    PPIB ppib;
+    while (s->count == 0)
+    {
+        /* reset while holding the mutex, so we can't miss a post. */
+        DosResetEventSem(s->hev, &posts);
+        DosReleaseMutexSem(s->hmtx);
+        DosWaitEventSem(s->hev, SEM_INDEFINITE_WAIT);
+        if (DosRequestMutexSem(s->hmtx, SEM_INDEFINITE_WAIT) != NO_ERROR)
+            return 0;
+    } /* while */
 
-    /*
-     * Allegedly, this API never fails, but we'll punt and return a
-     *  default value (zero might as well do) if it does.
-     */
-    const APIRET rc = DosGetInfoBlocks(&ptib, &ppib);
-    BAIL_IF(rc != NO_ERROR, errcodeFromAPIRET(rc), 0);
-    return ((void *) ptib->tib_ordinal);
-} /* __PHYSFS_platformGetThreadID */
+    s->count--;
+    DosReleaseMutexSem(s->hmtx);
+    return 1;
+} /* __PHYSFS_platformWaitSemaphore */
 
 
-void *__PHYSFS_platformCreateMutex(void)
+void __PHYSFS_platformPostSemaphore(void *sem)
 {
-    HMTX hmtx = NULLHANDLE;
-    const APIRET rc = DosCreateMutexSem(NULL, &hmtx, 0, 0);
-    BAIL_IF(rc != NO_ERROR, errcodeFromAPIRET(rc), NULL);
-    return ((void *) hmtx);
-} /* __PHYSFS_platformCreateMutex */
+    OS2Semaphore *s = (OS2Semaphore *) sem;
+    DosRequestMutexSem(s->hmtx, SEM_INDEFINITE_WAIT);
+    s->count++;
+    DosPostEventSem(s->hev);
+    DosReleaseMutexSem(s->hmtx);
+} /* __PHYSFS_platformPostSemaphore */
 
 
-void __PHYSFS_platformDestroyMutex(void *mutex)
+void __PHYSFS_platformSleep(PHYSFS_uint32 ms)
 {
-    DosCloseMutexSem((HMTX) mutex);
-} /* __PHYSFS_platformDestroyMutex */
+    DosSleep((ULONG) ms);
+} /* __PHYSFS_platformSleep */
 
 
-int __PHYSFS_platformGrabMutex(void *mutex)
+PHYSFS_uint64 __PHYSFS_platformGetTicks(void)
 {
-    /* Do _NOT_ set the physfs error message in here! */
-    return (DosRequestMutexSem((HMTX) mutex, SEM_INDEFINITE_WAIT) == NO_ERROR);
-} /* __PHYSFS_platformGrabMutex */
+    static ULONG freq = 0;
+    QWORD qw;
+    PHYSFS_uint64 ticks;
 
+    if ((freq == 0) && (DosTmrQueryFreq(&freq) != NO_ERROR))
+        freq = 0;
+    if ((freq == 0) || (DosTmrQueryTime(&qw) != NO_ERROR))
+    {
+        ULONG ms = 0;  /* fall back to the millisecond counter. */
+        DosQuerySysInfo(QSV_MS_COUNT, QSV_MS_COUNT, &ms, sizeof (ms));
+        return ((PHYSFS_uint64) ms) * 1000000;
+    } /* if */
 
-void __PHYSFS_platformReleaseMutex(void *mutex)
-{
-    DosReleaseMutexSem((HMTX) mutex);
-} /* __PHYSFS_platformReleaseMutex */
+    ticks = (((PHYSFS_uint64) qw.ulHi) << 32) | ((PHYSFS_uint64) qw.ulLo);
+    return ((ticks / freq) * 1000000000) +
+           (((ticks % freq) * 1000000000) / freq);
+} /* __PHYSFS_platformGetTicks */
 
 #endif  /* PHYSFS_PLATFORM_OS2 */
 
@@ -23228,6 +30448,16 @@ void __PHYSFS_platformReleaseMutex(void *mutex)
 #include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+
+#if PHYSFS_PLATFORM_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
+#if PHYSFS_PLATFORM_MAPFILE
+#include <sys/mman.h>
+#endif
 
 /*#include "physfs_internal.h"*/
 
@@ -23433,6 +30663,23 @@ PHYSFS_sint64 __PHYSFS_platformRead(void *opaque, void *buffer,
 } /* __PHYSFS_platformRead */
 
 
+PHYSFS_sint64 __PHYSFS_platformReadAt(void *opaque, PHYSFS_uint64 pos,
+                                      void *buffer, PHYSFS_uint64 len)
+{
+    const int fd = *((int *) opaque);
+    ssize_t rc = 0;
+
+    if (!__PHYSFS_ui64FitsAddressSpace(len))
+        BAIL(PHYSFS_ERR_INVALID_ARGUMENT, -1);
+
+    rc = pread(fd, buffer, (size_t) len, (off_t) pos);
+    BAIL_IF(rc == -1, errcodeFromErrno(), -1);
+    assert(rc >= 0);
+    assert((PHYSFS_uint64)rc <= len);
+    return (PHYSFS_sint64) rc;
+} /* __PHYSFS_platformReadAt */
+
+
 PHYSFS_sint64 __PHYSFS_platformWrite(void *opaque, const void *buffer,
                                      PHYSFS_uint64 len)
 {
@@ -23478,6 +30725,78 @@ PHYSFS_sint64 __PHYSFS_platformFileLength(void *opaque)
 } /* __PHYSFS_platformFileLength */
 
 
+void __PHYSFS_platformReadAhead(void *opaque, PHYSFS_uint64 pos,
+                                PHYSFS_uint64 len)
+{
+    const int fd = *((int *) opaque);
+#if defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(fd, (off_t) pos, (off_t) len, POSIX_FADV_WILLNEED);
+#elif defined(F_RDADVISE)  /* Apple platforms. */
+    struct radvisory ra;
+    ra.ra_offset = (off_t) pos;
+    ra.ra_count = (len > 0x7FFFFFFF) ? 0x7FFFFFFF : (int) len;
+    fcntl(fd, F_RDADVISE, &ra);
+#else
+    (void) fd;  /* no way to ask for it here. */
+#endif
+} /* __PHYSFS_platformReadAhead */
+
+
+void __PHYSFS_platformDropCache(void *opaque, PHYSFS_uint64 pos,
+                                PHYSFS_uint64 len)
+{
+#if defined(POSIX_FADV_DONTNEED)
+    const int fd = *((int *) opaque);
+    const PHYSFS_uint64 page = (PHYSFS_uint64) sysconf(_SC_PAGESIZE);
+    const PHYSFS_uint64 start = pos + ((page - (pos % page)) % page);
+    const PHYSFS_uint64 end = (pos + len) - ((pos + len) % page);
+
+    /* not every kernel keeps to the pages the range covers completely, so
+       round in to them ourselves: partial ones may hold someone else's
+       data, like the next entry in an archive. */
+    if (end > start)
+        posix_fadvise(fd, (off_t) start, (off_t) (end - start), POSIX_FADV_DONTNEED);
+#else
+    (void) opaque;  /* no way to ask for it here. */
+    (void) pos;
+    (void) len;
+#endif
+} /* __PHYSFS_platformDropCache */
+
+
+#if PHYSFS_PLATFORM_SENDFILE
+PHYSFS_sint64 __PHYSFS_platformSendFile(void *opaque, PHYSFS_uint64 pos,
+                                        int fd, PHYSFS_uint64 len)
+{
+    const int infd = *((int *) opaque);
+    off_t offset = (off_t) pos;
+    ssize_t rc;
+
+    /* Linux won't move more than this at once anyhow. */
+    if (len > 0x7FFFF000)
+        len = 0x7FFFF000;
+
+    rc = sendfile(fd, infd, &offset, (size_t) len);
+    BAIL_IF(rc == -1, errcodeFromErrno(), -1);
+    return (PHYSFS_sint64) rc;
+} /* __PHYSFS_platformSendFile */
+#endif
+
+
+PHYSFS_sint64 __PHYSFS_platformWriteFd(int fd, const void *buf,
+                                       PHYSFS_uint64 len)
+{
+    ssize_t rc;
+
+    if (!__PHYSFS_ui64FitsAddressSpace(len))
+        BAIL(PHYSFS_ERR_INVALID_ARGUMENT, -1);
+
+    rc = write(fd, buf, (size_t) len);
+    BAIL_IF(rc == -1, errcodeFromErrno(), -1);
+    return (PHYSFS_sint64) rc;
+} /* __PHYSFS_platformWriteFd */
+
+
 int __PHYSFS_platformFlush(void *opaque)
 {
     const int fd = *((int *) opaque);
@@ -23502,6 +30821,46 @@ int __PHYSFS_platformDelete(const char *path)
 } /* __PHYSFS_platformDelete */
 
 
+void *__PHYSFS_platformMapFile(const char *fname, PHYSFS_uint64 *len)
+{
+    struct stat statbuf;
+    void *retval = MAP_FAILED;
+    int err = 0;
+    const int fd = open(fname, O_RDONLY);
+    BAIL_IF(fd == -1, errcodeFromErrno(), NULL);
+
+    if (fstat(fd, &statbuf) == -1)
+        err = errno;
+    else if ( (statbuf.st_size <= 0) ||
+              (!__PHYSFS_ui64FitsAddressSpace((PHYSFS_uint64) statbuf.st_size)) )
+        err = EINVAL;
+    else
+    {
+        retval = mmap(NULL, (size_t) statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (retval == MAP_FAILED)
+            err = errno;
+    } /* else */
+
+    close(fd);  /* the mapping keeps the file. */
+    BAIL_IF(retval == MAP_FAILED, errcodeFromErrnoError(err), NULL);
+    *len = (PHYSFS_uint64) statbuf.st_size;
+    return retval;
+} /* __PHYSFS_platformMapFile */
+
+
+void __PHYSFS_platformUnmapFile(void *ptr, PHYSFS_uint64 len)
+{
+    munmap(ptr, (size_t) len);
+} /* __PHYSFS_platformUnmapFile */
+
+
+int __PHYSFS_platformRename(const char *src, const char *dst)
+{
+    BAIL_IF(rename(src, dst) == -1, errcodeFromErrno(), 0);
+    return 1;
+} /* __PHYSFS_platformRename */
+
+
 int __PHYSFS_platformStat(const char *fname, PHYSFS_Stat *st, const int follow)
 {
     struct stat statbuf;
@@ -23602,6 +30961,22 @@ int __PHYSFS_platformGrabMutex(void *mutex)
 } /* __PHYSFS_platformGrabMutex */
 
 
+int __PHYSFS_platformTryGrabMutex(void *mutex)
+{
+    PthreadMutex *m = (PthreadMutex *) mutex;
+    pthread_t tid = pthread_self();
+    if (m->owner != tid)
+    {
+        if (pthread_mutex_trylock(&m->mutex) != 0)
+            return 0;
+        m->owner = tid;
+    } /* if */
+
+    m->count++;
+    return 1;
+} /* __PHYSFS_platformTryGrabMutex */
+
+
 void __PHYSFS_platformReleaseMutex(void *mutex)
 {
     PthreadMutex *m = (PthreadMutex *) mutex;
@@ -23617,6 +30992,134 @@ void __PHYSFS_platformReleaseMutex(void *mutex)
     } /* if */
 } /* __PHYSFS_platformReleaseMutex */
 
+
+typedef struct
+{
+    pthread_t thread;
+    void (*fn)(void *);
+    void *data;
+} PthreadThread;
+
+static void *pthreadThreadMain(void *data)
+{
+    PthreadThread *t = (PthreadThread *) data;
+    t->fn(t->data);
+    return NULL;
+} /* pthreadThreadMain */
+
+
+void *__PHYSFS_platformCreateThread(void (*fn)(void *), void *data)
+{
+    PthreadThread *t = (PthreadThread *) allocator.Malloc(sizeof (PthreadThread));
+    BAIL_IF(!t, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    t->fn = fn;
+    t->data = data;
+    if (pthread_create(&t->thread, NULL, pthreadThreadMain, t) != 0)
+    {
+        allocator.Free(t);
+        BAIL(PHYSFS_ERR_OS_ERROR, NULL);
+    } /* if */
+    return t;
+} /* __PHYSFS_platformCreateThread */
+
+
+void __PHYSFS_platformWaitThread(void *thread)
+{
+    PthreadThread *t = (PthreadThread *) thread;
+    pthread_join(t->thread, NULL);
+    allocator.Free(t);
+} /* __PHYSFS_platformWaitThread */
+
+
+/* not sem_t: Mac OS X doesn't do unnamed ones. */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    PHYSFS_uint32 count;
+} PthreadSemaphore;
+
+
+void *__PHYSFS_platformCreateSemaphore(PHYSFS_uint32 count)
+{
+    PthreadSemaphore *s = (PthreadSemaphore *) allocator.Malloc(sizeof (PthreadSemaphore));
+    BAIL_IF(!s, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    if (pthread_mutex_init(&s->mutex, NULL) != 0)
+    {
+        allocator.Free(s);
+        BAIL(PHYSFS_ERR_OS_ERROR, NULL);
+    } /* if */
+
+    if (pthread_cond_init(&s->cond, NULL) != 0)
+    {
+        pthread_mutex_destroy(&s->mutex);
+        allocator.Free(s);
+        BAIL(PHYSFS_ERR_OS_ERROR, NULL);
+    } /* if */
+
+    s->count = count;
+    return s;
+} /* __PHYSFS_platformCreateSemaphore */
+
+
+void __PHYSFS_platformDestroySemaphore(void *sem)
+{
+    PthreadSemaphore *s = (PthreadSemaphore *) sem;
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->mutex);
+    allocator.Free(s);
+} /* __PHYSFS_platformDestroySemaphore */
+
+
+int __PHYSFS_platformWaitSemaphore(void *sem)
+{
+    PthreadSemaphore *s = (PthreadSemaphore *) sem;
+    if (pthread_mutex_lock(&s->mutex) != 0)
+        return 0;
+    while (s->count == 0)
+        pthread_cond_wait(&s->cond, &s->mutex);
+    s->count--;
+    pthread_mutex_unlock(&s->mutex);
+    return 1;
+} /* __PHYSFS_platformWaitSemaphore */
+
+
+void __PHYSFS_platformPostSemaphore(void *sem)
+{
+    PthreadSemaphore *s = (PthreadSemaphore *) sem;
+    pthread_mutex_lock(&s->mutex);
+    s->count++;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+} /* __PHYSFS_platformPostSemaphore */
+
+
+void __PHYSFS_platformSleep(PHYSFS_uint32 ms)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t) (ms / 1000);
+    ts.tv_nsec = (long) ((ms % 1000) * 1000000);
+    while ((nanosleep(&ts, &ts) == -1) && (errno == EINTR)) { /* again. */ }
+} /* __PHYSFS_platformSleep */
+
+
+PHYSFS_uint64 __PHYSFS_platformGetTicks(void)
+{
+    struct timeval tv;
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    {
+        return (((PHYSFS_uint64) ts.tv_sec) * 1000000000) +
+               ((PHYSFS_uint64) ts.tv_nsec);
+    } /* if */
+#endif
+
+    gettimeofday(&tv, NULL);  /* not monotonic, but better than nothing. */
+    return (((PHYSFS_uint64) tv.tv_sec) * 1000000000) +
+           (((PHYSFS_uint64) tv.tv_usec) * 1000);
+} /* __PHYSFS_platformGetTicks */
+
 #endif  /* PHYSFS_PLATFORM_POSIX */
 
 /* end of physfs_platform_posix.c ... */
@@ -24196,6 +31699,7 @@ char *__PHYSFS_platformCalcPrefDir(const char *org, const char *app)
 #include <errno.h>
 #include <ctype.h>
 #include <time.h>
+#include <io.h>  /* _write() for PHYSFS_sendToFd(). */
 
 #ifdef allocator  /* apparently Windows 10 SDK conflicts here. */
 #undef allocator
@@ -24993,6 +32497,41 @@ PHYSFS_sint64 __PHYSFS_platformFileLength(void *opaque)
 } /* __PHYSFS_platformFileLength */
 
 
+void __PHYSFS_platformReadAhead(void *opaque, PHYSFS_uint64 pos,
+                                PHYSFS_uint64 len)
+{
+    /* no-op: Win32 has no read-ahead hint for plain file handles. */
+    (void) opaque;
+    (void) pos;
+    (void) len;
+} /* __PHYSFS_platformReadAhead */
+
+
+void __PHYSFS_platformDropCache(void *opaque, PHYSFS_uint64 pos,
+                                PHYSFS_uint64 len)
+{
+    /* no-op: Win32 can only skip the cache for a whole file handle. */
+    (void) opaque;
+    (void) pos;
+    (void) len;
+} /* __PHYSFS_platformDropCache */
+
+
+PHYSFS_sint64 __PHYSFS_platformWriteFd(int fd, const void *buf,
+                                       PHYSFS_uint64 len)
+{
+    int rc;
+
+    /* the C runtime takes an unsigned int; a short write is allowed. */
+    if (len > 0x7FFFFFFF)
+        len = 0x7FFFFFFF;
+
+    rc = _write(fd, buf, (unsigned int) len);
+    BAIL_IF(rc == -1, PHYSFS_ERR_IO, -1);
+    return (PHYSFS_sint64) rc;
+} /* __PHYSFS_platformWriteFd */
+
+
 int __PHYSFS_platformFlush(void *opaque)
 {
     HANDLE h = (HANDLE) opaque;
@@ -25065,12 +32604,124 @@ int __PHYSFS_platformGrabMutex(void *mutex)
 } /* __PHYSFS_platformGrabMutex */
 
 
+int __PHYSFS_platformTryGrabMutex(void *mutex)
+{
+    return TryEnterCriticalSection((LPCRITICAL_SECTION) mutex) ? 1 : 0;
+} /* __PHYSFS_platformTryGrabMutex */
+
+
 void __PHYSFS_platformReleaseMutex(void *mutex)
 {
     LeaveCriticalSection((LPCRITICAL_SECTION) mutex);
 } /* __PHYSFS_platformReleaseMutex */
 
 
+typedef struct
+{
+    HANDLE handle;
+    void (*fn)(void *);
+    void *data;
+} WinThread;
+
+#ifndef PHYSFS_PLATFORM_WINRT
+static DWORD WINAPI winThreadMain(LPVOID data)
+{
+    WinThread *t = (WinThread *) data;
+    t->fn(t->data);
+    return 0;
+} /* winThreadMain */
+#endif
+
+
+void *__PHYSFS_platformCreateThread(void (*fn)(void *), void *data)
+{
+    #ifdef PHYSFS_PLATFORM_WINRT
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);  /* no CreateThread() in WinRT. */
+    #else
+    WinThread *t = (WinThread *) physfs_allocator.Malloc(sizeof (WinThread));
+    BAIL_IF(!t, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    t->fn = fn;
+    t->data = data;
+    t->handle = CreateThread(NULL, 0, winThreadMain, t, 0, NULL);
+    if (t->handle == NULL)
+    {
+        physfs_allocator.Free(t);
+        BAIL(errcodeFromWinApi(), NULL);
+    } /* if */
+    return t;
+    #endif
+} /* __PHYSFS_platformCreateThread */
+
+
+void __PHYSFS_platformWaitThread(void *thread)
+{
+    WinThread *t = (WinThread *) thread;
+    WaitForSingleObjectEx(t->handle, INFINITE, FALSE);
+    CloseHandle(t->handle);
+    physfs_allocator.Free(t);
+} /* __PHYSFS_platformWaitThread */
+
+
+void *__PHYSFS_platformCreateSemaphore(PHYSFS_uint32 count)
+{
+    #ifdef PHYSFS_PLATFORM_WINRT
+    BAIL(PHYSFS_ERR_UNSUPPORTED, NULL);  /* no threads to wait for anyhow. */
+    #else
+    HANDLE h = CreateSemaphoreW(NULL, (LONG) count, 0x7FFFFFFF, NULL);
+    BAIL_IF(h == NULL, errcodeFromWinApi(), NULL);
+    return h;
+    #endif
+} /* __PHYSFS_platformCreateSemaphore */
+
+
+void __PHYSFS_platformDestroySemaphore(void *sem)
+{
+    CloseHandle((HANDLE) sem);
+} /* __PHYSFS_platformDestroySemaphore */
+
+
+int __PHYSFS_platformWaitSemaphore(void *sem)
+{
+    return (WaitForSingleObjectEx((HANDLE) sem, INFINITE, FALSE) == WAIT_OBJECT_0);
+} /* __PHYSFS_platformWaitSemaphore */
+
+
+void __PHYSFS_platformPostSemaphore(void *sem)
+{
+    #ifndef PHYSFS_PLATFORM_WINRT
+    ReleaseSemaphore((HANDLE) sem, 1, NULL);
+    #endif
+} /* __PHYSFS_platformPostSemaphore */
+
+
+void __PHYSFS_platformSleep(PHYSFS_uint32 ms)
+{
+    #ifdef PHYSFS_PLATFORM_WINRT
+    (void) ms;  /* no Sleep() in WinRT, and no threads to yield to. */
+    #else
+    Sleep((DWORD) ms);
+    #endif
+} /* __PHYSFS_platformSleep */
+
+
+PHYSFS_uint64 __PHYSFS_platformGetTicks(void)
+{
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER counter;
+    PHYSFS_uint64 ticks;
+    PHYSFS_uint64 hz;
+
+    /* these never fail on XP and later. */
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+
+    ticks = (PHYSFS_uint64) counter.QuadPart;
+    hz = (PHYSFS_uint64) freq.QuadPart;
+    return ((ticks / hz) * 1000000000) + (((ticks % hz) * 1000000000) / hz);
+} /* __PHYSFS_platformGetTicks */
+
+
 static PHYSFS_sint64 FileTimeToPhysfsTime(const FILETIME *ft)
 {
     SYSTEMTIME st_utc;
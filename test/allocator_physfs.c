@@ -0,0 +1,472 @@
+/*
+ * PhysicsFS PHYSFS_setAllocator2() test.
+ *
+ * Plugs in a size-class pool allocator that relies on the sizes Free() and
+ *  Realloc() are given, instead of keeping its own, then mounts each
+ *  archive given, reads every file in them with a buffer set, and unmounts
+ *  them again. Every block carries a check (for this test only; the pool
+ *  doesn't need it) that the size and category PhysicsFS passes when it's
+ *  freed are the ones it was allocated with, and that the allocator's
+ *  context pointer always comes back. At the end, every block must have
+ *  gone back to the pool, and the archives must have been charged for
+ *  their directories and open files.
+ *
+ * The same reads are timed with the default allocator and with the pool.
+ *
+ * Reports, as CSV on stdout, what was allocated per category
+ *  (category,allocations,frees,peak_bytes), then each run's time
+ *  (allocator,seconds).
+ *
+ * The exit status is non-zero if anything went wrong.
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define MIN_CLASS_SHIFT 4     /* 16 bytes */
+#define MAX_CLASS_SHIFT 12    /* 4096 bytes; bigger goes to malloc(). */
+#define NUM_CLASSES (MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1)
+#define NUM_CATEGORIES 6
+#define BUFFER_SIZE 4096
+#define CHECK_MAGIC 0x50687973u
+
+/* put at the end of every block, so the test can catch a wrong size. */
+typedef struct Check
+{
+    PHYSFS_uint64 len;
+    PHYSFS_uint32 category;
+    PHYSFS_uint32 magic;
+} Check;
+
+typedef struct FreeBlock
+{
+    struct FreeBlock *next;
+} FreeBlock;
+
+typedef struct Pool
+{
+    pthread_mutex_t lock;
+    FreeBlock *classes[NUM_CLASSES];
+    int inits;
+    int deinits;
+    PHYSFS_sint64 live;
+    PHYSFS_sint64 bytes[NUM_CATEGORIES];
+    PHYSFS_sint64 peak[NUM_CATEGORIES];
+    PHYSFS_uint64 allocations[NUM_CATEGORIES];
+    PHYSFS_uint64 frees[NUM_CATEGORIES];
+    PHYSFS_uint64 mismatches;
+    PHYSFS_uint64 wrongContext;
+} Pool;
+
+static const char *categoryNames[NUM_CATEGORIES] = {
+    "other", "index", "handle", "buffer", "decode", "cache"
+};
+
+static Pool pool;
+static int failures = 0;
+
+
+/* the smallest class (len) fits in, or -1 if it's too big for any. */
+static int sizeClass(const PHYSFS_uint64 len)
+{
+    int shift = MIN_CLASS_SHIFT;
+    while ((((PHYSFS_uint64) 1) << shift) < len)
+    {
+        if (++shift > MAX_CLASS_SHIFT)
+            return -1;
+    } /* while */
+    return shift - MIN_CLASS_SHIFT;
+} /* sizeClass */
+
+
+static void *poolGet(const PHYSFS_uint64 len)
+{
+    const int cls = sizeClass(len);
+    void *retval = NULL;
+
+    if (cls == -1)
+        return malloc((size_t) len);
+
+    pthread_mutex_lock(&pool.lock);
+    if (pool.classes[cls] != NULL)
+    {
+        retval = pool.classes[cls];
+        pool.classes[cls] = pool.classes[cls]->next;
+    } /* if */
+    pthread_mutex_unlock(&pool.lock);
+
+    if (retval == NULL)
+        retval = malloc(((size_t) 1) << (cls + MIN_CLASS_SHIFT));
+    return retval;
+} /* poolGet */
+
+
+static void poolPut(void *ptr, const PHYSFS_uint64 len)
+{
+    const int cls = sizeClass(len);
+    if (cls == -1)
+        free(ptr);
+    else
+    {
+        FreeBlock *block = (FreeBlock *) ptr;
+        pthread_mutex_lock(&pool.lock);
+        block->next = pool.classes[cls];
+        pool.classes[cls] = block;
+        pthread_mutex_unlock(&pool.lock);
+    } /* else */
+} /* poolPut */
+
+
+static void poolDrain(void)
+{
+    int i;
+    for (i = 0; i < NUM_CLASSES; i++)
+    {
+        while (pool.classes[i] != NULL)
+        {
+            FreeBlock *next = pool.classes[i]->next;
+            free(pool.classes[i]);
+            pool.classes[i] = next;
+        } /* while */
+    } /* for */
+} /* poolDrain */
+
+
+static void count(const PHYSFS_MemoryCategory category, const PHYSFS_sint64 len,
+                  const int blocks)
+{
+    pthread_mutex_lock(&pool.lock);
+    pool.live += blocks;
+    pool.bytes[category] += len;
+    if (pool.bytes[category] > pool.peak[category])
+        pool.peak[category] = pool.bytes[category];
+    if (blocks > 0)
+        pool.allocations[category]++;
+    else if (blocks < 0)
+        pool.frees[category]++;
+    pthread_mutex_unlock(&pool.lock);
+} /* count */
+
+
+static void setCheck(void *ptr, const PHYSFS_uint64 len,
+                     const PHYSFS_MemoryCategory category)
+{
+    Check check;
+    check.len = len;
+    check.category = (PHYSFS_uint32) category;
+    check.magic = CHECK_MAGIC;
+    memcpy(((PHYSFS_uint8 *) ptr) + len, &check, sizeof (check));
+} /* setCheck */
+
+
+static void verifyCheck(const void *ptr, const PHYSFS_uint64 len,
+                        const PHYSFS_MemoryCategory category)
+{
+    Check check;
+    memcpy(&check, ((const PHYSFS_uint8 *) ptr) + len, sizeof (check));
+    if ((check.magic != CHECK_MAGIC) || (check.len != len) ||
+        (check.category != (PHYSFS_uint32) category))
+        __atomic_add_fetch(&pool.mismatches, 1, __ATOMIC_RELAXED);
+} /* verifyCheck */
+
+
+static void checkContext(void *opaque)
+{
+    if (opaque != &pool)
+        __atomic_add_fetch(&pool.wrongContext, 1, __ATOMIC_RELAXED);
+} /* checkContext */
+
+
+static int poolInit(void *opaque)
+{
+    checkContext(opaque);
+    pool.inits++;
+    return 1;
+} /* poolInit */
+
+
+static void poolDeinit(void *opaque)
+{
+    checkContext(opaque);
+    pool.deinits++;
+} /* poolDeinit */
+
+
+static void *poolMalloc(void *opaque, PHYSFS_uint64 len,
+                        PHYSFS_MemoryCategory category)
+{
+    void *retval;
+    checkContext(opaque);
+    retval = poolGet(len + sizeof (Check));
+    if (retval != NULL)
+    {
+        setCheck(retval, len, category);
+        count(category, (PHYSFS_sint64) len, 1);
+    } /* if */
+    return retval;
+} /* poolMalloc */
+
+
+static void *poolRealloc(void *opaque, void *ptr, PHYSFS_uint64 oldlen,
+                         PHYSFS_uint64 len, PHYSFS_MemoryCategory category)
+{
+    void *retval;
+    checkContext(opaque);
+    verifyCheck(ptr, oldlen, category);
+    if (sizeClass(oldlen + sizeof (Check)) == sizeClass(len + sizeof (Check)))
+    {
+        if (sizeClass(len + sizeof (Check)) != -1)
+            retval = ptr;  /* still fits its class; nothing to do. */
+        else
+        {
+            retval = realloc(ptr, (size_t) (len + sizeof (Check)));
+            if (retval == NULL)
+                return NULL;
+        } /* else */
+    } /* if */
+    else
+    {
+        retval = poolGet(len + sizeof (Check));
+        if (retval == NULL)
+            return NULL;
+        memcpy(retval, ptr, (size_t) ((oldlen < len) ? oldlen : len));
+        poolPut(ptr, oldlen + sizeof (Check));
+    } /* else */
+
+    setCheck(retval, len, category);
+    count(category, (PHYSFS_sint64) len - (PHYSFS_sint64) oldlen, 0);
+    return retval;
+} /* poolRealloc */
+
+
+static void poolFree(void *opaque, void *ptr, PHYSFS_uint64 len,
+                     PHYSFS_MemoryCategory category)
+{
+    checkContext(opaque);
+    verifyCheck(ptr, len, category);
+    count(category, -((PHYSFS_sint64) len), -1);
+    poolPut(ptr, len + sizeof (Check));
+} /* poolFree */
+
+
+static PHYSFS_EnumerateCallbackResult readCallback(void *data,
+                                       const char *origdir, const char *fname)
+{
+    char *path = (char *) malloc(strlen(origdir) + strlen(fname) + 2);
+    PHYSFS_Stat statbuf;
+
+    if (path == NULL)
+        return PHYSFS_ENUM_ERROR;
+
+    sprintf(path, "%s%s%s", origdir, *origdir ? "/" : "", fname);
+    if (PHYSFS_stat(path, &statbuf))
+    {
+        if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
+            PHYSFS_enumerate(path, readCallback, data);
+
+        else if (statbuf.filetype == PHYSFS_FILETYPE_REGULAR)
+        {
+            PHYSFS_File *f = PHYSFS_openRead(path);
+            char buf[4096];
+            if (f == NULL)
+            {
+                fprintf(stderr, "couldn't open %s: %s\n", path,
+                        PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+                failures++;
+            } /* if */
+            else
+            {
+                if (!PHYSFS_setBuffer(f, BUFFER_SIZE))
+                    failures++;
+                while (PHYSFS_readBytes(f, buf, sizeof (buf)) > 0) { /* spin. */ }
+                PHYSFS_close(f);
+            } /* else */
+        } /* else if */
+    } /* if */
+
+    free(path);
+    return PHYSFS_ENUM_OK;
+} /* readCallback */
+
+
+/* mount everything, read it all, unmount it all; seconds taken. */
+static double run(const char *argv0, char **archives, const int count)
+{
+    struct timespec start, end;
+    int i;
+
+    if (!PHYSFS_init(argv0))
+    {
+        fprintf(stderr, "PHYSFS_init() failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        exit(1);
+    } /* if */
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < count; i++)
+    {
+        if (!PHYSFS_mount(archives[i], NULL, 1))
+        {
+            fprintf(stderr, "couldn't mount %s: %s\n", archives[i],
+                    PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            exit(1);
+        } /* if */
+    } /* for */
+
+    PHYSFS_enumerate("", readCallback, NULL);
+
+    for (i = 0; i < count; i++)
+        PHYSFS_unmount(archives[i]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (!PHYSFS_deinit())
+    {
+        fprintf(stderr, "PHYSFS_deinit() failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        failures++;
+    } /* if */
+
+    return (double) (end.tv_sec - start.tv_sec) +
+           ((double) (end.tv_nsec - start.tv_nsec) / 1000000000.0);
+} /* run */
+
+
+int main(int argc, char **argv)
+{
+    PHYSFS_Allocator2 a;
+    const PHYSFS_Allocator *shared;
+    double plain, pooled;
+    void *ptr;
+    int i;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "USAGE: %s <archive>...\n", argv[0]);
+        return 1;
+    } /* if */
+
+    memset(&pool, '\0', sizeof (pool));
+    pthread_mutex_init(&pool.lock, NULL);
+
+    plain = run(argv[0], argv + 1, argc - 1);
+
+    memset(&a, '\0', sizeof (a));
+    a.version = 1;  /* from the future. */
+    a.opaque = &pool;
+    a.Init = poolInit;
+    a.Deinit = poolDeinit;
+    a.Malloc = poolMalloc;
+    a.Realloc = poolRealloc;
+    a.Free = poolFree;
+    if (PHYSFS_setAllocator2(&a) ||
+        (PHYSFS_getLastErrorCode() != PHYSFS_ERR_UNSUPPORTED))
+    {
+        fprintf(stderr, "an allocator from a newer version was accepted\n");
+        failures++;
+    } /* if */
+
+    a.version = 0;
+    a.Free = NULL;
+    if (PHYSFS_setAllocator2(&a) ||
+        (PHYSFS_getLastErrorCode() != PHYSFS_ERR_INVALID_ARGUMENT))
+    {
+        fprintf(stderr, "an allocator without Free() was accepted\n");
+        failures++;
+    } /* if */
+
+    a.Free = poolFree;
+    if (!PHYSFS_setAllocator2(&a))
+    {
+        fprintf(stderr, "PHYSFS_setAllocator2() failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    pooled = run(argv[0], argv + 1, argc - 1);
+
+    /* code sharing the library's allocator gets the pool, too. */
+    PHYSFS_init(argv[0]);
+    shared = PHYSFS_getAllocator();
+    ptr = shared ? shared->Malloc(100) : NULL;
+    ptr = ptr ? shared->Realloc(ptr, 10000) : NULL;
+    if (ptr == NULL)
+    {
+        fprintf(stderr, "PHYSFS_getAllocator() doesn't work with the pool\n");
+        failures++;
+    } /* if */
+    else
+    {
+        shared->Free(ptr);
+    } /* else */
+    PHYSFS_deinit();
+
+    /*
+     * An error before init is kept in a block from the allocator set then,
+     *  which has to go back to that allocator when it's replaced.
+     */
+    PHYSFS_getAllocator();
+    PHYSFS_setAllocator2(NULL);
+    PHYSFS_getAllocator();
+    run(argv[0], argv + 1, 0);
+
+    printf("category,allocations,frees,peak_bytes\n");
+    for (i = 0; i < NUM_CATEGORIES; i++)
+    {
+        printf("%s,%llu,%llu,%lld\n", categoryNames[i],
+               (unsigned long long) pool.allocations[i],
+               (unsigned long long) pool.frees[i], (long long) pool.peak[i]);
+    } /* for */
+    printf("allocator,seconds\n");
+    printf("default,%.6f\n", plain);
+    printf("pool,%.6f\n", pooled);
+
+    if (pool.mismatches != 0)
+    {
+        fprintf(stderr, "%llu blocks freed with the wrong size or category\n",
+                (unsigned long long) pool.mismatches);
+        failures++;
+    } /* if */
+
+    if (pool.wrongContext != 0)
+    {
+        fprintf(stderr, "%llu calls got the wrong context pointer\n",
+                (unsigned long long) pool.wrongContext);
+        failures++;
+    } /* if */
+
+    if ((pool.inits != 2) || (pool.deinits != 2))
+    {
+        fprintf(stderr, "Init() ran %d times and Deinit() %d, not twice each\n",
+                pool.inits, pool.deinits);
+        failures++;
+    } /* if */
+
+    if (pool.live != 0)
+    {
+        fprintf(stderr, "%lld blocks never came back\n", (long long) pool.live);
+        failures++;
+    } /* if */
+
+    if ((pool.allocations[PHYSFS_MEMORY_INDEX] == 0) ||
+        (pool.allocations[PHYSFS_MEMORY_HANDLE] == 0) ||
+        (pool.allocations[PHYSFS_MEMORY_BUFFER] == 0))
+    {
+        fprintf(stderr, "directories, open files or buffers weren't categorized\n");
+        failures++;
+    } /* if */
+
+    poolDrain();
+    pthread_mutex_destroy(&pool.lock);
+
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of allocator_physfs.c ... */
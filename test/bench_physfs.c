@@ -0,0 +1,1598 @@
+/*
+ * PhysicsFS benchmark suite.
+ *
+ * Generates synthetic archives of every supported layout (ZIP stored and
+ *  deflated, 7z solid and non-solid, GRP, WAD, ISO9660 and a plain directory
+ *  tree) and measures mount time, stat/exists latency for hits and misses,
+ *  openRead/close rate, sequential and random read throughput, enumeration
+ *  time, and how open+read+close scales across threads.
+ *
+ * The archives are deterministic, so results are comparable between runs
+ *  and between PhysicsFS versions. They are written once to the data
+ *  directory and reused by later runs.
+ *
+ * Results go to stdout as CSV (format,entries,metric,value,unit), progress
+ *  and a readable copy of the results go to stderr.
+ *
+ * This needs POSIX threads and clocks.
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define FILES_PER_DIR 1000
+#define MAX_ENTRIES 9999999
+#define MAX_ENTRY_SIZE 512
+#define BIG_NAME "BIGFILE"
+#define READ_CHUNK (64 * 1024)
+#define RANDOM_READ_SIZE 4096
+
+static const char *dataDir = "bench_data";
+static double benchSeconds = 0.5;
+static int maxThreads = 8;
+static PHYSFS_uint32 bigSize = 16 * 1024 * 1024;
+static PHYSFS_uint8 *bigData = NULL;
+
+
+/* Growable byte buffer, used for archive headers and compressed data. */
+typedef struct Buf
+{
+    PHYSFS_uint8 *data;
+    size_t len;
+    size_t cap;
+} Buf;
+
+static void bufReserve(Buf *b, const size_t extra)
+{
+    if (b->len + extra > b->cap)
+    {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + extra)
+            cap *= 2;
+        b->data = (PHYSFS_uint8 *) realloc(b->data, cap);
+        if (b->data == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        } /* if */
+        b->cap = cap;
+    } /* if */
+} /* bufReserve */
+
+static void bufPut(Buf *b, const void *data, const size_t len)
+{
+    bufReserve(b, len);
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+} /* bufPut */
+
+static void bufPut8(Buf *b, const PHYSFS_uint8 v)
+{
+    bufPut(b, &v, 1);
+} /* bufPut8 */
+
+static void bufPut16(Buf *b, const PHYSFS_uint16 v)
+{
+    bufPut8(b, (PHYSFS_uint8) v);
+    bufPut8(b, (PHYSFS_uint8) (v >> 8));
+} /* bufPut16 */
+
+static void bufPut32(Buf *b, const PHYSFS_uint32 v)
+{
+    bufPut16(b, (PHYSFS_uint16) v);
+    bufPut16(b, (PHYSFS_uint16) (v >> 16));
+} /* bufPut32 */
+
+static void bufPut64(Buf *b, const PHYSFS_uint64 v)
+{
+    bufPut32(b, (PHYSFS_uint32) v);
+    bufPut32(b, (PHYSFS_uint32) (v >> 32));
+} /* bufPut64 */
+
+/* ISO9660 "both-endian" fields: littleendian, then the same in bigendian. */
+static void bufPutBoth16(Buf *b, const PHYSFS_uint16 v)
+{
+    bufPut16(b, v);
+    bufPut8(b, (PHYSFS_uint8) (v >> 8));
+    bufPut8(b, (PHYSFS_uint8) v);
+} /* bufPutBoth16 */
+
+static void bufPutBoth32(Buf *b, const PHYSFS_uint32 v)
+{
+    bufPut32(b, v);
+    bufPut8(b, (PHYSFS_uint8) (v >> 24));
+    bufPut8(b, (PHYSFS_uint8) (v >> 16));
+    bufPut8(b, (PHYSFS_uint8) (v >> 8));
+    bufPut8(b, (PHYSFS_uint8) v);
+} /* bufPutBoth32 */
+
+static void bufPad(Buf *b, const size_t len)
+{
+    bufReserve(b, len);
+    memset(b->data + b->len, '\0', len);
+    b->len += len;
+} /* bufPad */
+
+
+static PHYSFS_uint32 crcTable[256];
+
+static void crcInit(void)
+{
+    PHYSFS_uint32 i, j;
+    for (i = 0; i < 256; i++)
+    {
+        PHYSFS_uint32 c = i;
+        for (j = 0; j < 8; j++)
+            c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+        crcTable[i] = c;
+    } /* for */
+} /* crcInit */
+
+static PHYSFS_uint32 crc32(const PHYSFS_uint8 *data, size_t len)
+{
+    PHYSFS_uint32 crc = 0xFFFFFFFF;
+    while (len--)
+        crc = crcTable[(crc ^ *(data++)) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+} /* crc32 */
+
+
+/* small, fast, and the same on every platform, unlike rand(). */
+static PHYSFS_uint32 nextRandom(PHYSFS_uint32 *state)
+{
+    PHYSFS_uint32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+} /* nextRandom */
+
+/* Fill a buffer with compressible text, so deflate has something to do. */
+static void fillText(PHYSFS_uint32 seed, PHYSFS_uint8 *buf, size_t len)
+{
+    static const char *words[] = {
+        "physfs", "archive", "search", "path", "mount", "directory",
+        "file", "read", "write", "stream", "buffer", "inflate", "entry",
+        "header", "central", "local", "sector", "volume", "texture",
+        "sound", "level", "model", "shader", "script", "config", "the",
+        "of", "and", "a", "to", "in", "is"
+    };
+    size_t pos = 0;
+
+    seed = (seed * 2654435761u) | 1;
+    while (pos < len)
+    {
+        const char *word = words[nextRandom(&seed) % 32];
+        while ((*word) && (pos < len))
+            buf[pos++] = (PHYSFS_uint8) *(word++);
+        if (pos < len)
+            buf[pos++] = (nextRandom(&seed) % 12) ? ' ' : '\n';
+    } /* while */
+} /* fillText */
+
+static PHYSFS_uint32 entrySize(const PHYSFS_uint32 index)
+{
+    PHYSFS_uint32 seed = (index * 2246822519u) | 1;
+    return 1 + (nextRandom(&seed) % MAX_ENTRY_SIZE);
+} /* entrySize */
+
+static PHYSFS_uint32 entryData(const PHYSFS_uint32 index, PHYSFS_uint8 *buf)
+{
+    const PHYSFS_uint32 len = entrySize(index);
+    fillText(index + 1, buf, len);
+    return len;
+} /* entryData */
+
+static PHYSFS_uint32 dirCount(const PHYSFS_uint32 count)
+{
+    return (count + FILES_PER_DIR - 1) / FILES_PER_DIR;
+} /* dirCount */
+
+/* name of an entry inside the archive, without any directory. */
+static void entryName(const PHYSFS_uint32 index, char *buf)
+{
+    sprintf(buf, "F%07u", (unsigned int) index);
+} /* entryName */
+
+static void dirName(const PHYSFS_uint32 dir, char *buf)
+{
+    sprintf(buf, "D%04u", (unsigned int) dir);
+} /* dirName */
+
+static void entryPath(const int flat, const PHYSFS_uint32 index, char *buf)
+{
+    if (flat)
+        entryName(index, buf);
+    else
+    {
+        dirName(index / FILES_PER_DIR, buf);
+        buf[5] = '/';
+        entryName(index, buf + 6);
+    } /* else */
+} /* entryPath */
+
+
+static int writeFile(const char *path, const void *data, const size_t len)
+{
+    FILE *io = fopen(path, "wb");
+    int ok;
+
+    if (io == NULL)
+        return 0;
+    ok = (fwrite(data, len, 1, io) == 1) || (len == 0);
+    ok = (fclose(io) == 0) && ok;
+    return ok;
+} /* writeFile */
+
+static int writeBuf(FILE *io, const Buf *b)
+{
+    return (b->len == 0) || (fwrite(b->data, b->len, 1, io) == 1);
+} /* writeBuf */
+
+
+/*
+ * A minimal deflate encoder: greedy LZ77 matches, one block with the fixed
+ *  Huffman codes. Plenty to exercise the inflate path.
+ */
+
+static const PHYSFS_uint16 lenBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const PHYSFS_uint8 lenExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const PHYSFS_uint16 distBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+static const PHYSFS_uint8 distExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+typedef struct BitWriter
+{
+    Buf *out;
+    PHYSFS_uint32 bits;
+    int count;
+} BitWriter;
+
+static void putBits(BitWriter *w, const PHYSFS_uint32 v, const int n)
+{
+    w->bits |= v << w->count;
+    w->count += n;
+    while (w->count >= 8)
+    {
+        bufPut8(w->out, (PHYSFS_uint8) w->bits);
+        w->bits >>= 8;
+        w->count -= 8;
+    } /* while */
+} /* putBits */
+
+/* Huffman codes are packed starting from their most significant bit. */
+static void putCode(BitWriter *w, const PHYSFS_uint32 code, const int n)
+{
+    PHYSFS_uint32 reversed = 0;
+    int i;
+    for (i = 0; i < n; i++)
+        reversed |= ((code >> i) & 1) << (n - 1 - i);
+    putBits(w, reversed, n);
+} /* putCode */
+
+static void putLiteral(BitWriter *w, const int v)
+{
+    if (v < 144)
+        putCode(w, 0x30 + v, 8);
+    else if (v < 256)
+        putCode(w, 0x190 + (v - 144), 9);
+    else if (v < 280)
+        putCode(w, v - 256, 7);
+    else
+        putCode(w, 0xC0 + (v - 280), 8);
+} /* putLiteral */
+
+static void putMatch(BitWriter *w, const int len, const int dist)
+{
+    int i;
+
+    for (i = 28; lenBase[i] > len; i--) {}
+    putLiteral(w, 257 + i);
+    putBits(w, len - lenBase[i], lenExtra[i]);
+
+    for (i = 29; distBase[i] > dist; i--) {}
+    putCode(w, i, 5);
+    putBits(w, dist - distBase[i], distExtra[i]);
+} /* putMatch */
+
+#define HASH_BITS 15
+static PHYSFS_uint64 hashHead[1 << HASH_BITS];
+static PHYSFS_uint64 hashBase = 0;  /* positions below this are stale. */
+
+static PHYSFS_uint32 hash3(const PHYSFS_uint8 *p)
+{
+    const PHYSFS_uint32 v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+} /* hash3 */
+
+static void deflateFixed(const PHYSFS_uint8 *in, const size_t len, Buf *out)
+{
+    BitWriter w;
+    size_t i = 0;
+
+    w.out = out;
+    w.bits = 0;
+    w.count = 0;
+
+    putBits(&w, 1, 1);  /* final block */
+    putBits(&w, 1, 2);  /* fixed Huffman codes */
+
+    while (i < len)
+    {
+        size_t best = 0;
+        size_t dist = 0;
+
+        if (i + 3 <= len)
+        {
+            const PHYSFS_uint32 h = hash3(in + i);
+            const PHYSFS_uint64 cand = hashHead[h];
+            hashHead[h] = hashBase + i + 1;
+            if ((cand > hashBase) && ((hashBase + i + 1) - cand <= 32768))
+            {
+                const size_t c = (size_t) (cand - hashBase - 1);
+                const size_t max = ((len - i) < 258) ? (len - i) : 258;
+                size_t n = 0;
+                while ((n < max) && (in[c + n] == in[i + n]))
+                    n++;
+                if (n >= 3)
+                {
+                    best = n;
+                    dist = i - c;
+                } /* if */
+            } /* if */
+        } /* if */
+
+        if (best == 0)
+            putLiteral(&w, in[i++]);
+        else
+        {
+            size_t j;
+            putMatch(&w, (int) best, (int) dist);
+            for (j = i + 1; (j < i + best) && (j + 3 <= len); j++)
+                hashHead[hash3(in + j)] = hashBase + j + 1;
+            i += best;
+        } /* else */
+    } /* while */
+
+    putLiteral(&w, 256);  /* end of block */
+    if (w.count > 0)
+        putBits(&w, 0, 8 - w.count);
+
+    hashBase += len + 32768;  /* invalidate everything we just hashed. */
+} /* deflateFixed */
+
+
+static int generateZip(const char *path, const PHYSFS_uint32 count,
+                       const int deflated)
+{
+    PHYSFS_uint8 data[MAX_ENTRY_SIZE];
+    Buf central = { NULL, 0, 0 };
+    Buf local = { NULL, 0, 0 };
+    Buf packed = { NULL, 0, 0 };
+    PHYSFS_uint64 offset = 0;
+    PHYSFS_uint64 centralOffset;
+    FILE *io = fopen(path, "wb");
+    PHYSFS_uint32 i;
+    int ok = (io != NULL);
+
+    for (i = 0; ok && (i <= count); i++)
+    {
+        const int isBig = (i == count);
+        const PHYSFS_uint8 *ptr = isBig ? bigData : data;
+        const PHYSFS_uint32 len = isBig ? bigSize : entryData(i, data);
+        const PHYSFS_uint32 crc = crc32(ptr, len);
+        char name[32];
+        PHYSFS_uint16 namelen;
+
+        if (isBig)
+            strcpy(name, BIG_NAME);
+        else
+            entryPath(0, i, name);
+        namelen = (PHYSFS_uint16) strlen(name);
+
+        packed.len = 0;
+        if (deflated)
+            deflateFixed(ptr, len, &packed);
+        else
+            bufPut(&packed, ptr, len);
+
+        if (offset + 30 + namelen + packed.len > 0xFFFFFFFF)
+        {
+            fprintf(stderr, "%s: too big for a non-zip64 entry\n", path);
+            ok = 0;
+            break;
+        } /* if */
+
+        local.len = 0;
+        bufPut32(&local, 0x04034b50);
+        bufPut16(&local, 20);  /* version needed */
+        bufPut16(&local, 0);  /* flags */
+        bufPut16(&local, deflated ? 8 : 0);
+        bufPut16(&local, 0);  /* time */
+        bufPut16(&local, 0x5021);  /* date: 2020-01-01 */
+        bufPut32(&local, crc);
+        bufPut32(&local, (PHYSFS_uint32) packed.len);
+        bufPut32(&local, len);
+        bufPut16(&local, namelen);
+        bufPut16(&local, 0);  /* extra */
+        bufPut(&local, name, namelen);
+        ok = writeBuf(io, &local) && writeBuf(io, &packed);
+
+        bufPut32(&central, 0x02014b50);
+        bufPut16(&central, 20);  /* version made by */
+        bufPut(&central, local.data + 4, 26);  /* same as local header. */
+        bufPut16(&central, 0);  /* comment */
+        bufPut16(&central, 0);  /* disk */
+        bufPut16(&central, 0);  /* internal attributes */
+        bufPut32(&central, 0);  /* external attributes */
+        bufPut32(&central, (PHYSFS_uint32) offset);
+        bufPut(&central, name, namelen);
+
+        offset += local.len + packed.len;
+    } /* for */
+
+    centralOffset = offset;
+    if (ok && (count + 1 >= 0xFFFF))  /* needs zip64 end records. */
+    {
+        const PHYSFS_uint64 zip64Offset = centralOffset + central.len;
+        bufPut32(&central, 0x06064b50);
+        bufPut64(&central, 44);  /* size of the rest of the record */
+        bufPut16(&central, 45);  /* version made by */
+        bufPut16(&central, 45);  /* version needed */
+        bufPut32(&central, 0);  /* disk */
+        bufPut32(&central, 0);  /* disk with central dir */
+        bufPut64(&central, count + 1);
+        bufPut64(&central, count + 1);
+        bufPut64(&central, zip64Offset - centralOffset);
+        bufPut64(&central, centralOffset);
+
+        bufPut32(&central, 0x07064b50);
+        bufPut32(&central, 0);  /* disk with zip64 end record */
+        bufPut64(&central, zip64Offset);
+        bufPut32(&central, 1);  /* total disks */
+    } /* if */
+
+    if (ok)
+    {
+        const PHYSFS_uint16 entries16 = (count + 1 >= 0xFFFF) ? 0xFFFF :
+                                        (PHYSFS_uint16) (count + 1);
+        PHYSFS_uint32 centralSize = (PHYSFS_uint32) central.len;
+        if (count + 1 >= 0xFFFF)  /* just the entries, not zip64 records. */
+            centralSize -= 56 + 20;
+        bufPut32(&central, 0x06054b50);
+        bufPut16(&central, 0);  /* disk */
+        bufPut16(&central, 0);  /* disk with central dir */
+        bufPut16(&central, entries16);
+        bufPut16(&central, entries16);
+        bufPut32(&central, centralSize);
+        bufPut32(&central, (PHYSFS_uint32) centralOffset);
+        bufPut16(&central, 0);  /* comment */
+        ok = writeBuf(io, &central);
+    } /* if */
+
+    if (io != NULL)
+        ok = (fclose(io) == 0) && ok;
+
+    free(central.data);
+    free(local.data);
+    free(packed.data);
+    return ok;
+} /* generateZip */
+
+static int generateZipStored(const char *path, const PHYSFS_uint32 count)
+{
+    return generateZip(path, count, 0);
+} /* generateZipStored */
+
+static int generateZipDeflated(const char *path, const PHYSFS_uint32 count)
+{
+    return generateZip(path, count, 1);
+} /* generateZipDeflated */
+
+
+/* 7z's variable length integers: leading 1 bits say how many bytes follow. */
+static void put7zNumber(Buf *b, PHYSFS_uint64 v)
+{
+    PHYSFS_uint8 first = 0;
+    PHYSFS_uint8 mask = 0x80;
+    int i;
+
+    for (i = 0; i < 8; i++)
+    {
+        if (v < (((PHYSFS_uint64) 1) << (7 * (i + 1))))
+        {
+            first |= (PHYSFS_uint8) (v >> (8 * i));
+            break;
+        } /* if */
+        first |= mask;
+        mask >>= 1;
+    } /* for */
+
+    bufPut8(b, first);
+    for (; i > 0; i--)
+    {
+        bufPut8(b, (PHYSFS_uint8) v);
+        v >>= 8;
+    } /* for */
+} /* put7zNumber */
+
+/*
+ * We don't have an LZMA encoder here, so entries use the Copy coder. That
+ *  still exercises the 7z header parsing, folder lookup and extraction code.
+ */
+static int generate7z(const char *path, const PHYSFS_uint32 count,
+                      const int solid)
+{
+    PHYSFS_uint8 data[MAX_ENTRY_SIZE];
+    const PHYSFS_uint32 files = count + 1;
+    const PHYSFS_uint32 folders = solid ? 1 : files;
+    Buf header = { NULL, 0, 0 };
+    Buf names = { NULL, 0, 0 };
+    Buf start = { NULL, 0, 0 };
+    PHYSFS_uint64 packed = 0;
+    FILE *io = fopen(path, "wb");
+    PHYSFS_uint32 i;
+    int ok = (io != NULL);
+
+    if (ok)
+        ok = (fseek(io, 32, SEEK_SET) == 0);  /* start header goes here. */
+
+    for (i = 0; ok && (i < files); i++)
+    {
+        const int isBig = (i == count);
+        const PHYSFS_uint32 len = isBig ? bigSize : entryData(i, data);
+        char name[32];
+        char *ptr;
+
+        ok = (fwrite(isBig ? bigData : data, len, 1, io) == 1);
+        packed += len;
+
+        if (isBig)
+            strcpy(name, BIG_NAME);
+        else
+            entryPath(0, i, name);
+        for (ptr = name; *ptr; ptr++)
+            bufPut16(&names, (PHYSFS_uint16) *ptr);  /* UTF-16LE */
+        bufPut16(&names, 0);
+    } /* for */
+
+    bufPut8(&header, 0x01);  /* kHeader */
+    bufPut8(&header, 0x04);  /* kMainStreamsInfo */
+
+    bufPut8(&header, 0x06);  /* kPackInfo */
+    put7zNumber(&header, 0);  /* pack position */
+    put7zNumber(&header, folders);
+    bufPut8(&header, 0x09);  /* kSize */
+    if (solid)
+        put7zNumber(&header, packed);
+    else
+    {
+        for (i = 0; i < files; i++)
+            put7zNumber(&header, (i == count) ? bigSize : entrySize(i));
+    } /* else */
+    bufPut8(&header, 0x00);  /* kEnd */
+
+    bufPut8(&header, 0x07);  /* kUnpackInfo */
+    bufPut8(&header, 0x0B);  /* kFolder */
+    put7zNumber(&header, folders);
+    bufPut8(&header, 0);  /* not external */
+    for (i = 0; i < folders; i++)
+    {
+        put7zNumber(&header, 1);  /* one coder */
+        bufPut8(&header, 0x01);  /* simple coder, 1 byte method id */
+        bufPut8(&header, 0x00);  /* Copy */
+    } /* for */
+    bufPut8(&header, 0x0C);  /* kCodersUnpackSize */
+    if (solid)
+        put7zNumber(&header, packed);
+    else
+    {
+        for (i = 0; i < files; i++)
+            put7zNumber(&header, (i == count) ? bigSize : entrySize(i));
+    } /* else */
+    bufPut8(&header, 0x00);  /* kEnd */
+
+    if (solid)
+    {
+        bufPut8(&header, 0x08);  /* kSubStreamsInfo */
+        bufPut8(&header, 0x0D);  /* kNumUnpackStream */
+        put7zNumber(&header, files);
+        bufPut8(&header, 0x09);  /* kSize, all but the last one */
+        for (i = 0; i < count; i++)
+            put7zNumber(&header, entrySize(i));
+        bufPut8(&header, 0x00);  /* kEnd */
+    } /* if */
+
+    bufPut8(&header, 0x00);  /* kEnd of kMainStreamsInfo */
+
+    bufPut8(&header, 0x05);  /* kFilesInfo */
+    put7zNumber(&header, files);
+    bufPut8(&header, 0x11);  /* kName */
+    put7zNumber(&header, names.len + 1);
+    bufPut8(&header, 0);  /* not external */
+    bufPut(&header, names.data, names.len);
+    bufPut8(&header, 0x00);  /* kEnd of kFilesInfo */
+
+    bufPut8(&header, 0x00);  /* kEnd of kHeader */
+
+    if (ok)
+        ok = writeBuf(io, &header);
+
+    bufPut(&start, "7z\xBC\xAF\x27\x1C\x00\x04", 8);
+    bufPut32(&start, 0);  /* start header CRC, below */
+    bufPut64(&start, packed);
+    bufPut64(&start, header.len);
+    bufPut32(&start, crc32(header.data, header.len));
+    {
+        const PHYSFS_uint32 crc = crc32(start.data + 12, 20);
+        start.data[8] = (PHYSFS_uint8) crc;
+        start.data[9] = (PHYSFS_uint8) (crc >> 8);
+        start.data[10] = (PHYSFS_uint8) (crc >> 16);
+        start.data[11] = (PHYSFS_uint8) (crc >> 24);
+    }
+
+    if (ok)
+        ok = (fseek(io, 0, SEEK_SET) == 0) && writeBuf(io, &start);
+
+    if (io != NULL)
+        ok = (fclose(io) == 0) && ok;
+
+    free(header.data);
+    free(names.data);
+    free(start.data);
+    return ok;
+} /* generate7z */
+
+static int generate7zSolid(const char *path, const PHYSFS_uint32 count)
+{
+    return generate7z(path, count, 1);
+} /* generate7zSolid */
+
+static int generate7zNonSolid(const char *path, const PHYSFS_uint32 count)
+{
+    return generate7z(path, count, 0);
+} /* generate7zNonSolid */
+
+
+static int generateGrp(const char *path, const PHYSFS_uint32 count)
+{
+    PHYSFS_uint8 data[MAX_ENTRY_SIZE];
+    Buf header = { NULL, 0, 0 };
+    FILE *io = fopen(path, "wb");
+    PHYSFS_uint32 i;
+    int ok = (io != NULL);
+
+    bufPut(&header, "KenSilverman", 12);
+    bufPut32(&header, count + 1);
+    for (i = 0; i <= count; i++)
+    {
+        char name[16];
+        size_t len;
+        if (i == count)
+            strcpy(name, BIG_NAME);
+        else
+            entryName(i, name);
+        len = strlen(name);
+        memset(name + len, ' ', sizeof (name) - len);  /* space padded. */
+        bufPut(&header, name, 12);
+        bufPut32(&header, (i == count) ? bigSize : entrySize(i));
+    } /* for */
+
+    ok = ok && writeBuf(io, &header);
+    for (i = 0; ok && (i < count); i++)
+        ok = (fwrite(data, entryData(i, data), 1, io) == 1);
+    ok = ok && (fwrite(bigData, bigSize, 1, io) == 1);
+
+    if (io != NULL)
+        ok = (fclose(io) == 0) && ok;
+    free(header.data);
+    return ok;
+} /* generateGrp */
+
+
+static int generateWad(const char *path, const PHYSFS_uint32 count)
+{
+    PHYSFS_uint8 data[MAX_ENTRY_SIZE];
+    Buf b = { NULL, 0, 0 };
+    PHYSFS_uint32 offset = 12;
+    FILE *io = fopen(path, "wb");
+    PHYSFS_uint32 i;
+    int ok = (io != NULL);
+
+    /* directory goes after the data, so its offset needs the data size. */
+    for (i = 0; i < count; i++)
+        offset += entrySize(i);
+    offset += bigSize;
+
+    bufPut(&b, "PWAD", 4);
+    bufPut32(&b, count + 1);
+    bufPut32(&b, offset);
+    ok = ok && writeBuf(io, &b);
+
+    for (i = 0; ok && (i < count); i++)
+        ok = (fwrite(data, entryData(i, data), 1, io) == 1);
+    ok = ok && (fwrite(bigData, bigSize, 1, io) == 1);
+
+    b.len = 0;
+    offset = 12;
+    for (i = 0; i <= count; i++)
+    {
+        const PHYSFS_uint32 len = (i == count) ? bigSize : entrySize(i);
+        char name[16];
+        memset(name, '\0', sizeof (name));
+        if (i == count)
+            strcpy(name, BIG_NAME);
+        else
+            entryName(i, name);
+        bufPut32(&b, offset);
+        bufPut32(&b, len);
+        bufPut(&b, name, 8);
+        offset += len;
+    } /* for */
+    ok = ok && writeBuf(io, &b);
+
+    if (io != NULL)
+        ok = (fclose(io) == 0) && ok;
+    free(b.data);
+    return ok;
+} /* generateWad */
+
+
+/*
+ * ISO9660 layout: 16 empty system sectors, the primary volume descriptor,
+ *  the terminator, then every directory (root first), then file data with
+ *  each file starting on a sector boundary.
+ */
+
+#define ISO_SECTOR 2048
+
+static size_t isoRecordLen(const size_t namelen)
+{
+    const size_t len = 33 + namelen;
+    return len + (len & 1);  /* records are padded to an even length. */
+} /* isoRecordLen */
+
+/* size of a directory, in sectors. Records can't cross a sector boundary. */
+static PHYSFS_uint32 isoDirSectors(const size_t *namelens, const size_t n)
+{
+    PHYSFS_uint32 sectors = 1;
+    size_t used = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        const size_t len = isoRecordLen(namelens[i]);
+        if (used + len > ISO_SECTOR)
+        {
+            sectors++;
+            used = 0;
+        } /* if */
+        used += len;
+    } /* for */
+
+    /* PhysicsFS stops at a zero length byte, so always leave one. */
+    if (used == ISO_SECTOR)
+        sectors++;
+
+    return sectors;
+} /* isoDirSectors */
+
+static void isoPutRecord(Buf *b, size_t *used, const PHYSFS_uint32 extent,
+                         const PHYSFS_uint32 len, const int isdir,
+                         const char *name, const size_t namelen)
+{
+    const size_t reclen = isoRecordLen(namelen);
+
+    if (*used + reclen > ISO_SECTOR)
+    {
+        bufPad(b, ISO_SECTOR - *used);
+        *used = 0;
+    } /* if */
+
+    bufPut8(b, (PHYSFS_uint8) reclen);
+    bufPut8(b, 0);  /* extended attribute record length */
+    bufPutBoth32(b, extent);
+    bufPutBoth32(b, len);
+    bufPut8(b, 120);  /* 2020-01-01 00:00:00 GMT */
+    bufPut8(b, 1);
+    bufPut8(b, 1);
+    bufPad(b, 4);
+    bufPut8(b, isdir ? 2 : 0);
+    bufPad(b, 2);  /* unit size, interleave gap */
+    bufPutBoth16(b, 1);  /* volume sequence number */
+    bufPut8(b, (PHYSFS_uint8) namelen);
+    bufPut(b, name, namelen);
+    if (namelen % 2 == 0)
+        bufPut8(b, 0);
+
+    *used += reclen;
+} /* isoPutRecord */
+
+static void isoFinishDir(Buf *b, const size_t start, const PHYSFS_uint32 sectors)
+{
+    bufPad(b, (start + (sectors * ISO_SECTOR)) - b->len);
+} /* isoFinishDir */
+
+static PHYSFS_uint32 isoSectors(const PHYSFS_uint32 len)
+{
+    return (len + ISO_SECTOR - 1) / ISO_SECTOR;
+} /* isoSectors */
+
+static int generateIso(const char *path, const PHYSFS_uint32 count)
+{
+    const PHYSFS_uint32 dirs = dirCount(count);
+    const size_t fileNameLen = 10;  /* "F0000000.;1" minus the ";1"... */
+    PHYSFS_uint8 data[ISO_SECTOR];
+    PHYSFS_uint32 *dirExtents = NULL;
+    PHYSFS_uint32 *dirSizes = NULL;
+    size_t *namelens = NULL;
+    PHYSFS_uint32 rootSectors;
+    PHYSFS_uint32 next;
+    PHYSFS_uint32 bigExtent;
+    PHYSFS_uint32 *fileExtents = NULL;
+    Buf b = { NULL, 0, 0 };
+    FILE *io = fopen(path, "wb");
+    PHYSFS_uint32 i, j;
+    size_t used;
+    int ok = (io != NULL);
+
+    namelens = (size_t *) malloc(sizeof (size_t) * (FILES_PER_DIR + 2 + dirs + 1));
+    dirExtents = (PHYSFS_uint32 *) malloc(sizeof (PHYSFS_uint32) * (dirs + 1));
+    dirSizes = (PHYSFS_uint32 *) malloc(sizeof (PHYSFS_uint32) * (dirs + 1));
+    fileExtents = (PHYSFS_uint32 *) malloc(sizeof (PHYSFS_uint32) * (count + 1));
+    if (!namelens || !dirExtents || !dirSizes || !fileExtents)
+        ok = 0;
+
+    /* lay out the root: ".", "..", every D0000 directory, and BIGFILE. */
+    if (ok)
+    {
+        namelens[0] = namelens[1] = 1;
+        for (i = 0; i < dirs; i++)
+            namelens[2 + i] = 5;
+        namelens[2 + dirs] = strlen(BIG_NAME) + 3;  /* "BIGFILE.;1" */
+        rootSectors = isoDirSectors(namelens, dirs + 3);
+
+        next = 18 + rootSectors;
+        for (i = 0; i < dirs; i++)
+        {
+            const PHYSFS_uint32 first = i * FILES_PER_DIR;
+            const PHYSFS_uint32 n = ((count - first) < FILES_PER_DIR) ?
+                                    (count - first) : FILES_PER_DIR;
+            namelens[0] = namelens[1] = 1;
+            for (j = 0; j < n; j++)
+                namelens[2 + j] = fileNameLen + 2;
+            dirExtents[i] = next;
+            dirSizes[i] = isoDirSectors(namelens, n + 2);
+            next += dirSizes[i];
+        } /* for */
+
+        for (i = 0; i < count; i++)
+        {
+            fileExtents[i] = next;
+            next += isoSectors(entrySize(i));
+        } /* for */
+        bigExtent = next;
+        next += isoSectors(bigSize);
+    } /* if */
+
+    if (ok)
+    {
+        /* system area */
+        bufPad(&b, 16 * ISO_SECTOR);
+
+        /* primary volume descriptor */
+        bufPut8(&b, 1);
+        bufPut(&b, "CD001", 5);
+        bufPut8(&b, 1);
+        bufPut8(&b, 0);
+        bufPad(&b, 32);  /* system id */
+        bufPut(&b, "PHYSFS_BENCH                    ", 32);
+        bufPad(&b, 8);
+        bufPutBoth32(&b, next);  /* volume space size */
+        bufPad(&b, 32);
+        bufPutBoth16(&b, 1);  /* volume set size */
+        bufPutBoth16(&b, 1);  /* volume sequence number */
+        bufPutBoth16(&b, ISO_SECTOR);
+        bufPutBoth32(&b, 0);  /* path table size */
+        bufPad(&b, 16);  /* path table locations */
+        used = 0;
+        isoPutRecord(&b, &used, 18, rootSectors * ISO_SECTOR, 1, "\0", 1);
+        bufPad(&b, 881 - (b.len - (16 * ISO_SECTOR)));
+        bufPut8(&b, 1);  /* file structure version */
+        bufPad(&b, (18 * ISO_SECTOR) - b.len - ISO_SECTOR);
+
+        /* volume descriptor set terminator */
+        bufPut8(&b, 255);
+        bufPut(&b, "CD001", 5);
+        bufPut8(&b, 1);
+        bufPad(&b, ISO_SECTOR - 7);
+
+        /* root directory */
+        used = 0;
+        isoPutRecord(&b, &used, 18, rootSectors * ISO_SECTOR, 1, "\0", 1);
+        isoPutRecord(&b, &used, 18, rootSectors * ISO_SECTOR, 1, "\1", 1);
+        for (i = 0; i < dirs; i++)
+        {
+            char name[16];
+            dirName(i, name);
+            isoPutRecord(&b, &used, dirExtents[i], dirSizes[i] * ISO_SECTOR,
+                         1, name, 5);
+        } /* for */
+        isoPutRecord(&b, &used, bigExtent, bigSize, 0, BIG_NAME ".;1",
+                     strlen(BIG_NAME) + 3);
+        isoFinishDir(&b, 18 * ISO_SECTOR, rootSectors);
+        ok = writeBuf(io, &b);
+    } /* if */
+
+    for (i = 0; ok && (i < dirs); i++)
+    {
+        const PHYSFS_uint32 first = i * FILES_PER_DIR;
+        const PHYSFS_uint32 n = ((count - first) < FILES_PER_DIR) ?
+                                (count - first) : FILES_PER_DIR;
+        b.len = 0;
+        used = 0;
+        isoPutRecord(&b, &used, dirExtents[i], dirSizes[i] * ISO_SECTOR,
+                     1, "\0", 1);
+        isoPutRecord(&b, &used, 18, rootSectors * ISO_SECTOR, 1, "\1", 1);
+        for (j = first; j < first + n; j++)
+        {
+            char name[32];
+            entryName(j, name);
+            strcat(name, ".;1");
+            isoPutRecord(&b, &used, fileExtents[j], entrySize(j), 0,
+                         name, fileNameLen + 2);
+        } /* for */
+        isoFinishDir(&b, 0, dirSizes[i]);
+        ok = writeBuf(io, &b);
+    } /* for */
+
+    for (i = 0; ok && (i < count); i++)
+    {
+        const PHYSFS_uint32 len = entryData(i, data);
+        memset(data + len, '\0', ISO_SECTOR - len);
+        ok = (fwrite(data, ISO_SECTOR, 1, io) == 1);
+    } /* for */
+
+    if (ok)
+    {
+        b.len = 0;
+        bufPut(&b, bigData, bigSize);
+        bufPad(&b, (isoSectors(bigSize) * ISO_SECTOR) - bigSize);
+        ok = writeBuf(io, &b);
+    } /* if */
+
+    if (io != NULL)
+        ok = (fclose(io) == 0) && ok;
+    free(b.data);
+    free(namelens);
+    free(dirExtents);
+    free(dirSizes);
+    free(fileExtents);
+    return ok;
+} /* generateIso */
+
+
+static int makeDir(const char *path)
+{
+    return (mkdir(path, 0755) == 0) || (errno == EEXIST);
+} /* makeDir */
+
+static int generateDir(const char *path, const PHYSFS_uint32 count)
+{
+    PHYSFS_uint8 data[MAX_ENTRY_SIZE];
+    char *fullpath = (char *) malloc(strlen(path) + 32);
+    PHYSFS_uint32 i;
+    int ok = (fullpath != NULL) && makeDir(path);
+
+    for (i = 0; ok && (i < count); i++)
+    {
+        if ((i % FILES_PER_DIR) == 0)
+        {
+            sprintf(fullpath, "%s/", path);
+            dirName(i / FILES_PER_DIR, fullpath + strlen(fullpath));
+            ok = makeDir(fullpath);
+        } /* if */
+
+        if (ok)
+        {
+            sprintf(fullpath, "%s/", path);
+            entryPath(0, i, fullpath + strlen(fullpath));
+            ok = writeFile(fullpath, data, entryData(i, data));
+        } /* if */
+    } /* for */
+
+    if (ok)
+    {
+        sprintf(fullpath, "%s/%s", path, BIG_NAME);
+        ok = writeFile(fullpath, bigData, bigSize);
+    } /* if */
+
+    free(fullpath);
+    return ok;
+} /* generateDir */
+
+
+typedef struct Format
+{
+    const char *name;
+    const char *ext;  /* NULL for a directory tree. */
+    int flat;  /* no subdirectories, everything in the root. */
+    int (*generate)(const char *path, const PHYSFS_uint32 count);
+} Format;
+
+static const Format formats[] =
+{
+    { "zip-stored", "zip", 0, generateZipStored },
+    { "zip-deflate", "zip", 0, generateZipDeflated },
+    { "7z-solid", "7z", 0, generate7zSolid },
+    { "7z", "7z", 0, generate7zNonSolid },
+    { "grp", "grp", 1, generateGrp },
+    { "wad", "wad", 1, generateWad },
+    { "iso", "iso", 0, generateIso },
+    { "dir", NULL, 0, generateDir },
+    { NULL, NULL, 0, NULL }
+};
+
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0);
+} /* now */
+
+static void report(const Format *fmt, const PHYSFS_uint32 count,
+                   const char *metric, const double value, const char *unit)
+{
+    printf("%s,%u,%s,%.3f,%s\n", fmt->name, (unsigned int) count,
+           metric, value, unit);
+    fflush(stdout);
+    if (!isatty(fileno(stdout)))  /* results went to a file, show them too. */
+    {
+        fprintf(stderr, "  %-12s %-20s %14.3f %s\n", fmt->name, metric,
+                value, unit);
+    } /* if */
+} /* report */
+
+
+/* What a benchmark operation works on. One per thread. */
+typedef struct BenchState
+{
+    const Format *fmt;
+    PHYSFS_uint32 count;
+    PHYSFS_uint32 random;
+    PHYSFS_File *big;
+    PHYSFS_uint8 *buf;
+    PHYSFS_uint64 ops;
+    PHYSFS_uint64 bytes;
+    volatile int *stop;
+    int failed;
+} BenchState;
+
+typedef int (*BenchOp)(BenchState *st);
+
+static void randomPath(BenchState *st, char *buf, const int missing)
+{
+    entryPath(st->fmt->flat, nextRandom(&st->random) % st->count, buf);
+    if (missing)  /* same directory, name that doesn't exist. */
+        *strrchr(buf, 'F') = 'X';
+} /* randomPath */
+
+static int opStatHit(BenchState *st)
+{
+    PHYSFS_Stat stat;
+    char path[32];
+    randomPath(st, path, 0);
+    return PHYSFS_stat(path, &stat);
+} /* opStatHit */
+
+static int opStatMiss(BenchState *st)
+{
+    PHYSFS_Stat stat;
+    char path[32];
+    randomPath(st, path, 1);
+    return !PHYSFS_stat(path, &stat);
+} /* opStatMiss */
+
+static int opExistsHit(BenchState *st)
+{
+    char path[32];
+    randomPath(st, path, 0);
+    return PHYSFS_exists(path);
+} /* opExistsHit */
+
+static int opExistsMiss(BenchState *st)
+{
+    char path[32];
+    randomPath(st, path, 1);
+    return !PHYSFS_exists(path);
+} /* opExistsMiss */
+
+static int opOpenClose(BenchState *st)
+{
+    PHYSFS_File *f;
+    char path[32];
+    randomPath(st, path, 0);
+    f = PHYSFS_openRead(path);
+    return (f != NULL) && PHYSFS_close(f);
+} /* opOpenClose */
+
+static int opOpenReadClose(BenchState *st)
+{
+    PHYSFS_sint64 br;
+    PHYSFS_File *f;
+    char path[32];
+    randomPath(st, path, 0);
+    f = PHYSFS_openRead(path);
+    if (f == NULL)
+        return 0;
+    br = PHYSFS_readBytes(f, st->buf, MAX_ENTRY_SIZE);
+    PHYSFS_close(f);
+    if (br <= 0)
+        return 0;
+    st->bytes += (PHYSFS_uint64) br;
+    return 1;
+} /* opOpenReadClose */
+
+static int opReadSequential(BenchState *st)
+{
+    PHYSFS_sint64 br = PHYSFS_readBytes(st->big, st->buf, READ_CHUNK);
+    if (br == 0)  /* start over at the end of the file. */
+    {
+        if (!PHYSFS_seek(st->big, 0))
+            return 0;
+        br = PHYSFS_readBytes(st->big, st->buf, READ_CHUNK);
+    } /* if */
+
+    if (br <= 0)
+        return 0;
+    st->bytes += (PHYSFS_uint64) br;
+    return 1;
+} /* opReadSequential */
+
+static int opReadRandom(BenchState *st)
+{
+    const PHYSFS_uint64 pos = nextRandom(&st->random) %
+                              (bigSize - RANDOM_READ_SIZE + 1);
+    if (!PHYSFS_seek(st->big, pos))
+        return 0;
+    if (PHYSFS_readBytes(st->big, st->buf, RANDOM_READ_SIZE) != RANDOM_READ_SIZE)
+        return 0;
+    st->bytes += RANDOM_READ_SIZE;
+    return 1;
+} /* opReadRandom */
+
+static PHYSFS_EnumerateCallbackResult countEntry(void *data,
+                                                 const char *dir,
+                                                 const char *fname)
+{
+    (*((PHYSFS_uint32 *) data))++;
+    return PHYSFS_ENUM_OK;
+} /* countEntry */
+
+static int opEnumerate(BenchState *st)
+{
+    const PHYSFS_uint32 dirs = st->fmt->flat ? 0 : dirCount(st->count);
+    PHYSFS_uint32 total = 0;
+    PHYSFS_uint32 i;
+
+    if (!PHYSFS_enumerate("", countEntry, &total))
+        return 0;
+
+    for (i = 0; i < dirs; i++)
+    {
+        char name[16];
+        dirName(i, name);
+        if (!PHYSFS_enumerate(name, countEntry, &total))
+            return 0;
+    } /* for */
+
+    return (total == st->count + dirs + 1);
+} /* opEnumerate */
+
+
+/* Run an operation over and over for the time budget; returns seconds. */
+static double runTimed(BenchOp op, BenchState *st, const int batch)
+{
+    const double start = now();
+    double elapsed;
+    int i;
+
+    st->ops = st->bytes = 0;
+    do
+    {
+        for (i = 0; i < batch; i++)
+        {
+            if (!op(st))
+            {
+                fprintf(stderr, "%s: operation failed: %s\n", st->fmt->name,
+                        PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+                st->failed = 1;
+                return now() - start;
+            } /* if */
+        } /* for */
+        st->ops += batch;
+        elapsed = now() - start;
+    } while (elapsed < benchSeconds);
+
+    return elapsed;
+} /* runTimed */
+
+static void reportLatency(BenchState *st, const char *metric,
+                          BenchOp op, const int batch)
+{
+    const double secs = runTimed(op, st, batch);
+    if (!st->failed)
+        report(st->fmt, st->count, metric, (secs * 1e9) / st->ops, "ns/op");
+} /* reportLatency */
+
+static void reportThroughput(BenchState *st, const char *metric,
+                             BenchOp op, const int batch)
+{
+    const double secs = runTimed(op, st, batch);
+    if (!st->failed)
+        report(st->fmt, st->count, metric, (st->bytes / secs) / 1e6, "MB/s");
+} /* reportThroughput */
+
+
+static void *threadMain(void *data)
+{
+    BenchState *st = (BenchState *) data;
+    while (!*st->stop)
+    {
+        if (!opOpenReadClose(st))
+        {
+            st->failed = 1;
+            break;
+        } /* if */
+        st->ops++;
+    } /* while */
+    return NULL;
+} /* threadMain */
+
+static void benchThreads(BenchState *base)
+{
+    char metric[32];
+    int threads;
+
+    for (threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        BenchState *st = (BenchState *) calloc(threads, sizeof (BenchState));
+        pthread_t *tids = (pthread_t *) calloc(threads, sizeof (pthread_t));
+        volatile int stop = 0;
+        PHYSFS_uint64 ops = 0;
+        struct timespec delay;
+        double start, secs;
+        int failed = 0;
+        int i;
+
+        if (!st || !tids)
+        {
+            free(st);
+            free(tids);
+            return;
+        } /* if */
+
+        start = now();
+        for (i = 0; i < threads; i++)
+        {
+            st[i] = *base;
+            st[i].random = 0x9E3779B9u * (i + 1);
+            st[i].buf = (PHYSFS_uint8 *) malloc(MAX_ENTRY_SIZE);
+            st[i].ops = 0;
+            st[i].stop = &stop;
+            pthread_create(&tids[i], NULL, threadMain, &st[i]);
+        } /* for */
+
+        delay.tv_sec = (time_t) benchSeconds;
+        delay.tv_nsec = (long) ((benchSeconds - delay.tv_sec) * 1e9);
+        nanosleep(&delay, NULL);
+        stop = 1;
+
+        for (i = 0; i < threads; i++)
+        {
+            pthread_join(tids[i], NULL);
+            ops += st[i].ops;
+            failed |= st[i].failed;
+            free(st[i].buf);
+        } /* for */
+        secs = now() - start;
+
+        free(st);
+        free(tids);
+
+        if (failed)
+        {
+            fprintf(stderr, "%s: threaded open/read/close failed\n",
+                    base->fmt->name);
+            return;
+        } /* if */
+
+        sprintf(metric, "mt_open_read_%dt", threads);
+        report(base->fmt, base->count, metric, ops / secs, "ops/s");
+    } /* for */
+} /* benchThreads */
+
+
+/* Spot check a few entries, so we never benchmark a broken archive. */
+static int verifyArchive(const Format *fmt, const PHYSFS_uint32 count)
+{
+    PHYSFS_uint8 expected[MAX_ENTRY_SIZE];
+    PHYSFS_uint8 actual[MAX_ENTRY_SIZE + 1];
+    const PHYSFS_uint32 checks[] = { 0, count / 2, count - 1 };
+    PHYSFS_File *f;
+    size_t i;
+
+    for (i = 0; i < sizeof (checks) / sizeof (checks[0]); i++)
+    {
+        const PHYSFS_uint32 len = entryData(checks[i], expected);
+        PHYSFS_sint64 br;
+        char path[32];
+
+        entryPath(fmt->flat, checks[i], path);
+        f = PHYSFS_openRead(path);
+        if (f == NULL)
+            return 0;
+        br = PHYSFS_readBytes(f, actual, sizeof (actual));
+        PHYSFS_close(f);
+        if ((br != (PHYSFS_sint64) len) || (memcmp(expected, actual, len) != 0))
+            return 0;
+    } /* for */
+
+    f = PHYSFS_openRead(BIG_NAME);
+    if (f == NULL)
+        return 0;
+    else
+    {
+        PHYSFS_uint8 *buf = (PHYSFS_uint8 *) malloc(bigSize);
+        int ok = (buf != NULL) &&
+                 (PHYSFS_readBytes(f, buf, bigSize) == (PHYSFS_sint64) bigSize) &&
+                 (memcmp(buf, bigData, bigSize) == 0);
+        free(buf);
+        PHYSFS_close(f);
+        return ok;
+    } /* else */
+} /* verifyArchive */
+
+
+static void benchFormat(const Format *fmt, const PHYSFS_uint32 count)
+{
+    struct stat statbuf;
+    BenchState st;
+    char path[1024];
+    char marker[1100];
+    double best = 0.0;
+    double start;
+    int runs;
+
+    if (fmt->ext)
+        snprintf(path, sizeof (path), "%s/%s-%u.%s", dataDir, fmt->name,
+                 (unsigned int) count, fmt->ext);
+    else
+        snprintf(path, sizeof (path), "%s/%s-%u", dataDir, fmt->name,
+                 (unsigned int) count);
+
+    /* the marker is written last, so an interrupted generation is redone. */
+    snprintf(marker, sizeof (marker), "%s.done", path);
+    if (stat(marker, &statbuf) != 0)
+    {
+        fprintf(stderr, "generating %s...\n", path);
+        if (!fmt->generate(path, count) || !writeFile(marker, "", 0))
+        {
+            fprintf(stderr, "%s: failed to generate %s\n", fmt->name, path);
+            return;
+        } /* if */
+    } /* if */
+
+    /* mount: best of several runs, as this is mostly a one-time cost. */
+    start = now();
+    for (runs = 0; (runs < 3) || ((now() - start) < benchSeconds); runs++)
+    {
+        const double t = now();
+        if (!PHYSFS_mount(path, "/bench", 0))
+        {
+            fprintf(stderr, "%s: failed to mount %s: %s\n", fmt->name, path,
+                    PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            return;
+        } /* if */
+        if ((runs == 0) || ((now() - t) < best))
+            best = now() - t;
+        PHYSFS_unmount(path);
+        if (runs >= 100)
+            break;
+    } /* for */
+    report(fmt, count, "mount", best * 1000.0, "ms");
+
+    /* everything below looks up paths relative to the archive's root. */
+    if (!PHYSFS_mount(path, NULL, 0))
+        return;
+
+    if (!verifyArchive(fmt, count))
+    {
+        fprintf(stderr, "%s: archive contents are wrong, skipping\n", path);
+        PHYSFS_unmount(path);
+        return;
+    } /* if */
+
+    memset(&st, '\0', sizeof (st));
+    st.fmt = fmt;
+    st.count = count;
+    st.random = 0x12345678;
+    st.buf = (PHYSFS_uint8 *) malloc(READ_CHUNK);
+    st.big = PHYSFS_openRead(BIG_NAME);
+
+    if ((st.buf != NULL) && (st.big != NULL))
+    {
+        reportLatency(&st, "stat_hit", opStatHit, 64);
+        reportLatency(&st, "stat_miss", opStatMiss, 64);
+        reportLatency(&st, "exists_hit", opExistsHit, 64);
+        reportLatency(&st, "exists_miss", opExistsMiss, 64);
+        reportLatency(&st, "open_close", opOpenClose, 16);
+        reportThroughput(&st, "read_entries", opOpenReadClose, 16);
+        reportThroughput(&st, "read_sequential", opReadSequential, 1);
+        reportThroughput(&st, "read_random", opReadRandom, 1);
+        reportLatency(&st, "enumerate", opEnumerate, 1);
+        if (!st.failed)
+            benchThreads(&st);
+    } /* if */
+
+    if (st.big != NULL)
+        PHYSFS_close(st.big);
+    free(st.buf);
+    PHYSFS_unmount(path);
+} /* benchFormat */
+
+
+static int parseList(char *str, PHYSFS_uint32 *counts, const int max)
+{
+    int n = 0;
+    char *tok;
+    for (tok = strtok(str, ","); tok && (n < max); tok = strtok(NULL, ","))
+    {
+        const long v = strtol(tok, NULL, 10);
+        if ((v <= 0) || (v > MAX_ENTRIES))
+            return 0;
+        counts[n++] = (PHYSFS_uint32) v;
+    } /* for */
+    return n;
+} /* parseList */
+
+static int wantFormat(const char *list, const char *name)
+{
+    const size_t len = strlen(name);
+    const char *ptr = list;
+
+    if (list == NULL)
+        return 1;
+
+    while ((ptr = strstr(ptr, name)) != NULL)
+    {
+        if ( ((ptr == list) || (ptr[-1] == ',')) &&
+             ((ptr[len] == '\0') || (ptr[len] == ',')) )
+            return 1;
+        ptr += len;
+    } /* while */
+
+    return 0;
+} /* wantFormat */
+
+static void usage(const char *argv0)
+{
+    const Format *fmt;
+    fprintf(stderr,
+        "USAGE: %s [options]\n"
+        "  -d <dir>     where to generate archives (default: bench_data)\n"
+        "  -n <counts>  comma-separated entry counts (default: 1000)\n"
+        "  -f <list>    comma-separated formats (default: all)\n"
+        "  -t <num>     most threads for the scaling test (default: 8)\n"
+        "  -s <MB>      size of the large file (default: 16)\n"
+        "  -b <secs>    time budget per measurement (default: 0.5)\n"
+        "formats:", argv0);
+    for (fmt = formats; fmt->name; fmt++)
+        fprintf(stderr, " %s", fmt->name);
+    fprintf(stderr, "\n");
+} /* usage */
+
+int main(int argc, char **argv)
+{
+    PHYSFS_uint32 counts[16] = { 1000 };
+    int numCounts = 1;
+    const char *formatList = NULL;
+    const Format *fmt;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if ((arg[0] != '-') || (arg[1] == '\0') || (arg[2] != '\0') || !val)
+        {
+            usage(argv[0]);
+            return 1;
+        } /* if */
+
+        i++;
+        switch (arg[1])
+        {
+            case 'd': dataDir = val; break;
+            case 'n': numCounts = parseList(val, counts, 16); break;
+            case 'f': formatList = val; break;
+            case 't': maxThreads = atoi(val); break;
+            case 's': bigSize = (PHYSFS_uint32) (atof(val) * 1024 * 1024); break;
+            case 'b': benchSeconds = atof(val); break;
+            default: numCounts = 0; break;
+        } /* switch */
+
+        if ((numCounts == 0) || (maxThreads < 1) || (benchSeconds <= 0.0) ||
+            (bigSize < RANDOM_READ_SIZE) || (bigSize > 0x7FFFFFFF))
+        {
+            usage(argv[0]);
+            return 1;
+        } /* if */
+    } /* for */
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init() failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    if (!makeDir(dataDir))
+    {
+        fprintf(stderr, "couldn't create %s\n", dataDir);
+        PHYSFS_deinit();
+        return 1;
+    } /* if */
+
+    crcInit();
+    bigData = (PHYSFS_uint8 *) malloc(bigSize);
+    if (bigData == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        PHYSFS_deinit();
+        return 1;
+    } /* if */
+    fillText(0xB16F11E, bigData, bigSize);
+
+    printf("format,entries,metric,value,unit\n");
+    for (i = 0; i < numCounts; i++)
+    {
+        for (fmt = formats; fmt->name; fmt++)
+        {
+            if (wantFormat(formatList, fmt->name))
+                benchFormat(fmt, counts[i]);
+        } /* for */
+    } /* for */
+
+    free(bigData);
+    PHYSFS_deinit();
+    return 0;
+} /* main */
+
+/* end of bench_physfs.c ... */
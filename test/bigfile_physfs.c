@@ -0,0 +1,574 @@
+/*
+ * PhysicsFS large entry test.
+ *
+ * Mounts a Zip64 archive holding a stored and a deflated entry, both bigger
+ *  than 4 gigabytes, and checks that reads, seeks and tells past the 4 gig
+ *  mark land where they should. The archive is never written anywhere: a
+ *  PHYSFS_Io makes up its bytes on demand, so this needs neither disk space
+ *  nor much memory. The deflated entry is a string of "stored" deflate
+ *  blocks, so zlib still has to walk the whole thing.
+ *
+ * Byte (i) of each entry is (i % 251), and 4 gigs isn't a multiple of 251,
+ *  so a position that wrapped at 32 bits reads the wrong bytes.
+ *
+ * With -l it also reads the deflated entry in a single PHYSFS_readBytes()
+ *  call longer than 4 gigabytes, which needs that much memory.
+ *
+ * The exit status is non-zero if anything came back wrong.
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FOUR_GIGS 0x100000000ULL
+#define STORED_NAME "stored.bin"
+#define DEFLATED_NAME "deflated.bin"
+#define STORED_SIZE (FOUR_GIGS + FOUR_GIGS / 2 + 12345)
+#define DEFLATED_SIZE (FOUR_GIGS + 3 * 65535 + 4321)
+#define DEFLATE_BLOCK 65535
+#define DEFLATE_BLOCK_HEADER 5
+#define DEFLATE_BLOCKS ((DEFLATED_SIZE + DEFLATE_BLOCK - 1) / DEFLATE_BLOCK)
+#define DEFLATED_PACKED (DEFLATED_SIZE + DEFLATE_BLOCKS * DEFLATE_BLOCK_HEADER)
+#define PATTERN_PERIOD 251
+#define CHUNK (1024 * 1024)
+#define DOS_TIME 0x5A210000  /* 2025-01-01 00:00:00 */
+
+/* one stretch of the archive, and where its bytes come from. */
+typedef enum { REGION_BYTES, REGION_STORED, REGION_DEFLATED } RegionType;
+
+typedef struct Region
+{
+    RegionType type;
+    PHYSFS_uint64 start;
+    PHYSFS_uint64 len;
+    PHYSFS_uint8 bytes[256];  /* for REGION_BYTES. */
+} Region;
+
+static Region regions[8];
+static int numRegions = 0;
+static PHYSFS_uint64 archiveLen = 0;
+static PHYSFS_uint8 pattern[PATTERN_PERIOD + CHUNK];
+static PHYSFS_uint8 *buf = NULL;
+
+
+/* the bytes of an entry at [pos, pos+len). */
+static void fillPattern(void *dst, const PHYSFS_uint64 pos, const size_t len)
+{
+    memcpy(dst, pattern + (pos % PATTERN_PERIOD), len);
+} /* fillPattern */
+
+
+/* the deflate stream for the deflated entry, at [pos, pos+len). */
+static void fillDeflated(PHYSFS_uint8 *dst, PHYSFS_uint64 pos, size_t len)
+{
+    const PHYSFS_uint64 blocklen = DEFLATE_BLOCK + DEFLATE_BLOCK_HEADER;
+
+    while (len > 0)
+    {
+        const PHYSFS_uint64 block = pos / blocklen;
+        const PHYSFS_uint64 at = pos % blocklen;
+        const int final = (block == DEFLATE_BLOCKS - 1);
+        const PHYSFS_uint64 datalen = final ?
+                DEFLATED_SIZE - block * DEFLATE_BLOCK : DEFLATE_BLOCK;
+        size_t n;
+
+        if (at < DEFLATE_BLOCK_HEADER)
+        {
+            /* BFINAL, BTYPE 00 (stored), pad to a byte, LEN, NLEN. */
+            const PHYSFS_uint8 hdr[DEFLATE_BLOCK_HEADER] = {
+                (PHYSFS_uint8) final,
+                (PHYSFS_uint8) (datalen & 0xFF),
+                (PHYSFS_uint8) (datalen >> 8),
+                (PHYSFS_uint8) (~datalen & 0xFF),
+                (PHYSFS_uint8) ((~datalen >> 8) & 0xFF)
+            };
+            n = (size_t) (DEFLATE_BLOCK_HEADER - at);
+            if (n > len)
+                n = len;
+            memcpy(dst, hdr + at, n);
+        } /* if */
+        else
+        {
+            n = (size_t) (datalen - (at - DEFLATE_BLOCK_HEADER));
+            if (n > len)
+                n = len;
+            fillPattern(dst, block * DEFLATE_BLOCK + (at - DEFLATE_BLOCK_HEADER), n);
+        } /* else */
+
+        dst += n;
+        pos += n;
+        len -= n;
+    } /* while */
+} /* fillDeflated */
+
+
+static void fillArchive(PHYSFS_uint8 *dst, PHYSFS_uint64 pos, size_t len)
+{
+    int i;
+    for (i = 0; (i < numRegions) && (len > 0); i++)
+    {
+        const Region *r = &regions[i];
+        PHYSFS_uint64 at;
+        size_t n;
+
+        if (pos >= r->start + r->len)
+            continue;
+
+        at = pos - r->start;
+        n = (r->len - at < len) ? (size_t) (r->len - at) : len;
+        if (r->type == REGION_BYTES)
+            memcpy(dst, r->bytes + at, n);
+        else if (r->type == REGION_STORED)
+            fillPattern(dst, at, n);
+        else
+            fillDeflated(dst, at, n);
+
+        dst += n;
+        pos += n;
+        len -= n;
+    } /* for */
+} /* fillArchive */
+
+
+static PHYSFS_sint64 bigIo_read(PHYSFS_Io *io, void *_dst, PHYSFS_uint64 len)
+{
+    PHYSFS_uint64 *pos = (PHYSFS_uint64 *) io->opaque;
+    PHYSFS_uint8 *dst = (PHYSFS_uint8 *) _dst;
+    PHYSFS_uint64 total;
+
+    if (len > archiveLen - *pos)
+        len = archiveLen - *pos;
+
+    /* in pieces, so fillPattern() never runs off the end of the table. */
+    for (total = 0; total < len; )
+    {
+        const size_t n = (len - total > CHUNK) ? CHUNK : (size_t) (len - total);
+        fillArchive(dst + total, *pos, n);
+        *pos += n;
+        total += n;
+    } /* for */
+
+    return (PHYSFS_sint64) len;
+} /* bigIo_read */
+
+static int bigIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
+{
+    if (offset > archiveLen)
+        return 0;
+    *((PHYSFS_uint64 *) io->opaque) = offset;
+    return 1;
+} /* bigIo_seek */
+
+static PHYSFS_sint64 bigIo_tell(PHYSFS_Io *io)
+{
+    return (PHYSFS_sint64) *((PHYSFS_uint64 *) io->opaque);
+} /* bigIo_tell */
+
+static PHYSFS_sint64 bigIo_length(PHYSFS_Io *io)
+{
+    return (PHYSFS_sint64) archiveLen;
+} /* bigIo_length */
+
+static PHYSFS_Io *bigIo_create(void);
+
+static PHYSFS_Io *bigIo_duplicate(PHYSFS_Io *io)
+{
+    return bigIo_create();
+} /* bigIo_duplicate */
+
+static void bigIo_destroy(PHYSFS_Io *io)
+{
+    free(io->opaque);
+    free(io);
+} /* bigIo_destroy */
+
+static PHYSFS_Io *bigIo_create(void)
+{
+    PHYSFS_Io *io = (PHYSFS_Io *) calloc(1, sizeof (PHYSFS_Io));
+    PHYSFS_uint64 *pos = (PHYSFS_uint64 *) calloc(1, sizeof (PHYSFS_uint64));
+    if ((io == NULL) || (pos == NULL))
+    {
+        free(io);
+        free(pos);
+        return NULL;
+    } /* if */
+
+    io->version = 0;
+    io->opaque = pos;
+    io->read = bigIo_read;
+    io->seek = bigIo_seek;
+    io->tell = bigIo_tell;
+    io->length = bigIo_length;
+    io->duplicate = bigIo_duplicate;
+    io->destroy = bigIo_destroy;
+    return io;
+} /* bigIo_create */
+
+
+static PHYSFS_uint8 *put16(PHYSFS_uint8 *p, const PHYSFS_uint32 v)
+{
+    p[0] = (PHYSFS_uint8) (v & 0xFF);
+    p[1] = (PHYSFS_uint8) ((v >> 8) & 0xFF);
+    return p + 2;
+} /* put16 */
+
+static PHYSFS_uint8 *put32(PHYSFS_uint8 *p, const PHYSFS_uint32 v)
+{
+    return put16(put16(p, v & 0xFFFF), v >> 16);
+} /* put32 */
+
+static PHYSFS_uint8 *put64(PHYSFS_uint8 *p, const PHYSFS_uint64 v)
+{
+    return put32(put32(p, (PHYSFS_uint32) v), (PHYSFS_uint32) (v >> 32));
+} /* put64 */
+
+static Region *addRegion(const RegionType type, const PHYSFS_uint64 len)
+{
+    Region *r = &regions[numRegions++];
+    r->type = type;
+    r->start = archiveLen;
+    r->len = len;
+    archiveLen += len;
+    return r;
+} /* addRegion */
+
+static void addLocalHeader(const char *name, const int method,
+                           const PHYSFS_uint64 size, const PHYSFS_uint64 packed)
+{
+    const size_t namelen = strlen(name);
+    Region *r = addRegion(REGION_BYTES, 30 + namelen + 20);
+    PHYSFS_uint8 *p = r->bytes;
+    p = put32(p, 0x04034b50);
+    p = put16(p, 45);  /* version needed: Zip64. */
+    p = put16(p, 0);
+    p = put16(p, method);
+    p = put32(p, DOS_TIME);
+    p = put32(p, 0);  /* crc-32: zero means "don't check." */
+    p = put32(p, 0xFFFFFFFF);
+    p = put32(p, 0xFFFFFFFF);
+    p = put16(p, (PHYSFS_uint32) namelen);
+    p = put16(p, 20);
+    memcpy(p, name, namelen);
+    p += namelen;
+    p = put16(p, 0x0001);  /* Zip64 extended information. */
+    p = put16(p, 16);
+    p = put64(p, size);
+    put64(p, packed);
+} /* addLocalHeader */
+
+static PHYSFS_uint8 *putCentralEntry(PHYSFS_uint8 *p, const char *name,
+                                     const int method, const PHYSFS_uint64 size,
+                                     const PHYSFS_uint64 packed,
+                                     const PHYSFS_uint64 offset)
+{
+    const size_t namelen = strlen(name);
+    p = put32(p, 0x02014b50);
+    p = put16(p, 45);  /* made by: MS-DOS, Zip64. */
+    p = put16(p, 45);
+    p = put16(p, 0);
+    p = put16(p, method);
+    p = put32(p, DOS_TIME);
+    p = put32(p, 0);
+    p = put32(p, 0xFFFFFFFF);
+    p = put32(p, 0xFFFFFFFF);
+    p = put16(p, (PHYSFS_uint32) namelen);
+    p = put16(p, 28);
+    p = put16(p, 0);  /* comment length. */
+    p = put16(p, 0);  /* starting disk. */
+    p = put16(p, 0);  /* internal attributes. */
+    p = put32(p, 0);  /* external attributes. */
+    p = put32(p, 0xFFFFFFFF);
+    memcpy(p, name, namelen);
+    p += namelen;
+    p = put16(p, 0x0001);
+    p = put16(p, 24);
+    p = put64(p, size);
+    p = put64(p, packed);
+    return put64(p, offset);
+} /* putCentralEntry */
+
+static void buildArchive(void)
+{
+    PHYSFS_uint64 storedOfs, deflatedOfs, centralOfs, centralLen, eocd64Ofs;
+    PHYSFS_uint8 *p;
+    Region *r;
+    size_t i;
+
+    for (i = 0; i < sizeof (pattern); i++)
+        pattern[i] = (PHYSFS_uint8) (i % PATTERN_PERIOD);
+
+    storedOfs = archiveLen;
+    addLocalHeader(STORED_NAME, 0, STORED_SIZE, STORED_SIZE);
+    addRegion(REGION_STORED, STORED_SIZE);
+
+    deflatedOfs = archiveLen;
+    addLocalHeader(DEFLATED_NAME, 8, DEFLATED_SIZE, DEFLATED_PACKED);
+    addRegion(REGION_DEFLATED, DEFLATED_PACKED);
+
+    centralOfs = archiveLen;
+    r = addRegion(REGION_BYTES, 0);
+    p = r->bytes;
+    p = putCentralEntry(p, STORED_NAME, 0, STORED_SIZE, STORED_SIZE, storedOfs);
+    p = putCentralEntry(p, DEFLATED_NAME, 8, DEFLATED_SIZE, DEFLATED_PACKED, deflatedOfs);
+    r->len = (PHYSFS_uint64) (p - r->bytes);
+    archiveLen += r->len;
+    centralLen = r->len;
+
+    eocd64Ofs = archiveLen;
+    r = addRegion(REGION_BYTES, 56 + 20 + 22);
+    p = r->bytes;
+    p = put32(p, 0x06064b50);  /* Zip64 end of central directory. */
+    p = put64(p, 44);
+    p = put16(p, 45);
+    p = put16(p, 45);
+    p = put32(p, 0);
+    p = put32(p, 0);
+    p = put64(p, 2);
+    p = put64(p, 2);
+    p = put64(p, centralLen);
+    p = put64(p, centralOfs);
+    p = put32(p, 0x07064b50);  /* ...its locator... */
+    p = put32(p, 0);
+    p = put64(p, eocd64Ofs);
+    p = put32(p, 1);
+    p = put32(p, 0x06054b50);  /* ...and the old end of central directory. */
+    p = put16(p, 0);
+    p = put16(p, 0);
+    p = put16(p, 2);
+    p = put16(p, 2);
+    p = put32(p, (PHYSFS_uint32) centralLen);
+    p = put32(p, 0xFFFFFFFF);
+    put16(p, 0);
+} /* buildArchive */
+
+
+static int failures = 0;
+
+static void fail(const char *fname, const char *what, const PHYSFS_uint64 pos)
+{
+    fprintf(stderr, "FAIL: %s: %s at %llu (%s)\n", fname, what,
+            (unsigned long long) pos,
+            PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+    failures++;
+} /* fail */
+
+
+/* read (len) bytes at the handle's current position, which should be (pos). */
+static int checkRead(PHYSFS_File *f, const char *fname,
+                     const PHYSFS_uint64 pos, const PHYSFS_uint64 len)
+{
+    PHYSFS_uint64 done;
+
+    for (done = 0; done < len; )
+    {
+        const size_t n = (len - done > CHUNK) ? CHUNK : (size_t) (len - done);
+        if (PHYSFS_readBytes(f, buf, n) != (PHYSFS_sint64) n)
+        {
+            fail(fname, "short read", pos + done);
+            return 0;
+        } /* if */
+
+        if (memcmp(buf, pattern + ((pos + done) % PATTERN_PERIOD), n) != 0)
+        {
+            fail(fname, "wrong data", pos + done);
+            return 0;
+        } /* if */
+
+        done += n;
+    } /* for */
+
+    if (PHYSFS_tell(f) != (PHYSFS_sint64) (pos + len))
+    {
+        fail(fname, "wrong tell() after read", pos + len);
+        return 0;
+    } /* if */
+
+    return 1;
+} /* checkRead */
+
+
+static int checkSeekRead(PHYSFS_File *f, const char *fname,
+                         const PHYSFS_uint64 pos, const PHYSFS_uint64 len)
+{
+    if (!PHYSFS_seek(f, pos))
+    {
+        fail(fname, "seek failed", pos);
+        return 0;
+    } /* if */
+
+    if (PHYSFS_tell(f) != (PHYSFS_sint64) pos)
+    {
+        fail(fname, "wrong tell() after seek", pos);
+        return 0;
+    } /* if */
+
+    return checkRead(f, fname, pos, len);
+} /* checkSeekRead */
+
+
+static void checkEof(PHYSFS_File *f, const char *fname, const PHYSFS_uint64 size)
+{
+    if (!PHYSFS_eof(f))
+        fail(fname, "not at EOF", size);
+    else if (PHYSFS_readBytes(f, buf, 1) != 0)
+        fail(fname, "read past EOF", size);
+    else if (PHYSFS_seek(f, size + 1))
+        fail(fname, "seek past EOF", size + 1);
+} /* checkEof */
+
+
+static PHYSFS_File *openBig(const char *fname, const PHYSFS_uint64 size)
+{
+    PHYSFS_File *f = PHYSFS_openRead(fname);
+    if (f == NULL)
+        fail(fname, "open failed", 0);
+    else if (PHYSFS_fileLength(f) != (PHYSFS_sint64) size)
+    {
+        fail(fname, "wrong length", (PHYSFS_uint64) PHYSFS_fileLength(f));
+        PHYSFS_close(f);
+        f = NULL;
+    } /* else if */
+    return f;
+} /* openBig */
+
+
+static void testStored(void)
+{
+    static const PHYSFS_uint64 offsets[] = {
+        0, FOUR_GIGS - 100, FOUR_GIGS, FOUR_GIGS + 123457,
+        STORED_SIZE - 70000, 1000
+    };
+    PHYSFS_File *f = openBig(STORED_NAME, STORED_SIZE);
+    size_t i;
+
+    if (f == NULL)
+        return;
+
+    fprintf(stderr, "%s: seeking around\n", STORED_NAME);
+    for (i = 0; i < sizeof (offsets) / sizeof (offsets[0]); i++)
+    {
+        const PHYSFS_uint64 pos = offsets[i];
+        const PHYSFS_uint64 len = (STORED_SIZE - pos < 70000) ? STORED_SIZE - pos : 70000;
+        checkSeekRead(f, STORED_NAME, pos, len);
+    } /* for */
+
+    if (checkSeekRead(f, STORED_NAME, STORED_SIZE - 10, 10))
+        checkEof(f, STORED_NAME, STORED_SIZE);
+
+    PHYSFS_close(f);
+} /* testStored */
+
+
+static void testDeflated(const int oneBigRead)
+{
+    PHYSFS_File *f = openBig(DEFLATED_NAME, DEFLATED_SIZE);
+    if (f == NULL)
+        return;
+
+    fprintf(stderr, "%s: reading it all\n", DEFLATED_NAME);
+    if (checkRead(f, DEFLATED_NAME, 0, DEFLATED_SIZE))
+        checkEof(f, DEFLATED_NAME, DEFLATED_SIZE);
+
+    /* backwards: decodes from the start again. */
+    fprintf(stderr, "%s: seeking back past 4 gigs\n", DEFLATED_NAME);
+    checkSeekRead(f, DEFLATED_NAME, FOUR_GIGS + 7777, 65536 * 2);
+
+    /* forwards: decodes up to the new spot. */
+    fprintf(stderr, "%s: seeking forward\n", DEFLATED_NAME);
+    checkSeekRead(f, DEFLATED_NAME, DEFLATED_SIZE - 100000, 100000);
+
+    PHYSFS_close(f);
+
+    if (oneBigRead)
+    {
+        PHYSFS_uint8 *all = (PHYSFS_uint8 *) malloc((size_t) DEFLATED_SIZE);
+        PHYSFS_uint64 i;
+
+        fprintf(stderr, "%s: one read for all of it\n", DEFLATED_NAME);
+        if (all == NULL)
+        {
+            fail(DEFLATED_NAME, "out of memory for the one big read", 0);
+            return;
+        } /* if */
+
+        f = openBig(DEFLATED_NAME, DEFLATED_SIZE);
+        if (f != NULL)
+        {
+            if (PHYSFS_readBytes(f, all, DEFLATED_SIZE) != (PHYSFS_sint64) DEFLATED_SIZE)
+                fail(DEFLATED_NAME, "short read", 0);
+            else
+            {
+                for (i = 0; i < DEFLATED_SIZE; i += CHUNK)
+                {
+                    const size_t n = (DEFLATED_SIZE - i > CHUNK) ? CHUNK : (size_t) (DEFLATED_SIZE - i);
+                    if (memcmp(all + i, pattern + (i % PATTERN_PERIOD), n) != 0)
+                    {
+                        fail(DEFLATED_NAME, "wrong data", i);
+                        break;
+                    } /* if */
+                } /* for */
+            } /* else */
+            PHYSFS_close(f);
+        } /* if */
+
+        free(all);
+    } /* if */
+} /* testDeflated */
+
+
+int main(int argc, char **argv)
+{
+    const int oneBigRead = ((argc > 1) && (strcmp(argv[1], "-l") == 0));
+    PHYSFS_Io *io;
+
+    if ((argc > 2) || ((argc == 2) && !oneBigRead))
+    {
+        fprintf(stderr, "USAGE: %s [-l]\n", argv[0]);
+        return 1;
+    } /* if */
+
+    buf = (PHYSFS_uint8 *) malloc(CHUNK);
+    if (buf == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    } /* if */
+
+    buildArchive();
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        free(buf);
+        return 1;
+    } /* if */
+
+    io = bigIo_create();
+    if ((io == NULL) || (!PHYSFS_mountIo(io, "big.zip", NULL, 0)))
+    {
+        fprintf(stderr, "couldn't mount the archive: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        if (io != NULL)
+            io->destroy(io);
+        PHYSFS_deinit();
+        free(buf);
+        return 1;
+    } /* if */
+
+    testStored();
+    testDeflated(oneBigRead);
+
+    PHYSFS_deinit();
+    free(buf);
+
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of bigfile_physfs.c ... */
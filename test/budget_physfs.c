@@ -0,0 +1,297 @@
+/*
+ * PhysicsFS PHYSFS_setMemoryBudget() test.
+ *
+ * Reads every file of an archive through the content cache, largest first,
+ *  then sets a budget of half what that used and checks the oldest cached
+ *  files were dropped to fit and the newest weren't. Then it checks that a
+ *  buffer or stream bigger than the budget is refused without breaking the
+ *  file, that smaller ones are counted until they're gone, that a file the
+ *  budget won't let us cache opens without an error, that
+ *  PHYSFS_lowMemory() gives back the whole cache, and that nothing is
+ *  counted once the cache is off and every file is closed.
+ *
+ * Reports, as CSV on stdout (step,budget,used,peak,trimmed,refused), the
+ *  budget's counters after each step.
+ *
+ * The exit status is non-zero if anything went wrong.
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FILES 256
+#define CACHE_BUDGET (256 * 1024 * 1024)
+
+typedef struct FileList
+{
+    char *names[MAX_FILES];
+    PHYSFS_sint64 sizes[MAX_FILES];
+    int count;
+} FileList;
+
+static int failures = 0;
+
+
+static void check(const int ok, const char *what)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "%s\n", what);
+        failures++;
+    } /* if */
+} /* check */
+
+
+static PHYSFS_MemoryBudgetStats report(const char *step)
+{
+    PHYSFS_MemoryBudgetStats st;
+    if (!PHYSFS_getMemoryBudgetStats(&st))
+    {
+        fprintf(stderr, "PHYSFS_getMemoryBudgetStats() failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        memset(&st, '\0', sizeof (st));
+        failures++;
+    } /* if */
+
+    printf("%s,%llu,%llu,%llu,%llu,%llu\n", step,
+           (unsigned long long) st.budget, (unsigned long long) st.used,
+           (unsigned long long) st.peak, (unsigned long long) st.trimmed,
+           (unsigned long long) st.refused);
+
+    if (st.peak < st.used)
+    {
+        fprintf(stderr, "peak is below what's used after %s\n", step);
+        failures++;
+    } /* if */
+
+    return st;
+} /* report */
+
+
+static PHYSFS_EnumerateCallbackResult listCallback(void *data,
+                                       const char *origdir, const char *fname)
+{
+    FileList *list = (FileList *) data;
+    char *path = (char *) malloc(strlen(origdir) + strlen(fname) + 2);
+    PHYSFS_Stat statbuf;
+
+    if (path == NULL)
+        return PHYSFS_ENUM_ERROR;
+
+    sprintf(path, "%s%s%s", origdir, *origdir ? "/" : "", fname);
+    if (!PHYSFS_stat(path, &statbuf))
+        free(path);
+    else if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
+    {
+        PHYSFS_enumerate(path, listCallback, list);
+        free(path);
+    } /* else if */
+    else if ((statbuf.filetype != PHYSFS_FILETYPE_REGULAR) ||
+             (statbuf.filesize <= 0) || (list->count >= MAX_FILES))
+        free(path);
+    else
+    {
+        list->names[list->count] = path;
+        list->sizes[list->count] = statbuf.filesize;
+        list->count++;
+    } /* else */
+
+    return (list->count < MAX_FILES) ? PHYSFS_ENUM_OK : PHYSFS_ENUM_STOP;
+} /* listCallback */
+
+
+static int largestFirst(const void *_a, const void *_b)
+{
+    const PHYSFS_sint64 a = *((const PHYSFS_sint64 *) _a);
+    const PHYSFS_sint64 b = *((const PHYSFS_sint64 *) _b);
+    return (a < b) ? 1 : ((a > b) ? -1 : 0);
+} /* largestFirst */
+
+
+/* sort by size, largest first, keeping each name with its size. */
+static void sortFiles(FileList *list)
+{
+    PHYSFS_sint64 keyed[MAX_FILES][2];
+    char *names[MAX_FILES];
+    int i;
+
+    for (i = 0; i < list->count; i++)
+    {
+        keyed[i][0] = list->sizes[i];
+        keyed[i][1] = i;
+        names[i] = list->names[i];
+    } /* for */
+
+    qsort(keyed, list->count, sizeof (keyed[0]), largestFirst);
+
+    for (i = 0; i < list->count; i++)
+    {
+        list->sizes[i] = keyed[i][0];
+        list->names[i] = names[keyed[i][1]];
+    } /* for */
+} /* sortFiles */
+
+
+/* open, read and close (name); nonzero if the content cache had it. */
+static int readThrough(const char *name)
+{
+    PHYSFS_ContentCacheStats before, after;
+    PHYSFS_File *f;
+    char buf[4096];
+
+    memset(&before, '\0', sizeof (before));
+    memset(&after, '\0', sizeof (after));
+    PHYSFS_getContentCacheStats(&before);
+    f = PHYSFS_openRead(name);
+    if (f == NULL)
+    {
+        fprintf(stderr, "couldn't open %s: %s\n", name,
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        failures++;
+        return 0;
+    } /* if */
+
+    while (PHYSFS_readBytes(f, buf, sizeof (buf)) > 0) { /* spin. */ }
+    PHYSFS_close(f);
+    PHYSFS_getContentCacheStats(&after);
+    return (after.hits > before.hits);
+} /* readThrough */
+
+
+int main(int argc, char **argv)
+{
+    PHYSFS_MemoryBudgetStats st;
+    PHYSFS_ContentCacheStats cst;
+    PHYSFS_uint64 used, freed;
+    PHYSFS_File *f;
+    FileList list;
+    PHYSFS_uint8 byte;
+    int i;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "USAGE: %s <archive>\n", argv[0]);
+        return 1;
+    } /* if */
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init() failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    if (!PHYSFS_mount(argv[1], NULL, 1))
+    {
+        fprintf(stderr, "couldn't mount %s: %s\n", argv[1],
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    list.count = 0;
+    PHYSFS_enumerate("", listCallback, &list);
+    if (list.count < 2)
+    {
+        fprintf(stderr, "%s needs at least two files that aren't empty\n", argv[1]);
+        return 1;
+    } /* if */
+    sortFiles(&list);
+
+    printf("step,budget,used,peak,trimmed,refused\n");
+    st = report("mount");
+    check(st.used == 0, "something is counted before anything was opened");
+
+    /* cache everything, with no budget yet. */
+    PHYSFS_setContentCache(CACHE_BUDGET, CACHE_BUDGET);
+    for (i = 0; i < list.count; i++)
+        readThrough(list.names[i]);
+    st = report("cached");
+    PHYSFS_getContentCacheStats(&cst);
+    check(st.used == cst.bytes, "cached files aren't counted against the budget");
+    used = st.used;
+
+    /* half of that: the oldest (largest) go, the newest (smallest) stay. */
+    PHYSFS_setMemoryBudget(used / 2);
+    st = report("budget");
+    check(st.used <= used / 2, "setting a budget didn't trim the cache to fit");
+    check(st.trimmed == used - st.used, "trimmed bytes don't match what's gone");
+    check(readThrough(list.names[list.count - 1]),
+          "the most recently used file was trimmed");
+    check(!readThrough(list.names[0]),
+          "the least recently used file wasn't trimmed");
+
+    PHYSFS_setContentCache(0, 0);  /* everything below is just buffers. */
+    st = report("uncached");
+    check(st.used == 0, "still counting cached files with the cache off");
+
+    /* more than the budget can't be had, but the file keeps working. */
+    f = PHYSFS_openRead(list.names[0]);
+    check(f != NULL, "couldn't open a file with a budget set");
+    if (f != NULL)
+    {
+        const PHYSFS_uint64 refused = report("opened").refused;
+        check(!PHYSFS_setBuffer(f, used), "a buffer over the budget was allowed");
+        check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_OUT_OF_MEMORY,
+              "a buffer over the budget didn't fail with OUT_OF_MEMORY");
+        check(!PHYSFS_setStreaming(f, used), "a stream over the budget was allowed");
+        check(PHYSFS_readBytes(f, &byte, 1) == 1, "refusing a buffer broke the file");
+        st = report("refused");
+        check(st.refused == refused + 2, "refusals weren't counted");
+
+        check(PHYSFS_setBuffer(f, 4096), "a buffer under the budget failed");
+        check(report("buffer").used == 4096, "a buffer isn't counted");
+        check(PHYSFS_setBuffer(f, 1024), "shrinking a buffer failed");
+        check(report("shrunk").used == 1024, "a shrunk buffer isn't counted");
+        check(PHYSFS_setStreaming(f, 4096), "a stream under the budget failed");
+        check(report("stream").used == 1024 + 4096, "a stream isn't counted");
+        check(PHYSFS_readBytes(f, &byte, 1) == 1, "reading a budgeted stream failed");
+        PHYSFS_close(f);
+        check(report("closed").used == 0, "a closed file is still counted");
+    } /* if */
+
+    /* a file too big for the budget to cache still opens, and cleanly. */
+    PHYSFS_setMemoryBudget(1);
+    PHYSFS_setContentCache(CACHE_BUDGET, CACHE_BUDGET);
+    PHYSFS_getLastErrorCode();
+    f = PHYSFS_openRead(list.names[0]);
+    check(f != NULL, "couldn't open a file the budget won't let us cache");
+    check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_OK,
+          "refusing to cache a file left an error behind");
+    if (f != NULL)
+        PHYSFS_close(f);
+    st = report("uncacheable");
+    check(st.used == 0, "a file the budget refused was cached anyway");
+
+    /* fill the cache again, and give it all back. */
+    PHYSFS_setMemoryBudget(0);
+    PHYSFS_setContentCache(CACHE_BUDGET, CACHE_BUDGET);
+    for (i = 0; i < list.count; i++)
+        readThrough(list.names[i]);
+    used = report("refilled").used;
+    freed = PHYSFS_lowMemory();
+    st = report("lowmemory");
+    PHYSFS_getContentCacheStats(&cst);
+    check(freed == used, "PHYSFS_lowMemory() didn't give back the whole cache");
+    check((st.used == 0) && (cst.files == 0), "cached files left after PHYSFS_lowMemory()");
+    check(st.budget == 0, "the budget didn't go away");
+
+    for (i = 0; i < list.count; i++)
+        free(list.names[i]);
+
+    if (!PHYSFS_deinit())
+    {
+        fprintf(stderr, "PHYSFS_deinit() failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        failures++;
+    } /* if */
+
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of budget_physfs.c ... */
@@ -0,0 +1,229 @@
+/*
+ * PhysicsFS PHYSFS_setUncached() test.
+ *
+ * Mounts an archive (or directory), and streams one file from it three
+ *  times: with PHYSFS_readBytes(), then the same on a handle with
+ *  PHYSFS_setUncached(), then with PHYSFS_sendToFd() to /dev/null on an
+ *  uncached handle. Before each run the file's bytes are dropped from the
+ *  OS's cache, and after it we count how many of them are cached again,
+ *  with mincore().
+ *
+ * Prints, as CSV on stdout (method,bytes,pages,resident_pages), and the exit
+ *  status is non-zero if either uncached run left more than a quarter of
+ *  the pages in the cache, or read different bytes than the plain one.
+ *
+ * This needs POSIX mmap(), mincore() and posix_fadvise().
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define READ_BUFSIZE (1024 * 1024)
+
+/* the part of a file on disk that holds what we're streaming. */
+typedef struct DiskRange
+{
+    char *path;
+    PHYSFS_uint64 offset;
+    PHYSFS_uint64 len;
+} DiskRange;
+
+static int failures = 0;
+
+
+static void dropRange(const DiskRange *r)
+{
+    const int fd = open(r->path, O_RDONLY);
+    if (fd == -1)
+        return;
+    posix_fadvise(fd, (off_t) r->offset, (off_t) r->len, POSIX_FADV_DONTNEED);
+    close(fd);
+} /* dropRange */
+
+
+static size_t residentPages(const DiskRange *r, size_t *_pages)
+{
+    const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    const PHYSFS_uint64 start = r->offset - (r->offset % page);
+    const size_t len = (size_t) ((r->offset + r->len) - start);
+    const size_t pages = (len + page - 1) / page;
+    unsigned char *vec = NULL;
+    size_t retval = 0;
+    void *map = MAP_FAILED;
+    size_t i;
+    int fd;
+
+    *_pages = pages;
+    if ((len == 0) || ((fd = open(r->path, O_RDONLY)) == -1))
+        return 0;
+
+    map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, (off_t) start);
+    vec = (unsigned char *) malloc(pages);
+    if ((map != MAP_FAILED) && (vec != NULL) && (mincore(map, len, vec) == 0))
+    {
+        for (i = 0; i < pages; i++)
+            retval += (vec[i] & 1);
+    } /* if */
+
+    free(vec);
+    if (map != MAP_FAILED)
+        munmap(map, len);
+    close(fd);
+    return retval;
+} /* residentPages */
+
+
+/* reads it all and returns a checksum of what came out, or 0 on failure. */
+static PHYSFS_uint64 streamFile(const char *fname, const int uncached,
+                                const int sendfd, PHYSFS_uint64 *_len)
+{
+    PHYSFS_File *f = PHYSFS_openRead(fname);
+    PHYSFS_uint8 *buf = (PHYSFS_uint8 *) malloc(READ_BUFSIZE);
+    PHYSFS_uint64 sum = 1;
+    PHYSFS_uint64 total = 0;
+    PHYSFS_sint64 br;
+    PHYSFS_sint64 i;
+
+    if ((f == NULL) || (buf == NULL))
+        goto streamFile_failed;
+
+    if (uncached && !PHYSFS_setUncached(f, 1))
+        goto streamFile_failed;
+
+    if (sendfd)
+    {
+        const int fd = open("/dev/null", O_WRONLY);
+        const PHYSFS_sint64 len = PHYSFS_fileLength(f);
+        if (fd == -1)
+            goto streamFile_failed;
+        br = PHYSFS_sendToFd(f, fd, (PHYSFS_uint64) len);
+        close(fd);
+        if (br != len)
+            goto streamFile_failed;
+        total = (PHYSFS_uint64) br;
+        sum = 0;  /* nothing to check. */
+    } /* if */
+
+    else
+    {
+        while ((br = PHYSFS_readBytes(f, buf, READ_BUFSIZE)) > 0)
+        {
+            for (i = 0; i < br; i++)
+                sum = (sum * 31) + buf[i];
+            total += (PHYSFS_uint64) br;
+        } /* while */
+
+        if (br < 0)
+            goto streamFile_failed;
+    } /* else */
+
+    free(buf);
+    PHYSFS_close(f);
+    *_len = total;
+    return sum;
+
+streamFile_failed:
+    fprintf(stderr, "couldn't stream %s: %s\n", fname,
+            PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+    free(buf);
+    if (f != NULL)
+        PHYSFS_close(f);
+    failures++;
+    return 0;
+} /* streamFile */
+
+
+static void runTest(const char *method, const DiskRange *r, const char *fname,
+                    const int uncached, const int sendfd, PHYSFS_uint64 *_sum)
+{
+    PHYSFS_uint64 len = 0;
+    PHYSFS_uint64 sum;
+    size_t pages, resident;
+
+    dropRange(r);
+    sum = streamFile(fname, uncached, sendfd, &len);
+    resident = residentPages(r, &pages);
+    printf("%s,%llu,%u,%u\n", method, (unsigned long long) len,
+           (unsigned int) pages, (unsigned int) resident);
+
+    if (uncached && (resident > pages / 4))
+    {
+        fprintf(stderr, "%s: %u of %u pages still cached\n", method,
+                (unsigned int) resident, (unsigned int) pages);
+        failures++;
+    } /* if */
+
+    if (*_sum == 0)
+        *_sum = sum;
+    else if ((sum != 0) && (sum != *_sum))
+    {
+        fprintf(stderr, "%s: read different bytes\n", method);
+        failures++;
+    } /* else if */
+} /* runTest */
+
+
+int main(int argc, char **argv)
+{
+    PHYSFS_PhysicalStat pstat;
+    PHYSFS_uint64 sum = 0;
+    DiskRange range;
+    struct stat statbuf;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "USAGE: %s <archive> <file>\n", argv[0]);
+        return 1;
+    } /* if */
+
+    if (!PHYSFS_init(argv[0]) || !PHYSFS_mount(argv[1], NULL, 0))
+    {
+        fprintf(stderr, "couldn't mount %s: %s\n", argv[1],
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    /* directories don't have a physical range, it's the whole file. */
+    if ((stat(argv[1], &statbuf) == 0) && S_ISDIR(statbuf.st_mode))
+    {
+        range.path = (char *) malloc(strlen(argv[1]) + strlen(argv[2]) + 2);
+        sprintf(range.path, "%s/%s", argv[1], argv[2]);
+        range.offset = 0;
+        range.len = (stat(range.path, &statbuf) == 0) ? statbuf.st_size : 0;
+    } /* if */
+
+    else if (PHYSFS_statPhysical(argv[2], &pstat))
+    {
+        range.path = strdup(pstat.archive);
+        range.offset = pstat.offset;
+        range.len = pstat.storedsize;
+    } /* else if */
+
+    else
+    {
+        fprintf(stderr, "can't find %s on disk: %s\n", argv[2],
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        PHYSFS_deinit();
+        return 1;
+    } /* else */
+
+    printf("method,bytes,pages,resident_pages\n");
+    runTest("read", &range, argv[2], 0, 0, &sum);
+    runTest("read_uncached", &range, argv[2], 1, 0, &sum);
+    runTest("sendtofd_uncached", &range, argv[2], 1, 1, &sum);
+
+    free(range.path);
+    PHYSFS_deinit();
+    return (failures > 0) ? 1 : 0;
+} /* main */
+
+/* end of cache_physfs.c ... */
@@ -0,0 +1,194 @@
+/*
+ * PhysicsFS PHYSFS_setDecodeThreads() test.
+ *
+ * Reads one deflated file from a ZIP archive whole, on one thread, to get
+ *  what it should contain. Then it reads it whole again on a handle with
+ *  PHYSFS_setDecodeThreads(), twice: the first time saves checkpoints, the
+ *  second decodes between them in parallel. Both must match, and the time
+ *  each took is reported as CSV on stdout (method,threads,bytes,seconds).
+ *
+ * After that, reads at random places and of random sizes, some of them
+ *  spanning several checkpoints, are checked on the threaded handle and on
+ *  a plain one, which seeks from checkpoints now too.
+ *
+ * The whole file is held in memory twice, so it can't be too big. The exit
+ *  status is non-zero if anything read back wrong.
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FILE_SIZE (1024 * 1024 * 1024)
+#define RANDOM_READS 200
+
+static int failures = 0;
+static PHYSFS_uint32 rng = 54321;
+
+
+static PHYSFS_uint64 nextRandom(PHYSFS_uint64 max)
+{
+    PHYSFS_uint64 v;
+    rng = (rng * 1103515245) + 12345;
+    v = rng >> 8;
+    rng = (rng * 1103515245) + 12345;
+    v = (v << 24) | (rng >> 8);
+    return v % max;
+} /* nextRandom */
+
+
+static double nowSeconds(void)
+{
+    return ((double) __PHYSFS_platformGetTicks()) / 1000000000.0;
+} /* nowSeconds */
+
+
+static int readWhole(PHYSFS_File *f, PHYSFS_uint8 *buf, PHYSFS_uint64 len,
+                     const char *method, const PHYSFS_uint32 threads)
+{
+    const double start = nowSeconds();
+    PHYSFS_sint64 br;
+
+    if (!PHYSFS_seek(f, 0))
+        return 0;
+    br = PHYSFS_readBytes(f, buf, len);
+    printf("%s,%u,%lld,%.3f\n", method, (unsigned int) threads,
+           (long long) br, nowSeconds() - start);
+    return (br == (PHYSFS_sint64) len);
+} /* readWhole */
+
+
+static void checkRange(PHYSFS_File *f, const char *name,
+                       const PHYSFS_uint8 *expected, PHYSFS_uint8 *buf,
+                       const PHYSFS_uint64 pos, const PHYSFS_uint64 len)
+{
+    PHYSFS_sint64 br;
+
+    if (!PHYSFS_seek(f, pos))
+    {
+        fprintf(stderr, "%s: seek to %llu failed: %s\n", name,
+                (unsigned long long) pos,
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        failures++;
+        return;
+    } /* if */
+
+    br = PHYSFS_readBytes(f, buf, len);
+    if (br != (PHYSFS_sint64) len)
+    {
+        fprintf(stderr, "%s: read of %llu at %llu returned %lld\n", name,
+                (unsigned long long) len, (unsigned long long) pos,
+                (long long) br);
+        failures++;
+    } /* if */
+    else if (memcmp(buf, expected + pos, (size_t) len) != 0)
+    {
+        fprintf(stderr, "%s: read of %llu at %llu was wrong\n", name,
+                (unsigned long long) len, (unsigned long long) pos);
+        failures++;
+    } /* else if */
+    else if (PHYSFS_tell(f) != (PHYSFS_sint64) (pos + len))
+    {
+        fprintf(stderr, "%s: tell after read at %llu is wrong\n", name,
+                (unsigned long long) pos);
+        failures++;
+    } /* else if */
+} /* checkRange */
+
+
+int main(int argc, char **argv)
+{
+    PHYSFS_File *plain = NULL;
+    PHYSFS_File *threaded = NULL;
+    PHYSFS_uint8 *expected = NULL;
+    PHYSFS_uint8 *buf = NULL;
+    PHYSFS_uint32 threads = 4;
+    PHYSFS_sint64 len;
+    int i;
+
+    if ((argc != 3) && (argc != 4))
+    {
+        fprintf(stderr, "USAGE: %s <archive> <file> [threads]\n", argv[0]);
+        return 1;
+    } /* if */
+
+    if (argc == 4)
+        threads = (PHYSFS_uint32) atoi(argv[3]);
+
+    if (!PHYSFS_init(argv[0]) || !PHYSFS_mount(argv[1], NULL, 0))
+    {
+        fprintf(stderr, "couldn't mount %s: %s\n", argv[1],
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    plain = PHYSFS_openRead(argv[2]);
+    threaded = PHYSFS_openRead(argv[2]);
+    if (!plain || !threaded || !PHYSFS_setDecodeThreads(threaded, threads))
+    {
+        fprintf(stderr, "couldn't open %s: %s\n", argv[2],
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    len = PHYSFS_fileLength(plain);
+    if ((len <= 0) || (len > MAX_FILE_SIZE))
+    {
+        fprintf(stderr, "%s is empty or too big to test\n", argv[2]);
+        return 1;
+    } /* if */
+
+    expected = (PHYSFS_uint8 *) malloc((size_t) len);
+    buf = (PHYSFS_uint8 *) malloc((size_t) len);
+    if (!expected || !buf)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    } /* if */
+
+    printf("method,threads,bytes,seconds\n");
+    if (!readWhole(plain, expected, len, "plain", 1))
+    {
+        fprintf(stderr, "couldn't read %s\n", argv[2]);
+        return 1;
+    } /* if */
+
+    for (i = 0; i < 2; i++)
+    {
+        memset(buf, '\0', (size_t) len);
+        if (!readWhole(threaded, buf, len, i ? "parallel" : "checkpointing", threads))
+        {
+            fprintf(stderr, "threaded read %d failed: %s\n", i,
+                    PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            failures++;
+        } /* if */
+        else if (memcmp(buf, expected, (size_t) len) != 0)
+        {
+            fprintf(stderr, "threaded read %d was wrong\n", i);
+            failures++;
+        } /* else if */
+    } /* for */
+
+    for (i = 0; (i < RANDOM_READS) && (failures == 0); i++)
+    {
+        const PHYSFS_uint64 pos = nextRandom((PHYSFS_uint64) len);
+        const PHYSFS_uint64 most = (PHYSFS_uint64) len - pos;
+        const PHYSFS_uint64 amount = (i % 4) ? nextRandom(most < 65536 ? most : 65536) + 1 : nextRandom(most) + 1;
+        checkRange(threaded, "threaded", expected, buf, pos, amount);
+        checkRange(plain, "plain", expected, buf, pos, amount);
+    } /* for */
+
+    PHYSFS_close(plain);
+    PHYSFS_close(threaded);
+    free(expected);
+    free(buf);
+    PHYSFS_deinit();
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of decode_physfs.c ... */
@@ -0,0 +1,382 @@
+/*
+ * PhysicsFS PHYSFS_setIndexCache() test.
+ *
+ * Mounts a ZIP archive the usual way and notes the size, time and contents
+ *  of every file in it. Then, with an index cache in a new directory under
+ *  (dir), it mounts the archive again, which builds the shared index, and
+ *  once more, which just maps it, and then does that in a few child
+ *  processes at once too. Every one of those mounts must show the same
+ *  files with the same contents.
+ *
+ * Reports, as CSV on stdout (mode,mount_ms,heap_bytes,files), how long each
+ *  mount took and how much heap PhysicsFS was holding for it afterwards.
+ *  With the index mapped, that should be next to nothing however big the
+ *  archive is; the index lives in the page cache, once for every process.
+ *
+ * The index directory is removed at the end. The exit status is non-zero
+ *  if anything went wrong.
+ *
+ * This needs POSIX (fork, mkdtemp).
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/wait.h>
+
+#define MAX_PROCESSES 64
+
+typedef struct TestFile
+{
+    char *path;
+    PHYSFS_sint64 size;
+    PHYSFS_sint64 modtime;
+    PHYSFS_uint64 hash;
+} TestFile;
+
+static TestFile *files = NULL;
+static size_t numFiles = 0;
+static size_t maxFiles = 0;
+static int failures = 0;
+
+/* PhysicsFS's heap, so we can see what a mount keeps. */
+static PHYSFS_sint64 heapBytes = 0;
+
+
+static void *countingMalloc(PHYSFS_uint64 len)
+{
+    PHYSFS_uint64 *ptr = (PHYSFS_uint64 *) malloc((size_t) len + 16);
+    if (ptr == NULL)
+        return NULL;
+    *ptr = len;
+    __atomic_add_fetch(&heapBytes, (PHYSFS_sint64) len, __ATOMIC_RELAXED);
+    return ((PHYSFS_uint8 *) ptr) + 16;
+} /* countingMalloc */
+
+static void countingFree(void *_ptr)
+{
+    if (_ptr != NULL)
+    {
+        PHYSFS_uint64 *ptr = (PHYSFS_uint64 *) (((PHYSFS_uint8 *) _ptr) - 16);
+        __atomic_sub_fetch(&heapBytes, (PHYSFS_sint64) *ptr, __ATOMIC_RELAXED);
+        free(ptr);
+    } /* if */
+} /* countingFree */
+
+static void *countingRealloc(void *_ptr, PHYSFS_uint64 len)
+{
+    void *retval = countingMalloc(len);
+    if ((retval != NULL) && (_ptr != NULL))
+    {
+        const PHYSFS_uint64 *ptr = (const PHYSFS_uint64 *) (((PHYSFS_uint8 *) _ptr) - 16);
+        memcpy(retval, _ptr, (size_t) ((*ptr < len) ? *ptr : len));
+        countingFree(_ptr);
+    } /* if */
+    return retval;
+} /* countingRealloc */
+
+static PHYSFS_sint64 heapNow(void)
+{
+    return __atomic_load_n(&heapBytes, __ATOMIC_RELAXED);
+} /* heapNow */
+
+
+static double nowSeconds(void)
+{
+    return ((double) __PHYSFS_platformGetTicks()) / 1000000000.0;
+} /* nowSeconds */
+
+static const char *lastError(void)
+{
+    return PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
+} /* lastError */
+
+
+static PHYSFS_uint64 hashFile(const char *path, int *ok)
+{
+    PHYSFS_uint64 hash = 0xCBF29CE484222325ULL;
+    PHYSFS_uint8 buf[16384];
+    PHYSFS_File *f = PHYSFS_openRead(path);
+    PHYSFS_sint64 br;
+
+    *ok = (f != NULL);
+    if (f == NULL)
+        return 0;
+
+    while ((br = PHYSFS_readBytes(f, buf, sizeof (buf))) > 0)
+    {
+        PHYSFS_sint64 i;
+        for (i = 0; i < br; i++)
+            hash = (hash ^ buf[i]) * 0x100000001B3ULL;
+    } /* while */
+
+    *ok = (br == 0);
+    PHYSFS_close(f);
+    return hash;
+} /* hashFile */
+
+
+static PHYSFS_EnumerateCallbackResult collectFiles(void *data, const char *dir,
+                                                   const char *fname)
+{
+    size_t *seen = (size_t *) data;
+    char path[1024];
+    PHYSFS_Stat statbuf;
+
+    if (snprintf(path, sizeof (path), "%s%s%s", dir, *dir ? "/" : "",
+                 fname) >= (int) sizeof (path))
+        return PHYSFS_ENUM_OK;  /* skip it. */
+    else if (!PHYSFS_stat(path, &statbuf))
+        return PHYSFS_ENUM_OK;  /* broken entries are broken everywhere. */
+    else if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
+        return PHYSFS_enumerate(path, collectFiles, data) ? PHYSFS_ENUM_OK : PHYSFS_ENUM_ERROR;
+    else if (statbuf.filetype != PHYSFS_FILETYPE_REGULAR)
+        return PHYSFS_ENUM_OK;
+
+    if (seen != NULL)  /* just counting, this time. */
+    {
+        (*seen)++;
+        return PHYSFS_ENUM_OK;
+    } /* if */
+
+    if (numFiles == maxFiles)
+    {
+        const size_t newmax = maxFiles ? maxFiles * 2 : 1024;
+        TestFile *ptr = (TestFile *) realloc(files, newmax * sizeof (TestFile));
+        if (ptr == NULL)
+            return PHYSFS_ENUM_ERROR;
+        files = ptr;
+        maxFiles = newmax;
+    } /* if */
+
+    files[numFiles].path = strdup(path);
+    files[numFiles].size = statbuf.filesize;
+    files[numFiles].modtime = statbuf.modtime;
+    if (files[numFiles].path == NULL)
+        return PHYSFS_ENUM_ERROR;
+    numFiles++;
+    return PHYSFS_ENUM_OK;
+} /* collectFiles */
+
+
+/* everything has to look like it did the first time. */
+static int checkFiles(const char *mode)
+{
+    size_t seen = 0;
+    size_t i;
+
+    if (!PHYSFS_enumerate("", collectFiles, &seen) || (seen != numFiles))
+    {
+        fprintf(stderr, "%s: found %llu files, expected %llu\n", mode,
+                (unsigned long long) seen, (unsigned long long) numFiles);
+        return 0;
+    } /* if */
+
+    for (i = 0; i < numFiles; i++)
+    {
+        const TestFile *f = &files[i];
+        PHYSFS_Stat statbuf;
+        int ok;
+
+        if (!PHYSFS_stat(f->path, &statbuf))
+        {
+            fprintf(stderr, "%s: couldn't stat %s: %s\n", mode, f->path, lastError());
+            return 0;
+        } /* if */
+        else if ((statbuf.filesize != f->size) || (statbuf.modtime != f->modtime))
+        {
+            fprintf(stderr, "%s: %s has the wrong size or time\n", mode, f->path);
+            return 0;
+        } /* else if */
+        else if ((hashFile(f->path, &ok) != f->hash) || !ok)
+        {
+            fprintf(stderr, "%s: %s read back wrong\n", mode, f->path);
+            return 0;
+        } /* else if */
+    } /* for */
+
+    if (PHYSFS_exists("this/file/does/not/exist"))
+    {
+        fprintf(stderr, "%s: found a file that isn't there\n", mode);
+        return 0;
+    } /* if */
+
+    return 1;
+} /* checkFiles */
+
+
+/* mount, report, check, unmount. */
+static int timeMount(const char *archive, const char *mode, const int learn)
+{
+    const PHYSFS_sint64 heap = heapNow();
+    const double start = nowSeconds();
+    int ok;
+
+    if (!PHYSFS_mount(archive, NULL, 1))
+    {
+        fprintf(stderr, "%s: couldn't mount %s: %s\n", mode, archive, lastError());
+        return 0;
+    } /* if */
+
+    printf("%s,%.3f,%lld,", mode, (nowSeconds() - start) * 1000.0,
+           (long long) (heapNow() - heap));
+
+    if (!learn)
+        ok = checkFiles(mode);
+    else
+    {
+        size_t i;
+        ok = PHYSFS_enumerate("", collectFiles, NULL);
+        for (i = 0; ok && (i < numFiles); i++)
+            files[i].hash = hashFile(files[i].path, &ok);
+        if (!ok)
+            fprintf(stderr, "couldn't read %s: %s\n", archive, lastError());
+    } /* else */
+
+    printf("%llu\n", (unsigned long long) numFiles);
+    fflush(stdout);
+    PHYSFS_unmount(archive);
+    return ok;
+} /* timeMount */
+
+
+static int startPhysFS(const char *argv0, const char *indexdir)
+{
+    if (!PHYSFS_init(argv0))
+    {
+        fprintf(stderr, "PHYSFS_init() failed: %s\n", lastError());
+        return 0;
+    } /* if */
+    else if (indexdir && !PHYSFS_setIndexCache(indexdir))
+    {
+        fprintf(stderr, "PHYSFS_setIndexCache() failed: %s\n", lastError());
+        PHYSFS_deinit();
+        return 0;
+    } /* else if */
+    return 1;
+} /* startPhysFS */
+
+
+static void removeIndexDir(const char *indexdir)
+{
+    DIR *dirp = opendir(indexdir);
+    struct dirent *dent;
+    char path[2048];
+
+    while (dirp && ((dent = readdir(dirp)) != NULL))
+    {
+        if (strcmp(dent->d_name, ".") && strcmp(dent->d_name, ".."))
+        {
+            snprintf(path, sizeof (path), "%s/%s", indexdir, dent->d_name);
+            remove(path);
+        } /* if */
+    } /* while */
+
+    if (dirp)
+        closedir(dirp);
+    rmdir(indexdir);
+} /* removeIndexDir */
+
+
+int main(int argc, char **argv)
+{
+    PHYSFS_Allocator counting;
+    pid_t pids[MAX_PROCESSES];
+    char indexdir[1024];
+    const char *archive;
+    int processes = 4;
+    int argi = 1;
+    int i;
+
+    if ((argc > 2) && (strcmp(argv[1], "-p") == 0))
+    {
+        processes = atoi(argv[2]);
+        argi += 2;
+    } /* if */
+
+    if ((argc - argi != 2) || (processes < 0) || (processes > MAX_PROCESSES))
+    {
+        fprintf(stderr, "USAGE: %s [-p processes] <archive.zip> <dir>\n", argv[0]);
+        return 1;
+    } /* if */
+
+    archive = argv[argi];
+    snprintf(indexdir, sizeof (indexdir), "%s/index_physfs.XXXXXX", argv[argi + 1]);
+    if (mkdtemp(indexdir) == NULL)
+    {
+        fprintf(stderr, "couldn't make a directory in %s\n", argv[argi + 1]);
+        return 1;
+    } /* if */
+
+    memset(&counting, '\0', sizeof (counting));
+    counting.Malloc = countingMalloc;
+    counting.Realloc = countingRealloc;
+    counting.Free = countingFree;
+    PHYSFS_setAllocator(&counting);
+
+    printf("mode,mount_ms,heap_bytes,files\n");
+    fflush(stdout);
+
+    if (!startPhysFS(argv[0], NULL))
+        failures++;
+    else
+    {
+        if (!timeMount(archive, "plain", 1) || (numFiles == 0))
+            failures++;
+        PHYSFS_deinit();
+    } /* else */
+
+    if ((failures == 0) && startPhysFS(argv[0], indexdir))
+    {
+        if (!timeMount(archive, "build", 0) || !timeMount(archive, "attach", 0))
+            failures++;
+        PHYSFS_deinit();
+    } /* if */
+    else
+    {
+        failures++;
+    } /* else */
+
+    /* now several processes at once, all mapping what's there. */
+    for (i = 0; (failures == 0) && (i < processes); i++)
+    {
+        pids[i] = fork();
+        if (pids[i] == 0)
+        {
+            int ok = startPhysFS(argv[0], indexdir);
+            ok = ok && timeMount(archive, "process", 0);
+            PHYSFS_deinit();
+            _exit(ok ? 0 : 1);
+        } /* if */
+        else if (pids[i] == -1)
+        {
+            fprintf(stderr, "couldn't start process %d\n", i);
+            failures++;
+            processes = i;
+        } /* else if */
+    } /* for */
+
+    for (i = 0; (i < processes) && (pids[i] > 0); i++)
+    {
+        int status = 0;
+        if ((waitpid(pids[i], &status, 0) == -1) || !WIFEXITED(status) ||
+            (WEXITSTATUS(status) != 0))
+            failures++;
+    } /* for */
+
+    removeIndexDir(indexdir);
+    for (i = 0; i < (int) numFiles; i++)
+        free(files[i].path);
+    free(files);
+
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of index_physfs.c ... */
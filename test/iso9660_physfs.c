@@ -0,0 +1,319 @@
+/*
+ * PhysicsFS ISO9660 directory test.
+ *
+ * Builds a small ISO9660 image in memory, with files in the root, in a
+ *  subdirectory and in a directory under that, mounts it, and checks that
+ *  every directory lists exactly what's in it, with no trace of the "."
+ *  and ".." records every ISO9660 directory starts with, and that every
+ *  file stats and reads right. Then it builds an image where a directory
+ *  lists itself under a real name, which must still fail to mount with
+ *  PHYSFS_ERR_CORRUPT.
+ *
+ * Reports, as CSV on stdout (image,mounted,failures), each image. The exit
+ *  status is non-zero if anything went wrong.
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ISO_SECTOR 2048
+
+/* where everything goes: the descriptors, then one sector each. */
+#define PVD_SECTOR 16
+#define ROOT_SECTOR 18
+#define SUB_SECTOR 19
+#define DEEP_SECTOR 20
+#define A_SECTOR 21
+#define B_SECTOR 22
+#define C_SECTOR 23
+#define TOTAL_SECTORS 24
+
+static PHYSFS_uint8 image[TOTAL_SECTORS * ISO_SECTOR];
+static const char *currentImage = "";
+static int failures = 0;
+
+
+static void check(const int ok, const char *what, const char *path)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "%s: %s: %s\n", currentImage, path, what);
+        failures++;
+    } /* if */
+} /* check */
+
+
+static const char *lastError(void)
+{
+    return PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
+} /* lastError */
+
+
+static void put16(PHYSFS_uint8 *buf, const PHYSFS_uint32 val)
+{
+    buf[0] = (PHYSFS_uint8) (val & 0xFF);
+    buf[1] = (PHYSFS_uint8) ((val >> 8) & 0xFF);
+} /* put16 */
+
+
+/* ISO9660 "both-endian" fields: littleendian, then the same in bigendian. */
+static void putBoth16(PHYSFS_uint8 *buf, const PHYSFS_uint32 val)
+{
+    put16(buf, val);
+    buf[2] = (PHYSFS_uint8) ((val >> 8) & 0xFF);
+    buf[3] = (PHYSFS_uint8) (val & 0xFF);
+} /* putBoth16 */
+
+
+static void putBoth32(PHYSFS_uint8 *buf, const PHYSFS_uint32 val)
+{
+    put16(buf, val & 0xFFFF);
+    put16(buf + 2, (val >> 16) & 0xFFFF);
+    buf[4] = (PHYSFS_uint8) ((val >> 24) & 0xFF);
+    buf[5] = (PHYSFS_uint8) ((val >> 16) & 0xFF);
+    buf[6] = (PHYSFS_uint8) ((val >> 8) & 0xFF);
+    buf[7] = (PHYSFS_uint8) (val & 0xFF);
+} /* putBoth32 */
+
+
+/* write a directory record at (*pos), and move (*pos) past it. */
+static void putRecord(size_t *pos, const PHYSFS_uint32 extent,
+                      const PHYSFS_uint32 len, const int isdir,
+                      const char *name, const size_t namelen)
+{
+    PHYSFS_uint8 *rec = image + *pos;
+    const size_t reclen = (33 + namelen) + ((33 + namelen) & 1);
+
+    rec[0] = (PHYSFS_uint8) reclen;
+    rec[1] = 0;  /* extended attribute record length */
+    putBoth32(rec + 2, extent);
+    putBoth32(rec + 10, len);
+    rec[18] = 120;  /* 2020-01-01 00:00:00 */
+    rec[19] = 1;
+    rec[20] = 1;
+    rec[25] = isdir ? 2 : 0;
+    putBoth16(rec + 28, 1);  /* volume sequence number */
+    rec[32] = (PHYSFS_uint8) namelen;
+    memcpy(rec + 33, name, namelen);
+
+    *pos += reclen;
+} /* putRecord */
+
+
+/* a directory's sector starts with "." for itself and ".." for its parent. */
+static size_t beginDir(const PHYSFS_uint32 sector, const PHYSFS_uint32 parent)
+{
+    size_t pos = sector * ISO_SECTOR;
+    putRecord(&pos, sector, ISO_SECTOR, 1, "\0", 1);
+    putRecord(&pos, parent, ISO_SECTOR, 1, "\1", 1);
+    return pos;
+} /* beginDir */
+
+
+static void putFile(size_t *pos, const PHYSFS_uint32 sector,
+                    const char *name, const char *contents)
+{
+    const size_t len = strlen(contents);
+    memcpy(image + (sector * ISO_SECTOR), contents, len);
+    putRecord(pos, sector, (PHYSFS_uint32) len, 0, name, strlen(name));
+} /* putFile */
+
+
+/* (loop) makes SUB list itself as LOOP. */
+static void buildImage(const int loop)
+{
+    PHYSFS_uint8 *pvd = image + (PVD_SECTOR * ISO_SECTOR);
+    size_t pos;
+
+    memset(image, '\0', sizeof (image));
+
+    pvd[0] = 1;  /* primary volume descriptor */
+    memcpy(pvd + 1, "CD001", 5);
+    pvd[6] = 1;
+    memcpy(pvd + 40, "PHYSFS_TEST", 11);
+    putBoth32(pvd + 80, TOTAL_SECTORS);  /* volume space size */
+    putBoth16(pvd + 120, 1);  /* volume set size */
+    putBoth16(pvd + 124, 1);  /* volume sequence number */
+    putBoth16(pvd + 128, ISO_SECTOR);
+    pos = (PVD_SECTOR * ISO_SECTOR) + 156;
+    putRecord(&pos, ROOT_SECTOR, ISO_SECTOR, 1, "\0", 1);
+    pvd[881] = 1;  /* file structure version */
+
+    pvd += ISO_SECTOR;  /* volume descriptor set terminator */
+    pvd[0] = 255;
+    memcpy(pvd + 1, "CD001", 5);
+    pvd[6] = 1;
+
+    pos = beginDir(ROOT_SECTOR, ROOT_SECTOR);  /* the root is its own parent. */
+    putFile(&pos, A_SECTOR, "A.TXT;1", "in the root");
+    putRecord(&pos, SUB_SECTOR, ISO_SECTOR, 1, "SUB", 3);
+
+    pos = beginDir(SUB_SECTOR, ROOT_SECTOR);
+    putFile(&pos, B_SECTOR, "B.TXT;1", "in a subdirectory");
+    putRecord(&pos, DEEP_SECTOR, ISO_SECTOR, 1, "DEEP", 4);
+    if (loop)
+        putRecord(&pos, SUB_SECTOR, ISO_SECTOR, 1, "LOOP", 4);
+
+    pos = beginDir(DEEP_SECTOR, SUB_SECTOR);
+    putFile(&pos, C_SECTOR, "C.TXT;1", "two levels down");
+} /* buildImage */
+
+
+/* what the archiver should say for 2020-01-01 00:00:00, in local time. */
+static PHYSFS_sint64 imageTime(void)
+{
+    struct tm t;
+    memset(&t, '\0', sizeof (t));
+    t.tm_year = 120;
+    t.tm_mday = 1;
+    t.tm_isdst = -1;
+    return (PHYSFS_sint64) mktime(&t);
+} /* imageTime */
+
+
+static void checkFile(const char *path, const char *contents)
+{
+    const size_t len = strlen(contents);
+    PHYSFS_File *f;
+    PHYSFS_Stat st;
+    char buf[64];
+
+    if (!PHYSFS_stat(path, &st))
+    {
+        check(0, lastError(), path);
+        return;
+    } /* if */
+
+    check(st.filetype == PHYSFS_FILETYPE_REGULAR, "not a file", path);
+    check(st.filesize == (PHYSFS_sint64) len, "wrong size", path);
+    check(st.modtime == imageTime(), "wrong modtime", path);
+
+    f = PHYSFS_openRead(path);
+    if (f == NULL)
+        check(0, lastError(), path);
+    else
+    {
+        const PHYSFS_sint64 br = PHYSFS_readBytes(f, buf, sizeof (buf));
+        check((br == (PHYSFS_sint64) len) && (memcmp(buf, contents, len) == 0),
+              "read the wrong data", path);
+        PHYSFS_close(f);
+    } /* else */
+} /* checkFile */
+
+
+/* (names) is NULL-terminated; each must be listed once, and nothing else. */
+static void checkList(const char *dir, const char * const *names)
+{
+    char **list = PHYSFS_enumerateFiles(dir);
+    char **i;
+    int expected = 0;
+    int found = 0;
+    PHYSFS_Stat st;
+
+    if (list == NULL)
+    {
+        check(0, lastError(), dir);
+        return;
+    } /* if */
+
+    check(PHYSFS_stat(dir, &st) && (st.filetype == PHYSFS_FILETYPE_DIRECTORY),
+          "not a directory", dir);
+
+    for (; names[expected] != NULL; expected++)
+    {
+        int seen = 0;
+        for (i = list; *i != NULL; i++)
+            seen += (strcmp(*i, names[expected]) == 0);
+        check(seen == 1, "lists a name the wrong number of times", names[expected]);
+    } /* for */
+
+    for (i = list; *i != NULL; i++)
+    {
+        check((**i != '\0') && (**i != '\1') && strcmp(*i, ".") &&
+              strcmp(*i, ".."), "lists a \".\" or \"..\" record", dir);
+        found++;
+    } /* for */
+    check(found == expected, "lists something it shouldn't", dir);
+    PHYSFS_freeList(list);
+} /* checkList */
+
+
+static void checkImage(void)
+{
+    static const char * const root[] = { "A.TXT", "SUB", NULL };
+    static const char * const sub[] = { "B.TXT", "DEEP", NULL };
+    static const char * const deep[] = { "C.TXT", NULL };
+
+    checkList("", root);
+    checkList("SUB", sub);
+    checkList("SUB/DEEP", deep);
+    checkFile("A.TXT", "in the root");
+    checkFile("SUB/B.TXT", "in a subdirectory");
+    checkFile("SUB/DEEP/C.TXT", "two levels down");
+    check(!PHYSFS_exists("SUB/DEEP/SUB"), "\"..\" looks like a directory",
+          "SUB/DEEP/SUB");
+} /* checkImage */
+
+
+static void runImage(const char *name, const int loop)
+{
+    const int before = failures;
+    int mounted;
+
+    currentImage = name;
+    buildImage(loop);
+    mounted = PHYSFS_mountMemory(image, sizeof (image), NULL, name, NULL, 1);
+
+    if (loop)
+    {
+        check(!mounted, "a directory that lists itself mounted", name);
+        check(mounted || (PHYSFS_getLastErrorCode() == PHYSFS_ERR_CORRUPT),
+              "a directory that lists itself didn't fail as corrupt", name);
+    } /* if */
+    else if (!mounted)
+        check(0, lastError(), name);
+    else
+        checkImage();
+
+    if (mounted)
+        PHYSFS_unmount(name);
+
+    printf("%s,%d,%d\n", name, mounted, failures - before);
+} /* runImage */
+
+
+int main(int argc, char **argv)
+{
+    if (argc != 1)
+    {
+        fprintf(stderr, "USAGE: %s\n", argv[0]);
+        return 1;
+    } /* if */
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init() failed: %s\n", lastError());
+        return 1;
+    } /* if */
+
+    printf("image,mounted,failures\n");
+    runImage("dirs.iso", 0);
+    runImage("loop.iso", 1);
+
+    if (!PHYSFS_deinit())
+    {
+        fprintf(stderr, "PHYSFS_deinit() failed: %s\n", lastError());
+        failures++;
+    } /* if */
+
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of iso9660_physfs.c ... */
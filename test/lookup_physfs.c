@@ -0,0 +1,432 @@
+/*
+ * PhysicsFS search path lookup test.
+ *
+ * Mounts an archive and collects the names of (up to) a few thousand of its
+ *  files. Then 1, 2, 4... threads, up to the limit, run PHYSFS_exists(),
+ *  PHYSFS_stat() and PHYSFS_openRead() on those names as fast as they can
+ *  for a while; every one must work. Lookups walk a snapshot of the search
+ *  path and don't take the library-wide lock, so this should scale with
+ *  the number of CPUs.
+ *
+ * If a second archive is given, another thread keeps mounting it (at
+ *  "churn", at the front or back of the search path), changing its root and
+ *  unmounting it the whole time, and the lookup threads now and then open
+ *  and read a file from it. Those opens may fail, as the archive might not
+ *  be mounted right then, but nothing else may, and a handle that did open
+ *  must keep reading after its archive leaves the search path. Try this
+ *  under -fsanitize=thread and -fsanitize=address.
+ *
+ * Results go to stdout as CSV (churn,threads,lookups_per_sec,speedup,
+ *  efficiency). The exit status is non-zero if any lookup failed.
+ *
+ * This needs POSIX threads.
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#define MAX_FILES 4096
+#define MAX_THREADS 64
+#define CHURN_FILES 64
+
+#if defined(__GNUC__) || defined(__clang__)
+#define getFlag(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define setFlag(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#else
+#define getFlag(x) (x)
+#define setFlag(x, v) ((x) = (v))
+#endif
+
+typedef struct Looker
+{
+    pthread_t thread;
+    int index;
+    PHYSFS_uint32 random;
+    PHYSFS_uint64 lookups;
+    PHYSFS_uint64 churnOpens;
+    int failed;
+} Looker;
+
+static char *files[MAX_FILES];
+static int numFiles = 0;
+static char *churnFiles[CHURN_FILES];
+static int numChurnFiles = 0;
+static const char *churnArchive = NULL;
+static double testSeconds = 1.0;
+static Looker lookers[MAX_THREADS];
+static volatile int stopLookers = 0;
+static volatile int stopChurn = 0;
+static volatile int churnFailed = 0;
+static PHYSFS_uint64 churnRounds = 0;
+
+
+static double nowSeconds(void)
+{
+    return ((double) __PHYSFS_platformGetTicks()) / 1000000000.0;
+} /* nowSeconds */
+
+static PHYSFS_uint32 nextRandom(PHYSFS_uint32 *state)
+{
+    /* xorshift32, good enough to pick files. */
+    PHYSFS_uint32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+} /* nextRandom */
+
+static const char *lastError(void)
+{
+    return PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
+} /* lastError */
+
+
+typedef struct FileList
+{
+    char **names;
+    int *count;
+    int max;
+} FileList;
+
+static PHYSFS_EnumerateCallbackResult findFiles(void *data, const char *dir,
+                                                const char *fname)
+{
+    FileList *list = (FileList *) data;
+    char path[1024];
+    PHYSFS_Stat statbuf;
+
+    if (*list->count >= list->max)
+        return PHYSFS_ENUM_STOP;
+    else if (snprintf(path, sizeof (path), "%s%s%s", dir, *dir ? "/" : "",
+                      fname) >= (int) sizeof (path))
+        return PHYSFS_ENUM_OK;  /* skip it. */
+    else if (!PHYSFS_stat(path, &statbuf))
+        return PHYSFS_ENUM_OK;
+    else if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
+        return PHYSFS_enumerate(path, findFiles, data) ? PHYSFS_ENUM_OK : PHYSFS_ENUM_ERROR;
+    else if (statbuf.filetype == PHYSFS_FILETYPE_REGULAR)
+    {
+        char *dup = strdup(path);
+        if (dup != NULL)
+            list->names[(*list->count)++] = dup;
+    } /* else if */
+
+    return PHYSFS_ENUM_OK;
+} /* findFiles */
+
+static int collectFiles(const char *dir, char **names, int *count, int max)
+{
+    FileList list;
+    list.names = names;
+    list.count = count;
+    list.max = max;
+    return PHYSFS_enumerate(dir, findFiles, &list);
+} /* collectFiles */
+
+
+/* one lookup of each kind; they all have to work. */
+static int lookupOne(Looker *l)
+{
+    const char *fname = files[nextRandom(&l->random) % numFiles];
+    PHYSFS_Stat statbuf;
+    PHYSFS_File *f;
+
+    if (!PHYSFS_exists(fname))
+    {
+        fprintf(stderr, "thread %d: %s doesn't exist\n", l->index, fname);
+        return 0;
+    } /* if */
+    else if (!PHYSFS_stat(fname, &statbuf) ||
+             (statbuf.filetype != PHYSFS_FILETYPE_REGULAR))
+    {
+        fprintf(stderr, "thread %d: couldn't stat %s: %s\n", l->index, fname,
+                lastError());
+        return 0;
+    } /* else if */
+    else if ((f = PHYSFS_openRead(fname)) == NULL)
+    {
+        fprintf(stderr, "thread %d: couldn't open %s: %s\n", l->index, fname,
+                lastError());
+        return 0;
+    } /* else if */
+
+    PHYSFS_close(f);
+    l->lookups += 3;
+    return 1;
+} /* lookupOne */
+
+/* the churn archive may or may not be there, but if it opens, it reads. */
+static int churnOne(Looker *l)
+{
+    char path[1024];
+    PHYSFS_uint8 buf[64];
+    PHYSFS_File *f;
+    int retval = 1;
+
+    snprintf(path, sizeof (path), "churn/%s",
+             churnFiles[nextRandom(&l->random) % numChurnFiles]);
+    f = PHYSFS_openRead(path);
+    if (f == NULL)
+        return 1;
+
+    /* long enough for the archive to leave the search path, sometimes. */
+    sched_yield();
+    if (PHYSFS_readBytes(f, buf, sizeof (buf)) < 0)
+    {
+        fprintf(stderr, "thread %d: couldn't read %s: %s\n", l->index, path,
+                lastError());
+        retval = 0;
+    } /* if */
+
+    PHYSFS_close(f);
+    l->churnOpens++;
+    return retval;
+} /* churnOne */
+
+static void *lookerMain(void *data)
+{
+    Looker *l = (Looker *) data;
+    while (!getFlag(stopLookers))
+    {
+        if (!lookupOne(l) ||
+            (numChurnFiles && ((nextRandom(&l->random) & 63) == 0) && !churnOne(l)))
+        {
+            l->failed = 1;
+            break;
+        } /* if */
+    } /* while */
+    return NULL;
+} /* lookerMain */
+
+
+/* publishes a new search path as often as it can. */
+static void *churnMain(void *data)
+{
+    PHYSFS_uint32 random = 0xC0FFEE;
+    (void) data;
+
+    while (!getFlag(stopChurn))
+    {
+        if (!PHYSFS_mount(churnArchive, "churn", (int) (nextRandom(&random) & 1)))
+        {
+            fprintf(stderr, "churn: couldn't mount %s: %s\n", churnArchive,
+                    lastError());
+            churnFailed = 1;
+            break;
+        } /* if */
+
+        if (!PHYSFS_setRoot(churnArchive, "/"))
+        {
+            fprintf(stderr, "churn: couldn't set root of %s: %s\n",
+                    churnArchive, lastError());
+            churnFailed = 1;
+            break;
+        } /* if */
+
+        /* a looker might have a file open in it right now; try again. */
+        while (!PHYSFS_unmount(churnArchive))
+        {
+            if (PHYSFS_getLastErrorCode() != PHYSFS_ERR_FILES_STILL_OPEN)
+            {
+                fprintf(stderr, "churn: couldn't unmount %s: %s\n",
+                        churnArchive, lastError());
+                churnFailed = 1;
+                return NULL;
+            } /* if */
+            sched_yield();
+        } /* while */
+
+        churnRounds++;
+    } /* while */
+    return NULL;
+} /* churnMain */
+
+
+/* run (threads) lookers for a while, return lookups per second or -1. */
+static double runLookers(const int threads)
+{
+    PHYSFS_uint64 lookups = 0;
+    double start, secs;
+    int failed = 0;
+    int i;
+
+    setFlag(stopLookers, 0);
+    start = nowSeconds();
+    for (i = 0; i < threads; i++)
+    {
+        lookers[i].index = i;
+        lookers[i].random = 0x9E3779B9u * (i + 1);
+        lookers[i].lookups = 0;
+        if (pthread_create(&lookers[i].thread, NULL, lookerMain, &lookers[i]) != 0)
+        {
+            fprintf(stderr, "couldn't start thread %d\n", i);
+            setFlag(stopLookers, 1);
+            while (--i >= 0)
+                pthread_join(lookers[i].thread, NULL);
+            return -1.0;
+        } /* if */
+    } /* for */
+
+    while ((nowSeconds() - start) < testSeconds)
+        usleep(10000);
+    setFlag(stopLookers, 1);
+
+    for (i = 0; i < threads; i++)
+    {
+        pthread_join(lookers[i].thread, NULL);
+        lookups += lookers[i].lookups;
+        failed |= lookers[i].failed;
+    } /* for */
+    secs = nowSeconds() - start;
+
+    return failed ? -1.0 : (lookups / secs);
+} /* runLookers */
+
+
+/* what's in the churn archive, mounted just long enough to look. */
+static int loadChurnFiles(void)
+{
+    int ok;
+    if (!PHYSFS_mount(churnArchive, "churn", 1))
+        return 0;
+    ok = collectFiles("churn", churnFiles, &numChurnFiles, CHURN_FILES);
+    PHYSFS_unmount(churnArchive);
+    if (ok)
+    {
+        int i;
+        for (i = 0; i < numChurnFiles; i++)  /* drop the "churn/" */
+            memmove(churnFiles[i], churnFiles[i] + 6, strlen(churnFiles[i] + 6) + 1);
+    } /* if */
+    return ok && (numChurnFiles > 0);
+} /* loadChurnFiles */
+
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+        "USAGE: %s [-s seconds] [-t threads] <archive> [churn_archive]\n"
+        "  -s <secs>    time to run each thread count (default: 1)\n"
+        "  -t <num>     most threads (default: number of CPUs)\n",
+        argv0);
+} /* usage */
+
+int main(int argc, char **argv)
+{
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int maxThreads = (cpus < 1) ? 1 : ((cpus > MAX_THREADS) ? MAX_THREADS : (int) cpus);
+    double base = 0.0;
+    pthread_t churn;
+    int churning = 0;
+    int failures = 0;
+    int argi = 1;
+    int threads;
+    int i;
+
+    while ((argc - argi > 1) && (argv[argi][0] == '-'))
+    {
+        if (strcmp(argv[argi], "-s") == 0)
+            testSeconds = atof(argv[argi + 1]);
+        else if (strcmp(argv[argi], "-t") == 0)
+            maxThreads = atoi(argv[argi + 1]);
+        else
+            break;
+        argi += 2;
+    } /* while */
+
+    if ((argc - argi < 1) || (argc - argi > 2) || (testSeconds <= 0.0) ||
+        (maxThreads < 1) || (maxThreads > MAX_THREADS))
+    {
+        usage(argv[0]);
+        return 1;
+    } /* if */
+
+    if (!PHYSFS_init(argv[0]) || !PHYSFS_mount(argv[argi], NULL, 1))
+    {
+        fprintf(stderr, "couldn't mount %s: %s\n", argv[argi], lastError());
+        return 1;
+    } /* if */
+
+    if (!collectFiles("", files, &numFiles, MAX_FILES) || (numFiles == 0))
+    {
+        fprintf(stderr, "no files to look up in %s\n", argv[argi]);
+        return 1;
+    } /* if */
+
+    if (argc - argi == 2)
+    {
+        churnArchive = argv[argi + 1];
+        if (!loadChurnFiles())
+        {
+            fprintf(stderr, "no files to look up in %s\n", churnArchive);
+            return 1;
+        } /* if */
+
+        if (pthread_create(&churn, NULL, churnMain, NULL) != 0)
+        {
+            fprintf(stderr, "couldn't start the churn thread\n");
+            return 1;
+        } /* if */
+        churning = 1;
+    } /* if */
+
+    printf("churn,threads,lookups_per_sec,speedup,efficiency\n");
+    for (threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        const double rate = runLookers(threads);
+        double speedup;
+
+        if (rate < 0.0)
+        {
+            failures++;
+            break;
+        } /* if */
+
+        if (threads == 1)
+            base = rate;
+        speedup = (base > 0.0) ? (rate / base) : 0.0;
+        printf("%s,%d,%.0f,%.2f,%.2f\n", churning ? "yes" : "no", threads,
+               rate, speedup, speedup / threads);
+        fflush(stdout);
+    } /* for */
+
+    if (churning)
+    {
+        setFlag(stopChurn, 1);
+        pthread_join(churn, NULL);
+        if (churnFailed)
+            failures++;
+        else
+        {
+            PHYSFS_uint64 opens = 0;
+            for (i = 0; i < maxThreads; i++)
+                opens += lookers[i].churnOpens;
+            fprintf(stderr, "churn: %llu mounts, %llu files opened from them\n",
+                    (unsigned long long) churnRounds, (unsigned long long) opens);
+        } /* else */
+    } /* if */
+
+    for (i = 0; i < numFiles; i++)
+        free(files[i]);
+    for (i = 0; i < numChurnFiles; i++)
+        free(churnFiles[i]);
+
+    if (!PHYSFS_deinit())
+    {
+        fprintf(stderr, "PHYSFS_deinit() failed: %s\n", lastError());
+        failures++;
+    } /* if */
+
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of lookup_physfs.c ... */
@@ -0,0 +1,325 @@
+/*
+ * PhysicsFS PHYSFS_getMemoryStats() test.
+ *
+ * Mounts each archive given, then opens files from all of them with a
+ *  buffer set on each, then reads them again through the content cache,
+ *  and closes and unmounts everything. After each step it checks that
+ *  the categories add up, that every archive is charged for its index
+ *  and, once files are open, for its handles, and that the library's
+ *  count agrees with what PhysicsFS asked of the app's allocator. At the
+ *  end, nothing may be left but the library's own state, and after
+ *  PHYSFS_deinit(), not even that.
+ *
+ * Reports, as CSV on stdout (archive,step,bytes,index,handles,buffers,
+ *  decode,cache,other,allocations), what each archive held after each
+ *  step, and what the whole library held (archive "*").
+ *
+ * The exit status is non-zero if anything went wrong.
+ */
+
+#define PHYSFS_SUPPORTS_MEMORY_STATS 1
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_OPEN 64
+#define BUFFER_SIZE 4096
+#define CACHE_BUDGET (16 * 1024 * 1024)
+
+typedef struct Opened
+{
+    PHYSFS_File *files[MAX_OPEN];
+    int count;
+} Opened;
+
+static int failures = 0;
+
+/* what PhysicsFS asked of us, headers and all. */
+static PHYSFS_sint64 heapBytes = 0;
+static PHYSFS_sint64 heapBlocks = 0;
+
+
+static void *countingMalloc(PHYSFS_uint64 len)
+{
+    PHYSFS_uint64 *ptr = (PHYSFS_uint64 *) malloc((size_t) len + 16);
+    if (ptr == NULL)
+        return NULL;
+    *ptr = len;
+    __atomic_add_fetch(&heapBytes, (PHYSFS_sint64) len, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&heapBlocks, 1, __ATOMIC_RELAXED);
+    return ((PHYSFS_uint8 *) ptr) + 16;
+} /* countingMalloc */
+
+static void countingFree(void *_ptr)
+{
+    if (_ptr != NULL)
+    {
+        PHYSFS_uint64 *ptr = (PHYSFS_uint64 *) (((PHYSFS_uint8 *) _ptr) - 16);
+        __atomic_sub_fetch(&heapBytes, (PHYSFS_sint64) *ptr, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&heapBlocks, 1, __ATOMIC_RELAXED);
+        free(ptr);
+    } /* if */
+} /* countingFree */
+
+static void *countingRealloc(void *_ptr, PHYSFS_uint64 len)
+{
+    void *retval = countingMalloc(len);
+    if ((retval != NULL) && (_ptr != NULL))
+    {
+        const PHYSFS_uint64 *ptr = (const PHYSFS_uint64 *) (((PHYSFS_uint8 *) _ptr) - 16);
+        memcpy(retval, _ptr, (size_t) ((*ptr < len) ? *ptr : len));
+        countingFree(_ptr);
+    } /* if */
+    return retval;
+} /* countingRealloc */
+
+
+static PHYSFS_uint64 categorySum(const PHYSFS_MemoryStats *st)
+{
+    return st->other + st->index + st->handles + st->buffers +
+           st->decode + st->cache;
+} /* categorySum */
+
+
+static void report(const char *archive, const char *step,
+                   PHYSFS_MemoryStats *st)
+{
+    if (!PHYSFS_getMemoryStats(archive, st))
+    {
+        fprintf(stderr, "PHYSFS_getMemoryStats(%s) failed: %s\n",
+                archive ? archive : "NULL",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        memset(st, '\0', sizeof (*st));
+        failures++;
+        return;
+    } /* if */
+
+    printf("%s,%s,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+           archive ? archive : "*", step, (unsigned long long) st->bytes,
+           (unsigned long long) st->index, (unsigned long long) st->handles,
+           (unsigned long long) st->buffers, (unsigned long long) st->decode,
+           (unsigned long long) st->cache, (unsigned long long) st->other,
+           (unsigned long long) st->allocations);
+
+    if (categorySum(st) != st->bytes)
+    {
+        fprintf(stderr, "%s: categories don't add up after %s\n",
+                archive ? archive : "*", step);
+        failures++;
+    } /* if */
+
+    if (st->peakBytes < st->bytes)
+    {
+        fprintf(stderr, "%s: peak is below current after %s\n",
+                archive ? archive : "*", step);
+        failures++;
+    } /* if */
+} /* report */
+
+
+/* the library's count, against what it really asked us for. */
+static void checkGlobal(const char *step)
+{
+    static PHYSFS_sint64 header = -1;
+    PHYSFS_MemoryStats st;
+    PHYSFS_sint64 extra;
+
+    report(NULL, step, &st);
+
+    if ((PHYSFS_sint64) st.allocations != heapBlocks)
+    {
+        fprintf(stderr, "%s: %llu blocks counted, %lld allocated\n", step,
+                (unsigned long long) st.allocations, (long long) heapBlocks);
+        failures++;
+        return;
+    } /* if */
+
+    /* each block is what was asked for, plus a header of the same size. */
+    extra = heapBytes - (PHYSFS_sint64) st.bytes;
+    if ((st.allocations == 0) || (extra % (PHYSFS_sint64) st.allocations))
+    {
+        fprintf(stderr, "%s: %lld bytes allocated don't fit %llu counted\n",
+                step, (long long) heapBytes, (unsigned long long) st.bytes);
+        failures++;
+        return;
+    } /* if */
+
+    if (header == -1)
+        header = extra / (PHYSFS_sint64) st.allocations;
+    else if (extra / (PHYSFS_sint64) st.allocations != header)
+    {
+        fprintf(stderr, "%s: %lld bytes allocated don't fit %llu counted\n",
+                step, (long long) heapBytes, (unsigned long long) st.bytes);
+        failures++;
+    } /* else if */
+} /* checkGlobal */
+
+
+static PHYSFS_EnumerateCallbackResult openCallback(void *data,
+                                       const char *origdir, const char *fname)
+{
+    Opened *opened = (Opened *) data;
+    char *path = (char *) malloc(strlen(origdir) + strlen(fname) + 2);
+    PHYSFS_Stat statbuf;
+
+    if (path == NULL)
+        return PHYSFS_ENUM_ERROR;
+
+    sprintf(path, "%s%s%s", origdir, *origdir ? "/" : "", fname);
+    if (PHYSFS_stat(path, &statbuf))
+    {
+        if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
+            PHYSFS_enumerate(path, openCallback, opened);
+
+        else if ((statbuf.filetype == PHYSFS_FILETYPE_REGULAR) &&
+                 (opened->count < MAX_OPEN))
+        {
+            PHYSFS_File *f = PHYSFS_openRead(path);
+            PHYSFS_uint8 byte;
+            if (f == NULL)
+            {
+                fprintf(stderr, "couldn't open %s: %s\n", path,
+                        PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+                failures++;
+            } /* if */
+            else
+            {
+                if (!PHYSFS_setBuffer(f, BUFFER_SIZE))
+                    failures++;
+                PHYSFS_readBytes(f, &byte, 1);
+                opened->files[opened->count++] = f;
+            } /* else */
+        } /* else if */
+    } /* if */
+
+    free(path);
+    return (opened->count < MAX_OPEN) ? PHYSFS_ENUM_OK : PHYSFS_ENUM_STOP;
+} /* openCallback */
+
+
+static void closeAll(Opened *opened)
+{
+    while (opened->count > 0)
+        PHYSFS_close(opened->files[--opened->count]);
+} /* closeAll */
+
+
+int main(int argc, char **argv)
+{
+    PHYSFS_Allocator a = { NULL, NULL, countingMalloc, countingRealloc, countingFree };
+    PHYSFS_MemoryStats st;
+    Opened opened;
+    int i;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "USAGE: %s <archive>...\n", argv[0]);
+        return 1;
+    } /* if */
+
+    PHYSFS_setAllocator(&a);
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init() failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    printf("archive,step,bytes,index,handles,buffers,decode,cache,other,allocations\n");
+    checkGlobal("init");
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!PHYSFS_mount(argv[i], NULL, 1))
+        {
+            fprintf(stderr, "couldn't mount %s: %s\n", argv[i],
+                    PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            return 1;
+        } /* if */
+
+        report(argv[i], "mount", &st);
+        if ((st.index == 0) || (st.handles != 0) || (st.buffers != 0))
+        {
+            fprintf(stderr, "%s: not charged for just its index\n", argv[i]);
+            failures++;
+        } /* if */
+    } /* for */
+    checkGlobal("mount");
+
+    opened.count = 0;
+    PHYSFS_enumerate("", openCallback, &opened);
+    for (i = 1; i < argc; i++)
+        report(argv[i], "open", &st);
+    checkGlobal("open");
+
+    PHYSFS_getMemoryStats(NULL, &st);
+    if ((opened.count > 0) && ((st.handles == 0) ||
+        (st.buffers < (PHYSFS_uint64) opened.count * BUFFER_SIZE)))
+    {
+        fprintf(stderr, "open files aren't charged for their handles\n");
+        failures++;
+    } /* if */
+
+    closeAll(&opened);
+    for (i = 1; i < argc; i++)
+    {
+        report(argv[i], "close", &st);
+        if ((st.handles != 0) || (st.buffers != 0))
+        {
+            fprintf(stderr, "%s: still charged for closed files\n", argv[i]);
+            failures++;
+        } /* if */
+    } /* for */
+
+    /* again, through the cache this time, which keeps files after closing. */
+    PHYSFS_setContentCache(CACHE_BUDGET, CACHE_BUDGET);
+    PHYSFS_enumerate("", openCallback, &opened);
+    closeAll(&opened);
+    for (i = 1; i < argc; i++)
+        report(argv[i], "cached", &st);
+    checkGlobal("cached");
+    PHYSFS_setContentCache(0, 0);
+
+    for (i = 1; i < argc; i++)
+        PHYSFS_unmount(argv[i]);
+    checkGlobal("unmount");
+
+    /* the library's own state can grow (error state...), nothing else. */
+    PHYSFS_getMemoryStats(NULL, &st);
+    if (st.bytes != st.other)
+    {
+        fprintf(stderr, "%llu bytes left for archives after unmounting\n",
+                (unsigned long long) (st.bytes - st.other));
+        failures++;
+    } /* if */
+
+    if (PHYSFS_getMemoryStats(argv[1], &st) ||
+        (PHYSFS_getLastErrorCode() != PHYSFS_ERR_NOT_MOUNTED))
+    {
+        fprintf(stderr, "stats for an archive that isn't mounted\n");
+        failures++;
+    } /* if */
+
+    if (!PHYSFS_deinit())
+    {
+        fprintf(stderr, "PHYSFS_deinit() failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        failures++;
+    } /* if */
+
+    if (heapBlocks != 0)
+    {
+        fprintf(stderr, "%lld blocks still allocated after deinit\n",
+                (long long) heapBlocks);
+        failures++;
+    } /* if */
+
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of memory_physfs.c ... */
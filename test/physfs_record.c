@@ -0,0 +1,431 @@
+/*
+ * Access trace recorder for PHYSFS_setTraceCallbacks().
+ *
+ * See physfs_record.h for the file format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "miniphysfs.h"
+#include "physfs_record.h"
+
+/* a PHYSFS_File that is open right now, and the number we gave it. */
+typedef struct RecordHandle
+{
+    const void *handle;
+    PHYSFS_uint64 file;
+    struct RecordHandle *next;
+} RecordHandle;
+
+/* a thread we've seen, and the number we gave it. */
+typedef struct RecordThread
+{
+    unsigned long tid;
+    PHYSFS_uint64 index;
+    struct RecordThread *next;
+} RecordThread;
+
+static FILE *recordFile = NULL;
+static PHYSFS_uint64 lastStart = 0;
+static PHYSFS_uint64 nextFile = 1;
+static PHYSFS_uint64 nextThread = 0;
+static RecordHandle *recordHandles = NULL;
+static RecordThread *recordThreads = NULL;
+
+#ifdef _WIN32
+static CRITICAL_SECTION recordLock;
+#define LOCK_RECORD() EnterCriticalSection(&recordLock)
+#define UNLOCK_RECORD() LeaveCriticalSection(&recordLock)
+#define THREAD_ID() ((unsigned long) GetCurrentThreadId())
+#else
+static pthread_mutex_t recordLock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_RECORD() pthread_mutex_lock(&recordLock)
+#define UNLOCK_RECORD() pthread_mutex_unlock(&recordLock)
+#define THREAD_ID() ((unsigned long) (size_t) pthread_self())
+#endif
+
+
+static void writeVarint(PHYSFS_uint64 v)
+{
+    while (v >= 0x80)
+    {
+        fputc((int) ((v & 0x7F) | 0x80), recordFile);
+        v >>= 7;
+    } /* while */
+    fputc((int) v, recordFile);
+} /* writeVarint */
+
+
+static void writeSvarint(const PHYSFS_sint64 v)
+{
+    writeVarint((((PHYSFS_uint64) v) << 1) ^ ((PHYSFS_uint64) (v >> 63)));
+} /* writeSvarint */
+
+
+static PHYSFS_uint64 threadIndex(void)
+{
+    const unsigned long tid = THREAD_ID();
+    RecordThread *i;
+
+    for (i = recordThreads; i != NULL; i = i->next)
+    {
+        if (i->tid == tid)
+            return i->index;
+    } /* for */
+
+    i = (RecordThread *) malloc(sizeof (RecordThread));
+    if (i == NULL)
+        return 0;  /* oh well, lump it in with the first thread. */
+
+    i->tid = tid;
+    i->index = nextThread++;
+    i->next = recordThreads;
+    recordThreads = i;
+    return i->index;
+} /* threadIndex */
+
+
+static RecordHandle *findHandle(const void *handle, RecordHandle **_prev)
+{
+    RecordHandle *prev = NULL;
+    RecordHandle *i;
+
+    for (i = recordHandles; i != NULL; i = i->next)
+    {
+        if (i->handle == handle)
+        {
+            if (_prev != NULL)
+                *_prev = prev;
+            return i;
+        } /* if */
+        prev = i;
+    } /* for */
+
+    return NULL;
+} /* findHandle */
+
+
+static void writeRecord(const int op, const PHYSFS_TraceEvent *ev,
+                        const PHYSFS_uint64 file)
+{
+    const PHYSFS_uint64 start = ev->timestamp - ev->duration;
+
+    fputc(op, recordFile);
+    writeVarint(threadIndex());
+    writeSvarint((lastStart == 0) ? 0 : (PHYSFS_sint64) (start - lastStart));
+    writeVarint(ev->duration);
+    writeVarint(file);
+    lastStart = start;
+} /* writeRecord */
+
+
+static void recordOpen(const PHYSFS_TraceEvent *ev)
+{
+    const size_t len = strlen(ev->path);
+    PHYSFS_uint64 file = 0;
+
+    if (ev->handle != NULL)
+    {
+        RecordHandle *h = (RecordHandle *) malloc(sizeof (RecordHandle));
+        if (h == NULL)
+            return;  /* drop it, we couldn't record what follows anyhow. */
+        h->handle = ev->handle;
+        h->file = file = nextFile++;
+        h->next = recordHandles;
+        recordHandles = h;
+    } /* if */
+
+    writeRecord(PHYSFS_RECORD_OPEN, ev, file);
+    writeVarint(len);
+    fwrite(ev->path, len, 1, recordFile);
+} /* recordOpen */
+
+
+static void recordEnd(void *data, const PHYSFS_TraceEvent *ev)
+{
+    RecordHandle *h;
+    RecordHandle *prev = NULL;
+
+    LOCK_RECORD();
+    if (recordFile == NULL)
+    {
+        UNLOCK_RECORD();
+        return;
+    } /* if */
+
+    switch (ev->op)
+    {
+        case PHYSFS_TRACE_OPEN:
+            recordOpen(ev);
+            break;
+
+        /* files opened before recording started are ignored. */
+        case PHYSFS_TRACE_READ:
+            if ((h = findHandle(ev->handle, NULL)) != NULL)
+            {
+                writeRecord(PHYSFS_RECORD_READ, ev, h->file);
+                writeVarint(ev->bytes);
+                writeSvarint(ev->result);
+            } /* if */
+            break;
+
+        case PHYSFS_TRACE_SEEK:
+            if ((h = findHandle(ev->handle, NULL)) != NULL)
+            {
+                writeRecord(PHYSFS_RECORD_SEEK, ev, h->file);
+                writeVarint(ev->bytes);
+                writeVarint(ev->result ? 1 : 0);
+            } /* if */
+            break;
+
+        case PHYSFS_TRACE_CLOSE:
+            if ((ev->result) && ((h = findHandle(ev->handle, &prev)) != NULL))
+            {
+                writeRecord(PHYSFS_RECORD_CLOSE, ev, h->file);
+                if (prev == NULL)
+                    recordHandles = h->next;
+                else
+                    prev->next = h->next;
+                free(h);
+            } /* if */
+            break;
+
+        default:
+            break;  /* not part of the access pattern. */
+    } /* switch */
+
+    UNLOCK_RECORD();
+} /* recordEnd */
+
+
+static void freeLists(void)
+{
+    while (recordHandles != NULL)
+    {
+        RecordHandle *next = recordHandles->next;
+        free(recordHandles);
+        recordHandles = next;
+    } /* while */
+
+    while (recordThreads != NULL)
+    {
+        RecordThread *next = recordThreads->next;
+        free(recordThreads);
+        recordThreads = next;
+    } /* while */
+} /* freeLists */
+
+
+int physfs_record_start(const char *filename)
+{
+    const PHYSFS_uint32 version = PHYSFS_swapULE32(PHYSFS_RECORD_VERSION);
+
+#ifdef _WIN32
+    InitializeCriticalSection(&recordLock);
+#endif
+
+    recordFile = fopen(filename, "wb");
+    if (recordFile == NULL)
+        return 0;
+
+    fwrite(PHYSFS_RECORD_MAGIC, 8, 1, recordFile);
+    fwrite(&version, sizeof (version), 1, recordFile);
+    lastStart = 0;
+    nextFile = 1;
+    nextThread = 0;
+
+    if (!PHYSFS_setTraceCallbacks(NULL, recordEnd, NULL))
+    {
+        fclose(recordFile);
+        recordFile = NULL;
+        return 0;
+    } /* if */
+
+    return 1;
+} /* physfs_record_start */
+
+
+void physfs_record_stop(void)
+{
+    PHYSFS_setTraceCallbacks(NULL, NULL, NULL);
+
+    LOCK_RECORD();
+    if (recordFile != NULL)
+    {
+        fclose(recordFile);
+        recordFile = NULL;
+    } /* if */
+    freeLists();
+    UNLOCK_RECORD();
+
+#ifdef _WIN32
+    DeleteCriticalSection(&recordLock);
+#endif
+} /* physfs_record_stop */
+
+
+
+static int readVarint(FILE *io, PHYSFS_uint64 *_v)
+{
+    PHYSFS_uint64 v = 0;
+    int shift = 0;
+    int ch;
+
+    do
+    {
+        if ((ch = fgetc(io)) == EOF || (shift > 63))
+            return 0;
+        v |= ((PHYSFS_uint64) (ch & 0x7F)) << shift;
+        shift += 7;
+    } while (ch & 0x80);
+
+    *_v = v;
+    return 1;
+} /* readVarint */
+
+
+static int readSvarint(FILE *io, PHYSFS_sint64 *_v)
+{
+    PHYSFS_uint64 v;
+    if (!readVarint(io, &v))
+        return 0;
+    *_v = (PHYSFS_sint64) ((v >> 1) ^ (~(v & 1) + 1));
+    return 1;
+} /* readSvarint */
+
+
+int physfs_record_load(const char *filename, physfs_record_entry **_records,
+                       size_t *_count)
+{
+    FILE *io = fopen(filename, "rb");
+    physfs_record_entry *records = NULL;
+    size_t count = 0;
+    size_t cap = 0;
+    PHYSFS_sint64 start = 0;
+    PHYSFS_sint64 first = 0;
+    char magic[8];
+    PHYSFS_uint32 version;
+    int op;
+
+    if (io == NULL)
+    {
+        fprintf(stderr, "couldn't open %s\n", filename);
+        return 0;
+    } /* if */
+
+    if ( (fread(magic, 8, 1, io) != 1) ||
+         (memcmp(magic, PHYSFS_RECORD_MAGIC, 8) != 0) ||
+         (fread(&version, 4, 1, io) != 1) ||
+         (PHYSFS_swapULE32(version) != PHYSFS_RECORD_VERSION) )
+    {
+        fprintf(stderr, "%s isn't a version %d access trace\n", filename,
+                PHYSFS_RECORD_VERSION);
+        fclose(io);
+        return 0;
+    } /* if */
+
+    while ((op = fgetc(io)) != EOF)
+    {
+        PHYSFS_uint64 thread, len, seekResult = 0;
+        PHYSFS_sint64 delta;
+        physfs_record_entry *r;
+        int ok;
+
+        if (count == cap)
+        {
+            void *ptr;
+            cap = cap ? cap * 2 : 4096;
+            ptr = realloc(records, cap * sizeof (physfs_record_entry));
+            if (ptr == NULL)
+            {
+                fprintf(stderr, "out of memory\n");
+                physfs_record_free(records, count);
+                fclose(io);
+                return 0;
+            } /* if */
+            records = (physfs_record_entry *) ptr;
+        } /* if */
+
+        r = &records[count];
+        memset(r, '\0', sizeof (*r));
+        r->op = op;
+        ok = readVarint(io, &thread) && readSvarint(io, &delta) &&
+             readVarint(io, &r->duration) && readVarint(io, &r->file);
+
+        switch (op)
+        {
+            case PHYSFS_RECORD_OPEN:
+                ok = ok && readVarint(io, &len) && (len < 0x10000);
+                if (ok)
+                {
+                    r->path = (char *) malloc((size_t) len + 1);
+                    ok = (r->path != NULL) &&
+                         ((len == 0) || (fread(r->path, (size_t) len, 1, io) == 1));
+                    if (ok)
+                        r->path[len] = '\0';
+                } /* if */
+                break;
+
+            case PHYSFS_RECORD_READ:
+                ok = ok && readVarint(io, &r->arg) && readSvarint(io, &r->result);
+                break;
+
+            case PHYSFS_RECORD_SEEK:
+                ok = ok && readVarint(io, &r->arg) && readVarint(io, &seekResult);
+                r->result = (PHYSFS_sint64) seekResult;
+                break;
+
+            case PHYSFS_RECORD_CLOSE:
+                break;
+
+            default:
+                ok = 0;
+                break;
+        } /* switch */
+
+        count++;  /* even if it failed, so its path gets freed. */
+
+        if (!ok)
+        {
+            fprintf(stderr, "%s is corrupt at record %u\n", filename,
+                    (unsigned int) (count - 1));
+            physfs_record_free(records, count);
+            fclose(io);
+            return 0;
+        } /* if */
+
+        start += delta;
+        if ((count == 1) || (start < first))
+            first = start;
+        r->start = start;
+        r->thread = (PHYSFS_uint32) thread;
+    } /* while */
+
+    fclose(io);
+
+    for (cap = 0; cap < count; cap++)
+        records[cap].start -= first;
+
+    *_records = records;
+    *_count = count;
+    return 1;
+} /* physfs_record_load */
+
+
+void physfs_record_free(physfs_record_entry *records, const size_t count)
+{
+    size_t i;
+    for (i = 0; i < count; i++)
+        free(records[i].path);
+    free(records);
+} /* physfs_record_free */
+
+/* end of physfs_record.c ... */
@@ -0,0 +1,70 @@
+/*
+ * Access trace recorder for PHYSFS_setTraceCallbacks().
+ *
+ * Records every open, read, seek and close on a PHYSFS_File opened for
+ *  reading, with the thread and time it happened, to a compact binary file
+ *  that replay_physfs can run again against any set of mounted archives.
+ *
+ * The PhysicsFS implementation must be built with PHYSFS_SUPPORTS_TRACE=1.
+ *
+ * File format, all fixed size integers are littleendian:
+ *
+ *   header: "PHYSFSAT", u32 version (PHYSFS_RECORD_VERSION)
+ *   then records until the end of the file:
+ *     u8 op (PHYSFS_RECORD_OPEN, etc)
+ *     varint thread, numbered from 0 in order of appearance
+ *     svarint start, nanoseconds since the previous record's start
+ *     varint duration, in nanoseconds
+ *     varint file, numbered from 1 in order of opening; 0 if open failed
+ *     open:  varint path length, then the path (UTF-8, not terminated)
+ *     read:  varint bytes requested, svarint bytes read (-1 on error)
+ *     seek:  varint offset, varint result (non-zero on success)
+ *     close: nothing else
+ *
+ *   varint is unsigned LEB128, svarint is zigzag encoded and then a varint.
+ *
+ * Records are written as operations finish, so starts can go backwards
+ *  when threads overlap.
+ */
+
+#ifndef _INCLUDE_PHYSFS_RECORD_H_
+#define _INCLUDE_PHYSFS_RECORD_H_
+
+#define PHYSFS_RECORD_MAGIC "PHYSFSAT"
+#define PHYSFS_RECORD_VERSION 1
+
+#define PHYSFS_RECORD_OPEN 1
+#define PHYSFS_RECORD_READ 2
+#define PHYSFS_RECORD_SEEK 3
+#define PHYSFS_RECORD_CLOSE 4
+
+/* Start recording to (filename). Returns zero on failure. */
+int physfs_record_start(const char *filename);
+
+/* Stop recording and finish writing the file. */
+void physfs_record_stop(void);
+
+/* One record of a trace, as loaded by physfs_record_load(). */
+typedef struct physfs_record_entry
+{
+    int op;  /* PHYSFS_RECORD_OPEN, etc */
+    PHYSFS_uint32 thread;
+    PHYSFS_sint64 start;  /* nanoseconds since the first record started. */
+    PHYSFS_uint64 duration;
+    PHYSFS_uint64 file;
+    PHYSFS_uint64 arg;  /* bytes requested, or seek offset. */
+    PHYSFS_sint64 result;  /* bytes read, or seek result. */
+    char *path;  /* for opens, NULL otherwise. */
+} physfs_record_entry;
+
+/* Load every record in (filename), in file order. Returns zero on failure,
+   after printing why to stderr. Free with physfs_record_free(). */
+int physfs_record_load(const char *filename, physfs_record_entry **_records,
+                       size_t *_count);
+
+/* Free what physfs_record_load() returned. */
+void physfs_record_free(physfs_record_entry *records, const size_t count);
+
+#endif
+
+/* end of physfs_record.h ... */
@@ -0,0 +1,239 @@
+/*
+ * Reference trace sink for PHYSFS_setTraceCallbacks().
+ *
+ * Each PhysicsFS operation becomes a pair of "B"egin/"E"nd events in the
+ *  Chrome trace event format, one track per thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "miniphysfs.h"
+#include "physfs_trace.h"
+
+/* remembers which path a PHYSFS_File was opened with, for reads/seeks. */
+typedef struct TraceHandle
+{
+    const void *handle;
+    char *path;
+    struct TraceHandle *next;
+} TraceHandle;
+
+static FILE *traceFile = NULL;
+static int traceEvents = 0;
+static PHYSFS_uint64 traceStart = 0;
+static TraceHandle *traceHandles = NULL;
+
+#ifdef _WIN32
+static CRITICAL_SECTION traceLock;
+#define LOCK_TRACE() EnterCriticalSection(&traceLock)
+#define UNLOCK_TRACE() LeaveCriticalSection(&traceLock)
+#define THREAD_ID() ((unsigned long) GetCurrentThreadId())
+#else
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_TRACE() pthread_mutex_lock(&traceLock)
+#define UNLOCK_TRACE() pthread_mutex_unlock(&traceLock)
+#define THREAD_ID() ((unsigned long) (size_t) pthread_self())
+#endif
+
+
+static const char *opName(const PHYSFS_TraceOp op)
+{
+    switch (op)
+    {
+        case PHYSFS_TRACE_OPEN: return "open";
+        case PHYSFS_TRACE_READ: return "read";
+        case PHYSFS_TRACE_SEEK: return "seek";
+        case PHYSFS_TRACE_STAT: return "stat";
+        case PHYSFS_TRACE_ENUMERATE: return "enumerate";
+        case PHYSFS_TRACE_MOUNT: return "mount";
+        case PHYSFS_TRACE_IO_READ: return "io_read";
+        case PHYSFS_TRACE_IO_SEEK: return "io_seek";
+        case PHYSFS_TRACE_CLOSE: return "close";
+    } /* switch */
+
+    return "unknown";
+} /* opName */
+
+
+static void writeString(const char *str)
+{
+    fputc('"', traceFile);
+    for (; *str; str++)
+    {
+        const unsigned char ch = (unsigned char) *str;
+        if ((ch == '"') || (ch == '\\'))
+            fprintf(traceFile, "\\%c", ch);
+        else if (ch < 0x20)
+            fprintf(traceFile, "\\u%04x", (unsigned int) ch);
+        else
+            fputc(ch, traceFile);
+    } /* for */
+    fputc('"', traceFile);
+} /* writeString */
+
+
+static const char *handlePath(const void *handle)
+{
+    const TraceHandle *i;
+    for (i = traceHandles; i != NULL; i = i->next)
+    {
+        if (i->handle == handle)
+            return i->path;
+    } /* for */
+    return NULL;
+} /* handlePath */
+
+
+static void rememberHandle(const void *handle, const char *path)
+{
+    TraceHandle *i;
+    char *dup = (char *) malloc(strlen(path) + 1);
+    if (dup == NULL)
+        return;
+    strcpy(dup, path);
+
+    for (i = traceHandles; i != NULL; i = i->next)
+    {
+        if (i->handle == handle)  /* address was reused by a new file. */
+        {
+            free(i->path);
+            i->path = dup;
+            return;
+        } /* if */
+    } /* for */
+
+    i = (TraceHandle *) malloc(sizeof (TraceHandle));
+    if (i == NULL)
+    {
+        free(dup);
+        return;
+    } /* if */
+
+    i->handle = handle;
+    i->path = dup;
+    i->next = traceHandles;
+    traceHandles = i;
+} /* rememberHandle */
+
+
+static void writeEvent(const PHYSFS_TraceEvent *ev, const char phase)
+{
+    const char *path = ev->path;
+    const PHYSFS_uint64 ns = ev->timestamp - traceStart;
+
+    if ((path == NULL) && (ev->handle != NULL))
+        path = handlePath(ev->handle);
+
+    fprintf(traceFile, "%s{\"name\":\"%s\",\"cat\":\"physfs\",\"ph\":\"%c\","
+            "\"ts\":%llu.%03u,\"pid\":1,\"tid\":%lu,\"args\":{",
+            traceEvents++ ? ",\n" : "", opName(ev->op), phase,
+            (unsigned long long) (ns / 1000), (unsigned int) (ns % 1000),
+            THREAD_ID());
+
+    if (phase == 'B')
+        fprintf(traceFile, "\"bytes\":%llu", (unsigned long long) ev->bytes);
+    else
+        fprintf(traceFile, "\"result\":%lld", (long long) ev->result);
+
+    if (path != NULL)
+    {
+        fprintf(traceFile, ",\"path\":");
+        writeString(path);
+    } /* if */
+
+    if (ev->archive != NULL)
+    {
+        fprintf(traceFile, ",\"archive\":");
+        writeString(ev->archive);
+    } /* if */
+
+    fprintf(traceFile, "}}");
+} /* writeEvent */
+
+
+static void traceBegin(void *data, const PHYSFS_TraceEvent *ev)
+{
+    LOCK_TRACE();
+    if (traceFile != NULL)
+    {
+        if (traceStart == 0)
+            traceStart = ev->timestamp;
+        writeEvent(ev, 'B');
+    } /* if */
+    UNLOCK_TRACE();
+} /* traceBegin */
+
+
+static void traceEnd(void *data, const PHYSFS_TraceEvent *ev)
+{
+    LOCK_TRACE();
+    if (traceFile != NULL)
+    {
+        if ((ev->op == PHYSFS_TRACE_OPEN) && (ev->handle != NULL))
+            rememberHandle(ev->handle, ev->path);
+        writeEvent(ev, 'E');
+    } /* if */
+    UNLOCK_TRACE();
+} /* traceEnd */
+
+
+int physfs_trace_start(const char *filename)
+{
+#ifdef _WIN32
+    InitializeCriticalSection(&traceLock);
+#endif
+
+    traceFile = fopen(filename, "w");
+    if (traceFile == NULL)
+        return 0;
+
+    fprintf(traceFile, "{\"traceEvents\":[\n");
+    traceEvents = 0;
+    traceStart = 0;
+
+    if (!PHYSFS_setTraceCallbacks(traceBegin, traceEnd, NULL))
+    {
+        fclose(traceFile);
+        traceFile = NULL;
+        return 0;
+    } /* if */
+
+    return 1;
+} /* physfs_trace_start */
+
+
+void physfs_trace_stop(void)
+{
+    PHYSFS_setTraceCallbacks(NULL, NULL, NULL);
+
+    LOCK_TRACE();
+    if (traceFile != NULL)
+    {
+        fprintf(traceFile, "\n]}\n");
+        fclose(traceFile);
+        traceFile = NULL;
+    } /* if */
+
+    while (traceHandles != NULL)
+    {
+        TraceHandle *next = traceHandles->next;
+        free(traceHandles->path);
+        free(traceHandles);
+        traceHandles = next;
+    } /* while */
+    UNLOCK_TRACE();
+
+#ifdef _WIN32
+    DeleteCriticalSection(&traceLock);
+#endif
+} /* physfs_trace_stop */
+
+/* end of physfs_trace.c ... */
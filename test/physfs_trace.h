@@ -0,0 +1,21 @@
+/*
+ * Reference trace sink for PHYSFS_setTraceCallbacks().
+ *
+ * Writes every traced operation to a file in the Chrome trace event format,
+ *  which can be loaded in chrome://tracing or https://ui.perfetto.dev/
+ *
+ * The PhysicsFS implementation must be built with PHYSFS_SUPPORTS_TRACE=1.
+ */
+
+#ifndef _INCLUDE_PHYSFS_TRACE_H_
+#define _INCLUDE_PHYSFS_TRACE_H_
+
+/* Start tracing to (filename). Returns zero on failure. */
+int physfs_trace_start(const char *filename);
+
+/* Stop tracing and finish writing the file. */
+void physfs_trace_stop(void);
+
+#endif
+
+/* end of physfs_trace.h ... */
@@ -0,0 +1,315 @@
+/*
+ * PhysicsFS PHYSFS_prefetch() stale mount test.
+ *
+ * Writes a small GRP archive to a directory, mounts it, and prefetches its
+ *  files, which must read ahead exactly their bytes. Then it prefetches
+ *  them again, but with one more path that only a tiny archiver mounted
+ *  after the GRP has; when the prefetch looks that up, the archiver's
+ *  stat() unmounts the GRP, and in the second run mounts it again. That
+ *  lands between the prefetch finding the files and reading them ahead, so
+ *  the byte ranges it found belong to a mount that's gone, and nothing may
+ *  be read ahead for them, not even into the new mount of the same file.
+ *  A last prefetch must read ahead from the new mount as usual.
+ *
+ * Each prefetch is polled with PHYSFS_prefetchDone() until it's done.
+ *
+ * Reports, as CSV on stdout (case,prefetched,failures), each prefetch. The
+ *  exit status is non-zero if anything went wrong.
+ */
+
+#define PHYSFS_SUPPORTS_STATS 1
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define A_SIZE 4000
+#define B_SIZE 3000
+#define GATE_PATH "remount"
+
+/* gate actions; each is done once, then the gate goes back to idle. */
+#define GATE_IDLE 0
+#define GATE_UNMOUNT 1
+#define GATE_REMOUNT 2
+
+static char grpPath[1100];
+static const char *currentCase = "";
+static int gateAction = GATE_IDLE;  /* what the gate does next time. */
+static int failures = 0;
+
+
+static void check(const int ok, const char *what)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "%s: %s\n", currentCase, what);
+        failures++;
+    } /* if */
+} /* check */
+
+
+static const char *lastError(void)
+{
+    return PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
+} /* lastError */
+
+
+static void putEntry(FILE *io, const char *name, const PHYSFS_uint32 size)
+{
+    char entry[16];
+    memset(entry, ' ', 12);
+    memcpy(entry, name, strlen(name));
+    entry[12] = (char) (size & 0xFF);
+    entry[13] = (char) ((size >> 8) & 0xFF);
+    entry[14] = (char) ((size >> 16) & 0xFF);
+    entry[15] = (char) ((size >> 24) & 0xFF);
+    fwrite(entry, sizeof (entry), 1, io);
+} /* putEntry */
+
+
+static int writeGrp(const char *path)
+{
+    static char data[A_SIZE + B_SIZE];
+    FILE *io = fopen(path, "wb");
+    int ok;
+
+    if (io == NULL)
+        return 0;
+
+    memset(data, 'a', A_SIZE);
+    memset(data + A_SIZE, 'b', B_SIZE);
+    fwrite("KenSilverman\2\0\0\0", 16, 1, io);
+    putEntry(io, "A.BIN", A_SIZE);
+    putEntry(io, "B.BIN", B_SIZE);
+    fwrite(data, sizeof (data), 1, io);
+    ok = !ferror(io);
+    return (fclose(io) == 0) && ok;
+} /* writeGrp */
+
+
+/* the gate archiver: one file, GATE_PATH, that does gateAction on stat. */
+
+static void *gate_openArchive(PHYSFS_Io *io, const char *name,
+                              int forWriting, int *claimed)
+{
+    char magic[4];
+    if ( (forWriting) || (io->length(io) != 4) ||
+         (io->read(io, magic, 4) != 4) || (memcmp(magic, "GATE", 4) != 0) )
+    {
+        PHYSFS_setErrorCode(PHYSFS_ERR_UNSUPPORTED);
+        return NULL;
+    } /* if */
+
+    *claimed = 1;
+    return io;  /* we own it now; closeArchive() frees it. */
+} /* gate_openArchive */
+
+
+static PHYSFS_EnumerateCallbackResult gate_enumerate(void *opaque,
+                                 const char *dirname, PHYSFS_EnumerateCallback cb,
+                                 const char *origdir, void *callbackdata)
+{
+    return PHYSFS_ENUM_OK;
+} /* gate_enumerate */
+
+
+static PHYSFS_Io *gate_openRead(void *opaque, const char *fnm)
+{
+    PHYSFS_setErrorCode(PHYSFS_ERR_NOT_FOUND);
+    return NULL;
+} /* gate_openRead */
+
+
+static PHYSFS_Io *gate_openWrite(void *opaque, const char *filename)
+{
+    PHYSFS_setErrorCode(PHYSFS_ERR_READ_ONLY);
+    return NULL;
+} /* gate_openWrite */
+
+
+static int gate_remove(void *opaque, const char *filename)
+{
+    PHYSFS_setErrorCode(PHYSFS_ERR_READ_ONLY);
+    return 0;
+} /* gate_remove */
+
+
+/* this runs on the prefetch thread, with the state lock held. */
+static int gate_stat(void *opaque, const char *fn, PHYSFS_Stat *stat)
+{
+    if (strcmp(fn, GATE_PATH) != 0)
+    {
+        PHYSFS_setErrorCode(PHYSFS_ERR_NOT_FOUND);
+        return 0;
+    } /* if */
+
+    /* the lookup stats the path more than once; act on the first. */
+    if (gateAction != GATE_IDLE)
+    {
+        check(PHYSFS_unmount(grpPath), "couldn't unmount from the prefetch thread");
+        if (gateAction == GATE_REMOUNT)
+            check(PHYSFS_mount(grpPath, NULL, 1), "couldn't remount from the prefetch thread");
+        gateAction = GATE_IDLE;
+    } /* if */
+
+    memset(stat, '\0', sizeof (*stat));
+    stat->filetype = PHYSFS_FILETYPE_REGULAR;
+    stat->readonly = 1;
+    return 1;
+} /* gate_stat */
+
+
+static void gate_closeArchive(void *opaque)
+{
+    PHYSFS_Io *io = (PHYSFS_Io *) opaque;
+    io->destroy(io);
+} /* gate_closeArchive */
+
+
+static const PHYSFS_Archiver gateArchiver =
+{
+    0,
+    {
+        "GATE",
+        "prefetch_physfs test gate",
+        "PhysicsFS tests",
+        "https://icculus.org/physfs/",
+        0,  /* supportsSymlinks */
+    },
+    gate_openArchive,
+    gate_enumerate,
+    gate_openRead,
+    gate_openWrite,
+    gate_openWrite,  /* openAppend */
+    gate_remove,
+    gate_remove,  /* mkdir */
+    gate_stat,
+    gate_closeArchive
+};
+
+
+/* global bytesPrefetched, or the archive's if (archive) isn't NULL. */
+static PHYSFS_uint64 prefetched(const char *archive)
+{
+    PHYSFS_IoStats stats;
+    if (!PHYSFS_getIoStats(archive, &stats))
+    {
+        check(0, lastError());
+        return 0;
+    } /* if */
+    return stats.bytesPrefetched;
+} /* prefetched */
+
+
+static void runPrefetch(const char *name, const char * const *paths,
+                        const PHYSFS_uint64 expected)
+{
+    const int before = failures;
+    const PHYSFS_uint64 start = prefetched(NULL);
+    PHYSFS_Prefetch *pf;
+    PHYSFS_uint64 got = 0;
+    int waited = 0;
+
+    currentCase = name;
+    pf = PHYSFS_prefetch(paths);
+    if (pf == NULL)
+        check(0, lastError());
+    else
+    {
+        while ((!PHYSFS_prefetchDone(pf)) && (waited < 10000))
+        {
+            usleep(1000);
+            waited++;
+        } /* while */
+        check(PHYSFS_prefetchDone(pf), "prefetch never finished");
+        PHYSFS_endPrefetch(pf, 0);
+
+        got = prefetched(NULL) - start;
+        check(got == expected, "read ahead the wrong number of bytes");
+    } /* else */
+
+    printf("%s,%llu,%d\n", name, (unsigned long long) got, failures - before);
+} /* runPrefetch */
+
+
+int main(int argc, char **argv)
+{
+    static const char gateData[4] = { 'G', 'A', 'T', 'E' };
+    static const char * const files[] = { "A.BIN", "B.BIN", NULL };
+    static const char * const gated[] = { "A.BIN", "B.BIN", GATE_PATH, NULL };
+    char tmpdir[1024];
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "USAGE: %s <dir>\n", argv[0]);
+        return 1;
+    } /* if */
+
+    snprintf(tmpdir, sizeof (tmpdir), "%s/prefetch_physfs.XXXXXX", argv[1]);
+    if (mkdtemp(tmpdir) == NULL)
+    {
+        fprintf(stderr, "couldn't make a directory in %s\n", argv[1]);
+        return 1;
+    } /* if */
+
+    snprintf(grpPath, sizeof (grpPath), "%s/prefetch.grp", tmpdir);
+    if (!writeGrp(grpPath))
+    {
+        fprintf(stderr, "couldn't write %s\n", grpPath);
+        rmdir(tmpdir);
+        return 1;
+    } /* if */
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init() failed: %s\n", lastError());
+        return 1;
+    } /* if */
+
+    if ( (!PHYSFS_registerArchiver(&gateArchiver)) ||
+         (!PHYSFS_mount(grpPath, NULL, 1)) ||
+         (!PHYSFS_mountMemory(gateData, sizeof (gateData), NULL,
+                              "prefetch.gate", NULL, 1)) )
+    {
+        fprintf(stderr, "couldn't set up: %s\n", lastError());
+        failures++;
+    } /* if */
+    else
+    {
+        printf("case,prefetched,failures\n");
+
+        runPrefetch("mounted", files, A_SIZE + B_SIZE);
+        check(prefetched(grpPath) == A_SIZE + B_SIZE, "not counted for the archive");
+
+        gateAction = GATE_UNMOUNT;
+        runPrefetch("unmounted", gated, 0);
+        check(gateAction == GATE_IDLE, "the gate wasn't looked up");
+        check(PHYSFS_mount(grpPath, NULL, 1), "couldn't mount again");
+
+        gateAction = GATE_REMOUNT;
+        runPrefetch("remounted", gated, 0);
+        check(gateAction == GATE_IDLE, "the gate wasn't looked up");
+        check(prefetched(grpPath) == 0, "read ahead into the new mount");
+
+        runPrefetch("new mount", files, A_SIZE + B_SIZE);
+        check(prefetched(grpPath) == A_SIZE + B_SIZE, "not counted for the archive");
+    } /* else */
+
+    if (!PHYSFS_deinit())
+    {
+        fprintf(stderr, "PHYSFS_deinit() failed: %s\n", lastError());
+        failures++;
+    } /* if */
+
+    remove(grpPath);
+    rmdir(tmpdir);
+
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of prefetch_physfs.c ... */
@@ -0,0 +1,472 @@
+/*
+ * PhysicsFS PHYSFS_Io readAt() and readv() test.
+ *
+ * Writes a small GRP archive to a directory, with entries of a few odd
+ *  sizes, and reads it through a native i/o, a memory i/o, and a copy of
+ *  the memory i/o that claims to be version 0, so the seek-and-read
+ *  emulation is used. Every read is checked against the bytes written:
+ *
+ *  - reads that end exactly at EOF, that run past it, and that start at or
+ *    past it, which must return what's left, or 0.
+ *  - readv() with ranges that each cross from one entry into the next, in
+ *    no particular order; one where a range runs past EOF, which must stop
+ *    there and leave the ranges after it alone; and one that starts at EOF.
+ *
+ * For each i/o with readAt(), a reader from __PHYSFS_duplicateForRead() is
+ *  checked the same way, and then several threads call readAt() and
+ *  readv() on that one reader at random places while this thread reads it
+ *  front to back with read() and seek(), which mustn't see their reads.
+ *  Last, the archive is mounted and each entry is read through a
+ *  PHYSFS_File, up to and at its end.
+ *
+ * There is no public way to get at an archive's i/o, so this calls the
+ *  internal functions archivers use.
+ *
+ * Reports, as CSV on stdout (io,readAt,failures), each i/o. The exit status
+ *  is non-zero if anything went wrong.
+ *
+ * This needs POSIX threads and mkdtemp().
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define NUM_ENTRIES 4
+#define HEADER_SIZE (16 + (16 * NUM_ENTRIES))
+#define DATA_SIZE (1000 + 3000 + 1 + 4095)
+#define IMAGE_SIZE (HEADER_SIZE + DATA_SIZE)
+
+#define NUM_THREADS 4
+#define THREAD_READS 5000
+#define MAX_READ 300
+#define SEQUENTIAL_READ 97
+#define SEQUENTIAL_PASSES 50
+
+typedef struct Hammer
+{
+    pthread_t thread;
+    PHYSFS_Io *io;
+    PHYSFS_uint32 seed;
+    int errors;
+} Hammer;
+
+static const PHYSFS_uint32 entrySizes[NUM_ENTRIES] = { 1000, 3000, 1, 4095 };
+static PHYSFS_uint64 entryOffsets[NUM_ENTRIES];
+static PHYSFS_uint8 image[IMAGE_SIZE];
+static const char *currentIo = "";
+static int failures = 0;
+
+
+static void check(const int ok, const char *what)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "%s: %s\n", currentIo, what);
+        failures++;
+    } /* if */
+} /* check */
+
+
+static const char *lastError(void)
+{
+    return PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
+} /* lastError */
+
+
+static void put32(PHYSFS_uint8 *buf, const PHYSFS_uint32 val)
+{
+    buf[0] = (PHYSFS_uint8) (val & 0xFF);
+    buf[1] = (PHYSFS_uint8) ((val >> 8) & 0xFF);
+    buf[2] = (PHYSFS_uint8) ((val >> 16) & 0xFF);
+    buf[3] = (PHYSFS_uint8) ((val >> 24) & 0xFF);
+} /* put32 */
+
+
+static void buildImage(void)
+{
+    PHYSFS_uint64 pos = HEADER_SIZE;
+    PHYSFS_uint32 i;
+
+    memcpy(image, "KenSilverman", 12);
+    put32(image + 12, NUM_ENTRIES);
+    for (i = 0; i < NUM_ENTRIES; i++)
+    {
+        PHYSFS_uint8 *entry = image + 16 + (16 * i);
+        memset(entry, ' ', 12);
+        snprintf((char *) entry, 12, "E%u.BIN", (unsigned int) i);
+        entry[strlen((char *) entry)] = ' ';  /* no terminator in the file. */
+        put32(entry + 12, entrySizes[i]);
+        entryOffsets[i] = pos;
+        pos += entrySizes[i];
+    } /* for */
+
+    for (i = HEADER_SIZE; i < IMAGE_SIZE; i++)
+        image[i] = (PHYSFS_uint8) ((i * 131) + (i >> 8));
+} /* buildImage */
+
+
+/* what a read of (len) at (offset) should get. */
+static PHYSFS_uint64 expectedLen(const PHYSFS_uint64 offset,
+                                 const PHYSFS_uint64 len)
+{
+    if (offset >= IMAGE_SIZE)
+        return 0;
+    return (len < IMAGE_SIZE - offset) ? len : IMAGE_SIZE - offset;
+} /* expectedLen */
+
+
+static int readIsRight(const PHYSFS_sint64 rc, const void *buf,
+                       const PHYSFS_uint64 offset, const PHYSFS_uint64 len)
+{
+    const PHYSFS_uint64 expected = expectedLen(offset, len);
+    return (rc == (PHYSFS_sint64) expected) &&
+           ((expected == 0) || (memcmp(buf, image + offset, (size_t) expected) == 0));
+} /* readIsRight */
+
+
+static void checkReadAt(PHYSFS_Io *io, const PHYSFS_uint64 offset,
+                        const PHYSFS_uint64 len, const char *what)
+{
+    PHYSFS_uint8 buf[64];
+    const PHYSFS_sint64 rc = __PHYSFS_readAt(io, offset, buf, len);
+    check(readIsRight(rc, buf, offset, len), what);
+} /* checkReadAt */
+
+
+static void testEof(PHYSFS_Io *io)
+{
+    check(io->length(io) == IMAGE_SIZE, "wrong length");
+    checkReadAt(io, IMAGE_SIZE - 10, 10, "a read that ends at EOF");
+    checkReadAt(io, IMAGE_SIZE - 4, 16, "a read that runs past EOF");
+    checkReadAt(io, IMAGE_SIZE, 1, "a read at EOF");
+    checkReadAt(io, IMAGE_SIZE + 100, 1, "a read past EOF");
+    checkReadAt(io, 0, 0, "an empty read");
+} /* testEof */
+
+
+static void testReadv(PHYSFS_Io *io)
+{
+    PHYSFS_uint8 bufs[4][64];
+    PHYSFS_IoVec vec[4];
+    PHYSFS_sint64 rc;
+    int i;
+
+    /* every range crosses where one entry (or the header) ends. */
+    vec[0].offset = entryOffsets[1] - 3;
+    vec[0].len = 6;
+    vec[1].offset = entryOffsets[0] - 8;
+    vec[1].len = 16;
+    vec[2].offset = entryOffsets[2] - 2;  /* all of the 1-byte entry. */
+    vec[2].len = 4;
+    vec[3].offset = entryOffsets[3] - 5;
+    vec[3].len = 50;
+    for (i = 0; i < 4; i++)
+        vec[i].buf = bufs[i];
+
+    rc = __PHYSFS_readv(io, vec, 4);
+    check(rc == 6 + 16 + 4 + 50, "readv across entries came up short");
+    for (i = 0; i < 4; i++)
+        check(readIsRight((PHYSFS_sint64) vec[i].len, bufs[i], vec[i].offset,
+                          vec[i].len), "readv across entries read the wrong data");
+
+    /* the second range runs past EOF, so the third isn't read. */
+    memset(bufs, 0xEE, sizeof (bufs));
+    vec[0].offset = 100;
+    vec[0].len = 50;
+    vec[1].offset = IMAGE_SIZE - 20;
+    vec[1].len = 40;
+    vec[2].offset = 200;
+    vec[2].len = 10;
+    rc = __PHYSFS_readv(io, vec, 3);
+    check(rc == 50 + 20, "readv past EOF returned the wrong count");
+    check(readIsRight(50, bufs[0], 100, 50), "readv past EOF read the wrong data");
+    check(readIsRight(20, bufs[1], IMAGE_SIZE - 20, 20),
+          "readv past EOF read the wrong data");
+    check((bufs[2][0] == 0xEE) && (bufs[2][9] == 0xEE),
+          "readv kept going after a short range");
+
+    vec[0].offset = IMAGE_SIZE;
+    vec[0].len = 10;
+    vec[1].offset = 0;
+    vec[1].len = 10;
+    check(__PHYSFS_readv(io, vec, 2) == 0, "readv at EOF didn't return 0");
+    vec[0].offset = IMAGE_SIZE + 5;
+    check(__PHYSFS_readv(io, vec, 1) == 0, "readv past EOF didn't return 0");
+} /* testReadv */
+
+
+static PHYSFS_uint32 nextRandom(PHYSFS_uint32 *seed)
+{
+    *seed = (*seed * 1103515245) + 12345;
+    return (*seed >> 8);
+} /* nextRandom */
+
+
+static void *hammerMain(void *_h)
+{
+    Hammer *h = (Hammer *) _h;
+    PHYSFS_uint8 buf[2][MAX_READ];
+    int i;
+
+    for (i = 0; i < THREAD_READS; i++)
+    {
+        const PHYSFS_uint64 offset = nextRandom(&h->seed) % (IMAGE_SIZE + 64);
+        const PHYSFS_uint64 len = (nextRandom(&h->seed) % MAX_READ) + 1;
+        if (i & 1)
+        {
+            const PHYSFS_sint64 rc = h->io->readAt(h->io, offset, buf[0], len);
+            h->errors += !readIsRight(rc, buf[0], offset, len);
+        } /* if */
+        else
+        {
+            PHYSFS_IoVec vec[2];
+            PHYSFS_sint64 rc;
+            vec[0].offset = offset / 2;
+            vec[0].buf = buf[0];
+            vec[0].len = len;
+            vec[1].offset = offset;
+            vec[1].buf = buf[1];
+            vec[1].len = len;
+            rc = h->io->readv(h->io, vec, 2);
+            if (expectedLen(vec[0].offset, len) != len)
+                h->errors += !readIsRight(rc, buf[0], vec[0].offset, len);
+            else
+            {
+                h->errors += !readIsRight((PHYSFS_sint64) len, buf[0], vec[0].offset, len);
+                h->errors += !readIsRight(rc - (PHYSFS_sint64) len, buf[1], offset, len);
+            } /* else */
+        } /* else */
+    } /* for */
+
+    return NULL;
+} /* hammerMain */
+
+
+/* several threads read at random places while this one reads in order. */
+static void testConcurrent(PHYSFS_Io *reader)
+{
+    Hammer hammers[NUM_THREADS];
+    PHYSFS_uint8 buf[SEQUENTIAL_READ];
+    int started = 0;
+    int pass, i;
+
+    for (i = 0; i < NUM_THREADS; i++)
+    {
+        hammers[i].io = reader;
+        hammers[i].seed = (PHYSFS_uint32) (i + 1) * 7919;
+        hammers[i].errors = 0;
+        if (pthread_create(&hammers[i].thread, NULL, hammerMain, &hammers[i]) != 0)
+        {
+            check(0, "couldn't start a thread");
+            break;
+        } /* if */
+        started++;
+    } /* for */
+
+    for (pass = 0; pass < SEQUENTIAL_PASSES; pass++)
+    {
+        PHYSFS_uint64 pos = 0;
+        PHYSFS_sint64 rc;
+
+        if (!reader->seek(reader, 0))
+        {
+            check(0, "couldn't seek");
+            break;
+        } /* if */
+
+        do
+        {
+            rc = reader->read(reader, buf, sizeof (buf));
+            if (!readIsRight(rc, buf, pos, sizeof (buf)))
+            {
+                check(0, "reading in order while others readAt() went wrong");
+                break;
+            } /* if */
+            pos += (PHYSFS_uint64) rc;
+            check(reader->tell(reader) == (PHYSFS_sint64) pos,
+                  "the position moved under us");
+        } while (rc > 0);
+    } /* for */
+
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(hammers[i].thread, NULL);
+        check(hammers[i].errors == 0, "a concurrent readAt() or readv() went wrong");
+    } /* for */
+} /* testConcurrent */
+
+
+static void testReader(PHYSFS_Io *parent)
+{
+    PHYSFS_Io *reader = __PHYSFS_duplicateForRead(parent);
+    PHYSFS_uint8 buf[16];
+
+    if (reader == NULL)
+    {
+        check(0, lastError());
+        return;
+    } /* if */
+
+    check(__PHYSFS_ioHasReadAt(reader), "the reader can't readAt()");
+    testEof(reader);
+    testReadv(reader);
+
+    check(reader->seek(reader, IMAGE_SIZE), "couldn't seek to EOF");
+    check(reader->read(reader, buf, sizeof (buf)) == 0, "a read at EOF");
+    check(reader->tell(reader) == IMAGE_SIZE, "a read at EOF moved");
+    check(reader->seek(reader, IMAGE_SIZE + 7), "couldn't seek past EOF");
+    check(reader->read(reader, buf, sizeof (buf)) == 0, "a read past EOF");
+    check(reader->tell(reader) == IMAGE_SIZE + 7, "a read past EOF moved");
+
+    testConcurrent(reader);
+    reader->destroy(reader);
+} /* testReader */
+
+
+static void runIo(const char *name, PHYSFS_Io *io)
+{
+    const int before = failures;
+    const int hasReadAt = (io != NULL) && __PHYSFS_ioHasReadAt(io);
+
+    currentIo = name;
+    if (io == NULL)
+        check(0, lastError());
+    else
+    {
+        testEof(io);
+        testReadv(io);
+        if (hasReadAt)
+            testReader(io);
+    } /* else */
+
+    printf("%s,%d,%d\n", name, hasReadAt, failures - before);
+} /* runIo */
+
+
+/* each entry through a PHYSFS_File, up to and at its end. */
+static void runArchive(const char *path)
+{
+    const int before = failures;
+    PHYSFS_uint8 buf[4096];
+    PHYSFS_uint32 i;
+
+    currentIo = "archive";
+    if (!PHYSFS_mount(path, NULL, 1))
+        check(0, lastError());
+    else
+    {
+        for (i = 0; i < NUM_ENTRIES; i++)
+        {
+            const PHYSFS_uint32 size = entrySizes[i];
+            PHYSFS_File *f;
+            char name[16];
+
+            snprintf(name, sizeof (name), "E%u.BIN", (unsigned int) i);
+            f = PHYSFS_openRead(name);
+            if (f == NULL)
+            {
+                check(0, lastError());
+                continue;
+            } /* if */
+
+            check(PHYSFS_readBytes(f, buf, sizeof (buf)) == (PHYSFS_sint64) size,
+                  "an entry read came up wrong");
+            check(memcmp(buf, image + entryOffsets[i], size) == 0,
+                  "an entry read the wrong data");
+            check(PHYSFS_eof(f), "not at EOF after the whole entry");
+            check(PHYSFS_readBytes(f, buf, 1) == 0, "an entry read at EOF");
+            check(PHYSFS_seek(f, size - 1), "couldn't seek to the last byte");
+            check(PHYSFS_readBytes(f, buf, 16) == 1, "an entry read past EOF");
+            check(buf[0] == image[entryOffsets[i] + size - 1],
+                  "the last byte was wrong");
+            PHYSFS_close(f);
+        } /* for */
+        PHYSFS_unmount(path);
+    } /* else */
+
+    printf("archive,1,%d\n", failures - before);
+} /* runArchive */
+
+
+int main(int argc, char **argv)
+{
+    char tmpdir[1024];
+    char path[1100];
+    PHYSFS_Io *io;
+    PHYSFS_Io legacy;
+    FILE *out;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "USAGE: %s <dir>\n", argv[0]);
+        return 1;
+    } /* if */
+
+    snprintf(tmpdir, sizeof (tmpdir), "%s/readat_physfs.XXXXXX", argv[1]);
+    if (mkdtemp(tmpdir) == NULL)
+    {
+        fprintf(stderr, "couldn't make a directory in %s\n", argv[1]);
+        return 1;
+    } /* if */
+
+    buildImage();
+    snprintf(path, sizeof (path), "%s/readat.grp", tmpdir);
+    out = fopen(path, "wb");
+    if ((out == NULL) || (fwrite(image, sizeof (image), 1, out) != 1))
+    {
+        fprintf(stderr, "couldn't write %s\n", path);
+        failures++;
+    } /* if */
+    if ((out != NULL) && (fclose(out) != 0))
+        failures++;
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init() failed: %s\n", lastError());
+        return 1;
+    } /* if */
+
+    printf("io,readAt,failures\n");
+
+    if (!failures)
+    {
+        io = __PHYSFS_createNativeIo(path, 'r');
+        runIo("native", io);
+        if (io != NULL)
+            io->destroy(io);
+
+        io = __PHYSFS_createMemoryIo(image, sizeof (image), NULL);
+        runIo("memory", io);
+        if (io != NULL)
+        {
+            /* the same i/o, but as if it predated readAt(). */
+            memcpy(&legacy, io, sizeof (legacy));
+            legacy.version = 0;
+            runIo("legacy", &legacy);
+            io->destroy(io);
+        } /* if */
+
+        runArchive(path);
+    } /* if */
+
+    if (!PHYSFS_deinit())
+    {
+        fprintf(stderr, "PHYSFS_deinit() failed: %s\n", lastError());
+        failures++;
+    } /* if */
+
+    remove(path);
+    rmdir(tmpdir);
+
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of readat_physfs.c ... */
@@ -0,0 +1,636 @@
+/*
+ * Rewrites an archive with its entries in the order an access trace first
+ *  opened them, so a program that reads the same way walks the file front
+ *  to back instead of seeking all over it.
+ *
+ * The source is mounted through PhysicsFS, so it can be anything PhysicsFS
+ *  reads (ZIP, 7z, GRP, ISO, a directory...). The trace is one written by
+ *  physfs_record.c. Entries the trace opened come first, in the order they
+ *  were first opened; everything else follows in path order, then the
+ *  directories. The output is always a ZIP with stored (uncompressed)
+ *  entries, since there's no compressor here.
+ *
+ * With -m, a PHYSFS_PREFETCH_MANIFEST entry is added too, naming the byte
+ *  range that holds the accessed entries. PhysicsFS asks the OS to read that
+ *  range ahead when the archive is mounted.
+ */
+
+#define _FILE_OFFSET_BITS 64  /* for fseeko() past 2 gigabytes. */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+#include "physfs_record.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define COPY_CHUNK (64 * 1024)
+
+typedef struct Buf
+{
+    PHYSFS_uint8 *data;
+    size_t len;
+    size_t cap;
+} Buf;
+
+/* a file or directory in the source, and whether it's in the output yet. */
+typedef struct Entry
+{
+    char *path;
+    PHYSFS_Stat stat;
+    int written;
+} Entry;
+
+typedef struct Writer
+{
+    FILE *io;
+    PHYSFS_uint64 offset;
+    PHYSFS_uint64 count;
+    Buf central;
+} Writer;
+
+static Entry *entries = NULL;
+static size_t numEntries = 0;
+static size_t capEntries = 0;
+static PHYSFS_uint32 crcTable[256];
+
+
+static void outOfMemory(void)
+{
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+} /* outOfMemory */
+
+
+static void bufPut(Buf *b, const void *data, const size_t len)
+{
+    if (b->len + len > b->cap)
+    {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + len)
+            cap *= 2;
+        b->data = (PHYSFS_uint8 *) realloc(b->data, cap);
+        if (b->data == NULL)
+            outOfMemory();
+        b->cap = cap;
+    } /* if */
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+} /* bufPut */
+
+static void bufPut16(Buf *b, const PHYSFS_uint16 v)
+{
+    const PHYSFS_uint8 bytes[2] = { (PHYSFS_uint8) v, (PHYSFS_uint8) (v >> 8) };
+    bufPut(b, bytes, 2);
+} /* bufPut16 */
+
+static void bufPut32(Buf *b, const PHYSFS_uint32 v)
+{
+    bufPut16(b, (PHYSFS_uint16) v);
+    bufPut16(b, (PHYSFS_uint16) (v >> 16));
+} /* bufPut32 */
+
+static void bufPut64(Buf *b, const PHYSFS_uint64 v)
+{
+    bufPut32(b, (PHYSFS_uint32) v);
+    bufPut32(b, (PHYSFS_uint32) (v >> 32));
+} /* bufPut64 */
+
+
+static void crcInit(void)
+{
+    PHYSFS_uint32 i, j;
+    for (i = 0; i < 256; i++)
+    {
+        PHYSFS_uint32 c = i;
+        for (j = 0; j < 8; j++)
+            c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+        crcTable[i] = c;
+    } /* for */
+} /* crcInit */
+
+/* start with (crc) == 0, feed it back in for each block. */
+static PHYSFS_uint32 crcUpdate(PHYSFS_uint32 crc, const PHYSFS_uint8 *data,
+                               size_t len)
+{
+    crc ^= 0xFFFFFFFF;
+    while (len--)
+        crc = crcTable[(crc ^ *(data++)) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+} /* crcUpdate */
+
+
+static void dosTime(const PHYSFS_sint64 modtime, PHYSFS_uint16 *_time,
+                    PHYSFS_uint16 *_date)
+{
+    const time_t t = (time_t) modtime;
+    const struct tm *tm = (modtime > 0) ? localtime(&t) : NULL;
+
+    if ((tm == NULL) || (tm->tm_year < 80))
+    {
+        *_time = 0;
+        *_date = (1 << 5) | 1;  /* 1980-01-01, the earliest there is. */
+        return;
+    } /* if */
+
+    *_time = (PHYSFS_uint16) ((tm->tm_hour << 11) | (tm->tm_min << 5) |
+                              (tm->tm_sec / 2));
+    *_date = (PHYSFS_uint16) (((tm->tm_year - 80) << 9) |
+                              ((tm->tm_mon + 1) << 5) | tm->tm_mday);
+} /* dosTime */
+
+
+static void addEntry(const char *path, const PHYSFS_Stat *stat)
+{
+    if (numEntries == capEntries)
+    {
+        capEntries = capEntries ? capEntries * 2 : 1024;
+        entries = (Entry *) realloc(entries, capEntries * sizeof (Entry));
+        if (entries == NULL)
+            outOfMemory();
+    } /* if */
+
+    entries[numEntries].path = strdup(path);
+    if (entries[numEntries].path == NULL)
+        outOfMemory();
+    memcpy(&entries[numEntries].stat, stat, sizeof (*stat));
+    entries[numEntries].written = 0;
+    numEntries++;
+} /* addEntry */
+
+
+static int collectEntries(const char *dir)
+{
+    char **list = PHYSFS_enumerateFiles(dir);
+    char **i;
+
+    if (list == NULL)
+    {
+        fprintf(stderr, "couldn't enumerate '%s': %s\n", dir,
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 0;
+    } /* if */
+
+    for (i = list; *i != NULL; i++)
+    {
+        const size_t len = strlen(dir) + strlen(*i) + 2;
+        char *path = (char *) malloc(len);
+        PHYSFS_Stat stat;
+
+        if (path == NULL)
+            outOfMemory();
+        snprintf(path, len, "%s%s%s", dir, (*dir) ? "/" : "", *i);
+
+        /* an old manifest is rewritten below, if asked for. */
+        if ((*dir == '\0') && (strcmp(path, PHYSFS_PREFETCH_MANIFEST) == 0))
+            ;
+        else if (!PHYSFS_stat(path, &stat))
+            fprintf(stderr, "skipping '%s': can't stat it\n", path);
+        else if (stat.filetype == PHYSFS_FILETYPE_DIRECTORY)
+        {
+            addEntry(path, &stat);
+            if (!collectEntries(path))
+            {
+                free(path);
+                PHYSFS_freeList(list);
+                return 0;
+            } /* if */
+        } /* else if */
+        else if (stat.filetype == PHYSFS_FILETYPE_REGULAR)
+            addEntry(path, &stat);
+
+        free(path);
+    } /* for */
+
+    PHYSFS_freeList(list);
+    return 1;
+} /* collectEntries */
+
+
+static int cmpEntryPath(const void *_a, const void *_b)
+{
+    const Entry *a = (const Entry *) _a;
+    const Entry *b = (const Entry *) _b;
+    return strcmp(a->path, b->path);
+} /* cmpEntryPath */
+
+
+static Entry *findSourceEntry(const char *path)
+{
+    Entry key;
+    while (*path == '/')  /* PhysicsFS paths may start with one. */
+        path++;
+    key.path = (char *) path;
+    return (Entry *) bsearch(&key, entries, numEntries, sizeof (Entry),
+                             cmpEntryPath);
+} /* findSourceEntry */
+
+
+static int cmpRecordStart(const void *_a, const void *_b)
+{
+    const physfs_record_entry *a = *((const physfs_record_entry **) _a);
+    const physfs_record_entry *b = *((const physfs_record_entry **) _b);
+    if (a->start != b->start)
+        return (a->start < b->start) ? -1 : 1;
+    return (a < b) ? -1 : (a > b) ? 1 : 0;  /* keep file order on ties. */
+} /* cmpRecordStart */
+
+
+/*
+ * Write a local header for an entry of (size) bytes; the CRC is filled in
+ *  by finishEntry() once the data is written.
+ */
+static int beginEntry(Writer *w, const char *name, const PHYSFS_uint64 size,
+                      const PHYSFS_sint64 modtime)
+{
+    const int zip64 = (size >= 0xFFFFFFFF);
+    const PHYSFS_uint16 namelen = (PHYSFS_uint16) strlen(name);
+    PHYSFS_uint16 dostime, dosdate;
+    Buf local = { NULL, 0, 0 };
+    int ok;
+
+    dosTime(modtime, &dostime, &dosdate);
+    bufPut32(&local, 0x04034b50);
+    bufPut16(&local, zip64 ? 45 : 20);  /* version needed */
+    bufPut16(&local, 1 << 11);  /* flags: names are UTF-8. */
+    bufPut16(&local, 0);  /* stored */
+    bufPut16(&local, dostime);
+    bufPut16(&local, dosdate);
+    bufPut32(&local, 0);  /* crc, for now. */
+    bufPut32(&local, zip64 ? 0xFFFFFFFF : (PHYSFS_uint32) size);
+    bufPut32(&local, zip64 ? 0xFFFFFFFF : (PHYSFS_uint32) size);
+    bufPut16(&local, namelen);
+    bufPut16(&local, zip64 ? 20 : 0);  /* extra */
+    bufPut(&local, name, namelen);
+    if (zip64)
+    {
+        bufPut16(&local, 0x0001);
+        bufPut16(&local, 16);
+        bufPut64(&local, size);
+        bufPut64(&local, size);
+    } /* if */
+
+    ok = (fwrite(local.data, local.len, 1, w->io) == 1);
+    w->offset += local.len;
+    free(local.data);
+    return ok;
+} /* beginEntry */
+
+
+static int finishEntry(Writer *w, const char *name, const int isDir,
+                       const PHYSFS_uint64 headerOffset,
+                       const PHYSFS_uint64 size, const PHYSFS_uint32 crc,
+                       const PHYSFS_sint64 modtime)
+{
+    const int bigSize = (size >= 0xFFFFFFFF);
+    const int bigOffset = (headerOffset >= 0xFFFFFFFF);
+    const PHYSFS_uint16 namelen = (PHYSFS_uint16) strlen(name);
+    const PHYSFS_uint16 extralen = (bigSize ? 16 : 0) + (bigOffset ? 8 : 0);
+    const PHYSFS_uint32 mode = isDir ? 040755 : 0100644;
+    PHYSFS_uint8 crcbytes[4];
+    PHYSFS_uint16 dostime, dosdate;
+    Buf *c = &w->central;
+
+    crcbytes[0] = (PHYSFS_uint8) crc;
+    crcbytes[1] = (PHYSFS_uint8) (crc >> 8);
+    crcbytes[2] = (PHYSFS_uint8) (crc >> 16);
+    crcbytes[3] = (PHYSFS_uint8) (crc >> 24);
+    if ( (fseeko(w->io, (off_t) (headerOffset + 14), SEEK_SET) != 0) ||
+         (fwrite(crcbytes, 4, 1, w->io) != 1) ||
+         (fseeko(w->io, 0, SEEK_END) != 0) )
+        return 0;
+
+    dosTime(modtime, &dostime, &dosdate);
+    bufPut32(c, 0x02014b50);
+    bufPut16(c, (3 << 8) | 45);  /* version made by: Unix, zip 4.5 */
+    bufPut16(c, (bigSize || bigOffset) ? 45 : 20);  /* version needed */
+    bufPut16(c, 1 << 11);  /* flags: names are UTF-8. */
+    bufPut16(c, 0);  /* stored */
+    bufPut16(c, dostime);
+    bufPut16(c, dosdate);
+    bufPut32(c, crc);
+    bufPut32(c, bigSize ? 0xFFFFFFFF : (PHYSFS_uint32) size);
+    bufPut32(c, bigSize ? 0xFFFFFFFF : (PHYSFS_uint32) size);
+    bufPut16(c, namelen);
+    bufPut16(c, extralen ? extralen + 4 : 0);
+    bufPut16(c, 0);  /* comment */
+    bufPut16(c, 0);  /* disk */
+    bufPut16(c, 0);  /* internal attributes */
+    bufPut32(c, (mode << 16) | (isDir ? 0x10 : 0));  /* external attributes */
+    bufPut32(c, bigOffset ? 0xFFFFFFFF : (PHYSFS_uint32) headerOffset);
+    bufPut(c, name, namelen);
+    if (extralen)
+    {
+        bufPut16(c, 0x0001);
+        bufPut16(c, extralen);
+        if (bigSize)
+        {
+            bufPut64(c, size);
+            bufPut64(c, size);
+        } /* if */
+        if (bigOffset)
+            bufPut64(c, headerOffset);
+    } /* if */
+
+    w->count++;
+    return 1;
+} /* finishEntry */
+
+
+static int writeFileEntry(Writer *w, const Entry *e)
+{
+    const PHYSFS_uint64 headerOffset = w->offset;
+    const PHYSFS_uint64 size = (PHYSFS_uint64) e->stat.filesize;
+    PHYSFS_uint8 *buf = (PHYSFS_uint8 *) malloc(COPY_CHUNK);
+    PHYSFS_File *in = PHYSFS_openRead(e->path);
+    PHYSFS_uint64 total = 0;
+    PHYSFS_uint32 crc = 0;
+    int ok = (buf != NULL) && (in != NULL) && (e->stat.filesize >= 0);
+
+    if (in == NULL)
+    {
+        fprintf(stderr, "couldn't open '%s': %s\n", e->path,
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+    } /* if */
+
+    ok = ok && beginEntry(w, e->path, size, e->stat.modtime);
+    while (ok)
+    {
+        const PHYSFS_sint64 br = PHYSFS_readBytes(in, buf, COPY_CHUNK);
+        if (br <= 0)
+        {
+            ok = (br == 0);
+            break;
+        } /* if */
+        crc = crcUpdate(crc, buf, (size_t) br);
+        ok = (fwrite(buf, (size_t) br, 1, w->io) == 1);
+        total += (PHYSFS_uint64) br;
+    } /* while */
+
+    if (ok && (total != size))
+    {
+        fprintf(stderr, "'%s' changed size while copying\n", e->path);
+        ok = 0;
+    } /* if */
+
+    w->offset += total;
+    ok = ok && finishEntry(w, e->path, 0, headerOffset, size, crc,
+                           e->stat.modtime);
+
+    if (in != NULL)
+        PHYSFS_close(in);
+    free(buf);
+    return ok;
+} /* writeFileEntry */
+
+
+static int writeMemEntry(Writer *w, const char *name, const int isDir,
+                         const Buf *data, const PHYSFS_sint64 modtime)
+{
+    const PHYSFS_uint64 headerOffset = w->offset;
+    const PHYSFS_uint32 crc = crcUpdate(0, data->data, data->len);
+
+    if (!beginEntry(w, name, data->len, modtime))
+        return 0;
+    if ((data->len > 0) && (fwrite(data->data, data->len, 1, w->io) != 1))
+        return 0;
+    w->offset += data->len;
+    return finishEntry(w, name, isDir, headerOffset, data->len, crc, modtime);
+} /* writeMemEntry */
+
+
+static int writeEndOfCentralDir(Writer *w)
+{
+    const PHYSFS_uint64 centralOffset = w->offset;
+    const PHYSFS_uint64 centralSize = w->central.len;
+    const int zip64 = (w->count >= 0xFFFF) ||
+                      (centralOffset >= 0xFFFFFFFF) ||
+                      (centralSize >= 0xFFFFFFFF);
+    Buf *c = &w->central;
+
+    if (zip64)
+    {
+        const PHYSFS_uint64 zip64Offset = centralOffset + centralSize;
+        bufPut32(c, 0x06064b50);
+        bufPut64(c, 44);  /* size of the rest of the record */
+        bufPut16(c, (3 << 8) | 45);  /* version made by */
+        bufPut16(c, 45);  /* version needed */
+        bufPut32(c, 0);  /* disk */
+        bufPut32(c, 0);  /* disk with central dir */
+        bufPut64(c, w->count);
+        bufPut64(c, w->count);
+        bufPut64(c, centralSize);
+        bufPut64(c, centralOffset);
+
+        bufPut32(c, 0x07064b50);
+        bufPut32(c, 0);  /* disk with zip64 end record */
+        bufPut64(c, zip64Offset);
+        bufPut32(c, 1);  /* total disks */
+    } /* if */
+
+    bufPut32(c, 0x06054b50);
+    bufPut16(c, 0);  /* disk */
+    bufPut16(c, 0);  /* disk with central dir */
+    bufPut16(c, zip64 ? 0xFFFF : (PHYSFS_uint16) w->count);
+    bufPut16(c, zip64 ? 0xFFFF : (PHYSFS_uint16) w->count);
+    bufPut32(c, zip64 ? 0xFFFFFFFF : (PHYSFS_uint32) centralSize);
+    bufPut32(c, zip64 ? 0xFFFFFFFF : (PHYSFS_uint32) centralOffset);
+    bufPut16(c, 0);  /* comment */
+
+    return (fwrite(c->data, c->len, 1, w->io) == 1);
+} /* writeEndOfCentralDir */
+
+
+static void manifestLine(Buf *manifest, const char *line)
+{
+    bufPut(manifest, line, strlen(line));
+    bufPut(manifest, "\n", 1);
+} /* manifestLine */
+
+
+static int repack(const char *tracefname, const char *outfname,
+                  const int withManifest)
+{
+    physfs_record_entry *records = NULL;
+    physfs_record_entry **opens = NULL;
+    size_t numRecords = 0;
+    size_t numOpens = 0;
+    size_t accessed = 0;
+    PHYSFS_uint64 prefetchEnd = 0;
+    Buf paths = { NULL, 0, 0 };
+    Writer w;
+    size_t i;
+    int ok;
+
+    if (!physfs_record_load(tracefname, &records, &numRecords))
+        return 0;
+
+    if (!collectEntries(""))
+    {
+        physfs_record_free(records, numRecords);
+        return 0;
+    } /* if */
+    qsort(entries, numEntries, sizeof (Entry), cmpEntryPath);
+
+    opens = (physfs_record_entry **) malloc((numRecords + 1) * sizeof (*opens));
+    if (opens == NULL)
+        outOfMemory();
+    for (i = 0; i < numRecords; i++)
+    {
+        if ((records[i].op == PHYSFS_RECORD_OPEN) && (records[i].file != 0))
+            opens[numOpens++] = &records[i];
+    } /* for */
+    qsort(opens, numOpens, sizeof (*opens), cmpRecordStart);
+
+    memset(&w, '\0', sizeof (w));
+    w.io = fopen(outfname, "wb");
+    if (w.io == NULL)
+    {
+        fprintf(stderr, "couldn't create %s\n", outfname);
+        free(opens);
+        physfs_record_free(records, numRecords);
+        return 0;
+    } /* if */
+
+    ok = 1;
+    for (i = 0; ok && (i < numOpens); i++)  /* first opens, in order. */
+    {
+        Entry *e = findSourceEntry(opens[i]->path);
+        if ((e == NULL) || (e->written) ||
+            (e->stat.filetype != PHYSFS_FILETYPE_REGULAR))
+            continue;  /* gone, already written, or not a file. */
+        ok = writeFileEntry(&w, e);
+        e->written = 1;
+        prefetchEnd = w.offset;
+        manifestLine(&paths, e->path);
+        accessed++;
+    } /* for */
+
+    for (i = 0; ok && (i < numEntries); i++)  /* the rest of the files. */
+    {
+        Entry *e = &entries[i];
+        if ((!e->written) && (e->stat.filetype == PHYSFS_FILETYPE_REGULAR))
+        {
+            ok = writeFileEntry(&w, e);
+            e->written = 1;
+        } /* if */
+    } /* for */
+
+    for (i = 0; ok && (i < numEntries); i++)  /* directories last. */
+    {
+        Entry *e = &entries[i];
+        if (e->stat.filetype == PHYSFS_FILETYPE_DIRECTORY)
+        {
+            const size_t len = strlen(e->path);
+            char *name = (char *) malloc(len + 2);
+            Buf empty = { NULL, 0, 0 };
+            if (name == NULL)
+                outOfMemory();
+            memcpy(name, e->path, len);
+            name[len] = '/';
+            name[len + 1] = '\0';
+            ok = writeMemEntry(&w, name, 1, &empty, e->stat.modtime);
+            e->written = 1;
+            free(name);
+        } /* if */
+    } /* for */
+
+    if (ok && withManifest)
+    {
+        Buf manifest = { NULL, 0, 0 };
+        char line[64];
+        manifestLine(&manifest, "PHYSFS-PREFETCH 1");
+        snprintf(line, sizeof (line), "range 0 %llu",
+                 (unsigned long long) prefetchEnd);
+        manifestLine(&manifest, line);
+        if (paths.len > 0)
+            bufPut(&manifest, paths.data, paths.len);
+        ok = writeMemEntry(&w, PHYSFS_PREFETCH_MANIFEST, 0, &manifest,
+                           (PHYSFS_sint64) time(NULL));
+        free(manifest.data);
+    } /* if */
+
+    ok = ok && writeEndOfCentralDir(&w);
+    ok = (fclose(w.io) == 0) && ok;
+
+    if (!ok)
+    {
+        fprintf(stderr, "failed to write %s\n", outfname);
+        remove(outfname);
+    } /* if */
+    else
+    {
+        printf("wrote %u entries to %s, %u of them in access order",
+               (unsigned int) w.count, outfname, (unsigned int) accessed);
+        if (withManifest)
+            printf(", read-ahead range is %llu bytes",
+                   (unsigned long long) prefetchEnd);
+        printf("\n");
+    } /* else */
+
+    free(w.central.data);
+    free(paths.data);
+    free(opens);
+    physfs_record_free(records, numRecords);
+    return ok;
+} /* repack */
+
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+        "USAGE: %s [-m] <trace> <source archive or dir> <output.zip>\n"
+        "  -m    add a prefetch manifest (" PHYSFS_PREFETCH_MANIFEST ")\n",
+        argv0);
+} /* usage */
+
+
+int main(int argc, char **argv)
+{
+    int withManifest = 0;
+    int argi = 1;
+    int ok;
+    size_t i;
+
+    if ((argi < argc) && (strcmp(argv[argi], "-m") == 0))
+    {
+        withManifest = 1;
+        argi++;
+    } /* if */
+
+    if ((argc - argi) != 3)
+    {
+        usage(argv[0]);
+        return 1;
+    } /* if */
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init() failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    if (!PHYSFS_mount(argv[argi + 1], NULL, 1))
+    {
+        fprintf(stderr, "failed to mount %s: %s\n", argv[argi + 1],
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        PHYSFS_deinit();
+        return 1;
+    } /* if */
+
+    crcInit();
+    ok = repack(argv[argi], argv[argi + 2], withManifest);
+
+    for (i = 0; i < numEntries; i++)
+        free(entries[i].path);
+    free(entries);
+
+    PHYSFS_deinit();
+    return ok ? 0 : 1;
+} /* main */
+
+/* end of repack_physfs.c ... */
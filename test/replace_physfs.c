@@ -0,0 +1,251 @@
+/*
+ * PhysicsFS PHYSFS_replaceMount() test.
+ *
+ * Takes two archives that both have (file), with different contents. It
+ *  mounts the first, then swaps it for the second and back again over and
+ *  over with PHYSFS_replaceMount(), while a few threads keep opening and
+ *  reading (file). Every open must work and read all of one version or the
+ *  other. One handle is opened before the first swap and read slowly all
+ *  the way through; it must see the first version to the end.
+ *
+ * Reports, as CSV on stdout (swaps,mean_replace_ms,opens,failed_opens,
+ *  max_open_ms), how long each swap took, and the longest any open had to
+ *  wait meanwhile. Archives with lots of files take a while to open, and
+ *  opens shouldn't wait for that.
+ *
+ * The exit status is non-zero if anything went wrong.
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define READER_THREADS 3
+
+typedef struct Version
+{
+    PHYSFS_uint8 *data;
+    PHYSFS_sint64 len;
+} Version;
+
+static const char *fname = NULL;
+static Version versions[2];
+static volatile int stop = 0;
+static volatile int failures = 0;
+
+/* per reader, so there's nothing to lock. */
+static PHYSFS_uint64 opens[READER_THREADS];
+static PHYSFS_uint64 failedOpens[READER_THREADS];
+static double worstOpen[READER_THREADS];
+
+
+static double nowSeconds(void)
+{
+    return ((double) __PHYSFS_platformGetTicks()) / 1000000000.0;
+} /* nowSeconds */
+
+
+static int isVersion(const Version *v, const PHYSFS_uint8 *buf,
+                     const PHYSFS_sint64 len)
+{
+    return (len == v->len) && (memcmp(buf, v->data, (size_t) len) == 0);
+} /* isVersion */
+
+
+/* what (fname) is in (archive), mounted out of the way for a moment. */
+static int loadVersion(const char *archive, Version *v)
+{
+    char *path = (char *) malloc(strlen(fname) + 10);
+    PHYSFS_File *f = NULL;
+    int retval = 0;
+
+    if (!path || !PHYSFS_mount(archive, "version", 0))
+    {
+        free(path);
+        return 0;
+    } /* if */
+
+    sprintf(path, "version/%s", fname);
+    f = PHYSFS_openRead(path);
+    free(path);
+
+    if (f != NULL)
+    {
+        v->len = PHYSFS_fileLength(f);
+        v->data = (PHYSFS_uint8 *) malloc((size_t) (v->len + 1));
+        retval = v->data && (PHYSFS_readBytes(f, v->data, v->len) == v->len);
+        PHYSFS_close(f);
+    } /* if */
+
+    PHYSFS_unmount(archive);
+    return retval;
+} /* loadVersion */
+
+
+static void *readerThread(void *_id)
+{
+    const int id = (int) (size_t) _id;
+    const PHYSFS_sint64 biggest = (versions[0].len > versions[1].len) ? versions[0].len : versions[1].len;
+    PHYSFS_uint8 *buf = (PHYSFS_uint8 *) malloc((size_t) (biggest + 1));
+
+    while (!stop && buf)
+    {
+        const double start = nowSeconds();
+        PHYSFS_File *f = PHYSFS_openRead(fname);
+        const double took = nowSeconds() - start;
+        PHYSFS_sint64 br;
+
+        if (took > worstOpen[id])
+            worstOpen[id] = took;
+
+        if (f == NULL)
+        {
+            fprintf(stderr, "open failed: %s\n",
+                    PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            failedOpens[id]++;
+            failures++;
+            continue;
+        } /* if */
+
+        opens[id]++;
+        br = PHYSFS_readBytes(f, buf, biggest + 1);
+        if (!isVersion(&versions[0], buf, br) && !isVersion(&versions[1], buf, br))
+        {
+            fprintf(stderr, "read something that's neither version\n");
+            failures++;
+        } /* if */
+        PHYSFS_close(f);
+    } /* while */
+
+    free(buf);
+    return NULL;
+} /* readerThread */
+
+
+int main(int argc, char **argv)
+{
+    pthread_t threads[READER_THREADS];
+    PHYSFS_File *longLived = NULL;
+    PHYSFS_uint8 *buf = NULL;
+    PHYSFS_uint64 totalOpens = 0;
+    PHYSFS_uint64 totalFailed = 0;
+    PHYSFS_sint64 pos = 0;
+    double replaceTime = 0.0;
+    double worst = 0.0;
+    int swaps = 50;
+    int i;
+
+    if ((argc != 4) && (argc != 5))
+    {
+        fprintf(stderr, "USAGE: %s <archive1> <archive2> <file> [swaps]\n", argv[0]);
+        return 1;
+    } /* if */
+
+    fname = argv[3];
+    if (argc == 5)
+        swaps = atoi(argv[4]);
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init() failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    if (!loadVersion(argv[1], &versions[0]) || !loadVersion(argv[2], &versions[1]))
+    {
+        fprintf(stderr, "couldn't read %s from both archives\n", fname);
+        return 1;
+    } /* if */
+
+    if (isVersion(&versions[0], versions[1].data, versions[1].len))
+    {
+        fprintf(stderr, "%s is the same in both archives\n", fname);
+        return 1;
+    } /* if */
+
+    if (!PHYSFS_mount(argv[1], NULL, 1) || !(longLived = PHYSFS_openRead(fname)))
+    {
+        fprintf(stderr, "couldn't mount %s: %s\n", argv[1],
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    for (i = 0; i < READER_THREADS; i++)
+        pthread_create(&threads[i], NULL, readerThread, (void *) (size_t) i);
+
+    buf = (PHYSFS_uint8 *) malloc((size_t) (versions[0].len + 1));
+    for (i = 0; i < swaps; i++)
+    {
+        const char *from = argv[1 + (i % 2)];
+        const char *to = argv[1 + ((i + 1) % 2)];
+        const double start = nowSeconds();
+        PHYSFS_sint64 br;
+
+        if (!PHYSFS_replaceMount(from, to))
+        {
+            fprintf(stderr, "swap %d failed: %s\n", i,
+                    PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            failures++;
+            break;
+        } /* if */
+        replaceTime += nowSeconds() - start;
+
+        /* a bit more of the long-lived handle each time: still the old one? */
+        br = PHYSFS_readBytes(longLived, buf + pos, (versions[0].len / swaps) + 1);
+        if (br > 0)
+            pos += br;
+    } /* for */
+
+    stop = 1;
+    for (i = 0; i < READER_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    if (failures == 0)
+    {
+        const PHYSFS_sint64 br = PHYSFS_readBytes(longLived, buf + pos, (versions[0].len - pos) + 1);
+        if (br > 0)
+            pos += br;
+        if (!isVersion(&versions[0], buf, pos))
+        {
+            fprintf(stderr, "the handle open from before didn't keep reading the old archive\n");
+            failures++;
+        } /* if */
+    } /* if */
+
+    PHYSFS_close(longLived);  /* the last user of a retired archive, maybe. */
+
+    for (i = 0; i < READER_THREADS; i++)
+    {
+        totalOpens += opens[i];
+        totalFailed += failedOpens[i];
+        if (worstOpen[i] > worst)
+            worst = worstOpen[i];
+    } /* for */
+
+    printf("swaps,mean_replace_ms,opens,failed_opens,max_open_ms\n");
+    printf("%d,%.3f,%llu,%llu,%.3f\n", swaps,
+           swaps ? (replaceTime * 1000.0) / swaps : 0.0,
+           (unsigned long long) totalOpens, (unsigned long long) totalFailed,
+           worst * 1000.0);
+
+    free(buf);
+    free(versions[0].data);
+    free(versions[1].data);
+    if (!PHYSFS_deinit())
+    {
+        fprintf(stderr, "PHYSFS_deinit() failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        failures++;
+    } /* if */
+
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of replace_physfs.c ... */
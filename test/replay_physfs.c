@@ -0,0 +1,428 @@
+/*
+ * Replays an access trace written by physfs_record.c against a set of
+ *  mounted archives, and reports latency percentiles per operation, next
+ *  to the ones that were recorded.
+ *
+ * Each recorded thread is a stream of operations. Streams are spread over
+ *  the replay threads round-robin; if there are more replay threads than
+ *  streams, the streams are replayed several times concurrently.
+ *
+ * This needs POSIX threads and clocks.
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+#include "physfs_record.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define NUM_OPS 5  /* index 0 is unused, ops are numbered from 1. */
+
+static const char *opNames[NUM_OPS] = { NULL, "open", "read", "seek", "close" };
+
+typedef physfs_record_entry Record;
+
+typedef struct Latencies
+{
+    PHYSFS_uint64 *ns;
+    size_t count;
+    size_t cap;
+} Latencies;
+
+typedef struct Replayer
+{
+    pthread_t tid;
+    Record **records;  /* everything this thread replays, by start time. */
+    size_t count;
+    PHYSFS_File **files;  /* indexed by the recorded file number. */
+    PHYSFS_uint8 *buf;
+    Latencies latency[NUM_OPS];
+    PHYSFS_uint64 bytes;
+    PHYSFS_uint64 skipped;
+    PHYSFS_uint64 failed;
+} Replayer;
+
+static Record *records = NULL;
+static size_t numRecords = 0;
+static PHYSFS_uint32 numStreams = 0;
+static PHYSFS_uint64 numFiles = 0;
+static PHYSFS_uint64 maxRead = 0;
+static PHYSFS_uint64 bufferSize = 0;
+static int paced = 0;
+static double replayStart = 0.0;
+
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0);
+} /* now */
+
+
+static void addLatency(Latencies *l, const PHYSFS_uint64 ns)
+{
+    if (l->count == l->cap)
+    {
+        l->cap = l->cap ? l->cap * 2 : 1024;
+        l->ns = (PHYSFS_uint64 *) realloc(l->ns, l->cap * sizeof (*l->ns));
+        if (l->ns == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        } /* if */
+    } /* if */
+    l->ns[l->count++] = ns;
+} /* addLatency */
+
+
+/* figure out how many streams and files there are, and the biggest read. */
+static void scanRecords(void)
+{
+    size_t i;
+    for (i = 0; i < numRecords; i++)
+    {
+        const Record *r = &records[i];
+        if (r->thread >= numStreams)
+            numStreams = r->thread + 1;
+        if (r->file >= numFiles)
+            numFiles = r->file + 1;
+        if ((r->op == PHYSFS_RECORD_READ) && (r->arg > maxRead))
+            maxRead = r->arg;
+    } /* for */
+} /* scanRecords */
+
+
+static int cmpRecordStart(const void *_a, const void *_b)
+{
+    const Record *a = *((const Record **) _a);
+    const Record *b = *((const Record **) _b);
+    if (a->start != b->start)
+        return (a->start < b->start) ? -1 : 1;
+    return (a < b) ? -1 : (a > b) ? 1 : 0;  /* keep file order on ties. */
+} /* cmpRecordStart */
+
+
+/* thread (k) of (threads) gets every stream s where s % threads == k, or
+   stream (k % streams) if there are more threads than streams. */
+static int assignRecords(Replayer *r, const int k, const int threads)
+{
+    size_t i;
+
+    r->records = (Record **) malloc(sizeof (Record *) * (numRecords + 1));
+    r->files = (PHYSFS_File **) calloc((size_t) numFiles, sizeof (PHYSFS_File *));
+    r->buf = (PHYSFS_uint8 *) malloc((size_t) maxRead + 1);
+    if (!r->records || !r->files || !r->buf)
+        return 0;
+
+    for (i = 0; i < numRecords; i++)
+    {
+        const PHYSFS_uint32 stream = records[i].thread;
+        const int mine = (numStreams >= (PHYSFS_uint32) threads) ?
+                            ((int) (stream % threads) == k) :
+                            (stream == (PHYSFS_uint32) (k % numStreams));
+        if (mine)
+            r->records[r->count++] = &records[i];
+    } /* for */
+
+    qsort(r->records, r->count, sizeof (Record *), cmpRecordStart);
+    return 1;
+} /* assignRecords */
+
+
+static void waitUntil(const PHYSFS_sint64 start)
+{
+    const double when = replayStart + (((double) start) / 1e9);
+    const double delay = when - now();
+    if (delay > 0.0)
+    {
+        struct timespec ts;
+        ts.tv_sec = (time_t) delay;
+        ts.tv_nsec = (long) ((delay - ts.tv_sec) * 1e9);
+        nanosleep(&ts, NULL);
+    } /* if */
+} /* waitUntil */
+
+
+static void replayRecord(Replayer *r, const Record *rec)
+{
+    PHYSFS_File *f = (rec->file < numFiles) ? r->files[rec->file] : NULL;
+    double t;
+    int ok = 1;
+
+    /* the file was opened on another thread, or the open failed here. */
+    if ((rec->op != PHYSFS_RECORD_OPEN) && (f == NULL))
+    {
+        r->skipped++;
+        return;
+    } /* if */
+
+    if (paced)
+        waitUntil(rec->start);
+
+    t = now();
+    switch (rec->op)
+    {
+        case PHYSFS_RECORD_OPEN:
+            f = PHYSFS_openRead(rec->path);
+            if ((f != NULL) && (bufferSize > 0))
+                PHYSFS_setBuffer(f, bufferSize);
+            break;
+
+        case PHYSFS_RECORD_READ:
+        {
+            const PHYSFS_sint64 br = PHYSFS_readBytes(f, r->buf, rec->arg);
+            ok = (br >= 0);
+            if (ok)
+                r->bytes += (PHYSFS_uint64) br;
+            break;
+        } /* case */
+
+        case PHYSFS_RECORD_SEEK:
+            ok = PHYSFS_seek(f, rec->arg);
+            break;
+
+        case PHYSFS_RECORD_CLOSE:
+            ok = PHYSFS_close(f);
+            break;
+    } /* switch */
+    addLatency(&r->latency[rec->op], (PHYSFS_uint64) ((now() - t) * 1e9));
+
+    if (rec->op == PHYSFS_RECORD_OPEN)
+    {
+        if (rec->file == 0)  /* recorded as a failed open. */
+        {
+            if (f != NULL)
+                PHYSFS_close(f);
+        } /* if */
+        else
+        {
+            ok = (f != NULL);
+            r->files[rec->file] = f;
+        } /* else */
+    } /* if */
+
+    else if (rec->op == PHYSFS_RECORD_CLOSE)
+        r->files[rec->file] = NULL;
+
+    if (!ok)
+        r->failed++;
+} /* replayRecord */
+
+
+static void *replayMain(void *data)
+{
+    Replayer *r = (Replayer *) data;
+    size_t i;
+
+    for (i = 0; i < r->count; i++)
+        replayRecord(r, r->records[i]);
+
+    for (i = 0; i < numFiles; i++)  /* anything the trace didn't close. */
+    {
+        if (r->files[i] != NULL)
+            PHYSFS_close(r->files[i]);
+    } /* for */
+
+    return NULL;
+} /* replayMain */
+
+
+static int cmpUint64(const void *_a, const void *_b)
+{
+    const PHYSFS_uint64 a = *((const PHYSFS_uint64 *) _a);
+    const PHYSFS_uint64 b = *((const PHYSFS_uint64 *) _b);
+    return (a < b) ? -1 : (a > b) ? 1 : 0;
+} /* cmpUint64 */
+
+
+static double percentile(const Latencies *l, const double p)
+{
+    size_t i = (size_t) ((p / 100.0) * l->count);
+    if (i >= l->count)
+        i = l->count - 1;
+    return l->ns[i] / 1000.0;
+} /* percentile */
+
+
+static void printLatencies(const char *title, Latencies *l)
+{
+    int op;
+
+    printf("%s (microseconds):\n", title);
+    printf("  %-6s %10s %10s %10s %10s %10s %10s %10s\n", "op", "count",
+           "mean", "p50", "p90", "p99", "p99.9", "max");
+    for (op = 1; op < NUM_OPS; op++)
+    {
+        double total = 0.0;
+        size_t i;
+
+        if (l[op].count == 0)
+            continue;
+
+        qsort(l[op].ns, l[op].count, sizeof (PHYSFS_uint64), cmpUint64);
+        for (i = 0; i < l[op].count; i++)
+            total += (double) l[op].ns[i];
+
+        printf("  %-6s %10u %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+               opNames[op], (unsigned int) l[op].count,
+               (total / l[op].count) / 1000.0, percentile(&l[op], 50.0),
+               percentile(&l[op], 90.0), percentile(&l[op], 99.0),
+               percentile(&l[op], 99.9), l[op].ns[l[op].count - 1] / 1000.0);
+    } /* for */
+} /* printLatencies */
+
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+        "USAGE: %s [options] <trace> <archive or dir> [more archives...]\n"
+        "  -t <num>    replay threads (default: one per recorded thread)\n"
+        "  -B <bytes>  PHYSFS_setBuffer() size for every opened file\n"
+        "  -p          keep the recorded timing, instead of going flat out\n",
+        argv0);
+} /* usage */
+
+
+int main(int argc, char **argv)
+{
+    Latencies recorded[NUM_OPS];
+    Latencies replayed[NUM_OPS];
+    Replayer *replayers;
+    PHYSFS_uint64 bytes = 0, skipped = 0, failed = 0;
+    double elapsed;
+    int threads = 0;
+    int argi;
+    int i, op;
+    size_t j;
+
+    for (argi = 1; (argi < argc) && (argv[argi][0] == '-'); argi++)
+    {
+        if (strcmp(argv[argi], "-p") == 0)
+            paced = 1;
+        else if ((strcmp(argv[argi], "-t") == 0) && (argi + 1 < argc))
+            threads = atoi(argv[++argi]);
+        else if ((strcmp(argv[argi], "-B") == 0) && (argi + 1 < argc))
+            bufferSize = (PHYSFS_uint64) atol(argv[++argi]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        } /* else */
+    } /* for */
+
+    if ((argc - argi) < 2)
+    {
+        usage(argv[0]);
+        return 1;
+    } /* if */
+
+    if (!physfs_record_load(argv[argi], &records, &numRecords))
+        return 1;
+
+    if (numRecords == 0)
+    {
+        fprintf(stderr, "%s has no records\n", argv[argi]);
+        return 1;
+    } /* if */
+
+    scanRecords();
+    if (threads <= 0)
+        threads = (int) numStreams;
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init() failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    for (argi++; argi < argc; argi++)
+    {
+        if (!PHYSFS_mount(argv[argi], NULL, 1))
+        {
+            fprintf(stderr, "failed to mount %s: %s\n", argv[argi],
+                    PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            PHYSFS_deinit();
+            return 1;
+        } /* if */
+    } /* for */
+
+    replayers = (Replayer *) calloc(threads, sizeof (Replayer));
+    for (i = 0; (replayers != NULL) && (i < threads); i++)
+    {
+        if (!assignRecords(&replayers[i], i, threads))
+        {
+            free(replayers);
+            replayers = NULL;
+        } /* if */
+    } /* for */
+
+    if (replayers == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        PHYSFS_deinit();
+        return 1;
+    } /* if */
+
+    replayStart = now();
+    for (i = 0; i < threads; i++)
+        pthread_create(&replayers[i].tid, NULL, replayMain, &replayers[i]);
+    for (i = 0; i < threads; i++)
+        pthread_join(replayers[i].tid, NULL);
+    elapsed = now() - replayStart;
+
+    memset(recorded, '\0', sizeof (recorded));
+    memset(replayed, '\0', sizeof (replayed));
+    for (j = 0; j < numRecords; j++)
+        addLatency(&recorded[records[j].op], records[j].duration);
+
+    for (i = 0; i < threads; i++)
+    {
+        Replayer *r = &replayers[i];
+        for (op = 1; op < NUM_OPS; op++)
+        {
+            for (j = 0; j < r->latency[op].count; j++)
+                addLatency(&replayed[op], r->latency[op].ns[j]);
+            free(r->latency[op].ns);
+        } /* for */
+        bytes += r->bytes;
+        skipped += r->skipped;
+        failed += r->failed;
+        free(r->records);
+        free(r->files);
+        free(r->buf);
+    } /* for */
+    free(replayers);
+
+    printf("%u records from %u recorded threads, replayed on %d threads "
+           "in %.3f s (%.2f MB/s)\n", (unsigned int) numRecords,
+           (unsigned int) numStreams, threads, elapsed,
+           (bytes / elapsed) / 1e6);
+    if (skipped || failed)
+    {
+        printf("%u operations skipped, %u failed\n",
+               (unsigned int) skipped, (unsigned int) failed);
+    } /* if */
+
+    printLatencies("recorded", recorded);
+    printLatencies("replayed", replayed);
+
+    for (op = 1; op < NUM_OPS; op++)
+    {
+        free(recorded[op].ns);
+        free(replayed[op].ns);
+    } /* for */
+
+    physfs_record_free(records, numRecords);
+
+    PHYSFS_deinit();
+    return 0;
+} /* main */
+
+/* end of replay_physfs.c ... */
@@ -0,0 +1,282 @@
+/*
+ * PhysicsFS PHYSFS_setIoScheduler() test.
+ *
+ * Reads one file from an archive on several threads at once, two at each
+ *  PHYSFS_IoPriority: the urgent and normal ones read small pieces at
+ *  random places, the background ones read big pieces front to back. Every
+ *  read is checked against a copy of the file read up front. This is done
+ *  for a few seconds with the archive's scheduler off and then on, starting
+ *  from a cold OS cache each time, and reports each priority's reads and
+ *  how long they took as CSV on stdout
+ *  (scheduler,priority,reads,bytes,mean_ms,max_ms).
+ *
+ * With -t, background reads are throttled to that many bytes per second
+ *  while the scheduler is on, and the test fails if they went much faster.
+ *  The limit is on bytes read from the archive, so for a compressed file it
+ *  is scaled by how well it compressed before checking.
+ *
+ * The exit status is non-zero if any read came back wrong.
+ *
+ * This needs POSIX threads and posix_fadvise().
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define THREADS_PER_PRIORITY 2
+#define SMALL_READ (16 * 1024)
+#define BIG_READ (256 * 1024)
+#define URGENT_DEADLINE_MS 20
+
+typedef struct Reader
+{
+    pthread_t thread;
+    PHYSFS_IoPriority priority;
+    PHYSFS_uint32 seed;
+    PHYSFS_uint64 reads;
+    PHYSFS_uint64 bytes;
+    double seconds;
+    double worst;
+} Reader;
+
+static const char *fname = NULL;
+static const PHYSFS_uint8 *expected = NULL;
+static PHYSFS_uint64 filelen = 0;
+static double storedRatio = 1.0;  /* archive bytes per file byte. */
+static double runUntil = 0.0;
+static volatile int failures = 0;
+
+static const char *priorityNames[] = { "background", "normal", "urgent" };
+
+
+static double nowSeconds(void)
+{
+    return ((double) __PHYSFS_platformGetTicks()) / 1000000000.0;
+} /* nowSeconds */
+
+
+static PHYSFS_uint32 nextRandom(PHYSFS_uint32 *seed, PHYSFS_uint32 max)
+{
+    *seed = (*seed * 1103515245) + 12345;
+    return ((*seed >> 8) % max);
+} /* nextRandom */
+
+
+static void *readerThread(void *_reader)
+{
+    Reader *reader = (Reader *) _reader;
+    const int background = (reader->priority == PHYSFS_IOPRIO_BACKGROUND);
+    const PHYSFS_uint32 piece = background ? BIG_READ : SMALL_READ;
+    const PHYSFS_uint32 deadline = (reader->priority == PHYSFS_IOPRIO_URGENT) ? URGENT_DEADLINE_MS : 0;
+    PHYSFS_File *f = PHYSFS_openRead(fname);
+    PHYSFS_uint8 *buf = (PHYSFS_uint8 *) malloc(piece);
+    PHYSFS_uint64 pos = 0;
+
+    if (!f || !buf || !PHYSFS_setIoPriority(f, reader->priority, deadline))
+    {
+        fprintf(stderr, "couldn't open %s: %s\n", fname,
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        failures++;
+        goto done;
+    } /* if */
+
+    while (nowSeconds() < runUntil)
+    {
+        PHYSFS_sint64 br;
+        double start, took;
+
+        if (!background)  /* anywhere, but a piece at a time. */
+            pos = ((PHYSFS_uint64) nextRandom(&reader->seed, (PHYSFS_uint32) (filelen / piece))) * piece;
+        else if (pos >= filelen)
+            pos = 0;
+
+        start = nowSeconds();
+        if (PHYSFS_seek(f, pos))
+            br = PHYSFS_readBytes(f, buf, piece);
+        else
+            br = -1;
+        took = nowSeconds() - start;
+
+        if ((br < 0) || (memcmp(buf, expected + pos, (size_t) br) != 0))
+        {
+            fprintf(stderr, "%s read at %llu came back wrong\n",
+                    priorityNames[reader->priority], (unsigned long long) pos);
+            failures++;
+            break;
+        } /* if */
+
+        pos += (PHYSFS_uint64) br;
+        reader->reads++;
+        reader->bytes += (PHYSFS_uint64) br;
+        reader->seconds += took;
+        if (took > reader->worst)
+            reader->worst = took;
+    } /* while */
+
+done:
+    free(buf);
+    if (f)
+        PHYSFS_close(f);
+    return NULL;
+} /* readerThread */
+
+
+static void dropArchiveCache(const char *archive)
+{
+    const int fd = open(archive, O_RDONLY);
+    if (fd != -1)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    } /* if */
+} /* dropArchiveCache */
+
+
+static void runTest(const char *archive, const int scheduled,
+                    const PHYSFS_uint64 throttle, const int seconds)
+{
+    Reader readers[3 * THREADS_PER_PRIORITY];
+    const size_t total = sizeof (readers) / sizeof (readers[0]);
+    double elapsed;
+    size_t i;
+    int prio;
+
+    if (!PHYSFS_setIoScheduler(archive, scheduled, throttle))
+    {
+        fprintf(stderr, "couldn't set up the scheduler: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        failures++;
+        return;
+    } /* if */
+
+    memset(readers, '\0', sizeof (readers));
+    dropArchiveCache(archive);
+    runUntil = nowSeconds() + seconds;
+    elapsed = nowSeconds();
+    for (i = 0; i < total; i++)
+    {
+        readers[i].priority = (PHYSFS_IoPriority) (i / THREADS_PER_PRIORITY);
+        readers[i].seed = (PHYSFS_uint32) (i + 1);
+        pthread_create(&readers[i].thread, NULL, readerThread, &readers[i]);
+    } /* for */
+
+    for (i = 0; i < total; i++)
+        pthread_join(readers[i].thread, NULL);
+    elapsed = nowSeconds() - elapsed;
+
+    for (prio = PHYSFS_IOPRIO_URGENT; prio >= PHYSFS_IOPRIO_BACKGROUND; prio--)
+    {
+        PHYSFS_uint64 reads = 0;
+        PHYSFS_uint64 bytes = 0;
+        double secs = 0.0;
+        double worst = 0.0;
+
+        for (i = 0; i < total; i++)
+        {
+            if (readers[i].priority != (PHYSFS_IoPriority) prio)
+                continue;
+            reads += readers[i].reads;
+            bytes += readers[i].bytes;
+            secs += readers[i].seconds;
+            if (readers[i].worst > worst)
+                worst = readers[i].worst;
+        } /* for */
+
+        printf("%s,%s,%llu,%llu,%.3f,%.3f\n", scheduled ? "on" : "off",
+               priorityNames[prio], (unsigned long long) reads,
+               (unsigned long long) bytes,
+               reads ? (secs * 1000.0) / reads : 0.0, worst * 1000.0);
+
+        /* a read can sneak in at the start, and one can finish late. */
+        if (scheduled && throttle && (prio == PHYSFS_IOPRIO_BACKGROUND) &&
+            ((bytes * storedRatio) > (throttle * elapsed * 1.25) + (4 * BIG_READ)))
+        {
+            fprintf(stderr, "background reads weren't throttled: %llu bytes"
+                    " in %.1f seconds\n", (unsigned long long) bytes, elapsed);
+            failures++;
+        } /* if */
+    } /* for */
+} /* runTest */
+
+
+int main(int argc, char **argv)
+{
+    PHYSFS_uint64 throttle = 0;
+    PHYSFS_uint8 *buf = NULL;
+    PHYSFS_File *f = NULL;
+    int seconds = 3;
+    int argi = 1;
+
+    while ((argc - argi > 2) && (argv[argi][0] == '-'))
+    {
+        if (strcmp(argv[argi], "-t") == 0)
+            throttle = (PHYSFS_uint64) strtoull(argv[argi + 1], NULL, 10);
+        else if (strcmp(argv[argi], "-s") == 0)
+            seconds = atoi(argv[argi + 1]);
+        else
+            break;
+        argi += 2;
+    } /* while */
+
+    if (argc - argi != 2)
+    {
+        fprintf(stderr, "USAGE: %s [-t bytes_per_sec] [-s seconds] <archive> <file>\n", argv[0]);
+        return 1;
+    } /* if */
+
+    if (!PHYSFS_init(argv[0]) || !PHYSFS_mount(argv[argi], NULL, 0))
+    {
+        fprintf(stderr, "couldn't mount %s: %s\n", argv[argi],
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    fname = argv[argi + 1];
+    f = PHYSFS_openRead(fname);
+    if (f != NULL)
+    {
+        const PHYSFS_sint64 len = PHYSFS_fileLength(f);
+        if (len >= BIG_READ)
+        {
+            filelen = (PHYSFS_uint64) len;
+            buf = (PHYSFS_uint8 *) malloc((size_t) filelen);
+            if (buf && (PHYSFS_readBytes(f, buf, filelen) != len))
+            {
+                free(buf);
+                buf = NULL;
+            } /* if */
+        } /* if */
+        PHYSFS_close(f);
+    } /* if */
+
+    if (buf == NULL)
+    {
+        fprintf(stderr, "couldn't read %s, or it's too small\n", fname);
+        return 1;
+    } /* if */
+
+    expected = buf;
+    {
+        PHYSFS_PhysicalStat pstat;
+        if (PHYSFS_statPhysical(fname, &pstat) && (pstat.filesize > 0))
+            storedRatio = ((double) pstat.storedsize) / ((double) pstat.filesize);
+    }
+    printf("scheduler,priority,reads,bytes,mean_ms,max_ms\n");
+    runTest(argv[argi], 0, 0, seconds);
+    runTest(argv[argi], 1, throttle, seconds);
+
+    free(buf);
+    PHYSFS_deinit();
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of sched_physfs.c ... */
@@ -0,0 +1,445 @@
+/*
+ * PhysicsFS PHYSFS_sendToFd() test.
+ *
+ * Mounts each archive given on the command line and sends every file in it
+ *  to a pipe, a socketpair and a temporary file with PHYSFS_sendToFd(),
+ *  mixed with PHYSFS_readBytes() and PHYSFS_seek() on the same handle, with
+ *  and without a PHYSFS_setBuffer() buffer. Whatever comes out the other
+ *  end is checked against what PHYSFS_readBytes() reads.
+ *
+ * Then it sends every file over a socketpair once with PHYSFS_sendToFd()
+ *  and once with a PHYSFS_readBytes() and write() loop, and reports the CPU
+ *  time each took per gigabyte, as CSV on stdout (archive,method,bytes,
+ *  cpu_sec_per_gb).
+ *
+ * The exit status is non-zero if any byte came out wrong.
+ *
+ * This needs POSIX threads and sockets.
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#define MAX_FILE_SIZE (64 * 1024 * 1024)
+#define COPY_BUFSIZE (64 * 1024)
+
+typedef struct TestFile
+{
+    char *path;
+    PHYSFS_uint8 *data;
+    PHYSFS_uint64 len;
+} TestFile;
+
+/* collects everything written to the other end of a pipe or socket. */
+typedef struct Drain
+{
+    int fd;
+    PHYSFS_uint8 *data;
+    size_t len;
+    size_t cap;
+    int discard;  /* just count it. */
+} Drain;
+
+static TestFile *files = NULL;
+static size_t numFiles = 0;
+static size_t capFiles = 0;
+static int failures = 0;
+
+
+static void *drainThread(void *_d)
+{
+    Drain *d = (Drain *) _d;
+    PHYSFS_uint8 buf[COPY_BUFSIZE];
+    ssize_t br;
+
+    while ((br = read(d->fd, buf, sizeof (buf))) > 0)
+    {
+        if (!d->discard)
+        {
+            if (d->len + (size_t) br > d->cap)
+            {
+                void *ptr;
+                d->cap = (d->cap + (size_t) br) * 2;
+                ptr = realloc(d->data, d->cap);
+                if (ptr == NULL)
+                {
+                    d->discard = 1;  /* counted as a failure below. */
+                    continue;
+                } /* if */
+                d->data = (PHYSFS_uint8 *) ptr;
+            } /* if */
+            memcpy(d->data + d->len, buf, (size_t) br);
+        } /* if */
+        d->len += (size_t) br;
+    } /* while */
+
+    return NULL;
+} /* drainThread */
+
+
+static void addFile(const char *path)
+{
+    PHYSFS_File *f;
+    PHYSFS_sint64 len;
+    TestFile *tf;
+
+    if (numFiles == capFiles)
+    {
+        void *ptr;
+        capFiles = capFiles ? capFiles * 2 : 64;
+        ptr = realloc(files, capFiles * sizeof (TestFile));
+        if (ptr == NULL)
+        {
+            capFiles = numFiles;
+            return;
+        } /* if */
+        files = (TestFile *) ptr;
+    } /* if */
+
+    f = PHYSFS_openRead(path);
+    if (f == NULL)
+        return;
+
+    len = PHYSFS_fileLength(f);
+    tf = &files[numFiles];
+    tf->path = strdup(path);
+    tf->len = (PHYSFS_uint64) len;
+    tf->data = (PHYSFS_uint8 *) malloc((size_t) len + 1);
+    if ( (len < 0) || (len > MAX_FILE_SIZE) || (!tf->path) || (!tf->data) ||
+         (PHYSFS_readBytes(f, tf->data, (PHYSFS_uint64) len) != len) )
+    {
+        free(tf->path);
+        free(tf->data);
+    } /* if */
+    else
+    {
+        numFiles++;
+    } /* else */
+
+    PHYSFS_close(f);
+} /* addFile */
+
+
+static PHYSFS_EnumerateCallbackResult findFiles(void *data,
+                                        const char *origdir, const char *fname)
+{
+    char path[1024];
+    PHYSFS_Stat st;
+
+    snprintf(path, sizeof (path), "%s%s%s", origdir, *origdir ? "/" : "", fname);
+    if (!PHYSFS_stat(path, &st))
+        return PHYSFS_ENUM_OK;
+    else if (st.filetype == PHYSFS_FILETYPE_DIRECTORY)
+        return PHYSFS_enumerate(path, findFiles, data) ? PHYSFS_ENUM_OK : PHYSFS_ENUM_ERROR;
+    else if (st.filetype == PHYSFS_FILETYPE_REGULAR)
+        addFile(path);
+    return PHYSFS_ENUM_OK;
+} /* findFiles */
+
+
+static void freeFiles(void)
+{
+    size_t i;
+    for (i = 0; i < numFiles; i++)
+    {
+        free(files[i].path);
+        free(files[i].data);
+    } /* for */
+    free(files);
+    files = NULL;
+    numFiles = capFiles = 0;
+} /* freeFiles */
+
+
+static void fail(const TestFile *tf, const char *sink, const char *what)
+{
+    fprintf(stderr, "FAIL: %s to %s: %s (%s)\n", tf->path, sink, what,
+            PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+    failures++;
+} /* fail */
+
+
+/*
+ * Send the file to (fd) in pieces, reading and seeking in between. Returns
+ *  the bytes that should have come out, in (expect), and how many.
+ */
+static size_t sendPieces(const TestFile *tf, const char *sink, int fd,
+                         const PHYSFS_uint64 bufsize, PHYSFS_uint8 *expect)
+{
+    const PHYSFS_uint64 len = tf->len;
+    const PHYSFS_uint64 third = len / 3;
+    const PHYSFS_uint64 skip = (len > 200) ? 100 : 0;
+    PHYSFS_uint8 tmp[100];
+    size_t expected = 0;
+    PHYSFS_File *f = PHYSFS_openRead(tf->path);
+    PHYSFS_sint64 rc;
+
+    if (f == NULL)
+    {
+        fail(tf, sink, "open failed");
+        return 0;
+    } /* if */
+
+    if ((bufsize > 0) && (!PHYSFS_setBuffer(f, bufsize)))
+        fail(tf, sink, "setBuffer failed");
+
+    /* read a little first, so a buffer has something left in it. */
+    if ((skip > 0) && (PHYSFS_readBytes(f, tmp, skip) != (PHYSFS_sint64) skip))
+        fail(tf, sink, "readBytes failed");
+
+    /* a third of it... */
+    rc = PHYSFS_sendToFd(f, fd, third);
+    if (rc != (PHYSFS_sint64) third)
+        fail(tf, sink, "short send");
+    else if (PHYSFS_tell(f) != (PHYSFS_sint64) (skip + third))
+        fail(tf, sink, "wrong tell() after send");
+    memcpy(expect + expected, tf->data + skip, (size_t) third);
+    expected += (size_t) third;
+
+    /* ...then back up and send the rest, asking for more than there is. */
+    if (!PHYSFS_seek(f, skip / 2))
+        fail(tf, sink, "seek failed");
+    rc = PHYSFS_sendToFd(f, fd, len + 1000);
+    if (rc != (PHYSFS_sint64) (len - skip / 2))
+        fail(tf, sink, "short send of the rest");
+    else if (!PHYSFS_eof(f))
+        fail(tf, sink, "not at EOF after send");
+    else if (PHYSFS_sendToFd(f, fd, 1) != 0)
+        fail(tf, sink, "sent past EOF");
+    memcpy(expect + expected, tf->data + skip / 2, (size_t) (len - skip / 2));
+    expected += (size_t) (len - skip / 2);
+
+    PHYSFS_close(f);
+    return expected;
+} /* sendPieces */
+
+
+static void checkOutput(const TestFile *tf, const char *sink,
+                        const PHYSFS_uint8 *got, const size_t gotlen,
+                        const PHYSFS_uint8 *expect, const size_t len)
+{
+    if (gotlen != len)
+        fail(tf, sink, "wrong number of bytes came out");
+    else if ((len > 0) && (memcmp(got, expect, len) != 0))
+        fail(tf, sink, "wrong bytes came out");
+} /* checkOutput */
+
+
+static void testStream(const TestFile *tf, const int socket,
+                       const PHYSFS_uint64 bufsize, PHYSFS_uint8 *expect)
+{
+    const char *sink = socket ? "socketpair" : "pipe";
+    Drain d;
+    pthread_t thread;
+    int fds[2];
+    size_t len;
+
+    memset(&d, '\0', sizeof (d));
+    if ((socket ? socketpair(AF_UNIX, SOCK_STREAM, 0, fds) : pipe(fds)) == -1)
+    {
+        fail(tf, sink, "couldn't create it");
+        return;
+    } /* if */
+
+    d.fd = fds[0];
+    pthread_create(&thread, NULL, drainThread, &d);
+    len = sendPieces(tf, sink, fds[1], bufsize, expect);
+    close(fds[1]);
+    pthread_join(thread, NULL);
+    close(fds[0]);
+
+    if (d.discard)
+        fail(tf, sink, "out of memory");
+    else
+        checkOutput(tf, sink, d.data, d.len, expect, len);
+    free(d.data);
+} /* testStream */
+
+
+static void testTempFile(const TestFile *tf, const PHYSFS_uint64 bufsize,
+                         PHYSFS_uint8 *expect, PHYSFS_uint8 *got)
+{
+    FILE *io = tmpfile();
+    size_t len, gotlen;
+
+    if (io == NULL)
+    {
+        fail(tf, "file", "couldn't create it");
+        return;
+    } /* if */
+
+    /* start partway in, so we know it writes at the fd's position. */
+    if (write(fileno(io), "x", 1) != 1)
+        fail(tf, "file", "write failed");
+    len = sendPieces(tf, "file", fileno(io), bufsize, expect);
+    gotlen = (size_t) pread(fileno(io), got, len + 2, 1);
+    checkOutput(tf, "file", got, gotlen, expect, len);
+    fclose(io);
+} /* testTempFile */
+
+
+static void testFiles(void)
+{
+    static const PHYSFS_uint64 bufsizes[] = { 0, 1000 };
+    size_t i, j;
+
+    for (i = 0; i < numFiles; i++)
+    {
+        const TestFile *tf = &files[i];
+        PHYSFS_uint8 *expect = (PHYSFS_uint8 *) malloc((size_t) tf->len * 2 + 2);
+        PHYSFS_uint8 *got = (PHYSFS_uint8 *) malloc((size_t) tf->len * 2 + 2);
+
+        if ((expect == NULL) || (got == NULL))
+            fail(tf, "anything", "out of memory");
+        else
+        {
+            for (j = 0; j < sizeof (bufsizes) / sizeof (bufsizes[0]); j++)
+            {
+                testStream(tf, 0, bufsizes[j], expect);
+                testStream(tf, 1, bufsizes[j], expect);
+                testTempFile(tf, bufsizes[j], expect, got);
+            } /* for */
+        } /* else */
+
+        free(expect);
+        free(got);
+    } /* for */
+} /* testFiles */
+
+
+static double cpuSeconds(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ((double) ru.ru_utime.tv_sec) + (ru.ru_utime.tv_usec / 1000000.0) +
+           ((double) ru.ru_stime.tv_sec) + (ru.ru_stime.tv_usec / 1000000.0);
+} /* cpuSeconds */
+
+
+/* send every file over one socketpair, and time it. The drain counts too. */
+static void benchmark(const char *archive, const int useSend)
+{
+    PHYSFS_uint8 *buf = (PHYSFS_uint8 *) malloc(COPY_BUFSIZE);
+    PHYSFS_uint64 total = 0;
+    pthread_t thread;
+    Drain d;
+    double start;
+    int fds[2];
+    size_t i;
+
+    memset(&d, '\0', sizeof (d));
+    d.discard = 1;
+    if ((buf == NULL) || (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1))
+    {
+        free(buf);
+        return;
+    } /* if */
+
+    d.fd = fds[0];
+    start = cpuSeconds();
+    pthread_create(&thread, NULL, drainThread, &d);
+
+    for (i = 0; i < numFiles; i++)
+    {
+        PHYSFS_File *f = PHYSFS_openRead(files[i].path);
+        if (f == NULL)
+            continue;
+
+        if (useSend)
+        {
+            const PHYSFS_sint64 rc = PHYSFS_sendToFd(f, fds[1], files[i].len);
+            if (rc > 0)
+                total += (PHYSFS_uint64) rc;
+        } /* if */
+        else
+        {
+            PHYSFS_sint64 br;
+            while ((br = PHYSFS_readBytes(f, buf, COPY_BUFSIZE)) > 0)
+            {
+                if (write(fds[1], buf, (size_t) br) != (ssize_t) br)
+                    break;
+                total += (PHYSFS_uint64) br;
+            } /* while */
+        } /* else */
+
+        PHYSFS_close(f);
+    } /* for */
+
+    close(fds[1]);
+    pthread_join(thread, NULL);
+    close(fds[0]);
+    free(buf);
+
+    if (d.len != total)
+    {
+        fprintf(stderr, "FAIL: %s: sent %llu bytes, %llu came out\n", archive,
+                (unsigned long long) total, (unsigned long long) d.len);
+        failures++;
+    } /* if */
+
+    if (total > 0)
+    {
+        const double secs = cpuSeconds() - start;
+        printf("%s,%s,%llu,%.3f\n", archive, useSend ? "sendToFd" : "readBytes",
+               (unsigned long long) total, secs / (total / 1073741824.0));
+        fprintf(stderr, "%s: %s: %.3f cpu sec/GB\n", archive,
+                useSend ? "PHYSFS_sendToFd" : "readBytes+write",
+                secs / (total / 1073741824.0));
+    } /* if */
+} /* benchmark */
+
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "USAGE: %s <archive> [archive...]\n", argv[0]);
+        return 1;
+    } /* if */
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init failed: %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    printf("archive,method,bytes,cpu_sec_per_gb\n");
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!PHYSFS_mount(argv[i], NULL, 0))
+        {
+            fprintf(stderr, "FAIL: couldn't mount %s: %s\n", argv[i],
+                    PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            failures++;
+            continue;
+        } /* if */
+
+        PHYSFS_enumerate("", findFiles, NULL);
+        fprintf(stderr, "%s: %u files\n", argv[i], (unsigned int) numFiles);
+        testFiles();
+        benchmark(argv[i], 0);
+        benchmark(argv[i], 1);
+        freeFiles();
+        PHYSFS_unmount(argv[i]);
+    } /* for */
+
+    PHYSFS_deinit();
+
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of sendfd_physfs.c ... */
@@ -0,0 +1,465 @@
+/*
+ * PhysicsFS PHYSFS_getIoStats() and PHYSFS_getLockProfile() test.
+ *
+ * Builds a small ZIP archive in memory, with one stored and one deflated
+ *  file, mounts it, and reads and seeks through both. After each step the
+ *  archive's counters, and the library's, must have moved by exactly what
+ *  the step did: one open per open, the bytes handed back by reads, the
+ *  bytes read from the archive for the stored file and decoded for the
+ *  deflated one, and one re-decode for each backwards seek in the deflated
+ *  file, but not for forward seeks or seeks in the stored one. Archives
+ *  that aren't mounted, and bad arguments, must fail.
+ *
+ * Then it clears the lock profiles and remounts the archive, opens a file
+ *  and closes it, and checks that each of those grew its own site's
+ *  profile, and that every profile adds up. Sites that don't exist must
+ *  fail.
+ *
+ * Reports, as CSV on stdout (step,opens,bytesRead,bytesReadPhysical,
+ *  bytesDecompressed,seekReinflates), the archive's counters after each
+ *  step. The exit status is non-zero if anything went wrong.
+ */
+
+#define PHYSFS_SUPPORTS_STATS 1
+#define PHYSFS_SUPPORTS_LOCK_PROFILE 1
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARCHIVE_NAME "stats.zip"
+#define FILE_SIZE 5000
+
+typedef struct ZipBuilder
+{
+    PHYSFS_uint8 data[32 * 1024];
+    PHYSFS_uint8 central[1024];
+    size_t len;
+    size_t centralLen;
+    PHYSFS_uint32 count;
+} ZipBuilder;
+
+static ZipBuilder zip;
+static PHYSFS_uint8 fileData[FILE_SIZE];
+static PHYSFS_IoStats lastArchive;
+static PHYSFS_IoStats lastGlobal;
+static int failures = 0;
+
+
+static void check(const int ok, const char *step, const char *what)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "%s: %s\n", step, what);
+        failures++;
+    } /* if */
+} /* check */
+
+
+static const char *lastError(void)
+{
+    return PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
+} /* lastError */
+
+
+static PHYSFS_uint32 crc32Of(const PHYSFS_uint8 *buf, size_t len)
+{
+    PHYSFS_uint32 crc = 0xFFFFFFFF;
+    while (len--)
+    {
+        int i;
+        crc ^= *(buf++);
+        for (i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    } /* while */
+    return ~crc;
+} /* crc32Of */
+
+
+static void put16(PHYSFS_uint8 *buf, size_t *len, const PHYSFS_uint32 val)
+{
+    buf[(*len)++] = (PHYSFS_uint8) (val & 0xFF);
+    buf[(*len)++] = (PHYSFS_uint8) ((val >> 8) & 0xFF);
+} /* put16 */
+
+
+static void put32(PHYSFS_uint8 *buf, size_t *len, const PHYSFS_uint32 val)
+{
+    put16(buf, len, val & 0xFFFF);
+    put16(buf, len, (val >> 16) & 0xFFFF);
+} /* put32 */
+
+
+static void putBytes(PHYSFS_uint8 *buf, size_t *len, const void *data,
+                     const size_t datalen)
+{
+    memcpy(buf + *len, data, datalen);
+    *len += datalen;
+} /* putBytes */
+
+
+/*
+ * Add a file. A deflated one is a single stored deflate block, which any
+ *  inflater has to decode like the rest, so we don't need a compressor.
+ */
+static void zipAdd(const char *name, const PHYSFS_uint8 *data,
+                   const size_t len, const int deflate)
+{
+    const PHYSFS_uint32 crc = crc32Of(data, len);
+    const PHYSFS_uint32 stored = (PHYSFS_uint32) (deflate ? len + 5 : len);
+    const PHYSFS_uint32 offset = (PHYSFS_uint32) zip.len;
+    const size_t namelen = strlen(name);
+
+    put32(zip.data, &zip.len, 0x04034B50);  /* local file header. */
+    put16(zip.data, &zip.len, 20);
+    put16(zip.data, &zip.len, 0);  /* general purpose bits. */
+    put16(zip.data, &zip.len, deflate ? 8 : 0);
+    put32(zip.data, &zip.len, 0x50216000);  /* 2020-01-01 12:00:00. */
+    put32(zip.data, &zip.len, crc);
+    put32(zip.data, &zip.len, stored);
+    put32(zip.data, &zip.len, (PHYSFS_uint32) len);
+    put16(zip.data, &zip.len, (PHYSFS_uint32) namelen);
+    put16(zip.data, &zip.len, 0);
+    putBytes(zip.data, &zip.len, name, namelen);
+    if (deflate)
+    {
+        zip.data[zip.len++] = 1;  /* final block, stored. */
+        put16(zip.data, &zip.len, (PHYSFS_uint32) len);
+        put16(zip.data, &zip.len, (PHYSFS_uint32) ~len);
+    } /* if */
+    putBytes(zip.data, &zip.len, data, len);
+
+    put32(zip.central, &zip.centralLen, 0x02014B50);
+    put16(zip.central, &zip.centralLen, (3 << 8) | 20);  /* made on Unix. */
+    put16(zip.central, &zip.centralLen, 20);
+    put16(zip.central, &zip.centralLen, 0);
+    put16(zip.central, &zip.centralLen, deflate ? 8 : 0);
+    put32(zip.central, &zip.centralLen, 0x50216000);
+    put32(zip.central, &zip.centralLen, crc);
+    put32(zip.central, &zip.centralLen, stored);
+    put32(zip.central, &zip.centralLen, (PHYSFS_uint32) len);
+    put16(zip.central, &zip.centralLen, (PHYSFS_uint32) namelen);
+    put16(zip.central, &zip.centralLen, 0);
+    put16(zip.central, &zip.centralLen, 0);  /* comment. */
+    put16(zip.central, &zip.centralLen, 0);  /* disk. */
+    put16(zip.central, &zip.centralLen, 0);  /* internal attributes. */
+    put32(zip.central, &zip.centralLen, 0100644 << 16);
+    put32(zip.central, &zip.centralLen, offset);
+    putBytes(zip.central, &zip.centralLen, name, namelen);
+
+    zip.count++;
+} /* zipAdd */
+
+
+static void zipFinish(void)
+{
+    const PHYSFS_uint32 centralOfs = (PHYSFS_uint32) zip.len;
+    putBytes(zip.data, &zip.len, zip.central, zip.centralLen);
+    put32(zip.data, &zip.len, 0x06054B50);  /* end of central dir. */
+    put16(zip.data, &zip.len, 0);
+    put16(zip.data, &zip.len, 0);
+    put16(zip.data, &zip.len, zip.count);
+    put16(zip.data, &zip.len, zip.count);
+    put32(zip.data, &zip.len, (PHYSFS_uint32) zip.centralLen);
+    put32(zip.data, &zip.len, centralOfs);
+    put16(zip.data, &zip.len, 0);  /* comment. */
+} /* zipFinish */
+
+
+static void checkDelta(const char *step, const char *field,
+                       const PHYSFS_uint64 archiveDelta,
+                       const PHYSFS_uint64 globalDelta,
+                       const PHYSFS_sint64 expected)
+{
+    char what[128];
+    if (expected < 0)
+        return;  /* depends on the inflater's buffering, don't care. */
+
+    snprintf(what, sizeof (what), "archive's %s moved by %llu, not %lld",
+             field, (unsigned long long) archiveDelta, (long long) expected);
+    check(archiveDelta == (PHYSFS_uint64) expected, step, what);
+    snprintf(what, sizeof (what), "global %s moved by %llu, not %lld",
+             field, (unsigned long long) globalDelta, (long long) expected);
+    check(globalDelta == (PHYSFS_uint64) expected, step, what);
+} /* checkDelta */
+
+
+/*
+ * Check that the archive's counters, and the library's, moved by exactly
+ *  the given amounts since the last step. -1 means don't care.
+ */
+static void checkStep(const char *step, const PHYSFS_sint64 opens,
+                      const PHYSFS_sint64 bytesRead,
+                      const PHYSFS_sint64 physical,
+                      const PHYSFS_sint64 decompressed,
+                      const PHYSFS_sint64 reinflates)
+{
+    const PHYSFS_IoStats *la = &lastArchive;
+    const PHYSFS_IoStats *lg = &lastGlobal;
+    PHYSFS_IoStats a, g;
+
+    if (!PHYSFS_getIoStats(ARCHIVE_NAME, &a) || !PHYSFS_getIoStats(NULL, &g))
+    {
+        check(0, step, lastError());
+        return;
+    } /* if */
+
+    checkDelta(step, "opens", a.opens - la->opens, g.opens - lg->opens, opens);
+    checkDelta(step, "bytesRead", a.bytesRead - la->bytesRead,
+               g.bytesRead - lg->bytesRead, bytesRead);
+    checkDelta(step, "bytesReadPhysical",
+               a.bytesReadPhysical - la->bytesReadPhysical,
+               g.bytesReadPhysical - lg->bytesReadPhysical, physical);
+    checkDelta(step, "bytesDecompressed",
+               a.bytesDecompressed - la->bytesDecompressed,
+               g.bytesDecompressed - lg->bytesDecompressed, decompressed);
+    checkDelta(step, "seekReinflates", a.seekReinflates - la->seekReinflates,
+               g.seekReinflates - lg->seekReinflates, reinflates);
+    check(a.lockAcquisitions == 0, step, "an archive has lock counters");
+
+    printf("%s,%llu,%llu,%llu,%llu,%llu\n", step,
+           (unsigned long long) a.opens, (unsigned long long) a.bytesRead,
+           (unsigned long long) a.bytesReadPhysical,
+           (unsigned long long) a.bytesDecompressed,
+           (unsigned long long) a.seekReinflates);
+
+    lastArchive = a;
+    lastGlobal = g;
+} /* checkStep */
+
+
+static void readOrFail(const char *step, PHYSFS_File *f,
+                       const PHYSFS_uint64 pos, const PHYSFS_uint64 len)
+{
+    static PHYSFS_uint8 buf[FILE_SIZE];
+    const PHYSFS_sint64 br = PHYSFS_readBytes(f, buf, len);
+    check((br == (PHYSFS_sint64) len) && !memcmp(buf, fileData + pos, len),
+          step, "read the wrong data");
+} /* readOrFail */
+
+
+static void testStored(void)
+{
+    PHYSFS_File *f = PHYSFS_openRead("stored.bin");
+    PHYSFS_uint8 byte;
+
+    if (f == NULL)
+    {
+        check(0, "open stored", lastError());
+        return;
+    } /* if */
+    checkStep("open stored", 1, 0, -1, 0, 0);  /* it may read its header. */
+
+    readOrFail("read stored", f, 0, 1000);
+    checkStep("read stored", 0, 1000, 1000, 0, 0);
+
+    check(PHYSFS_seek(f, 4000), "seek stored", lastError());
+    readOrFail("seek and read stored", f, 4000, 1000);
+    checkStep("seek and read stored", 0, 1000, 1000, 0, 0);
+
+    check(PHYSFS_seek(f, 500), "seek back stored", lastError());
+    readOrFail("seek back and read stored", f, 500, 10);
+    checkStep("seek back and read stored", 0, 10, 10, 0, 0);
+
+    check(PHYSFS_seek(f, FILE_SIZE), "seek to end of stored", lastError());
+    check(PHYSFS_readBytes(f, &byte, 1) == 0, "read stored at EOF",
+          "read something at EOF");
+    checkStep("read stored at EOF", 0, 0, 0, 0, 0);
+
+    PHYSFS_close(f);
+} /* testStored */
+
+
+static void testDeflated(void)
+{
+    PHYSFS_File *f = PHYSFS_openRead("deflated.bin");
+
+    if (f == NULL)
+    {
+        check(0, "open deflated", lastError());
+        return;
+    } /* if */
+    checkStep("open deflated", 1, 0, -1, 0, 0);
+
+    readOrFail("read deflated", f, 0, 3000);
+    checkStep("read deflated", 0, 3000, -1, 3000, 0);
+
+    /* going back decodes from the start again, up to where we're going. */
+    check(PHYSFS_seek(f, 1000), "seek back deflated", lastError());
+    checkStep("seek back deflated", 0, 0, -1, 1000, 1);
+
+    readOrFail("read deflated again", f, 1000, 500);
+    checkStep("read deflated again", 0, 500, -1, 500, 0);
+
+    /* going forward just decodes what's skipped. */
+    check(PHYSFS_seek(f, 4000), "seek forward deflated", lastError());
+    checkStep("seek forward deflated", 0, 0, -1, 2500, 0);
+
+    readOrFail("read deflated to the end", f, 4000, 1000);
+    checkStep("read deflated to the end", 0, 1000, -1, 1000, 0);
+
+    PHYSFS_close(f);
+} /* testDeflated */
+
+
+static void testFailures(void)
+{
+    PHYSFS_IoStats stats;
+
+    check(!PHYSFS_getIoStats("nothere.zip", &stats), "unknown archive",
+          "got stats for an archive that isn't mounted");
+    check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_NOT_MOUNTED,
+          "unknown archive", "wrong error");
+
+    check(!PHYSFS_getIoStats("stats", &stats), "partial name",
+          "got stats for part of an archive's name");
+    check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_NOT_MOUNTED,
+          "partial name", "wrong error");
+
+    check(!PHYSFS_getIoStats(ARCHIVE_NAME, NULL), "no struct",
+          "got stats without a place to put them");
+    check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_INVALID_ARGUMENT,
+          "no struct", "wrong error");
+} /* testFailures */
+
+
+static int getProfile(const char *step, const PHYSFS_LockSite site,
+                      PHYSFS_LockProfile *profile)
+{
+    PHYSFS_uint64 total = 0;
+    int i;
+
+    if (!PHYSFS_getLockProfile(site, profile))
+    {
+        check(0, step, lastError());
+        memset(profile, '\0', sizeof (*profile));
+        return 0;
+    } /* if */
+
+    for (i = 0; i < PHYSFS_LOCK_HISTOGRAM_BUCKETS; i++)
+        total += profile->waitHistogram[i];
+    check(total == profile->acquisitions, step, "histogram doesn't add up");
+    check(profile->contentions <= profile->acquisitions, step,
+          "more contentions than acquisitions");
+    check(profile->longestWaitNanoseconds <= profile->waitNanoseconds, step,
+          "longest wait is longer than all of them");
+    check(profile->longestHoldNanoseconds <= profile->holdNanoseconds, step,
+          "longest hold is longer than all of them");
+    return 1;
+} /* getProfile */
+
+
+/* (site)'s profile has to have grown since (before), and now is (before). */
+static void checkGrew(const char *step, const PHYSFS_LockSite site,
+                      PHYSFS_LockProfile *before)
+{
+    PHYSFS_LockProfile now;
+    if (getProfile(step, site, &now))
+    {
+        check(now.acquisitions > before->acquisitions, step,
+              "the lock profile didn't grow");
+        *before = now;
+    } /* if */
+} /* checkGrew */
+
+
+static void testLockProfiles(void)
+{
+    const PHYSFS_LockSite past = (PHYSFS_LockSite) (PHYSFS_LOCKSITE_ERRORSTATE + 1);
+    PHYSFS_LockProfile mount, open, close;
+    PHYSFS_File *f;
+
+    check(PHYSFS_resetLockProfiles(), "reset profiles", lastError());
+    if (getProfile("reset profiles", PHYSFS_LOCKSITE_MOUNT, &mount))
+        check(mount.acquisitions == 0, "reset profiles", "not cleared");
+    getProfile("reset profiles", PHYSFS_LOCKSITE_OPEN, &open);
+    getProfile("reset profiles", PHYSFS_LOCKSITE_CLOSE, &close);
+
+    check(PHYSFS_unmount(ARCHIVE_NAME), "remount", lastError());
+    check(PHYSFS_mountMemory(zip.data, zip.len, NULL, ARCHIVE_NAME, NULL, 1),
+          "remount", lastError());
+    checkGrew("remount", PHYSFS_LOCKSITE_MOUNT, &mount);
+
+    f = PHYSFS_openRead("stored.bin");
+    check(f != NULL, "open for profile", lastError());
+    checkGrew("open for profile", PHYSFS_LOCKSITE_OPEN, &open);
+
+    if (f != NULL)
+    {
+        check(PHYSFS_close(f), "close for profile", lastError());
+        checkGrew("close for profile", PHYSFS_LOCKSITE_CLOSE, &close);
+    } /* if */
+
+    check(!PHYSFS_getLockProfile(past, &mount), "bad site",
+          "got a profile for a site that doesn't exist");
+    check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_INVALID_ARGUMENT,
+          "bad site", "wrong error");
+    check(!PHYSFS_getLockProfile((PHYSFS_LockSite) -1, &mount),
+          "negative site", "got a profile for a site that doesn't exist");
+    check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_INVALID_ARGUMENT,
+          "negative site", "wrong error");
+    check(!PHYSFS_getLockProfile(PHYSFS_LOCKSITE_MOUNT, NULL), "no struct",
+          "got a profile without a place to put it");
+    check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_INVALID_ARGUMENT,
+          "no struct", "wrong error");
+} /* testLockProfiles */
+
+
+int main(int argc, char **argv)
+{
+    size_t i;
+
+    if (argc != 1)
+    {
+        fprintf(stderr, "USAGE: %s\n", argv[0]);
+        return 1;
+    } /* if */
+
+    for (i = 0; i < sizeof (fileData); i++)
+        fileData[i] = (PHYSFS_uint8) ((i * 31) ^ (i >> 8));
+    zipAdd("stored.bin", fileData, sizeof (fileData), 0);
+    zipAdd("deflated.bin", fileData, sizeof (fileData), 1);
+    zipFinish();
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init() failed: %s\n", lastError());
+        return 1;
+    } /* if */
+
+    printf("step,opens,bytesRead,bytesReadPhysical,bytesDecompressed,seekReinflates\n");
+
+    if (!PHYSFS_mountMemory(zip.data, zip.len, NULL, ARCHIVE_NAME, NULL, 1))
+        check(0, "mount", lastError());
+    else
+    {
+        memset(&lastArchive, '\0', sizeof (lastArchive));
+        check(PHYSFS_getIoStats(NULL, &lastGlobal), "mount", lastError());
+        checkStep("mount", 0, 0, -1, 0, 0);  /* new archives start at zero. */
+
+        testStored();
+        testDeflated();
+        testFailures();
+        testLockProfiles();
+
+        check(PHYSFS_unmount(ARCHIVE_NAME), "unmount", lastError());
+        check(!PHYSFS_getIoStats(ARCHIVE_NAME, &lastArchive), "unmount",
+              "still have stats for an unmounted archive");
+        check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_NOT_MOUNTED,
+              "unmount", "wrong error");
+    } /* else */
+
+    if (!PHYSFS_deinit())
+    {
+        fprintf(stderr, "PHYSFS_deinit() failed: %s\n", lastError());
+        failures++;
+    } /* if */
+
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of stats_physfs.c ... */
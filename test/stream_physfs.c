@@ -0,0 +1,245 @@
+/*
+ * PhysicsFS PHYSFS_setStreaming() test.
+ *
+ * Opens one file from an archive twice, streams one handle with
+ *  PHYSFS_setStreaming() and leaves the other alone, then does the same
+ *  random reads and seeks (small ones inside a chunk, big ones, past the
+ *  end) on both and checks they always agree, for a few buffer sizes. It
+ *  also turns streaming on and off partway through.
+ *
+ * Then it reads the file front to back in 64K pieces, pretending to work on
+ *  each piece for a while (-w microseconds, default 200), with and without
+ *  streaming, starting from a cold OS cache each time, and reports the wall
+ *  clock time as CSV on stdout (method,bytes,seconds).
+ *
+ * The exit status is non-zero if the two handles ever disagreed.
+ *
+ * This needs POSIX threads and posix_fadvise().
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define MAX_READ (3 * 1024 * 1024)
+#define WORK_PIECE (64 * 1024)
+#define STREAM_BUFSIZE (4 * 1024 * 1024)
+#define OPS_PER_SIZE 500
+
+static int failures = 0;
+static PHYSFS_uint32 rng = 12345;
+
+
+static PHYSFS_uint32 nextRandom(PHYSFS_uint32 max)
+{
+    rng = (rng * 1103515245) + 12345;
+    return ((rng >> 8) % max);
+} /* nextRandom */
+
+
+static double nowSeconds(void)
+{
+    return ((double) __PHYSFS_platformGetTicks()) / 1000000000.0;
+} /* nowSeconds */
+
+
+static void fail(const char *what, const PHYSFS_uint64 size, const int op)
+{
+    fprintf(stderr, "bufsize %llu, op %d: %s\n", (unsigned long long) size,
+            op, what);
+    failures++;
+} /* fail */
+
+
+static void compareHandles(const char *fname, const PHYSFS_uint64 bufsize,
+                           PHYSFS_uint8 *buf1, PHYSFS_uint8 *buf2)
+{
+    PHYSFS_File *plain = PHYSFS_openRead(fname);
+    PHYSFS_File *streamed = PHYSFS_openRead(fname);
+    PHYSFS_sint64 len;
+    int op;
+
+    if (!plain || !streamed || !PHYSFS_setStreaming(streamed, bufsize))
+    {
+        fprintf(stderr, "couldn't open and stream %s: %s\n", fname,
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        failures++;
+        goto done;
+    } /* if */
+
+    len = PHYSFS_fileLength(plain);
+    if (PHYSFS_fileLength(streamed) != len)
+        fail("lengths differ", bufsize, -1);
+
+    for (op = 0; (op < OPS_PER_SIZE) && (failures == 0); op++)
+    {
+        const PHYSFS_uint32 what = nextRandom(100);
+        const PHYSFS_sint64 pos = PHYSFS_tell(plain);
+
+        if (what < 70)  /* read, mostly sequentially, of any size. */
+        {
+            const PHYSFS_uint32 amount = (what < 10) ? nextRandom(16) :
+                nextRandom((PHYSFS_uint32) ((bufsize * 2) < MAX_READ ? (bufsize * 2) + 1 : MAX_READ));
+            const PHYSFS_sint64 br1 = PHYSFS_readBytes(plain, buf1, amount);
+            const PHYSFS_sint64 br2 = PHYSFS_readBytes(streamed, buf2, amount);
+            if (br1 != br2)
+                fail("read returned different lengths", bufsize, op);
+            else if ((br1 > 0) && (memcmp(buf1, buf2, (size_t) br1) != 0))
+                fail("read different bytes", bufsize, op);
+        } /* if */
+
+        else if (what < 95)  /* seek: nearby, anywhere, or past the end. */
+        {
+            PHYSFS_sint64 target;
+            int rc1, rc2;
+
+            if (what < 85)
+                target = pos + ((PHYSFS_sint64) nextRandom(20000)) - 10000;
+            else if (what < 94)
+                target = (PHYSFS_sint64) nextRandom((PHYSFS_uint32) (len + 1));
+            else
+                target = len + 1 + nextRandom(10);
+
+            if (target < 0)
+                target = 0;
+            rc1 = PHYSFS_seek(plain, (PHYSFS_uint64) target);
+            rc2 = PHYSFS_seek(streamed, (PHYSFS_uint64) target);
+            if ((rc1 != 0) != (rc2 != 0))
+                fail("seek results differ", bufsize, op);
+        } /* else if */
+
+        else if (what < 98)  /* stop streaming... */
+        {
+            if (!PHYSFS_setStreaming(streamed, 0))
+                fail("couldn't stop streaming", bufsize, op);
+        } /* else if */
+
+        else  /* ...and start again. */
+        {
+            if (!PHYSFS_setStreaming(streamed, bufsize))
+                fail("couldn't start streaming", bufsize, op);
+        } /* else */
+
+        if (PHYSFS_tell(plain) != PHYSFS_tell(streamed))
+            fail("tell differs", bufsize, op);
+        if (PHYSFS_eof(plain) != PHYSFS_eof(streamed))
+            fail("eof differs", bufsize, op);
+    } /* for */
+
+done:
+    if (plain)
+        PHYSFS_close(plain);
+    if (streamed)
+        PHYSFS_close(streamed);
+} /* compareHandles */
+
+
+static void dropArchiveCache(const char *archive)
+{
+    const int fd = open(archive, O_RDONLY);
+    if (fd != -1)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    } /* if */
+} /* dropArchiveCache */
+
+
+static void pretendToWork(const int usecs)
+{
+    const double until = nowSeconds() + (usecs / 1000000.0);
+    while (nowSeconds() < until) { /* spin */ }
+} /* pretendToWork */
+
+
+static void timeSequential(const char *archive, const char *fname,
+                           const int streaming, const int usecs,
+                           PHYSFS_uint8 *buf)
+{
+    PHYSFS_File *f;
+    PHYSFS_uint64 total = 0;
+    PHYSFS_sint64 br;
+    double start;
+
+    dropArchiveCache(archive);
+    start = nowSeconds();
+    f = PHYSFS_openRead(fname);
+    if (!f || (streaming && !PHYSFS_setStreaming(f, STREAM_BUFSIZE)))
+    {
+        fprintf(stderr, "couldn't open and stream %s: %s\n", fname,
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        failures++;
+        if (f)
+            PHYSFS_close(f);
+        return;
+    } /* if */
+
+    while ((br = PHYSFS_readBytes(f, buf, WORK_PIECE)) > 0)
+    {
+        total += (PHYSFS_uint64) br;
+        pretendToWork(usecs);
+    } /* while */
+
+    PHYSFS_close(f);
+    printf("%s,%llu,%.3f\n", streaming ? "streaming" : "plain",
+           (unsigned long long) total, nowSeconds() - start);
+} /* timeSequential */
+
+
+int main(int argc, char **argv)
+{
+    static const PHYSFS_uint64 sizes[] = { 4, 4097, 256 * 1024, STREAM_BUFSIZE };
+    PHYSFS_uint8 *buf1 = NULL;
+    PHYSFS_uint8 *buf2 = NULL;
+    int usecs = 200;
+    int argi = 1;
+    size_t i;
+
+    if ((argc > 2) && (strcmp(argv[1], "-w") == 0))
+    {
+        usecs = atoi(argv[2]);
+        argi += 2;
+    } /* if */
+
+    if (argc - argi != 2)
+    {
+        fprintf(stderr, "USAGE: %s [-w usecs] <archive> <file>\n", argv[0]);
+        return 1;
+    } /* if */
+
+    if (!PHYSFS_init(argv[0]) || !PHYSFS_mount(argv[argi], NULL, 0))
+    {
+        fprintf(stderr, "couldn't mount %s: %s\n", argv[argi],
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    buf1 = (PHYSFS_uint8 *) malloc(MAX_READ);
+    buf2 = (PHYSFS_uint8 *) malloc(MAX_READ);
+    if (!buf1 || !buf2)
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    } /* if */
+
+    for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+        compareHandles(argv[argi + 1], sizes[i], buf1, buf2);
+
+    printf("method,bytes,seconds\n");
+    timeSequential(argv[argi], argv[argi + 1], 0, usecs, buf1);
+    timeSequential(argv[argi], argv[argi + 1], 1, usecs, buf1);
+
+    free(buf1);
+    free(buf2);
+    PHYSFS_deinit();
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of stream_physfs.c ... */
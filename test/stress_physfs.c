@@ -0,0 +1,531 @@
+/*
+ * PhysicsFS multithreaded read stress test.
+ *
+ * Mounts an archive, gives every thread its own PHYSFS_File for each of a
+ *  handful of the archive's files, and has all of them read their handles
+ *  at once, checking every byte against a copy loaded up front. It runs
+ *  with 1, 2, 4... threads up to the limit and reports the throughput of
+ *  each and how close it came to scaling linearly.
+ *
+ * Distinct handles share no mutable state on the read path, so the only
+ *  limits should be CPU cores and the disk. With -c another thread stats,
+ *  opens, reads and closes files in the same archive the whole time, which
+ *  shakes out anything that does share state (try it under -fsanitize=thread).
+ *
+ * Results go to stdout as CSV (threads,value,unit,speedup,efficiency),
+ *  progress and a readable copy go to stderr. The exit status is non-zero
+ *  if any read returned the wrong data, or if -e was given and the scaling
+ *  efficiency at the most threads fell short of it.
+ *
+ * This needs POSIX threads and clocks.
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define MAX_FILES 16
+#define MAX_FILE_SIZE (32 * 1024 * 1024)
+#define MAX_THREADS 64
+
+typedef struct TestFile
+{
+    char *path;
+    PHYSFS_uint8 *data;  /* the whole file, read before the test. */
+    PHYSFS_uint64 len;
+} TestFile;
+
+typedef struct Worker
+{
+    PHYSFS_File *handles[MAX_FILES];
+    PHYSFS_uint64 pos[MAX_FILES];  /* where we think each handle is. */
+    PHYSFS_uint8 *buf;
+    PHYSFS_uint32 random;
+    PHYSFS_uint64 bytes;
+    int index;
+    int failed;
+} Worker;
+
+static TestFile files[MAX_FILES];
+static int numFiles = 0;
+static Worker workers[MAX_THREADS];
+static double testSeconds = 1.0;
+static size_t readSize = 16 * 1024;
+static int stopWorkers = 0;
+static int stopChurn = 0;
+static PHYSFS_uint64 churnOps = 0;
+static int churnFailed = 0;
+
+
+/* the stop flags are the only thing the threads share; keep tsan quiet. */
+#define getFlag(flag) __atomic_load_n(&(flag), __ATOMIC_RELAXED)
+#define setFlag(flag, val) __atomic_store_n(&(flag), (val), __ATOMIC_RELAXED)
+
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1000000000.0);
+} /* now */
+
+static PHYSFS_uint32 nextRandom(PHYSFS_uint32 *state)
+{
+    /* xorshift32, good enough to pick files and offsets. */
+    PHYSFS_uint32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+} /* nextRandom */
+
+static const char *lastError(void)
+{
+    return PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
+} /* lastError */
+
+
+/* keep the biggest files that fit, so reads aren't all open overhead. */
+static void considerFile(const char *path, const PHYSFS_uint64 len)
+{
+    int smallest = 0;
+    int i;
+
+    if ((len == 0) || (len > MAX_FILE_SIZE))
+        return;
+
+    if (numFiles == MAX_FILES)
+    {
+        for (i = 1; i < numFiles; i++)
+        {
+            if (files[i].len < files[smallest].len)
+                smallest = i;
+        } /* for */
+
+        if (files[smallest].len >= len)
+            return;
+        free(files[smallest].path);
+        i = smallest;
+    } /* if */
+    else
+    {
+        i = numFiles++;
+    } /* else */
+
+    files[i].path = strdup(path);
+    files[i].len = len;
+    if (files[i].path == NULL)
+        files[i] = files[--numFiles];
+} /* considerFile */
+
+static PHYSFS_EnumerateCallbackResult findFiles(void *data, const char *dir,
+                                                const char *fname)
+{
+    char path[1024];
+    PHYSFS_Stat statbuf;
+
+    if (snprintf(path, sizeof (path), "%s%s%s", dir, *dir ? "/" : "",
+                 fname) >= (int) sizeof (path))
+        return PHYSFS_ENUM_OK;  /* skip it. */
+    else if (!PHYSFS_stat(path, &statbuf))
+        return PHYSFS_ENUM_OK;
+    else if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
+        return PHYSFS_enumerate(path, findFiles, data) ? PHYSFS_ENUM_OK : PHYSFS_ENUM_ERROR;
+    else if (statbuf.filetype == PHYSFS_FILETYPE_REGULAR)
+        considerFile(path, (PHYSFS_uint64) statbuf.filesize);
+
+    return PHYSFS_ENUM_OK;
+} /* findFiles */
+
+static int loadFile(TestFile *f)
+{
+    PHYSFS_File *io = PHYSFS_openRead(f->path);
+    PHYSFS_sint64 len;
+    int ok;
+
+    if (io == NULL)
+    {
+        fprintf(stderr, "couldn't open %s: %s\n", f->path, lastError());
+        return 0;
+    } /* if */
+
+    len = PHYSFS_fileLength(io);
+    ok = (len > 0) && (len <= MAX_FILE_SIZE);
+    if (ok)
+    {
+        f->len = (PHYSFS_uint64) len;
+        f->data = (PHYSFS_uint8 *) malloc((size_t) f->len);
+        ok = (f->data != NULL) &&
+             (PHYSFS_readBytes(io, f->data, f->len) == len);
+    } /* if */
+
+    if (!ok)
+        fprintf(stderr, "couldn't read %s: %s\n", f->path, lastError());
+    PHYSFS_close(io);
+    return ok;
+} /* loadFile */
+
+
+/* reads the next chunk of one of our handles and checks it. */
+static int readOne(Worker *w)
+{
+    const int i = (int) (nextRandom(&w->random) % numFiles);
+    const TestFile *f = &files[i];
+    PHYSFS_File *h = w->handles[i];
+    PHYSFS_uint64 len = readSize;
+    PHYSFS_sint64 br;
+
+    /* now and then jump somewhere else, mostly stream along. */
+    if ((w->pos[i] == f->len) || ((nextRandom(&w->random) & 15) == 0))
+    {
+        const PHYSFS_uint64 pos = nextRandom(&w->random) % f->len;
+        if (!PHYSFS_seek(h, pos))
+        {
+            fprintf(stderr, "thread %d: seek %s to %llu failed: %s\n",
+                    w->index, f->path, (unsigned long long) pos, lastError());
+            return 0;
+        } /* if */
+        w->pos[i] = pos;
+    } /* if */
+
+    if (len > f->len - w->pos[i])
+        len = f->len - w->pos[i];
+
+    br = PHYSFS_readBytes(h, w->buf, len);
+    if (br != (PHYSFS_sint64) len)
+    {
+        fprintf(stderr, "thread %d: read %s at %llu got %lld of %llu: %s\n",
+                w->index, f->path, (unsigned long long) w->pos[i],
+                (long long) br, (unsigned long long) len, lastError());
+        return 0;
+    } /* if */
+    else if (memcmp(w->buf, f->data + w->pos[i], (size_t) len) != 0)
+    {
+        fprintf(stderr, "thread %d: read %s at %llu returned the wrong data\n",
+                w->index, f->path, (unsigned long long) w->pos[i]);
+        return 0;
+    } /* else if */
+
+    w->pos[i] += len;
+    if (PHYSFS_tell(h) != (PHYSFS_sint64) w->pos[i])
+    {
+        fprintf(stderr, "thread %d: tell %s is %lld, expected %llu\n",
+                w->index, f->path, (long long) PHYSFS_tell(h),
+                (unsigned long long) w->pos[i]);
+        return 0;
+    } /* if */
+
+    w->bytes += len;
+    return 1;
+} /* readOne */
+
+static void *workerMain(void *data)
+{
+    Worker *w = (Worker *) data;
+    while (!getFlag(stopWorkers))
+    {
+        if (!readOne(w))
+        {
+            w->failed = 1;
+            break;
+        } /* if */
+    } /* while */
+    return NULL;
+} /* workerMain */
+
+
+/* takes stateLock over and over, and moves things around in the archive. */
+static void *churnMain(void *data)
+{
+    PHYSFS_uint32 random = 0xC0FFEE;
+    PHYSFS_uint8 buf[512];
+
+    (void) data;
+    while (!getFlag(stopChurn))
+    {
+        const TestFile *f = &files[nextRandom(&random) % numFiles];
+        PHYSFS_Stat statbuf;
+        PHYSFS_File *io;
+
+        PHYSFS_exists("this/file/does/not/exist");
+        if (!PHYSFS_stat(f->path, &statbuf) ||
+            ((io = PHYSFS_openRead(f->path)) == NULL))
+        {
+            fprintf(stderr, "churn: couldn't open %s: %s\n", f->path,
+                    lastError());
+            churnFailed = 1;
+            break;
+        } /* if */
+
+        if (PHYSFS_readBytes(io, buf, sizeof (buf)) < 0)
+        {
+            fprintf(stderr, "churn: couldn't read %s: %s\n", f->path,
+                    lastError());
+            churnFailed = 1;
+        } /* if */
+
+        PHYSFS_close(io);
+        churnOps++;
+    } /* while */
+    return NULL;
+} /* churnMain */
+
+
+/* run (threads) workers for a while, return bytes per second or -1. */
+static double runWorkers(const int threads)
+{
+    pthread_t tids[MAX_THREADS];
+    struct timespec delay;
+    PHYSFS_uint64 bytes = 0;
+    double start, secs;
+    int failed = 0;
+    int i;
+
+    setFlag(stopWorkers, 0);
+    start = now();
+    for (i = 0; i < threads; i++)
+    {
+        workers[i].bytes = 0;
+        if (pthread_create(&tids[i], NULL, workerMain, &workers[i]) != 0)
+        {
+            fprintf(stderr, "couldn't start thread %d\n", i);
+            setFlag(stopWorkers, 1);
+            while (--i >= 0)
+                pthread_join(tids[i], NULL);
+            return -1.0;
+        } /* if */
+    } /* for */
+
+    delay.tv_sec = (time_t) testSeconds;
+    delay.tv_nsec = (long) ((testSeconds - delay.tv_sec) * 1e9);
+    nanosleep(&delay, NULL);
+    setFlag(stopWorkers, 1);
+
+    for (i = 0; i < threads; i++)
+    {
+        pthread_join(tids[i], NULL);
+        bytes += workers[i].bytes;
+        failed |= workers[i].failed;
+    } /* for */
+    secs = now() - start;
+
+    return failed ? -1.0 : (bytes / secs);
+} /* runWorkers */
+
+
+static int setupWorkers(const int threads)
+{
+    int i, j;
+    for (i = 0; i < threads; i++)
+    {
+        Worker *w = &workers[i];
+        w->index = i;
+        w->random = 0x9E3779B9u * (i + 1);
+        w->buf = (PHYSFS_uint8 *) malloc(readSize);
+        if (w->buf == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 0;
+        } /* if */
+
+        for (j = 0; j < numFiles; j++)
+        {
+            w->handles[j] = PHYSFS_openRead(files[j].path);
+            if (w->handles[j] == NULL)
+            {
+                fprintf(stderr, "couldn't open %s: %s\n", files[j].path,
+                        lastError());
+                return 0;
+            } /* if */
+            w->pos[j] = 0;
+        } /* for */
+    } /* for */
+
+    return 1;
+} /* setupWorkers */
+
+static void freeWorkers(const int threads)
+{
+    int i, j;
+    for (i = 0; i < threads; i++)
+    {
+        for (j = 0; j < numFiles; j++)
+        {
+            if (workers[i].handles[j] != NULL)
+                PHYSFS_close(workers[i].handles[j]);
+        } /* for */
+        free(workers[i].buf);
+    } /* for */
+} /* freeWorkers */
+
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+        "USAGE: %s [options] <archive> [path...]\n"
+        "  -t <num>     most threads (default: number of CPUs)\n"
+        "  -b <secs>    time to run each thread count (default: 1)\n"
+        "  -r <bytes>   size of each read (default: 16384)\n"
+        "  -e <ratio>   fail if efficiency at the most threads is lower\n"
+        "  -c           open and close files on another thread meanwhile\n"
+        "Without paths, the %d largest files in the archive are read.\n",
+        argv0, MAX_FILES);
+} /* usage */
+
+int main(int argc, char **argv)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int maxThreads = (cpus < 1) ? 1 : ((cpus > MAX_THREADS) ? MAX_THREADS : (int) cpus);
+    double minEfficiency = 0.0;
+    double efficiency = 1.0;
+    double base = 0.0;
+    const char *archive;
+    pthread_t churn;
+    int useChurn = 0;
+    int loaded = 1;
+    int retval = 1;
+    int threads;
+    int i;
+
+    for (i = 1; (i < argc) && (argv[i][0] == '-'); i++)
+    {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if ((arg[1] == '\0') || (arg[2] != '\0'))
+            break;
+        else if (arg[1] == 'c')
+        {
+            useChurn = 1;
+            continue;
+        } /* else if */
+        else if (val == NULL)
+            break;
+
+        i++;
+        switch (arg[1])
+        {
+            case 't': maxThreads = atoi(val); break;
+            case 'b': testSeconds = atof(val); break;
+            case 'r': readSize = (size_t) atol(val); break;
+            case 'e': minEfficiency = atof(val); break;
+            default: maxThreads = 0; break;
+        } /* switch */
+    } /* for */
+
+    if ((i >= argc) || (maxThreads < 1) || (maxThreads > MAX_THREADS) ||
+        (testSeconds <= 0.0) || (readSize == 0) || (minEfficiency < 0.0))
+    {
+        usage(argv[0]);
+        return 1;
+    } /* if */
+
+    archive = argv[i++];
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init() failed: %s\n", lastError());
+        return 1;
+    } /* if */
+
+    if (!PHYSFS_mount(archive, NULL, 0))
+    {
+        fprintf(stderr, "couldn't mount %s: %s\n", archive, lastError());
+        PHYSFS_deinit();
+        return 1;
+    } /* if */
+
+    if (i < argc)
+    {
+        for (; (i < argc) && (numFiles < MAX_FILES); i++)
+            considerFile(argv[i], 1);  /* real length comes from loadFile. */
+    } /* if */
+    else
+    {
+        PHYSFS_enumerate("", findFiles, NULL);
+    } /* else */
+
+    if (numFiles == 0)
+        fprintf(stderr, "no files to read in %s\n", archive);
+
+    for (i = 0; (i < numFiles) && loaded; i++)
+        loaded = loadFile(&files[i]);
+
+    if ((numFiles > 0) && loaded && setupWorkers(maxThreads))
+    {
+        retval = 0;
+        fprintf(stderr, "reading %d files from %s, %s\n", numFiles, archive,
+                useChurn ? "with churn" : "no churn");
+
+        if (useChurn && (pthread_create(&churn, NULL, churnMain, NULL) != 0))
+        {
+            fprintf(stderr, "couldn't start churn thread\n");
+            useChurn = 0;
+            retval = 1;
+        } /* if */
+
+        printf("threads,value,unit,speedup,efficiency\n");
+        for (threads = 1; (retval == 0) && (threads <= maxThreads); )
+        {
+            const double rate = runWorkers(threads);
+            double speedup;
+
+            if (rate < 0.0)
+            {
+                retval = 1;
+                break;
+            } /* if */
+
+            if (threads == 1)
+                base = rate;
+            speedup = (base > 0.0) ? (rate / base) : 0.0;
+            efficiency = speedup / threads;
+            printf("%d,%.3f,MB/s,%.3f,%.3f\n", threads, rate / 1e6,
+                   speedup, efficiency);
+            fprintf(stderr, "%3d threads: %10.3f MB/s  %6.2fx  %5.1f%%\n",
+                    threads, rate / 1e6, speedup, efficiency * 100.0);
+            fflush(stdout);
+
+            if (threads == maxThreads)
+                break;
+            threads = ((threads * 2) > maxThreads) ? maxThreads : (threads * 2);
+        } /* for */
+
+        if (useChurn)
+        {
+            setFlag(stopChurn, 1);
+            pthread_join(churn, NULL);
+            fprintf(stderr, "churn: %llu open/read/close cycles\n",
+                    (unsigned long long) churnOps);
+            if (churnFailed)
+                retval = 1;
+        } /* if */
+
+        if ((retval == 0) && (efficiency < minEfficiency))
+        {
+            fprintf(stderr, "efficiency %.3f is below %.3f\n",
+                    efficiency, minEfficiency);
+            retval = 1;
+        } /* if */
+    } /* if */
+
+    freeWorkers(maxThreads);
+    for (i = 0; i < numFiles; i++)
+    {
+        free(files[i].path);
+        free(files[i].data);
+    } /* for */
+
+    PHYSFS_deinit();
+    return retval;
+} /* main */
+
+/* end of stress_physfs.c ... */
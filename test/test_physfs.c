@@ -1311,6 +1311,37 @@ static int cmd_stat(char *args)
     return 1;
 } /* cmd_filelength */
 
+static int cmd_statphysical(char *args)
+{
+    PHYSFS_PhysicalStat stat;
+
+    if (*args == '\"')
+    {
+        args++;
+        args[strlen(args) - 1] = '\0';
+    } /* if */
+
+    if (!PHYSFS_statPhysical(args, &stat))
+    {
+        printf("failed to stat. Reason [%s].\n", PHYSFS_getLastError());
+        return 1;
+    } /* if */
+
+    printf("Filename: %s\n", args);
+    printf("Archive: %s\n", stat.archive);
+    printf("Offset: %llu\n", (unsigned long long) stat.offset);
+    printf("Stored size: %llu\n", (unsigned long long) stat.storedsize);
+    printf("Size: %llu\n", (unsigned long long) stat.filesize);
+    printf("Method: %u\n", (unsigned int) stat.method);
+    if (stat.hascrc)
+        printf("CRC-32: 0x%08X\n", (unsigned int) stat.crc);
+    else
+        printf("CRC-32: none\n");
+    printf("Encrypted: %s\n", stat.encrypted ? "true" : "false");
+
+    return 1;
+} /* cmd_statphysical */
+
 
 
 /* must have spaces trimmed prior to this call. */
@@ -1381,6 +1412,7 @@ static const command_info commands[] =
     { "cat2",           cmd_cat2,           2, "<fileToCat1> <fileToCat2>"  },
     { "filelength",     cmd_filelength,     1, "<fileToCheck>"              },
     { "stat",           cmd_stat,           1, "<fileToStat>"               },
+    { "statphysical",   cmd_statphysical,   1, "<fileToStat>"               },
     { "append",         cmd_append,         1, "<fileToAppend>"             },
     { "write",          cmd_write,          1, "<fileToCreateOrTrash>"      },
     { "getlastmodtime", cmd_getlastmodtime, 1, "<fileToExamine>"            },
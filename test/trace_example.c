@@ -0,0 +1,74 @@
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#define PHYSFS_SUPPORTS_TRACE 1
+#include "miniphysfs.h"
+#include "physfs_trace.h"
+#include "physfs_record.h"
+
+/* Mounts an archive, reads every file in it, and writes a Chrome trace,
+   or with -r, an access trace for replay_physfs. */
+
+static void readTree(const char *dir)
+{
+    char **files = PHYSFS_enumerateFiles(dir);
+    char **i;
+    char path[1024];
+    char buf[16384];
+
+    for (i = files; (files != NULL) && (*i != NULL); i++)
+    {
+        PHYSFS_Stat st;
+        snprintf(path, sizeof (path), "%s/%s", dir, *i);
+        if (!PHYSFS_stat(path, &st))
+            continue;
+        else if (st.filetype == PHYSFS_FILETYPE_DIRECTORY)
+            readTree(path);
+        else
+        {
+            PHYSFS_File *f = PHYSFS_openRead(path);
+            if (f != NULL)
+            {
+                while (PHYSFS_readBytes(f, buf, sizeof (buf)) > 0) {}
+                PHYSFS_close(f);
+            }
+        }
+    }
+
+    PHYSFS_freeList(files);
+}
+
+int main(int argc, char **argv) {
+    const int record = (argc > 1) && (strcmp(argv[1], "-r") == 0);
+    const char *in = argv[1 + record];
+    const char *out = (argc > 2 + record) ? argv[2 + record] :
+                      record ? "physfs_access.trace" : "physfs_trace.json";
+
+    if (argc < 2 + record) {
+        printf("USAGE: %s [-r] <archive or dir> [output file]\n", argv[0]);
+        return 1;
+    }
+
+    if(!PHYSFS_init(argv[0])) {
+        printf("PhysFS initialization failed: %s\n", PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return -1;
+    }
+
+    if (record ? !physfs_record_start(out) : !physfs_trace_start(out)) {
+        printf("Failed to start tracing to %s\n", out);
+        PHYSFS_deinit();
+        return -1;
+    }
+
+    if (!PHYSFS_mount(in, NULL, 1))
+        printf("Failed to mount %s: %s\n", in, PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+    else
+        readTree("");
+
+    if (record)
+        physfs_record_stop();
+    else
+        physfs_trace_stop();
+    PHYSFS_deinit();
+    printf("Wrote %s\n", out);
+    return 0;
+}
@@ -0,0 +1,846 @@
+/*
+ * PhysicsFS ZIP index test.
+ *
+ * Builds small ZIP archives in memory, each laid out to hit one corner of
+ *  how a ZIP's entries are indexed at mount: parent directories that only
+ *  the paths under them imply, a directory listed after its children,
+ *  duplicate entries, a file that's also used as a directory, chains of
+ *  symlinks (and a loop, and one that goes nowhere), a Zip64 archive,
+ *  enough files that resolving them at mount takes several threads, and a
+ *  file whose local header is garbage. Each one is mounted from memory and
+ *  checked with stat(), enumeration and reads; the broken ones must fail to
+ *  mount with PHYSFS_ERR_CORRUPT, and the broken file must fail to stat
+ *  and open the same way. Each one is mounted again with
+ *  PHYSFS_setResolveOnMount(), and must check out exactly the same.
+ *
+ * With a (dir), each archive is also written to a new directory under it
+ *  and mounted from there with PHYSFS_setIndexCache(), once to build the
+ *  shared index and again to map it, and must check out the same way.
+ *  Mounted like that, PHYSFS_statPhysical() must report exactly where a
+ *  stored and a deflated file sit in the archive, and their sizes, method
+ *  and CRC, and the bytes there on disk must be theirs. Mounted from
+ *  memory, it must fail as unsupported.
+ *
+ * Reports, as CSV on stdout (archive,mode,entries,mounted,failures), each
+ *  mount. The directory is removed at the end. The exit status is non-zero
+ *  if anything went wrong.
+ *
+ * With a (dir), this needs POSIX (mkdtemp).
+ */
+
+#define PHYSFS_IMPL
+#define PHYSFS_PLATFORM_IMPL
+#include "miniphysfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#define ZIP_FILE 0
+#define ZIP_DIR 1
+#define ZIP_LINK 2
+#define ZIP_DEFLATED 3  /* a file, as a single stored deflate block. */
+
+#define FILE_TIME 0x50216000  /* 2020-01-01 12:00:00, MS-DOS style. */
+#define DIR_TIME 0x52CF0000  /* 2021-06-15 00:00:00. */
+
+typedef struct ZipBuilder
+{
+    PHYSFS_uint8 data[160 * 1024];
+    PHYSFS_uint8 central[96 * 1024];
+    size_t len;
+    size_t centralLen;
+    PHYSFS_uint32 count;
+    PHYSFS_uint32 lastData;  /* where the last entry's data starts. */
+    int zip64;
+} ZipBuilder;
+
+typedef struct ZipCase
+{
+    const char *name;
+    void (*build)(void);
+    void (*check)(void);  /* NULL if it mustn't mount. */
+} ZipCase;
+
+static ZipBuilder zip;
+static const char *currentArchive = "";
+static const char *currentMode = "";
+static const char *currentPath = NULL;  /* the file it's mounted from, if any. */
+static int failures = 0;
+
+
+static void check(const int ok, const char *what, const char *path)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "%s (%s): %s: %s\n", currentArchive, currentMode,
+                path, what);
+        failures++;
+    } /* if */
+} /* check */
+
+
+static const char *lastError(void)
+{
+    return PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode());
+} /* lastError */
+
+
+static PHYSFS_uint32 crc32Of(const PHYSFS_uint8 *buf, size_t len)
+{
+    PHYSFS_uint32 crc = 0xFFFFFFFF;
+    while (len--)
+    {
+        int i;
+        crc ^= *(buf++);
+        for (i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    } /* while */
+    return ~crc;
+} /* crc32Of */
+
+
+static void put16(PHYSFS_uint8 *buf, size_t *len, const PHYSFS_uint32 val)
+{
+    buf[(*len)++] = (PHYSFS_uint8) (val & 0xFF);
+    buf[(*len)++] = (PHYSFS_uint8) ((val >> 8) & 0xFF);
+} /* put16 */
+
+
+static void put32(PHYSFS_uint8 *buf, size_t *len, const PHYSFS_uint32 val)
+{
+    put16(buf, len, val & 0xFFFF);
+    put16(buf, len, (val >> 16) & 0xFFFF);
+} /* put32 */
+
+
+static void put64(PHYSFS_uint8 *buf, size_t *len, const PHYSFS_uint64 val)
+{
+    put32(buf, len, (PHYSFS_uint32) (val & 0xFFFFFFFF));
+    put32(buf, len, (PHYSFS_uint32) (val >> 32));
+} /* put64 */
+
+
+static void putBytes(PHYSFS_uint8 *buf, size_t *len, const void *data,
+                     const size_t datalen)
+{
+    memcpy(buf + *len, data, datalen);
+    *len += datalen;
+} /* putBytes */
+
+
+static void zipBegin(const int zip64)
+{
+    memset(&zip, '\0', sizeof (zip));
+    zip.zip64 = zip64;
+} /* zipBegin */
+
+
+/*
+ * Add an entry. Directories end in '/'. A symlink's (data) is where it
+ *  points. Files in a Zip64 archive keep their sizes in the Zip64 extra
+ *  field, so loading them takes the 64-bit path. A deflated file is a
+ *  single stored deflate block, which any inflater has to decode like the
+ *  rest, so we don't need a compressor.
+ */
+static void zipAdd(const char *name, const void *data, const size_t len,
+                   const int kind, const PHYSFS_uint32 dostime)
+{
+    const int wide = zip.zip64 && (kind == ZIP_FILE);
+    const int deflate = (kind == ZIP_DEFLATED);
+    const PHYSFS_uint32 size32 = wide ? 0xFFFFFFFF : (PHYSFS_uint32) len;
+    const PHYSFS_uint32 stored32 = deflate ? size32 + 5 : size32;
+    const PHYSFS_uint32 crc = crc32Of((const PHYSFS_uint8 *) data, len);
+    const PHYSFS_uint16 needed = wide ? 45 : 20;
+    const PHYSFS_uint32 offset = (PHYSFS_uint32) zip.len;
+    const size_t namelen = strlen(name);
+    PHYSFS_uint32 attr;
+
+    if (kind == ZIP_DIR)
+        attr = (0040755u << 16) | 0x10;
+    else if (kind == ZIP_LINK)
+        attr = 0120777u << 16;
+    else
+        attr = 0100644u << 16;
+
+    put32(zip.data, &zip.len, 0x04034B50);  /* local file header. */
+    put16(zip.data, &zip.len, needed);
+    put16(zip.data, &zip.len, 0);  /* general purpose bits. */
+    put16(zip.data, &zip.len, deflate ? 8 : 0);
+    put32(zip.data, &zip.len, dostime);
+    put32(zip.data, &zip.len, crc);
+    put32(zip.data, &zip.len, stored32);
+    put32(zip.data, &zip.len, size32);
+    put16(zip.data, &zip.len, (PHYSFS_uint32) namelen);
+    put16(zip.data, &zip.len, wide ? 20 : 0);
+    putBytes(zip.data, &zip.len, name, namelen);
+    if (wide)
+    {
+        put16(zip.data, &zip.len, 0x0001);
+        put16(zip.data, &zip.len, 16);
+        put64(zip.data, &zip.len, len);
+        put64(zip.data, &zip.len, len);
+    } /* if */
+    zip.lastData = (PHYSFS_uint32) zip.len;
+    if (deflate)
+    {
+        zip.data[zip.len++] = 1;  /* final block, stored. */
+        put16(zip.data, &zip.len, (PHYSFS_uint32) len);
+        put16(zip.data, &zip.len, (PHYSFS_uint32) ~len);
+    } /* if */
+    putBytes(zip.data, &zip.len, data, len);
+
+    put32(zip.central, &zip.centralLen, 0x02014B50);
+    put16(zip.central, &zip.centralLen, (3 << 8) | 20);  /* made on Unix. */
+    put16(zip.central, &zip.centralLen, needed);
+    put16(zip.central, &zip.centralLen, 0);
+    put16(zip.central, &zip.centralLen, deflate ? 8 : 0);
+    put32(zip.central, &zip.centralLen, dostime);
+    put32(zip.central, &zip.centralLen, crc);
+    put32(zip.central, &zip.centralLen, stored32);
+    put32(zip.central, &zip.centralLen, size32);
+    put16(zip.central, &zip.centralLen, (PHYSFS_uint32) namelen);
+    put16(zip.central, &zip.centralLen, wide ? 20 : 0);
+    put16(zip.central, &zip.centralLen, 0);  /* comment. */
+    put16(zip.central, &zip.centralLen, 0);  /* disk. */
+    put16(zip.central, &zip.centralLen, 0);  /* internal attributes. */
+    put32(zip.central, &zip.centralLen, attr);
+    put32(zip.central, &zip.centralLen, offset);
+    putBytes(zip.central, &zip.centralLen, name, namelen);
+    if (wide)
+    {
+        put16(zip.central, &zip.centralLen, 0x0001);
+        put16(zip.central, &zip.centralLen, 16);
+        put64(zip.central, &zip.centralLen, len);
+        put64(zip.central, &zip.centralLen, len);
+    } /* if */
+
+    zip.count++;
+} /* zipAdd */
+
+
+static void zipAddFile(const char *name, const char *contents)
+{
+    zipAdd(name, contents, strlen(contents), ZIP_FILE, FILE_TIME);
+} /* zipAddFile */
+
+
+static void zipAddLink(const char *name, const char *target)
+{
+    zipAdd(name, target, strlen(target), ZIP_LINK, FILE_TIME);
+} /* zipAddLink */
+
+
+static void zipAddDir(const char *name)
+{
+    zipAdd(name, "", 0, ZIP_DIR, DIR_TIME);
+} /* zipAddDir */
+
+
+/* the central directory and its end records go after everything else. */
+static void zipFinish(void)
+{
+    const PHYSFS_uint64 centralOfs = zip.len;
+    const PHYSFS_uint64 centralLen = zip.centralLen;
+
+    putBytes(zip.data, &zip.len, zip.central, zip.centralLen);
+
+    if (zip.zip64)
+    {
+        const PHYSFS_uint64 endOfs = zip.len;
+        put32(zip.data, &zip.len, 0x06064B50);  /* Zip64 end of central dir. */
+        put64(zip.data, &zip.len, 44);
+        put16(zip.data, &zip.len, (3 << 8) | 45);
+        put16(zip.data, &zip.len, 45);
+        put32(zip.data, &zip.len, 0);
+        put32(zip.data, &zip.len, 0);
+        put64(zip.data, &zip.len, zip.count);
+        put64(zip.data, &zip.len, zip.count);
+        put64(zip.data, &zip.len, centralLen);
+        put64(zip.data, &zip.len, centralOfs);
+
+        put32(zip.data, &zip.len, 0x07064B50);  /* ...and its locator. */
+        put32(zip.data, &zip.len, 0);
+        put64(zip.data, &zip.len, endOfs);
+        put32(zip.data, &zip.len, 1);
+    } /* if */
+
+    put32(zip.data, &zip.len, 0x06054B50);  /* end of central dir. */
+    put16(zip.data, &zip.len, 0);
+    put16(zip.data, &zip.len, 0);
+    put16(zip.data, &zip.len, zip.zip64 ? 0xFFFF : zip.count);
+    put16(zip.data, &zip.len, zip.zip64 ? 0xFFFF : zip.count);
+    put32(zip.data, &zip.len, zip.zip64 ? 0xFFFFFFFF : (PHYSFS_uint32) centralLen);
+    put32(zip.data, &zip.len, zip.zip64 ? 0xFFFFFFFF : (PHYSFS_uint32) centralOfs);
+    put16(zip.data, &zip.len, 0);  /* comment. */
+} /* zipFinish */
+
+
+/* what ZIP_stat() should say for an MS-DOS time, in local time. */
+static PHYSFS_sint64 dosTime(const PHYSFS_uint32 dostime)
+{
+    struct tm t;
+    memset(&t, '\0', sizeof (t));
+    t.tm_year = ((dostime >> 25) & 0x7F) + 80;
+    t.tm_mon = ((dostime >> 21) & 0x0F) - 1;
+    t.tm_mday = (dostime >> 16) & 0x1F;
+    t.tm_hour = (dostime >> 11) & 0x1F;
+    t.tm_min = (dostime >> 5) & 0x3F;
+    t.tm_sec = (dostime << 1) & 0x3E;
+    t.tm_isdst = -1;
+    return (PHYSFS_sint64) mktime(&t);
+} /* dosTime */
+
+
+static void checkContents(const char *path, const void *data, const size_t len)
+{
+    PHYSFS_File *f = PHYSFS_openRead(path);
+    char buf[2048];
+    PHYSFS_sint64 br;
+
+    if (f == NULL)
+    {
+        check(0, lastError(), path);
+        return;
+    } /* if */
+
+    br = PHYSFS_readBytes(f, buf, sizeof (buf));
+    check((br == (PHYSFS_sint64) len) && (memcmp(buf, data, len) == 0),
+          "read the wrong data", path);
+    PHYSFS_close(f);
+} /* checkContents */
+
+
+static void checkFile(const char *path, const void *data, const size_t len)
+{
+    PHYSFS_Stat st;
+    if (!PHYSFS_stat(path, &st))
+        check(0, lastError(), path);
+    else
+    {
+        check(st.filetype == PHYSFS_FILETYPE_REGULAR, "not a file", path);
+        check(st.filesize == (PHYSFS_sint64) len, "wrong size", path);
+        check(st.modtime == dosTime(FILE_TIME), "wrong modtime", path);
+    } /* else */
+    checkContents(path, data, len);
+} /* checkFile */
+
+
+static void checkDir(const char *path, const PHYSFS_sint64 modtime)
+{
+    PHYSFS_Stat st;
+    if (!PHYSFS_stat(path, &st))
+        check(0, lastError(), path);
+    else
+    {
+        check(st.filetype == PHYSFS_FILETYPE_DIRECTORY, "not a directory", path);
+        check(st.modtime == modtime, "wrong modtime", path);
+    } /* else */
+} /* checkDir */
+
+
+static void checkMissing(const char *path)
+{
+    check(!PHYSFS_exists(path), "shouldn't exist", path);
+} /* checkMissing */
+
+
+/* (names) is NULL-terminated; each must be listed once, and nothing else. */
+static void checkList(const char *dir, const char * const *names)
+{
+    char **list = PHYSFS_enumerateFiles(dir);
+    char **i;
+    int expected = 0;
+    int found = 0;
+
+    if (list == NULL)
+    {
+        check(0, lastError(), dir);
+        return;
+    } /* if */
+
+    for (; names[expected] != NULL; expected++)
+    {
+        int seen = 0;
+        for (i = list; *i != NULL; i++)
+            seen += (strcmp(*i, names[expected]) == 0);
+        check(seen == 1, "lists a name the wrong number of times", names[expected]);
+    } /* for */
+
+    for (i = list; *i != NULL; i++)
+        found++;
+    check(found == expected, "lists something it shouldn't", dir);
+    PHYSFS_freeList(list);
+} /* checkList */
+
+
+static void buildImplicit(void)
+{
+    zipBegin(0);
+    zipAddFile("a/b/c.txt", "hello");
+    zipAddFile("a/d.txt", "world");
+    zipAddFile("e/f/g/h.txt", "deep");
+    zipFinish();
+} /* buildImplicit */
+
+static void checkImplicit(void)
+{
+    static const char * const root[] = { "a", "e", NULL };
+    static const char * const a[] = { "b", "d.txt", NULL };
+    static const char * const g[] = { "h.txt", NULL };
+    checkDir("a", 0);  /* filled in, so no time of their own. */
+    checkDir("a/b", 0);
+    checkDir("e/f/g", 0);
+    checkFile("a/b/c.txt", "hello", 5);
+    checkFile("a/d.txt", "world", 5);
+    checkFile("e/f/g/h.txt", "deep", 4);
+    checkList("", root);
+    checkList("a", a);
+    checkList("e/f/g", g);
+    checkMissing("b");
+    checkMissing("a/c.txt");
+    checkMissing("a/b/c.txt/x");
+} /* checkImplicit */
+
+
+static void buildLateDir(void)
+{
+    zipBegin(0);
+    zipAddFile("d/x.txt", "x");
+    zipAddFile("d/sub/y.txt", "yy");
+    zipAddDir("d/sub/");
+    zipAddDir("d/");
+    zipAddDir("empty/");
+    zipFinish();
+} /* buildLateDir */
+
+static void checkLateDir(void)
+{
+    static const char * const root[] = { "d", "empty", NULL };
+    static const char * const d[] = { "x.txt", "sub", NULL };
+    static const char * const empty[] = { NULL };
+    checkDir("d", dosTime(DIR_TIME));  /* the entry's, not a filled-in one. */
+    checkDir("d/sub", dosTime(DIR_TIME));
+    checkDir("empty", dosTime(DIR_TIME));
+    checkFile("d/x.txt", "x", 1);
+    checkFile("d/sub/y.txt", "yy", 2);
+    checkList("", root);
+    checkList("d", d);
+    checkList("empty", empty);
+} /* checkLateDir */
+
+
+static void buildDuplicate(void)
+{
+    zipBegin(0);
+    zipAddFile("one.txt", "1");
+    zipAddFile("dup.txt", "first");
+    zipAddFile("dup.txt", "second");
+    zipFinish();
+} /* buildDuplicate */
+
+
+static void buildDuplicateDir(void)
+{
+    zipBegin(0);
+    zipAddFile("e/x.txt", "x");
+    zipAddDir("e/");
+    zipAddDir("e/");
+    zipFinish();
+} /* buildDuplicateDir */
+
+
+static void buildFileAsDir(void)
+{
+    zipBegin(0);
+    zipAddFile("f", "a file");
+    zipAddFile("f/g", "under a file");
+    zipFinish();
+} /* buildFileAsDir */
+
+
+/* the links come before what they point to, so they can't resolve early. */
+static void buildSymlinks(void)
+{
+    zipBegin(0);
+    zipAddLink("l1", "l2");
+    zipAddLink("l2", "sub/target.txt");
+    zipAddLink("sub/l3", "sub/../l1");  /* targets are from the root. */
+    zipAddLink("loopA", "loopB");
+    zipAddLink("loopB", "loopA");
+    zipAddLink("broken", "nowhere.txt");
+    zipAddFile("sub/target.txt", "the target");
+    zipFinish();
+} /* buildSymlinks */
+
+static void checkSymlinks(void)
+{
+    static const char * const root[] = { "l1", "l2", "sub", "loopA", "loopB", "broken", NULL };
+    PHYSFS_Stat st;
+
+    PHYSFS_permitSymbolicLinks(1);
+    checkFile("sub/target.txt", "the target", 10);
+    checkContents("l2", "the target", 10);
+    checkContents("l1", "the target", 10);
+    checkContents("sub/l3", "the target", 10);
+    check(PHYSFS_stat("l1", &st) && (st.filetype == PHYSFS_FILETYPE_SYMLINK),
+          "not a symlink", "l1");
+    check(PHYSFS_openRead("loopA") == NULL, "a symlink loop opened", "loopA");
+    check(PHYSFS_openRead("broken") == NULL, "a broken symlink opened", "broken");
+    checkList("", root);
+
+    PHYSFS_permitSymbolicLinks(0);
+    check(PHYSFS_openRead("l1") == NULL, "opened with symlinks forbidden", "l1");
+    check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_SYMLINK_FORBIDDEN,
+          "wrong error with symlinks forbidden", "l1");
+} /* checkSymlinks */
+
+
+static PHYSFS_uint8 bigData[1500];
+
+static void buildZip64(void)
+{
+    size_t i;
+    for (i = 0; i < sizeof (bigData); i++)
+        bigData[i] = (PHYSFS_uint8) (i * 7);
+
+    zipBegin(1);
+    zipAdd("big/a.bin", bigData, sizeof (bigData), ZIP_FILE, FILE_TIME);
+    zipAddFile("small.txt", "small");
+    zipAddDir("big/");
+    zipFinish();
+} /* buildZip64 */
+
+static void checkZip64(void)
+{
+    static const char * const root[] = { "big", "small.txt", NULL };
+    static const char * const big[] = { "a.bin", NULL };
+    checkFile("big/a.bin", bigData, sizeof (bigData));
+    checkFile("small.txt", "small", 5);
+    checkDir("big", dosTime(DIR_TIME));
+    checkList("", root);
+    checkList("big", big);
+} /* checkZip64 */
+
+
+/* enough files that resolving them at mount is split across threads. */
+#define MANY_FILES 1100
+
+static void manyName(char *buf, const size_t buflen, const unsigned int i)
+{
+    snprintf(buf, buflen, "many/f%04u.txt", i);
+} /* manyName */
+
+static void buildMany(void)
+{
+    char name[32];
+    char contents[32];
+    unsigned int i;
+
+    zipBegin(0);
+    for (i = 0; i < MANY_FILES; i++)
+    {
+        manyName(name, sizeof (name), i);
+        snprintf(contents, sizeof (contents), "file %u", i);
+        zipAddFile(name, contents);
+    } /* for */
+    zipFinish();
+} /* buildMany */
+
+static void checkMany(void)
+{
+    char **list = PHYSFS_enumerateFiles("many");
+    char name[32];
+    char contents[32];
+    unsigned int i;
+
+    for (i = 0; i < MANY_FILES; i++)
+    {
+        manyName(name, sizeof (name), i);
+        snprintf(contents, sizeof (contents), "file %u", i);
+        checkFile(name, contents, strlen(contents));
+    } /* for */
+
+    if (list == NULL)
+        check(0, lastError(), "many");
+    else
+    {
+        i = 0;
+        while (list[i] != NULL)
+            i++;
+        check(i == MANY_FILES, "lists the wrong number of files", "many");
+        PHYSFS_freeList(list);
+    } /* else */
+} /* checkMany */
+
+
+/* a file whose local header is garbage mounts, but won't open. */
+static void buildBadLocal(void)
+{
+    size_t bad;
+    zipBegin(0);
+    zipAddFile("good.txt", "good");
+    bad = zip.len;
+    zipAddFile("bad.txt", "bad");
+    zipAddFile("after.txt", "after");
+    zipFinish();
+    zip.data[bad] = 'X';  /* not a local header signature anymore. */
+} /* buildBadLocal */
+
+static void checkBadLocal(void)
+{
+    PHYSFS_Stat st;
+    checkFile("good.txt", "good", 4);
+    checkFile("after.txt", "after", 5);
+    check(!PHYSFS_stat("bad.txt", &st), "a broken file stats", "bad.txt");
+    check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_CORRUPT,
+          "a broken file didn't stat as corrupt", "bad.txt");
+    check(PHYSFS_openRead("bad.txt") == NULL, "a broken file opened", "bad.txt");
+    check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_CORRUPT,
+          "a broken file didn't fail as corrupt", "bad.txt");
+} /* checkBadLocal */
+
+
+/* where PHYSFS_statPhysical() must say each file's data is. */
+static PHYSFS_uint8 physicalData[2000];
+static PHYSFS_uint32 storedData;
+static PHYSFS_uint32 deflatedData;
+static PHYSFS_uint32 nestedData;
+
+static void buildPhysical(void)
+{
+    size_t i;
+    for (i = 0; i < sizeof (physicalData); i++)
+        physicalData[i] = (PHYSFS_uint8) (i * 13);
+
+    zipBegin(0);
+    zipAdd("stored.bin", physicalData, sizeof (physicalData), ZIP_FILE, FILE_TIME);
+    storedData = zip.lastData;
+    zipAdd("deflated.bin", physicalData, sizeof (physicalData), ZIP_DEFLATED,
+           FILE_TIME);
+    deflatedData = zip.lastData;
+    zipAddDir("sub/");
+    zipAddFile("sub/nested.txt", "nested");
+    nestedData = zip.lastData;
+    zipFinish();
+} /* buildPhysical */
+
+/* only a mount from a file has a physical location; it's checked on disk. */
+static void checkPhysicalFile(const char *path, const PHYSFS_uint32 offset,
+                              const int method, const void *data,
+                              const size_t len)
+{
+    const size_t storedsize = method ? len + 5 : len;
+    PHYSFS_uint8 buf[4096];
+    PHYSFS_PhysicalStat st;
+    FILE *io;
+
+    if (currentPath == NULL)
+    {
+        check(!PHYSFS_statPhysical(path, &st),
+              "a memory mount has a physical location", path);
+        check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_UNSUPPORTED,
+              "a memory mount didn't fail as unsupported", path);
+        return;
+    } /* if */
+    else if (!PHYSFS_statPhysical(path, &st))
+    {
+        check(0, lastError(), path);
+        return;
+    } /* else if */
+
+    check((st.archive != NULL) && (strcmp(st.archive, currentPath) == 0),
+          "wrong archive", path);
+    check(st.offset == offset, "wrong offset", path);
+    check(st.storedsize == storedsize, "wrong stored size", path);
+    check(st.filesize == len, "wrong file size", path);
+    check(st.method == method, "wrong method", path);
+    check(st.hascrc && (st.crc == crc32Of((const PHYSFS_uint8 *) data, len)),
+          "wrong crc", path);
+    check(!st.encrypted, "encrypted", path);
+
+    /* a deflated file's data is after the stored block's header. */
+    io = fopen(currentPath, "rb");
+    check( (io != NULL) && (fseek(io, (long) st.offset, SEEK_SET) == 0) &&
+           (fread(buf, storedsize, 1, io) == 1) &&
+           (memcmp(buf + (method ? 5 : 0), data, len) == 0),
+           "the data isn't where it says", path);
+    if (io != NULL)
+        fclose(io);
+} /* checkPhysicalFile */
+
+static void checkPhysical(void)
+{
+    PHYSFS_PhysicalStat st;
+    checkFile("stored.bin", physicalData, sizeof (physicalData));
+    checkFile("deflated.bin", physicalData, sizeof (physicalData));
+    checkFile("sub/nested.txt", "nested", 6);
+    checkPhysicalFile("stored.bin", storedData, 0,
+                      physicalData, sizeof (physicalData));
+    checkPhysicalFile("deflated.bin", deflatedData, 8,
+                      physicalData, sizeof (physicalData));
+    checkPhysicalFile("sub/nested.txt", nestedData, 0, "nested", 6);
+    check(!PHYSFS_statPhysical("sub", &st),
+          "a directory has a physical location", "sub");
+    check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_NOT_A_FILE,
+          "a directory didn't fail as not a file", "sub");
+    check(!PHYSFS_statPhysical("missing.bin", &st),
+          "a missing file has a physical location", "missing.bin");
+    check(PHYSFS_getLastErrorCode() == PHYSFS_ERR_NOT_FOUND,
+          "a missing file didn't fail as not found", "missing.bin");
+} /* checkPhysical */
+
+
+static const ZipCase cases[] = {
+    { "implicit.zip", buildImplicit, checkImplicit },
+    { "latedir.zip", buildLateDir, checkLateDir },
+    { "duplicate.zip", buildDuplicate, NULL },
+    { "duplicatedir.zip", buildDuplicateDir, NULL },
+    { "fileasdir.zip", buildFileAsDir, NULL },
+    { "symlinks.zip", buildSymlinks, checkSymlinks },
+    { "zip64.zip", buildZip64, checkZip64 },
+    { "many.zip", buildMany, checkMany },
+    { "badlocal.zip", buildBadLocal, checkBadLocal },
+    { "physical.zip", buildPhysical, checkPhysical }
+};
+
+
+/*
+ * mount what (name) is, check it, and unmount it. The "resolve" mode
+ *  mounts from memory with PHYSFS_setResolveOnMount().
+ */
+static void runCase(const ZipCase *c, const char *mode, const char *path)
+{
+    const int before = failures;
+    int mounted;
+
+    currentArchive = c->name;
+    currentMode = mode;
+
+    currentPath = path;
+
+    PHYSFS_setResolveOnMount(strcmp(mode, "resolve") == 0);
+    if (path == NULL)
+        mounted = PHYSFS_mountMemory(zip.data, zip.len, NULL, c->name, NULL, 1);
+    else
+        mounted = PHYSFS_mount(path, NULL, 1);
+    PHYSFS_setResolveOnMount(0);
+
+    if (c->check == NULL)
+    {
+        check(!mounted, "a broken archive mounted", c->name);
+        check(mounted || (PHYSFS_getLastErrorCode() == PHYSFS_ERR_CORRUPT),
+              "a broken archive didn't fail as corrupt", c->name);
+    } /* if */
+    else if (!mounted)
+        check(0, lastError(), c->name);
+    else
+        c->check();
+
+    if (mounted)
+        PHYSFS_unmount(path ? path : c->name);
+
+    printf("%s,%s,%u,%d,%d\n", c->name, mode, (unsigned int) zip.count,
+           mounted, failures - before);
+} /* runCase */
+
+
+static void removeDir(const char *dir)
+{
+    DIR *dirp = opendir(dir);
+    struct dirent *dent;
+    char path[2048];
+
+    while (dirp && ((dent = readdir(dirp)) != NULL))
+    {
+        if (strcmp(dent->d_name, ".") && strcmp(dent->d_name, ".."))
+        {
+            snprintf(path, sizeof (path), "%s/%s", dir, dent->d_name);
+            remove(path);
+        } /* if */
+    } /* while */
+
+    if (dirp)
+        closedir(dirp);
+    rmdir(dir);
+} /* removeDir */
+
+
+int main(int argc, char **argv)
+{
+    const size_t total = sizeof (cases) / sizeof (cases[0]);
+    char tmpdir[1024];
+    char path[2048];
+    size_t i;
+
+    if (argc > 2)
+    {
+        fprintf(stderr, "USAGE: %s [dir]\n", argv[0]);
+        return 1;
+    } /* if */
+
+    if (argc == 2)
+    {
+        snprintf(tmpdir, sizeof (tmpdir), "%s/zipindex_physfs.XXXXXX", argv[1]);
+        if (mkdtemp(tmpdir) == NULL)
+        {
+            fprintf(stderr, "couldn't make a directory in %s\n", argv[1]);
+            return 1;
+        } /* if */
+    } /* if */
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init() failed: %s\n", lastError());
+        return 1;
+    } /* if */
+    else if ((argc == 2) && (!PHYSFS_setIndexCache(tmpdir)))
+    {
+        fprintf(stderr, "PHYSFS_setIndexCache() failed: %s\n", lastError());
+        return 1;
+    } /* else if */
+
+    printf("archive,mode,entries,mounted,failures\n");
+
+    for (i = 0; i < total; i++)
+    {
+        const ZipCase *c = &cases[i];
+        c->build();
+        runCase(c, "memory", NULL);
+        runCase(c, "resolve", NULL);
+
+        if (argc == 2)
+        {
+            FILE *io;
+            snprintf(path, sizeof (path), "%s/%s", tmpdir, c->name);
+            io = fopen(path, "wb");
+            if ((io == NULL) || (fwrite(zip.data, zip.len, 1, io) != 1))
+            {
+                fprintf(stderr, "couldn't write %s\n", path);
+                failures++;
+            } /* if */
+            if (io != NULL)
+                fclose(io);
+
+            runCase(c, "build", path);
+            runCase(c, "mapped", path);
+        } /* if */
+    } /* for */
+
+    if (!PHYSFS_deinit())
+    {
+        fprintf(stderr, "PHYSFS_deinit() failed: %s\n", lastError());
+        failures++;
+    } /* if */
+
+    if (argc == 2)
+        removeDir(tmpdir);
+
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+} /* main */
+
+/* end of zipindex_physfs.c ... */